@@ -4,13 +4,15 @@
  *
  * Provides VK_KHR_xcb_surface + VK_KHR_xlib_surface + VK_KHR_swapchain for
  * Wine/DXVK on FEX-Emu. Intercepts XCB/Xlib surface creation and emulates
- * swapchain with CPU readback + TCP frame sending to FrameSocketServer on Android.
+ * swapchain with CPU readback + shared-memory frame transport to FrameShmReader
+ * on Android (TCP to FrameSocketServer as a legacy fallback).
  *
  * Rendering pipeline:
  *   Game -> DXVK (DX11->Vulkan) -> winevulkan (win32->xlib/xcb surface)
  *   -> THIS LAYER (xlib/xcb->headless, swapchain->frame capture)
  *   -> ICD (Vortek via FEX thunks -> Mali GPU)
- *   -> TCP 19850 -> FrameSocketServer -> Android SurfaceView
+ *   -> /tmp/headless_frames (shm triple buffer) -> FrameShmReader -> SurfaceView
+ *      (fallback: TCP 19850 -> FrameSocketServer)
  *
  * Why a layer instead of LD_PRELOAD:
  *   Wine's preloader breaks LD_PRELOAD — the guest ld.so cannot open the .so
@@ -41,6 +43,12 @@
 #include <dlfcn.h>
 #include <signal.h>
 #include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/futex.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 /* ============================================================================
  * Section 1: Vulkan Types and Constants (inline, no SDK headers needed)
@@ -55,17 +63,22 @@ typedef uint64_t VkDeviceSize;
 #define VK_SUCCESS 0
 #define VK_INCOMPLETE 5
 #define VK_NOT_READY 1
+#define VK_TIMEOUT 2
 #define VK_SUBOPTIMAL_KHR 1000001003
 #define VK_ERROR_OUT_OF_HOST_MEMORY (-1)
 #define VK_ERROR_INITIALIZATION_FAILED (-3)
 #define VK_ERROR_EXTENSION_NOT_PRESENT (-7)
 #define VK_ERROR_INCOMPATIBLE_DRIVER (-9)
+#define VK_ERROR_OUT_OF_DATE_KHR (-1000001004)
 #define VK_MAX_EXTENSION_NAME_SIZE 256
 
+#define VK_FORMAT_R8G8B8A8_UNORM 37
 #define VK_FORMAT_B8G8R8A8_UNORM 44
 #define VK_COLOR_SPACE_SRGB_NONLINEAR_KHR 0
 #define VK_PRESENT_MODE_FIFO_KHR 2
 #define VK_PRESENT_MODE_IMMEDIATE_KHR 0
+#define VK_PRESENT_MODE_MAILBOX_KHR 1
+#define VK_PRESENT_MODE_FIFO_RELAXED_KHR 3
 
 #define VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR 0x00000001
 #define VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR 0x00000001
@@ -99,6 +112,7 @@ typedef uint64_t VkDeviceSize;
 #define VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO 40
 #define VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO 42
 #define VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER 46
+#define VK_STRUCTURE_TYPE_FENCE_CREATE_INFO 8
 #define VK_BUFFER_USAGE_TRANSFER_DST_BIT 0x00000002
 #define VK_COMMAND_BUFFER_LEVEL_PRIMARY 0
 #define VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT 0x00000002
@@ -117,6 +131,7 @@ typedef uint64_t VkDeviceSize;
 #define VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT 0x00000001
 #define VK_PIPELINE_STAGE_TRANSFER_BIT 0x00001000
 #define VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT 0x00002000
+#define VK_PIPELINE_STAGE_ALL_COMMANDS_BIT 0x00010000
 #define VK_QUEUE_FAMILY_IGNORED 0xFFFFFFFF
 
 typedef int VkResult;
@@ -186,6 +201,10 @@ typedef struct VkCommandBufferBeginInfo_t {
     const void* pInheritanceInfo;
 } VkCommandBufferBeginInfo_t;
 
+typedef struct VkFenceCreateInfo_t {
+    int sType; const void* pNext; VkFlags flags;
+} VkFenceCreateInfo_t;
+
 typedef PFN_vkVoidFunction (*PFN_vkGetInstanceProcAddr)(VkInstance, const char*);
 typedef PFN_vkVoidFunction (*PFN_vkGetDeviceProcAddr)(VkDevice, const char*);
 
@@ -329,6 +348,35 @@ typedef struct VkMemoryAllocateInfo {
     VkDeviceSize allocationSize; uint32_t memoryTypeIndex;
 } VkMemoryAllocateInfo;
 
+/* VK_ANDROID_external_memory_android_hardware_buffer — zero-copy swapchain
+ * images (Section 4d). The AHardwareBuffer is never dereferenced here. */
+#define VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO 1000072001
+#define VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO 1000127001
+#define VK_STRUCTURE_TYPE_ANDROID_HARDWARE_BUFFER_PROPERTIES_ANDROID 1000129001
+#define VK_STRUCTURE_TYPE_IMPORT_ANDROID_HARDWARE_BUFFER_INFO_ANDROID 1000129003
+#define VK_EXTERNAL_MEMORY_HANDLE_TYPE_ANDROID_HARDWARE_BUFFER_BIT_ANDROID 0x00000400
+#define VK_QUEUE_FAMILY_FOREIGN_EXT 0xFFFFFFFD
+struct AHardwareBuffer;
+typedef struct VkExternalMemoryImageCreateInfo {
+    int sType; const void* pNext; VkFlags handleTypes;
+} VkExternalMemoryImageCreateInfo;
+typedef struct VkMemoryDedicatedAllocateInfo {
+    int sType; const void* pNext; VkImage image; VkBuffer buffer;
+} VkMemoryDedicatedAllocateInfo;
+typedef struct VkImportAndroidHardwareBufferInfoANDROID {
+    int sType; const void* pNext; struct AHardwareBuffer* buffer;
+} VkImportAndroidHardwareBufferInfoANDROID;
+typedef struct VkAndroidHardwareBufferPropertiesANDROID {
+    int sType; void* pNext; VkDeviceSize allocationSize; uint32_t memoryTypeBits;
+} VkAndroidHardwareBufferPropertiesANDROID;
+
+#define VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE 6
+typedef struct VkMappedMemoryRange {
+    int sType; const void* pNext;
+    VkDeviceMemory memory; VkDeviceSize offset; VkDeviceSize size;
+} VkMappedMemoryRange;
+#define VK_WHOLE_SIZE (~0ULL)
+
 typedef struct VkMemoryType { uint32_t propertyFlags; uint32_t heapIndex; } VkMemoryType;
 typedef struct VkMemoryHeap { VkDeviceSize size; uint32_t flags; } VkMemoryHeap;
 typedef struct VkPhysicalDeviceMemoryProperties {
@@ -493,13 +541,73 @@ static PFN_vkGetInstanceProcAddr g_next_gipa = NULL;
 static PFN_vkGetDeviceProcAddr g_next_gdpa = NULL;
 
 /* Per-device dispatch table — needed because DXVK creates multiple devices
- * (probe device + real device) and destroying the probe clears globals. */
+ * (probe device + real device) and destroying the probe clears globals.
+ *
+ * Everything the swapchain emulation calls down the chain is resolved once
+ * in headless_CreateDevice, so the acquire/present paths never go through
+ * string-keyed GetDeviceProcAddr lookups. Swapchains keep a pointer to
+ * their device's table. */
+typedef struct LayerDispatch {
+    /* Per-frame (acquire / present / readback) */
+    VkResult (*QueueSubmit)(VkQueue, uint32_t, const VkSubmitInfo*, VkFence);
+    VkResult (*QueueWaitIdle)(VkQueue);
+    VkResult (*QueuePresentKHR)(VkQueue, const VkPresentInfoKHR*);
+    VkResult (*ResetCommandBuffer)(VkCommandBuffer, VkFlags);
+    VkResult (*BeginCommandBuffer)(VkCommandBuffer, const VkCommandBufferBeginInfo_t*);
+    VkResult (*EndCommandBuffer)(VkCommandBuffer);
+    void (*CmdPipelineBarrier)(VkCommandBuffer, VkFlags, VkFlags, VkFlags,
+                               uint32_t, const void*, uint32_t, const void*,
+                               uint32_t, const VkImageMemoryBarrier*);
+    void (*CmdCopyImageToBuffer)(VkCommandBuffer, VkImage, int, VkBuffer,
+                                 uint32_t, const VkBufferImageCopy*);
+    VkResult (*ResetFences)(VkDevice, uint32_t, const VkFence*);
+    VkResult (*WaitForFences)(VkDevice, uint32_t, const VkFence*, VkBool32, uint64_t);
+    VkResult (*InvalidateMappedMemoryRanges)(VkDevice, uint32_t, const VkMappedMemoryRange*);
+    /* Swapchain setup / teardown */
+    VkResult (*MapMemory)(VkDevice, VkDeviceMemory, VkDeviceSize, VkDeviceSize, VkFlags, void**);
+    void (*UnmapMemory)(VkDevice, VkDeviceMemory);
+    VkResult (*CreateImage)(VkDevice, const VkImageCreateInfo*, const VkAllocationCallbacks*, VkImage*);
+    void (*DestroyImage)(VkDevice, VkImage, const VkAllocationCallbacks*);
+    void (*GetImageMemoryRequirements)(VkDevice, VkImage, VkMemoryRequirements*);
+    VkResult (*BindImageMemory)(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize);
+    VkResult (*CreateBuffer)(VkDevice, const VkBufferCreateInfo*, const VkAllocationCallbacks*, VkBuffer*);
+    void (*DestroyBuffer)(VkDevice, VkBuffer, const VkAllocationCallbacks*);
+    void (*GetBufferMemoryRequirements)(VkDevice, VkBuffer, VkMemoryRequirements*);
+    VkResult (*BindBufferMemory)(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize);
+    VkResult (*AllocateMemory)(VkDevice, const VkMemoryAllocateInfo*, const VkAllocationCallbacks*, VkDeviceMemory*);
+    void (*FreeMemory)(VkDevice, VkDeviceMemory, const VkAllocationCallbacks*);
+    VkResult (*CreateCommandPool)(VkDevice, const VkCommandPoolCreateInfo_t*, const VkAllocationCallbacks*, VkCommandPool*);
+    void (*DestroyCommandPool)(VkDevice, VkCommandPool, const VkAllocationCallbacks*);
+    VkResult (*AllocateCommandBuffers)(VkDevice, const VkCommandBufferAllocateInfo_t*, VkCommandBuffer*);
+    VkResult (*CreateFence)(VkDevice, const VkFenceCreateInfo_t*, const VkAllocationCallbacks*, VkFence*);
+    void (*DestroyFence)(VkDevice, VkFence, const VkAllocationCallbacks*);
+    void (*GetDeviceQueue)(VkDevice, uint32_t, uint32_t, VkQueue*);
+    VkResult (*DeviceWaitIdle)(VkDevice);
+    void (*DestroyDevice)(VkDevice, const VkAllocationCallbacks*);
+    /* Zero-copy swapchains (Section 4d); only called on ahb_import devices */
+    VkResult (*GetAndroidHardwareBufferPropertiesANDROID)(VkDevice, const struct AHardwareBuffer*,
+                                                          VkAndroidHardwareBufferPropertiesANDROID*);
+} LayerDispatch;
+
 #define MAX_LAYER_DEVICES 8
-static struct {
-    VkDevice device;
+typedef struct LayerDevice {
+    VkDevice device;                /* NULL = free slot */
+    void* key;                      /* loader dispatch key (shared by its queues/CBs) */
     PFN_vkGetDeviceProcAddr gdpa;
-} g_device_table[MAX_LAYER_DEVICES];
+    LayerDispatch vk;
+    int ahb_import;                 /* AHB import extensions enabled (Section 4d) */
+} LayerDevice;
+static LayerDevice g_device_table[MAX_LAYER_DEVICES];
 static int g_device_count = 0;
+static pthread_mutex_t g_device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Dispatch key → LayerDevice, open addressing with linear probing. Every
+ * dispatchable handle starts with the loader's dispatch pointer, and a
+ * device's queues and command buffers share it, so any of them maps to
+ * its device in O(1). Rebuilt under g_device_lock on create/destroy
+ * (rare); lookups are lock-free and fall back to a table scan. */
+#define DEVICE_MAP_SIZE 32          /* power of two, > 2 * MAX_LAYER_DEVICES */
+static LayerDevice* g_device_map[DEVICE_MAP_SIZE];
 
 /* Diagnostic: Vulkan command buffer interception to find where vkBeginCommandBuffer hangs */
 static PFN_vkBeginCommandBuffer g_real_BeginCmdBuf = NULL;
@@ -563,22 +671,231 @@ static PFN_GetImageFormatProps2 g_real_get_image_format_props2 = NULL;
 #define LOG_TAG "[HeadlessLayer] "
 #define LOG(...) do { fprintf(stderr, LOG_TAG __VA_ARGS__); fflush(stderr); } while(0)
 
-/* File-based debug markers — survives even if stderr is lost */
+/* Per-frame diagnostics: logged for the first FRAME_LOG_FRAMES presents, or
+ * for every frame with HEADLESS_VERBOSE=1. Steady state only hits the trace
+ * ring (Section 3a). */
+#define FRAME_LOG_FRAMES 3
+static int g_verbose = 0;
+static int g_force_invalidate = 0;  /* HEADLESS_STAGING_INVALIDATE=1 */
+static int g_present_count = 0;
+#define FRAME_LOG(...) do { \
+    if (g_verbose || g_present_count <= FRAME_LOG_FRAMES) LOG(__VA_ARGS__); \
+} while(0)
+
+/* File-based debug markers — survives even if stderr is lost.
+ * Used for rare events (instance/device/swapchain setup). Per-call tracing
+ * goes through the binary trace ring below. */
 static void layer_marker(const char* msg) {
     FILE* f = fopen("/tmp/layer_trace.log", "a");
     if (f) { fprintf(f, "%s\n", msg); fclose(f); }
 }
 
+/* ============================================================================
+ * Section 3a: Binary Trace Ring
+ * ============================================================================
+ *
+ * TRACE_FN used to append a text line to /tmp/layer_trace.log on every
+ * intercepted call — open+write+close, three syscalls through FEX per call.
+ * Events now go into a per-thread ring inside a MAP_SHARED file,
+ * /tmp/layer_trace.<pid>.bin: no syscalls on the hot path, and the page
+ * cache keeps the contents when the process dies (SIGABRT, SIGSEGV, kill).
+ *
+ * Layout: TraceFileHeader, then TRACE_MAX_NAMES fixed-size name slots, then
+ * TRACE_MAX_THREADS rings of TRACE_RING_EVENTS events. Each call site
+ * interns its name once (static id); an event is 24 bytes
+ * {timestamp, global sequence, tid, name id, arg}. A thread claims a ring on
+ * its first event; threads beyond TRACE_MAX_THREADS are counted as dropped.
+ *
+ * Decode offline: scripts/decode_layer_trace.py layer_trace.<pid>.bin
+ *
+ * The file is only wanted after a crash, so a clean exit (library
+ * destructor) unlinks it unless it recorded a SIGABRT.
+ *
+ * HEADLESS_TRACE=0 disables the ring, HEADLESS_TRACE=keep keeps the file
+ * after a clean exit too; HEADLESS_TRACE_TEXT=1 additionally writes the old
+ * text lines to /tmp/layer_trace.log (grep-based scripts). */
+
+#define TRACE_MAGIC        0x52544C48  /* "HLTR" little-endian */
+#define TRACE_VERSION      1
+#define TRACE_MAX_NAMES    512
+#define TRACE_NAME_LEN     48
+#define TRACE_MAX_THREADS  64
+#define TRACE_RING_EVENTS  1024        /* power of two */
+
+typedef struct TraceEvent {
+    uint64_t ts_ns;        /* CLOCK_MONOTONIC */
+    uint32_t seq;          /* global order across threads */
+    uint32_t tid;
+    uint16_t name_id;      /* index into the name table, 0 = unused */
+    uint16_t flags;
+    uint32_t arg;          /* call-site specific (result code, image index) */
+} TraceEvent;
+
+typedef struct TraceRing {
+    uint32_t tid;
+    uint32_t reserved;
+    uint64_t head;         /* events ever written; slot = head % RING_EVENTS */
+    TraceEvent ev[TRACE_RING_EVENTS];
+} TraceRing;
+
+typedef struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t name_len;
+    uint32_t max_names;
+    uint32_t max_threads;
+    uint32_t ring_events;
+    uint32_t pid;
+    uint64_t start_ns;
+    uint32_t name_count;
+    uint32_t thread_count;     /* rings claimed (may exceed max_threads) */
+    uint32_t abort_tid;        /* set by the SIGABRT handler */
+    uint32_t abort_seq;
+    uint8_t  reserved[8];
+} TraceFileHeader;             /* 64 bytes */
+
+#define TRACE_FLAG_ABORT 1
+
+static uint8_t* g_trace = NULL;
+static size_t g_trace_size = 0;
+static int g_trace_text = 0;
+static int g_trace_keep = 0;
+static char g_trace_path[64];
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_trace_name_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint32_t g_trace_seq = 0;
+
+static __thread TraceRing* t_trace_ring = NULL;
+static __thread int t_trace_claimed = 0;
+static __thread uint32_t t_trace_tid = 0;
+
+#define TRACE_HDR()   ((TraceFileHeader*)g_trace)
+#define TRACE_NAMES() ((char*)(g_trace + sizeof(TraceFileHeader)))
+#define TRACE_RINGS() ((TraceRing*)(g_trace + sizeof(TraceFileHeader) + \
+                                    TRACE_MAX_NAMES * TRACE_NAME_LEN))
+
+static void trace_open(void) {
+    const char* env = getenv("HEADLESS_TRACE");
+    if (env && env[0] == '0') return;
+    g_trace_keep = env && strcmp(env, "keep") == 0;
+    env = getenv("HEADLESS_TRACE_TEXT");
+    g_trace_text = env && env[0] == '1';
+
+    char* path = g_trace_path;
+    snprintf(path, sizeof(g_trace_path), "/tmp/layer_trace.%d.bin", getpid());
+    size_t size = sizeof(TraceFileHeader) + TRACE_MAX_NAMES * TRACE_NAME_LEN +
+                  TRACE_MAX_THREADS * sizeof(TraceRing);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    if (ftruncate(fd, (off_t)size) != 0) { close(fd); return; }
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return;
+
+    TraceFileHeader* h = (TraceFileHeader*)p;
+    h->version = TRACE_VERSION;
+    h->header_size = sizeof(TraceFileHeader);
+    h->name_len = TRACE_NAME_LEN;
+    h->max_names = TRACE_MAX_NAMES;
+    h->max_threads = TRACE_MAX_THREADS;
+    h->ring_events = TRACE_RING_EVENTS;
+    h->pid = (uint32_t)getpid();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    h->start_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    h->name_count = 1;  /* id 0 is reserved for "unused" */
+    __atomic_store_n(&h->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+
+    g_trace_size = size;
+    __atomic_store_n(&g_trace, (uint8_t*)p, __ATOMIC_RELEASE);
+}
+
+/* Clean exit or unload. The mapping stays: other threads may still emit. */
+__attribute__((destructor))
+static void trace_close(void) {
+    if (!g_trace || g_trace_keep || __atomic_load_n(&TRACE_HDR()->abort_tid, __ATOMIC_ACQUIRE))
+        return;
+    unlink(g_trace_path);
+}
+
+/* Map a call-site name to a stable id. Called once per call site. */
+static uint16_t trace_intern(const char* name) {
+    pthread_once(&g_trace_once, trace_open);
+    if (!g_trace) return 0;
+    uint16_t id = 0;
+    pthread_mutex_lock(&g_trace_name_lock);
+    TraceFileHeader* h = TRACE_HDR();
+    char* names = TRACE_NAMES();
+    for (uint32_t i = 1; i < h->name_count; i++) {
+        if (strncmp(names + i * TRACE_NAME_LEN, name, TRACE_NAME_LEN - 1) == 0) {
+            id = (uint16_t)i;
+            break;
+        }
+    }
+    if (!id && h->name_count < TRACE_MAX_NAMES) {
+        id = (uint16_t)h->name_count;
+        strncpy(names + id * TRACE_NAME_LEN, name, TRACE_NAME_LEN - 1);
+        __atomic_store_n(&h->name_count, h->name_count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_trace_name_lock);
+    return id;
+}
+
+static TraceRing* trace_claim_ring(void) {
+    t_trace_claimed = 1;
+    t_trace_tid = (uint32_t)syscall(SYS_gettid);
+    uint32_t idx = __atomic_fetch_add(&TRACE_HDR()->thread_count, 1, __ATOMIC_RELAXED);
+    if (idx >= TRACE_MAX_THREADS) return NULL;
+    TraceRing* r = &TRACE_RINGS()[idx];
+    r->tid = t_trace_tid;
+    return r;
+}
+
+static inline void trace_emit(uint16_t id, uint32_t arg, uint16_t flags) {
+    if (!id || !g_trace) return;
+    if (!t_trace_claimed) t_trace_ring = trace_claim_ring();
+    TraceRing* r = t_trace_ring;
+    if (!r) return;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    TraceEvent* e = &r->ev[r->head & (TRACE_RING_EVENTS - 1)];
+    e->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    e->seq = __atomic_add_fetch(&g_trace_seq, 1, __ATOMIC_RELAXED);
+    e->tid = t_trace_tid;
+    e->name_id = id;
+    e->flags = flags;
+    e->arg = arg;
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/* Record a named event with a 32-bit argument. */
+#define TRACE_POINT(name, arg) do { \
+    static uint16_t _trace_id; \
+    if (!_trace_id) _trace_id = trace_intern(name); \
+    trace_emit(_trace_id, (uint32_t)(arg), 0); \
+    if (g_trace_text) { \
+        char _tb[160]; snprintf(_tb, sizeof(_tb), "%s %u", name, (unsigned)(arg)); \
+        layer_marker(_tb); \
+    } \
+} while(0)
+
 /* Global call tracker — identifies last Vulkan function called before crash */
 static volatile const char* g_last_fn = "none";
 static volatile int g_call_seq = 0;
 
 #define TRACE_FN(name) do { \
+    static uint16_t _trace_id; \
     g_last_fn = name; \
     int _seq = __sync_add_and_fetch(&g_call_seq, 1); \
-    long _tid = syscall(SYS_gettid); \
-    char _tb[160]; snprintf(_tb, sizeof(_tb), "[%d] T%ld " name, _seq, _tid); \
-    layer_marker(_tb); \
+    if (!_trace_id) _trace_id = trace_intern(name); \
+    trace_emit(_trace_id, (uint32_t)_seq, 0); \
+    if (g_trace_text) { \
+        char _tb[160]; snprintf(_tb, sizeof(_tb), "[%d] T%ld " name, _seq, \
+                                (long)syscall(SYS_gettid)); \
+        layer_marker(_tb); \
+    } \
 } while(0)
 
 /* SIGABRT handler — Wine's _wassert calls abort() which raises SIGABRT.
@@ -596,14 +913,25 @@ static volatile int g_call_seq = 0;
  * Risk: Thread 0090 might hold Wine locks. If so, other threads will
  * deadlock on those locks. But empirically, the game progresses further
  * than it does with the assertion killing the whole process. */
+static uint16_t g_trace_abort_id = 0;   /* interned in layer_init */
+
 static void sigabrt_handler(int sig) {
     (void)sig;
     long tid = syscall(SYS_gettid);
+    /* Mark the abort in the trace ring; this thread's preceding events show
+     * the call that failed. Only async-signal-safe work in trace_emit. */
+    trace_emit(g_trace_abort_id, (uint32_t)g_call_seq, TRACE_FLAG_ABORT);
+    if (g_trace) {
+        TRACE_HDR()->abort_seq = (uint32_t)g_call_seq;
+        __atomic_store_n(&TRACE_HDR()->abort_tid, (uint32_t)tid, __ATOMIC_RELEASE);
+    }
     FILE* f = fopen("/tmp/vk_abort_info.log", "a");
     if (f) {
         fprintf(f, "SIGABRT caught on thread %ld! Killing ONLY this thread.\n", tid);
         fprintf(f, "Last Vulkan function: %s\n", (const char*)g_last_fn);
         fprintf(f, "Call sequence: %d\n", g_call_seq);
+        if (g_trace)
+            fprintf(f, "Trace ring: /tmp/layer_trace.%d.bin\n", getpid());
         fclose(f);
     }
     /* Log to stderr too */
@@ -615,16 +943,95 @@ static void sigabrt_handler(int sig) {
     syscall(SYS_exit, 0);
 }
 
+/* ============================================================================
+ * Section 4a: Frame Copy Kernels (copy + force alpha in one pass)
+ * ============================================================================
+ *
+ * DXVK doesn't write swapchain alpha (irrelevant on desktop), but our
+ * readback captures it as transparent. Instead of a separate byte loop over
+ * the mapped staging memory, the alpha is ORed in while copying into the
+ * transport buffer, so each pixel is read and written exactly once.
+ * The widest kernel the (FEX-reported) CPU supports is picked at load time;
+ * FEX translates SSE2/AVX2 to NEON on the host. */
+
+typedef void (*PFN_copy_alpha_row)(uint32_t* dst, const uint32_t* src, size_t n);
+
+static void copy_alpha_row_scalar(uint32_t* dst, const uint32_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i] | 0xFF000000u;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse2")))
+static void copy_alpha_row_sse2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m128i a = _mm_set1_epi32((int)0xFF000000u);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(p0, a));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_or_si128(p1, a));
+    }
+    copy_alpha_row_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void copy_alpha_row_avx2(uint32_t* dst, const uint32_t* src, size_t n) {
+    const __m256i a = _mm256_set1_epi32((int)0xFF000000u);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i p0 = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i p1 = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(p0, a));
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_or_si256(p1, a));
+    }
+    copy_alpha_row_scalar(dst + i, src + i, n - i);
+}
+#endif
+
+static PFN_copy_alpha_row g_copy_alpha_row = copy_alpha_row_scalar;
+
+static void select_copy_kernel(void) {
+    const char* name = "scalar";
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_copy_alpha_row = copy_alpha_row_avx2;
+        name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        g_copy_alpha_row = copy_alpha_row_sse2;
+        name = "sse2";
+    }
+#endif
+    LOG("Frame copy kernel: %s\n", name);
+}
+
+/* Copy a BGRA frame into a tightly packed destination with alpha=0xFF.
+ * Handles a source pitch wider than the row (one pass, no repack step). */
+static void copy_frame_alpha(void* dst, const void* src, uint32_t width,
+                             uint32_t height, size_t src_pitch) {
+    size_t row = (size_t)width * 4;
+    if (src_pitch == row) {
+        g_copy_alpha_row((uint32_t*)dst, (const uint32_t*)src, (size_t)width * height);
+        return;
+    }
+    uint8_t* d = dst;
+    const uint8_t* s = src;
+    for (uint32_t y = 0; y < height; y++) {
+        g_copy_alpha_row((uint32_t*)d, (const uint32_t*)s, width);
+        d += row;
+        s += src_pitch;
+    }
+}
+
 /* ============================================================================
  * Section 4: TCP Frame Socket (frame capture → FrameSocketServer)
  * ============================================================================ */
 
 #define FRAME_SOCKET_PORT 19850
-#define TARGET_FRAME_NS (8333333ULL)  /* ~120 FPS */
 
 static int g_frame_socket = -1;
 static int g_frame_connected = 0;
-static uint64_t g_last_present_ns = 0;
 
 static uint8_t* g_pending_buf = NULL;
 static size_t g_pending_cap = 0;
@@ -634,7 +1041,7 @@ static size_t g_pending_sent = 0;
 /* Dump mode: write first N presented frames as PPM files to /tmp/ */
 static int g_dump_max_frames = 0;   /* 0=disabled, >0=dump first N frames */
 static int g_dump_frame_count = 0;  /* frames dumped so far */
-static int g_dump_mode = 0;         /* 1=active (skip TCP) */
+static int g_dump_mode = 0;         /* 1=active (skip frame transport) */
 static FILE* g_dump_summary = NULL; /* /tmp/frame_summary.txt */
 
 static uint64_t get_time_ns(void) {
@@ -705,7 +1112,6 @@ static void send_frame(uint32_t width, uint32_t height, const void* pixels, size
         if (r == 0) return; /* drop frame */
     }
 
-    size_t expected_pitch = width * 4;
     size_t pixel_size = width * height * 4;
     size_t frame_size = 8 + pixel_size;
 
@@ -717,24 +1123,498 @@ static void send_frame(uint32_t width, uint32_t height, const void* pixels, size
 
     uint32_t header[2] = { width, height };
     memcpy(g_pending_buf, header, 8);
-
-    if (row_pitch == expected_pitch) {
-        memcpy(g_pending_buf + 8, pixels, pixel_size);
-    } else {
-        uint8_t* dst = g_pending_buf + 8;
-        const uint8_t* src = pixels;
-        for (uint32_t y = 0; y < height; y++) {
-            memcpy(dst, src, expected_pitch);
-            dst += expected_pitch;
-            src += row_pitch;
-        }
-    }
+    copy_frame_alpha(g_pending_buf + 8, pixels, width, height, row_pitch);
 
     g_pending_total = frame_size;
     g_pending_sent = 0;
     if (drain_pending() < 0) disconnect_frame_socket();
 }
 
+/* ============================================================================
+ * Section 4b: Shared-Memory Frame Transport (frame capture → FrameShmReader)
+ * ============================================================================
+ *
+ * FRAME_SHM_PATH is a plain file in the guest /tmp, which is the rootfs tmp
+ * dir on the Android side, so the layer and FrameShmReader map the same
+ * page-cache pages and no frame data crosses a socket. Layout must match
+ * app/src/main/cpp/frame_shm.h:
+ *
+ *   [0, FRAME_SHM_HEADER_SIZE)            FrameShmHeader (+ slot descriptors)
+ *   [HEADER_SIZE + i*slot_size, +slot)    pixels of slot i, tightly packed
+ *
+ * Triple buffer: the writer fills a slot that is neither `latest` nor the
+ * reader's `reader_slot`, then publishes it by storing `latest` and bumping
+ * `frame_seq` with release semantics. Each slot also carries a seqlock
+ * counter (odd while being written) so the reader can detect the rare race
+ * where a slot it picked is recycled mid-copy and drop that frame.
+ *
+ * A writer that needs bigger slots (or finds a stale file from an earlier
+ * run) marks the old file `closed` and replaces it; the reader remaps.
+ * Process exit and library unload mark it `closed` and unlink it as well
+ * (vkDestroyInstance is deliberately not intercepted, see GIPA). */
+
+#define FRAME_SHM_PATH "/tmp/headless_frames"
+#define FRAME_SHM_MAGIC 0x4D524648u   /* "HFRM" little-endian */
+#define FRAME_SHM_VERSION 2
+#define FRAME_SHM_SLOTS 3
+#define FRAME_SHM_HEADER_SIZE 4096
+#define FRAME_SHM_NO_SLOT 0xFFFFFFFFu
+
+typedef struct FrameShmSlot {
+    uint64_t seq;           /* seqlock: odd while the writer owns the slot */
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;        /* bytes per row */
+    uint32_t format;        /* VkFormat of the pixels */
+    uint64_t frame_seq;     /* header frame_seq this slot was published as */
+} FrameShmSlot;
+
+typedef struct FrameShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_count;
+    uint64_t slot_size;
+    uint64_t frame_seq;     /* bumped on every publish */
+    uint32_t latest;        /* newest complete slot, FRAME_SHM_NO_SLOT if none */
+    uint32_t reader_slot;   /* slot the reader is copying (reader-owned) */
+    uint32_t writer_pid;
+    uint32_t closed;        /* writer abandoned this file, reader must remap */
+    uint64_t target_interval_ns; /* reader's display refresh period, 0 = unknown (reader-owned) */
+    uint8_t reserved[8];
+    FrameShmSlot slots[FRAME_SHM_SLOTS];
+} FrameShmHeader;
+
+static FrameShmHeader* g_shm = NULL;
+static size_t g_shm_map_size = 0;
+static int g_shm_disabled = 0;      /* HEADLESS_FRAME_TRANSPORT=tcp or open failed */
+/* Display refresh period last published by a reader (shm or AHB header), 0 if
+ * none. Copied out on the present thread, which is the only one that remaps,
+ * so the pacer in vkAcquireNextImageKHR never touches a mapping. */
+static uint64_t g_display_interval_ns = 0;
+static dev_t g_shm_dev;
+static ino_t g_shm_ino;
+
+static void shm_close_transport(void) {
+    if (!g_shm) return;
+    __atomic_store_n(&g_shm->closed, 1, __ATOMIC_RELEASE);
+    munmap(g_shm, g_shm_map_size);
+    g_shm = NULL;
+    g_shm_map_size = 0;
+    /* Only our own file: another process may already have replaced it */
+    struct stat st;
+    if (stat(FRAME_SHM_PATH, &st) == 0 && st.st_dev == g_shm_dev && st.st_ino == g_shm_ino)
+        unlink(FRAME_SHM_PATH);
+}
+
+__attribute__((destructor))
+static void shm_unload(void) {
+    shm_close_transport();
+}
+
+/* (Re)create FRAME_SHM_PATH with slots of at least `slot_bytes` each */
+static int shm_open_transport(size_t slot_bytes) {
+    slot_bytes = (slot_bytes + 4095) & ~(size_t)4095;
+    size_t total = FRAME_SHM_HEADER_SIZE + FRAME_SHM_SLOTS * slot_bytes;
+
+    /* Tell a reader still mapping an older file (ours or a previous run's)
+     * to let go of it before we unlink it */
+    shm_close_transport();
+    int old = open(FRAME_SHM_PATH, O_RDWR);
+    if (old >= 0) {
+        struct stat st;
+        if (fstat(old, &st) == 0 && (size_t)st.st_size >= sizeof(FrameShmHeader)) {
+            FrameShmHeader* oh = mmap(NULL, sizeof(FrameShmHeader),
+                                      PROT_READ | PROT_WRITE, MAP_SHARED, old, 0);
+            if (oh != MAP_FAILED) {
+                __atomic_store_n(&oh->closed, 1, __ATOMIC_RELEASE);
+                munmap(oh, sizeof(FrameShmHeader));
+            }
+        }
+        close(old);
+    }
+    unlink(FRAME_SHM_PATH);
+
+    int fd = open(FRAME_SHM_PATH, O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (fd < 0) {
+        LOG("shm: open(%s) failed: %s\n", FRAME_SHM_PATH, strerror(errno));
+        return 0;
+    }
+    fchmod(fd, 0660);  /* past the umask; the reader shares our uid */
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        g_shm_dev = st.st_dev;
+        g_shm_ino = st.st_ino;
+    }
+    if (ftruncate(fd, (off_t)total) != 0) {
+        LOG("shm: ftruncate(%zu) failed: %s\n", total, strerror(errno));
+        close(fd);
+        unlink(FRAME_SHM_PATH);
+        return 0;
+    }
+    void* p = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LOG("shm: mmap(%zu) failed: %s\n", total, strerror(errno));
+        unlink(FRAME_SHM_PATH);
+        return 0;
+    }
+
+    FrameShmHeader* h = (FrameShmHeader*)p;
+    h->version = FRAME_SHM_VERSION;
+    h->header_size = FRAME_SHM_HEADER_SIZE;
+    h->slot_count = FRAME_SHM_SLOTS;
+    h->slot_size = slot_bytes;
+    h->latest = FRAME_SHM_NO_SLOT;
+    h->reader_slot = FRAME_SHM_NO_SLOT;
+    h->writer_pid = (uint32_t)getpid();
+    /* magic last: the reader treats the file as valid only once it is set */
+    __atomic_store_n(&h->magic, FRAME_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    g_shm = h;
+    g_shm_map_size = total;
+    LOG("shm: %s ready, %d slots x %zu bytes\n", FRAME_SHM_PATH, FRAME_SHM_SLOTS, slot_bytes);
+    return 1;
+}
+
+/* Copy one frame (alpha forced) into a free slot and publish it. Never blocks on the
+ * reader: with three slots there is always one that is neither the newest
+ * published frame nor the one being read. Returns 0 if shm is unavailable. */
+static int shm_send_frame(uint32_t width, uint32_t height, const void* pixels,
+                          size_t row_pitch, uint32_t format) {
+    if (g_shm_disabled) return 0;
+    size_t stride = (size_t)width * 4;
+    size_t need = stride * height;
+    if (!g_shm || g_shm->slot_size < need) {
+        if (!shm_open_transport(need)) {
+            g_shm_disabled = 1;
+            LOG("shm: transport unavailable, falling back to TCP\n");
+            return 0;
+        }
+    }
+
+    FrameShmHeader* h = g_shm;
+    uint32_t latest = __atomic_load_n(&h->latest, __ATOMIC_ACQUIRE);
+    uint32_t busy = __atomic_load_n(&h->reader_slot, __ATOMIC_ACQUIRE);
+    uint32_t s = 0;
+    while (s == latest || s == busy) s++;
+
+    FrameShmSlot* slot = &h->slots[s];
+    uint64_t lock = slot->seq + 1;                 /* odd: writing */
+    __atomic_store_n(&slot->seq, lock, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint8_t* dst = (uint8_t*)h + h->header_size + (size_t)s * h->slot_size;
+    copy_frame_alpha(dst, pixels, width, height, row_pitch);
+    slot->width = width;
+    slot->height = height;
+    slot->stride = (uint32_t)stride;
+    slot->format = format;
+    slot->frame_seq = h->frame_seq + 1;
+    __atomic_store_n(&slot->seq, lock + 1, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&h->latest, s, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->frame_seq, slot->frame_seq, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_display_interval_ns,
+                     __atomic_load_n(&h->target_interval_ns, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    return 1;
+}
+
+/* Deliver a captured frame: shared memory first, TCP as fallback */
+static void publish_frame(uint32_t width, uint32_t height, const void* pixels,
+                          size_t row_pitch, uint32_t format) {
+    if (shm_send_frame(width, height, pixels, row_pitch, format)) return;
+    send_frame(width, height, pixels, row_pitch);
+}
+
+/* ============================================================================
+ * Section 4c: Frame Pacing
+ * ============================================================================
+ *
+ * A headless swapchain has no display to throttle it, so the layer plays the
+ * presentation engine's clock. A FIFO swapchain releases one image per display
+ * refresh: vkAcquireNextImageKHR sleeps until the swapchain's next deadline,
+ * which advances by one interval per acquire. Deadlines are absolute
+ * (clock_nanosleep TIMER_ABSTIME), so oversleeping one frame shortens the
+ * next wait instead of shifting every later frame; a swapchain that falls
+ * more than an interval behind restarts from now rather than bursting to
+ * catch up. FIFO_RELAXED restarts from now as soon as a frame is late at
+ * all, so a late frame goes out at once and the next waits a full interval.
+ * Waiting in acquire puts the sleep before the game's CPU work for
+ * the frame instead of after the readback, where it only added latency.
+ *
+ * MAILBOX and IMMEDIATE are not throttled: the shm triple buffer already
+ * behaves like a mailbox (the reader takes the newest slot, the writer never
+ * waits) and without scanout there is nothing to tear.
+ *
+ * The interval is the display refresh period the reader (shm header) or the
+ * zero-copy presenter (AHB header) published, as of the last present; until
+ * one has, PACE_DEFAULT_INTERVAL_NS applies. Frames going out over TCP have
+ * no reader to report a rate and are not paced. */
+
+#define PACE_DEFAULT_INTERVAL_NS (8333333ULL)    /* ~120 Hz */
+#define PACE_MIN_INTERVAL_NS     (2000000ULL)    /* 500 Hz */
+#define PACE_MAX_INTERVAL_NS     (100000000ULL)  /* 10 Hz */
+
+typedef struct FramePacer {
+    int mode;                   /* VkPresentModeKHR the swapchain was created with */
+    uint64_t deadline_ns;       /* CLOCK_MONOTONIC release time of the next FIFO image */
+} FramePacer;
+
+/* 0: do not pace */
+static uint64_t pace_interval_ns(int zero_copy) {
+    uint64_t ns = __atomic_load_n(&g_display_interval_ns, __ATOMIC_RELAXED);
+    if (ns >= PACE_MIN_INTERVAL_NS && ns <= PACE_MAX_INTERVAL_NS) return ns;
+    if (!zero_copy && __atomic_load_n(&g_shm_disabled, __ATOMIC_RELAXED)) return 0;
+    return PACE_DEFAULT_INTERVAL_NS;
+}
+
+static void pace_sleep_until(uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline_ns / 1000000000ULL);
+    ts.tv_nsec = (long)(deadline_ns % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+/* Wait for the swapchain's next image release. Follows vkAcquireNextImageKHR's
+ * timeout rules: VK_NOT_READY (timeout 0) or VK_TIMEOUT if the release is
+ * further away than `timeout`, in which case the release is not consumed. */
+static VkResult pace_acquire(FramePacer* p, int zero_copy, uint64_t timeout) {
+    if (p->mode != VK_PRESENT_MODE_FIFO_KHR && p->mode != VK_PRESENT_MODE_FIFO_RELAXED_KHR)
+        return VK_SUCCESS;
+
+    uint64_t interval = pace_interval_ns(zero_copy);
+    if (interval == 0) return VK_SUCCESS;
+    uint64_t now = get_time_ns();
+    uint64_t deadline = p->deadline_ns;
+    uint64_t slack = p->mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR ? 0 : interval;
+    if (deadline + slack < now) deadline = now;  /* first acquire, or late (FIFO: a frame or more) */
+    if (deadline > now) {
+        if (timeout == 0) return VK_NOT_READY;
+        if (timeout < deadline - now) {
+            pace_sleep_until(now + timeout);
+            return VK_TIMEOUT;
+        }
+        pace_sleep_until(deadline);
+    }
+    p->deadline_ns = deadline + interval;
+    return VK_SUCCESS;
+}
+
+/* ============================================================================
+ * Section 4d: Zero-Copy Presentation (AHardwareBuffer swapchain images)
+ * ============================================================================
+ *
+ * The readback path costs a GPU copy plus two CPU copies per frame (staging
+ * → shm slot, slot → Bitmap) before the canvas blit. When the app runs its
+ * AhbPresenter, a swapchain can instead be backed by AHardwareBuffers the
+ * presenter allocated: the layer imports them as the swapchain images, the
+ * game renders straight into them, and the presenter posts the same buffers
+ * to the SurfaceView through ASurfaceControl. No pixel is touched by a CPU.
+ *
+ * The buffer handles are pointers in the app process, which is also where
+ * the Vortek renderer that executes our Vulkan calls lives, so the layer
+ * passes them through VkImportAndroidHardwareBufferInfoANDROID without ever
+ * dereferencing them. That needs the driver chain below us to expose
+ * VK_ANDROID_external_memory_android_hardware_buffer; if it does not, if the
+ * presenter is not running, or if the swapchain format is not R8G8B8A8, the
+ * swapchain uses the readback path as before.
+ *
+ * AHB_SHM_PATH is created by the presenter; layout must match
+ * app/src/main/cpp/ahb_shm.h. Slot i is swapchain image i:
+ *
+ *   FREE     → ACQUIRED   layer, vkAcquireNextImageKHR
+ *   ACQUIRED → QUEUED     layer, once the present's GPU work has completed
+ *   QUEUED   → POSTED     presenter, buffer handed to SurfaceFlinger
+ *   QUEUED   → FREE       presenter, superseded by a newer frame
+ *   POSTED   → FREE       presenter, once the buffer's release fence signals
+ *
+ * queue_seq and free_seq are futex words (shared, not private: the file is
+ * mapped by two processes), so neither side spins. Only one swapchain owns
+ * the slots at a time; the presenter answers one buffer request at a time.
+ *
+ * HEADLESS_ZERO_COPY=0 disables the path. */
+
+#define AHB_SHM_PATH "/tmp/headless_ahb"
+#define AHB_SHM_MAGIC 0x42484148u   /* "HAHB" little-endian */
+#define AHB_SHM_VERSION 2
+#define AHB_SHM_SLOTS 8
+
+#define AHB_SLOT_FREE 0u
+#define AHB_SLOT_ACQUIRED 1u
+#define AHB_SLOT_QUEUED 2u
+#define AHB_SLOT_POSTED 3u
+
+#define AHB_FORMAT_R8G8B8A8_UNORM 1
+#define AHB_MIN_IMAGES 3                      /* one on screen, one queued, one rendering */
+#define AHB_GRANT_TIMEOUT_NS (500000000ULL)
+#define AHB_STALL_NS (1000000000ULL)          /* no buffer released for this long: reclaim */
+
+typedef struct AhbShmSlot {
+    uint64_t buffer;        /* AHardwareBuffer* in the app process, opaque here */
+    uint32_t state;         /* AHB_SLOT_* */
+    uint32_t reserved0;
+    uint64_t frame_seq;     /* present sequence when the slot was queued */
+    uint64_t reserved1;
+} AhbShmSlot;
+
+typedef struct AhbShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t presenter_pid;
+    uint32_t ready;         /* presenter has a surface to post to (presenter-owned) */
+    uint32_t width;         /* buffer request (layer-owned); count 0 releases */
+    uint32_t height;
+    uint32_t format;        /* AHardwareBuffer format */
+    uint32_t count;
+    uint64_t request_seq;   /* bumped once the request is filled in */
+    uint64_t grant_seq;     /* = request_seq once slots[] answer it (presenter-owned) */
+    int32_t grant_status;   /* 0 = slots[0, count) hold buffers, < 0 = failed */
+    uint32_t layer_pid;     /* process whose swapchain owns the slots */
+    uint32_t queue_seq;     /* futex: bumped + woken by us after queueing a slot */
+    uint32_t free_seq;      /* futex: bumped + woken by the presenter after freeing one */
+    uint64_t target_interval_ns; /* presenter's display refresh period, 0 = unknown (presenter-owned) */
+    AhbShmSlot slots[AHB_SHM_SLOTS];
+} AhbShmHeader;
+
+static AhbShmHeader* g_ahb = NULL;
+static uint32_t g_ahb_epoch = 0;    /* bumped on every (re)map; swapchains from an older mapping are stale */
+static int g_zero_copy = 1;         /* HEADLESS_ZERO_COPY=0 clears */
+
+static void ahb_futex_wake(uint32_t* addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+static void ahb_futex_wait(uint32_t* addr, uint32_t expected, uint64_t timeout_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(timeout_ns / 1000000000ULL);
+    ts.tv_nsec = (long)(timeout_ns % 1000000000ULL);
+    syscall(SYS_futex, addr, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+/* Map the presenter's file, or remap it if the presenter was restarted
+ * (it recreates the file and clears magic in the old one). */
+static AhbShmHeader* ahb_map(void) {
+    if (g_ahb && __atomic_load_n(&g_ahb->magic, __ATOMIC_ACQUIRE) == AHB_SHM_MAGIC)
+        return g_ahb;
+    if (g_ahb) {
+        munmap(g_ahb, sizeof(AhbShmHeader));
+        g_ahb = NULL;
+    }
+
+    int fd = open(AHB_SHM_PATH, O_RDWR);
+    if (fd < 0) return NULL;
+    struct stat st;
+    AhbShmHeader* h = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(AhbShmHeader))
+        h = mmap(NULL, sizeof(AhbShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) return NULL;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != AHB_SHM_MAGIC ||
+        h->version != AHB_SHM_VERSION) {
+        munmap(h, sizeof(AhbShmHeader));
+        return NULL;
+    }
+    g_ahb = h;
+    g_ahb_epoch++;
+    LOG("ahb: mapped %s (presenter pid %u)\n", AHB_SHM_PATH, h->presenter_pid);
+    return h;
+}
+
+/* The presenter behind mapping h stopped or died: its buffers are gone */
+static int ahb_presenter_gone(const AhbShmHeader* h) {
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != AHB_SHM_MAGIC) return 1;
+    return kill((pid_t)h->presenter_pid, 0) != 0 && errno == ESRCH;
+}
+
+/* The presenter behind mapping h is showing frames (it has a surface) */
+static int ahb_presenter_alive(const AhbShmHeader* h) {
+    return __atomic_load_n(&h->ready, __ATOMIC_ACQUIRE) && !ahb_presenter_gone(h);
+}
+
+/* A presenter is running and has a surface to post to */
+static int ahb_presenter_ready(void) {
+    AhbShmHeader* h = ahb_map();
+    return h && ahb_presenter_alive(h);
+}
+
+/* Tell the presenter our imports are gone; it drops its buffers. No wait. */
+static void ahb_release(void) {
+    AhbShmHeader* h = g_ahb;
+    uint32_t self = (uint32_t)getpid();
+    if (!h || __atomic_load_n(&h->layer_pid, __ATOMIC_ACQUIRE) != self) return;
+    h->count = 0;
+    __atomic_add_fetch(&h->request_seq, 1, __ATOMIC_ACQ_REL);
+    __atomic_compare_exchange_n(&h->layer_pid, &self, 0u, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* Ask the presenter for `count` buffers and wait for its answer. Once
+ * granted the slots belong to this process; another process's swapchain
+ * keeps them only while that process is alive. A timed-out or failed
+ * request gives them up again. */
+static int ahb_request(uint32_t width, uint32_t height, uint32_t format, uint32_t count) {
+    AhbShmHeader* h = ahb_map();
+    if (!h) return 0;
+    /* Claim the slots if they are free or their owner died; the exchange
+     * fails, and the new owner is checked, if another process claims first */
+    uint32_t self = (uint32_t)getpid();
+    uint32_t owner = __atomic_load_n(&h->layer_pid, __ATOMIC_ACQUIRE);
+    while (owner != self) {
+        if (owner && (kill((pid_t)owner, 0) == 0 || errno != ESRCH)) {
+            LOG("ahb: slots owned by pid %u, using readback\n", owner);
+            return 0;
+        }
+        if (__atomic_compare_exchange_n(&h->layer_pid, &owner, self, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            break;
+    }
+
+    h->width = width;
+    h->height = height;
+    h->format = format;
+    h->count = count;
+    uint64_t seq = __atomic_add_fetch(&h->request_seq, 1, __ATOMIC_ACQ_REL);
+
+    uint64_t start = get_time_ns();
+    while (__atomic_load_n(&h->grant_seq, __ATOMIC_ACQUIRE) != seq) {
+        if (get_time_ns() - start > AHB_GRANT_TIMEOUT_NS) {
+            LOG("ahb: presenter did not answer request %lu\n", (unsigned long)seq);
+            ahb_release();      /* withdraw the request and free the slots */
+            return 0;
+        }
+        pace_sleep_until(get_time_ns() + 1000000ULL);
+    }
+    if (h->grant_status != 0) {
+        LOG("ahb: presenter could not allocate %u x %ux%u buffers (%d)\n",
+            count, width, height, h->grant_status);
+        ahb_release();
+        return 0;
+    }
+    return 1;
+}
+
+/* Hand a rendered slot to the presenter (or straight back to ourselves if
+ * no presenter is showing frames) */
+static void ahb_queue_slot(uint32_t slot, uint64_t frame_seq) {
+    AhbShmHeader* h = g_ahb;
+    h->slots[slot].frame_seq = frame_seq;
+    uint32_t next = ahb_presenter_alive(h) ? AHB_SLOT_QUEUED : AHB_SLOT_FREE;
+    __atomic_store_n(&h->slots[slot].state, next, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&h->queue_seq, 1, __ATOMIC_RELEASE);
+    ahb_futex_wake(&h->queue_seq);
+}
+
+/* Take back slots a presenter that stopped showing frames still holds */
+static void ahb_reclaim_slots(uint32_t count, int posted_only) {
+    AhbShmHeader* h = g_ahb;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t st = __atomic_load_n(&h->slots[i].state, __ATOMIC_ACQUIRE);
+        if (st == AHB_SLOT_POSTED || (st == AHB_SLOT_QUEUED && !posted_only))
+            __atomic_compare_exchange_n(&h->slots[i].state, &st, AHB_SLOT_FREE, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+}
+
 /* ============================================================================
  * Section 5: Surface Tracking
  * ============================================================================ */
@@ -792,11 +1672,23 @@ static void remove_surface(VkSurfaceKHR handle) {
  * ============================================================================ */
 
 #define MAX_SC_IMAGES 8
+#define READBACK_RING 3
+
+typedef struct ReadbackSlot {
+    VkBuffer buf;
+    VkDeviceMemory mem;
+    VkCommandBuffer cmd;
+    VkFence fence;
+    void* mapped;                   /* persistent mapping of mem (whole buffer) */
+    int pending;                    /* copy submitted, frame not yet delivered */
+    uint64_t seq;                   /* present sequence number of the frame */
+} ReadbackSlot;
 
 typedef struct SwapchainEntry {
     VkSwapchainKHR handle;
     VkSurfaceKHR surface;
     VkDevice device;
+    const LayerDispatch* vk;        /* device's dispatch, resolved at CreateDevice */
     uint32_t image_count;
     VkImage images[MAX_SC_IMAGES];
     VkDeviceMemory memory[MAX_SC_IMAGES];
@@ -804,17 +1696,30 @@ typedef struct SwapchainEntry {
     uint32_t width, height;
     int format;
     uint32_t current_image;
+    FramePacer pacer;               /* image release schedule for the present mode */
     VkQueue signal_queue;           /* for signaling acquire semaphore/fence */
-    /* Staging buffer for OPTIMAL image → CPU readback */
-    VkBuffer staging_buf;
-    VkDeviceMemory staging_mem;
+    /* Readback ring for OPTIMAL image → CPU. Each slot owns its staging
+     * buffer, command buffer and fence, so the copy for frame K can run on
+     * the GPU while the CPU is still delivering frame K-1. */
+    ReadbackSlot readback[READBACK_RING];
+    uint32_t rb_next;               /* slot the next present records into */
+    uint64_t present_seq;           /* presents submitted to the ring */
     VkDeviceSize staging_size;
+    int staging_invalidate;         /* invalidate mappings before each read */
     VkCommandPool copy_pool;
-    VkCommandBuffer copy_cmd;
+    /* Zero-copy (Section 4d): images are imported AHardwareBuffers and
+     * present only hands them to the presenter — no readback ring */
+    int zero_copy;
+    uint32_t zc_epoch;              /* g_ahb_epoch the buffers were granted under */
+    VkCommandBuffer zc_cmd[MAX_SC_IMAGES];  /* release to the foreign queue, recorded once */
+    VkFence zc_fence[MAX_SC_IMAGES];
+    int zc_pending[MAX_SC_IMAGES];  /* present submitted, slot not queued yet */
+    uint64_t zc_seq[MAX_SC_IMAGES]; /* present sequence number of the frame */
     struct SwapchainEntry* next;
 } SwapchainEntry;
 
 static SwapchainEntry* g_swapchains = NULL;
+static SwapchainEntry* g_ahb_owner = NULL;  /* swapchain whose images the presenter's slots are */
 static uint64_t g_next_sc = 0xDEAD000000000001ULL;
 
 static SwapchainEntry* find_swapchain(VkSwapchainKHR h) {
@@ -830,6 +1735,10 @@ static int is_our_swapchain(VkSwapchainKHR h) {
     return (h & 0xFFFF000000000000ULL) == 0xDEAD000000000000ULL;
 }
 
+static int readback_slot_ok(const ReadbackSlot* rs) {
+    return rs->buf && rs->mem && rs->mapped && rs->cmd && rs->fence;
+}
+
 /* Memory properties cache */
 static VkPhysicalDeviceMemoryProperties g_mem_props = {0};
 static int g_mem_props_queried = 0;
@@ -844,12 +1753,50 @@ static PFN_vkVoidFunction next_instance_proc(const char* name) {
     return NULL;
 }
 
+static inline void* dispatch_key(const void* handle) {
+    return handle ? *(void* const*)handle : NULL;
+}
+
+static inline uint32_t device_map_hash(const void* key) {
+    return (uint32_t)(((uintptr_t)key >> 4) * 0x9E3779B97F4A7C15ULL >> 59) & (DEVICE_MAP_SIZE - 1);
+}
+
+/* Caller holds g_device_lock */
+static void device_map_rebuild(void) {
+    LayerDevice* map[DEVICE_MAP_SIZE] = {0};
+    for (int i = 0; i < MAX_LAYER_DEVICES; i++) {
+        LayerDevice* ld = &g_device_table[i];
+        if (!ld->device) continue;
+        uint32_t h = device_map_hash(ld->key);
+        while (map[h]) h = (h + 1) & (DEVICE_MAP_SIZE - 1);
+        map[h] = ld;
+    }
+    for (int h = 0; h < DEVICE_MAP_SIZE; h++)
+        __atomic_store_n(&g_device_map[h], map[h], __ATOMIC_RELEASE);
+}
+
+/* Find the layer device owning any dispatchable handle (device, queue, CB) */
+static LayerDevice* layer_device_for(const void* handle) {
+    void* key = dispatch_key(handle);
+    if (!key) return NULL;
+    uint32_t h = device_map_hash(key);
+    for (int n = 0; n < DEVICE_MAP_SIZE; n++) {
+        LayerDevice* ld = __atomic_load_n(&g_device_map[h], __ATOMIC_ACQUIRE);
+        if (!ld) break;
+        if (ld->key == key && ld->device) return ld;
+        h = (h + 1) & (DEVICE_MAP_SIZE - 1);
+    }
+    /* Map is being rebuilt — fall back to a scan */
+    for (int i = 0; i < MAX_LAYER_DEVICES; i++)
+        if (g_device_table[i].device && g_device_table[i].key == key)
+            return &g_device_table[i];
+    return NULL;
+}
+
 /* Look up GDPA for a specific device from the per-device table */
 static PFN_vkGetDeviceProcAddr gdpa_for_device(VkDevice device) {
-    for (int i = 0; i < g_device_count; i++) {
-        if (g_device_table[i].device == device)
-            return g_device_table[i].gdpa;
-    }
+    LayerDevice* ld = layer_device_for(device);
+    if (ld) return ld->gdpa;
     /* Fallback to global (last-known) GDPA */
     return g_next_gdpa;
 }
@@ -862,13 +1809,58 @@ static PFN_vkVoidFunction next_device_proc_for(VkDevice device, const char* name
     return NULL;
 }
 
+/* Dispatch table for a device; an empty table if the device is unknown,
+ * so callers only need to NULL-check the entry they use. */
+static const LayerDispatch* dispatch_for(VkDevice device) {
+    static const LayerDispatch empty;
+    LayerDevice* ld = layer_device_for(device);
+    return ld ? &ld->vk : &empty;
+}
+
+static void dispatch_init(LayerDispatch* vk, VkDevice device, PFN_vkGetDeviceProcAddr gdpa) {
+#define DISPATCH_LOAD(fn) vk->fn = (__typeof__(vk->fn))gdpa(device, "vk" #fn)
+    DISPATCH_LOAD(QueueSubmit);
+    DISPATCH_LOAD(QueueWaitIdle);
+    DISPATCH_LOAD(QueuePresentKHR);
+    DISPATCH_LOAD(ResetCommandBuffer);
+    DISPATCH_LOAD(BeginCommandBuffer);
+    DISPATCH_LOAD(EndCommandBuffer);
+    DISPATCH_LOAD(CmdPipelineBarrier);
+    DISPATCH_LOAD(CmdCopyImageToBuffer);
+    DISPATCH_LOAD(ResetFences);
+    DISPATCH_LOAD(WaitForFences);
+    DISPATCH_LOAD(InvalidateMappedMemoryRanges);
+    DISPATCH_LOAD(MapMemory);
+    DISPATCH_LOAD(UnmapMemory);
+    DISPATCH_LOAD(CreateImage);
+    DISPATCH_LOAD(DestroyImage);
+    DISPATCH_LOAD(GetImageMemoryRequirements);
+    DISPATCH_LOAD(BindImageMemory);
+    DISPATCH_LOAD(CreateBuffer);
+    DISPATCH_LOAD(DestroyBuffer);
+    DISPATCH_LOAD(GetBufferMemoryRequirements);
+    DISPATCH_LOAD(BindBufferMemory);
+    DISPATCH_LOAD(AllocateMemory);
+    DISPATCH_LOAD(FreeMemory);
+    DISPATCH_LOAD(CreateCommandPool);
+    DISPATCH_LOAD(DestroyCommandPool);
+    DISPATCH_LOAD(AllocateCommandBuffers);
+    DISPATCH_LOAD(CreateFence);
+    DISPATCH_LOAD(DestroyFence);
+    DISPATCH_LOAD(GetDeviceQueue);
+    DISPATCH_LOAD(DeviceWaitIdle);
+    DISPATCH_LOAD(DestroyDevice);
+    DISPATCH_LOAD(GetAndroidHardwareBufferPropertiesANDROID);
+#undef DISPATCH_LOAD
+}
+
 /* Legacy: resolve using any known device (for code without a device param) */
 static PFN_vkVoidFunction next_device_proc(const char* name) {
     /* Try global first */
     if (g_next_gdpa && g_device)
         return g_next_gdpa(g_device, name);
     /* Fallback: try any device in the table */
-    for (int i = 0; i < g_device_count; i++) {
+    for (int i = 0; i < MAX_LAYER_DEVICES; i++) {
         if (g_device_table[i].device && g_device_table[i].gdpa) {
             PFN_vkVoidFunction fn = g_device_table[i].gdpa(g_device_table[i].device, name);
             if (fn) return fn;
@@ -1226,18 +2218,40 @@ static VkResult headless_GetPhysicalDeviceSurfaceCapabilitiesKHR(
     return VK_ERROR_EXTENSION_NOT_PRESENT;
 }
 
+/* Surface formats in preference order. Only R8G8B8A8 can be backed by an
+ * AHardwareBuffer import, so it leads the list while zero-copy is
+ * available; B8G8R8A8 (and R8G8B8A8 without a presenter) use readback. */
+static uint32_t surface_formats(int formats[2]) {
+    int zc = g_zero_copy && !g_dump_mode && !g_shm_disabled;
+    if (zc) {
+        zc = 0;
+        for (int i = 0; i < MAX_LAYER_DEVICES; i++)
+            if (g_device_table[i].device && g_device_table[i].ahb_import) zc = 1;
+    }
+    if (zc && ahb_presenter_ready()) {
+        formats[0] = VK_FORMAT_R8G8B8A8_UNORM;
+        formats[1] = VK_FORMAT_B8G8R8A8_UNORM;
+        return 2;
+    }
+    formats[0] = VK_FORMAT_B8G8R8A8_UNORM;
+    return 1;
+}
+
 static VkResult headless_GetPhysicalDeviceSurfaceFormatsKHR(
     VkPhysicalDevice pd, VkSurfaceKHR surface, uint32_t* pCount, VkSurfaceFormatKHR* pFormats)
 {
     TRACE_FN("vkGetPhysicalDeviceSurfaceFormatsKHR");
     if (find_surface(surface)) {
-        if (!pFormats) { *pCount = 1; return VK_SUCCESS; }
-        if (*pCount >= 1) {
-            pFormats[0].format = VK_FORMAT_B8G8R8A8_UNORM;
-            pFormats[0].colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-            *pCount = 1;
+        int formats[2];
+        uint32_t total = surface_formats(formats);
+        if (!pFormats) { *pCount = total; return VK_SUCCESS; }
+        uint32_t n = *pCount < total ? *pCount : total;
+        for (uint32_t i = 0; i < n; i++) {
+            pFormats[i].format = formats[i];
+            pFormats[i].colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
         }
-        return VK_SUCCESS;
+        *pCount = n;
+        return n < total ? VK_INCOMPLETE : VK_SUCCESS;
     }
     typedef VkResult (*PFN)(VkPhysicalDevice, VkSurfaceKHR, uint32_t*, VkSurfaceFormatKHR*);
     PFN fn = (PFN)next_instance_proc("vkGetPhysicalDeviceSurfaceFormatsKHR");
@@ -1250,12 +2264,16 @@ static VkResult headless_GetPhysicalDeviceSurfacePresentModesKHR(
 {
     TRACE_FN("vkGetPhysicalDeviceSurfacePresentModesKHR");
     if (find_surface(surface)) {
-        if (!pModes) { *pCount = 2; return VK_SUCCESS; }
-        uint32_t n = *pCount < 2 ? *pCount : 2;
-        VkPresentModeKHR modes[] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+        static const VkPresentModeKHR modes[] = {
+            VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+            VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR
+        };
+        const uint32_t count = sizeof(modes) / sizeof(modes[0]);
+        if (!pModes) { *pCount = count; return VK_SUCCESS; }
+        uint32_t n = *pCount < count ? *pCount : count;
         memcpy(pModes, modes, n * sizeof(VkPresentModeKHR));
         *pCount = n;
-        return n < 2 ? VK_INCOMPLETE : VK_SUCCESS;
+        return n < count ? VK_INCOMPLETE : VK_SUCCESS;
     }
     typedef VkResult (*PFN)(VkPhysicalDevice, VkSurfaceKHR, uint32_t*, VkPresentModeKHR*);
     PFN fn = (PFN)next_instance_proc("vkGetPhysicalDeviceSurfacePresentModesKHR");
@@ -1318,18 +2336,21 @@ static VkResult headless_GetPhysicalDeviceSurfaceFormats2KHR(
         (unsigned long long)surface, (void*)pSurfaceFormatCount, (void*)pSurfaceFormats);
 
     if (find_surface(surface)) {
+        int formats[2];
+        uint32_t total = surface_formats(formats);
         if (!pSurfaceFormats) {
-            *pSurfaceFormatCount = 1;
+            *pSurfaceFormatCount = total;
             return VK_SUCCESS;
         }
-        if (*pSurfaceFormatCount >= 1) {
-            pSurfaceFormats[0].sType = VK_STRUCTURE_TYPE_SURFACE_FORMAT_2_KHR;
-            pSurfaceFormats[0].pNext = NULL;
-            pSurfaceFormats[0].surfaceFormat.format = VK_FORMAT_B8G8R8A8_UNORM;
-            pSurfaceFormats[0].surfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-            *pSurfaceFormatCount = 1;
+        uint32_t n = *pSurfaceFormatCount < total ? *pSurfaceFormatCount : total;
+        for (uint32_t i = 0; i < n; i++) {
+            pSurfaceFormats[i].sType = VK_STRUCTURE_TYPE_SURFACE_FORMAT_2_KHR;
+            pSurfaceFormats[i].pNext = NULL;
+            pSurfaceFormats[i].surfaceFormat.format = formats[i];
+            pSurfaceFormats[i].surfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
         }
-        return VK_SUCCESS;
+        *pSurfaceFormatCount = n;
+        return n < total ? VK_INCOMPLETE : VK_SUCCESS;
     }
 
     typedef VkResult (*PFN)(VkPhysicalDevice, const VkPhysicalDeviceSurfaceInfo2KHR*,
@@ -1382,6 +2403,299 @@ static uint32_t find_device_local_mem(uint32_t typeBits) {
     return 0;
 }
 
+/* --- Zero-copy swapchain images (Section 4d) --- */
+
+static int zc_owns_slots(const SwapchainEntry* sc) {
+    return sc->zero_copy && g_ahb_owner == sc && g_ahb && sc->zc_epoch == g_ahb_epoch;
+}
+
+/* Destroy whatever zc_create_images managed to create */
+static void zc_discard_images(SwapchainEntry* sc) {
+    const LayerDispatch* vk = sc->vk;
+    for (uint32_t i = 0; i < MAX_SC_IMAGES; i++) {
+        if (sc->zc_fence[i] && vk->DestroyFence) vk->DestroyFence(sc->device, sc->zc_fence[i], NULL);
+        if (sc->images[i] && vk->DestroyImage) vk->DestroyImage(sc->device, sc->images[i], NULL);
+        if (sc->memory[i] && vk->FreeMemory) vk->FreeMemory(sc->device, sc->memory[i], NULL);
+        sc->zc_fence[i] = 0;
+        sc->zc_cmd[i] = NULL;
+        sc->images[i] = 0;
+        sc->memory[i] = 0;
+    }
+    if (sc->copy_pool && vk->DestroyCommandPool) vk->DestroyCommandPool(sc->device, sc->copy_pool, NULL);
+    sc->copy_pool = NULL;
+}
+
+/* Create swapchain image i on top of the presenter's buffer in slot i */
+static VkResult zc_import_image(SwapchainEntry* sc, const VkSwapchainCreateInfoKHR* ci, uint32_t i) {
+    const LayerDispatch* vk = sc->vk;
+    struct AHardwareBuffer* ahb = (struct AHardwareBuffer*)(uintptr_t)g_ahb->slots[i].buffer;
+
+    VkExternalMemoryImageCreateInfo emi = {0};
+    emi.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+    emi.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_ANDROID_HARDWARE_BUFFER_BIT_ANDROID;
+
+    VkImageCreateInfo ici = {0};
+    ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ici.pNext = &emi;
+    ici.imageType = VK_IMAGE_TYPE_2D;
+    ici.format = ci->imageFormat;
+    ici.extent.width = sc->width;
+    ici.extent.height = sc->height;
+    ici.extent.depth = 1;
+    ici.mipLevels = 1;
+    ici.arrayLayers = 1;
+    ici.samples = VK_SAMPLE_COUNT_1_BIT;
+    ici.tiling = VK_IMAGE_TILING_OPTIMAL;
+    ici.usage = ci->imageUsage;
+    ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    ici.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult res = vk->CreateImage(sc->device, &ici, NULL, &sc->images[i]);
+    if (res != VK_SUCCESS) {
+        sc->images[i] = 0;
+        return res;
+    }
+
+    VkAndroidHardwareBufferPropertiesANDROID props = {0};
+    props.sType = VK_STRUCTURE_TYPE_ANDROID_HARDWARE_BUFFER_PROPERTIES_ANDROID;
+    res = vk->GetAndroidHardwareBufferPropertiesANDROID(sc->device, ahb, &props);
+    if (res != VK_SUCCESS || !props.memoryTypeBits) return res != VK_SUCCESS ? res : VK_ERROR_INITIALIZATION_FAILED;
+
+    VkMemoryDedicatedAllocateInfo dai = {0};
+    dai.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dai.image = sc->images[i];
+    VkImportAndroidHardwareBufferInfoANDROID import = {0};
+    import.sType = VK_STRUCTURE_TYPE_IMPORT_ANDROID_HARDWARE_BUFFER_INFO_ANDROID;
+    import.pNext = &dai;
+    import.buffer = ahb;
+    VkMemoryAllocateInfo ai = {0};
+    ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    ai.pNext = &import;
+    ai.allocationSize = props.allocationSize;
+    ai.memoryTypeIndex = find_device_local_mem(props.memoryTypeBits);
+    res = vk->AllocateMemory(sc->device, &ai, NULL, &sc->memory[i]);
+    if (res != VK_SUCCESS) {
+        sc->memory[i] = 0;
+        return res;
+    }
+    return vk->BindImageMemory(sc->device, sc->images[i], sc->memory[i], 0);
+}
+
+/* Record image i's present-time barrier: PRESENT_SRC → GENERAL, released to
+ * the foreign queue family (SurfaceFlinger). Never re-recorded. Acquire needs
+ * no matching barrier: swapchain contents are undefined after acquire, so the
+ * app's own UNDEFINED transition discards ownership and contents together. */
+static VkResult zc_record_release(SwapchainEntry* sc, uint32_t i) {
+    const LayerDispatch* vk = sc->vk;
+    VkCommandBufferBeginInfo_t bi = {0};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    VkResult res = vk->BeginCommandBuffer(sc->zc_cmd[i], &bi);
+    if (res != VK_SUCCESS) return res;
+
+    VkImageMemoryBarrier imb = {0};
+    imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imb.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    imb.dstAccessMask = 0;
+    imb.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    imb.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imb.srcQueueFamilyIndex = 0;
+    imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_FOREIGN_EXT;
+    imb.image = sc->images[i];
+    imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imb.subresourceRange.levelCount = 1;
+    imb.subresourceRange.layerCount = 1;
+    vk->CmdPipelineBarrier(sc->zc_cmd[i],
+           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+           0, 0, NULL, 0, NULL, 1, &imb);
+    return vk->EndCommandBuffer(sc->zc_cmd[i]);
+}
+
+/* Back the swapchain with the presenter's AHardwareBuffers. Returns 0, with
+ * nothing left behind, if zero-copy is unavailable for this swapchain; the
+ * caller then creates ordinary images for the readback path. */
+static int zc_create_images(SwapchainEntry* sc, const VkSwapchainCreateInfoKHR* ci) {
+    const LayerDispatch* vk = sc->vk;
+    LayerDevice* ld = layer_device_for(sc->device);
+    if (!g_zero_copy || g_dump_mode || !ld || !ld->ahb_import) return 0;
+    if (ci->imageFormat != VK_FORMAT_R8G8B8A8_UNORM || ci->imageArrayLayers != 1) return 0;
+    if (!vk->GetAndroidHardwareBufferPropertiesANDROID || !vk->CreateImage || !vk->AllocateMemory ||
+        !vk->BindImageMemory || !vk->CreateCommandPool || !vk->AllocateCommandBuffers ||
+        !vk->BeginCommandBuffer || !vk->EndCommandBuffer || !vk->CmdPipelineBarrier ||
+        !vk->CreateFence || !vk->ResetFences || !vk->WaitForFences || !vk->QueueSubmit)
+        return 0;
+    if (!ahb_presenter_ready()) return 0;
+
+    uint32_t count = sc->image_count < AHB_MIN_IMAGES ? AHB_MIN_IMAGES : sc->image_count;
+    if (count > AHB_SHM_SLOTS) count = AHB_SHM_SLOTS;
+    if (!ahb_request(sc->width, sc->height, AHB_FORMAT_R8G8B8A8_UNORM, count)) return 0;
+
+    VkResult res = VK_SUCCESS;
+    for (uint32_t i = 0; i < count && res == VK_SUCCESS; i++) {
+        res = zc_import_image(sc, ci, i);
+        if (res != VK_SUCCESS) LOG("[ZC] import of buffer %u failed: %d\n", i, res);
+    }
+
+    if (res == VK_SUCCESS) {
+        VkCommandPoolCreateInfo_t cpci = {0};
+        cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cpci.queueFamilyIndex = 0;
+        res = vk->CreateCommandPool(sc->device, &cpci, NULL, &sc->copy_pool);
+    }
+    if (res == VK_SUCCESS) {
+        VkCommandBufferAllocateInfo_t cbai = {0};
+        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbai.commandPool = sc->copy_pool;
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cbai.commandBufferCount = count;
+        res = vk->AllocateCommandBuffers(sc->device, &cbai, sc->zc_cmd);
+    }
+    for (uint32_t i = 0; i < count && res == VK_SUCCESS; i++) {
+        VkFenceCreateInfo_t fci = {0};
+        fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        res = vk->CreateFence(sc->device, &fci, NULL, &sc->zc_fence[i]);
+        if (res == VK_SUCCESS) res = zc_record_release(sc, i);
+    }
+
+    if (res != VK_SUCCESS) {
+        LOG("[ZC] zero-copy setup failed (%d), using readback\n", res);
+        zc_discard_images(sc);
+        ahb_release();
+        return 0;
+    }
+
+    sc->image_count = count;
+    sc->zc_epoch = g_ahb_epoch;
+    g_ahb_owner = sc;
+    LOG("[ZC] %u images imported from the presenter's buffers\n", count);
+    return 1;
+}
+
+/* Queue completed presents to the presenter, oldest first, skipping image
+ * `skip`. Waits up to `timeout` in total across all of them; timeout 0
+ * queues only the ones already done. */
+static void zc_queue_completed(SwapchainEntry* sc, int skip, uint64_t timeout) {
+    const LayerDispatch* vk = sc->vk;
+    uint64_t start = timeout ? get_time_ns() : 0;
+    uint64_t left = timeout;
+    for (;;) {
+        int oldest = -1;
+        for (uint32_t i = 0; i < sc->image_count; i++) {
+            if ((int)i == skip || !sc->zc_pending[i]) continue;
+            if (oldest < 0 || sc->zc_seq[i] < sc->zc_seq[oldest]) oldest = (int)i;
+        }
+        if (oldest < 0) return;
+        if (timeout && timeout != UINT64_MAX) {
+            uint64_t spent = get_time_ns() - start;
+            left = spent < timeout ? timeout - spent : 0;
+        }
+        VkResult wres = vk->WaitForFences(sc->device, 1, &sc->zc_fence[oldest], VK_TRUE, left);
+        if (wres == VK_TIMEOUT) return;     /* later presents are not done either */
+        TRACE_POINT("ZC_QUEUE", wres);
+        if (wres != VK_SUCCESS)
+            LOG("[ZC] WaitForFences failed: %d (frame %lu)\n", wres, (unsigned long)sc->zc_seq[oldest]);
+        sc->zc_pending[oldest] = 0;
+        if (zc_owns_slots(sc)) ahb_queue_slot((uint32_t)oldest, sc->zc_seq[oldest]);
+    }
+}
+
+/* vkAcquireNextImageKHR for a zero-copy swapchain: claim a FREE slot,
+ * waiting up to `timeout` for the presenter to release one. Returns
+ * VK_ERROR_OUT_OF_DATE_KHR once the slots are no longer ours (presenter
+ * restarted, or a newer swapchain took them) so the app recreates the
+ * swapchain against whatever is available now. */
+static VkResult zc_acquire(SwapchainEntry* sc, uint64_t timeout, uint32_t* pImageIndex) {
+    if (!zc_owns_slots(sc) || ahb_presenter_gone(g_ahb)) return VK_ERROR_OUT_OF_DATE_KHR;
+    AhbShmHeader* h = g_ahb;
+    uint64_t start = get_time_ns();
+    int reclaimed = 0;
+
+    zc_queue_completed(sc, -1, 0);
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&h->free_seq, __ATOMIC_ACQUIRE);
+        for (uint32_t n = 0; n < sc->image_count; n++) {
+            uint32_t i = (sc->current_image + n) % sc->image_count;
+            uint32_t expected = AHB_SLOT_FREE;
+            if (__atomic_compare_exchange_n(&h->slots[i].state, &expected, AHB_SLOT_ACQUIRED, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                *pImageIndex = i;
+                sc->current_image = (i + 1) % sc->image_count;
+                return VK_SUCCESS;
+            }
+        }
+
+        /* The presenter frees a buffer only once a newer frame replaces it,
+         * so hand over everything we have finished before waiting */
+        uint64_t waited = get_time_ns() - start;
+        zc_queue_completed(sc, -1, waited < timeout ? timeout - waited : 0);
+        if (ahb_presenter_gone(h)) return VK_ERROR_OUT_OF_DATE_KHR;
+
+        waited = get_time_ns() - start;
+        if (!ahb_presenter_alive(h)) {
+            ahb_reclaim_slots(sc->image_count, 0);
+        } else if (waited >= AHB_STALL_NS && !reclaimed) {
+            LOG("[ZC] no buffer released for %lu ms, reclaiming posted buffers\n",
+                (unsigned long)(waited / 1000000ULL));
+            ahb_reclaim_slots(sc->image_count, 1);
+            reclaimed = 1;
+        }
+        if (timeout == 0) return VK_NOT_READY;
+        if (waited >= timeout) return VK_TIMEOUT;
+        uint64_t wait = timeout - waited;
+        if (wait > 2000000ULL) wait = 2000000ULL;  /* recheck liveness and our own fences */
+        ahb_futex_wait(&h->free_seq, seq, wait);
+    }
+}
+
+/* vkQueuePresentKHR for a zero-copy swapchain: release the image to the
+ * presenter's queue family, consuming the present's wait semaphores (see the
+ * readback submit for why they must be consumed), and queue the slot once
+ * that has executed. Earlier presents whose GPU work is done are queued here
+ * too, oldest first; present never waits for the GPU. Ones still running are
+ * queued by the next present or acquire, and zc_acquire waits for them when
+ * it needs a buffer back from the presenter. */
+static void zc_present(SwapchainEntry* sc, VkQueue queue, uint32_t idx,
+                       uint32_t wait_count, const VkSemaphore* waits) {
+    const LayerDispatch* vk = sc->vk;
+    if (zc_owns_slots(sc))
+        __atomic_store_n(&g_display_interval_ns,
+                         __atomic_load_n(&g_ahb->target_interval_ns, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+    VkSubmitInfo si;
+    memset(&si, 0, sizeof(si));
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &sc->zc_cmd[idx];
+    VkFlags stage_buf[8];
+    VkFlags* wait_stages = stage_buf;
+    if (wait_count > 8 && !(wait_stages = malloc(wait_count * sizeof(VkFlags)))) {
+        LOG("[ZC] out of memory for %u wait semaphores\n", wait_count);
+        wait_stages = stage_buf;
+        wait_count = 8;
+    }
+    for (uint32_t w = 0; w < wait_count; w++)
+        wait_stages[w] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    si.waitSemaphoreCount = wait_count;
+    si.pWaitSemaphores = waits;
+    si.pWaitDstStageMask = wait_stages;
+
+    vk->ResetFences(sc->device, 1, &sc->zc_fence[idx]);
+    VkResult qs_res = vk->QueueSubmit(queue, 1, &si, sc->zc_fence[idx]);
+    if (wait_stages != stage_buf) free(wait_stages);
+    TRACE_POINT("ZC_SUBMIT", qs_res);
+    if (qs_res == VK_SUCCESS) {
+        sc->zc_pending[idx] = 1;
+        sc->zc_seq[idx] = sc->present_seq++;
+    } else {
+        LOG("[ZC] QueueSubmit failed: %d\n", qs_res);
+        if (zc_owns_slots(sc)) {
+            __atomic_store_n(&g_ahb->slots[idx].state, AHB_SLOT_FREE, __ATOMIC_RELEASE);
+            ahb_futex_wake(&g_ahb->free_seq);
+        }
+    }
+
+    zc_queue_completed(sc, -1, 0);
+}
+
 static VkResult headless_CreateSwapchainKHR(
     VkDevice device,
     const VkSwapchainCreateInfoKHR* pCreateInfo,
@@ -1407,9 +2721,9 @@ static VkResult headless_CreateSwapchainKHR(
     }
 
     layer_marker("SC_OUR_SURFACE");
-    LOG("CreateSwapchainKHR: %ux%u, %u images, format=%d\n",
+    LOG("CreateSwapchainKHR: %ux%u, %u images, format=%d, presentMode=%d\n",
         pCreateInfo->imageExtent.width, pCreateInfo->imageExtent.height,
-        pCreateInfo->minImageCount, pCreateInfo->imageFormat);
+        pCreateInfo->minImageCount, pCreateInfo->imageFormat, pCreateInfo->presentMode);
 
     /* Update surface size */
     surf->width = pCreateInfo->imageExtent.width;
@@ -1421,38 +2735,29 @@ static VkResult headless_CreateSwapchainKHR(
     sc->handle = g_next_sc++;
     sc->surface = pCreateInfo->surface;
     sc->device = device;
+    sc->vk = dispatch_for(device);
     sc->width = pCreateInfo->imageExtent.width;
     sc->height = pCreateInfo->imageExtent.height;
     sc->format = pCreateInfo->imageFormat;
     sc->image_count = pCreateInfo->minImageCount;
     if (sc->image_count > MAX_SC_IMAGES) sc->image_count = MAX_SC_IMAGES;
+    sc->pacer.mode = pCreateInfo->presentMode;
 
-    /* Get Vulkan functions for image/buffer creation — use THIS device's dispatch */
-    typedef VkResult (*PFN_CI)(VkDevice, const VkImageCreateInfo*, const VkAllocationCallbacks*, VkImage*);
-    typedef void (*PFN_GMR)(VkDevice, VkImage, VkMemoryRequirements*);
-    typedef VkResult (*PFN_AM)(VkDevice, const VkMemoryAllocateInfo*, const VkAllocationCallbacks*, VkDeviceMemory*);
-    typedef VkResult (*PFN_BIM)(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize);
-    typedef VkResult (*PFN_CB)(VkDevice, const VkBufferCreateInfo*, const VkAllocationCallbacks*, VkBuffer*);
-    typedef void (*PFN_GBMR)(VkDevice, VkBuffer, VkMemoryRequirements*);
-    typedef VkResult (*PFN_BBM)(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize);
-
-    layer_marker("SC_RESOLVE_FN_START");
-    PFN_CI fn_ci = (PFN_CI)next_device_proc_for(device, "vkCreateImage");
-    PFN_GMR fn_gmr = (PFN_GMR)next_device_proc_for(device, "vkGetImageMemoryRequirements");
-    PFN_AM fn_am = (PFN_AM)next_device_proc_for(device, "vkAllocateMemory");
-    PFN_BIM fn_bim = (PFN_BIM)next_device_proc_for(device, "vkBindImageMemory");
-    PFN_CB fn_cb = (PFN_CB)next_device_proc_for(device, "vkCreateBuffer");
-    PFN_GBMR fn_gbmr = (PFN_GBMR)next_device_proc_for(device, "vkGetBufferMemoryRequirements");
-    PFN_BBM fn_bbm = (PFN_BBM)next_device_proc_for(device, "vkBindBufferMemory");
+    /* Image/buffer creation goes through THIS device's dispatch */
+    const LayerDispatch* vk = sc->vk;
+    int have_image_fns = vk->CreateImage && vk->GetImageMemoryRequirements &&
+                         vk->AllocateMemory && vk->BindImageMemory;
 
     char dbuf[256];
     snprintf(dbuf, sizeof(dbuf), "SC_FNS ci=%p gmr=%p am=%p bim=%p cb=%p",
-             (void*)fn_ci, (void*)fn_gmr, (void*)fn_am, (void*)fn_bim, (void*)fn_cb);
+             (void*)vk->CreateImage, (void*)vk->GetImageMemoryRequirements,
+             (void*)vk->AllocateMemory, (void*)vk->BindImageMemory, (void*)vk->CreateBuffer);
     layer_marker(dbuf);
 
-    if (!fn_ci || !fn_gmr || !fn_am || !fn_bim) {
+    if (!have_image_fns) {
         LOG("Missing core Vulkan functions! ci=%p gmr=%p am=%p bim=%p dev=%p gdpa=%p\n",
-            (void*)fn_ci, (void*)fn_gmr, (void*)fn_am, (void*)fn_bim,
+            (void*)vk->CreateImage, (void*)vk->GetImageMemoryRequirements,
+            (void*)vk->AllocateMemory, (void*)vk->BindImageMemory,
             device, (void*)gdpa_for_device(device));
         layer_marker("SC_MISSING_FNS");
     }
@@ -1463,11 +2768,14 @@ static VkResult headless_CreateSwapchainKHR(
              g_mem_props.memoryTypeCount, g_physical_device);
     layer_marker(dbuf);
 
+    /* Zero-copy first (Section 4d); the OPTIMAL images and readback ring
+     * below are the fallback */
+    sc->zero_copy = zc_create_images(sc, pCreateInfo);
+
     /* Create OPTIMAL images — LINEAR + COLOR_ATTACHMENT causes device loss on Mali */
-    for (uint32_t i = 0; i < sc->image_count; i++) {
-        if (!fn_ci || !fn_gmr || !fn_am || !fn_bim) {
+    for (uint32_t i = 0; i < sc->image_count && !sc->zero_copy; i++) {
+        if (!have_image_fns)
             break;
-        }
 
         VkImageCreateInfo ici = {0};
         ici.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1488,7 +2796,7 @@ static VkResult headless_CreateSwapchainKHR(
                  i, sc->width, sc->height, ici.format, ici.usage);
         layer_marker(dbuf);
 
-        VkResult res = fn_ci(device, &ici, NULL, &sc->images[i]);
+        VkResult res = vk->CreateImage(device, &ici, NULL, &sc->images[i]);
         snprintf(dbuf, sizeof(dbuf), "SC_IMG%u_RESULT res=%d img=0x%lx",
                  i, res, (unsigned long)sc->images[i]);
         layer_marker(dbuf);
@@ -1498,7 +2806,7 @@ static VkResult headless_CreateSwapchainKHR(
         }
 
         VkMemoryRequirements memReq = {0};
-        fn_gmr(device, sc->images[i], &memReq);
+        vk->GetImageMemoryRequirements(device, sc->images[i], &memReq);
         snprintf(dbuf, sizeof(dbuf), "SC_IMG%u_MEMREQ size=%lu align=%lu bits=0x%x",
                  i, (unsigned long)memReq.size, (unsigned long)memReq.alignment, memReq.memoryTypeBits);
         layer_marker(dbuf);
@@ -1512,7 +2820,7 @@ static VkResult headless_CreateSwapchainKHR(
                  i, (unsigned long)ai.allocationSize, ai.memoryTypeIndex);
         layer_marker(dbuf);
 
-        res = fn_am(device, &ai, NULL, &sc->memory[i]);
+        res = vk->AllocateMemory(device, &ai, NULL, &sc->memory[i]);
         snprintf(dbuf, sizeof(dbuf), "SC_IMG%u_ALLOC_RESULT res=%d mem=0x%lx",
                  i, res, (unsigned long)sc->memory[i]);
         layer_marker(dbuf);
@@ -1521,7 +2829,7 @@ static VkResult headless_CreateSwapchainKHR(
             continue;
         }
 
-        res = fn_bim(device, sc->images[i], sc->memory[i], 0);
+        res = vk->BindImageMemory(device, sc->images[i], sc->memory[i], 0);
         snprintf(dbuf, sizeof(dbuf), "SC_IMG%u_BIND_RESULT res=%d", i, res);
         layer_marker(dbuf);
         if (res != VK_SUCCESS) {
@@ -1538,100 +2846,107 @@ static VkResult headless_CreateSwapchainKHR(
         layer_marker(dbuf);
     }
 
-    /* Create staging buffer for OPTIMAL→CPU readback during Present */
+    /* Create readback ring for OPTIMAL→CPU readback during Present */
     sc->staging_size = (VkDeviceSize)sc->width * sc->height * 4;
-    sc->staging_buf = 0;
-    sc->staging_mem = 0;
+    /* Coherent staging needs no invalidate; HEADLESS_STAGING_INVALIDATE=1
+     * forces it in case the thunk path loses coherence (the ICD used to
+     * invalidate on every vkMapMemory for that reason). */
+    sc->staging_invalidate = g_force_invalidate;
     sc->copy_pool = NULL;
-    sc->copy_cmd = NULL;
+    sc->rb_next = 0;
+
+    if (!sc->zero_copy && vk->CreateBuffer && vk->GetBufferMemoryRequirements &&
+        vk->BindBufferMemory && vk->AllocateMemory) {
 
-    if (fn_cb && fn_gbmr && fn_bbm) {
-        VkBufferCreateInfo bci = {0};
-        bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bci.size = sc->staging_size;
-        bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-        bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        for (uint32_t r = 0; r < READBACK_RING; r++) {
+            ReadbackSlot* rs = &sc->readback[r];
+            VkBufferCreateInfo bci = {0};
+            bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bci.size = sc->staging_size;
+            bci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            bci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        VkResult bres = fn_cb(device, &bci, NULL, &sc->staging_buf);
-        LOG("Staging buffer: size=%lu result=%d buf=0x%lx\n",
-            (unsigned long)sc->staging_size, bres, (unsigned long)sc->staging_buf);
+            VkResult bres = vk->CreateBuffer(device, &bci, NULL, &rs->buf);
+            LOG("Staging buffer[%u]: size=%lu result=%d buf=0x%lx\n",
+                r, (unsigned long)sc->staging_size, bres, (unsigned long)rs->buf);
+            if (bres != VK_SUCCESS || !rs->buf) { rs->buf = 0; continue; }
 
-        if (bres == VK_SUCCESS && sc->staging_buf) {
             VkMemoryRequirements bmr = {0};
-            fn_gbmr(device, sc->staging_buf, &bmr);
+            vk->GetBufferMemoryRequirements(device, rs->buf, &bmr);
 
             VkMemoryAllocateInfo bai = {0};
             bai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
             bai.allocationSize = bmr.size;
             bai.memoryTypeIndex = find_host_visible_mem(bmr.memoryTypeBits);
 
-            bres = fn_am(device, &bai, NULL, &sc->staging_mem);
-            LOG("Staging memory: size=%lu typeIdx=%u result=%d\n",
-                (unsigned long)bmr.size, bai.memoryTypeIndex, bres);
-
-            if (bres == VK_SUCCESS && sc->staging_mem) {
-                fn_bbm(device, sc->staging_buf, sc->staging_mem, 0);
-                /* Pre-fill staging buffer with sentinel pattern so we can tell
-                 * if CopyImageToBuffer actually executed (zeros = copy ran but
-                 * blank; 0xDE = copy never ran; other = real data) */
-                {
-                    typedef VkResult (*PFN_MM)(VkDevice, VkDeviceMemory, VkDeviceSize, VkDeviceSize, VkFlags, void**);
-                    typedef void (*PFN_UM)(VkDevice, VkDeviceMemory);
-                    PFN_MM fmm = (PFN_MM)next_device_proc_for(device, "vkMapMemory");
-                    PFN_UM fum = (PFN_UM)next_device_proc_for(device, "vkUnmapMemory");
-                    if (fmm && fum) {
-                        void *p = NULL;
-                        if (fmm(device, sc->staging_mem, 0, sc->staging_size, 0, &p) == VK_SUCCESS && p) {
-                            memset(p, 0xDE, (size_t)sc->staging_size);
-                            fum(device, sc->staging_mem);
-                            LOG("Staging buffer pre-filled with 0xDE sentinel (%lu bytes)\n",
-                                (unsigned long)sc->staging_size);
-                        }
-                    }
+            bres = vk->AllocateMemory(device, &bai, NULL, &rs->mem);
+            if (!(g_mem_props.memoryTypes[bai.memoryTypeIndex & 31].propertyFlags &
+                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+                sc->staging_invalidate = 1;
+            LOG("Staging memory[%u]: size=%lu typeIdx=%u result=%d\n",
+                r, (unsigned long)bmr.size, bai.memoryTypeIndex, bres);
+            if (bres != VK_SUCCESS || !rs->mem) { rs->mem = 0; continue; }
+
+            vk->BindBufferMemory(device, rs->buf, rs->mem, 0);
+            /* Pre-fill staging buffer with sentinel pattern so we can tell
+             * if CopyImageToBuffer actually executed (zeros = copy ran but
+             * blank; 0xDE = copy never ran; other = real data) */
+            /* Staging memory stays mapped for the swapchain's lifetime —
+             * a map/unmap per frame costs two thunk round trips plus the
+             * ICD's map bookkeeping. */
+            if (vk->MapMemory) {
+                void *p = NULL;
+                VkResult mres = vk->MapMemory(device, rs->mem, 0, sc->staging_size, 0, &p);
+                if (mres == VK_SUCCESS && p) {
+                    rs->mapped = p;
+                    memset(p, 0xDE, (size_t)sc->staging_size);
+                } else {
+                    LOG("Staging map[%u] failed: %d\n", r, mres);
                 }
             }
         }
 
-        /* Create command pool + command buffer for copy operations */
-        typedef VkResult (*PFN_CCP)(VkDevice, const VkCommandPoolCreateInfo_t*, const VkAllocationCallbacks*, VkCommandPool*);
-        typedef VkResult (*PFN_ACB)(VkDevice, const VkCommandBufferAllocateInfo_t*, VkCommandBuffer*);
-        PFN_CCP fn_ccp = (PFN_CCP)next_device_proc_for(device, "vkCreateCommandPool");
-        PFN_ACB fn_acb = (PFN_ACB)next_device_proc_for(device, "vkAllocateCommandBuffers");
-
-        if (fn_ccp && fn_acb) {
+        /* One command pool, one command buffer + fence per ring slot */
+        if (vk->CreateCommandPool && vk->AllocateCommandBuffers && vk->CreateFence) {
             VkCommandPoolCreateInfo_t cpci = {0};
             cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
             cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
             cpci.queueFamilyIndex = 0;
 
-            VkResult cpres = fn_ccp(device, &cpci, NULL, &sc->copy_pool);
+            VkResult cpres = vk->CreateCommandPool(device, &cpci, NULL, &sc->copy_pool);
             LOG("Copy command pool: result=%d pool=%p\n", cpres, sc->copy_pool);
 
             if (cpres == VK_SUCCESS && sc->copy_pool) {
+                VkCommandBuffer cmds[READBACK_RING] = {0};
                 VkCommandBufferAllocateInfo_t cbai = {0};
                 cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
                 cbai.commandPool = sc->copy_pool;
                 cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-                cbai.commandBufferCount = 1;
-
-                fn_acb(device, &cbai, &sc->copy_cmd);
-                LOG("Copy command buffer: cmd=%p\n", sc->copy_cmd);
+                cbai.commandBufferCount = READBACK_RING;
+
+                VkResult ares = vk->AllocateCommandBuffers(device, &cbai, cmds);
+                for (uint32_t r = 0; r < READBACK_RING; r++) {
+                    ReadbackSlot* rs = &sc->readback[r];
+                    VkFenceCreateInfo_t fci = {0};
+                    fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+                    if (ares == VK_SUCCESS) rs->cmd = cmds[r];
+                    if (vk->CreateFence(device, &fci, NULL, &rs->fence) != VK_SUCCESS)
+                        rs->fence = 0;
+                    LOG("Readback slot[%u]: cmd=%p fence=0x%lx\n",
+                        r, rs->cmd, (unsigned long)rs->fence);
+                }
             }
         }
-    } else {
+    } else if (!sc->zero_copy) {
         LOG("WARNING: Missing buffer functions, no staging readback available\n");
     }
 
     /* Get a queue for signaling acquire semaphore/fence in AcquireNextImage.
      * Without this, DXVK's vkQueueSubmit waits forever on the unsignaled semaphore. */
     sc->signal_queue = NULL;
-    {
-        typedef void (*PFN_GDQ)(VkDevice, uint32_t, uint32_t, VkQueue*);
-        PFN_GDQ fn_gdq = (PFN_GDQ)next_device_proc_for(device, "vkGetDeviceQueue");
-        if (fn_gdq) {
-            fn_gdq(device, 0, 0, &sc->signal_queue);
-            LOG("Got signal_queue=%p for acquire sync\n", sc->signal_queue);
-        }
+    if (vk->GetDeviceQueue) {
+        vk->GetDeviceQueue(device, 0, 0, &sc->signal_queue);
+        LOG("Got signal_queue=%p for acquire sync\n", sc->signal_queue);
     }
 
     pthread_mutex_lock(&g_mutex);
@@ -1642,25 +2957,23 @@ static VkResult headless_CreateSwapchainKHR(
     *pSwapchain = sc->handle;
 
     /* Health check: verify the device is not lost after all image/buffer creation */
-    {
-        typedef VkResult (*PFN_DWI)(VkDevice);
-        PFN_DWI fn_dwi = (PFN_DWI)next_device_proc_for(device, "vkDeviceWaitIdle");
-        if (fn_dwi) {
-            VkResult wires = fn_dwi(device);
-            LOG("Post-swapchain DeviceWaitIdle: %d\n", wires);
-            if (wires != VK_SUCCESS) {
-                LOG("WARNING: Device may be LOST after swapchain creation! result=%d\n", wires);
-            }
+    if (vk->DeviceWaitIdle) {
+        VkResult wires = vk->DeviceWaitIdle(device);
+        LOG("Post-swapchain DeviceWaitIdle: %d\n", wires);
+        if (wires != VK_SUCCESS) {
+            LOG("WARNING: Device may be LOST after swapchain creation! result=%d\n", wires);
         }
     }
 
-    snprintf(scbuf, sizeof(scbuf), "SC_OK handle=0x%lx images=%u staging=%s",
-             (unsigned long)sc->handle, sc->image_count,
-             sc->staging_buf ? "YES" : "NO");
+    uint32_t rb_ok = 0;
+    for (uint32_t r = 0; r < READBACK_RING; r++)
+        if (readback_slot_ok(&sc->readback[r])) rb_ok++;
+    snprintf(scbuf, sizeof(scbuf), "SC_OK handle=0x%lx images=%u readback=%u/%d zero_copy=%d",
+             (unsigned long)sc->handle, sc->image_count, rb_ok, READBACK_RING, sc->zero_copy);
     layer_marker(scbuf);
-    LOG("Created swapchain 0x%lx with %u OPTIMAL images, staging=%s\n",
-        (unsigned long)sc->handle, sc->image_count,
-        sc->staging_buf ? "YES" : "NO");
+    LOG("Created swapchain 0x%lx with %u %s images, readback slots=%u/%d\n",
+        (unsigned long)sc->handle, sc->image_count, sc->zero_copy ? "AHB-imported" : "OPTIMAL",
+        rb_ok, READBACK_RING);
     return VK_SUCCESS;
 }
 
@@ -1692,33 +3005,30 @@ static void headless_DestroySwapchainKHR(
     if (!to_free) return;
 
     VkDevice dev = device ? device : to_free->device;
-    typedef VkResult (*PFN_WI)(VkDevice);
-    typedef void (*PFN_DI)(VkDevice, VkImage, const VkAllocationCallbacks*);
-    typedef void (*PFN_FM)(VkDevice, VkDeviceMemory, const VkAllocationCallbacks*);
-
-    PFN_WI fn_wait = (PFN_WI)next_device_proc_for(dev, "vkDeviceWaitIdle");
-    PFN_DI fn_di = (PFN_DI)next_device_proc_for(dev, "vkDestroyImage");
-    PFN_FM fn_fm = (PFN_FM)next_device_proc_for(dev, "vkFreeMemory");
+    const LayerDispatch* vk = to_free->vk;
 
-    if (fn_wait) fn_wait(dev);
+    if (vk->DeviceWaitIdle) vk->DeviceWaitIdle(dev);
 
-    /* Destroy staging resources */
-    if (to_free->copy_pool) {
-        typedef void (*PFN_DCP)(VkDevice, VkCommandPool, const VkAllocationCallbacks*);
-        PFN_DCP fn_dcp = (PFN_DCP)next_device_proc_for(dev, "vkDestroyCommandPool");
-        if (fn_dcp) fn_dcp(dev, to_free->copy_pool, NULL);
+    /* Destroy readback ring (DeviceWaitIdle above retired all copies) */
+    for (uint32_t r = 0; r < READBACK_RING; r++) {
+        ReadbackSlot* rs = &to_free->readback[r];
+        if (rs->fence && vk->DestroyFence) vk->DestroyFence(dev, rs->fence, NULL);
+        if (rs->mapped && vk->UnmapMemory) vk->UnmapMemory(dev, rs->mem);
+        if (rs->buf && vk->DestroyBuffer) vk->DestroyBuffer(dev, rs->buf, NULL);
+        if (rs->mem && vk->FreeMemory) vk->FreeMemory(dev, rs->mem, NULL);
     }
-    if (to_free->staging_buf) {
-        typedef void (*PFN_DB)(VkDevice, VkBuffer, const VkAllocationCallbacks*);
-        PFN_DB fn_db = (PFN_DB)next_device_proc_for(dev, "vkDestroyBuffer");
-        if (fn_db) fn_db(dev, to_free->staging_buf, NULL);
-    }
-    if (to_free->staging_mem && fn_fm) fn_fm(dev, to_free->staging_mem, NULL);
+    if (to_free->copy_pool && vk->DestroyCommandPool)
+        vk->DestroyCommandPool(dev, to_free->copy_pool, NULL);
+    for (uint32_t i = 0; i < MAX_SC_IMAGES; i++)
+        if (to_free->zc_fence[i] && vk->DestroyFence) vk->DestroyFence(dev, to_free->zc_fence[i], NULL);
 
     for (uint32_t i = 0; i < to_free->image_count; i++) {
-        if (to_free->images[i] && fn_di) fn_di(dev, to_free->images[i], NULL);
-        if (to_free->memory[i] && fn_fm) fn_fm(dev, to_free->memory[i], NULL);
+        if (to_free->images[i] && vk->DestroyImage) vk->DestroyImage(dev, to_free->images[i], NULL);
+        if (to_free->memory[i] && vk->FreeMemory) vk->FreeMemory(dev, to_free->memory[i], NULL);
     }
+    /* Our imports are gone; the presenter can drop its buffers */
+    if (zc_owns_slots(to_free)) ahb_release();
+    if (g_ahb_owner == to_free) g_ahb_owner = NULL;
     free(to_free);
     LOG("Destroyed swapchain 0x%lx\n", (unsigned long)swapchain);
 }
@@ -1753,20 +3063,27 @@ static VkResult headless_AcquireNextImageKHR(
         if (fn) return fn(device, swapchain, timeout, sem, fence, pImageIndex);
         return VK_ERROR_INITIALIZATION_FAILED;
     }
-    *pImageIndex = sc->current_image;
-    sc->current_image = (sc->current_image + 1) % sc->image_count;
+
+    VkResult paced = pace_acquire(&sc->pacer, sc->zero_copy, timeout);
+    if (paced != VK_SUCCESS) {
+        TRACE_POINT("ANI_NOT_READY", paced);
+        return paced;
+    }
+    if (sc->zero_copy) {
+        VkResult zr = zc_acquire(sc, timeout, pImageIndex);
+        if (zr != VK_SUCCESS) {
+            TRACE_POINT("ANI_ZC_NOT_READY", zr);
+            return zr;
+        }
+    } else {
+        *pImageIndex = sc->current_image;
+        sc->current_image = (sc->current_image + 1) % sc->image_count;
+    }
 
     /* Signal the acquire semaphore and/or fence via a no-op queue submit.
      * Without this, DXVK's vkQueueSubmit waits forever on the unsignaled
      * semaphore — the headless "presentation engine" is always ready. */
-    {
-        char abuf[256];
-        snprintf(abuf, sizeof(abuf), "ANI img=%u sem=0x%llx fence=0x%llx queue=%p dev=%p",
-                 pImageIndex ? *pImageIndex : 99,
-                 (unsigned long long)sem, (unsigned long long)fence,
-                 sc->signal_queue, device);
-        layer_marker(abuf);
-    }
+    TRACE_POINT("ANI_IMAGE", *pImageIndex);
 
     if ((sem || fence) && sc->signal_queue) {
         VkSubmitInfo si;
@@ -1776,23 +3093,14 @@ static VkResult headless_AcquireNextImageKHR(
             si.signalSemaphoreCount = 1;
             si.pSignalSemaphores = &sem;
         }
-        typedef VkResult (*PFN_QS)(VkQueue, uint32_t, const VkSubmitInfo*, VkFence);
-        PFN_QS fn_qs = (PFN_QS)next_device_proc_for(device, "vkQueueSubmit");
-        {
-            char abuf[128];
-            snprintf(abuf, sizeof(abuf), "ANI_SIGNAL fn_qs=%p", (void*)fn_qs);
-            layer_marker(abuf);
-        }
-        if (fn_qs) {
-            VkResult r = fn_qs(sc->signal_queue, 1, &si, fence);
-            {
-                char abuf[128];
-                snprintf(abuf, sizeof(abuf), "ANI_SIGNAL_RESULT=%d", r);
-                layer_marker(abuf);
-            }
+        if (sc->vk->QueueSubmit) {
+            VkResult r = sc->vk->QueueSubmit(sc->signal_queue, 1, &si, fence);
+            TRACE_POINT("ANI_SIGNAL_RESULT", r);
+        } else {
+            TRACE_POINT("ANI_SIGNAL_NO_FN", 0);
         }
     } else {
-        layer_marker("ANI_NO_SIGNAL");
+        TRACE_POINT("ANI_NO_SIGNAL", 0);
     }
 
     return VK_SUCCESS;
@@ -1862,7 +3170,93 @@ static void dump_frame_ppm(int frame_num, uint32_t width, uint32_t height, const
     }
 }
 
-static int g_present_count = 0;
+/* Wait for a readback slot's copy, then map it and hand the frame to the
+ * dump / TCP path. Clears the slot's pending flag. */
+static void readback_deliver(SwapchainEntry* sc, ReadbackSlot* rs)
+{
+    const LayerDispatch* vk = sc->vk;
+
+    rs->pending = 0;
+    if (!vk->WaitForFences) return;
+    VkResult wres = vk->WaitForFences(sc->device, 1, &rs->fence, VK_TRUE, UINT64_MAX);
+    TRACE_POINT("READBACK_WAIT", wres);
+    FRAME_LOG("[COPY] WaitForFences=%d frame=%lu\n", wres, (unsigned long)rs->seq);
+    if (wres != VK_SUCCESS) {
+        LOG("[COPY] WaitForFences failed: %d (frame %lu)\n", wres, (unsigned long)rs->seq);
+        return;
+    }
+    void* mapped = rs->mapped;
+    if (sc->staging_invalidate && vk->InvalidateMappedMemoryRanges) {
+        VkMappedMemoryRange range = {0};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = rs->mem;
+        range.size = VK_WHOLE_SIZE;
+        vk->InvalidateMappedMemoryRanges(sc->device, 1, &range);
+    }
+
+    /* Check first 16 bytes for sentinel vs real data */
+    const uint8_t *px = (const uint8_t *)mapped;
+    FRAME_LOG("[COPY] First 16 bytes: %02x %02x %02x %02x %02x %02x %02x %02x "
+        "%02x %02x %02x %02x %02x %02x %02x %02x\n",
+        px[0], px[1], px[2], px[3], px[4], px[5], px[6], px[7],
+        px[8], px[9], px[10], px[11], px[12], px[13], px[14], px[15]);
+    /* Check center pixel too */
+    uint32_t center_off = (sc->height/2 * sc->width + sc->width/2) * 4;
+    FRAME_LOG("[COPY] Center pixel @%u: %02x %02x %02x %02x\n",
+        center_off, px[center_off], px[center_off+1],
+        px[center_off+2], px[center_off+3]);
+
+    /* Alpha is forced by the transport copy (copy_frame_alpha); dump
+     * mode writes RGB only, so the staging memory is never modified. */
+
+    if (g_dump_mode) {
+        /* Dump mode: write PPM files, skip frame transport */
+        if (g_dump_frame_count < g_dump_max_frames) {
+            dump_frame_ppm(g_dump_frame_count, sc->width, sc->height, mapped);
+        }
+    } else {
+        /* Normal mode: shared memory (TCP fallback) */
+        publish_frame(sc->width, sc->height, mapped, sc->width * 4, (uint32_t)sc->format);
+
+        /* Legacy single-frame dump (backward compat) */
+        {
+            static int dumped = 0;
+            if (!dumped && getenv("HEADLESS_DUMP_PPM")) {
+                dumped = 1;
+                FILE *f = fopen("/tmp/frame_dump.ppm", "wb");
+                if (f) {
+                    fprintf(f, "P6\n%u %u\n255\n", sc->width, sc->height);
+                    for (uint32_t y = 0; y < sc->height; y++) {
+                        for (uint32_t x = 0; x < sc->width; x++) {
+                            uint32_t off = (y * sc->width + x) * 4;
+                            uint8_t rgb[3] = { px[off+2], px[off+1], px[off+0] };
+                            fwrite(rgb, 1, 3, f);
+                        }
+                    }
+                    fclose(f);
+                    LOG("PPM frame dumped: /tmp/frame_dump.ppm (%ux%u)\n",
+                        sc->width, sc->height);
+                }
+            }
+        }
+    }
+}
+
+/* Deliver every pending slot other than `current`, oldest first, so frames
+ * reach the reader in present order. */
+static void readback_deliver_older(SwapchainEntry* sc, ReadbackSlot* current)
+{
+    for (;;) {
+        ReadbackSlot* oldest = NULL;
+        for (uint32_t r = 0; r < READBACK_RING; r++) {
+            ReadbackSlot* rs = &sc->readback[r];
+            if (rs == current || !rs->pending) continue;
+            if (!oldest || rs->seq < oldest->seq) oldest = rs;
+        }
+        if (!oldest) break;
+        readback_deliver(sc, oldest);
+    }
+}
 
 static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo)
 {
@@ -1904,51 +3298,48 @@ static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR*
         SwapchainEntry* sc = find_swapchain(pPresentInfo->pSwapchains[i]);
         if (!sc) {
             /* Forward to ICD */
+            LayerDevice* ld = layer_device_for(queue);
             typedef VkResult (*PFN)(VkQueue, const VkPresentInfoKHR*);
-            PFN fn = (PFN)next_device_proc("vkQueuePresentKHR");
+            PFN fn = ld ? ld->vk.QueuePresentKHR : (PFN)next_device_proc("vkQueuePresentKHR");
             if (fn) return fn(queue, pPresentInfo);
             continue;
         }
 
         uint32_t idx = pPresentInfo->pImageIndices[i];
+        if (sc->zero_copy) {
+            if (idx < sc->image_count && queue)
+                zc_present(sc, queue, idx, i == 0 ? pPresentInfo->waitSemaphoreCount : 0,
+                           pPresentInfo->pWaitSemaphores);
+            if (pPresentInfo->pResults)
+                pPresentInfo->pResults[i] = VK_SUCCESS;
+            continue;
+        }
+
+        ReadbackSlot* rs = &sc->readback[sc->rb_next];
         if (idx < sc->image_count && sc->images[idx] &&
-            sc->staging_buf && sc->copy_cmd && queue) {
-
-            /* Resolve command recording functions */
-            typedef VkResult (*PFN_BCB)(VkCommandBuffer, const VkCommandBufferBeginInfo_t*);
-            typedef VkResult (*PFN_ECB)(VkCommandBuffer);
-            typedef VkResult (*PFN_RCB)(VkCommandBuffer, VkFlags);
-            typedef void (*PFN_CPB)(VkCommandBuffer, VkFlags, VkFlags, VkFlags,
-                                    uint32_t, const void*, uint32_t, const void*,
-                                    uint32_t, const VkImageMemoryBarrier*);
-            typedef void (*PFN_CITB)(VkCommandBuffer, VkImage, int, VkBuffer,
-                                     uint32_t, const VkBufferImageCopy*);
-            typedef VkResult (*PFN_QS)(VkQueue, uint32_t, const VkSubmitInfo*, uint64_t);
-            typedef VkResult (*PFN_QWI)(VkQueue);
-            typedef VkResult (*PFN_MM)(VkDevice, VkDeviceMemory, VkDeviceSize, VkDeviceSize, VkFlags, void**);
-            typedef void (*PFN_UM)(VkDevice, VkDeviceMemory);
-
-            PFN_RCB fn_rcb = (PFN_RCB)next_device_proc_for(sc->device, "vkResetCommandBuffer");
-            PFN_BCB fn_bcb = (PFN_BCB)next_device_proc_for(sc->device, "vkBeginCommandBuffer");
-            PFN_ECB fn_ecb = (PFN_ECB)next_device_proc_for(sc->device, "vkEndCommandBuffer");
-            PFN_CPB fn_cpb = (PFN_CPB)next_device_proc_for(sc->device, "vkCmdPipelineBarrier");
-            PFN_CITB fn_citb = (PFN_CITB)next_device_proc_for(sc->device, "vkCmdCopyImageToBuffer");
-            PFN_QS fn_qs = (PFN_QS)next_device_proc_for(sc->device, "vkQueueSubmit");
-            PFN_QWI fn_qwi = (PFN_QWI)next_device_proc_for(sc->device, "vkQueueWaitIdle");
-            PFN_MM fn_map = (PFN_MM)next_device_proc_for(sc->device, "vkMapMemory");
-            PFN_UM fn_unmap = (PFN_UM)next_device_proc_for(sc->device, "vkUnmapMemory");
-
-            if (fn_rcb && fn_bcb && fn_ecb && fn_citb && fn_cpb && fn_qs && fn_qwi) {
+            readback_slot_ok(rs) && queue) {
+
+            /* Command recording goes through the swapchain's cached dispatch */
+            const LayerDispatch* vk = sc->vk;
+
+            if (vk->ResetCommandBuffer && vk->BeginCommandBuffer && vk->EndCommandBuffer &&
+                vk->CmdCopyImageToBuffer && vk->CmdPipelineBarrier && vk->QueueSubmit &&
+                vk->ResetFences) {
+                /* Slot still in flight from READBACK_RING presents ago —
+                 * only happens if its delivery was skipped. Retire it first. */
+                if (rs->pending)
+                    readback_deliver(sc, rs);
+
                 /* Record: barrier(PRESENT_SRC→TRANSFER_SRC) + CopyImageToBuffer
                  * Barriers work on ARM64 host side (no handle wrapping issues) */
-                VkResult rcb_res = fn_rcb(sc->copy_cmd, 0);
-                LOG("[COPY] ResetCB=%d cmd=%p\n", rcb_res, sc->copy_cmd);
+                VkResult rcb_res = vk->ResetCommandBuffer(rs->cmd, 0);
+                FRAME_LOG("[COPY] ResetCB=%d cmd=%p slot=%u\n", rcb_res, rs->cmd, sc->rb_next);
 
                 VkCommandBufferBeginInfo_t bi = {0};
                 bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
                 bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-                VkResult bcb_res = fn_bcb(sc->copy_cmd, &bi);
-                LOG("[COPY] BeginCB=%d\n", bcb_res);
+                VkResult bcb_res = vk->BeginCommandBuffer(rs->cmd, &bi);
+                FRAME_LOG("[COPY] BeginCB=%d\n", bcb_res);
 
                 /* Barrier: PRESENT_SRC → TRANSFER_SRC */
                 {
@@ -1964,13 +3355,13 @@ static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR*
                     imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
                     imb.subresourceRange.levelCount = 1;
                     imb.subresourceRange.layerCount = 1;
-                    fn_cpb(sc->copy_cmd,
+                    vk->CmdPipelineBarrier(rs->cmd,
                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
                            VK_PIPELINE_STAGE_TRANSFER_BIT,
                            0, 0, NULL, 0, NULL, 1, &imb);
                 }
 
-                /* Copy image to staging buffer */
+                /* Copy image to this slot's staging buffer */
                 VkBufferImageCopy region = {0};
                 region.bufferRowLength = 0;      /* tightly packed */
                 region.bufferImageHeight = 0;
@@ -1980,13 +3371,13 @@ static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR*
                 region.imageExtent.height = sc->height;
                 region.imageExtent.depth = 1;
 
-                LOG("[COPY] CopyImageToBuffer: img=0x%lx buf=0x%lx %ux%u\n",
-                    (unsigned long)sc->images[idx], (unsigned long)sc->staging_buf,
+                FRAME_LOG("[COPY] CopyImageToBuffer: img=0x%lx buf=0x%lx %ux%u\n",
+                    (unsigned long)sc->images[idx], (unsigned long)rs->buf,
                     sc->width, sc->height);
-                fn_citb(sc->copy_cmd, sc->images[idx],
+                vk->CmdCopyImageToBuffer(rs->cmd, sc->images[idx],
                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                        sc->staging_buf, 1, &region);
-                LOG("[COPY] CopyImageToBuffer recorded\n");
+                        rs->buf, 1, &region);
+                FRAME_LOG("[COPY] CopyImageToBuffer recorded\n");
 
                 /* Barrier: TRANSFER_SRC → PRESENT_SRC (restore for next frame) */
                 {
@@ -2002,17 +3393,17 @@ static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR*
                     rb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
                     rb.subresourceRange.levelCount = 1;
                     rb.subresourceRange.layerCount = 1;
-                    fn_cpb(sc->copy_cmd,
+                    vk->CmdPipelineBarrier(rs->cmd,
                            VK_PIPELINE_STAGE_TRANSFER_BIT,
                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                            0, 0, NULL, 0, NULL, 1, &rb);
                 }
-                LOG("[COPY] Barrier TRANSFER_SRC→PRESENT_SRC recorded\n");
+                FRAME_LOG("[COPY] Barrier TRANSFER_SRC→PRESENT_SRC recorded\n");
 
-                VkResult ecb_res = fn_ecb(sc->copy_cmd);
-                LOG("[COPY] EndCB=%d\n", ecb_res);
+                VkResult ecb_res = vk->EndCommandBuffer(rs->cmd);
+                FRAME_LOG("[COPY] EndCB=%d\n", ecb_res);
 
-                /* Submit copy and wait.
+                /* Submit copy with the slot's fence — no QueueWaitIdle.
                  * CRITICAL: consume the present's wait semaphores here so
                  * binary semaphores transition to unsignaled.  Otherwise the
                  * next QueueSubmit that signals them hits a spec violation
@@ -2021,91 +3412,44 @@ static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR*
                 memset(&si, 0, sizeof(si));
                 si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
                 si.commandBufferCount = 1;
-                si.pCommandBuffers = &sc->copy_cmd;
-                VkFlags wait_stages[8];
+                si.pCommandBuffers = &rs->cmd;
+                VkFlags stage_buf[8];
+                VkFlags* wait_stages = stage_buf;
                 if (i == 0 && pPresentInfo->waitSemaphoreCount > 0) {
                     uint32_t wc = pPresentInfo->waitSemaphoreCount;
-                    if (wc > 8) wc = 8;
+                    if (wc > 8 && !(wait_stages = malloc(wc * sizeof(VkFlags)))) {
+                        LOG("[COPY] out of memory for %u wait semaphores\n", wc);
+                        wait_stages = stage_buf;
+                        wc = 8;
+                    }
                     si.waitSemaphoreCount = wc;
                     si.pWaitSemaphores = pPresentInfo->pWaitSemaphores;
                     for (uint32_t w = 0; w < wc; w++)
                         wait_stages[w] = VK_PIPELINE_STAGE_TRANSFER_BIT;
                     si.pWaitDstStageMask = wait_stages;
                 }
-                VkResult qs_res = fn_qs(queue, 1, &si, 0);
-                LOG("[COPY] QueueSubmit=%d (waitSems=%u)\n", qs_res, si.waitSemaphoreCount);
-                VkResult qwi_res = fn_qwi(queue);
-                LOG("[COPY] QueueWaitIdle=%d\n", qwi_res);
-
-                /* Map staging buffer and send frame */
-                if (fn_map && fn_unmap) {
-                    void* mapped = NULL;
-                    VkResult mres = fn_map(sc->device, sc->staging_mem, 0,
-                                           sc->staging_size, 0, &mapped);
-                    LOG("[COPY] MapMemory=%d ptr=%p\n", mres, mapped);
-                    if (mres == VK_SUCCESS && mapped) {
-                        /* Check first 16 bytes for sentinel vs real data */
-                        const uint8_t *px = (const uint8_t *)mapped;
-                        LOG("[COPY] First 16 bytes: %02x %02x %02x %02x %02x %02x %02x %02x "
-                            "%02x %02x %02x %02x %02x %02x %02x %02x\n",
-                            px[0], px[1], px[2], px[3], px[4], px[5], px[6], px[7],
-                            px[8], px[9], px[10], px[11], px[12], px[13], px[14], px[15]);
-                        /* Check center pixel too */
-                        uint32_t center_off = (sc->height/2 * sc->width + sc->width/2) * 4;
-                        LOG("[COPY] Center pixel @%u: %02x %02x %02x %02x\n",
-                            center_off, px[center_off], px[center_off+1],
-                            px[center_off+2], px[center_off+3]);
-
-                        /* Force alpha=255 — DXVK doesn't write swapchain alpha
-                         * (irrelevant on desktop), but our readback captures it
-                         * as transparent. Set every 4th byte to 0xFF. */
-                        {
-                            uint8_t *dst = (uint8_t *)mapped;
-                            uint32_t npx = sc->width * sc->height;
-                            for (uint32_t i = 0; i < npx; i++)
-                                dst[i * 4 + 3] = 0xFF;
-                        }
-
-                        if (g_dump_mode) {
-                            /* Dump mode: write PPM files, skip TCP */
-                            if (g_dump_frame_count < g_dump_max_frames) {
-                                dump_frame_ppm(g_dump_frame_count, sc->width, sc->height, mapped);
-                            }
-                        } else {
-                            /* Normal mode: send via TCP */
-                            send_frame(sc->width, sc->height, mapped, sc->width * 4);
-
-                            /* Legacy single-frame dump (backward compat) */
-                            {
-                                static int dumped = 0;
-                                if (!dumped && getenv("HEADLESS_DUMP_PPM")) {
-                                    dumped = 1;
-                                    FILE *f = fopen("/tmp/frame_dump.ppm", "wb");
-                                    if (f) {
-                                        fprintf(f, "P6\n%u %u\n255\n", sc->width, sc->height);
-                                        for (uint32_t y = 0; y < sc->height; y++) {
-                                            for (uint32_t x = 0; x < sc->width; x++) {
-                                                uint32_t off = (y * sc->width + x) * 4;
-                                                uint8_t rgb[3] = { px[off+2], px[off+1], px[off+0] };
-                                                fwrite(rgb, 1, 3, f);
-                                            }
-                                        }
-                                        fclose(f);
-                                        LOG("PPM frame dumped: /tmp/frame_dump.ppm (%ux%u)\n",
-                                            sc->width, sc->height);
-                                    }
-                                }
-                            }
-                        }
-
-                        fn_unmap(sc->device, sc->staging_mem);
-                    }
+                vk->ResetFences(sc->device, 1, &rs->fence);
+                VkResult qs_res = vk->QueueSubmit(queue, 1, &si, rs->fence);
+                if (wait_stages != stage_buf) free(wait_stages);
+                TRACE_POINT("READBACK_SUBMIT", qs_res);
+                FRAME_LOG("[COPY] QueueSubmit=%d (waitSems=%u) slot=%u\n",
+                    qs_res, si.waitSemaphoreCount, sc->rb_next);
+                if (qs_res != VK_SUCCESS)
+                    LOG("[COPY] QueueSubmit failed: %d\n", qs_res);
+
+                if (qs_res == VK_SUCCESS) {
+                    rs->pending = 1;
+                    rs->seq = sc->present_seq++;
                 }
+                sc->rb_next = (sc->rb_next + 1) % READBACK_RING;
+
+                /* Deliver the previous frame(s) while this copy runs on the GPU.
+                 * Their fences were submitted a whole present ago, so the wait
+                 * is normally already satisfied. */
+                readback_deliver_older(sc, rs);
             } else {
                 /* Fallback: just wait idle (no readback) */
-                typedef VkResult (*PFN_QWI2)(VkQueue);
-                PFN_QWI2 fn_qwi2 = (PFN_QWI2)next_device_proc_for(sc->device, "vkQueueWaitIdle");
-                if (fn_qwi2 && queue) fn_qwi2(queue);
+                if (vk->QueueWaitIdle) vk->QueueWaitIdle(queue);
             }
         }
 
@@ -2113,17 +3457,7 @@ static VkResult headless_QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR*
             pPresentInfo->pResults[i] = VK_SUCCESS;
     }
 
-    /* Vsync emulation */
-    uint64_t now = get_time_ns();
-    if (g_last_present_ns > 0) {
-        uint64_t elapsed = now - g_last_present_ns;
-        if (elapsed < TARGET_FRAME_NS) {
-            struct timespec ts = {0, (long)(TARGET_FRAME_NS - elapsed)};
-            nanosleep(&ts, NULL);
-        }
-    }
-    g_last_present_ns = get_time_ns();
-
+    /* No sleep here: FIFO pacing happens in vkAcquireNextImageKHR (Section 4c) */
     return VK_SUCCESS;
 }
 
@@ -2592,7 +3926,8 @@ static VkResult headless_CreateDevice(
         }
     }
 
-    const char** filtered = malloc(pCreateInfo->enabledExtensionCount * sizeof(char*));
+    /* +2: extensions the zero-copy swapchain path adds below */
+    const char** filtered = malloc((pCreateInfo->enabledExtensionCount + 2) * sizeof(char*));
     uint32_t fc = 0;
     for (uint32_t i = 0; i < pCreateInfo->enabledExtensionCount; i++) {
         const char* ext = pCreateInfo->ppEnabledExtensionNames[i];
@@ -2627,6 +3962,32 @@ static VkResult headless_CreateDevice(
             LOG("Filtering spoofed extension (ICD lacks): %s\n", ext);
         }
     }
+
+    /* Zero-copy swapchains (Section 4d) import the presenter's
+     * AHardwareBuffers: enable the extensions for that whenever the driver
+     * chain exposes them, whether or not the app asked. The extension's
+     * other dependencies are core in the Vulkan 1.1+ DXVK/VKD3D require. */
+    int ahb_import = 0;
+    if (g_zero_copy) {
+        static const char* const zc_exts[] = {
+            "VK_ANDROID_external_memory_android_hardware_buffer",
+            "VK_EXT_queue_family_foreign",
+        };
+        int have = 0;
+        for (uint32_t e = 0; e < 2; e++)
+            for (uint32_t j = 0; j < icd_ext_count && icd_exts; j++)
+                if (strcmp(zc_exts[e], icd_exts[j].extensionName) == 0) { have++; break; }
+        if (have == 2) {
+            for (uint32_t e = 0; e < 2; e++) {
+                int dup = 0;
+                for (uint32_t j = 0; j < fc; j++)
+                    if (strcmp(filtered[j], zc_exts[e]) == 0) dup = 1;
+                if (!dup) filtered[fc++] = zc_exts[e];
+            }
+            ahb_import = 1;
+            LOG("Enabling AHardwareBuffer import for zero-copy swapchains\n");
+        }
+    }
     free(icd_exts);
 
     VkDeviceCreateInfo modified = *pCreateInfo;
@@ -2645,12 +4006,21 @@ static VkResult headless_CreateDevice(
     if (result == VK_SUCCESS) {
         g_next_gdpa = next_gdpa;
         g_device = *pDevice;
-        /* Store in per-device table */
-        if (g_device_count < MAX_LAYER_DEVICES) {
-            g_device_table[g_device_count].device = *pDevice;
-            g_device_table[g_device_count].gdpa = next_gdpa;
+        /* Store in per-device table with its dispatch resolved once */
+        pthread_mutex_lock(&g_device_lock);
+        for (int i = 0; i < MAX_LAYER_DEVICES; i++) {
+            LayerDevice* ld = &g_device_table[i];
+            if (ld->device) continue;
+            ld->key = dispatch_key(*pDevice);
+            ld->gdpa = next_gdpa;
+            ld->ahb_import = ahb_import;
+            dispatch_init(&ld->vk, *pDevice, next_gdpa);
+            __atomic_store_n(&ld->device, *pDevice, __ATOMIC_RELEASE);
             g_device_count++;
+            device_map_rebuild();
+            break;
         }
+        pthread_mutex_unlock(&g_device_lock);
         LOG("Device created: %p (tracked %d devices)\n", *pDevice, g_device_count);
         snprintf(buf, sizeof(buf), "CD_OK device=%p gdpa=%p", *pDevice, (void*)next_gdpa);
         layer_marker(buf);
@@ -2663,33 +4033,35 @@ static VkResult headless_CreateDevice(
 
 static void headless_DestroyDevice(VkDevice device, const VkAllocationCallbacks* pAllocator) {
     TRACE_FN("vkDestroyDevice");
-    /* Use THIS device's GDPA to resolve vkDestroyDevice */
-    typedef void (*PFN)(VkDevice, const VkAllocationCallbacks*);
-    PFN fn = (PFN)next_device_proc_for(device, "vkDestroyDevice");
-    if (fn) fn(device, pAllocator);
-
-    /* Remove from per-device table */
-    for (int i = 0; i < g_device_count; i++) {
+    /* Use THIS device's dispatch to call vkDestroyDevice */
+    const LayerDispatch* vk = dispatch_for(device);
+    if (vk->DestroyDevice) vk->DestroyDevice(device, pAllocator);
+
+    /* Remove from per-device table (slots never move — swapchains point
+     * into them) */
+    pthread_mutex_lock(&g_device_lock);
+    for (int i = 0; i < MAX_LAYER_DEVICES; i++) {
         if (g_device_table[i].device == device) {
-            /* Shift remaining entries down */
-            for (int j = i; j < g_device_count - 1; j++)
-                g_device_table[j] = g_device_table[j + 1];
+            __atomic_store_n(&g_device_table[i].device, NULL, __ATOMIC_RELEASE);
             g_device_count--;
+            device_map_rebuild();
             break;
         }
     }
 
     /* Only clear globals if THIS was the global device */
     if (g_device == device) {
-        if (g_device_count > 0) {
-            /* Point globals to another live device */
-            g_device = g_device_table[g_device_count - 1].device;
-            g_next_gdpa = g_device_table[g_device_count - 1].gdpa;
-        } else {
-            g_device = NULL;
-            g_next_gdpa = NULL;
+        g_device = NULL;
+        g_next_gdpa = NULL;
+        /* Point globals to another live device */
+        for (int i = 0; i < MAX_LAYER_DEVICES; i++) {
+            if (g_device_table[i].device) {
+                g_device = g_device_table[i].device;
+                g_next_gdpa = g_device_table[i].gdpa;
+            }
         }
     }
+    pthread_mutex_unlock(&g_device_lock);
     LOG("Device destroyed: %p (remaining %d devices)\n", device, g_device_count);
 }
 
@@ -3074,7 +4446,10 @@ VkResult vkNegotiateLoaderLayerInterfaceVersion(VkNegotiateLayerInterface* pVers
 __attribute__((constructor))
 static void layer_init(void) {
     LOG("Vulkan headless surface layer loaded (pid=%d)\n", getpid());
+    pthread_once(&g_trace_once, trace_open);
+    g_trace_abort_id = trace_intern("SIGABRT");
     signal(SIGABRT, sigabrt_handler);
+    select_copy_kernel();
 
     /* Dump mode: HEADLESS_DUMP_FRAMES=N writes first N frames as PPM to /tmp/ */
     const char *dump_env = getenv("HEADLESS_DUMP_FRAMES");
@@ -3095,4 +4470,21 @@ static void layer_init(void) {
             LOG("DUMP MODE enabled: will capture %d frames to /tmp/frame_NNNN.ppm\n", g_dump_max_frames);
         }
     }
+
+    /* HEADLESS_VERBOSE=1 keeps the per-frame [COPY] logs past the first frames */
+    const char *verbose = getenv("HEADLESS_VERBOSE");
+    if (verbose && verbose[0] == '1') g_verbose = 1;
+    const char *inval = getenv("HEADLESS_STAGING_INVALIDATE");
+    if (inval && inval[0] == '1') g_force_invalidate = 1;
+
+    /* HEADLESS_FRAME_TRANSPORT=tcp forces the legacy FrameSocketServer path */
+    const char *transport = getenv("HEADLESS_FRAME_TRANSPORT");
+    if (transport && strcmp(transport, "tcp") == 0) {
+        g_shm_disabled = 1;
+        LOG("Frame transport: TCP %d (forced)\n", FRAME_SOCKET_PORT);
+    }
+
+    /* HEADLESS_ZERO_COPY=0 keeps every swapchain on the readback path */
+    const char *zero_copy = getenv("HEADLESS_ZERO_COPY");
+    if (zero_copy && zero_copy[0] == '0') g_zero_copy = 0;
 }
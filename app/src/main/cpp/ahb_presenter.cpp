@@ -0,0 +1,568 @@
+/**
+ * AhbPresenter JNI - zero-copy presentation of the headless layer's swapchains
+ *
+ * Owns /tmp/headless_ahb (layout in ahb_shm.h). When the layer creates a
+ * swapchain it asks for one AHardwareBuffer per image; the buffers are
+ * allocated here, imported by the layer as its swapchain images (the Vortek
+ * renderer that executes the layer's Vulkan calls lives in this process, so
+ * the pointers are valid for it), rendered into by the game, and posted to
+ * the SurfaceView unchanged through a child ASurfaceControl. No pixel is
+ * copied by a CPU on the way.
+ *
+ * ASurfaceControl is API 29 and minSdk is 26, so its entry points are looked
+ * up at runtime; below 29 nativeCreate fails and the layer keeps using the
+ * shm readback path.
+ *
+ * All presenter state is touched under Presenter::lock: nativePoll runs on the
+ * presenter thread, nativeSetSurface on whichever thread owns the Surface.
+ * SurfaceFlinger's OnComplete callbacks arrive on a binder thread and only
+ * append to the ReleaseQueue.
+ */
+
+#include <jni.h>
+#include <android/hardware_buffer.h>
+#include <android/log.h>
+#include <android/native_window.h>
+#include <android/native_window_jni.h>
+#include <android/rect.h>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ahb_shm.h"
+
+#define LOG_TAG "AhbPresenter"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+// While a release fence is outstanding the poll loop rechecks it this often
+#define RELEASE_POLL_NS 1000000LL
+
+// <android/surface_control.h> (API 29) is not usable with minSdk 26
+struct ASurfaceControl;
+struct ASurfaceTransaction;
+struct ASurfaceTransactionStats;
+
+#define ASURFACE_TRANSACTION_VISIBILITY_HIDE 0
+#define ASURFACE_TRANSACTION_VISIBILITY_SHOW 1
+#define ASURFACE_TRANSACTION_TRANSPARENCY_OPAQUE 2
+
+typedef void (*ASurfaceTransaction_OnComplete)(void *context, ASurfaceTransactionStats *stats);
+
+struct SurfaceControlApi {
+    ASurfaceControl *(*createFromWindow)(ANativeWindow *parent, const char *name);
+    void (*release)(ASurfaceControl *control);
+    ASurfaceTransaction *(*transactionCreate)();
+    void (*transactionDelete)(ASurfaceTransaction *t);
+    void (*apply)(ASurfaceTransaction *t);
+    void (*setOnComplete)(ASurfaceTransaction *t, void *context, ASurfaceTransaction_OnComplete fn);
+    void (*setBuffer)(ASurfaceTransaction *t, ASurfaceControl *control, AHardwareBuffer *buffer,
+                      int acquireFenceFd);
+    void (*setGeometry)(ASurfaceTransaction *t, ASurfaceControl *control, const ARect &source,
+                        const ARect &destination, int32_t transform);
+    void (*setVisibility)(ASurfaceTransaction *t, ASurfaceControl *control, int8_t visibility);
+    void (*setBufferTransparency)(ASurfaceTransaction *t, ASurfaceControl *control, int8_t transparency);
+    int (*getPreviousReleaseFenceFd)(ASurfaceTransactionStats *stats, ASurfaceControl *control);
+};
+
+static bool load_surface_control_api(SurfaceControlApi *api) {
+    void *lib = dlopen("libandroid.so", RTLD_NOW);
+    if (lib == nullptr) return false;
+#define SC_LOAD(field, name) \
+    if ((api->field = reinterpret_cast<decltype(api->field)>(dlsym(lib, name))) == nullptr) return false
+    SC_LOAD(createFromWindow, "ASurfaceControl_createFromWindow");
+    SC_LOAD(release, "ASurfaceControl_release");
+    SC_LOAD(transactionCreate, "ASurfaceTransaction_create");
+    SC_LOAD(transactionDelete, "ASurfaceTransaction_delete");
+    SC_LOAD(apply, "ASurfaceTransaction_apply");
+    SC_LOAD(setOnComplete, "ASurfaceTransaction_setOnComplete");
+    SC_LOAD(setBuffer, "ASurfaceTransaction_setBuffer");
+    SC_LOAD(setGeometry, "ASurfaceTransaction_setGeometry");
+    SC_LOAD(setVisibility, "ASurfaceTransaction_setVisibility");
+    SC_LOAD(setBufferTransparency, "ASurfaceTransaction_setBufferTransparency");
+    SC_LOAD(getPreviousReleaseFenceFd, "ASurfaceTransactionStats_getPreviousReleaseFenceFd");
+#undef SC_LOAD
+    return true;   // libandroid stays loaded for the life of the process
+}
+
+// A buffer SurfaceFlinger gave back, with the fence to wait for before reuse
+struct PendingRelease {
+    ASurfaceControl *control;   // control the completed transaction was applied to
+    int slot;               // -1 = nothing was on screen before
+    uint64_t generation;    // grant the slot index belongs to
+    int fence;              // -1 = already released
+};
+
+// Filled from binder threads by on_transaction_complete; shared with the
+// callbacks so it outlives a presenter destroyed while transactions are in flight
+struct ReleaseQueue {
+    std::mutex lock;
+    std::vector<PendingRelease> items;
+    bool closed = false;
+};
+
+struct CompleteContext {
+    std::shared_ptr<ReleaseQueue> queue;
+    int (*getPreviousReleaseFenceFd)(ASurfaceTransactionStats *stats, ASurfaceControl *control);
+    PendingRelease replaced;    // slot that was on screen before this transaction
+};
+
+struct SurfaceBinding {
+    ASurfaceControl *control;
+    int inflight;           // transactions whose OnComplete has not run yet
+};
+
+struct Presenter {
+    std::mutex lock;
+    SurfaceControlApi api;
+    AhbShmHeader *h = nullptr;
+
+    ANativeWindow *window = nullptr;
+    ASurfaceControl *control = nullptr;
+    std::vector<SurfaceBinding> bindings;   // current + detached controls awaiting callbacks
+    ARect source{}, destination{};
+    int32_t windowWidth = 0, windowHeight = 0;
+
+    AHardwareBuffer *buffers[AHB_SHM_SLOTS] = {};
+    uint32_t count = 0;
+    uint64_t generation = 0;    // request_seq of the current grant
+    int posted = -1;            // slot on screen
+    std::vector<PendingRelease> releases;
+    std::shared_ptr<ReleaseQueue> queue = std::make_shared<ReleaseQueue>();
+
+    uint64_t framesPosted = 0;
+    uint64_t framesDropped = 0;
+};
+
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+static void futex_wait(uint32_t *addr, uint32_t expected, int64_t timeout_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(timeout_ns / 1000000000LL);
+    ts.tv_nsec = (long)(timeout_ns % 1000000000LL);
+    syscall(SYS_futex, addr, FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+// Slot state transition by the presenter; wakes a layer waiting for a free slot
+static bool slot_transition(AhbShmHeader *h, int slot, uint32_t from, uint32_t to) {
+    uint32_t expected = from;
+    if (!__atomic_compare_exchange_n(&h->slots[slot].state, &expected, to, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    if (to == AHB_SLOT_FREE) {
+        __atomic_add_fetch(&h->free_seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&h->free_seq);
+    }
+    return true;
+}
+
+// Hand every slot the layer is not rendering into back to it
+static void free_displayed_slots(Presenter *p) {
+    for (uint32_t i = 0; i < p->count; i++) {
+        slot_transition(p->h, (int)i, AHB_SLOT_QUEUED, AHB_SLOT_FREE);
+        slot_transition(p->h, (int)i, AHB_SLOT_POSTED, AHB_SLOT_FREE);
+    }
+    p->posted = -1;
+}
+
+static void on_transaction_complete(void *context, ASurfaceTransactionStats *stats) {
+    auto *ctx = static_cast<CompleteContext *>(context);
+    PendingRelease release = ctx->replaced;
+    release.fence = release.slot >= 0 ? ctx->getPreviousReleaseFenceFd(stats, release.control) : -1;
+    {
+        std::lock_guard<std::mutex> guard(ctx->queue->lock);
+        if (!ctx->queue->closed) {
+            ctx->queue->items.push_back(release);
+            release.fence = -1;
+        }
+    }
+    if (release.fence >= 0) close(release.fence);
+    delete ctx;
+}
+
+// ----------------------------------------------------------------------------
+// Surface binding
+// ----------------------------------------------------------------------------
+
+static void detach_surface(Presenter *p) {
+    if (p->control != nullptr) {
+        ASurfaceTransaction *t = p->api.transactionCreate();
+        p->api.setVisibility(t, p->control, ASURFACE_TRANSACTION_VISIBILITY_HIDE);
+        p->api.apply(t);
+        p->api.transactionDelete(t);
+        p->control = nullptr;   // released once its in-flight callbacks have run
+    }
+    if (p->window != nullptr) {
+        ANativeWindow_release(p->window);
+        p->window = nullptr;
+    }
+    __atomic_store_n(&p->h->ready, 0u, __ATOMIC_RELEASE);
+    free_displayed_slots(p);
+}
+
+static bool attach_surface(Presenter *p, ANativeWindow *window) {
+    ASurfaceControl *control = p->api.createFromWindow(window, "HeadlessSwapchain");
+    if (control == nullptr) {
+        LOGE("ASurfaceControl_createFromWindow failed");
+        ANativeWindow_release(window);
+        return false;
+    }
+    p->window = window;
+    p->control = control;
+    p->bindings.push_back({control, 0});
+    p->windowWidth = p->windowHeight = 0;   // forces setGeometry on the first post
+    __atomic_store_n(&p->h->ready, 1u, __ATOMIC_RELEASE);
+    LOGI("Attached to surface %dx%d", ANativeWindow_getWidth(window), ANativeWindow_getHeight(window));
+    return true;
+}
+
+static SurfaceBinding *binding_for(Presenter *p, ASurfaceControl *control) {
+    for (auto &b : p->bindings)
+        if (b.control == control) return &b;
+    return nullptr;
+}
+
+// ----------------------------------------------------------------------------
+// Poll steps
+// ----------------------------------------------------------------------------
+
+// Answer a new buffer request from the layer. The layer's imports hold their
+// own references, so the previous set can be released right away.
+static void handle_request(Presenter *p) {
+    AhbShmHeader *h = p->h;
+    uint64_t request = __atomic_load_n(&h->request_seq, __ATOMIC_ACQUIRE);
+    if (request == __atomic_load_n(&h->grant_seq, __ATOMIC_RELAXED)) return;
+
+    for (uint32_t i = 0; i < AHB_SHM_SLOTS; i++) {
+        if (p->buffers[i] != nullptr) AHardwareBuffer_release(p->buffers[i]);
+        p->buffers[i] = nullptr;
+        h->slots[i].buffer = 0;
+        h->slots[i].state = AHB_SLOT_FREE;
+        h->slots[i].frame_seq = 0;
+    }
+    p->count = 0;
+    p->posted = -1;
+    p->generation = request;
+
+    uint32_t count = h->count < AHB_SHM_SLOTS ? h->count : AHB_SHM_SLOTS;
+    int32_t status = 0;
+    AHardwareBuffer_Desc desc = {};
+    desc.width = h->width;
+    desc.height = h->height;
+    desc.layers = 1;
+    desc.format = h->format;
+    desc.usage = AHARDWAREBUFFER_USAGE_GPU_COLOR_OUTPUT |
+                 AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE |
+                 AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY;
+    for (uint32_t i = 0; i < count; i++) {
+        if (AHardwareBuffer_allocate(&desc, &p->buffers[i]) != 0) {
+            LOGE("AHardwareBuffer_allocate %ux%u format %u failed", desc.width, desc.height, desc.format);
+            status = -1;
+            break;
+        }
+        h->slots[i].buffer = reinterpret_cast<uint64_t>(p->buffers[i]);
+    }
+    if (status == 0) {
+        p->count = count;
+        if (count > 0) LOGI("Granted %u buffers %ux%u format %u", count, desc.width, desc.height, desc.format);
+        else LOGI("Layer released its buffers");
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            if (p->buffers[i] != nullptr) AHardwareBuffer_release(p->buffers[i]);
+            p->buffers[i] = nullptr;
+            h->slots[i].buffer = 0;
+        }
+    }
+    h->grant_status = status;
+    __atomic_store_n(&h->grant_seq, request, __ATOMIC_RELEASE);
+}
+
+// Return buffers SurfaceFlinger is done with. Returns true while a release
+// fence is still outstanding.
+static bool reap_releases(Presenter *p) {
+    {
+        std::lock_guard<std::mutex> guard(p->queue->lock);
+        for (const auto &r : p->queue->items) {
+            // A completed transaction no longer pins its control
+            SurfaceBinding *b = binding_for(p, r.control);
+            if (b != nullptr) b->inflight--;
+            p->releases.push_back(r);
+        }
+        p->queue->items.clear();
+    }
+
+    for (size_t i = 0; i < p->releases.size();) {
+        PendingRelease &r = p->releases[i];
+        if (r.fence >= 0) {
+            struct pollfd pfd = {r.fence, POLLIN, 0};
+            if (poll(&pfd, 1, 0) == 0) {
+                i++;
+                continue;
+            }
+            close(r.fence);
+        }
+        if (r.generation == p->generation && r.slot >= 0 && r.slot != p->posted)
+            slot_transition(p->h, r.slot, AHB_SLOT_POSTED, AHB_SLOT_FREE);
+        p->releases.erase(p->releases.begin() + (long)i);
+    }
+
+    // Controls replaced by a newer surface go once nothing references them
+    for (size_t i = 0; i < p->bindings.size();) {
+        SurfaceBinding &b = p->bindings[i];
+        if (b.control != p->control && b.inflight == 0) {
+            p->api.release(b.control);
+            p->bindings.erase(p->bindings.begin() + (long)i);
+        } else {
+            i++;
+        }
+    }
+    return !p->releases.empty();
+}
+
+static void update_geometry(Presenter *p, ASurfaceTransaction *t, uint32_t width, uint32_t height) {
+    int32_t ww = ANativeWindow_getWidth(p->window);
+    int32_t wh = ANativeWindow_getHeight(p->window);
+    ARect source = {0, 0, (int32_t)width, (int32_t)height};
+    if (ww == p->windowWidth && wh == p->windowHeight &&
+        source.right == p->source.right && source.bottom == p->source.bottom) {
+        return;
+    }
+    // Scale to fit, centered (FrameShmReader draws the readback path the same way)
+    float scale = std::min((float)ww / (float)width, (float)wh / (float)height);
+    int32_t dw = (int32_t)((float)width * scale);
+    int32_t dh = (int32_t)((float)height * scale);
+    ARect destination = {(ww - dw) / 2, (wh - dh) / 2, (ww - dw) / 2 + dw, (wh - dh) / 2 + dh};
+    p->api.setGeometry(t, p->control, source, destination, 0);
+    p->source = source;
+    p->destination = destination;
+    p->windowWidth = ww;
+    p->windowHeight = wh;
+}
+
+// Post the newest queued slot; older queued slots are dropped (mailbox).
+// Returns true if a frame was posted.
+static bool post_newest(Presenter *p) {
+    AhbShmHeader *h = p->h;
+    int newest = -1;
+    for (uint32_t i = 0; i < p->count; i++) {
+        if (__atomic_load_n(&h->slots[i].state, __ATOMIC_ACQUIRE) != AHB_SLOT_QUEUED) continue;
+        if (newest < 0 || h->slots[i].frame_seq > h->slots[newest].frame_seq) newest = (int)i;
+    }
+    if (newest < 0) return false;
+    for (uint32_t i = 0; i < p->count; i++) {
+        if ((int)i != newest && slot_transition(h, (int)i, AHB_SLOT_QUEUED, AHB_SLOT_FREE))
+            p->framesDropped++;
+    }
+    if (p->control == nullptr) {
+        slot_transition(h, newest, AHB_SLOT_QUEUED, AHB_SLOT_FREE);
+        return false;
+    }
+    if (!slot_transition(h, newest, AHB_SLOT_QUEUED, AHB_SLOT_POSTED)) return false;
+
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(p->buffers[newest], &desc);
+
+    auto *ctx = new CompleteContext{p->queue, p->api.getPreviousReleaseFenceFd, {p->control, p->posted, p->generation, -1}};
+    ASurfaceTransaction *t = p->api.transactionCreate();
+    update_geometry(p, t, desc.width, desc.height);
+    // The layer queues a slot only after its GPU work completed: no acquire fence
+    p->api.setBuffer(t, p->control, p->buffers[newest], -1);
+    p->api.setBufferTransparency(t, p->control, ASURFACE_TRANSACTION_TRANSPARENCY_OPAQUE);
+    p->api.setVisibility(t, p->control, ASURFACE_TRANSACTION_VISIBILITY_SHOW);
+    p->api.setOnComplete(t, ctx, on_transaction_complete);
+    binding_for(p, p->control)->inflight++;
+    p->api.apply(t);
+    p->api.transactionDelete(t);
+
+    p->posted = newest;
+    p->framesPosted++;
+    return true;
+}
+
+static Presenter *presenter_from(jlong handle) {
+    return reinterpret_cast<Presenter *>(handle);
+}
+
+extern "C" {
+
+/**
+ * Create /tmp/headless_ahb at path and return a presenter handle, or 0 if
+ * ASurfaceControl is unavailable or the file cannot be created.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_mediatek_steamlauncher_AhbPresenter_nativeCreate(
+        JNIEnv *env,
+        jobject /* this */,
+        jstring jpath) {
+
+    auto *p = new Presenter();
+    if (!load_surface_control_api(&p->api)) {
+        LOGW("ASurfaceControl unavailable, zero-copy presentation disabled");
+        delete p;
+        return 0;
+    }
+
+    const char *path = env->GetStringUTFChars(jpath, nullptr);
+    unlink(path);   // a previous run's layer may still map the old file; it sees a new one on remap
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd >= 0) fchmod(fd, 0666);  // the layer runs under FEX, not necessarily as our uid
+    if (fd < 0 || ftruncate(fd, sizeof(AhbShmHeader)) != 0) {
+        LOGE("Failed to create %s", path);
+        if (fd >= 0) close(fd);
+        env->ReleaseStringUTFChars(jpath, path);
+        delete p;
+        return 0;
+    }
+    void *map = mmap(nullptr, sizeof(AhbShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOGE("Failed to map %s", path);
+        unlink(path);
+        env->ReleaseStringUTFChars(jpath, path);
+        delete p;
+        return 0;
+    }
+    env->ReleaseStringUTFChars(jpath, path);
+
+    p->h = static_cast<AhbShmHeader *>(map);
+    p->h->version = AHB_SHM_VERSION;
+    p->h->presenter_pid = (uint32_t)getpid();
+    // magic last: the layer treats the file as valid only once it is set
+    __atomic_store_n(&p->h->magic, AHB_SHM_MAGIC, __ATOMIC_RELEASE);
+    return reinterpret_cast<jlong>(p);
+}
+
+/** Post to surface from now on (null detaches). Frames are dropped while detached. */
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_AhbPresenter_nativeSetSurface(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong handle,
+        jobject surface) {
+
+    Presenter *p = presenter_from(handle);
+    if (p == nullptr) return;
+    ANativeWindow *window = surface != nullptr ? ANativeWindow_fromSurface(env, surface) : nullptr;
+
+    std::lock_guard<std::mutex> guard(p->lock);
+    if (window != nullptr && window == p->window) {
+        ANativeWindow_release(window);
+        return;
+    }
+    detach_surface(p);
+    if (window != nullptr) attach_surface(p, window);
+}
+
+/** Publish the display refresh period the layer paces FIFO swapchains to (0 = unknown). */
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_AhbPresenter_nativeSetTargetInterval(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jlong handle,
+        jlong intervalNs) {
+
+    Presenter *p = presenter_from(handle);
+    if (p == nullptr) return;
+    __atomic_store_n(&p->h->target_interval_ns, (uint64_t)intervalNs, __ATOMIC_RELAXED);
+}
+
+/**
+ * Serve buffer requests, recycle released buffers and post the newest queued
+ * frame. Blocks up to timeoutMs for the layer to queue one when idle.
+ * Returns the number of frames posted.
+ */
+JNIEXPORT jint JNICALL
+Java_com_mediatek_steamlauncher_AhbPresenter_nativePoll(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jlong handle,
+        jint timeoutMs) {
+
+    Presenter *p = presenter_from(handle);
+    if (p == nullptr) return 0;
+
+    uint32_t seq = __atomic_load_n(&p->h->queue_seq, __ATOMIC_ACQUIRE);
+    bool fences_pending;
+    bool posted;
+    {
+        std::lock_guard<std::mutex> guard(p->lock);
+        handle_request(p);
+        fences_pending = reap_releases(p);
+        posted = post_newest(p);
+    }
+    if (posted) return 1;
+
+    int64_t wait = (int64_t)timeoutMs * 1000000LL;
+    if (fences_pending && wait > RELEASE_POLL_NS) wait = RELEASE_POLL_NS;
+    futex_wait(&p->h->queue_seq, seq, wait);
+    return 0;
+}
+
+/** Frames posted / dropped since the last call, for the Kotlin stats log. */
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_AhbPresenter_nativeTakeStats(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong handle,
+        jlongArray out) {
+
+    Presenter *p = presenter_from(handle);
+    if (p == nullptr) return;
+    std::lock_guard<std::mutex> guard(p->lock);
+    jlong vals[2] = {(jlong)p->framesPosted, (jlong)p->framesDropped};
+    env->SetLongArrayRegion(out, 0, 2, vals);
+    p->framesPosted = 0;
+    p->framesDropped = 0;
+}
+
+/** Detach, release every buffer and invalidate the file for the layer. */
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_AhbPresenter_nativeDestroy(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jlong handle) {
+
+    Presenter *p = presenter_from(handle);
+    if (p == nullptr) return;
+    {
+        std::lock_guard<std::mutex> guard(p->lock);
+        detach_surface(p);
+        {
+            std::lock_guard<std::mutex> qguard(p->queue->lock);
+            p->queue->closed = true;
+            for (const auto &r : p->queue->items)
+                if (r.fence >= 0) close(r.fence);
+            p->queue->items.clear();
+        }
+        for (const auto &r : p->releases)
+            if (r.fence >= 0) close(r.fence);
+        // Controls with callbacks still in flight are leaked rather than
+        // released under them; this only happens at shutdown
+        for (const auto &b : p->bindings)
+            if (b.inflight == 0) p->api.release(b.control);
+        __atomic_store_n(&p->h->magic, 0u, __ATOMIC_RELEASE);
+        for (uint32_t i = 0; i < AHB_SHM_SLOTS; i++)
+            if (p->buffers[i] != nullptr) AHardwareBuffer_release(p->buffers[i]);
+        futex_wake(&p->h->free_seq);
+        munmap(p->h, sizeof(AhbShmHeader));
+    }
+    delete p;
+}
+
+} // extern "C"
@@ -0,0 +1,63 @@
+/**
+ * Zero-copy swapchain slot table (presenter side).
+ *
+ * Created by AhbPresenter (ahb_presenter.cpp) as /tmp/headless_ahb inside
+ * the FEX rootfs and mapped by the headless Vulkan layer
+ * (assets/vulkan_headless_layer.c, "Section 4d"). The layer asks for a set of
+ * AHardwareBuffers, imports them as its swapchain images and hands rendered
+ * images back through the slot states; the presenter posts them to the
+ * SurfaceView through ASurfaceControl. The layer is built standalone for
+ * x86-64, so the layout is duplicated there — keep both in sync and bump
+ * AHB_SHM_VERSION on change.
+ *
+ * Slot ownership:
+ *   FREE     -> ACQUIRED   layer, vkAcquireNextImageKHR
+ *   ACQUIRED -> QUEUED     layer, once the present's GPU work has completed
+ *   QUEUED   -> POSTED     presenter, buffer handed to SurfaceFlinger
+ *   QUEUED   -> FREE       presenter, superseded by a newer frame
+ *   POSTED   -> FREE       presenter, once the buffer's release fence signals
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#define AHB_SHM_MAGIC 0x42484148u     // "HAHB" little-endian
+#define AHB_SHM_VERSION 2
+#define AHB_SHM_SLOTS 8
+
+#define AHB_SLOT_FREE 0u
+#define AHB_SLOT_ACQUIRED 1u
+#define AHB_SLOT_QUEUED 2u
+#define AHB_SLOT_POSTED 3u
+
+struct AhbShmSlot {
+    uint64_t buffer;        // AHardwareBuffer* in the app process, opaque to the layer
+    uint32_t state;         // AHB_SLOT_*
+    uint32_t reserved0;
+    uint64_t frame_seq;     // layer's present sequence when the slot was queued
+    uint64_t reserved1;
+};
+
+struct AhbShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t presenter_pid;
+    uint32_t ready;         // presenter has a surface to post to (presenter-owned)
+    // Buffer request (layer-owned); count 0 releases the buffers
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;        // AHardwareBuffer format
+    uint32_t count;
+    uint64_t request_seq;   // bumped by the layer once the request is filled in
+    uint64_t grant_seq;     // set to request_seq once slots[] answer it (presenter-owned)
+    int32_t grant_status;   // 0 = slots[0, count) hold buffers, < 0 = allocation failed
+    uint32_t layer_pid;     // process whose swapchain owns the slots
+    uint32_t queue_seq;     // futex: bumped + woken by the layer after queueing a slot
+    uint32_t free_seq;      // futex: bumped + woken by the presenter after freeing a slot
+    uint64_t target_interval_ns; // display refresh period, 0 = unknown (presenter-owned)
+    AhbShmSlot slots[AHB_SHM_SLOTS];
+};
+
+static_assert(sizeof(AhbShmSlot) == 32, "AhbShmSlot layout drifted from the layer");
+static_assert(sizeof(AhbShmHeader) == 72 + AHB_SHM_SLOTS * 32, "AhbShmHeader layout drifted from the layer");
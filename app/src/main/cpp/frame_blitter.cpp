@@ -0,0 +1,393 @@
+/**
+ * FrameBlitter JNI - draws received frames straight into a Surface's buffers
+ *
+ * Replaces the Bitmap + Canvas path FrameSocketServer and FrameShmReader drew
+ * with: the frame is swizzled (BGRA -> RGBA), alpha-forced and scaled to fit
+ * while it is written into the ANativeWindow_lock buffer, letterboxed in
+ * black and centered like the old canvas.scale() draw. The JVM and Skia never
+ * touch the pixels.
+ *
+ * Window buffers may be write-combined, so nothing is read back from them:
+ * scaled rows are built once per source row in a cached scratch row and then
+ * stored with the NEON swizzle kernels from frame_copy.h. Unscaled frames go
+ * from source to window in a single pass.
+ *
+ * Shm slots are drawn in three steps (nativeLock, nativeDrawBuffer,
+ * nativePost) so the reader can check the slot's seqlock after drawing and
+ * redraw a newer slot into the same buffer before anything is posted.
+ *
+ * Not thread-safe; FrameBlitter.kt serialises all calls on one blitter.
+ */
+
+#include <jni.h>
+#include <android/log.h>
+#include <android/native_window.h>
+#include <android/native_window_jni.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "frame_copy.h"
+
+#define LOG_TAG "FrameBlitter"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+// Scale modes (FrameBlitter.SCALE_*)
+#define BLIT_SCALE_FIT 0        // nearest-neighbour, fit to the window
+#define BLIT_SCALE_INTEGER 1    // nearest-neighbour, largest whole factor that fits
+#define BLIT_SCALE_BILINEAR 2   // bilinear, fit to the window
+
+#define BLIT_BLACK 0xFF000000u
+#define BLIT_NO_ROW 0xFFFFFFFFu
+
+struct Blitter {
+    ANativeWindow *window = nullptr;
+    int mode = BLIT_SCALE_FIT;
+    bool bad_format_logged = false;
+
+    // Buffer held between nativeLock and nativePost; `locked` keeps its own
+    // window reference so a surface change in between cannot free it
+    ANativeWindow *locked = nullptr;
+    ANativeWindow_Buffer out{};
+    bool drawn = false;
+
+    // Placement for the last frame/buffer size pair; rebuilt when either changes
+    uint32_t src_w = 0, src_h = 0;
+    int32_t buf_w = 0, buf_h = 0;
+    int32_t dst_x = 0, dst_y = 0;
+    uint32_t dst_w = 0, dst_h = 0;
+    std::vector<uint32_t> xmap;     // source column per output column
+    std::vector<uint8_t> xfrac;     // bilinear: weight of column xmap[i] + 1, 0..127
+    std::vector<uint32_t> row;      // scaled row, still in source byte order
+    std::vector<uint32_t> vrow;     // bilinear: vertically blended source row + 1 pad pixel
+};
+
+/** Nearest source index for output index i when n samples are scaled to out. */
+static inline uint32_t nearest_pos(uint32_t i, uint32_t n, uint32_t out) {
+    return (uint32_t)(((uint64_t)(2 * i + 1) * n) / (2 * (uint64_t)out));
+}
+
+/** Bilinear source position of output index i in 1/128 units, clamped to [0, (n - 1) * 128]. */
+static inline uint32_t bilinear_pos(uint32_t i, uint32_t n, uint32_t out) {
+    int64_t pos = ((int64_t)(2 * i + 1) * n * 128) / (2 * (int64_t)out) - 64;
+    return (uint32_t)std::clamp<int64_t>(pos, 0, (int64_t)(n - 1) * 128);
+}
+
+/** Per-byte a * (128 - f) / 128 + b * f / 128, rounded; f in [0, 128). */
+static inline uint32_t lerp_pixel(uint32_t a, uint32_t b, uint32_t f) {
+    uint32_t g = 128 - f;
+    uint32_t rb = (((a & 0x00FF00FFu) * g + (b & 0x00FF00FFu) * f + 0x00400040u) >> 7) & 0x00FF00FFu;
+    uint32_t ag = ((((a >> 8) & 0x00FF00FFu) * g + ((b >> 8) & 0x00FF00FFu) * f + 0x00400040u) >> 7) &
+                  0x00FF00FFu;
+    return rb | (ag << 8);
+}
+
+/** Vertical half of the bilinear filter: dst = lerp(a, b, f) for n pixels. */
+static void blend_rows(uint32_t *dst, const uint32_t *a, const uint32_t *b, size_t n, uint32_t f) {
+    if (f == 0) {
+        memcpy(dst, a, n * 4);
+        return;
+    }
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    const uint8x8_t wa = vdup_n_u8((uint8_t)(128 - f));
+    const uint8x8_t wb = vdup_n_u8((uint8_t)f);
+    for (; i + 4 <= n; i += 4) {
+        uint8x16_t va = vld1q_u8(reinterpret_cast<const uint8_t *>(a + i));
+        uint8x16_t vb = vld1q_u8(reinterpret_cast<const uint8_t *>(b + i));
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa), vget_low_u8(vb), wb);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa), vget_high_u8(vb), wb);
+        vst1q_u8(reinterpret_cast<uint8_t *>(dst + i),
+                 vcombine_u8(vrshrn_n_u16(lo, 7), vrshrn_n_u16(hi, 7)));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = lerp_pixel(a[i], b[i], f);
+}
+
+/** Work out where a w x h frame goes in a bw x bh buffer and the column maps for it. */
+static void blit_plan(Blitter *b, uint32_t w, uint32_t h, int32_t bw, int32_t bh) {
+    if (w == b->src_w && h == b->src_h && bw == b->buf_w && bh == b->buf_h) return;
+
+    uint32_t dw, dh;
+    uint32_t whole = std::min((uint32_t)bw / w, (uint32_t)bh / h);
+    if (b->mode == BLIT_SCALE_INTEGER && whole >= 1) {
+        dw = w * whole;
+        dh = h * whole;
+    } else if ((uint64_t)bw * h <= (uint64_t)bh * w) {
+        dw = (uint32_t)bw;
+        dh = std::max<uint32_t>(1, (uint32_t)((uint64_t)h * bw / w));
+    } else {
+        dh = (uint32_t)bh;
+        dw = std::max<uint32_t>(1, (uint32_t)((uint64_t)w * bh / h));
+    }
+
+    b->src_w = w;
+    b->src_h = h;
+    b->buf_w = bw;
+    b->buf_h = bh;
+    b->dst_w = dw;
+    b->dst_h = dh;
+    b->dst_x = (bw - (int32_t)dw) / 2;
+    b->dst_y = (bh - (int32_t)dh) / 2;
+
+    b->xmap.resize(dw);
+    b->xfrac.resize(dw);
+    for (uint32_t i = 0; i < dw; i++) {
+        if (b->mode == BLIT_SCALE_BILINEAR) {
+            uint32_t p = bilinear_pos(i, w, dw);
+            b->xmap[i] = p >> 7;
+            b->xfrac[i] = (uint8_t)(p & 127);
+        } else {
+            b->xmap[i] = nearest_pos(i, w, dw);
+            b->xfrac[i] = 0;
+        }
+    }
+    b->row.resize(dw);
+    b->vrow.resize(w + 1);
+
+    LOGI("Blitting %ux%u -> %ux%u at (%d,%d) in %dx%d, mode %d",
+         w, h, dw, dh, b->dst_x, b->dst_y, bw, bh, b->mode);
+}
+
+static bool blit_lock(Blitter *b, ANativeWindow_Buffer *out) {
+    if (b->window == nullptr) return false;
+    if (ANativeWindow_lock(b->window, out, nullptr) != 0) return false;
+    if (out->format != WINDOW_FORMAT_RGBA_8888 && out->format != WINDOW_FORMAT_RGBX_8888) {
+        if (!b->bad_format_logged) {
+            LOGE("Window buffer format %d is not RGBA_8888, not drawing", out->format);
+            b->bad_format_logged = true;
+        }
+        ANativeWindow_unlockAndPost(b->window);
+        return false;
+    }
+    return true;
+}
+
+/** Write a w x h frame (rows src_stride bytes apart) into a locked window buffer. */
+static void blit_frame(Blitter *b, const ANativeWindow_Buffer &out,
+                       const uint8_t *src, size_t src_stride, uint32_t w, uint32_t h, bool swizzle) {
+    blit_plan(b, w, h, out.width, out.height);
+
+    auto row_fn = swizzle ? copy_swizzle_alpha_row : copy_alpha_row;
+    auto src_row = [&](uint32_t y) {
+        return reinterpret_cast<const uint32_t *>(src + (size_t)y * src_stride);
+    };
+    auto *dst = static_cast<uint32_t *>(out.bits);
+    size_t pitch = (size_t)out.stride;
+    bool unscaled = b->dst_w == w && b->dst_h == h;
+
+    // Letterbox bars
+    for (int32_t y = 0; y < b->dst_y; y++)
+        std::fill_n(dst + y * pitch, out.width, BLIT_BLACK);
+    for (int32_t y = b->dst_y + (int32_t)b->dst_h; y < out.height; y++)
+        std::fill_n(dst + y * pitch, out.width, BLIT_BLACK);
+
+    uint32_t built = BLIT_NO_ROW;
+    for (uint32_t i = 0; i < b->dst_h; i++) {
+        uint32_t *d = dst + (size_t)(b->dst_y + (int32_t)i) * pitch;
+        std::fill_n(d, b->dst_x, BLIT_BLACK);
+        std::fill_n(d + b->dst_x + b->dst_w, out.width - b->dst_x - (int32_t)b->dst_w, BLIT_BLACK);
+        d += b->dst_x;
+
+        if (unscaled) {
+            row_fn(d, src_row(i), w);
+            continue;
+        }
+
+        // Rebuild the scratch row only when the source row (or blend weight) changes;
+        // integer and upscaled frames repeat it across several output rows.
+        if (b->mode == BLIT_SCALE_BILINEAR) {
+            uint32_t p = bilinear_pos(i, h, b->dst_h);
+            if (p != built) {
+                uint32_t y0 = p >> 7;
+                blend_rows(b->vrow.data(), src_row(y0), src_row(std::min(y0 + 1, h - 1)), w, p & 127);
+                b->vrow[w] = b->vrow[w - 1];
+                for (uint32_t x = 0; x < b->dst_w; x++) {
+                    uint32_t sx = b->xmap[x];
+                    b->row[x] = lerp_pixel(b->vrow[sx], b->vrow[sx + 1], b->xfrac[x]);
+                }
+                built = p;
+            }
+        } else {
+            uint32_t y = nearest_pos(i, h, b->dst_h);
+            if (y != built) {
+                const uint32_t *s = src_row(y);
+                for (uint32_t x = 0; x < b->dst_w; x++)
+                    b->row[x] = s[b->xmap[x]];
+                built = y;
+            }
+        }
+        row_fn(d, b->row.data(), b->dst_w);
+    }
+}
+
+/** Post the held buffer; black if nothing was drawn into it (its contents are undefined). */
+static void blit_post(Blitter *b) {
+    if (b->locked == nullptr) return;
+    if (!b->drawn) {
+        auto *dst = static_cast<uint32_t *>(b->out.bits);
+        for (int32_t y = 0; y < b->out.height; y++)
+            std::fill_n(dst + (size_t)y * b->out.stride, b->out.width, BLIT_BLACK);
+    }
+    ANativeWindow_unlockAndPost(b->locked);
+    ANativeWindow_release(b->locked);
+    b->locked = nullptr;
+    b->drawn = false;
+}
+
+extern "C" {
+
+JNIEXPORT jlong JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativeCreate(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jint mode) {
+
+    auto *b = new Blitter();
+    b->mode = (mode >= BLIT_SCALE_FIT && mode <= BLIT_SCALE_BILINEAR) ? mode : BLIT_SCALE_FIT;
+    return reinterpret_cast<jlong>(b);
+}
+
+/**
+ * Draw into surface from now on (null detaches). The window is asked for
+ * RGBA_8888 buffers at its own size, so resizes need no call here.
+ */
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativeSetSurface(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong handle,
+        jobject surface) {
+
+    auto *b = reinterpret_cast<Blitter *>(handle);
+    if (b == nullptr) return;
+
+    ANativeWindow *window = surface != nullptr ? ANativeWindow_fromSurface(env, surface) : nullptr;
+    if (window == b->window) {
+        if (window != nullptr) ANativeWindow_release(window);
+        return;
+    }
+    if (b->window != nullptr) ANativeWindow_release(b->window);
+    b->window = window;
+    b->buf_w = b->buf_h = 0;
+    b->bad_format_logged = false;
+    if (window == nullptr) return;
+
+    if (ANativeWindow_setBuffersGeometry(window, 0, 0, WINDOW_FORMAT_RGBA_8888) != 0)
+        LOGE("ANativeWindow_setBuffersGeometry failed");
+    LOGI("Attached to surface %dx%d", ANativeWindow_getWidth(window), ANativeWindow_getHeight(window));
+}
+
+/**
+ * Draw a tightly packed width x height frame from a byte[] and post it.
+ * Blocks in ANativeWindow_lock until a buffer is free, which paces to vsync.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativeBlitArray(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong handle,
+        jbyteArray pixels,
+        jint width,
+        jint height,
+        jboolean swizzle) {
+
+    auto *b = reinterpret_cast<Blitter *>(handle);
+    if (b == nullptr || b->locked != nullptr || pixels == nullptr || width <= 0 || height <= 0)
+        return JNI_FALSE;
+    size_t stride = (size_t)width * 4;
+    if ((size_t)env->GetArrayLength(pixels) < stride * height) return JNI_FALSE;
+
+    // Lock first: the wait for a free buffer must not happen inside the critical section
+    ANativeWindow_Buffer out;
+    if (!blit_lock(b, &out)) return JNI_FALSE;
+
+    void *src = env->GetPrimitiveArrayCritical(pixels, nullptr);
+    if (src != nullptr) {
+        blit_frame(b, out, static_cast<const uint8_t *>(src), stride, width, height, swizzle);
+        env->ReleasePrimitiveArrayCritical(pixels, src, JNI_ABORT);
+    }
+    ANativeWindow_unlockAndPost(b->window);
+    return src != nullptr ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Lock the next window buffer for nativeDrawBuffer. Blocks until a buffer is
+ * free, which paces to vsync.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativeLock(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jlong handle) {
+
+    auto *b = reinterpret_cast<Blitter *>(handle);
+    if (b == nullptr) return JNI_FALSE;
+    if (b->locked != nullptr) return JNI_TRUE;
+    if (!blit_lock(b, &b->out)) return JNI_FALSE;
+    ANativeWindow_acquire(b->window);
+    b->locked = b->window;
+    b->drawn = false;
+    return JNI_TRUE;
+}
+
+/**
+ * Draw a frame that starts at offset in a direct ByteBuffer (e.g. a slot of
+ * the mapped /tmp/headless_frames) into the locked buffer. May be called
+ * again before nativePost to replace what was drawn.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativeDrawBuffer(
+        JNIEnv *env,
+        jobject /* this */,
+        jlong handle,
+        jobject buffer,
+        jlong offset,
+        jint width,
+        jint height,
+        jint stride,
+        jboolean swizzle) {
+
+    auto *b = reinterpret_cast<Blitter *>(handle);
+    if (b == nullptr || b->locked == nullptr || buffer == nullptr || width <= 0 || height <= 0 ||
+        offset < 0 || stride < width * 4 || (stride & 3) != 0) {
+        return JNI_FALSE;
+    }
+    auto *base = static_cast<const uint8_t *>(env->GetDirectBufferAddress(buffer));
+    jlong cap = env->GetDirectBufferCapacity(buffer);
+    if (base == nullptr || offset + (jlong)stride * (height - 1) + (jlong)width * 4 > cap)
+        return JNI_FALSE;
+
+    blit_frame(b, b->out, base + offset, (size_t)stride, width, height, swizzle);
+    b->drawn = true;
+    return JNI_TRUE;
+}
+
+/** Post the buffer taken by nativeLock. */
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativePost(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jlong handle) {
+
+    auto *b = reinterpret_cast<Blitter *>(handle);
+    if (b != nullptr) blit_post(b);
+}
+
+JNIEXPORT void JNICALL
+Java_com_mediatek_steamlauncher_FrameBlitter_nativeDestroy(
+        JNIEnv * /* env */,
+        jobject /* this */,
+        jlong handle) {
+
+    auto *b = reinterpret_cast<Blitter *>(handle);
+    if (b == nullptr) return;
+    blit_post(b);
+    if (b->window != nullptr) ANativeWindow_release(b->window);
+    delete b;
+}
+
+} // extern "C"
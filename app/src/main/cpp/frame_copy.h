@@ -0,0 +1,76 @@
+/**
+ * Frame copy kernels for captured headless-layer frames (Android side).
+ *
+ * Copies BGRA rows while forcing alpha to 0xFF in the same pass, mirroring
+ * copy_frame_alpha() in the x86-64 layer, and the swizzling variant the
+ * window blitter (frame_blitter.cpp) uses to turn BGRA into RGBA. arm64-v8a
+ * always has NEON, so the NEON path is chosen at compile time with a scalar
+ * fallback for other ABIs.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static inline void copy_alpha_row(uint32_t *dst, const uint32_t *src, size_t n) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    const uint32x4_t a = vdupq_n_u32(0xFF000000u);
+    for (; i + 16 <= n; i += 16) {
+        uint32x4x4_t p = vld1q_u32_x4(src + i);
+        p.val[0] = vorrq_u32(p.val[0], a);
+        p.val[1] = vorrq_u32(p.val[1], a);
+        p.val[2] = vorrq_u32(p.val[2], a);
+        p.val[3] = vorrq_u32(p.val[3], a);
+        vst1q_u32_x4(dst + i, p);
+    }
+    for (; i + 4 <= n; i += 4)
+        vst1q_u32(dst + i, vorrq_u32(vld1q_u32(src + i), a));
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] | 0xFF000000u;
+}
+
+/** Same as copy_alpha_row, but also swaps bytes 0 and 2 (BGRA <-> RGBA). */
+static inline void copy_swizzle_alpha_row(uint32_t *dst, const uint32_t *src, size_t n) {
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    const uint8x16_t a = vdupq_n_u8(0xFF);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t p = vld4q_u8(reinterpret_cast<const uint8_t *>(src + i));
+        uint8x16_t t = p.val[0];
+        p.val[0] = p.val[2];
+        p.val[2] = t;
+        p.val[3] = a;
+        vst4q_u8(reinterpret_cast<uint8_t *>(dst + i), p);
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t p = src[i];
+        dst[i] = (p & 0x0000FF00u) | ((p & 0xFFu) << 16) | ((p >> 16) & 0xFFu) | 0xFF000000u;
+    }
+}
+
+/** Copy width x height pixels between buffers with arbitrary row strides (bytes). */
+static inline void copy_frame_alpha(void *dst, size_t dst_stride,
+                                    const void *src, size_t src_stride,
+                                    uint32_t width, uint32_t height) {
+    size_t row = (size_t)width * 4;
+    if (dst_stride == row && src_stride == row) {
+        copy_alpha_row(static_cast<uint32_t *>(dst), static_cast<const uint32_t *>(src),
+                       (size_t)width * height);
+        return;
+    }
+    auto *d = static_cast<uint8_t *>(dst);
+    auto *s = static_cast<const uint8_t *>(src);
+    for (uint32_t y = 0; y < height; y++) {
+        copy_alpha_row(reinterpret_cast<uint32_t *>(d), reinterpret_cast<const uint32_t *>(s), width);
+        d += dst_stride;
+        s += src_stride;
+    }
+}
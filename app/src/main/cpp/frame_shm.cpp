@@ -0,0 +1,101 @@
+/**
+ * FrameShmReader JNI - acquire/release of frame slots in /tmp/headless_frames
+ *
+ * The mapping itself is owned by Kotlin (a MappedByteBuffer); these helpers
+ * only provide the acquire/release ordering that the triple-buffer protocol
+ * needs and that Kotlin cannot express on a ByteBuffer below API 33.
+ * No syscalls — each call is a handful of loads and stores.
+ */
+
+#include <jni.h>
+
+#include "frame_shm.h"
+
+// Return codes for nativeAcquireSlot (slot indices are >= 0)
+#define SHM_NO_FRAME  (-1)   // nothing newer than lastSeq yet
+#define SHM_REMAP     (-2)   // header invalid or closed: reopen the file
+
+static FrameShmHeader *shm_header(JNIEnv *env, jobject buffer) {
+    if (buffer == nullptr) return nullptr;
+    void *addr = env->GetDirectBufferAddress(buffer);
+    jlong cap = env->GetDirectBufferCapacity(buffer);
+    if (addr == nullptr || cap < (jlong)sizeof(FrameShmHeader)) return nullptr;
+    return static_cast<FrameShmHeader *>(addr);
+}
+
+extern "C" {
+
+/**
+ * Claim the newest published slot if it is newer than lastSeq.
+ * On success fills out[0] = frame sequence, out[1] = slot seqlock value
+ * (to pass back to nativeReleaseSlot) and returns the slot index.
+ */
+JNIEXPORT jint JNICALL
+Java_com_mediatek_steamlauncher_FrameShmReader_nativeAcquireSlot(
+        JNIEnv *env,
+        jobject /* this */,
+        jobject buffer,
+        jlong lastSeq,
+        jlongArray out) {
+
+    FrameShmHeader *h = shm_header(env, buffer);
+    if (h == nullptr) return SHM_REMAP;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != FRAME_SHM_MAGIC ||
+        h->version != FRAME_SHM_VERSION ||
+        __atomic_load_n(&h->closed, __ATOMIC_ACQUIRE)) {
+        return SHM_REMAP;
+    }
+
+    if ((jlong)__atomic_load_n(&h->frame_seq, __ATOMIC_ACQUIRE) == lastSeq)
+        return SHM_NO_FRAME;
+
+    // Advertise the slot we are about to read, then confirm the writer did
+    // not publish over it in between; the writer never picks reader_slot.
+    uint32_t slot = FRAME_SHM_NO_SLOT;
+    for (int tries = 0; tries < 4; tries++) {
+        uint32_t latest = __atomic_load_n(&h->latest, __ATOMIC_ACQUIRE);
+        if (latest >= FRAME_SHM_SLOTS) return SHM_NO_FRAME;
+        __atomic_store_n(&h->reader_slot, latest, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&h->latest, __ATOMIC_SEQ_CST) == latest) {
+            slot = latest;
+            break;
+        }
+    }
+    if (slot == FRAME_SHM_NO_SLOT) {
+        __atomic_store_n(&h->reader_slot, FRAME_SHM_NO_SLOT, __ATOMIC_RELEASE);
+        return SHM_NO_FRAME;
+    }
+
+    uint64_t lock = __atomic_load_n(&h->slots[slot].seq, __ATOMIC_ACQUIRE);
+    if (lock & 1) {
+        __atomic_store_n(&h->reader_slot, FRAME_SHM_NO_SLOT, __ATOMIC_RELEASE);
+        return SHM_NO_FRAME;
+    }
+
+    jlong vals[2] = { (jlong)h->slots[slot].frame_seq, (jlong)lock };
+    env->SetLongArrayRegion(out, 0, 2, vals);
+    return (jint)slot;
+}
+
+/**
+ * Release a slot claimed by nativeAcquireSlot. Returns false if the writer
+ * recycled the slot while it was being read (the drawn frame was torn).
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_mediatek_steamlauncher_FrameShmReader_nativeReleaseSlot(
+        JNIEnv *env,
+        jobject /* this */,
+        jobject buffer,
+        jint slot,
+        jlong lock) {
+
+    FrameShmHeader *h = shm_header(env, buffer);
+    if (h == nullptr || slot < 0 || slot >= FRAME_SHM_SLOTS) return JNI_FALSE;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t now = __atomic_load_n(&h->slots[slot].seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->reader_slot, FRAME_SHM_NO_SLOT, __ATOMIC_RELEASE);
+    return now == (uint64_t)lock ? JNI_TRUE : JNI_FALSE;
+}
+
+} // extern "C"
@@ -0,0 +1,48 @@
+/**
+ * Shared-memory frame transport layout (reader side).
+ *
+ * Written by the headless Vulkan layer (assets/vulkan_headless_layer.c,
+ * "Section 4b") into /tmp/headless_frames inside the FEX rootfs and read by
+ * FrameShmReader. The layer is built standalone for x86-64, so the layout is
+ * duplicated there — keep both in sync and bump FRAME_SHM_VERSION on change.
+ *
+ *   [0, header_size)                     FrameShmHeader + slot descriptors
+ *   [header_size + i * slot_size, ...)   pixels of slot i, tightly packed
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#define FRAME_SHM_MAGIC 0x4D524648u   // "HFRM" little-endian
+#define FRAME_SHM_VERSION 2
+#define FRAME_SHM_SLOTS 3
+#define FRAME_SHM_NO_SLOT 0xFFFFFFFFu
+
+struct FrameShmSlot {
+    uint64_t seq;           // seqlock: odd while the writer owns the slot
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;        // bytes per row
+    uint32_t format;        // VkFormat of the pixels
+    uint64_t frame_seq;     // header frame_seq this slot was published as
+};
+
+struct FrameShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_count;
+    uint64_t slot_size;
+    uint64_t frame_seq;     // bumped on every publish
+    uint32_t latest;        // newest complete slot, FRAME_SHM_NO_SLOT if none
+    uint32_t reader_slot;   // slot the reader is copying (reader-owned)
+    uint32_t writer_pid;
+    uint32_t closed;        // writer abandoned this file, reader must remap
+    uint64_t target_interval_ns; // display refresh period the layer paces FIFO to, 0 = unknown (reader-owned)
+    uint8_t reserved[8];
+    FrameShmSlot slots[FRAME_SHM_SLOTS];
+};
+
+static_assert(sizeof(FrameShmSlot) == 32, "FrameShmSlot layout drifted from the layer");
+static_assert(sizeof(FrameShmHeader) == 64 + 3 * 32, "FrameShmHeader layout drifted from the layer");
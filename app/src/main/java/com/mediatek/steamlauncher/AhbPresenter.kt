@@ -0,0 +1,125 @@
+package com.mediatek.steamlauncher
+
+import android.os.Build
+import android.util.Log
+import android.view.Surface
+import java.util.concurrent.atomic.AtomicBoolean
+
+/**
+ * Zero-copy presenter for the headless Vulkan layer.
+ *
+ * Allocates the AHardwareBuffers the layer imports as its swapchain images
+ * and posts finished images straight to the output surface through a child
+ * ASurfaceControl (see ahb_presenter.cpp and the slot protocol in ahb_shm.h).
+ * The frames never touch the CPU, unlike the shm readback path that
+ * [FrameShmReader] draws — which stays in place for swapchains the layer
+ * cannot back with buffers from here.
+ *
+ * Needs API 29; below that [start] returns false and the layer never sees
+ * the slot file.
+ */
+class AhbPresenter(private val path: String) {
+
+    companion object {
+        private const val TAG = "AhbPresenter"
+        private const val WAIT_MS = 100
+
+        init {
+            System.loadLibrary("framebuffer_bridge")
+        }
+    }
+
+    private var presenterThread: Thread? = null
+    private val running = AtomicBoolean(false)
+
+    // Native presenter, 0 while stopped; guarded by `this`
+    private var handle = 0L
+    private var pendingSurface: Surface? = null
+    private var targetIntervalNs = 0L
+
+    fun setOutputSurface(surface: Surface?) {
+        synchronized(this) {
+            pendingSurface = surface
+            if (handle != 0L) nativeSetSurface(handle, surface)
+        }
+    }
+
+    /** Display refresh period the layer paces FIFO swapchains to; 0 = unknown. */
+    fun setTargetInterval(intervalNs: Long) {
+        synchronized(this) {
+            targetIntervalNs = intervalNs
+            if (handle != 0L) nativeSetTargetInterval(handle, intervalNs)
+        }
+    }
+
+    fun start(): Boolean {
+        if (Build.VERSION.SDK_INT < Build.VERSION_CODES.Q) {
+            Log.i(TAG, "ASurfaceControl needs API 29, zero-copy presentation disabled")
+            return false
+        }
+        if (running.getAndSet(true)) return true
+        synchronized(this) {
+            handle = nativeCreate(path)
+            if (handle == 0L) {
+                running.set(false)
+                return false
+            }
+            pendingSurface?.let { nativeSetSurface(handle, it) }
+            nativeSetTargetInterval(handle, targetIntervalNs)
+        }
+        presenterThread = Thread({ presentLoop() }, "Ahb-Presenter").apply {
+            isDaemon = true
+            start()
+        }
+        Log.i(TAG, "Zero-copy presenter started on $path")
+        return true
+    }
+
+    private fun presentLoop() {
+        val stats = LongArray(2)
+        var lastStatsTime = System.currentTimeMillis()
+        while (running.get()) {
+            nativePoll(handle, WAIT_MS)
+
+            val now = System.currentTimeMillis()
+            if (now - lastStatsTime > 5000) {
+                synchronized(this) { nativeTakeStats(handle, stats) }
+                if (stats[0] > 0 || stats[1] > 0) {
+                    Log.i(TAG, "Zero-copy: %.1f FPS, dropped: %d".format(
+                        stats[0] * 1000.0 / (now - lastStatsTime), stats[1]))
+                }
+                lastStatsTime = now
+            }
+        }
+        Log.i(TAG, "Zero-copy presenter ended")
+    }
+
+    fun stop() {
+        if (!running.getAndSet(false)) return
+        presenterThread?.join(500)
+        presenterThread = null
+        synchronized(this) {
+            nativeDestroy(handle)
+            handle = 0L
+        }
+        Log.i(TAG, "Zero-copy presenter stopped")
+    }
+
+    fun isRunning(): Boolean = running.get()
+
+    /** Create the slot file at [path]; 0 if ASurfaceControl or the file is unavailable. */
+    private external fun nativeCreate(path: String): Long
+
+    /** Post to [surface] from now on; null detaches and hands every buffer back to the layer. */
+    private external fun nativeSetSurface(handle: Long, surface: Surface?)
+
+    private external fun nativeSetTargetInterval(handle: Long, intervalNs: Long)
+
+    /** Serve requests, recycle and post; waits up to [timeoutMs] when idle. Returns frames posted. */
+    private external fun nativePoll(handle: Long, timeoutMs: Int): Int
+
+    /** out[0] = frames posted, out[1] = frames dropped since the last call. */
+    private external fun nativeTakeStats(handle: Long, out: LongArray)
+
+    private external fun nativeDestroy(handle: Long)
+}
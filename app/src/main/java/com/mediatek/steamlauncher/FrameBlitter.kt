@@ -0,0 +1,89 @@
+package com.mediatek.steamlauncher
+
+import android.view.Surface
+import java.nio.ByteBuffer
+
+/**
+ * Native frame blitter for the frame receivers.
+ *
+ * Writes frames straight into the output Surface's buffers (ANativeWindow_lock,
+ * see frame_blitter.cpp): BGRA→RGBA swizzle, alpha fill and scale-to-fit
+ * happen in one NEON pass, so no Bitmap, Canvas or per-pixel Kotlin code sits
+ * in the per-frame path. Output is centered and letterboxed in black like the
+ * old canvas draw.
+ *
+ * [blit] blocks until the surface has a free buffer, which paces to vsync.
+ * Shm slots are drawn with [lock], [draw] and [post] instead, so the caller
+ * can verify the slot after drawing and redraw before the buffer is shown.
+ * Calls are serialised on this object; a buffer held between [lock] and
+ * [post] survives [setSurface], and [release] posts it.
+ */
+class FrameBlitter(scaleMode: Int = SCALE_FIT) {
+
+    companion object {
+        /** Nearest-neighbour at the largest scale that fits (the old unfiltered Paint). */
+        const val SCALE_FIT = 0
+        /** Nearest-neighbour at the largest whole-number scale that fits; pixel-exact. */
+        const val SCALE_INTEGER = 1
+        /** Bilinear at the largest scale that fits. */
+        const val SCALE_BILINEAR = 2
+
+        init {
+            System.loadLibrary("framebuffer_bridge")
+        }
+    }
+
+    private var handle = nativeCreate(scaleMode)
+
+    @Synchronized
+    fun setSurface(surface: Surface?) {
+        if (handle != 0L) nativeSetSurface(handle, surface)
+    }
+
+    /** Draw a tightly packed [width] x [height] frame. [swizzle] swaps R and B. */
+    @Synchronized
+    fun blit(pixels: ByteArray, width: Int, height: Int, swizzle: Boolean): Boolean =
+        handle != 0L && nativeBlitArray(handle, pixels, width, height, swizzle)
+
+    /** Take the next surface buffer for [draw]; blocks until one is free. */
+    @Synchronized
+    fun lock(): Boolean = handle != 0L && nativeLock(handle)
+
+    /**
+     * Draw a frame starting at [offset] in a direct [buffer], rows [stride] bytes
+     * apart, into the buffer taken by [lock]. Drawing again replaces it.
+     */
+    @Synchronized
+    fun draw(buffer: ByteBuffer, offset: Long, width: Int, height: Int, stride: Int,
+             swizzle: Boolean): Boolean =
+        handle != 0L && nativeDrawBuffer(handle, buffer, offset, width, height, stride, swizzle)
+
+    /** Show the buffer taken by [lock] (black if nothing was drawn). */
+    @Synchronized
+    fun post() {
+        if (handle != 0L) nativePost(handle)
+    }
+
+    @Synchronized
+    fun release() {
+        if (handle == 0L) return
+        nativeDestroy(handle)
+        handle = 0L
+    }
+
+    private external fun nativeCreate(mode: Int): Long
+
+    private external fun nativeSetSurface(handle: Long, surface: Surface?)
+
+    private external fun nativeBlitArray(handle: Long, pixels: ByteArray, width: Int, height: Int,
+                                         swizzle: Boolean): Boolean
+
+    private external fun nativeLock(handle: Long): Boolean
+
+    private external fun nativeDrawBuffer(handle: Long, buffer: ByteBuffer, offset: Long, width: Int,
+                                          height: Int, stride: Int, swizzle: Boolean): Boolean
+
+    private external fun nativePost(handle: Long)
+
+    private external fun nativeDestroy(handle: Long)
+}
@@ -0,0 +1,284 @@
+package com.mediatek.steamlauncher
+
+import android.util.Log
+import android.view.Surface
+import java.io.File
+import java.io.RandomAccessFile
+import java.nio.ByteOrder
+import java.nio.MappedByteBuffer
+import java.nio.channels.FileChannel
+import java.util.concurrent.atomic.AtomicBoolean
+
+/**
+ * Shared-memory frame reader for the headless Vulkan layer.
+ *
+ * The layer writes captured frames into a triple buffer in
+ * /tmp/headless_frames inside the FEX rootfs (see frame_shm.h for the
+ * layout). This reader maps that file once and, per frame, only claims the
+ * newest slot and blits it from the mapping straight into the Surface's
+ * buffers with a [FrameBlitter] — no socket reads, no intermediate ByteArray
+ * or Bitmap, no syscall to fetch a frame. Slot claim/release goes through
+ * tiny JNI helpers for the memory ordering. The slot's seqlock is checked
+ * before the buffer is posted; a torn slot is redrawn from the newest one.
+ *
+ * B8G8R8A8 frames are R↔B swizzled by the blitter like FrameSocketServer's;
+ * R8G8B8A8 frames (a zero-copy-capable swapchain that fell back to readback)
+ * only get their alpha forced.
+ *
+ * Swapchains the layer can back with AHardwareBuffers skip this path entirely:
+ * the reader runs an [AhbPresenter] next to it on the same surface, and the
+ * layer stops writing shm frames for those swapchains.
+ *
+ * The reader also tells the layer the display's refresh period
+ * (target_interval_ns in the header), which the layer paces FIFO swapchains to.
+ */
+class FrameShmReader(private val path: String) {
+
+    companion object {
+        private const val TAG = "FrameShmReader"
+        private const val POLL_INTERVAL_MS = 8L
+        private const val REOPEN_INTERVAL_MS = 500L
+
+        // Header offsets (frame_shm.h)
+        private const val OFF_MAGIC = 0
+        private const val OFF_HEADER_SIZE = 8
+        private const val OFF_SLOT_COUNT = 12
+        private const val OFF_SLOT_SIZE = 16
+        private const val OFF_FRAME_SEQ = 24
+        private const val OFF_CLOSED = 44
+        private const val OFF_TARGET_INTERVAL = 48
+        private const val OFF_SLOTS = 64
+        private const val SLOT_DESC_SIZE = 32
+        private const val SLOT_OFF_WIDTH = 8
+        private const val SLOT_OFF_HEIGHT = 12
+        private const val SLOT_OFF_STRIDE = 16
+        private const val SLOT_OFF_FORMAT = 20
+        private const val VK_FORMAT_R8G8B8A8_UNORM = 37
+        private const val FRAME_SHM_MAGIC = 0x4D524648
+
+        private const val SHM_REMAP = -2
+        /** Slots drawn into one window buffer before a torn one is shown anyway. */
+        private const val MAX_DRAW_ATTEMPTS = 3
+
+        init {
+            System.loadLibrary("framebuffer_bridge")
+        }
+    }
+
+    private var readerThread: Thread? = null
+    private val running = AtomicBoolean(false)
+
+    @Volatile
+    private var outputSurface: Surface? = null
+
+    @Volatile
+    private var targetIntervalNs = 0L
+
+    // Mapping + rendering state (accessed only from reader thread)
+    private var shm: MappedByteBuffer? = null
+    private var lastSeq = 0L
+    private var publishedIntervalNs = 0L
+    private val acquired = LongArray(2)
+    private val blitter = FrameBlitter()
+    private val ahbPresenter = AhbPresenter(File(File(path).parentFile, "headless_ahb").path)
+
+    // Frame stats
+    private var frameCount = 0L
+    private var tornCount = 0L
+    private var lastStatsTime = System.currentTimeMillis()
+
+    fun setOutputSurface(surface: Surface?) {
+        outputSurface = surface
+        blitter.setSurface(surface)
+        ahbPresenter.setOutputSurface(surface)
+        Log.i(TAG, "Output surface set: ${surface != null}")
+    }
+
+    /** Refresh rate of the display frames are shown on; the layer paces FIFO presents to it. */
+    fun setDisplayRefreshRate(hz: Float) {
+        if (hz < 1f) return
+        targetIntervalNs = (1_000_000_000.0 / hz).toLong()
+        ahbPresenter.setTargetInterval(targetIntervalNs)
+        Log.i(TAG, "Display refresh rate: %.1f Hz".format(hz))
+    }
+
+    fun start(): Boolean {
+        if (running.getAndSet(true)) {
+            Log.w(TAG, "Already running")
+            return true
+        }
+        ahbPresenter.start()
+        readerThread = Thread({ readLoop() }, "Frame-Shm-Reader").apply {
+            isDaemon = true
+            start()
+        }
+        Log.i(TAG, "Frame shm reader started on $path")
+        return true
+    }
+
+    private fun readLoop() {
+        while (running.get()) {
+            try {
+                val buf = shm ?: openMapping()
+                if (buf == null) {
+                    Thread.sleep(REOPEN_INTERVAL_MS)
+                    continue
+                }
+                publishInterval(buf)
+                if (!pollFrame(buf)) Thread.sleep(POLL_INTERVAL_MS)
+            } catch (e: InterruptedException) {
+                break
+            } catch (e: Exception) {
+                Log.e(TAG, "Error reading frame", e)
+                shm = null
+            }
+        }
+        shm = null
+        Log.i(TAG, "Frame shm reader ended")
+    }
+
+    /**
+     * Map the whole file once the layer has initialised it. The mapping is
+     * reused until the layer marks the file closed (resize / new process).
+     */
+    private fun openMapping(): MappedByteBuffer? {
+        val file = File(path)
+        if (!file.exists()) return null
+        return try {
+            RandomAccessFile(file, "rw").use { raf ->
+                val size = raf.length()
+                if (size < OFF_SLOTS + 3 * SLOT_DESC_SIZE) return null
+                val buf = raf.channel.map(FileChannel.MapMode.READ_WRITE, 0, size)
+                buf.order(ByteOrder.LITTLE_ENDIAN)
+                if (buf.getInt(OFF_MAGIC) != FRAME_SHM_MAGIC) return null
+                val needed = buf.getInt(OFF_HEADER_SIZE).toLong() +
+                        buf.getInt(OFF_SLOT_COUNT).toLong() * buf.getLong(OFF_SLOT_SIZE)
+                if (needed > size) return null
+                Log.i(TAG, "Mapped $path ($size bytes)")
+                lastSeq = 0
+                publishedIntervalNs = 0
+                shm = buf
+                buf
+            }
+        } catch (e: Exception) {
+            Log.w(TAG, "Failed to map $path: ${e.message}")
+            null
+        }
+    }
+
+    /** Write the display refresh period into the header when it changes or the file is new. */
+    private fun publishInterval(buf: MappedByteBuffer) {
+        val interval = targetIntervalNs
+        if (interval == publishedIntervalNs) return
+        buf.putLong(OFF_TARGET_INTERVAL, interval)
+        publishedIntervalNs = interval
+    }
+
+    /** Render the newest frame if there is one. Returns false when idle. */
+    private fun pollFrame(buf: MappedByteBuffer): Boolean {
+        // A locked window buffer has to be posted, so only lock for a new frame
+        if (buf.getInt(OFF_CLOSED) == 0 && buf.getLong(OFF_FRAME_SEQ) == lastSeq) return false
+
+        // Claim before locking: a remap, a missing frame or a slot that can't
+        // be drawn then leaves the last frame on screen instead of posting an
+        // empty buffer. Holding the slot through the wait for a free window
+        // buffer costs the writer nothing; it has the other two.
+        var slot = nativeAcquireSlot(buf, lastSeq, acquired)
+        if (slot == SHM_REMAP) {
+            Log.i(TAG, "Layer replaced $path, remapping")
+            shm = null
+            return true
+        }
+        if (slot < 0) return true
+        val surface = outputSurface
+        if (!slotDrawable(buf, slot) || surface == null || !surface.isValid || !blitter.lock()) {
+            nativeReleaseSlot(buf, slot, acquired[1])
+            lastSeq = acquired[0]
+            return true
+        }
+
+        // A slot found torn is redrawn from a newer one before posting
+        var drawn = false
+        var intact = false
+        try {
+            for (attempt in 1..MAX_DRAW_ATTEMPTS) {
+                val ok = drawSlot(buf, slot)
+                intact = nativeReleaseSlot(buf, slot, acquired[1])
+                lastSeq = acquired[0]
+                drawn = drawn || ok
+                if (!ok || intact || attempt == MAX_DRAW_ATTEMPTS) break
+                // A remap is picked up by the next poll: `closed` stays set
+                slot = nativeAcquireSlot(buf, lastSeq, acquired)
+                if (slot < 0) break
+                if (!slotDrawable(buf, slot)) {
+                    nativeReleaseSlot(buf, slot, acquired[1])
+                    lastSeq = acquired[0]
+                    break
+                }
+            }
+        } finally {
+            blitter.post()
+        }
+
+        if (!drawn) return true
+        frameCount++
+        if (!intact) tornCount++
+
+        val now = System.currentTimeMillis()
+        if (now - lastStatsTime > 5000) {
+            val dispFps = frameCount * 1000.0 / (now - lastStatsTime)
+            Log.i(TAG, "Display: %.1f FPS, torn: %d, seq: %d".format(dispFps, tornCount, lastSeq))
+            frameCount = 0
+            tornCount = 0
+            lastStatsTime = now
+        }
+        return true
+    }
+
+    /** Whether [slot] describes a frame that fits it. */
+    private fun slotDrawable(buf: MappedByteBuffer, slot: Int): Boolean {
+        val desc = OFF_SLOTS + slot * SLOT_DESC_SIZE
+        val width = buf.getInt(desc + SLOT_OFF_WIDTH)
+        val height = buf.getInt(desc + SLOT_OFF_HEIGHT)
+        val stride = buf.getInt(desc + SLOT_OFF_STRIDE)
+        return width in 1..4096 && height in 1..4096 &&
+            stride >= width * 4 && stride.toLong() * height <= buf.getLong(OFF_SLOT_SIZE)
+    }
+
+    /** Draw [slot] into the locked window buffer. */
+    private fun drawSlot(buf: MappedByteBuffer, slot: Int): Boolean {
+        if (!slotDrawable(buf, slot)) return false
+        val desc = OFF_SLOTS + slot * SLOT_DESC_SIZE
+        val width = buf.getInt(desc + SLOT_OFF_WIDTH)
+        val height = buf.getInt(desc + SLOT_OFF_HEIGHT)
+        val stride = buf.getInt(desc + SLOT_OFF_STRIDE)
+        val format = buf.getInt(desc + SLOT_OFF_FORMAT)
+        val slotSize = buf.getLong(OFF_SLOT_SIZE)
+        val offset = buf.getInt(OFF_HEADER_SIZE) + slot * slotSize
+        return blitter.draw(buf, offset, width, height, stride,
+                            swizzle = format != VK_FORMAT_R8G8B8A8_UNORM)
+    }
+
+    fun stop() {
+        Log.i(TAG, "Stopping frame shm reader")
+        running.set(false)
+        readerThread?.interrupt()
+        readerThread?.join(500)
+        readerThread = null
+        ahbPresenter.stop()
+        blitter.release()
+        Log.i(TAG, "Frame shm reader stopped")
+    }
+
+    fun isRunning(): Boolean = running.get()
+
+    /**
+     * Claim the newest slot newer than [lastSeq]. Returns the slot index,
+     * -1 if there is no new frame, -2 if the file must be remapped.
+     * On success out[0] = frame sequence, out[1] = slot lock for release.
+     */
+    private external fun nativeAcquireSlot(buffer: MappedByteBuffer, lastSeq: Long, out: LongArray): Int
+
+    /** Release a claimed slot; false if it was overwritten during the blit. */
+    private external fun nativeReleaseSlot(buffer: MappedByteBuffer, slot: Int, lock: Long): Boolean
+}
@@ -1,10 +1,6 @@
 package com.mediatek.steamlauncher
 
 import android.graphics.Bitmap
-import android.graphics.Color
-import android.graphics.ColorMatrix
-import android.graphics.ColorMatrixColorFilter
-import android.graphics.Paint
 import android.util.Log
 import android.view.Surface
 import java.net.ServerSocket
@@ -16,10 +12,11 @@ import java.util.concurrent.atomic.AtomicBoolean
 /**
  * TCP socket server for receiving Vulkan frames from the FEX container.
  *
- * Architecture: receiver thread reads each frame and renders it directly
- * via lockHardwareCanvas. The native wrapper caps at ~60 FPS via vsync
- * emulation, so each received frame maps 1:1 to a display frame.
- * lockHardwareCanvas naturally paces to vsync, preventing tearing.
+ * Architecture: receiver thread reads each frame and hands it to a native
+ * [FrameBlitter], which swizzles and scales it straight into the Surface's
+ * buffers. The native wrapper caps at ~60 FPS via vsync emulation, so each
+ * received frame maps 1:1 to a display frame. Locking the window buffer
+ * naturally paces to vsync, preventing tearing.
  *
  * The native wrapper sends frames in format:
  * - 4 bytes: width (little-endian uint32)
@@ -38,25 +35,8 @@ class FrameSocketServer(private val port: Int = 19850) {
     private var receiverThread: Thread? = null
     private val running = AtomicBoolean(false)
 
-    // Output surface for rendering
-    @Volatile
-    private var outputSurface: Surface? = null
-
-    // Reusable rendering resources (accessed only from receiver thread)
-    private var frameBitmap: Bitmap? = null
-    private var bitmapWidth = 0
-    private var bitmapHeight = 0
-    private val paint = Paint().apply {
-        isFilterBitmap = false
-        isAntiAlias = false
-        // Swizzle R↔B: GPU/Vortek outputs RGBA bytes but Android ARGB_8888 expects BGRA
-        colorFilter = ColorMatrixColorFilter(ColorMatrix(floatArrayOf(
-            0f, 0f, 1f, 0f, 0f,    // R ← B
-            0f, 1f, 0f, 0f, 0f,    // G ← G
-            1f, 0f, 0f, 0f, 0f,    // B ← R
-            0f, 0f, 0f, 1f, 0f     // A ← A
-        )))
-    }
+    // Draws into the output surface; frames arrive as BGRA and are swizzled to RGBA
+    private val blitter = FrameBlitter()
 
     // Frame stats
     private var frameCount = 0L
@@ -67,7 +47,7 @@ class FrameSocketServer(private val port: Int = 19850) {
      * Set the output surface for rendering frames.
      */
     fun setOutputSurface(surface: Surface?) {
-        outputSurface = surface
+        blitter.setSurface(surface)
         Log.i(TAG, "Output surface set: ${surface != null}")
     }
 
@@ -144,9 +124,9 @@ class FrameSocketServer(private val port: Int = 19850) {
     }
 
     /**
-     * Receive frames and render each one directly via lockHardwareCanvas.
-     * Since the native wrapper caps at ~60 FPS, lockHardwareCanvas naturally
-     * paces to vsync giving smooth 1:1 frame delivery.
+     * Receive frames and render each one directly through the blitter.
+     * Since the native wrapper caps at ~60 FPS, locking the window buffer
+     * naturally paces to vsync giving smooth 1:1 frame delivery.
      */
     private fun receiveFrames(socket: Socket) {
         Log.i(TAG, "Receiving frames from ${socket.inetAddress}")
@@ -204,8 +184,10 @@ class FrameSocketServer(private val port: Int = 19850) {
 
                 receivedCount++
 
-                // Render this frame directly
-                renderFrame(width, height, pixelBuffer)
+                // Render this frame directly; alpha is forced by the blitter
+                if (blitter.blit(pixelBuffer, width, height, swizzle = true)) {
+                    frameCount++
+                }
 
                 // Stats
                 val now = System.currentTimeMillis()
@@ -229,69 +211,6 @@ class FrameSocketServer(private val port: Int = 19850) {
         Log.i(TAG, "Frame receiver ended")
     }
 
-    /**
-     * Render a frame directly using lockHardwareCanvas.
-     * Called from the receiver thread — lockHardwareCanvas paces to vsync.
-     */
-    private fun renderFrame(width: Int, height: Int, pixels: ByteArray) {
-        val surface = outputSurface
-        if (surface == null || !surface.isValid) return
-
-        try {
-            // Reuse or create bitmap
-            if (frameBitmap == null || bitmapWidth != width || bitmapHeight != height) {
-                frameBitmap?.recycle()
-                frameBitmap = Bitmap.createBitmap(width, height, Bitmap.Config.ARGB_8888)
-                bitmapWidth = width
-                bitmapHeight = height
-                Log.i(TAG, "Created frame bitmap: ${width}x${height}")
-            }
-
-            // Force alpha=255 — DXVK doesn't write swapchain alpha.
-            // This runs natively on ARM64 (ART JIT → NEON), unlike the old
-            // x86-64 loop that ran under FEX emulation and killed FPS.
-            var i = 3
-            val end = width * height * 4
-            while (i < end) {
-                pixels[i] = 0xFF.toByte()
-                i += 4
-            }
-
-            // Copy pixels to bitmap
-            frameBitmap!!.copyPixelsFromBuffer(ByteBuffer.wrap(pixels, 0, width * height * 4))
-
-            // lockHardwareCanvas blocks until vsync — natural frame pacing
-            val canvas = try {
-                surface.lockHardwareCanvas()
-            } catch (e: Exception) {
-                try {
-                    surface.lockCanvas(null)
-                } catch (e2: Exception) {
-                    return
-                }
-            } ?: return
-
-            // Scale to fit surface, centered
-            val scaleX = canvas.width.toFloat() / width
-            val scaleY = canvas.height.toFloat() / height
-            val scale = minOf(scaleX, scaleY)
-            val offsetX = (canvas.width - width * scale) / 2
-            val offsetY = (canvas.height - height * scale) / 2
-
-            canvas.drawColor(Color.BLACK)
-            canvas.save()
-            canvas.translate(offsetX, offsetY)
-            canvas.scale(scale, scale)
-            canvas.drawBitmap(frameBitmap!!, 0f, 0f, paint)
-            canvas.restore()
-
-            surface.unlockCanvasAndPost(canvas)
-            frameCount++
-        } catch (e: Exception) {
-            Log.e(TAG, "Failed to render frame: ${e.message}")
-        }
-    }
-
     /**
      * Save a frame for debugging.
      */
@@ -329,8 +248,7 @@ class FrameSocketServer(private val port: Int = 19850) {
         receiverThread?.interrupt()
         receiverThread = null
 
-        frameBitmap?.recycle()
-        frameBitmap = null
+        blitter.release()
 
         Log.i(TAG, "Frame socket server stopped")
     }
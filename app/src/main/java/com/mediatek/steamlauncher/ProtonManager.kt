@@ -1017,10 +1017,11 @@ REGEOF
 
                 # Check for rendering activity (new Vulkan calls since last check)
                 echo "=== layer_trace check (t+${'$'}{checkpoint}s) ==="
-                PRESENT_COUNT=${'$'}(grep -c "vkQueuePresentKHR" /tmp/layer_trace.log 2>/dev/null); PRESENT_COUNT=${'$'}{PRESENT_COUNT:-0}
-                ACQUIRE_COUNT=${'$'}(grep -c "vkAcquireNextImageKHR" /tmp/layer_trace.log 2>/dev/null); ACQUIRE_COUNT=${'$'}{ACQUIRE_COUNT:-0}
-                echo "  AcquireNextImage calls: ${'$'}ACQUIRE_COUNT"
-                echo "  QueuePresent calls: ${'$'}PRESENT_COUNT"
+                # Per-call events live in the binary ring (scripts/decode_layer_trace.py);
+                # the text log only records the first presents.
+                PRESENT_COUNT=${'$'}(grep -c "QueuePresent #" /tmp/layer_trace.log 2>/dev/null); PRESENT_COUNT=${'$'}{PRESENT_COUNT:-0}
+                echo "  QueuePresent markers: ${'$'}PRESENT_COUNT"
+                ls -la /tmp/layer_trace.*.bin 2>/dev/null
                 if [ "${'$'}PRESENT_COUNT" -gt 0 ]; then
                     echo "  >>> RENDERING ACTIVE! <<<"
                     tail -10 /tmp/layer_trace.log 2>/dev/null
@@ -1116,6 +1117,7 @@ REGEOF
             export HEADLESS_LAYER=1
             export DISABLE_HOST_HEADLESS=1
             export HEADLESS_DUMP_FRAMES=$dumpFrames
+            export HEADLESS_TRACE_TEXT=1   # per-call text lines in /tmp/layer_trace.log
 
             # DLL overrides (same as normal launch)
             export WINEDLLOVERRIDES="d3d11=n;d3d10core=n;d3d9=n;dxgi=n;d3d8=n;d3dcompiler_47=n;d3dcompiler_43=n;wined3d=d;mscoree=d;mshtml=d;steam_api64=n;steam_api=n;openvr_api_dxvk=d;d3d12=d;d3d12core=d;quartz=d;wmvcore=d;xaudio2_7=n;xaudio2_6=d;xaudio2_5=d;xaudio2_4=d;xaudio2_3=d;xaudio2_2=d;xaudio2_1=d;xaudio2_0=d;xaudio2_8=d;xaudio2_9=d;x3daudio1_7=d;x3daudio1_0=d;mfplat=d;mfreadwrite=d;mf=d;mfplay=d"
@@ -1188,7 +1190,7 @@ DXVKEOF
 
             # Clean old dump files
             rm -f /tmp/frame_*.ppm /tmp/frame_summary.txt
-            rm -f /tmp/layer_trace.log /tmp/icd_trace.log
+            rm -f /tmp/layer_trace.log /tmp/layer_trace.*.bin /tmp/icd_trace.log
             rm -f /tmp/wine_debug.log
             echo "Cleaned old dump files"
 
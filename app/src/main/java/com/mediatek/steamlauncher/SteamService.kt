@@ -4,11 +4,15 @@ import android.app.Notification
 import android.app.PendingIntent
 import android.app.Service
 import android.content.Intent
+import android.hardware.display.DisplayManager
 import android.os.Binder
 import android.os.Build
+import android.os.Handler
 import android.os.IBinder
+import android.os.Looper
 import android.os.PowerManager
 import android.util.Log
+import android.view.Display
 import android.view.Surface
 import androidx.annotation.RequiresApi
 import androidx.core.app.NotificationCompat
@@ -50,10 +54,23 @@ class SteamService : Service() {
     // Vortek socket path - must be accessible from both Android and container
     private val vortekSocketPath: String by lazy { "${app.getTmpDir()}/vortek.sock" }
 
-    // Frame socket for receiving Vulkan frames from FEX container (TCP on localhost:19850)
+    // Shared-memory frame reader for Vulkan frames from FEX container (/tmp/headless_frames),
+    // plus the legacy TCP server on localhost:19850 as a fallback
+    private var frameShmReader: FrameShmReader? = null
     private var frameSocketServer: FrameSocketServer? = null
     private var vulkanFrameSurface: Surface? = null  // Stored for when server starts later
 
+    /** Re-publishes the refresh period when the default display changes mode. */
+    private val displayListener = object : DisplayManager.DisplayListener {
+        override fun onDisplayAdded(displayId: Int) {}
+        override fun onDisplayRemoved(displayId: Int) {}
+        override fun onDisplayChanged(displayId: Int) {
+            if (displayId != Display.DEFAULT_DISPLAY) return
+            getSystemService(DisplayManager::class.java).getDisplay(displayId)
+                ?.let { frameShmReader?.setDisplayRefreshRate(it.refreshRate) }
+        }
+    }
+
     inner class LocalBinder : Binder() {
         fun getService(): SteamService = this@SteamService
     }
@@ -618,7 +635,16 @@ class SteamService : Service() {
             return
         }
 
-        Log.i(TAG, "Starting frame socket server on TCP port 19850")
+        Log.i(TAG, "Starting frame shm reader + socket server on TCP port 19850")
+
+        val displayManager = getSystemService(DisplayManager::class.java)
+        frameShmReader = FrameShmReader("${app.getFexRootfsDir()}/tmp/headless_frames").apply {
+            vulkanFrameSurface?.let { setOutputSurface(it) }
+            displayManager.getDisplay(Display.DEFAULT_DISPLAY)
+                ?.let { setDisplayRefreshRate(it.refreshRate) }
+            start()
+        }
+        displayManager.registerDisplayListener(displayListener, Handler(Looper.getMainLooper()))
 
         frameSocketServer = FrameSocketServer().apply {
             // Use the Vulkan frame surface if available, otherwise leave null
@@ -635,6 +661,9 @@ class SteamService : Service() {
      * Stop the frame socket server.
      */
     private fun stopFrameSocketServer() {
+        getSystemService(DisplayManager::class.java).unregisterDisplayListener(displayListener)
+        frameShmReader?.stop()
+        frameShmReader = null
         frameSocketServer?.stop()
         frameSocketServer = null
         Log.i(TAG, "Frame socket server stopped")
@@ -734,12 +763,13 @@ class SteamService : Service() {
     }
 
     /**
-     * Set the surface for Vulkan frame rendering (from FrameSocketServer).
+     * Set the surface for Vulkan frame rendering (from FrameShmReader / FrameSocketServer).
      * This is separate from the X11 output surface.
      */
     fun setVulkanFrameSurface(surface: Surface?) {
         Log.i(TAG, "setVulkanFrameSurface: surface=${surface != null}, serverRunning=${frameSocketServer != null}")
         vulkanFrameSurface = surface
+        frameShmReader?.setOutputSurface(surface)
         frameSocketServer?.setOutputSurface(surface)
     }
 
@@ -1,9 +1,11 @@
 package com.mediatek.steamlauncher
 
+import android.hardware.display.DisplayManager
 import android.os.Bundle
 import android.os.Handler
 import android.os.Looper
 import android.util.Log
+import android.view.Display
 import android.view.KeyEvent
 import android.view.SurfaceHolder
 import android.view.SurfaceView
@@ -46,12 +48,24 @@ class TerminalActivity : AppCompatActivity() {
     private var currentJob: Job? = null
     private var currentProcess: Process? = null
     private var currentDir: String = ""  // initialized in onCreate from app.getFexHomeDir()
-    private var frameSocketServer: FrameSocketServer? = null
+    private var frameShmReader: FrameShmReader? = null
+    private var frameSocketServer: FrameSocketServer? = null  // legacy TCP fallback
     private var x11Server: X11Server? = null
     private var framebufferBridge: FramebufferBridge? = null
     private var isDisplayMode = false
     private var surfaceReady = false
 
+    /** Re-publishes the refresh period when the default display changes mode. */
+    private val displayListener = object : DisplayManager.DisplayListener {
+        override fun onDisplayAdded(displayId: Int) {}
+        override fun onDisplayRemoved(displayId: Int) {}
+        override fun onDisplayChanged(displayId: Int) {
+            if (displayId != Display.DEFAULT_DISPLAY) return
+            getSystemService(DisplayManager::class.java).getDisplay(displayId)
+                ?.let { frameShmReader?.setDisplayRefreshRate(it.refreshRate) }
+        }
+    }
+
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
         setContentView(R.layout.activity_terminal)
@@ -71,7 +85,8 @@ class TerminalActivity : AppCompatActivity() {
         // Start VortekRenderer for Vulkan passthrough (doesn't need a surface)
         startVortekRenderer()
 
-        // Start frame socket server for vkcube frame capture
+        // Start frame readers for headless layer capture (shm, TCP fallback)
+        startFrameShmReader()
         startFrameSocketServer()
 
         // Request 120Hz display refresh rate
@@ -88,6 +103,7 @@ class TerminalActivity : AppCompatActivity() {
                 // Connect FramebufferBridge to the surface for Vortek rendering
                 framebufferBridge?.setOutputSurface(holder.surface)
                 if (isDisplayMode) {
+                    frameShmReader?.setOutputSurface(holder.surface)
                     frameSocketServer?.setOutputSurface(holder.surface)
                     Log.i(TAG, "Vulkan display surface created and connected")
                 }
@@ -96,6 +112,7 @@ class TerminalActivity : AppCompatActivity() {
             override fun surfaceChanged(holder: SurfaceHolder, format: Int, width: Int, height: Int) {
                 framebufferBridge?.setOutputSurface(holder.surface)
                 if (isDisplayMode) {
+                    frameShmReader?.setOutputSurface(holder.surface)
                     frameSocketServer?.setOutputSurface(holder.surface)
                     Log.i(TAG, "Vulkan display surface changed: ${width}x${height}")
                 }
@@ -104,6 +121,7 @@ class TerminalActivity : AppCompatActivity() {
             override fun surfaceDestroyed(holder: SurfaceHolder) {
                 surfaceReady = false
                 framebufferBridge?.setOutputSurface(null)
+                frameShmReader?.setOutputSurface(null)
                 frameSocketServer?.setOutputSurface(null)
                 Log.i(TAG, "Vulkan display surface destroyed")
             }
@@ -187,7 +205,7 @@ class TerminalActivity : AppCompatActivity() {
         }
 
         // vkcube: start X11 for xcb_connect(), switch to display mode, run with LD_PRELOAD
-        // for guest-side xcb_surface injection + frame capture via TCP 19850
+        // for guest-side xcb_surface injection + frame capture via /tmp/headless_frames
         findViewById<Button>(R.id.btnVkcube).setOnClickListener {
             // Start X11 if needed (vkcube calls xcb_connect())
             if (x11Server?.isRunning() != true) {
@@ -493,6 +511,7 @@ class TerminalActivity : AppCompatActivity() {
 
             // Connect surface if already ready
             if (surfaceReady) {
+                frameShmReader?.setOutputSurface(vulkanSurface.holder.surface)
                 frameSocketServer?.setOutputSurface(vulkanSurface.holder.surface)
             }
             Log.i(TAG, "Switched to Vulkan display mode")
@@ -502,6 +521,7 @@ class TerminalActivity : AppCompatActivity() {
             btnDisplay.text = "Display"
 
             // Disconnect surface
+            frameShmReader?.setOutputSurface(null)
             frameSocketServer?.setOutputSurface(null)
             Log.i(TAG, "Switched to terminal mode")
         }
@@ -892,6 +912,17 @@ class TerminalActivity : AppCompatActivity() {
         }
     }
 
+    private fun startFrameShmReader() {
+        if (frameShmReader != null) return
+        val displayManager = getSystemService(DisplayManager::class.java)
+        frameShmReader = FrameShmReader("${app.getFexRootfsDir()}/tmp/headless_frames").apply {
+            displayManager.getDisplay(Display.DEFAULT_DISPLAY)
+                ?.let { setDisplayRefreshRate(it.refreshRate) }
+            start()
+        }
+        displayManager.registerDisplayListener(displayListener, handler)
+    }
+
     private fun startFrameSocketServer() {
         if (frameSocketServer != null) return
         frameSocketServer = FrameSocketServer().apply {
@@ -908,7 +939,11 @@ class TerminalActivity : AppCompatActivity() {
         currentProcess = null
         currentJob?.cancel()
         scope.cancel()
+        getSystemService(DisplayManager::class.java).unregisterDisplayListener(displayListener)
+        frameShmReader?.setOutputSurface(null)
         frameSocketServer?.setOutputSurface(null)
+        frameShmReader?.stop()
+        frameShmReader = null
         frameSocketServer?.stop()
         frameSocketServer = null
         x11Server?.stop()
@@ -20,7 +20,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
@@ -34,7 +38,85 @@ static PFN_vkGetInstanceProcAddr real_gipa = NULL;
 static int init_done = 0;
 static void* saved_instance = NULL;
 
-/* File-based logging: stderr may not be captured, so also write to /tmp/icd_debug.txt */
+/* ==== Logging ====
+ * Leveled, per-category logging. Output still goes to stderr and
+ * /tmp/icd_debug.txt (stderr may not be captured), but hot paths no longer
+ * pay for it:
+ *
+ *   - Compile time: calls above ICD_LOG_COMPILE_LEVEL vanish entirely
+ *     (e.g. -DICD_LOG_COMPILE_LEVEL=2 for production builds).
+ *   - Run time: ICD_LOG_LEVEL=0..4 and ICD_LOG_CATS=mem,submit,...|all are
+ *     read once at load. A disabled call is one load + branch; its
+ *     arguments are not evaluated.
+ *   - Enabled messages are formatted into a lock-free ring and written by a
+ *     background thread, so the calling thread never touches stdio or does
+ *     the two fflushes through FEX syscall emulation. ERROR messages (and
+ *     everything with ICD_LOG_SYNC=1) drain the ring and write inline, so
+ *     nothing is lost if the process dies right after. A full ring drops
+ *     messages and counts them instead of blocking.
+ *
+ * LOG() is INFO/general; use LOGE/LOGW/LOGI/LOGD/LOGT(cat, ...) elsewhere.
+ */
+#include <stdarg.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define ICD_LL_ERROR 0
+#define ICD_LL_WARN  1
+#define ICD_LL_INFO  2
+#define ICD_LL_DEBUG 3   /* per-object: allocations, maps, shader modules */
+#define ICD_LL_TRACE 4   /* per-call: submits, Cmd*, descriptor updates */
+
+#ifndef ICD_LOG_COMPILE_LEVEL
+#define ICD_LOG_COMPILE_LEVEL ICD_LL_TRACE
+#endif
+
+#define ICD_LC_GENERAL (1u << 0)   /* init, instance/device, proc addr */
+#define ICD_LC_MEM     (1u << 1)   /* allocate/map/bind, heap split */
+#define ICD_LC_SUBMIT  (1u << 2)   /* queue submit/wait */
+#define ICD_LC_CMD     (1u << 3)   /* command recording, secondary replay */
+#define ICD_LC_SHADER  (1u << 4)   /* shader modules, SPIR-V fixups */
+#define ICD_LC_PIPE    (1u << 5)   /* pipeline creation */
+#define ICD_LC_DESC    (1u << 6)   /* descriptor sets/templates */
+#define ICD_LC_RES     (1u << 7)   /* buffers, images, views, samplers, sync objects */
+#define ICD_LC_ALL     0xFFFFFFFFu
+
+static int g_log_level = ICD_LL_INFO;
+static uint32_t g_log_cats = ICD_LC_ALL;
+static int g_log_sync = 0;
+
+#define ICD_LOG_ON(lvl, cat) \
+    ((lvl) <= ICD_LOG_COMPILE_LEVEL && (lvl) <= g_log_level && (g_log_cats & (cat)))
+#define LOGC(lvl, cat, ...) do { \
+    if (ICD_LOG_ON(lvl, cat)) icd_log_emit(lvl, __VA_ARGS__); \
+} while(0)
+#define LOGE(cat, ...) LOGC(ICD_LL_ERROR, cat, __VA_ARGS__)
+#define LOGW(cat, ...) LOGC(ICD_LL_WARN,  cat, __VA_ARGS__)
+#define LOGI(cat, ...) LOGC(ICD_LL_INFO,  cat, __VA_ARGS__)
+#define LOGD(cat, ...) LOGC(ICD_LL_DEBUG, cat, __VA_ARGS__)
+#define LOGT(cat, ...) LOGC(ICD_LL_TRACE, cat, __VA_ARGS__)
+#define LOG(...) LOGI(ICD_LC_GENERAL, __VA_ARGS__)
+
+#define LOG_RING_SIZE 2048          /* entries, power of two */
+#define LOG_MSG_MAX   480
+
+typedef struct {
+    volatile uint32_t seq;          /* Vyukov bounded-queue sequence */
+    struct timespec ts;
+    char msg[LOG_MSG_MAX];
+} LogEntry;
+
+static LogEntry g_log_ring[LOG_RING_SIZE];
+static volatile uint32_t g_log_head = 0;   /* next ticket for producers */
+static uint32_t g_log_tail = 0;            /* consumer position (drain lock held) */
+static volatile uint32_t g_log_dropped = 0;
+static volatile int g_log_waiter = 0;      /* consumer parked on futex */
+static volatile int g_log_stop = 0;        /* set by the unload destructor */
+static pthread_t g_log_thread;
+static int g_log_thread_running = 0;
+static pthread_mutex_t g_log_drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_log_thread_once = PTHREAD_ONCE_INIT;
+
 static FILE* g_icd_log = NULL;
 static void icd_log_init(void) {
     if (!g_icd_log) {
@@ -45,55 +127,728 @@ static void icd_log_init(void) {
         }
     }
 }
-static void log_timestamp(FILE* f) {
+static void log_timestamp(FILE* f, const struct timespec* ts) {
+    struct tm tm;
+    localtime_r(&ts->tv_sec, &tm);
+    fprintf(f, "[%02d:%02d:%02d.%03ld] ", tm.tm_hour, tm.tm_min, tm.tm_sec, ts->tv_nsec / 1000000);
+}
+
+static void log_write_line(const struct timespec* ts, const char* msg) {
+    log_timestamp(stderr, ts); fputs(msg, stderr);
+    icd_log_init();
+    if (g_icd_log) { log_timestamp(g_icd_log, ts); fputs(msg, g_icd_log); }
+}
+
+/* Write out everything published so far. Caller must hold g_log_drain_lock. */
+static int log_drain_locked(void) {
+    int n = 0;
+    for (;;) {
+        LogEntry* e = &g_log_ring[g_log_tail & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != g_log_tail + 1) break;
+        log_write_line(&e->ts, e->msg);
+        __atomic_store_n(&e->seq, g_log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        g_log_tail++;
+        n++;
+    }
+    uint32_t dropped = __atomic_exchange_n(&g_log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        char note[96];
+        snprintf(note, sizeof(note), "fex_thunk_icd: [log] ring full, dropped %u messages\n", dropped);
+        log_write_line(&ts, note);
+        n++;
+    }
+    if (n) { fflush(stderr); if (g_icd_log) fflush(g_icd_log); }
+    return n;
+}
+
+static void* log_writer_thread(void* arg) {
+    (void)arg;
+    while (!__atomic_load_n(&g_log_stop, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_log_drain_lock);
+        int n = log_drain_locked();
+        pthread_mutex_unlock(&g_log_drain_lock);
+        if (n) continue;
+        /* Park until a producer wakes us; the timeout bounds latency if a
+         * wake races with parking. */
+        __atomic_store_n(&g_log_waiter, 1, __ATOMIC_SEQ_CST);
+        LogEntry* e = &g_log_ring[g_log_tail & (LOG_RING_SIZE - 1)];
+        if (!__atomic_load_n(&g_log_stop, __ATOMIC_SEQ_CST) &&
+            __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != g_log_tail + 1) {
+            struct timespec to = {0, 100 * 1000000L};
+            syscall(SYS_futex, &g_log_waiter, FUTEX_WAIT_PRIVATE, 1, &to, NULL, 0);
+        }
+        __atomic_store_n(&g_log_waiter, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void log_start_thread(void) {
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) g_log_ring[i].seq = i;
+    if (pthread_create(&g_log_thread, NULL, log_writer_thread, NULL) == 0)
+        g_log_thread_running = 1;
+    else
+        g_log_sync = 1;
+}
+
+__attribute__((format(printf, 2, 3)))
+static void icd_log_emit(int lvl, const char* fmt, ...) {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
-    struct tm tm;
-    localtime_r(&ts.tv_sec, &tm);
-    fprintf(f, "[%02d:%02d:%02d.%03ld] ", tm.tm_hour, tm.tm_min, tm.tm_sec, ts.tv_nsec / 1000000);
+
+    if (g_log_sync || lvl == ICD_LL_ERROR) {
+        char line[LOG_MSG_MAX + 16];
+        int off = snprintf(line, sizeof(line), "fex_thunk_icd: ");
+        va_list ap; va_start(ap, fmt);
+        vsnprintf(line + off, sizeof(line) - off, fmt, ap);
+        va_end(ap);
+        pthread_mutex_lock(&g_log_drain_lock);
+        log_drain_locked();                 /* keep ordering with queued lines */
+        log_write_line(&ts, line);
+        fflush(stderr); if (g_icd_log) fflush(g_icd_log);
+        pthread_mutex_unlock(&g_log_drain_lock);
+        return;
+    }
+
+    pthread_once(&g_log_thread_once, log_start_thread);
+    if (g_log_sync) { /* thread creation failed */
+        va_list ap; va_start(ap, fmt);
+        char msg[LOG_MSG_MAX];
+        vsnprintf(msg, sizeof(msg), fmt, ap);
+        va_end(ap);
+        icd_log_emit(ICD_LL_ERROR, "%s", msg);
+        return;
+    }
+
+    /* Claim a ticket; the slot is free when its seq equals the ticket */
+    uint32_t pos = __atomic_load_n(&g_log_head, __ATOMIC_RELAXED);
+    LogEntry* e;
+    for (;;) {
+        e = &g_log_ring[pos & (LOG_RING_SIZE - 1)];
+        uint32_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_log_head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&g_log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&g_log_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    int off = snprintf(e->msg, sizeof(e->msg), "fex_thunk_icd: ");
+    va_list ap; va_start(ap, fmt);
+    vsnprintf(e->msg + off, sizeof(e->msg) - off, fmt, ap);
+    va_end(ap);
+    e->ts = ts;
+    __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&g_log_waiter, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&g_log_waiter, 0, __ATOMIC_RELAXED);
+        syscall(SYS_futex, &g_log_waiter, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static uint32_t log_cat_bit(const char* name, size_t len) {
+    static const struct { const char* name; uint32_t bit; } cats[] = {
+        {"general", ICD_LC_GENERAL}, {"mem", ICD_LC_MEM}, {"submit", ICD_LC_SUBMIT},
+        {"cmd", ICD_LC_CMD}, {"shader", ICD_LC_SHADER}, {"pipe", ICD_LC_PIPE},
+        {"desc", ICD_LC_DESC}, {"res", ICD_LC_RES}, {"all", ICD_LC_ALL},
+    };
+    for (size_t i = 0; i < sizeof(cats) / sizeof(cats[0]); i++)
+        if (strlen(cats[i].name) == len && strncmp(cats[i].name, name, len) == 0)
+            return cats[i].bit;
+    return 0;
+}
+
+/* A forked child has no writer thread — log synchronously there */
+static void icd_log_atfork_child(void) {
+    g_log_sync = 1;
+    g_log_thread_running = 0;
+    pthread_mutex_init(&g_log_drain_lock, NULL);
+}
+
+/* Runtime config, read once. Manual parsing — avoid __isoc23_strtol@GLIBC_2.38. */
+__attribute__((constructor)) static void icd_log_setup(void) {
+    const char* lvl = getenv("ICD_LOG_LEVEL");
+    if (lvl && *lvl >= '0' && *lvl <= '4') g_log_level = *lvl - '0';
+    const char* cats = getenv("ICD_LOG_CATS");
+    if (cats && *cats) {
+        g_log_cats = ICD_LC_GENERAL;  /* general always on so init/errors stay visible */
+        for (const char* p = cats; *p; ) {
+            const char* q = p;
+            while (*q && *q != ',') q++;
+            g_log_cats |= log_cat_bit(p, (size_t)(q - p));
+            p = *q ? q + 1 : q;
+        }
+    }
+    const char* sync = getenv("ICD_LOG_SYNC");
+    if (sync && *sync == '1') g_log_sync = 1;
+    pthread_atfork(NULL, NULL, icd_log_atfork_child);
+}
+
+/* Stop the writer before the loader unmaps us, then flush whatever it
+ * hasn't written yet */
+__attribute__((destructor)) static void icd_log_shutdown(void) {
+    if (g_log_thread_running) {
+        __atomic_store_n(&g_log_stop, 1, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&g_log_waiter, 0, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &g_log_waiter, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        pthread_join(g_log_thread, NULL);
+        g_log_thread_running = 0;
+    }
+    g_log_sync = 1;  /* other destructors may still log */
+    pthread_mutex_lock(&g_log_drain_lock);
+    log_drain_locked();
+    pthread_mutex_unlock(&g_log_drain_lock);
 }
-#define LOG(...) do { \
-    log_timestamp(stderr); fprintf(stderr, "fex_thunk_icd: " __VA_ARGS__); fflush(stderr); \
-    icd_log_init(); \
-    if (g_icd_log) { log_timestamp(g_icd_log); fprintf(g_icd_log, "fex_thunk_icd: " __VA_ARGS__); fflush(g_icd_log); } \
-} while(0)
 
 /* Forward declaration: injected extensions list (defined near extension filter) */
 static const char* g_injected_extensions[];
 
 /* ==== Handle Wrapper ====
  *
- * 16-byte struct that stands in for dispatchable handles (VkDevice, VkQueue,
+ * 32-byte struct that stands in for dispatchable handles (VkDevice, VkQueue,
  * VkCommandBuffer). The Vulkan loader writes its dispatch table to offset 0.
  * We store the real thunk handle at offset 8, never touched by anyone else.
+ * Command buffers hang their ICD-side state (CmdBufState, e.g. the secondary
+ * CB replay stream) off offset 16, so it is found without a table lookup.
  *
  * Thread safety: offset 8 is write-once (set at creation). Multiple threads
- * can read it concurrently with zero synchronization.
+ * can read it concurrently with zero synchronization. cb_state belongs to
+ * the thread recording the command buffer (external synchronization).
  */
 
 typedef struct {
     void* loader_dispatch;  /* offset 0: loader/layers write here */
     void* real_handle;      /* offset 8: real thunk handle (immutable) */
+    void* cb_state;         /* offset 16: CmdBufState*, created on demand */
+    void* reserved;         /* keeps cells at two per cache line */
 } HandleWrapper;
 
-static HandleWrapper* wrap_handle(void* real_handle) {
-    HandleWrapper* w = (HandleWrapper*)malloc(sizeof(HandleWrapper));
-    if (!w) {
-        LOG("wrap_handle: malloc failed!\n");
-        return NULL;
+static void cb_state_free(void* state);  /* defined in "Command Buffer State" */
+
+/* Wrappers are carved from 4 KiB slabs into 32-byte cells (two per cache
+ * line) and recycled through a per-thread free list, so the hot
+ * AllocateCommandBuffers/FreeCommandBuffers path never reaches guest
+ * malloc/free and never takes a lock. A thread hands surplus cells to a
+ * shared pool in batches and refills from it the same way; cells cached by
+ * an exiting thread go back to the pool. Slabs are never returned.
+ *
+ * ICD_WRAP_DEBUG=1 poisons freed cells: offset 0 (the loader's dispatch
+ * slot) is set to WRAP_POISON so a call through a stale handle faults at a
+ * recognizable address, unwrap() reports stale handles, double frees are
+ * caught, and a cell whose poison was overwritten is reported on reuse.
+ */
+_Static_assert(sizeof(HandleWrapper) == 32, "HandleWrapper must stay 32 bytes");
+
+#define WRAP_SLAB_BYTES 4096
+#define WRAP_SLAB_CELLS (WRAP_SLAB_BYTES / sizeof(HandleWrapper))
+#define WRAP_BATCH 64   /* cells moved between a thread and the pool at once */
+#define WRAP_POISON ((void*)0xDEADF4EEDEADF4EEULL)
+
+/* Free cells are linked through real_handle */
+#define WRAP_NEXT(w) (*(HandleWrapper**)&(w)->real_handle)
+
+static int g_wrap_debug = 0;
+static pthread_mutex_t g_wrap_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static HandleWrapper* g_wrap_pool = NULL;
+static uint32_t g_wrap_pool_count = 0;
+static uint32_t g_wrap_slabs = 0;
+static pthread_key_t g_wrap_key;
+static pthread_once_t g_wrap_once = PTHREAD_ONCE_INIT;
+static int g_wrap_key_valid = 0;
+
+static __thread HandleWrapper* t_wrap_free = NULL;
+static __thread uint32_t t_wrap_free_count = 0;
+static __thread int t_wrap_registered = 0;
+
+/* Move up to `n` cells from the head of *list to the pool */
+static void wrap_pool_give(HandleWrapper** list, uint32_t* count, uint32_t n) {
+    if (!*list || n == 0) return;
+    HandleWrapper* head = *list;
+    HandleWrapper* tail = head;
+    uint32_t moved = 1;
+    while (moved < n && WRAP_NEXT(tail)) {
+        tail = WRAP_NEXT(tail);
+        moved++;
+    }
+    *list = WRAP_NEXT(tail);
+    *count -= moved;
+    pthread_mutex_lock(&g_wrap_pool_lock);
+    WRAP_NEXT(tail) = g_wrap_pool;
+    g_wrap_pool = head;
+    g_wrap_pool_count += moved;
+    pthread_mutex_unlock(&g_wrap_pool_lock);
+}
+
+static void wrap_thread_exit(void* unused) {
+    (void)unused;
+    wrap_pool_give(&t_wrap_free, &t_wrap_free_count, t_wrap_free_count);
+}
+
+static void wrap_key_init(void) {
+    g_wrap_key_valid = pthread_key_create(&g_wrap_key, wrap_thread_exit) == 0;
+}
+
+/* App threads that outlive a dlclose() must not run wrap_thread_exit from
+ * unmapped text. Their cached cells are simply lost with the slabs. */
+__attribute__((destructor)) static void wrap_key_shutdown(void) {
+    if (g_wrap_key_valid) {
+        pthread_key_delete(g_wrap_key);
+        g_wrap_key_valid = 0;
+    }
+}
+
+/* Slow path: ensure this thread holds at least `want` free cells */
+static int wrap_refill(uint32_t want) {
+    if (!t_wrap_registered) {
+        pthread_once(&g_wrap_once, wrap_key_init);
+        pthread_setspecific(g_wrap_key, (void*)1);
+        t_wrap_registered = 1;
+    }
+    while (t_wrap_free_count < want) {
+        /* Prefer recycled cells */
+        pthread_mutex_lock(&g_wrap_pool_lock);
+        uint32_t take = 0;
+        while (g_wrap_pool && (take < WRAP_BATCH || t_wrap_free_count < want)) {
+            HandleWrapper* w = g_wrap_pool;
+            g_wrap_pool = WRAP_NEXT(w);
+            WRAP_NEXT(w) = t_wrap_free;
+            t_wrap_free = w;
+            t_wrap_free_count++;
+            take++;
+        }
+        g_wrap_pool_count -= take;
+        pthread_mutex_unlock(&g_wrap_pool_lock);
+        if (take) continue;
+
+        void* slab = mmap(NULL, WRAP_SLAB_BYTES, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED) {
+            LOGE(ICD_LC_GENERAL, "wrap_refill: slab mmap failed\n");
+            return 0;
+        }
+        HandleWrapper* cells = (HandleWrapper*)slab;
+        for (uint32_t i = 0; i < WRAP_SLAB_CELLS; i++) {
+            cells[i].loader_dispatch = g_wrap_debug ? WRAP_POISON : NULL;
+            WRAP_NEXT(&cells[i]) = t_wrap_free;
+            t_wrap_free = &cells[i];
+        }
+        t_wrap_free_count += WRAP_SLAB_CELLS;
+        uint32_t slabs = __atomic_add_fetch(&g_wrap_slabs, 1, __ATOMIC_RELAXED);
+        LOGD(ICD_LC_GENERAL, "wrap_refill: new wrapper slab #%u (%u cells)\n",
+            slabs, (unsigned)WRAP_SLAB_CELLS);
     }
+    return 1;
+}
+
+static inline HandleWrapper* wrap_pop(void* real_handle) {
+    HandleWrapper* w = t_wrap_free;
+    t_wrap_free = WRAP_NEXT(w);
+    t_wrap_free_count--;
+    if (g_wrap_debug && w->loader_dispatch != WRAP_POISON)
+        LOGE(ICD_LC_GENERAL, "wrapper %p written after free (offset 0 = %p)\n",
+            (void*)w, w->loader_dispatch);
     w->loader_dispatch = NULL;
     w->real_handle = real_handle;
+    w->cb_state = NULL;
     return w;
 }
 
+static HandleWrapper* wrap_handle(void* real_handle) {
+    if (!t_wrap_free && !wrap_refill(1)) {
+        LOG("wrap_handle: allocation failed!\n");
+        return NULL;
+    }
+    return wrap_pop(real_handle);
+}
+
+/* Wrap `count` handles in place (NULL entries are left alone). Cells for the
+ * whole batch are reserved up front, so one refill serves a large
+ * vkAllocateCommandBuffers. Returns 0 if the cells could not be allocated;
+ * nothing is wrapped in that case. */
+static int wrap_handles(void** handles, uint32_t count) {
+    if (t_wrap_free_count < count && !wrap_refill(count)) {
+        LOG("wrap_handles: allocation of %u wrappers failed!\n", count);
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        if (handles[i]) handles[i] = wrap_pop(handles[i]);
+    return 1;
+}
+
 static inline void* unwrap(void* wrapper) {
     if (!wrapper) return NULL;
+    if (__builtin_expect(g_wrap_debug, 0) &&
+        ((HandleWrapper*)wrapper)->loader_dispatch == WRAP_POISON)
+        LOGE(ICD_LC_GENERAL, "unwrap: handle %p used after free\n", wrapper);
     return ((HandleWrapper*)wrapper)->real_handle;
 }
 
 static void free_wrapper(void* wrapper) {
-    free(wrapper);
+    HandleWrapper* w = (HandleWrapper*)wrapper;
+    if (!w) return;
+    if (g_wrap_debug) {
+        if (w->loader_dispatch == WRAP_POISON) {
+            LOGE(ICD_LC_GENERAL, "free_wrapper: double free of %p\n", wrapper);
+            return;
+        }
+        w->loader_dispatch = WRAP_POISON;
+    }
+    if (w->cb_state) {
+        cb_state_free(w->cb_state);
+        w->cb_state = NULL;
+    }
+    WRAP_NEXT(w) = t_wrap_free;
+    t_wrap_free = w;
+    if (++t_wrap_free_count > 2 * WRAP_BATCH)
+        wrap_pool_give(&t_wrap_free, &t_wrap_free_count, WRAP_BATCH);
+}
+
+/* ==== Handle Maps ====
+ *
+ * Side tables keyed by 64-bit non-dispatchable handles (buffer → memory
+ * binding, image → BC substitution, pipeline → vertex input strides, ...).
+ * Open addressing with linear probing; deletion shifts the rest of the
+ * cluster back instead of leaving tombstones, so probe lengths don't decay
+ * as games churn through resources. Tables grow at 50% load — nothing is
+ * ever silently dropped at a fixed cap.
+ *
+ * Thread safety: one rwlock per map, since DXVK creates resources and
+ * records commands from several worker threads. Values are stored inline and
+ * move on growth/deletion: either copy them out (hmap_get) or hold the lock
+ * while using the pointer (hmap_*_locked). Key 0 (VK_NULL_HANDLE) is never
+ * stored.
+ */
+
+typedef struct {
+    pthread_rwlock_t lock;
+    uint64_t* keys;     /* 0 = empty slot */
+    uint8_t* vals;
+    uint32_t val_size;
+    uint32_t cap;       /* power of two, 0 until the first insert */
+    uint32_t count;
+} HandleMap;
+
+#define HMAP_INIT(type) { PTHREAD_RWLOCK_INITIALIZER, NULL, NULL, sizeof(type), 0, 0 }
+#define HMAP_MIN_CAP 64
+
+static inline uint32_t hmap_hash(uint64_t key) {
+    /* murmur3 finalizer: handles are often page-aligned pointers/indices */
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+#define hmap_rdlock(m) pthread_rwlock_rdlock(&(m)->lock)
+#define hmap_wrlock(m) pthread_rwlock_wrlock(&(m)->lock)
+#define hmap_unlock(m) pthread_rwlock_unlock(&(m)->lock)
+
+static inline void* hmap_val(HandleMap* m, uint32_t i) {
+    return m->vals + (size_t)i * m->val_size;
+}
+
+static void* hmap_find_locked(HandleMap* m, uint64_t key) {
+    if (!key || !m->cap) return NULL;
+    uint32_t mask = m->cap - 1;
+    for (uint32_t i = hmap_hash(key) & mask;; i = (i + 1) & mask) {
+        if (m->keys[i] == key) return hmap_val(m, i);
+        if (!m->keys[i]) return NULL;
+    }
+}
+
+static int hmap_grow(HandleMap* m) {
+    uint32_t ncap = m->cap ? m->cap * 2 : HMAP_MIN_CAP;
+    uint64_t* nkeys = (uint64_t*)calloc(ncap, sizeof(uint64_t));
+    uint8_t* nvals = (uint8_t*)malloc((size_t)ncap * m->val_size);
+    if (!nkeys || !nvals) {
+        free(nkeys);
+        free(nvals);
+        LOGE(ICD_LC_RES, "hmap_grow: allocation failed (cap %u)\n", ncap);
+        return 0;
+    }
+    for (uint32_t i = 0; i < m->cap; i++) {
+        if (!m->keys[i]) continue;
+        uint32_t j = hmap_hash(m->keys[i]) & (ncap - 1);
+        while (nkeys[j]) j = (j + 1) & (ncap - 1);
+        nkeys[j] = m->keys[i];
+        memcpy(nvals + (size_t)j * m->val_size, hmap_val(m, i), m->val_size);
+    }
+    free(m->keys);
+    free(m->vals);
+    m->keys = nkeys;
+    m->vals = nvals;
+    m->cap = ncap;
+    return 1;
+}
+
+/* Find or insert `key`. New values are zeroed. NULL only if key is 0 or
+ * the table could not grow. Caller holds the write lock. */
+static void* hmap_insert_locked(HandleMap* m, uint64_t key) {
+    if (!key) return NULL;
+    void* v = hmap_find_locked(m, key);
+    if (v) return v;
+    if ((m->count + 1) * 2 > m->cap && !hmap_grow(m)) return NULL;
+    uint32_t mask = m->cap - 1;
+    uint32_t i = hmap_hash(key) & mask;
+    while (m->keys[i]) i = (i + 1) & mask;
+    m->keys[i] = key;
+    m->count++;
+    v = hmap_val(m, i);
+    memset(v, 0, m->val_size);
+    return v;
+}
+
+/* Remove `key`, copying its value to `out` if non-NULL. Returns 1 if it
+ * was present. Caller holds the write lock. */
+static int hmap_remove_locked(HandleMap* m, uint64_t key, void* out) {
+    if (!key || !m->cap) return 0;
+    uint32_t mask = m->cap - 1;
+    uint32_t i = hmap_hash(key) & mask;
+    while (m->keys[i] != key) {
+        if (!m->keys[i]) return 0;
+        i = (i + 1) & mask;
+    }
+    if (out) memcpy(out, hmap_val(m, i), m->val_size);
+
+    /* Backward shift: pull later cluster members into the hole unless that
+     * would move them before their home slot. */
+    for (uint32_t j = (i + 1) & mask; m->keys[j]; j = (j + 1) & mask) {
+        uint32_t home = hmap_hash(m->keys[j]) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->keys[i] = m->keys[j];
+            memcpy(hmap_val(m, i), hmap_val(m, j), m->val_size);
+            i = j;
+        }
+    }
+    m->keys[i] = 0;
+    m->count--;
+    return 1;
+}
+
+static int hmap_get(HandleMap* m, uint64_t key, void* out) {
+    hmap_rdlock(m);
+    void* v = hmap_find_locked(m, key);
+    if (v && out) memcpy(out, v, m->val_size);
+    hmap_unlock(m);
+    return v != NULL;
+}
+
+static int hmap_put(HandleMap* m, uint64_t key, const void* val) {
+    hmap_wrlock(m);
+    void* v = hmap_insert_locked(m, key);
+    if (v) memcpy(v, val, m->val_size);
+    hmap_unlock(m);
+    return v != NULL;
+}
+
+static int hmap_del(HandleMap* m, uint64_t key, void* out) {
+    hmap_wrlock(m);
+    int found = hmap_remove_locked(m, key, out);
+    hmap_unlock(m);
+    return found;
+}
+
+static inline uint32_t hmap_count(HandleMap* m) {
+    return __atomic_load_n(&m->count, __ATOMIC_RELAXED);
+}
+
+/* Drop every entry and the table itself */
+static void hmap_clear(HandleMap* m) {
+    hmap_wrlock(m);
+    free(m->keys);
+    free(m->vals);
+    m->keys = NULL;
+    m->vals = NULL;
+    m->cap = 0;
+    m->count = 0;
+    hmap_unlock(m);
+}
+
+/* ==== Worker Pools ====
+ *
+ * Fork-join pools for work that fans out into independent items (BC decode
+ * rows, inline shader stages, pipelines of a batch). worker_pool_for()
+ * queues a job; the pool threads and the calling thread claim its items
+ * until none are left, and the call returns once all of them finished.
+ *
+ * Threads start on first use, sized by the pool's env var (default: CPUs - 1,
+ * capped at the pool's max; 0 runs everything on the caller). Every started
+ * pool is registered so that:
+ *   - a forked child, which has no pool threads, runs items on the caller;
+ *   - a library destructor stops and joins the threads before the loader
+ *     unmaps us, since a worker left parked in pthread_cond_wait would
+ *     return into unmapped text.
+ */
+
+#define WORKER_POOL_LIMIT 16   /* env var values are clamped to this */
+
+typedef struct PoolJob {
+    struct PoolJob* next;       /* queue of jobs with unclaimed items */
+    void (*fn)(void* ctx, uint32_t item);
+    void* ctx;
+    uint32_t count;
+    uint32_t next_item;
+    uint32_t done;
+} PoolJob;
+
+typedef struct WorkerPool {
+    const char* name;           /* for logs */
+    const char* env;            /* thread count override */
+    int max_threads;            /* default cap */
+    int threads;                /* 0 = run on the caller */
+    int started;                /* threads started (set once, under g_worker_pools_lock) */
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    PoolJob* queue;
+    pthread_t tids[WORKER_POOL_LIMIT];
+    struct WorkerPool* next_pool;
+} WorkerPool;
+
+#define WORKER_POOL_INIT(name_, env_, max_) { \
+    (name_), (env_), (max_), 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, \
+    PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, {0}, NULL }
+
+static pthread_mutex_t g_worker_pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static WorkerPool* g_worker_pools = NULL;   /* pools with running threads */
+
+/* Claim the next item of the oldest queued job (or of `only`). A job
+ * leaves the queue once its last item is claimed. Caller holds p->lock. */
+static PoolJob* worker_pool_claim_locked(WorkerPool* p, PoolJob* only, uint32_t* item) {
+    for (PoolJob** pp = &p->queue; *pp; pp = &(*pp)->next) {
+        PoolJob* j = *pp;
+        if (only && j != only) continue;
+        *item = j->next_item++;
+        if (j->next_item >= j->count) *pp = j->next;
+        return j;
+    }
+    return NULL;
+}
+
+static void* worker_pool_thread(void* arg) {
+    WorkerPool* p = (WorkerPool*)arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        uint32_t item;
+        PoolJob* j = worker_pool_claim_locked(p, NULL, &item);
+        if (!j) {
+            if (p->stop) break;
+            pthread_cond_wait(&p->wake, &p->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+        j->fn(j->ctx, item);
+        pthread_mutex_lock(&p->lock);
+        if (++j->done == j->count)
+            pthread_cond_broadcast(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void worker_pools_atfork_child(void) {
+    for (WorkerPool* p = g_worker_pools; p; p = p->next_pool) {
+        p->threads = 0;
+        p->queue = NULL;
+        pthread_mutex_init(&p->lock, NULL);
+    }
+    g_worker_pools = NULL;
+    pthread_mutex_init(&g_worker_pools_lock, NULL);
+}
+
+__attribute__((destructor)) static void worker_pools_shutdown(void) {
+    pthread_mutex_lock(&g_worker_pools_lock);
+    for (WorkerPool* p = g_worker_pools; p; p = p->next_pool) {
+        pthread_mutex_lock(&p->lock);
+        p->stop = 1;
+        pthread_cond_broadcast(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+        for (int i = 0; i < p->threads; i++)
+            pthread_join(p->tids[i], NULL);
+        __atomic_store_n(&p->threads, 0, __ATOMIC_RELAXED);  /* late callers run items inline */
+    }
+    g_worker_pools = NULL;
+    pthread_mutex_unlock(&g_worker_pools_lock);
+}
+
+/* Start the pool's threads unless that was already done; returns the
+ * thread count. Manual parsing — avoid __isoc23_strtol@GLIBC_2.38. */
+static int worker_pool_start(WorkerPool* p) {
+    static int atfork_registered = 0;
+    if (__atomic_load_n(&p->started, __ATOMIC_ACQUIRE))
+        return __atomic_load_n(&p->threads, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&g_worker_pools_lock);
+    if (p->started) {
+        pthread_mutex_unlock(&g_worker_pools_lock);
+        return p->threads;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int want = cpus > 1 ? (int)(cpus - 1) : 0;
+    if (want > p->max_threads) want = p->max_threads;
+    const char* env = getenv(p->env);
+    if (env && *env >= '0' && *env <= '9') {
+        want = 0;
+        for (const char* s = env; *s >= '0' && *s <= '9' && want <= WORKER_POOL_LIMIT; s++)
+            want = want * 10 + (*s - '0');
+        if (want > WORKER_POOL_LIMIT) want = WORKER_POOL_LIMIT;
+    }
+
+    int started = 0;
+    for (int i = 0; i < want; i++) {
+        if (pthread_create(&p->tids[i], NULL, worker_pool_thread, p) != 0) break;
+        started++;
+    }
+    if (started) {
+        p->next_pool = g_worker_pools;
+        g_worker_pools = p;
+        if (!atfork_registered) {
+            pthread_atfork(NULL, NULL, worker_pools_atfork_child);
+            atfork_registered = 1;
+        }
+    }
+    p->threads = started;
+    __atomic_store_n(&p->started, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_worker_pools_lock);
+    LOG("%s pool: %d thread(s)\n", p->name, started);
+    return started;
+}
+
+/* Run fn(ctx, 0..count-1) on the pool and the calling thread; returns once
+ * every item has finished. The caller only helps with its own job, so a
+ * long item from another thread's job never delays it. */
+static void worker_pool_for(WorkerPool* p, uint32_t count,
+                            void (*fn)(void* ctx, uint32_t item), void* ctx) {
+    if (worker_pool_start(p) == 0 || count < 2) {
+        for (uint32_t i = 0; i < count; i++) fn(ctx, i);
+        return;
+    }
+
+    PoolJob job = { NULL, fn, ctx, count, 0, 0 };
+    pthread_mutex_lock(&p->lock);
+    PoolJob** tail = &p->queue;
+    while (*tail) tail = &(*tail)->next;
+    *tail = &job;
+    pthread_cond_broadcast(&p->wake);
+
+    uint32_t item;
+    while (worker_pool_claim_locked(p, &job, &item)) {
+        pthread_mutex_unlock(&p->lock);
+        fn(ctx, item);
+        pthread_mutex_lock(&p->lock);
+        job.done++;
+    }
+    while (job.done < job.count)
+        pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
 }
 
 /* ==== Unwrap Trampoline Generator ====
@@ -149,13 +904,23 @@ static void ensure_init(void) {
     if (init_done) return;
     init_done = 1;
 
+    const char* wrap_dbg = getenv("ICD_WRAP_DEBUG");
+    if (wrap_dbg && *wrap_dbg == '1') {
+        g_wrap_debug = 1;
+        LOG("ICD_WRAP_DEBUG: poisoning freed handle wrappers\n");
+    }
+
+    /* ICD_THUNK_LIB points the shim at another vkGetInstanceProcAddr
+     * provider, e.g. the loader tests' mock ICD for the startup benchmark */
     const char* paths[] = {
+        getenv("ICD_THUNK_LIB"),
         "/opt/fex/share/fex-emu/GuestThunks/libvulkan-guest.so",
         "/opt/fex/share/fex-emu/GuestThunks_32/libvulkan-guest.so",
         NULL
     };
+    int first = paths[0] && *paths[0] ? 0 : 1;
 
-    for (int i = 0; paths[i]; i++) {
+    for (int i = first; paths[i]; i++) {
         LOG("Trying: %s\n", paths[i]);
         thunk_lib = dlopen(paths[i], RTLD_NOW | RTLD_LOCAL);
         if (thunk_lib) {
@@ -209,7 +974,7 @@ static void ensure_init(void) {
 
 #define STAGING_HEAP_CAP (512ULL * 1024 * 1024)  /* 512 MiB — generous; real limit is Vortek/Mali, not memory */
 #define MAP_BYTE_LIMIT  (4096ULL * 1024 * 1024) /* 4 GiB — must exceed ALLOC_BYTE_CAP to prevent fake maps */
-#define ALLOC_BYTE_CAP  (2048ULL * 1024 * 1024)  /* 2 GiB — BC→RGBA 4x memory increase */
+#define ALLOC_BYTE_CAP  (2048ULL * 1024 * 1024)  /* 2 GiB — BC→RGBA 4x memory increase (ICD_BC_TARGET=etc2 avoids it) */
 
 /* Tracks the virtual type we added so other wrappers can patch accordingly */
 static int g_added_type_index = -1;    /* index of added DEVICE_LOCAL-only type, -1 if none */
@@ -381,42 +1146,67 @@ static int is_bc_format(uint32_t format) {
     return format >= 131 && format <= 146;
 }
 
+/* BC format → ETC2/EAC format of the same block size, or 0 (BC6H) */
+static uint32_t bc_to_etc2_format(uint32_t bc_fmt) {
+    switch (bc_fmt) {
+    case 131: return 147;                   /* ETC2_R8G8B8_UNORM */
+    case 132: return 148;                   /* ETC2_R8G8B8_SRGB */
+    case 133: return 149;                   /* ETC2_R8G8B8A1_UNORM */
+    case 134: return 150;                   /* ETC2_R8G8B8A1_SRGB */
+    case 135: case 137: case 145: return 151;   /* ETC2_R8G8B8A8_UNORM */
+    case 136: case 138: case 146: return 152;   /* ETC2_R8G8B8A8_SRGB */
+    case 139: return 153;                   /* EAC_R11_UNORM */
+    case 140: return 154;                   /* EAC_R11_SNORM */
+    case 141: return 155;                   /* EAC_R11G11_UNORM */
+    case 142: return 156;                   /* EAC_R11G11_SNORM */
+    default: return 0;
+    }
+}
+
+static int is_etc2_format(uint32_t fmt) {
+    return fmt >= 147 && fmt <= 156;
+}
+
+/* ICD_BC_TARGET=etc2 and textureCompressionETC2 enabled, see wrapped_CreateDevice */
+static int g_bc_etc2 = 0;
+
 /* BC→RGBA format substitution: Mali doesn't support BC formats.
  * Map BC formats to uncompressed equivalents so vkCreateImage succeeds.
  * SRGB variants: 132, 134, 136, 138, 146 → R8G8B8A8_SRGB (43)
- * UNORM variants: everything else → R8G8B8A8_UNORM (37) */
-static uint32_t bc_to_rgba_format(uint32_t bc_fmt) {
+ * SNORM variants: 140 (BC4), 142 (BC5) → R8G8B8A8_SNORM (38)
+ * UNORM variants: everything else → R8G8B8A8_UNORM (37)
+ * In ETC2 mode, images only sampled and copied get the ETC2/EAC format of
+ * the same block size instead (keeps the BC footprint; ETC2 can't be a
+ * storage image or attachment).
+ * Uploads are decoded into these formats, see "BCn Decode". */
+static uint32_t bc_to_rgba_format(uint32_t bc_fmt, uint32_t usage) {
+    /* TRANSFER_SRC | TRANSFER_DST | SAMPLED */
+    if (g_bc_etc2 && !(usage & ~0x7u) && bc_to_etc2_format(bc_fmt))
+        return bc_to_etc2_format(bc_fmt);
     switch (bc_fmt) {
         case 132: case 134: case 136: case 138: case 146:
             return 43; /* VK_FORMAT_R8G8B8A8_SRGB */
+        case 140: case 142:
+            return 38; /* VK_FORMAT_R8G8B8A8_SNORM */
         default:
             return 37; /* VK_FORMAT_R8G8B8A8_UNORM */
     }
 }
 
 /* Track BC-substituted images: image handle → original BC format */
-#define BC_IMG_MAX 4096
-static struct {
-    uint64_t image;
+typedef struct {
     uint32_t bc_format;
     uint32_t rgba_format;
-} g_bc_images[BC_IMG_MAX];
-static int g_bc_img_count = 0;
+} BcImageInfo;
+static HandleMap g_bc_images = HMAP_INIT(BcImageInfo);
 
 static void bc_img_track(uint64_t image, uint32_t bc_fmt, uint32_t rgba_fmt) {
-    if (g_bc_img_count < BC_IMG_MAX) {
-        g_bc_images[g_bc_img_count].image = image;
-        g_bc_images[g_bc_img_count].bc_format = bc_fmt;
-        g_bc_images[g_bc_img_count].rgba_format = rgba_fmt;
-        g_bc_img_count++;
-    }
+    BcImageInfo info = { bc_fmt, rgba_fmt };
+    hmap_put(&g_bc_images, image, &info);
 }
 
-static int bc_img_lookup(uint64_t image) {
-    for (int i = 0; i < g_bc_img_count; i++)
-        if (g_bc_images[i].image == image)
-            return i;
-    return -1;
+static int bc_img_lookup(uint64_t image, BcImageInfo* out) {
+    return hmap_get(&g_bc_images, image, out);
 }
 
 static int fmt_prop_call_count = 0;
@@ -424,7 +1214,7 @@ static int fmt_prop_call_count = 0;
 static void wrapped_GetPhysicalDeviceFormatProperties(void* physDev, uint32_t format, void* pProps) {
     fmt_prop_call_count++;
     if (fmt_prop_call_count <= 5 || is_bc_format(format)) {
-        LOG("FormatProperties CALLED #%d: fmt=%u pd=%p pProps=%p\n",
+        LOGD(ICD_LC_RES, "FormatProperties CALLED #%d: fmt=%u pd=%p pProps=%p\n",
             fmt_prop_call_count, format, physDev, pProps);
     }
 
@@ -438,10 +1228,10 @@ static void wrapped_GetPhysicalDeviceFormatProperties(void* physDev, uint32_t fo
         uint32_t* optimal = (uint32_t*)((uint8_t*)pProps + 4);
         uint32_t* buffer  = (uint32_t*)((uint8_t*)pProps + 8);
 
-        LOG("FormatProperties: fmt=%u (BC) linear=0x%x optimal=0x%x buf=0x%x\n",
+        LOGD(ICD_LC_RES, "FormatProperties: fmt=%u (BC) linear=0x%x optimal=0x%x buf=0x%x\n",
             format, *linear, *optimal, *buffer);
         if (*optimal == 0) {
-            LOG("FormatProperties: fmt=%u -> INJECTING optimal=0x%x\n",
+            LOGD(ICD_LC_RES, "FormatProperties: fmt=%u -> INJECTING optimal=0x%x\n",
                 format, BC_OPTIMAL_FEATURES);
             *optimal = BC_OPTIMAL_FEATURES;
         }
@@ -453,7 +1243,7 @@ static void wrapped_GetPhysicalDeviceFormatProperties(void* physDev, uint32_t fo
         uint32_t* buffer = (uint32_t*)((uint8_t*)pProps + 8);
         if (!(*buffer & MY_VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
             *buffer |= MY_VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT;
-            LOG("FormatProperties: fmt=%u (SCALED) -> INJECTING VERTEX_BUFFER_BIT\n", format);
+            LOGD(ICD_LC_RES, "FormatProperties: fmt=%u (SCALED) -> INJECTING VERTEX_BUFFER_BIT\n", format);
         }
     }
 }
@@ -467,7 +1257,7 @@ static int fmt_prop2_call_count = 0;
 static void wrapped_GetPhysicalDeviceFormatProperties2(void* physDev, uint32_t format, void* pProps) {
     fmt_prop2_call_count++;
     if (fmt_prop2_call_count <= 5 || is_bc_format(format)) {
-        LOG("FormatProperties2 CALLED #%d: fmt=%u pd=%p\n",
+        LOGD(ICD_LC_RES, "FormatProperties2 CALLED #%d: fmt=%u pd=%p\n",
             fmt_prop2_call_count, format, physDev);
     }
 
@@ -478,9 +1268,9 @@ static void wrapped_GetPhysicalDeviceFormatProperties2(void* physDev, uint32_t f
     /* VkFormatProperties2: sType(4)+pad(4)+pNext(8)+formatProperties(12) */
     if (pProps && is_bc_format(format)) {
         uint32_t* optimal = (uint32_t*)((uint8_t*)pProps + 20);
-        LOG("FormatProperties2: fmt=%u (BC) optimal=0x%x\n", format, *optimal);
+        LOGD(ICD_LC_RES, "FormatProperties2: fmt=%u (BC) optimal=0x%x\n", format, *optimal);
         if (*optimal == 0) {
-            LOG("FormatProperties2: fmt=%u -> INJECTING optimal=0x%x\n",
+            LOGD(ICD_LC_RES, "FormatProperties2: fmt=%u -> INJECTING optimal=0x%x\n",
                 format, BC_OPTIMAL_FEATURES);
             *optimal = BC_OPTIMAL_FEATURES;
         }
@@ -492,7 +1282,7 @@ static void wrapped_GetPhysicalDeviceFormatProperties2(void* physDev, uint32_t f
         uint32_t* buffer = (uint32_t*)((uint8_t*)pProps + 24);
         if (!(*buffer & MY_VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT)) {
             *buffer |= MY_VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT;
-            LOG("FormatProperties2: fmt=%u (SCALED) -> INJECTING VERTEX_BUFFER_BIT\n", format);
+            LOGD(ICD_LC_RES, "FormatProperties2: fmt=%u (SCALED) -> INJECTING VERTEX_BUFFER_BIT\n", format);
         }
     }
 }
@@ -758,6 +1548,7 @@ static void wrapped_GetPhysicalDeviceFeatures2(void* physDev, void* pFeatures) {
 
 typedef VkResult (*PFN_vkCreateInstance)(const void*, const void*, void**);
 static PFN_vkCreateInstance real_create_instance = NULL;
+static char g_app_name[64];     /* VkApplicationInfo::pApplicationName, names per-game caches */
 
 /* Worker thread for CreateInstance — avoids FEX thunk hang when called
  * from within Wine's embedded Vulkan loader context */
@@ -784,6 +1575,13 @@ static VkResult wrapped_CreateInstance(const void* pCreateInfo,
         return -3;
     }
 
+    /* VkInstanceCreateInfo: pApplicationInfo at 24; VkApplicationInfo:
+     * pApplicationName at 16 (DXVK puts the executable name there) */
+    const uint8_t* app_info = pCreateInfo ? *(const uint8_t* const*)((const uint8_t*)pCreateInfo + 24) : NULL;
+    const char* app_name = app_info ? *(const char* const*)(app_info + 16) : NULL;
+    if (app_name && *app_name)
+        snprintf(g_app_name, sizeof(g_app_name), "%s", app_name);
+
     /* Call real_create_instance from a separate thread to avoid FEX thunk
      * hanging when called from within Wine's embedded Vulkan loader context.
      * The loader may hold locks or create a context that blocks the thunk. */
@@ -849,11 +1647,28 @@ static PFN_vkGetDeviceProcAddr real_gdpa = NULL;
  * one real VkDevice but give each caller its own HandleWrapper.
  *
  * Queue serialization: Two dxvk-submit threads race on the same real VkQueue.
- * VkQueue requires external synchronization for submit/wait ops. We use a
- * pthread mutex around all queue operations to prevent DEVICE_LOST. */
+ * VkQueue requires external synchronization for submit/wait ops, so every
+ * queue operation goes through the real queue's QueueState lock (see
+ * "Queue Submission") to prevent DEVICE_LOST. */
 static void* shared_real_device = NULL;
 static int device_ref_count = 0;
-static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t g_max_storage_buffer_range = 0;  /* 0 = unknown */
+static void submit_flush(void);  /* defined in "Queue Submission" */
+static void bc_stage_release_cb(void* real_cb);  /* defined in "BCn Decode" */
+static void bc_stage_track_cbs(const void* pAllocInfo, void** pCmdBufs, uint32_t count);
+static void bc_stage_forget_cb(void* real_cb);
+static void bc_stage_release_pool(uint64_t pool, int destroyed);
+static void bc_stage_destroy_all(void);
+static void spv_cache_report(void);  /* defined in "SPIR-V Fixup Cache" */
+static void pcache_open(void* real_device);  /* defined in "Pipeline Cache" */
+static void pcache_close(void);
+static void desc_batch_flush(void);  /* defined in "Descriptor Update Batching" */
+static void desc_batch_close(void* real_device);
+static void bc_gpu_track_pool(uint64_t pool, uint32_t family);
+static void bc_gpu_track_cbs(const void* pAllocInfo, void** pCmdBufs, uint32_t count);
+static void bc_gpu_forget_cb(void* real_cb);
+static void bc_gpu_end_cb(void* real_cb);
+static const void* bc_gpu_submits(int v2, uint32_t count, const void* pSubmits);
 
 /* ==== VK_EXT_device_fault: query GPU fault details on DEVICE_LOST ====
  *
@@ -894,7 +1709,7 @@ static void query_device_fault(void) {
     if (g_fault_queried || !real_get_device_fault_info || !shared_real_device) return;
     g_fault_queried = 1;
 
-    LOG("=== QUERYING VK_EXT_device_fault ===\n");
+    LOGE(ICD_LC_GENERAL, "=== QUERYING VK_EXT_device_fault ===\n");
 
     /* First call: get counts */
     uint8_t counts[32];
@@ -905,7 +1720,7 @@ static void query_device_fault(void) {
     uint32_t addrCount = *(uint32_t*)(counts + 16);
     uint32_t vendorCount = *(uint32_t*)(counts + 20);
     uint64_t binarySize = *(uint64_t*)(counts + 24);
-    LOG("  GetDeviceFaultInfo(counts): result=%d addrInfos=%u vendorInfos=%u binarySize=%llu\n",
+    LOGE(ICD_LC_GENERAL, "  GetDeviceFaultInfo(counts): result=%d addrInfos=%u vendorInfos=%u binarySize=%llu\n",
         res, addrCount, vendorCount, (unsigned long long)binarySize);
 
     if (res != 0 && res != 5 /* VK_INCOMPLETE */) return;
@@ -929,14 +1744,14 @@ static void query_device_fault(void) {
     *(uint64_t*)(counts + 24) = 0; /* don't allocate binary data */
 
     res = real_get_device_fault_info(shared_real_device, counts, info);
-    LOG("  GetDeviceFaultInfo(info): result=%d\n", res);
-    LOG("  Description: %.256s\n", (char*)(info + 16));
+    LOGE(ICD_LC_GENERAL, "  GetDeviceFaultInfo(info): result=%d\n", res);
+    LOGE(ICD_LC_GENERAL, "  Description: %.256s\n", (char*)(info + 16));
 
     for (uint32_t i = 0; i < addrCount && addrInfos; i++) {
         uint32_t type = *(uint32_t*)(addrInfos + i * 24);
         uint64_t addr = *(uint64_t*)(addrInfos + i * 24 + 8);
         uint64_t prec = *(uint64_t*)(addrInfos + i * 24 + 16);
-        LOG("  AddrInfo[%u]: type=%u addr=0x%llx precision=0x%llx\n",
+        LOGE(ICD_LC_GENERAL, "  AddrInfo[%u]: type=%u addr=0x%llx precision=0x%llx\n",
             i, type, (unsigned long long)addr, (unsigned long long)prec);
     }
 
@@ -944,11 +1759,11 @@ static void query_device_fault(void) {
         char* desc = (char*)(vendorInfos + i * 280);
         uint64_t code = *(uint64_t*)(vendorInfos + i * 280 + 256);
         uint64_t data = *(uint64_t*)(vendorInfos + i * 280 + 264);
-        LOG("  VendorInfo[%u]: code=0x%llx data=0x%llx desc=%.256s\n",
+        LOGE(ICD_LC_GENERAL, "  VendorInfo[%u]: code=0x%llx data=0x%llx desc=%.256s\n",
             i, (unsigned long long)code, (unsigned long long)data, desc);
     }
 
-    LOG("=== END device_fault ===\n");
+    LOGE(ICD_LC_GENERAL, "=== END device_fault ===\n");
     if (addrInfos) free(addrInfos);
     if (vendorInfos) free(vendorInfos);
 }
@@ -1068,8 +1883,50 @@ static VkResult wrapped_CreateDevice(void* physDev, const void* pCreateInfo,
         }
     }
 
+    /* ICD_BC_TARGET=etc2: BC images are substituted with ETC2/EAC (see
+     * bc_to_rgba_format), which needs textureCompressionETC2 (offset 80 in
+     * VkPhysicalDeviceFeatures). Enable it if the app didn't. */
+    uint32_t* etc2_feat = NULL;
+    uint32_t save_etc2 = 0;
+    {
+        const char* target = getenv("ICD_BC_TARGET");
+        const char* decode = getenv("ICD_BC_DECODE");
+        int want = target && strcmp(target, "etc2") == 0 && !(decode && *decode == '0');
+        if (want && real_get_features2) {
+            uint8_t f2[16 + 220];
+            memset(f2, 0, sizeof(f2));
+            *(uint32_t*)f2 = 51;    /* VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 */
+            real_get_features2(physDev, f2);
+            if (!*(uint32_t*)(f2 + 16 + 80)) {
+                LOGW(ICD_LC_GENERAL, "CD: ICD_BC_TARGET=etc2 but textureCompressionETC2 is unsupported\n");
+                want = 0;
+            }
+        }
+        if (want) {
+            if (pEnabledFeatures) {
+                etc2_feat = (uint32_t*)((uint8_t*)pEnabledFeatures + 80);
+            } else {
+                PNBase* pn = (PNBase*)(*(void**)((uint8_t*)pCreateInfo + 8));
+                while (pn && pn->sType != 51) pn = (PNBase*)pn->pNext;
+                if (pn) etc2_feat = (uint32_t*)((uint8_t*)pn + 16 + 80);
+            }
+            if (etc2_feat) {
+                save_etc2 = *etc2_feat;
+                *etc2_feat = 1;
+            }
+        }
+    }
+
     VkResult res = real_create_device(physDev, pCreateInfo, pAllocator, pDevice);
 
+    if (etc2_feat) {
+        *etc2_feat = save_etc2;
+        if (res == 0) {
+            g_bc_etc2 = 1;
+            LOG("CD: BC images substituted with ETC2/EAC (ICD_BC_TARGET=etc2)\n");
+        }
+    }
+
     /* Restore all stripped features */
     if (pEnabledFeatures) {
         *(uint32_t*)((uint8_t*)pEnabledFeatures + 32) = save_pef_logicOp;
@@ -1113,6 +1970,18 @@ static VkResult wrapped_CreateDevice(void* physDev, const void* pCreateInfo,
             LOG("Thunk GDPA resolved: %p\n", (void*)real_gdpa);
         }
 
+        /* Limits the ICD's own compute work must respect (BC GPU decode).
+         * VkPhysicalDeviceProperties: limits at 296, maxStorageBufferRange +28 */
+        PFN_vkGetPhysDeviceProps get_props = real_get_phys_dev_props;
+        if (!get_props && real_gipa && saved_instance)
+            get_props = (PFN_vkGetPhysDeviceProps)real_gipa(saved_instance, "vkGetPhysicalDeviceProperties");
+        if (get_props) {
+            uint64_t props[1024 / 8];
+            memset(props, 0, sizeof(props));
+            get_props(physDev, props);
+            g_max_storage_buffer_range = *(const uint32_t*)((const uint8_t*)props + 296 + 28);
+        }
+
         HandleWrapper* w = wrap_handle(real_device);
         if (!w) {
             LOG("CreateDevice: FATAL: wrap_handle failed (OOM)\n");
@@ -1125,6 +1994,7 @@ static VkResult wrapped_CreateDevice(void* physDev, const void* pCreateInfo,
         *pDevice = w;
         LOG("CreateDevice #%d OK: real=%p wrapper=%p refcount=%d\n",
             g_device_count, real_device, (void*)w, device_ref_count);
+        pcache_open(real_device);
     }
     return res;
 }
@@ -1139,10 +2009,15 @@ static void wrapper_DestroyDevice(void* device, const void* pAllocator) {
     void* real = unwrap(device);
     LOG("DestroyDevice: wrapper=%p real=%p refcount=%d\n",
         device, real, device_ref_count);
+    submit_flush();
     free_wrapper(device);
     device_ref_count--;
     if (device_ref_count <= 0) {
         LOG("DestroyDevice: last ref, destroying real device %p\n", real);
+        bc_stage_destroy_all();
+        spv_cache_report();
+        desc_batch_close(real);
+        pcache_close();
         if (real_destroy_device) real_destroy_device(real, pAllocator);
         shared_real_device = NULL;
         device_ref_count = 0;
@@ -1163,7 +2038,7 @@ static void wrapper_GetDeviceQueue(void* device, uint32_t qfi,
         HandleWrapper* w = wrap_handle(real_queue);
         if (w) {
             *pQueue = w;
-            LOG("GetDeviceQueue: qfi=%u qi=%u real=%p wrapper=%p\n",
+            LOGD(ICD_LC_SUBMIT, "GetDeviceQueue: qfi=%u qi=%u real=%p wrapper=%p\n",
                 qfi, qi, real_queue, (void*)w);
         }
     }
@@ -1199,15 +2074,12 @@ static VkResult wrapper_AllocateCommandBuffers(void* device,
         ? *(const uint32_t*)((const char*)pAllocInfo + 28) : 0;
 
     VkResult res = real_alloc_cmdbufs(real, pAllocInfo, pCmdBufs);
-    LOG("[D%d] vkAllocateCommandBuffers: dev=%p count=%u result=%d\n",
+    LOGD(ICD_LC_CMD, "[D%d] vkAllocateCommandBuffers: dev=%p count=%u result=%d\n",
         g_device_count, real, count, res);
     if (res == 0 && pCmdBufs && count > 0) {
-        for (uint32_t i = 0; i < count; i++) {
-            if (pCmdBufs[i]) {
-                HandleWrapper* w = wrap_handle(pCmdBufs[i]);
-                if (w) pCmdBufs[i] = w;
-            }
-        }
+        bc_gpu_track_cbs(pAllocInfo, pCmdBufs, count);
+        bc_stage_track_cbs(pAllocInfo, pCmdBufs, count);
+        wrap_handles(pCmdBufs, count);
     }
     return res;
 }
@@ -1231,6 +2103,9 @@ static void wrapper_FreeCommandBuffers(void* device, uint64_t pool,
     for (uint32_t i = 0; i < count; i++) {
         if (pCmdBufs[i]) {
             real_bufs[i] = unwrap((void*)pCmdBufs[i]);
+            bc_stage_release_cb(real_bufs[i]);
+            bc_stage_forget_cb(real_bufs[i]);
+            bc_gpu_forget_cb(real_bufs[i]);
             free_wrapper((void*)pCmdBufs[i]);
         } else {
             real_bufs[i] = NULL;
@@ -1240,7 +2115,31 @@ static void wrapper_FreeCommandBuffers(void* device, uint64_t pool,
     real_free_cmdbufs(real, pool, count, real_bufs);
 }
 
-/* ---- vkQueueSubmit: unwrap queue + cmdBufs in VkSubmitInfo ---- */
+/* ==== Queue Submission ====
+ *
+ * Each real VkQueue has a QueueState whose lock serializes the operations
+ * Vulkan requires external synchronization for (submit, wait-idle, present,
+ * bind-sparse). Both D3D11 devices share one real device, so every wrapper
+ * of the same queue resolves to the same state: it is keyed by the real
+ * handle. Different queues no longer contend with each other.
+ *
+ * Submits are deferred by default. The calling thread deep-copies the
+ * submit (unwrapping command buffers), pushes it onto a lock-free MPSC list
+ * and returns. One submitter thread takes jobs in push order — which keeps
+ * cross-queue semaphore signal→wait order intact — and merges consecutive
+ * jobs for the same queue into one vkQueueSubmit/vkQueueSubmit2, so a burst
+ * of DXVK submits costs one thunk crossing. A batch ends at a job with a
+ * fence, so the fence covers that job and the work before it, as before.
+ *
+ * Anything that must see earlier submits in order (wait-idle, present,
+ * bind-sparse, DeviceWaitIdle, DestroyDevice, and submits whose pNext
+ * chain we can't deep-copy) calls submit_flush() first. A deferred submit
+ * that fails is reported by the next submit or wait-idle on its queue. A
+ * submit that reports the error is dropped, as if it had failed itself, so
+ * nothing it references changes; the failed batch's fence is signalled by an
+ * empty submit so nobody waits on it forever.
+ * ICD_ASYNC_SUBMIT=0 submits on the calling thread (still per-queue locked).
+ */
 
 /* VkSubmitInfo layout on x86-64 (72 bytes) */
 typedef struct {
@@ -1255,40 +2154,455 @@ typedef struct {
     const void* pSignalSemaphores;      /* 64 */
 } ICD_VkSubmitInfo;
 
+/* VkTimelineSemaphoreSubmitInfo (48 bytes), the only VkSubmitInfo pNext
+ * DXVK sends */
+#define ICD_STYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO 1000207003
+typedef struct {
+    uint32_t        sType;                      /* 0 */
+    const void*     pNext;                      /* 8 */
+    uint32_t        waitSemaphoreValueCount;    /* 16 */
+    const uint64_t* pWaitSemaphoreValues;       /* 24 */
+    uint32_t        signalSemaphoreValueCount;  /* 32 */
+    const uint64_t* pSignalSemaphoreValues;     /* 40 */
+} ICD_VkTimelineSemaphoreSubmitInfo;
+
+/* VkCommandBufferSubmitInfo (32 bytes on x86-64) */
+typedef struct {
+    uint32_t    sType;          /* 0 */
+    uint32_t    _pad0;          /* 4 */
+    const void* pNext;          /* 8 */
+    void*       commandBuffer;  /* 16 */
+    uint32_t    deviceMask;     /* 24 */
+    uint32_t    _pad1;          /* 28 */
+} ICD_VkCommandBufferSubmitInfo;
+
+/* VkSemaphoreSubmitInfo (48 bytes on x86-64) */
+typedef struct {
+    uint32_t    sType;          /* 0 */
+    uint32_t    _pad0;          /* 4 */
+    const void* pNext;          /* 8 */
+    uint64_t    semaphore;      /* 16 */
+    uint64_t    value;          /* 24 */
+    uint64_t    stageMask;      /* 32 */
+    uint32_t    deviceIndex;    /* 40 */
+    uint32_t    _pad1;          /* 44 */
+} ICD_VkSemaphoreSubmitInfo;
+
+/* VkSubmitInfo2 (64 bytes on x86-64) */
+typedef struct {
+    uint32_t    sType;                      /* 0 */
+    uint32_t    _pad0;                      /* 4 */
+    const void* pNext;                      /* 8 */
+    uint32_t    flags;                      /* 16 */
+    uint32_t    waitSemaphoreInfoCount;     /* 20 */
+    const ICD_VkSemaphoreSubmitInfo* pWaitSemaphoreInfos;   /* 24 */
+    uint32_t    commandBufferInfoCount;     /* 32 */
+    uint32_t    _pad1;                      /* 36 */
+    const ICD_VkCommandBufferSubmitInfo* pCommandBufferInfos; /* 40 */
+    uint32_t    signalSemaphoreInfoCount;   /* 48 */
+    uint32_t    _pad2;                      /* 52 */
+    const ICD_VkSemaphoreSubmitInfo* pSignalSemaphoreInfos; /* 56 */
+} ICD_VkSubmitInfo2;
+
 typedef VkResult (*PFN_vkQueueSubmit)(void*, uint32_t, const ICD_VkSubmitInfo*, uint64_t);
 static PFN_vkQueueSubmit real_queue_submit = NULL;
+typedef VkResult (*PFN_vkQueueSubmit2)(void*, uint32_t, const ICD_VkSubmitInfo2*, uint64_t);
+static PFN_vkQueueSubmit2 real_queue_submit2 = NULL;
 
-static int submit_count_global = 0;
-static int g_cmd_op_count = 0;  /* Cmd* operation counter (defined here, used in Cmd* traces below) */
+typedef struct {
+    pthread_mutex_t lock;
+    void* real_queue;
+    VkResult deferred_error;    /* first failure of a deferred submit, 0 if none */
+} QueueState;
+
+/* Used if a QueueState can't be allocated: everything shares one lock */
+static QueueState g_queue_fallback = { PTHREAD_MUTEX_INITIALIZER, NULL, 0 };
+static HandleMap g_queue_states = HMAP_INIT(QueueState*);
+
+static QueueState* queue_state_for(void* real_queue) {
+    uint64_t key = (uint64_t)(uintptr_t)real_queue;
+    QueueState* qs = NULL;
+    if (hmap_get(&g_queue_states, key, &qs) && qs) return qs;
+    hmap_wrlock(&g_queue_states);
+    QueueState** slot = (QueueState**)hmap_insert_locked(&g_queue_states, key);
+    if (slot && !*slot) {
+        QueueState* n = (QueueState*)calloc(1, sizeof(QueueState));
+        if (n) {
+            pthread_mutex_init(&n->lock, NULL);
+            n->real_queue = real_queue;
+        }
+        *slot = n;
+    }
+    qs = slot ? *slot : NULL;
+    hmap_unlock(&g_queue_states);
+    return qs ? qs : &g_queue_fallback;
+}
+
+/* Error of an earlier deferred submit on qs, cleared once taken. A submit
+ * that gets one back returns it without submitting anything. */
+static VkResult queue_take_error(QueueState* qs) {
+    if (!__atomic_load_n(&qs->deferred_error, __ATOMIC_RELAXED)) return 0;
+    return __atomic_exchange_n(&qs->deferred_error, 0, __ATOMIC_ACQ_REL);
+}
+
+/* One deferred vkQueueSubmit/vkQueueSubmit2 call. The submit structs and
+ * every array they point to live in the same allocation. */
+typedef struct SubmitJob {
+    struct SubmitJob* next;
+    QueueState* qs;
+    int v2;                 /* submits are ICD_VkSubmitInfo2 */
+    int sn;                 /* submit number, for logs */
+    uint32_t count;
+    uint64_t fence;
+    void* submits;
+} SubmitJob;
+
+#define SUBMIT_BATCH_MAX 32     /* jobs merged into one thunk call */
+
+static int g_async_submit = 1;
+static int g_submit_thread_ok = 0;
+static pthread_once_t g_submit_thread_once = PTHREAD_ONCE_INIT;
+static pthread_t g_submit_tid;
+static volatile int g_submit_stop = 0;             /* set by the unload destructor */
+static SubmitJob* volatile g_submit_head = NULL;   /* LIFO; consumer reverses */
+static volatile uint32_t g_submit_pushed = 0;
+static volatile uint32_t g_submit_done = 0;
+static volatile int g_submit_waiter = 0;           /* submitter parked on futex */
+static volatile int g_flush_waiters = 0;
+static pthread_mutex_t g_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_flush_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t g_submit_jobs = 0, g_submit_calls = 0;
+
+/* Bump allocator over a job's single allocation */
+static void* job_copy(uint8_t** cur, const void* src, size_t n) {
+    if (!src || !n) return NULL;
+    void* dst = *cur;
+    memcpy(dst, src, n);
+    *cur += (n + 7) & ~(size_t)7;
+    return dst;
+}
+#define JOB_SIZE(n) (((size_t)(n) + 7) & ~(size_t)7)
+
+/* Deep copy of a vkQueueSubmit, or NULL if it can't be deferred */
+static SubmitJob* submit_job_v1(QueueState* qs, uint32_t count,
+                                const ICD_VkSubmitInfo* pSubmits, uint64_t fence) {
+    size_t size = JOB_SIZE(sizeof(SubmitJob)) + JOB_SIZE(count * sizeof(ICD_VkSubmitInfo));
+    for (uint32_t s = 0; s < count; s++) {
+        const ICD_VkSubmitInfo* si = &pSubmits[s];
+        const ICD_VkTimelineSemaphoreSubmitInfo* tl = (const ICD_VkTimelineSemaphoreSubmitInfo*)si->pNext;
+        if (tl && (tl->sType != ICD_STYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO || tl->pNext))
+            return NULL;
+        size += JOB_SIZE(si->waitSemaphoreCount * 8) + JOB_SIZE(si->waitSemaphoreCount * 4)
+              + JOB_SIZE(si->commandBufferCount * 8) + JOB_SIZE(si->signalSemaphoreCount * 8);
+        if (tl)
+            size += JOB_SIZE(sizeof(*tl)) + JOB_SIZE(tl->waitSemaphoreValueCount * 8)
+                  + JOB_SIZE(tl->signalSemaphoreValueCount * 8);
+    }
+    SubmitJob* job = (SubmitJob*)malloc(size);
+    if (!job) return NULL;
+    uint8_t* cur = (uint8_t*)job + JOB_SIZE(sizeof(SubmitJob));
+    ICD_VkSubmitInfo* out = (ICD_VkSubmitInfo*)job_copy(&cur, pSubmits, count * sizeof(ICD_VkSubmitInfo));
+    for (uint32_t s = 0; s < count; s++) {
+        const ICD_VkSubmitInfo* si = &pSubmits[s];
+        out[s].pWaitSemaphores = job_copy(&cur, si->pWaitSemaphores, si->waitSemaphoreCount * 8);
+        out[s].pWaitDstStageMask = job_copy(&cur, si->pWaitDstStageMask, si->waitSemaphoreCount * 4);
+        out[s].pSignalSemaphores = job_copy(&cur, si->pSignalSemaphores, si->signalSemaphoreCount * 8);
+        out[s].pCommandBuffers = (void**)job_copy(&cur, si->pCommandBuffers, si->commandBufferCount * 8);
+        for (uint32_t c = 0; out[s].pCommandBuffers && c < si->commandBufferCount; c++)
+            out[s].pCommandBuffers[c] = unwrap(out[s].pCommandBuffers[c]);
+        if (si->pNext) {
+            const ICD_VkTimelineSemaphoreSubmitInfo* tl = (const ICD_VkTimelineSemaphoreSubmitInfo*)si->pNext;
+            ICD_VkTimelineSemaphoreSubmitInfo* tlc =
+                (ICD_VkTimelineSemaphoreSubmitInfo*)job_copy(&cur, tl, sizeof(*tl));
+            tlc->pWaitSemaphoreValues = (const uint64_t*)job_copy(&cur, tl->pWaitSemaphoreValues,
+                                                                 tl->waitSemaphoreValueCount * 8);
+            tlc->pSignalSemaphoreValues = (const uint64_t*)job_copy(&cur, tl->pSignalSemaphoreValues,
+                                                                   tl->signalSemaphoreValueCount * 8);
+            out[s].pNext = tlc;
+        }
+    }
+    job->next = NULL;
+    job->qs = qs;
+    job->v2 = 0;
+    job->count = count;
+    job->fence = fence;
+    job->submits = out;
+    return job;
+}
+
+/* Deep copy of a vkQueueSubmit2, or NULL if it can't be deferred */
+static SubmitJob* submit_job_v2(QueueState* qs, uint32_t count,
+                                const ICD_VkSubmitInfo2* pSubmits, uint64_t fence) {
+    size_t size = JOB_SIZE(sizeof(SubmitJob)) + JOB_SIZE(count * sizeof(ICD_VkSubmitInfo2));
+    for (uint32_t s = 0; s < count; s++) {
+        const ICD_VkSubmitInfo2* si = &pSubmits[s];
+        if (si->pNext) return NULL;
+        size += JOB_SIZE(si->waitSemaphoreInfoCount * sizeof(ICD_VkSemaphoreSubmitInfo))
+              + JOB_SIZE(si->commandBufferInfoCount * sizeof(ICD_VkCommandBufferSubmitInfo))
+              + JOB_SIZE(si->signalSemaphoreInfoCount * sizeof(ICD_VkSemaphoreSubmitInfo));
+        for (uint32_t i = 0; si->pWaitSemaphoreInfos && i < si->waitSemaphoreInfoCount; i++)
+            if (si->pWaitSemaphoreInfos[i].pNext) return NULL;
+        for (uint32_t i = 0; si->pSignalSemaphoreInfos && i < si->signalSemaphoreInfoCount; i++)
+            if (si->pSignalSemaphoreInfos[i].pNext) return NULL;
+        for (uint32_t i = 0; si->pCommandBufferInfos && i < si->commandBufferInfoCount; i++)
+            if (si->pCommandBufferInfos[i].pNext) return NULL;
+    }
+    SubmitJob* job = (SubmitJob*)malloc(size);
+    if (!job) return NULL;
+    uint8_t* cur = (uint8_t*)job + JOB_SIZE(sizeof(SubmitJob));
+    ICD_VkSubmitInfo2* out = (ICD_VkSubmitInfo2*)job_copy(&cur, pSubmits, count * sizeof(ICD_VkSubmitInfo2));
+    for (uint32_t s = 0; s < count; s++) {
+        const ICD_VkSubmitInfo2* si = &pSubmits[s];
+        out[s].pWaitSemaphoreInfos = (const ICD_VkSemaphoreSubmitInfo*)job_copy(&cur,
+            si->pWaitSemaphoreInfos, si->waitSemaphoreInfoCount * sizeof(ICD_VkSemaphoreSubmitInfo));
+        out[s].pSignalSemaphoreInfos = (const ICD_VkSemaphoreSubmitInfo*)job_copy(&cur,
+            si->pSignalSemaphoreInfos, si->signalSemaphoreInfoCount * sizeof(ICD_VkSemaphoreSubmitInfo));
+        ICD_VkCommandBufferSubmitInfo* cbs = (ICD_VkCommandBufferSubmitInfo*)job_copy(&cur,
+            si->pCommandBufferInfos, si->commandBufferInfoCount * sizeof(ICD_VkCommandBufferSubmitInfo));
+        for (uint32_t c = 0; cbs && c < si->commandBufferInfoCount; c++)
+            cbs[c].commandBuffer = unwrap(cbs[c].commandBuffer);
+        out[s].pCommandBufferInfos = cbs;
+    }
+    job->next = NULL;
+    job->qs = qs;
+    job->v2 = 1;
+    job->count = count;
+    job->fence = fence;
+    job->submits = out;
+    return job;
+}
+
+/* Submit a run of consecutive jobs for one queue with a single thunk call.
+ * Returns the first job not included. */
+static SubmitJob* submit_run(SubmitJob* first) {
+    static void* scratch = NULL;        /* submitter thread only */
+    static size_t scratch_size = 0;
+
+    QueueState* qs = first->qs;
+    int v2 = first->v2;
+    size_t elem = v2 ? sizeof(ICD_VkSubmitInfo2) : sizeof(ICD_VkSubmitInfo);
+    uint32_t jobs = 0, total = 0;
+    SubmitJob* end = first;
+    uint64_t fence = 0;
+    while (end && end->qs == qs && end->v2 == v2 && jobs < SUBMIT_BATCH_MAX) {
+        total += end->count;
+        jobs++;
+        fence = end->fence;
+        end = end->next;
+        if (fence) break;
+    }
+
+    const void* submits = first->submits;
+    if (jobs > 1 && total > first->count) {
+        if (total * elem > scratch_size) {
+            void* n = realloc(scratch, total * elem);
+            if (!n) {       /* submit this job alone; the rest follow */
+                jobs = 1;
+                total = first->count;
+                fence = first->fence;
+                end = first->next;
+                goto submit;
+            }
+            scratch = n;
+            scratch_size = total * elem;
+        }
+        uint8_t* dst = (uint8_t*)scratch;
+        for (SubmitJob* j = first; j != end; j = j->next) {
+            memcpy(dst, j->submits, j->count * elem);
+            dst += j->count * elem;
+        }
+        submits = scratch;
+    }
+
+submit:
+    pthread_mutex_lock(&qs->lock);
+    VkResult res = v2
+        ? real_queue_submit2(qs->real_queue, total, total ? (const ICD_VkSubmitInfo2*)submits : NULL, fence)
+        : real_queue_submit(qs->real_queue, total, total ? (const ICD_VkSubmitInfo*)submits : NULL, fence);
+    pthread_mutex_unlock(&qs->lock);
+
+    g_submit_jobs += jobs;
+    g_submit_calls++;
+    LOGT(ICD_LC_SUBMIT, "[submit] queue=%p jobs=%u (#%d..#%d) submits=%u fence=0x%llx result=%d\n",
+        qs->real_queue, jobs, first->sn, first->sn + (int)jobs - 1, total,
+        (unsigned long long)fence, res);
+    if ((g_submit_calls & 1023) == 0)
+        LOGD(ICD_LC_SUBMIT, "[submit] %llu submits in %llu thunk calls\n",
+            (unsigned long long)g_submit_jobs, (unsigned long long)g_submit_calls);
+    if (res != 0) {
+        LOGW(ICD_LC_SUBMIT, "[D%d] deferred %s #%d FAILED: %d\n",
+            g_device_count, v2 ? "vkQueueSubmit2" : "vkQueueSubmit", first->sn, res);
+        VkResult none = 0;
+        __atomic_compare_exchange_n(&qs->deferred_error, &none, res, 0,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        /* The app was told this batch went in; signal its fence anyway. If
+         * the device is lost this fails too and fence waits report that. */
+        if (fence) {
+            pthread_mutex_lock(&qs->lock);
+            if (v2) real_queue_submit2(qs->real_queue, 0, NULL, fence);
+            else    real_queue_submit(qs->real_queue, 0, NULL, fence);
+            pthread_mutex_unlock(&qs->lock);
+        }
+    }
+
+    while (first != end) {
+        SubmitJob* next = first->next;
+        free(first);
+        first = next;
+    }
+    __atomic_add_fetch(&g_submit_done, jobs, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_flush_waiters, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_flush_lock);
+        pthread_cond_broadcast(&g_flush_cond);
+        pthread_mutex_unlock(&g_flush_lock);
+    }
+    return end;
+}
+
+/* Submit everything queued so far, oldest first */
+static void submit_drain(SubmitJob* list) {
+    SubmitJob* fifo = NULL;
+    while (list) {
+        SubmitJob* next = list->next;
+        list->next = fifo;
+        fifo = list;
+        list = next;
+    }
+    while (fifo) fifo = submit_run(fifo);
+}
+
+static void* submit_thread(void* arg) {
+    (void)arg;
+    for (;;) {
+        SubmitJob* list = __atomic_exchange_n(&g_submit_head, NULL, __ATOMIC_ACQUIRE);
+        if (!list) {
+            /* Only exit once the queue is empty */
+            if (__atomic_load_n(&g_submit_stop, __ATOMIC_SEQ_CST)) break;
+            /* Park until a producer wakes us; the timeout bounds latency if
+             * a wake races with parking. */
+            __atomic_store_n(&g_submit_waiter, 1, __ATOMIC_SEQ_CST);
+            if (!__atomic_load_n(&g_submit_stop, __ATOMIC_SEQ_CST) &&
+                !__atomic_load_n(&g_submit_head, __ATOMIC_SEQ_CST)) {
+                struct timespec to = {0, 100 * 1000000L};
+                syscall(SYS_futex, &g_submit_waiter, FUTEX_WAIT_PRIVATE, 1, &to, NULL, 0);
+            }
+            __atomic_store_n(&g_submit_waiter, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        submit_drain(list);
+    }
+    return NULL;
+}
 
-static VkResult wrapper_QueueSubmit(void* queue, uint32_t submitCount,
-                                    const ICD_VkSubmitInfo* pSubmits,
-                                    uint64_t fence) {
-    void* real_queue = unwrap(queue);
+/* Forked children have no submitter thread; submit inline there */
+static void submit_atfork_child(void) {
+    g_async_submit = 0;
+    g_submit_thread_ok = 0;
+}
 
-    if (submitCount == 0 || !pSubmits) {
-        pthread_mutex_lock(&queue_mutex);
-        VkResult r = real_queue_submit(real_queue, submitCount, pSubmits, fence);
-        pthread_mutex_unlock(&queue_mutex);
-        return r;
+static void submit_start_thread(void) {
+    const char* env = getenv("ICD_ASYNC_SUBMIT");
+    if (env && *env == '0') g_async_submit = 0;
+    if (!g_async_submit) return;
+    if (pthread_create(&g_submit_tid, NULL, submit_thread, NULL) != 0) {
+        LOGW(ICD_LC_SUBMIT, "submitter thread creation failed, submitting inline\n");
+        g_async_submit = 0;
+        return;
     }
+    g_submit_thread_ok = 1;
+    pthread_atfork(NULL, NULL, submit_atfork_child);
+    LOG("Async queue submission enabled (ICD_ASYNC_SUBMIT=0 to disable)\n");
+}
+
+/* The submitter must be gone before the loader unmaps us. New submits go
+ * inline from here on; the thread drains what is already queued, and a job
+ * pushed while it was exiting is submitted here. */
+__attribute__((destructor)) static void submit_shutdown(void) {
+    if (!g_submit_thread_ok) return;
+    g_async_submit = 0;
+    __atomic_store_n(&g_submit_stop, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&g_submit_waiter, 0, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &g_submit_waiter, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    pthread_join(g_submit_tid, NULL);
+    submit_drain(__atomic_exchange_n(&g_submit_head, NULL, __ATOMIC_ACQUIRE));
+    g_submit_thread_ok = 0;
+}
+
+static int submit_async_enabled(void) {
+    pthread_once(&g_submit_thread_once, submit_start_thread);
+    return g_async_submit;
+}
+
+static void submit_push(SubmitJob* job) {
+    /* Count first: a flush that sees the job on the list must also see it
+     * in g_submit_pushed, or it could return before the job is submitted */
+    __atomic_add_fetch(&g_submit_pushed, 1, __ATOMIC_SEQ_CST);
+    SubmitJob* head = __atomic_load_n(&g_submit_head, __ATOMIC_RELAXED);
+    do {
+        job->next = head;
+    } while (!__atomic_compare_exchange_n(&g_submit_head, &head, job, 1,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    if (__atomic_load_n(&g_submit_waiter, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&g_submit_waiter, 0, __ATOMIC_RELAXED);
+        syscall(SYS_futex, &g_submit_waiter, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/* Wait until every job pushed before this call has been submitted */
+static void submit_flush(void) {
+    if (!g_submit_thread_ok) return;
+    uint32_t target = __atomic_load_n(&g_submit_pushed, __ATOMIC_SEQ_CST);
+    if ((int32_t)(__atomic_load_n(&g_submit_done, __ATOMIC_SEQ_CST) - target) >= 0) return;
+    pthread_mutex_lock(&g_flush_lock);
+    __atomic_add_fetch(&g_flush_waiters, 1, __ATOMIC_SEQ_CST);
+    while ((int32_t)(__atomic_load_n(&g_submit_done, __ATOMIC_SEQ_CST) - target) < 0)
+        pthread_cond_wait(&g_flush_cond, &g_flush_lock);
+    __atomic_sub_fetch(&g_flush_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&g_flush_lock);
+}
+
+static int submit_count_global = 0;
+/* Cmd* operation counter for the Cmd* traces below; per thread so recording
+ * threads do not bounce one cache line between them. */
+static __thread int g_cmd_op_count = 0;
+
+static VkResult queue_submit1(void* queue, uint32_t submitCount,
+                              const ICD_VkSubmitInfo* pSubmits,
+                              uint64_t fence) {
+    void* real_queue = unwrap(queue);
+    QueueState* qs = queue_state_for(real_queue);
+    VkResult err = queue_take_error(qs);
+    if (err) return err;
+    if (!pSubmits) submitCount = 0;
 
     /* Count total cmdBufs to unwrap */
     uint32_t total = 0;
     for (uint32_t s = 0; s < submitCount; s++)
         total += pSubmits[s].commandBufferCount;
 
-    if (total == 0) {
-        pthread_mutex_lock(&queue_mutex);
-        VkResult r = real_queue_submit(real_queue, submitCount, pSubmits, fence);
-        pthread_mutex_unlock(&queue_mutex);
-        return r;
+    int sn = __atomic_add_fetch(&submit_count_global, 1, __ATOMIC_RELAXED);
+    LOGT(ICD_LC_SUBMIT, "[D%d] vkQueueSubmit #%d: queue=%p submits=%u cmdBufs=%u\n",
+        g_device_count, sn, real_queue, submitCount, total);
+
+    /* TSO fix: With TSOEnabled=0, ARM64 stores from x86-64 guest code may
+     * still be in the CPU store buffer. Force all prior stores to be visible
+     * before submitting work to the GPU. This mfence is always translated to
+     * a full ARM64 barrier (dmb sy) by FEX, even with TSO disabled. */
+    __sync_synchronize();
+
+    if (submit_async_enabled()) {
+        SubmitJob* job = submit_job_v1(qs, submitCount, pSubmits, fence);
+        if (job) {
+            job->sn = sn;
+            submit_push(job);
+            return 0;
+        }
     }
 
-    /* Create temp copies with unwrapped cmdBuf arrays */
+    /* Inline: create temp copies with unwrapped cmdBuf arrays */
     ICD_VkSubmitInfo* tmp = (ICD_VkSubmitInfo*)alloca(
-        submitCount * sizeof(ICD_VkSubmitInfo));
-    void** bufs = (void**)alloca(total * sizeof(void*));
+        (submitCount ? submitCount : 1) * sizeof(ICD_VkSubmitInfo));
+    void** bufs = (void**)alloca((total ? total : 1) * sizeof(void*));
     uint32_t idx = 0;
 
     for (uint32_t s = 0; s < submitCount; s++) {
@@ -1300,114 +2614,236 @@ static VkResult wrapper_QueueSubmit(void* queue, uint32_t submitCount,
         }
     }
 
-    int sn = ++submit_count_global;
-    LOG("[D%d] vkQueueSubmit #%d: queue=%p submits=%u cmdBufs=%u\n",
-        g_device_count, sn, real_queue, submitCount, total);
-
-    /* TSO fix: With TSOEnabled=0, ARM64 stores from x86-64 guest code may
-     * still be in the CPU store buffer. Force all prior stores to be visible
-     * before submitting work to the GPU. This mfence is always translated to
-     * a full ARM64 barrier (dmb sy) by FEX, even with TSO disabled. */
-    __sync_synchronize();
-
-    /* Serialize queue operations — shared device means shared queue */
-    pthread_mutex_lock(&queue_mutex);
-    VkResult res = real_queue_submit(real_queue, submitCount, tmp, fence);
-    pthread_mutex_unlock(&queue_mutex);
+    submit_flush();
+    pthread_mutex_lock(&qs->lock);
+    VkResult res = real_queue_submit(real_queue, submitCount, submitCount ? tmp : NULL, fence);
+    pthread_mutex_unlock(&qs->lock);
     if (res != 0)
-        LOG("[D%d] vkQueueSubmit #%d FAILED: %d\n", g_device_count, sn, res);
+        LOGW(ICD_LC_SUBMIT, "[D%d] vkQueueSubmit #%d FAILED: %d\n", g_device_count, sn, res);
 
     return res;
 }
 
-/* ===== Secondary CB Command Replay =====
- * Vortek IPC doesn't properly handle secondary command buffers:
- *   - Dynamic state not inherited from primary→secondary (confirmed)
- *   - Possible pNext chain (InheritanceRenderingInfo) not serialized
- * Instead of using CmdExecuteCommands, we record commands from secondary CBs
- * and replay them directly into the primary CB context. This makes all
- * commands execute within the primary CB's render pass + dynamic state. */
-
-#define MAX_REPLAY_CBS 64
-#define MAX_REPLAY_CMDS 512
-#define MAX_REPLAY_DATA 256  /* max push constant data */
-
-enum {
-    RCMD_NONE = 0,
-    RCMD_BIND_VB,
-    RCMD_BIND_IB,
-    RCMD_BIND_PIPELINE,
-    RCMD_BIND_DESC_SETS,
-    RCMD_PUSH_CONSTS,
-    RCMD_DRAW_INDEXED,
-    RCMD_DRAW,
-    /* Extended dynamic state — generic slot-based recording */
-    RCMD_EDS_UINT,       /* (cmdBuf, uint32_t value) — cull, depth test, etc. */
-    RCMD_EDS_VIEWPORT,   /* (cmdBuf, count, pViewports) */
-    RCMD_EDS_SCISSOR,    /* (cmdBuf, count, pScissors) */
-    RCMD_EDS_DEPTHBIAS,  /* (cmdBuf, float, float, float) */
-    RCMD_EDS_BLEND,      /* (cmdBuf, float[4]) */
-    RCMD_EDS_STENCIL2,   /* (cmdBuf, faceMask, value) */
-    RCMD_EDS_STENCILOP,  /* (cmdBuf, faceMask, failOp, passOp, depthFailOp, compareOp) */
-};
+/* BC GPU transcode prologues (if any) go in front of their command buffers */
+static VkResult wrapper_QueueSubmit(void* queue, uint32_t submitCount,
+                                    const ICD_VkSubmitInfo* pSubmits,
+                                    uint64_t fence) {
+    desc_batch_flush();
+    const ICD_VkSubmitInfo* subs = (const ICD_VkSubmitInfo*)bc_gpu_submits(0, submitCount, pSubmits);
+    VkResult res = queue_submit1(queue, submitCount, subs, fence);
+    if (subs != pSubmits) free((void*)subs);
+    return res;
+}
 
-typedef struct {
-    uint8_t type;
-    union {
-        struct { uint32_t first, count; uint64_t buffers[8]; uint64_t offsets[8]; uint64_t strides[8]; } vb;
-        struct { uint64_t buffer; uint64_t offset; uint32_t indexType; } ib;
-        struct { uint32_t bindPoint; uint64_t pipeline; } pipe;
-        struct { uint32_t bindPoint; uint64_t layout; uint32_t firstSet, setCount;
-                 uint64_t sets[4]; uint32_t dynOffCount; uint32_t dynOffs[8]; } desc;
-        struct { uint64_t layout; uint32_t stageFlags, offset, size;
-                 uint8_t data[MAX_REPLAY_DATA]; } pc;
-        struct { uint32_t indexCount, instanceCount, firstIndex;
-                 int32_t vertexOffset; uint32_t firstInstance; } draw_idx;
-        struct { uint32_t vertexCount, instanceCount, firstVertex, firstInstance; } draw;
-        /* EDS generic */
-        struct { int slot; uint32_t value; } eds_uint;
-        struct { int slot; uint32_t count; float data[6]; } eds_viewport; /* max 1 viewport: 6 floats */
-        struct { int slot; uint32_t count; uint32_t data[4]; } eds_scissor; /* max 1 scissor: 4 u32 */
-        struct { float a, b, c; } eds_depthbias;
-        struct { float vals[4]; } eds_blend;
-        struct { int slot; uint32_t face, val; } eds_stencil2;
-        struct { uint32_t face, fail, pass, dfail, cmp; } eds_stencilop;
-    };
-} ReplayCmd;
+/* ==== Command Buffer State ====
+ *
+ * ICD-side state of one VkCommandBuffer, hung off its wrapper
+ * (HandleWrapper::cb_state) and created at vkBeginCommandBuffer. DXVK
+ * records command buffers on several threads; a command buffer is only
+ * recorded by one of them at a time, so everything a recording thread
+ * writes lives here rather than in process-wide globals:
+ *   - the "last bound" trackers behind the draw-time diagnostics
+ *     (pipeline, vertex/index buffers, UBOs, viewport, push constants)
+ *     and the dynamic rendering scope;
+ *   - the secondary CB replay stream (see "Secondary CB Command Replay");
+ *   - the buffers transfer commands have written so far, which the BC GPU
+ *     decoder must not read from its prologue (see "GPU transcode").
+ * The struct is cache-line aligned and the trackers written on every bind
+ * come first, so two recording threads never share a writable line.
+ * Bound state is undefined at vkBeginCommandBuffer, so it starts zeroed.
+ */
 
+#define MAX_VB_SLOTS 8
 typedef struct {
-    void* wrapped_cb;      /* wrapped CB handle (for lookup) */
-    int is_secondary;      /* 1 if RENDER_PASS_CONTINUE was set */
-    int cmd_count;         /* number of recorded commands */
-    ReplayCmd cmds[MAX_REPLAY_CMDS];
-} ReplayCB;
-
-static ReplayCB g_replay_cbs[MAX_REPLAY_CBS];
-static int g_replay_cb_count = 0;
-
-static ReplayCB* find_replay_cb(void* wrapped, int create) {
-    for (int i = 0; i < g_replay_cb_count; i++)
-        if (g_replay_cbs[i].wrapped_cb == wrapped)
-            return &g_replay_cbs[i];
-    if (create && g_replay_cb_count < MAX_REPLAY_CBS) {
-        ReplayCB* cb = &g_replay_cbs[g_replay_cb_count++];
-        memset(cb, 0, sizeof(ReplayCB));
-        return cb;
-    }
-    return NULL;
+    uint64_t buffer;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t stride;
+    int      bound; /* set to 1 when VB2 binds this slot */
+} VBSlotInfo;
+
+#define MAX_LAST_UBO 16
+#define MAX_XFER_DST 8      /* beyond this every buffer counts as written */
+typedef struct {
+    uint64_t buffer;
+    uint64_t offset;
+    uint64_t range;
+} LastUboEntry;
+
+typedef struct __attribute__((aligned(64))) {
+    /* Bound graphics pipeline and index buffer */
+    uint64_t pipeline;
+    uint64_t ib_buf;
+    uint64_t ib_off;
+    uint32_t ib_type;       /* 0=UINT16, 1=UINT32 */
+    uint32_t vb_max;        /* highest bound VB slot + 1 */
+    int ubo_count;
+    uint32_t viewport_set;
+    uint32_t pc_size;
+    uint32_t pc_stages;
+
+    /* Dynamic rendering scope (CmdBeginRendering .. CmdEndRendering) */
+    uint64_t render_image;  /* image behind color attachment 0 */
+    int in_render_pass;
+    uint32_t rp_w, rp_h;    /* render area */
+
+    /* Secondary CB replay stream */
+    uint8_t* replay;        /* encoded commands (secondary CBs only) */
+    uint32_t replay_len;
+    uint32_t replay_cap;
+    int is_secondary;       /* 1 if RENDER_PASS_CONTINUE was set */
+    int replay_broken;      /* stream could not grow: replay would be incomplete */
+
+    /* Destinations of CmdCopyBuffer/UpdateBuffer/FillBuffer/CopyImageToBuffer */
+    uint32_t xfer_dst_count;
+    uint64_t xfer_dst[MAX_XFER_DST];
+
+    float viewport[6];      /* x, y, w, h, minD, maxD */
+    uint32_t scissor[4];    /* x, y, w, h */
+    VBSlotInfo vb[MAX_VB_SLOTS];
+    LastUboEntry ubo[MAX_LAST_UBO];   /* from the bound sets' UBO tracking */
+    uint8_t pc_data[256];
+} CmdBufState;
+
+/* Read-only stand-in for a command buffer without state */
+static const CmdBufState g_cb_state_none;
+
+static CmdBufState* cb_state_get(void* wrapped_cb, int create) {
+    HandleWrapper* w = (HandleWrapper*)wrapped_cb;
+    if (!w->cb_state && create) {
+        CmdBufState* cbs = (CmdBufState*)aligned_alloc(64, sizeof(CmdBufState));
+        if (cbs) memset(cbs, 0, sizeof(*cbs));
+        w->cb_state = cbs;
+    }
+    return (CmdBufState*)w->cb_state;
+}
+
+/* State for diagnostics that only read it: never NULL */
+static inline const CmdBufState* cb_state_peek(void* wrapped_cb) {
+    const CmdBufState* cbs = (const CmdBufState*)((HandleWrapper*)wrapped_cb)->cb_state;
+    return cbs ? cbs : &g_cb_state_none;
+}
+
+/* vkBeginCommandBuffer: forget the previous recording, keep the stream buffer */
+static void cb_state_begin(void* wrapped_cb, int secondary) {
+    CmdBufState* cbs = cb_state_get(wrapped_cb, 1);
+    if (!cbs) return;
+    uint8_t* replay = cbs->replay;
+    uint32_t replay_cap = cbs->replay_cap;
+    memset(cbs, 0, sizeof(*cbs));
+    cbs->replay = replay;
+    cbs->replay_cap = replay_cap;
+    cbs->is_secondary = secondary;
+}
+
+/* A transfer command in this recording writes `buffer` */
+static void cb_state_note_write(void* wrapped_cb, uint64_t buffer) {
+    CmdBufState* cbs = cb_state_get(wrapped_cb, 0);
+    if (!cbs || !buffer) return;
+    uint32_t n = cbs->xfer_dst_count < MAX_XFER_DST ? cbs->xfer_dst_count : MAX_XFER_DST;
+    for (uint32_t i = 0; i < n; i++)
+        if (cbs->xfer_dst[i] == buffer) return;
+    if (cbs->xfer_dst_count < MAX_XFER_DST) cbs->xfer_dst[cbs->xfer_dst_count] = buffer;
+    if (cbs->xfer_dst_count <= MAX_XFER_DST) cbs->xfer_dst_count++;
+}
+
+/* Has a transfer command earlier in this recording (possibly) written `buffer`? */
+static int cb_state_wrote(void* wrapped_cb, uint64_t buffer) {
+    const CmdBufState* cbs = cb_state_peek(wrapped_cb);
+    if (cbs->xfer_dst_count > MAX_XFER_DST) return 1;
+    for (uint32_t i = 0; i < cbs->xfer_dst_count; i++)
+        if (cbs->xfer_dst[i] == buffer) return 1;
+    return 0;
+}
+
+static void cb_state_free(void* state) {
+    CmdBufState* cbs = (CmdBufState*)state;
+    free(cbs->replay);
+    free(cbs);
 }
 
-static ReplayCmd* add_replay_cmd(void* wrapped_cb, int type) {
-    ReplayCB* rcb = find_replay_cb(wrapped_cb, 0);
-    if (!rcb || !rcb->is_secondary || rcb->cmd_count >= MAX_REPLAY_CMDS) return NULL;
-    ReplayCmd* cmd = &rcb->cmds[rcb->cmd_count++];
-    memset(cmd, 0, sizeof(ReplayCmd));
-    cmd->type = type;
-    return cmd;
+/* ===== Secondary CB Command Replay =====
+ * Vortek IPC doesn't properly handle secondary command buffers:
+ *   - Dynamic state not inherited from primary→secondary (confirmed)
+ *   - Possible pNext chain (InheritanceRenderingInfo) not serialized
+ * Instead of using CmdExecuteCommands, we record commands from secondary CBs
+ * and replay them directly into the primary CB context. This makes all
+ * commands execute within the primary CB's render pass + dynamic state.
+ *
+ * Each secondary CB encodes its commands into a growable byte stream in its
+ * CmdBufState: an 8-byte ReplayRec header (type, payload
+ * size) followed by exactly the payload the command needs, padded to 8.
+ * Arrays (vertex buffers, descriptor sets, push constant data, viewports)
+ * are stored at their real length, so there is no per-command or per-CB
+ * cap and a draw costs 32 bytes instead of a fixed-size slot. */
+
+#define REPLAY_STREAM_MIN 4096
+
+enum {
+    RCMD_NONE = 0,
+    RCMD_BIND_VB,        /* RcBindVB + buffers[count] + offsets[count] */
+    RCMD_BIND_IB,
+    RCMD_BIND_PIPELINE,
+    RCMD_BIND_DESC_SETS, /* RcDescSets + sets[setCount] + dynOffs[dynOffCount] */
+    RCMD_PUSH_CONSTS,    /* RcPushConsts + data[size] */
+    RCMD_DRAW_INDEXED,
+    RCMD_DRAW,
+    /* Extended dynamic state — generic slot-based recording */
+    RCMD_EDS_UINT,       /* (cmdBuf, uint32_t value) — cull, depth test, etc. */
+    RCMD_EDS_VIEWPORT,   /* (cmdBuf, count, pViewports): RcRects + count × 6 floats */
+    RCMD_EDS_SCISSOR,    /* (cmdBuf, count, pScissors): RcRects + count × 4 u32 */
+    RCMD_EDS_DEPTHBIAS,  /* (cmdBuf, float, float, float) */
+    RCMD_EDS_BLEND,      /* (cmdBuf, float[4]) */
+    RCMD_EDS_STENCIL2,   /* (cmdBuf, faceMask, value) */
+    RCMD_EDS_STENCILOP,  /* (cmdBuf, faceMask, failOp, passOp, depthFailOp, compareOp) */
+};
+
+typedef struct { uint32_t type, size; } ReplayRec;   /* size: payload bytes */
+
+typedef struct { uint32_t first, count; } RcBindVB;
+typedef struct { uint64_t buffer, offset; uint32_t indexType; } RcBindIB;
+typedef struct { uint64_t pipeline; uint32_t bindPoint; } RcBindPipeline;
+typedef struct { uint64_t layout; uint32_t bindPoint, firstSet, setCount, dynOffCount; } RcDescSets;
+typedef struct { uint64_t layout; uint32_t stageFlags, offset, size; } RcPushConsts;
+typedef struct { uint32_t indexCount, instanceCount, firstIndex;
+                 int32_t vertexOffset; uint32_t firstInstance; } RcDrawIndexed;
+typedef struct { uint32_t vertexCount, instanceCount, firstVertex, firstInstance; } RcDraw;
+typedef struct { int slot; uint32_t value; } RcEdsUint;
+typedef struct { uint32_t count; } RcRects;
+typedef struct { float a, b, c; } RcDepthBias;
+typedef struct { float vals[4]; } RcBlend;
+typedef struct { int slot; uint32_t face, val; } RcStencil2;
+typedef struct { uint32_t face, fail, pass, dfail, cmp; } RcStencilOp;
+
+/* Append a command to a secondary CB's replay stream. Returns its payload
+ * (size bytes, zeroed), or NULL if the CB isn't recorded for replay. */
+static void* replay_emit(void* wrapped_cb, uint32_t type, uint32_t size) {
+    CmdBufState* cbs = (CmdBufState*)((HandleWrapper*)wrapped_cb)->cb_state;
+    if (!cbs || !cbs->is_secondary || cbs->replay_broken) return NULL;
+    uint32_t len = sizeof(ReplayRec) + ((size + 7) & ~7u);
+    if (cbs->replay_len + len > cbs->replay_cap) {
+        uint32_t ncap = cbs->replay_cap ? cbs->replay_cap : REPLAY_STREAM_MIN;
+        while (ncap < cbs->replay_len + len) ncap *= 2;
+        uint8_t* nbuf = (uint8_t*)realloc(cbs->replay, ncap);
+        if (!nbuf) {
+            LOGE(ICD_LC_CMD, "replay: out of memory growing cb=%p stream to %u bytes\n",
+                wrapped_cb, ncap);
+            cbs->replay_broken = 1;
+            return NULL;
+        }
+        cbs->replay = nbuf;
+        cbs->replay_cap = ncap;
+    }
+    ReplayRec* rec = (ReplayRec*)(cbs->replay + cbs->replay_len);
+    rec->type = type;
+    rec->size = size;
+    memset(rec + 1, 0, len - sizeof(ReplayRec));
+    cbs->replay_len += len;
+    return rec + 1;
 }
 
 /* Forward declaration — defined after all real_cmd_* function pointers */
-static void replay_secondary_into_primary(void* real_primary, ReplayCB* rcb);
+static void replay_secondary_into_primary(void* real_primary, const CmdBufState* cbs);
 
 /* ---- vkCmdExecuteCommands: unwrap + forward ---- */
 
@@ -1415,18 +2851,18 @@ typedef void (*PFN_vkCmdExecCmds)(void*, uint32_t, void* const*);
 static PFN_vkCmdExecCmds real_cmd_exec_cmds = NULL;
 
 /* Detailed logging callback — set after state variables are defined */
-typedef void (*ExecCmdsLogFn)(void* real_primary, uint32_t count, void* const* pSecondary);
+typedef void (*ExecCmdsLogFn)(void* primary, uint32_t count, void* const* pSecondary);
 static ExecCmdsLogFn g_exec_cmds_log = NULL;
 
 /* Callback to inject VB/IB state onto a primary CB — set after globals are defined */
-typedef void (*InjectVBIBFn)(void* real_primary);
+typedef void (*InjectVBIBFn)(void* real_primary, const CmdBufState* src);
 static InjectVBIBFn g_inject_vb_ib = NULL;
 
 static void wrapper_CmdExecuteCommands(void* cmdBuf, uint32_t count,
                                        void* const* pSecondary) {
     void* real_cmd = unwrap(cmdBuf);
     if (g_exec_cmds_log)
-        g_exec_cmds_log(real_cmd, count, pSecondary);
+        g_exec_cmds_log(cmdBuf, count, pSecondary);
 
     /* NATIVE path: unwrap all secondary handles and pass through.
      * Replay is disabled to test if real secondary CBs have VB bindings
@@ -1437,7 +2873,7 @@ static void wrapper_CmdExecuteCommands(void* cmdBuf, uint32_t count,
 
     static int exec_log = 0;
     if (++exec_log <= 20)
-        LOG("  EXEC_NATIVE: primary=%p count=%u sec[0]=%p->%p\n",
+        LOGT(ICD_LC_CMD, "  EXEC_NATIVE: primary=%p count=%u sec[0]=%p->%p\n",
             real_cmd, count, count > 0 ? pSecondary[0] : NULL,
             count > 0 ? native_sec[0] : NULL);
 
@@ -1451,67 +2887,41 @@ static void wrapper_CmdExecuteCommands(void* cmdBuf, uint32_t count,
  * any command buffer handles embedded in VkCommandBufferSubmitInfo.
  */
 
-/* VkCommandBufferSubmitInfo (32 bytes on x86-64) */
-typedef struct {
-    uint32_t    sType;          /* 0 */
-    uint32_t    _pad0;          /* 4 */
-    const void* pNext;          /* 8 */
-    void*       commandBuffer;  /* 16 */
-    uint32_t    deviceMask;     /* 24 */
-    uint32_t    _pad1;          /* 28 */
-} ICD_VkCommandBufferSubmitInfo;
-
-/* VkSubmitInfo2 (64 bytes on x86-64) */
-typedef struct {
-    uint32_t    sType;                      /* 0 */
-    uint32_t    _pad0;                      /* 4 */
-    const void* pNext;                      /* 8 */
-    uint32_t    flags;                      /* 16 */
-    uint32_t    waitSemaphoreInfoCount;     /* 20 */
-    const void* pWaitSemaphoreInfos;        /* 24 */
-    uint32_t    commandBufferInfoCount;     /* 32 */
-    uint32_t    _pad1;                      /* 36 */
-    const ICD_VkCommandBufferSubmitInfo* pCommandBufferInfos; /* 40 */
-    uint32_t    signalSemaphoreInfoCount;   /* 48 */
-    uint32_t    _pad2;                      /* 52 */
-    const void* pSignalSemaphoreInfos;      /* 56 */
-} ICD_VkSubmitInfo2;
-
-typedef VkResult (*PFN_vkQueueSubmit2)(void*, uint32_t, const ICD_VkSubmitInfo2*, uint64_t);
-static PFN_vkQueueSubmit2 real_queue_submit2 = NULL;
-
-static VkResult wrapper_QueueSubmit2(void* queue, uint32_t submitCount,
-                                     const ICD_VkSubmitInfo2* pSubmits,
-                                     uint64_t fence) {
+static VkResult queue_submit2(void* queue, uint32_t submitCount,
+                               const ICD_VkSubmitInfo2* pSubmits,
+                               uint64_t fence) {
     void* real_queue = unwrap(queue);
-
-    if (submitCount == 0 || !pSubmits) {
-        VkResult r = real_queue_submit2(real_queue, 0, NULL, fence);
-        return r;
-    }
+    QueueState* qs = queue_state_for(real_queue);
+    VkResult err = queue_take_error(qs);
+    if (err) return err;
+    if (!pSubmits) submitCount = 0;
 
     /* Count total cmdBufs to unwrap */
     uint32_t total = 0;
     for (uint32_t s = 0; s < submitCount; s++)
         total += pSubmits[s].commandBufferInfoCount;
 
-    if (total == 0) {
-        /* No command buffers to unwrap — pass through directly */
-        int sn = ++submit_count_global;
-        LOG("[D%d] vkQueueSubmit2 #%d: queue=%p submits=%u cmdBufs=0 (passthrough)\n",
-            g_device_count, sn, real_queue, submitCount);
-        pthread_mutex_lock(&queue_mutex);
-        VkResult r = real_queue_submit2(real_queue, submitCount, pSubmits, fence);
-        pthread_mutex_unlock(&queue_mutex);
-        LOG("[D%d] vkQueueSubmit2 #%d: result=%d\n", g_device_count, sn, r);
-        return r;
+    int sn = __atomic_add_fetch(&submit_count_global, 1, __ATOMIC_RELAXED);
+    LOGT(ICD_LC_SUBMIT, "[D%d] vkQueueSubmit2 #%d: queue=%p submits=%u cmdBufs=%u (thread_cmd_ops=%d)\n",
+        g_device_count, sn, real_queue, submitCount, total, g_cmd_op_count);
+
+    /* TSO fix: ensure all CPU stores (UBO data, etc.) are committed before GPU reads */
+    __sync_synchronize();
+
+    if (submit_async_enabled()) {
+        SubmitJob* job = submit_job_v2(qs, submitCount, pSubmits, fence);
+        if (job) {
+            job->sn = sn;
+            submit_push(job);
+            return 0;
+        }
     }
 
-    /* Create temp copies of VkSubmitInfo2 with unwrapped cmdBuf handles. */
+    /* Inline: temp copies of VkSubmitInfo2 with unwrapped cmdBuf handles. */
     ICD_VkSubmitInfo2* tmp = (ICD_VkSubmitInfo2*)alloca(
-        submitCount * sizeof(ICD_VkSubmitInfo2));
+        (submitCount ? submitCount : 1) * sizeof(ICD_VkSubmitInfo2));
     ICD_VkCommandBufferSubmitInfo* cbInfos = (ICD_VkCommandBufferSubmitInfo*)alloca(
-        total * sizeof(ICD_VkCommandBufferSubmitInfo));
+        (total ? total : 1) * sizeof(ICD_VkCommandBufferSubmitInfo));
     uint32_t ci = 0;
 
     for (uint32_t s = 0; s < submitCount; s++) {
@@ -1526,37 +2936,84 @@ static VkResult wrapper_QueueSubmit2(void* queue, uint32_t submitCount,
         }
     }
 
-    int sn = ++submit_count_global;
-    LOG("[D%d] vkQueueSubmit2 #%d: queue=%p submits=%u cmdBufs=%u (cmd_ops_so_far=%d)\n",
-        g_device_count, sn, real_queue, submitCount, total, g_cmd_op_count);
-
-    /* TSO fix: ensure all CPU stores (UBO data, etc.) are committed before GPU reads */
-    __sync_synchronize();
-
-    pthread_mutex_lock(&queue_mutex);
-    VkResult res = real_queue_submit2(real_queue, submitCount, tmp, fence);
-    pthread_mutex_unlock(&queue_mutex);
+    submit_flush();
+    pthread_mutex_lock(&qs->lock);
+    VkResult res = real_queue_submit2(real_queue, submitCount, submitCount ? tmp : NULL, fence);
+    pthread_mutex_unlock(&qs->lock);
     if (res != 0)
-        LOG("[D%d] vkQueueSubmit2 #%d FAILED: %d\n", g_device_count, sn, res);
+        LOGW(ICD_LC_SUBMIT, "[D%d] vkQueueSubmit2 #%d FAILED: %d\n", g_device_count, sn, res);
     else
-        LOG("[D%d] vkQueueSubmit2 #%d OK\n", g_device_count, sn);
+        LOGT(ICD_LC_SUBMIT, "[D%d] vkQueueSubmit2 #%d OK\n", g_device_count, sn);
 
     return res;
 }
 
-/* ---- vkQueueWaitIdle: mutex-protected (shared queue) ---- */
+/* BC GPU transcode prologues (if any) go in front of their command buffers */
+static VkResult wrapper_QueueSubmit2(void* queue, uint32_t submitCount,
+                                     const ICD_VkSubmitInfo2* pSubmits,
+                                     uint64_t fence) {
+    desc_batch_flush();
+    const ICD_VkSubmitInfo2* subs = (const ICD_VkSubmitInfo2*)bc_gpu_submits(1, submitCount, pSubmits);
+    VkResult res = queue_submit2(queue, submitCount, subs, fence);
+    if (subs != pSubmits) free((void*)subs);
+    return res;
+}
+
+/* ---- vkQueueWaitIdle: flush deferred submits, then wait under the queue lock ---- */
 
 typedef VkResult (*PFN_vkQueueWaitIdle)(void*);
 static PFN_vkQueueWaitIdle real_queue_wait_idle = NULL;
 
 static VkResult wrapper_QueueWaitIdle(void* queue) {
     void* real_queue = unwrap(queue);
-    pthread_mutex_lock(&queue_mutex);
+    QueueState* qs = queue_state_for(real_queue);
+    submit_flush();
+    pthread_mutex_lock(&qs->lock);
     VkResult res = real_queue_wait_idle(real_queue);
-    pthread_mutex_unlock(&queue_mutex);
+    pthread_mutex_unlock(&qs->lock);
+    VkResult err = queue_take_error(qs);
+    return res ? res : err;
+}
+
+/* ---- vkQueuePresentKHR / vkQueueBindSparse: ordered after deferred submits ---- */
+
+typedef VkResult (*PFN_vkQueuePresentKHR)(void*, const void*);
+static PFN_vkQueuePresentKHR real_queue_present = NULL;
+
+static VkResult wrapper_QueuePresentKHR(void* queue, const void* pPresentInfo) {
+    void* real_queue = unwrap(queue);
+    QueueState* qs = queue_state_for(real_queue);
+    submit_flush();
+    pthread_mutex_lock(&qs->lock);
+    VkResult res = real_queue_present(real_queue, pPresentInfo);
+    pthread_mutex_unlock(&qs->lock);
+    return res;
+}
+
+typedef VkResult (*PFN_vkQueueBindSparse)(void*, uint32_t, const void*, uint64_t);
+static PFN_vkQueueBindSparse real_queue_bind_sparse = NULL;
+
+static VkResult wrapper_QueueBindSparse(void* queue, uint32_t bindInfoCount,
+                                        const void* pBindInfo, uint64_t fence) {
+    void* real_queue = unwrap(queue);
+    QueueState* qs = queue_state_for(real_queue);
+    submit_flush();
+    pthread_mutex_lock(&qs->lock);
+    VkResult res = real_queue_bind_sparse(real_queue, bindInfoCount, pBindInfo, fence);
+    pthread_mutex_unlock(&qs->lock);
     return res;
 }
 
+/* ---- vkDeviceWaitIdle: must also cover submits still in the queue ---- */
+
+typedef VkResult (*PFN_vkDeviceWaitIdle)(void*);
+static PFN_vkDeviceWaitIdle real_device_wait_idle = NULL;
+
+static VkResult wrapper_DeviceWaitIdle(void* device) {
+    submit_flush();
+    return real_device_wait_idle(unwrap(device));
+}
+
 /* ==== Tracing wrappers for device initialization ====
  *
  * These log VkResult + handle for key functions during device init.
@@ -1578,12 +3035,43 @@ static VkResult trace_CreateCommandPool(void* device, const void* pCreateInfo,
         qfi = *(const uint32_t*)((const char*)pCreateInfo + 20);
     }
     VkResult res = real_create_cmd_pool(real, pCreateInfo, pAllocator, pPool);
-    LOG("[D%d] vkCreateCommandPool: dev=%p qfi=%u flags=0x%x result=%d pool=0x%llx\n",
+    if (res == 0 && pPool) bc_gpu_track_pool(*pPool, qfi);
+    LOGD(ICD_LC_CMD, "[D%d] vkCreateCommandPool: dev=%p qfi=%u flags=0x%x result=%d pool=0x%llx\n",
         g_device_count, real, qfi, flags, res,
         pPool ? (unsigned long long)*pPool : 0);
     return res;
 }
 
+/* vkResetCommandPool / vkDestroyCommandPool reset or free every command
+ * buffer of the pool without naming them; their BC decode staging goes
+ * back like on vkResetCommandBuffer / vkFreeCommandBuffers */
+typedef VkResult (*PFN_vkResetCommandPool)(void*, uint64_t, uint32_t);
+static PFN_vkResetCommandPool real_reset_cmd_pool = NULL;
+
+static VkResult trace_ResetCommandPool(void* device, uint64_t pool, uint32_t flags) {
+    void* real = unwrap(device);
+    bc_stage_release_pool(pool, 0);
+    return real_reset_cmd_pool(real, pool, flags);
+}
+
+typedef void (*PFN_vkDestroyCommandPool)(void*, uint64_t, const void*);
+static PFN_vkDestroyCommandPool real_destroy_cmd_pool = NULL;
+
+static void trace_DestroyCommandPool(void* device, uint64_t pool, const void* pAllocator) {
+    void* real = unwrap(device);
+    bc_stage_release_pool(pool, 1);
+    real_destroy_cmd_pool(real, pool, pAllocator);
+}
+
+typedef VkResult (*PFN_vkResetCommandBuffer)(void*, uint32_t);
+static PFN_vkResetCommandBuffer real_reset_cmd_buf = NULL;
+
+static VkResult trace_ResetCommandBuffer(void* cmdBuf, uint32_t flags) {
+    void* real = unwrap(cmdBuf);
+    bc_stage_release_cb(real);
+    return real_reset_cmd_buf(real, flags);
+}
+
 typedef VkResult (*PFN_vkAllocateMemory)(void*, const void*, const void*, uint64_t*);
 static PFN_vkAllocateMemory real_alloc_memory = NULL;
 static uint64_t g_staging_alloc_total = 0;  /* total allocated from HOST_VISIBLE types */
@@ -1591,10 +3079,28 @@ static uint64_t g_staging_alloc_total = 0;  /* total allocated from HOST_VISIBLE
 /* Forward declarations for auto-map in trace_AllocateMemory */
 typedef VkResult (*PFN_vkMapMemory)(void*, uint64_t, uint64_t, uint64_t, uint32_t, void**);
 static PFN_vkMapMemory real_map_memory;  /* defined later, set by GDPA */
-typedef struct { uint64_t memory; void* pointer; uint64_t mapOffset; } MapPtrEntry;
-#define MAX_MAP_PTR 2048
-static MapPtrEntry g_map_ptrs[MAX_MAP_PTR];
-static int g_map_ptr_count;
+typedef struct {
+    void* pointer;
+    uint64_t mapOffset;
+    int on_demand;      /* mapped by lookup_ubo_ptr, not by the app */
+} MapPtrEntry;
+
+/* memory → MapPtrEntry, one entry per currently mapped VkDeviceMemory.
+ * Map replaces, unmap removes. */
+static HandleMap g_map_ptrs = HMAP_INIT(MapPtrEntry);
+
+static int map_ptr_find(uint64_t memory, MapPtrEntry* out) {
+    return hmap_get(&g_map_ptrs, memory, out);
+}
+
+static void map_ptr_set(uint64_t memory, void* pointer, uint64_t mapOffset, int on_demand) {
+    MapPtrEntry e = { pointer, mapOffset, on_demand };
+    hmap_put(&g_map_ptrs, memory, &e);
+}
+
+static void map_ptr_remove(uint64_t memory) {
+    hmap_del(&g_map_ptrs, memory, NULL);
+}
 
 /* Types 0 and 1 are HOST_VISIBLE (staging heap). Check if a type is HOST_VISIBLE.
  * Our virtual type (g_added_type_index) is also HOST_VISIBLE now (Mali unified). */
@@ -1630,7 +3136,7 @@ static VkResult trace_AllocateMemory(void* device, const void* pAllocInfo,
         *(uint32_t*)(local_info + 24) = (uint32_t)g_remap_to_type;
         real_type = (uint32_t)g_remap_to_type;
         alloc_info = local_info;
-        LOG("[D%d] vkAllocateMemory: REMAP type %u -> %u (virtual DEVICE_LOCAL -> real)\n",
+        LOGD(ICD_LC_MEM, "[D%d] vkAllocateMemory: REMAP type %u -> %u (virtual DEVICE_LOCAL -> real)\n",
             g_device_count, mem_type, real_type);
     }
 
@@ -1639,7 +3145,7 @@ static VkResult trace_AllocateMemory(void* device, const void* pAllocInfo,
      * type (g_added_type_index) is NOT capped — it's for the large texture heap.
      * DXVK handles -1 by retrying smaller chunk sizes (16→8→4→2→1 MB). */
     if (is_staging_type(mem_type) && g_staging_alloc_total + alloc_size > ALLOC_BYTE_CAP) {
-        LOG("[D%d] vkAllocateMemory: CAPPED type=%u size=%llu staging=%llu MB (cap=%llu MB) -> OOM\n",
+        LOGW(ICD_LC_MEM, "[D%d] vkAllocateMemory: CAPPED type=%u size=%llu staging=%llu MB (cap=%llu MB) -> OOM\n",
             g_device_count, mem_type, (unsigned long long)alloc_size,
             (unsigned long long)(g_staging_alloc_total / (1024*1024)),
             (unsigned long long)(ALLOC_BYTE_CAP / (1024*1024)));
@@ -1653,7 +3159,7 @@ static VkResult trace_AllocateMemory(void* device, const void* pAllocInfo,
      * Query device fault info for diagnostics. DXVK treats -4 as fatal
      * but handles -1 gracefully (retries smaller sizes, falls back). */
     if (res == -4) {
-        LOG("[D%d] vkAllocateMemory: DEVICE_LOST! type=%u size=%llu staging=%llu MB\n",
+        LOGE(ICD_LC_MEM, "[D%d] vkAllocateMemory: DEVICE_LOST! type=%u size=%llu staging=%llu MB\n",
             g_device_count, mem_type, (unsigned long long)alloc_size,
             (unsigned long long)(g_staging_alloc_total / (1024*1024)));
         query_device_fault();
@@ -1665,7 +3171,7 @@ static VkResult trace_AllocateMemory(void* device, const void* pAllocInfo,
     if (res == 0 && is_staging_type(mem_type))
         g_staging_alloc_total += alloc_size;
 
-    LOG("[D%d] vkAllocateMemory: dev=%p size=%llu type=%u(%u) result=%d mem=0x%llx staging=%llu MB\n",
+    LOGD(ICD_LC_MEM, "[D%d] vkAllocateMemory: dev=%p size=%llu type=%u(%u) result=%d mem=0x%llx staging=%llu MB\n",
         g_device_count, real, (unsigned long long)alloc_size, mem_type, real_type, res,
         pMemory ? (unsigned long long)*pMemory : 0,
         (unsigned long long)(g_staging_alloc_total / (1024*1024)));
@@ -1702,7 +3208,7 @@ static VkResult trace_CreateBuffer(void* device, const void* pCreateInfo,
         usage = *(const uint32_t*)((const char*)pCreateInfo + 32);
         sharing = *(const uint32_t*)((const char*)pCreateInfo + 36);
     }
-    LOG("[D%d] vkCreateBuffer: dev=%p size=%llu usage=0x%x flags=0x%x sharing=%u pNext=%p\n",
+    LOGD(ICD_LC_RES, "[D%d] vkCreateBuffer: dev=%p size=%llu usage=0x%x flags=0x%x sharing=%u pNext=%p\n",
         g_device_count, real, (unsigned long long)size, usage, flags, sharing, pNext);
 
     /* Force STORAGE_BUFFER_BIT on all buffers (bionic-vulkan-wrapper compat).
@@ -1714,15 +3220,15 @@ static VkResult trace_CreateBuffer(void* device, const void* pCreateInfo,
         memcpy(patched_buf_ci, pCreateInfo, 56);
         *(uint32_t*)(patched_buf_ci + 32) = usage | 0x20;
         bufCI = patched_buf_ci;
-        LOG("[D%d] vkCreateBuffer: +STORAGE_BUFFER_BIT (0x%x -> 0x%x)\n",
+        LOGD(ICD_LC_RES, "[D%d] vkCreateBuffer: +STORAGE_BUFFER_BIT (0x%x -> 0x%x)\n",
             g_device_count, usage, usage | 0x20);
     }
 
     VkResult res = real_create_buffer(real, bufCI, pAllocator, pBuffer);
-    LOG("[D%d] vkCreateBuffer: result=%d buf=0x%llx\n",
+    LOGD(ICD_LC_RES, "[D%d] vkCreateBuffer: result=%d buf=0x%llx\n",
         g_device_count, res, pBuffer ? (unsigned long long)*pBuffer : 0);
     if (res != 0) {
-        LOG("[D%d] *** CreateBuffer FAILED: size=%llu usage=0x%x flags=0x%x ***\n",
+        LOGW(ICD_LC_RES, "[D%d] *** CreateBuffer FAILED: size=%llu usage=0x%x flags=0x%x ***\n",
             g_device_count, (unsigned long long)size, usage, flags);
     }
     return res;
@@ -1763,7 +3269,7 @@ static VkResult trace_CreateImage(void* device, const void* pCreateInfo,
     const void* actual_ci = pCreateInfo;
     uint32_t rgba_fmt = 0;
     if (pCreateInfo && is_bc_format(fmt)) {
-        rgba_fmt = bc_to_rgba_format(fmt);
+        rgba_fmt = bc_to_rgba_format(fmt, usage);
         memcpy(ci_copy, pCreateInfo, 72);
         *(uint32_t*)(ci_copy + 24) = rgba_fmt;
         actual_ci = ci_copy;
@@ -1773,24 +3279,33 @@ static VkResult trace_CreateImage(void* device, const void* pCreateInfo,
 
     if (res == 0 && rgba_fmt && pImage) {
         bc_img_track(*pImage, fmt, rgba_fmt);
-        LOG("[D%d] vkCreateImage: BC SUBST fmt=%u->%u %ux%u result=0 img=0x%llx\n",
+        LOGD(ICD_LC_RES, "[D%d] vkCreateImage: BC SUBST fmt=%u->%u %ux%u result=0 img=0x%llx\n",
             g_device_count, fmt, rgba_fmt, w, h, (unsigned long long)*pImage);
         return res;
     }
 
     /* Convert DEVICE_LOST: query fault info, then return recoverable error */
     if (res == -4) {
-        LOG("[D%d] vkCreateImage: DEVICE_LOST! fmt=%u %ux%u tiling=%u usage=0x%x\n",
+        LOGE(ICD_LC_RES, "[D%d] vkCreateImage: DEVICE_LOST! fmt=%u %ux%u tiling=%u usage=0x%x\n",
             g_device_count, fmt, w, h, tiling, usage);
         query_device_fault();
         return -1;
     }
-    LOG("[D%d] vkCreateImage: dev=%p fmt=%u %ux%u tiling=%u usage=0x%x result=%d img=0x%llx\n",
+    LOGD(ICD_LC_RES, "[D%d] vkCreateImage: dev=%p fmt=%u %ux%u tiling=%u usage=0x%x result=%d img=0x%llx\n",
         g_device_count, real, fmt, w, h, tiling, usage, res,
         pImage ? (unsigned long long)*pImage : 0);
     return res;
 }
 
+/* Trace: vkDestroyImage — drop BC substitution tracking */
+typedef void (*PFN_vkDestroyImage)(void*, uint64_t, const void*);
+static PFN_vkDestroyImage real_destroy_image = NULL;
+
+static void trace_DestroyImage(void* device, uint64_t image, const void* pAllocator) {
+    hmap_del(&g_bc_images, image, NULL);
+    real_destroy_image(unwrap(device), image, pAllocator);
+}
+
 typedef VkResult (*PFN_vkCreateFence)(void*, const void*, const void*, uint64_t*);
 static PFN_vkCreateFence real_create_fence = NULL;
 
@@ -1798,7 +3313,7 @@ static VkResult trace_CreateFence(void* device, const void* pCreateInfo,
                                   const void* pAllocator, uint64_t* pFence) {
     void* real = unwrap(device);
     VkResult res = real_create_fence(real, pCreateInfo, pAllocator, pFence);
-    LOG("[D%d] vkCreateFence: dev=%p result=%d fence=0x%llx\n",
+    LOGD(ICD_LC_RES, "[D%d] vkCreateFence: dev=%p result=%d fence=0x%llx\n",
         g_device_count, real, res, pFence ? (unsigned long long)*pFence : 0);
     return res;
 }
@@ -1810,7 +3325,7 @@ static VkResult trace_CreateSemaphore(void* device, const void* pCreateInfo,
                                       const void* pAllocator, uint64_t* pSem) {
     void* real = unwrap(device);
     VkResult res = real_create_semaphore(real, pCreateInfo, pAllocator, pSem);
-    LOG("[D%d] vkCreateSemaphore: dev=%p result=%d sem=0x%llx\n",
+    LOGD(ICD_LC_RES, "[D%d] vkCreateSemaphore: dev=%p result=%d sem=0x%llx\n",
         g_device_count, real, res, pSem ? (unsigned long long)*pSem : 0);
     return res;
 }
@@ -1864,71 +3379,68 @@ static int g_fake_map_count = 0;
 
 /* Track real-mapped handles so we can decrement g_total_mapped_bytes on unmap.
  * Without this, the counter is monotonically increasing and eventually ALL maps
- * become FAKE (including the headless layer's small staging buffer → black frames). */
+ * become FAKE (including the headless layer's small staging buffer → black frames).
+ * Keyed by memory handle. */
 typedef struct {
-    uint64_t handle;
     uint64_t mapped_size;
 } RealMapEntry;
 
-#define MAX_REAL_MAPS 512
-static RealMapEntry g_real_maps[MAX_REAL_MAPS];
-static int g_real_map_count = 0;
+static HandleMap g_real_maps = HMAP_INIT(RealMapEntry);
 
 /* === UBO data readback tracking ===
  * Track mapped pointers and buffer→memory bindings so we can read back
  * UBO data at descriptor write time to verify CPU-side correctness.
- * NOTE: MapPtrEntry, g_map_ptrs, g_map_ptr_count, MAX_MAP_PTR, PFN_vkMapMemory,
- * real_map_memory are forward-declared before trace_AllocateMemory (for auto-map). */
+ * NOTE: MapPtrEntry, g_map_ptrs, PFN_vkMapMemory, real_map_memory are
+ * forward-declared before trace_AllocateMemory (for auto-map). */
 
 typedef struct {
-    uint64_t buffer;
     uint64_t memory;
     uint64_t memOffset;  /* offset in vkBindBufferMemory */
 } BufMemEntry;
 
-#define MAX_BUF_MEM 8192
-static BufMemEntry g_buf_mem[MAX_BUF_MEM];
-static int g_buf_mem_count = 0;
+/* buffer → BufMemEntry; dropped in vkDestroyBuffer */
+static HandleMap g_buf_mem = HMAP_INIT(BufMemEntry);
 
 /* Look up mapped pointer for a buffer at a given descriptor offset.
  * Returns pointer to the data, or NULL if not trackable. */
 static void* lookup_ubo_ptr(uint64_t buffer, uint64_t descOffset) {
     /* Find buffer → memory binding */
-    uint64_t mem = 0;
-    uint64_t memOff = 0;
-    for (int i = g_buf_mem_count - 1; i >= 0; i--) {
-        if (g_buf_mem[i].buffer == buffer) {
-            mem = g_buf_mem[i].memory;
-            memOff = g_buf_mem[i].memOffset;
-            break;
-        }
-    }
-    if (!mem) return NULL;
+    BufMemEntry bm;
+    if (!hmap_get(&g_buf_mem, buffer, &bm) || !bm.memory) return NULL;
+    uint64_t mem = bm.memory;
+    uint64_t memOff = bm.memOffset;
 
     /* Find memory → mapped pointer */
-    for (int i = g_map_ptr_count - 1; i >= 0; i--) {
-        if (g_map_ptrs[i].memory == mem && g_map_ptrs[i].pointer) {
-            uint8_t* base = (uint8_t*)g_map_ptrs[i].pointer;
-            uint64_t mapOff = g_map_ptrs[i].mapOffset;
-            void* result = base + memOff + descOffset - mapOff;
-            return result;
-        }
-    }
+    MapPtrEntry mp;
+    if (map_ptr_find(mem, &mp) && mp.pointer)
+        return (uint8_t*)mp.pointer + memOff + descOffset - mp.mapOffset;
 
     /* On-demand map: memory not yet mapped (DXVK DEFAULT usage).
      * On Mali unified memory, all types are HOST_VISIBLE so MapMemory works.
-     * Use VK_WHOLE_SIZE (-1) since we don't know the allocation size. */
-    if (real_map_memory && shared_real_device && g_map_ptr_count < MAX_MAP_PTR) {
-        void* ptr = NULL;
-        VkResult mr = real_map_memory(shared_real_device, mem, 0, (uint64_t)-1, 0, &ptr);
-        if (mr == 0 && ptr) {
-            g_map_ptrs[g_map_ptr_count].memory = mem;
-            g_map_ptrs[g_map_ptr_count].pointer = ptr;
-            g_map_ptrs[g_map_ptr_count].mapOffset = 0;
-            g_map_ptr_count++;
-            LOG("ON-DEMAND-MAP: mem=0x%lx ptr=%p\n", (unsigned long)mem, ptr);
-            return (uint8_t*)ptr + memOff + descOffset;
+     * Use VK_WHOLE_SIZE (-1) since we don't know the allocation size.
+     * Map under the write lock so two recording threads can't both map it. */
+    if (real_map_memory && shared_real_device) {
+        void* result = NULL;
+        hmap_wrlock(&g_map_ptrs);
+        MapPtrEntry* e = (MapPtrEntry*)hmap_find_locked(&g_map_ptrs, mem);
+        if (e && e->pointer) {
+            result = (uint8_t*)e->pointer + memOff + descOffset - e->mapOffset;
+        } else {
+            void* ptr = NULL;
+            VkResult mr = real_map_memory(shared_real_device, mem, 0, (uint64_t)-1, 0, &ptr);
+            if (mr == 0 && ptr) {
+                e = (MapPtrEntry*)hmap_insert_locked(&g_map_ptrs, mem);
+                if (e) {
+                    e->pointer = ptr;
+                    e->mapOffset = 0;
+                    e->on_demand = 1;
+                }
+                LOGT(ICD_LC_MEM, "ON-DEMAND-MAP: mem=0x%lx ptr=%p\n", (unsigned long)mem, ptr);
+                result = (uint8_t*)ptr + memOff + descOffset;
+            }
         }
+        hmap_unlock(&g_map_ptrs);
+        return result;
     }
     return NULL;
 }
@@ -1945,7 +3457,7 @@ static VkResult trace_MapMemory(void* device, uint64_t memory, uint64_t offset,
             g_fake_map_handles[g_fake_map_count++] = memory;
             g_map_count++;
             if (ppData) *ppData = g_scratch_buf; /* all fakes share one buffer */
-            LOG("[D%d] vkMapMemory #%d FAKE: mem=0x%llx sz=%llu scratch=%p total_real=%llu MB (limit=%llu MB)\n",
+            LOGD(ICD_LC_MEM, "[D%d] vkMapMemory #%d FAKE: mem=0x%llx sz=%llu scratch=%p total_real=%llu MB (limit=%llu MB)\n",
                 g_device_count, g_map_count, (unsigned long long)memory,
                 (unsigned long long)map_size, g_scratch_buf,
                 (unsigned long long)(g_total_mapped_bytes / (1024*1024)),
@@ -1962,10 +3474,16 @@ static VkResult trace_MapMemory(void* device, uint64_t memory, uint64_t offset,
         real_flush_mapped = (PFN_vkFlushMappedMemoryRanges)
             dlsym(thunk_lib, "vkFlushMappedMemoryRanges");
 
+    /* lookup_ubo_ptr may have mapped this memory on demand; a second real
+     * map would fail with MEMORY_MAP_FAILED, so drop ours first. */
+    MapPtrEntry prev;
+    if (hmap_del(&g_map_ptrs, memory, &prev) && prev.on_demand)
+        real_unmap_memory(real, memory);
+
     VkResult res = real_map_memory(real, memory, offset, size, flags, ppData);
     /* Convert DEVICE_LOST from VA exhaustion to recoverable error */
     if (res == -4) {
-        LOG("[D%d] vkMapMemory: DEVICE_LOST -> MEMORY_MAP_FAILED (VA exhausted) total=%llu MB\n",
+        LOGE(ICD_LC_MEM, "[D%d] vkMapMemory: DEVICE_LOST -> MEMORY_MAP_FAILED (VA exhausted) total=%llu MB\n",
             g_device_count, (unsigned long long)(g_total_mapped_bytes / (1024*1024)));
         return -5; /* VK_ERROR_MEMORY_MAP_FAILED */
     }
@@ -1974,25 +3492,18 @@ static VkResult trace_MapMemory(void* device, uint64_t memory, uint64_t offset,
         uint64_t tracked = (size != (uint64_t)-1) ? size : (16ULL * 1024 * 1024);
         g_total_mapped_bytes += tracked;
         /* Track handle→size for decrement on unmap */
-        if (g_real_map_count < MAX_REAL_MAPS) {
-            g_real_maps[g_real_map_count].handle = memory;
-            g_real_maps[g_real_map_count].mapped_size = tracked;
-            g_real_map_count++;
-        }
+        RealMapEntry rm = { tracked };
+        hmap_put(&g_real_maps, memory, &rm);
         /* Track memory→pointer for UBO readback */
-        if (ppData && *ppData && g_map_ptr_count < MAX_MAP_PTR) {
-            g_map_ptrs[g_map_ptr_count].memory = memory;
-            g_map_ptrs[g_map_ptr_count].pointer = *ppData;
-            g_map_ptrs[g_map_ptr_count].mapOffset = offset;
-            g_map_ptr_count++;
-        }
+        if (ppData && *ppData)
+            map_ptr_set(memory, *ppData, offset, 0);
     }
-    LOG("[D%d] vkMapMemory #%d: mem=0x%llx sz=%llu result=%d total_mapped=%llu MB\n",
+    LOGD(ICD_LC_MEM, "[D%d] vkMapMemory #%d: mem=0x%llx sz=%llu result=%d total_mapped=%llu MB\n",
         g_device_count, g_map_count, (unsigned long long)memory,
         (unsigned long long)size, res,
         (unsigned long long)(g_total_mapped_bytes / (1024*1024)));
     if (res != 0) {
-        LOG("  !!! MapMemory FAILED (result=%d) after %llu MB total mapped\n",
+        LOGW(ICD_LC_MEM, "  !!! MapMemory FAILED (result=%d) after %llu MB total mapped\n",
             res, (unsigned long long)(g_total_mapped_bytes / (1024*1024)));
     }
 
@@ -2015,40 +3526,53 @@ static VkResult trace_MapMemory(void* device, uint64_t memory, uint64_t offset,
 
 /* UnmapMemory: if fake-mapped, just remove from tracking (scratch is shared).
  * If real-mapped, call real unmap AND decrement g_total_mapped_bytes so the
- * counter stays accurate (fixes: all maps becoming FAKE after enough cycles). */
+ * counter stays accurate (fixes: all maps becoming FAKE after enough cycles).
+ * map_untrack returns 1 for fake maps (nothing to unmap for real). */
 
-static void trace_UnmapMemory(void* device, uint64_t memory) {
+static int map_untrack(uint64_t memory) {
     /* Check fake maps first */
     for (int i = 0; i < g_fake_map_count; i++) {
         if (g_fake_map_handles[i] == memory) {
-            LOG("[D%d] vkUnmapMemory FAKE: mem=0x%llx\n",
+            LOGD(ICD_LC_MEM, "[D%d] vkUnmapMemory FAKE: mem=0x%llx\n",
                 g_device_count, (unsigned long long)memory);
             for (int j = i; j < g_fake_map_count - 1; j++)
                 g_fake_map_handles[j] = g_fake_map_handles[j + 1];
             g_fake_map_count--;
-            return;
+            return 1;
         }
     }
 
     /* Real map: decrement tracked bytes */
-    for (int i = 0; i < g_real_map_count; i++) {
-        if (g_real_maps[i].handle == memory) {
-            g_total_mapped_bytes -= g_real_maps[i].mapped_size;
-            LOG("[D%d] vkUnmapMemory REAL: mem=0x%llx freed=%llu MB total_mapped=%llu MB\n",
-                g_device_count, (unsigned long long)memory,
-                (unsigned long long)(g_real_maps[i].mapped_size / (1024*1024)),
-                (unsigned long long)(g_total_mapped_bytes / (1024*1024)));
-            for (int j = i; j < g_real_map_count - 1; j++)
-                g_real_maps[j] = g_real_maps[j + 1];
-            g_real_map_count--;
-            break;
-        }
+    RealMapEntry rm;
+    if (hmap_del(&g_real_maps, memory, &rm)) {
+        g_total_mapped_bytes -= rm.mapped_size;
+        LOGD(ICD_LC_MEM, "[D%d] vkUnmapMemory REAL: mem=0x%llx freed=%llu MB total_mapped=%llu MB\n",
+            g_device_count, (unsigned long long)memory,
+            (unsigned long long)(rm.mapped_size / (1024*1024)),
+            (unsigned long long)(g_total_mapped_bytes / (1024*1024)));
     }
 
+    /* The pointer is dead after unmap — lookup_ubo_ptr maps again on demand */
+    map_ptr_remove(memory);
+    return 0;
+}
+
+static void trace_UnmapMemory(void* device, uint64_t memory) {
+    if (map_untrack(memory)) return;
     void* real = unwrap(device);
     real_unmap_memory(real, memory);
 }
 
+/* FreeMemory implicitly unmaps: drop the mapping so its bytes leave
+ * g_total_mapped_bytes and a recycled handle can't hit a stale pointer. */
+typedef void (*PFN_vkFreeMemory)(void*, uint64_t, const void*);
+static PFN_vkFreeMemory real_free_memory = NULL;
+
+static void trace_FreeMemory(void* device, uint64_t memory, const void* pAllocator) {
+    map_untrack(memory);
+    real_free_memory(unwrap(device), memory, pAllocator);
+}
+
 typedef VkResult (*PFN_vkBindBufferMemory)(void*, uint64_t, uint64_t, uint64_t);
 static PFN_vkBindBufferMemory real_bind_buf_mem = NULL;
 
@@ -2056,15 +3580,13 @@ static VkResult trace_BindBufferMemory(void* device, uint64_t buffer,
                                        uint64_t memory, uint64_t offset) {
     void* real = unwrap(device);
     VkResult res = real_bind_buf_mem(real, buffer, memory, offset);
-    LOG("[D%d] vkBindBufferMemory: dev=%p buf=0x%llx mem=0x%llx off=%llu result=%d\n",
+    LOGD(ICD_LC_MEM, "[D%d] vkBindBufferMemory: dev=%p buf=0x%llx mem=0x%llx off=%llu result=%d\n",
         g_device_count, real, (unsigned long long)buffer,
         (unsigned long long)memory, (unsigned long long)offset, res);
     /* Track buffer→memory for UBO readback */
-    if (res == 0 && g_buf_mem_count < MAX_BUF_MEM) {
-        g_buf_mem[g_buf_mem_count].buffer = buffer;
-        g_buf_mem[g_buf_mem_count].memory = memory;
-        g_buf_mem[g_buf_mem_count].memOffset = offset;
-        g_buf_mem_count++;
+    if (res == 0) {
+        BufMemEntry bm = { memory, offset };
+        hmap_put(&g_buf_mem, buffer, &bm);
     }
     return res;
 }
@@ -2081,8 +3603,8 @@ static VkResult trace_BindBufferMemory2(void* device, uint32_t bindInfoCount,
     VkResult res = real_bind_buf_mem2(real, bindInfoCount, pBindInfos);
     g_bind_buf_mem2_calls++;
     if (g_bind_buf_mem2_calls <= 20) {
-        LOG("BindBufferMemory2: call#%d count=%u result=%d total_tracked=%d\n",
-            g_bind_buf_mem2_calls, bindInfoCount, res, g_buf_mem_count);
+        LOGD(ICD_LC_MEM, "BindBufferMemory2: call#%d count=%u result=%d total_tracked=%u\n",
+            g_bind_buf_mem2_calls, bindInfoCount, res, hmap_count(&g_buf_mem));
     }
     if (res == 0 && pBindInfos) {
         const uint8_t* infos = (const uint8_t*)pBindInfos;
@@ -2092,20 +3614,25 @@ static VkResult trace_BindBufferMemory2(void* device, uint32_t bindInfoCount,
             uint64_t memory = *(const uint64_t*)(bi + 24);
             uint64_t memOffset = *(const uint64_t*)(bi + 32);
             if (g_bind_buf_mem2_calls <= 5) {
-                LOG("  BBM2[%u]: buf=0x%lx mem=0x%lx off=%lu\n",
+                LOGD(ICD_LC_MEM, "  BBM2[%u]: buf=0x%lx mem=0x%lx off=%lu\n",
                     i, (unsigned long)buffer, (unsigned long)memory, (unsigned long)memOffset);
             }
-            if (g_buf_mem_count < MAX_BUF_MEM) {
-                g_buf_mem[g_buf_mem_count].buffer = buffer;
-                g_buf_mem[g_buf_mem_count].memory = memory;
-                g_buf_mem[g_buf_mem_count].memOffset = memOffset;
-                g_buf_mem_count++;
-            }
+            BufMemEntry bm = { memory, memOffset };
+            hmap_put(&g_buf_mem, buffer, &bm);
         }
     }
     return res;
 }
 
+typedef void (*PFN_vkDestroyBuffer)(void*, uint64_t, const void*);
+static PFN_vkDestroyBuffer real_destroy_buffer = NULL;
+
+static void trace_DestroyBuffer(void* device, uint64_t buffer, const void* pAllocator) {
+    desc_batch_flush();
+    hmap_del(&g_buf_mem, buffer, NULL);
+    real_destroy_buffer(unwrap(device), buffer, pAllocator);
+}
+
 typedef VkResult (*PFN_vkBindImageMemory)(void*, uint64_t, uint64_t, uint64_t);
 static PFN_vkBindImageMemory real_bind_img_mem = NULL;
 
@@ -2113,7 +3640,7 @@ static VkResult trace_BindImageMemory(void* device, uint64_t image,
                                       uint64_t memory, uint64_t offset) {
     void* real = unwrap(device);
     VkResult res = real_bind_img_mem(real, image, memory, offset);
-    LOG("[D%d] vkBindImageMemory: dev=%p img=0x%llx mem=0x%llx result=%d\n",
+    LOGD(ICD_LC_MEM, "[D%d] vkBindImageMemory: dev=%p img=0x%llx mem=0x%llx result=%d\n",
         g_device_count, real, (unsigned long long)image,
         (unsigned long long)memory, res);
     return res;
@@ -2126,7 +3653,7 @@ static VkResult trace_CreateDescriptorSetLayout(void* device, const void* pCreat
                                                 const void* pAllocator, uint64_t* pLayout) {
     void* real = unwrap(device);
     VkResult res = real_create_dsl(real, pCreateInfo, pAllocator, pLayout);
-    LOG("[D%d] vkCreateDescriptorSetLayout: dev=%p result=%d layout=0x%llx\n",
+    LOGD(ICD_LC_DESC, "[D%d] vkCreateDescriptorSetLayout: dev=%p result=%d layout=0x%llx\n",
         g_device_count, real, res, pLayout ? (unsigned long long)*pLayout : 0);
     return res;
 }
@@ -2138,7 +3665,7 @@ static VkResult trace_CreatePipelineLayout(void* device, const void* pCreateInfo
                                            const void* pAllocator, uint64_t* pLayout) {
     void* real = unwrap(device);
     VkResult res = real_create_pl(real, pCreateInfo, pAllocator, pLayout);
-    LOG("[D%d] vkCreatePipelineLayout: dev=%p result=%d layout=0x%llx\n",
+    LOGD(ICD_LC_PIPE, "[D%d] vkCreatePipelineLayout: dev=%p result=%d layout=0x%llx\n",
         g_device_count, real, res, pLayout ? (unsigned long long)*pLayout : 0);
     return res;
 }
@@ -2151,21 +3678,16 @@ static VkResult trace_BeginCommandBuffer(void* cmdBuf, const void* pBeginInfo) {
     void* real = unwrap(cmdBuf);
     /* VkCommandBufferBeginInfo: sType(4)+pad(4)+pNext(8)+flags(4) at offset 16 */
     uint32_t flags = pBeginInfo ? *(const uint32_t*)((const uint8_t*)pBeginInfo + 16) : 0;
+    /* Begin implies the CB is no longer pending: reclaim its BC decode staging */
+    bc_stage_release_cb(real);
     VkResult res = real_begin_cmd_buf(real, pBeginInfo);
-    LOG("[D%d] vkBeginCommandBuffer: cb=%p(real=%p) flags=0x%x%s result=%d\n",
+    LOGT(ICD_LC_CMD, "[D%d] vkBeginCommandBuffer: cb=%p(real=%p) flags=0x%x%s result=%d\n",
         g_device_count, cmdBuf, real, flags,
         (flags & 0x02) ? " RENDER_PASS_CONTINUE(SECONDARY)" : "",
         res);
     /* Track secondary CBs for command replay.
      * RENDER_PASS_CONTINUE_BIT = 0x02 means this is a secondary CB. */
-    if (flags & 0x02) {
-        ReplayCB* rcb = find_replay_cb(cmdBuf, 1);
-        if (rcb) {
-            rcb->wrapped_cb = cmdBuf;
-            rcb->is_secondary = 1;
-            rcb->cmd_count = 0;  /* reset for new recording */
-        }
-    }
+    cb_state_begin(cmdBuf, (flags & 0x02) != 0);
     return res;
 }
 
@@ -2178,15 +3700,13 @@ static VkResult trace_EndCommandBuffer(void* cmdBuf); /* defined below */
 typedef VkResult (*PFN_vkCreateImageView)(void*, const void*, const void*, uint64_t*);
 static PFN_vkCreateImageView real_create_image_view = NULL;
 
-/* Track imageView→image for the last N views (ring buffer) */
-#define IV_TRACK_MAX 256
-static struct { uint64_t view; uint64_t image; } g_iv_track[IV_TRACK_MAX];
-static int g_iv_idx = 0;
+/* Track imageView→image (dropped in vkDestroyImageView) */
+static HandleMap g_iv_track = HMAP_INIT(uint64_t);
 
 static uint64_t iv_lookup_image(uint64_t view) {
-    for (int i = 0; i < IV_TRACK_MAX; i++)
-        if (g_iv_track[i].view == view) return g_iv_track[i].image;
-    return 0;
+    uint64_t image = 0;
+    hmap_get(&g_iv_track, view, &image);
+    return image;
 }
 
 static VkResult trace_CreateImageView(void* device, const void* pCreateInfo,
@@ -2211,32 +3731,40 @@ static VkResult trace_CreateImageView(void* device, const void* pCreateInfo,
     /* If this image was BC-substituted, fix the view format too */
     char ivci_copy[80];
     const void* actual_ci = pCreateInfo;
-    int bc_idx = bc_img_lookup(src_image);
-    if (bc_idx >= 0 && pCreateInfo && is_bc_format(view_fmt)) {
+    BcImageInfo bc;
+    int is_bc = bc_img_lookup(src_image, &bc);
+    if (is_bc && pCreateInfo && is_bc_format(view_fmt)) {
         memcpy(ivci_copy, pCreateInfo, 76); /* VkImageViewCreateInfo is ~76 bytes */
-        *(uint32_t*)(ivci_copy + 36) = g_bc_images[bc_idx].rgba_format;
+        *(uint32_t*)(ivci_copy + 36) = bc.rgba_format;
         actual_ci = ivci_copy;
     }
 
     VkResult res = real_create_image_view(real, actual_ci, pAllocator, pView);
-    if (res == 0 && pView) {
-        g_iv_track[g_iv_idx % IV_TRACK_MAX].view = *pView;
-        g_iv_track[g_iv_idx % IV_TRACK_MAX].image = src_image;
-        g_iv_idx++;
-    }
-    if (bc_idx >= 0) {
-        LOG("[D%d] vkCreateImageView: BC img=0x%llx fmt=%u->%u view=0x%llx result=%d\n",
+    if (res == 0 && pView)
+        hmap_put(&g_iv_track, *pView, &src_image);
+    if (is_bc) {
+        LOGD(ICD_LC_RES, "[D%d] vkCreateImageView: BC img=0x%llx fmt=%u->%u view=0x%llx result=%d\n",
             g_device_count, (unsigned long long)src_image, view_fmt,
-            g_bc_images[bc_idx].rgba_format,
+            bc.rgba_format,
             pView ? (unsigned long long)*pView : 0, res);
     } else {
-        LOG("[D%d] vkCreateImageView: dev=%p img=0x%llx view=0x%llx result=%d\n",
+        LOGD(ICD_LC_RES, "[D%d] vkCreateImageView: dev=%p img=0x%llx view=0x%llx result=%d\n",
             g_device_count, real, (unsigned long long)src_image,
             pView ? (unsigned long long)*pView : 0, res);
     }
     return res;
 }
 
+/* Trace: vkDestroyImageView */
+typedef void (*PFN_vkDestroyImageView)(void*, uint64_t, const void*);
+static PFN_vkDestroyImageView real_destroy_image_view = NULL;
+
+static void trace_DestroyImageView(void* device, uint64_t view, const void* pAllocator) {
+    desc_batch_flush();
+    hmap_del(&g_iv_track, view, NULL);
+    real_destroy_image_view(unwrap(device), view, pAllocator);
+}
+
 /* Trace: vkCreateSampler */
 typedef VkResult (*PFN_vkCreateSampler)(void*, const void*, const void*, uint64_t*);
 static PFN_vkCreateSampler real_create_sampler = NULL;
@@ -2245,7 +3773,7 @@ static VkResult trace_CreateSampler(void* device, const void* pCreateInfo,
                                     const void* pAllocator, uint64_t* pSampler) {
     void* real = unwrap(device);
     VkResult res = real_create_sampler(real, pCreateInfo, pAllocator, pSampler);
-    LOG("[D%d] vkCreateSampler: dev=%p result=%d sampler=0x%llx\n",
+    LOGD(ICD_LC_RES, "[D%d] vkCreateSampler: dev=%p result=%d sampler=0x%llx\n",
         g_device_count, real, res, pSampler ? (unsigned long long)*pSampler : 0);
     return res;
 }
@@ -2254,11 +3782,19 @@ static VkResult trace_CreateSampler(void* device, const void* pCreateInfo,
 typedef VkResult (*PFN_vkCreateShaderModule)(void*, const void*, const void*, uint64_t*);
 static PFN_vkCreateShaderModule real_create_shader_module = NULL;
 
-/* Forward declarations for Mali SPIR-V fix passes (defined below, ~line 3700+) */
-static int strip_clip_distance_spirv(uint32_t* code, uint64_t codeSize);
-static int fix_mali_spirv(uint32_t* code, uint64_t codeSize);
-static uint32_t* add_mali_shift_barriers(const uint32_t* code, uint64_t codeSize,
-                                          uint64_t* outSize, int* nBarriersOut);
+/* Mali SPIR-V fixups: "SPIR-V Rewriter" and "SPIR-V Fixup Cache" (defined below) */
+typedef struct ScaledRemapInfo ScaledRemapInfo;
+static const uint32_t* spv_rewrite(const uint32_t* code, uint64_t size,
+                                   const ScaledRemapInfo* remap,
+                                   uint64_t* out_size, int* fixes);
+static uint64_t spv_cache_key(const uint32_t* code, uint64_t size, const ScaledRemapInfo* remap);
+static int spv_cache_get(uint64_t key, const uint32_t* in, uint64_t in_size,
+                         const ScaledRemapInfo* remap,
+                         const uint32_t** out, uint64_t* out_size, int* fixes);
+static void spv_cache_put(uint64_t key, const uint32_t* in, uint64_t in_size,
+                          const ScaledRemapInfo* remap,
+                          const uint32_t* code, uint64_t out_size, int fixes);
+static void pcache_note_module(uint64_t module, uint64_t code_hash);  /* "Pipeline Cache" */
 
 static VkResult trace_CreateShaderModule(void* device, const void* pCreateInfo,
                                          const void* pAllocator, uint64_t* pModule) {
@@ -2280,76 +3816,48 @@ static VkResult trace_CreateShaderModule(void* device, const void* pCreateInfo,
         if (f) {
             fwrite(pCode, 1, codeSize, f);
             fclose(f);
-            LOG("[D%d] SHADER-DUMP: %s (%u words, %lu bytes)\n",
+            LOGD(ICD_LC_SHADER, "[D%d] SHADER-DUMP: %s (%u words, %lu bytes)\n",
                 g_device_count, fname, wordCount, (unsigned long)codeSize);
             shader_dump_count++;
         }
     }
 
     /* ==== Apply Mali SPIR-V fixes ==== */
-    uint32_t* mutableCode = NULL;
+    const uint32_t* fixedCode = NULL;
     uint64_t effectiveSize = codeSize;
     uint8_t patched_ci[40];
     const void* moduleCI = pCreateInfo;
+    uint64_t spv_key = 0;
 
     if (pCode && codeSize > 20) {
-        mutableCode = (uint32_t*)malloc(codeSize);
-        if (mutableCode) {
-            memcpy(mutableCode, pCode, codeSize);
-            int total_fixes = 0;
-
-            /* Fix 1: Strip ClipDistance/CullDistance (Mali unsupported) */
-            {
-                int n_strip = strip_clip_distance_spirv(mutableCode, effectiveSize);
-                if (n_strip > 0) {
-                    total_fixes += n_strip;
-                    LOG("[D%d] MALI-FIX(CSM): stripped %d ClipDistance/CullDistance\n",
-                        g_device_count, n_strip);
-                }
-            }
-            /* Fix 2: OpConstantComposite → OpSpecConstantComposite */
-            {
-                int n_composite = fix_mali_spirv(mutableCode, effectiveSize);
-                if (n_composite > 0) {
-                    total_fixes += n_composite;
-                    LOG("[D%d] MALI-FIX(CSM): fixed %d ConstantComposite→Spec\n",
-                        g_device_count, n_composite);
-                }
-            }
-            /* Fix 3: Shift optimization barriers */
-            {
-                uint64_t barrierSize = 0;
-                int nBarriers = 0;
-                uint32_t* barrierCode = add_mali_shift_barriers(
-                    mutableCode, effectiveSize, &barrierSize, &nBarriers);
-                if (barrierCode) {
-                    free(mutableCode);
-                    mutableCode = barrierCode;
-                    effectiveSize = barrierSize;
-                    total_fixes += nBarriers;
-                    LOG("[D%d] MALI-FIX(CSM): added %d shift barriers (%lu→%lu bytes)\n",
-                        g_device_count, nBarriers,
-                        (unsigned long)codeSize, (unsigned long)barrierSize);
-                }
-            }
+        spv_key = spv_cache_key(pCode, codeSize, NULL);
+        int total_fixes = 0;
+        if (spv_cache_get(spv_key, pCode, codeSize, NULL, &fixedCode, &effectiveSize, &total_fixes)) {
+            LOGD(ICD_LC_SHADER, "[D%d] MALI-FIX(CSM): cache hit, %d fixes\n",
+                g_device_count, total_fixes);
+        } else {
+            fixedCode = spv_rewrite(pCode, codeSize, NULL, &effectiveSize, &total_fixes);
+            if (total_fixes >= 0)
+                spv_cache_put(spv_key, pCode, codeSize, NULL, fixedCode, effectiveSize, total_fixes);
+            else
+                total_fixes = 0;
+        }
 
-            if (total_fixes > 0) {
-                /* Build modified VkShaderModuleCreateInfo with patched SPIR-V */
-                memcpy(patched_ci, pCreateInfo, 40);
-                *(uint64_t*)(patched_ci + 24) = effectiveSize;
-                *(const uint32_t**)(patched_ci + 32) = mutableCode;
-                moduleCI = patched_ci;
-                LOG("[D%d] MALI-FIX(CSM): %d total fixes applied (%u words)\n",
-                    g_device_count, total_fixes, wordCount);
-            }
+        if (total_fixes > 0 && fixedCode) {
+            /* Build modified VkShaderModuleCreateInfo with patched SPIR-V */
+            memcpy(patched_ci, pCreateInfo, 40);
+            *(uint64_t*)(patched_ci + 24) = effectiveSize;
+            *(const uint32_t**)(patched_ci + 32) = fixedCode;
+            moduleCI = patched_ci;
+            LOGD(ICD_LC_SHADER, "[D%d] MALI-FIX(CSM): %d total fixes applied (%u words)\n",
+                g_device_count, total_fixes, wordCount);
         }
     }
 
     VkResult res = real_create_shader_module(real, moduleCI, pAllocator, pModule);
-    LOG("[D%d] vkCreateShaderModule: dev=%p result=%d module=0x%llx words=%u\n",
+    if (res == 0 && pModule) pcache_note_module(*pModule, spv_key);
+    LOGD(ICD_LC_SHADER, "[D%d] vkCreateShaderModule: dev=%p result=%d module=0x%llx words=%u\n",
         g_device_count, real, res, pModule ? (unsigned long long)*pModule : 0, wordCount);
-
-    if (mutableCode) free(mutableCode);
     return res;
 }
 
@@ -2439,7 +3947,7 @@ static void converter_CmdPipelineBarrier2(void* cmdBuf, const void* pDependencyI
                 bufCount = *(const uint32_t*)(di + 32);
                 imgCount = *(const uint32_t*)(di + 48);
             }
-            LOG("[CMD#%d] Barrier2 PASSTHROUGH: cb=%p mem=%u buf=%u img=%u\n",
+            LOGT(ICD_LC_CMD, "[CMD#%d] Barrier2 PASSTHROUGH: cb=%p mem=%u buf=%u img=%u\n",
                 op, real, memCount, bufCount, imgCount);
         }
         real_cmd_pipeline_barrier2(real, pDependencyInfo);
@@ -2520,14 +4028,14 @@ static void converter_CmdPipelineBarrier2(void* cmdBuf, const void* pDependencyI
     if (!dstStages) dstStages = 0x2000; /* BOTTOM_OF_PIPE */
 
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] Barrier2->v1: cb=%p src=0x%x dst=0x%x dep=0x%x mem=%u buf=%u img=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] Barrier2->v1: cb=%p src=0x%x dst=0x%x dep=0x%x mem=%u buf=%u img=%u\n",
         op, real, srcStages, dstStages, depFlags, memCount, bufCount, imgCount);
     /* Log image barrier layout transitions (first 4) to diagnose rendering */
     for (uint32_t i = 0; i < imgCount && i < 4; i++) {
         uint32_t old_l = *(uint32_t*)(imgV1 + i * 72 + 24);
         uint32_t new_l = *(uint32_t*)(imgV1 + i * 72 + 28);
         uint64_t img_h = *(uint64_t*)(imgV1 + i * 72 + 40);
-        LOG("[CMD#%d]   img[%u] 0x%llx layout %u->%u\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d]   img[%u] 0x%llx layout %u->%u\n",
             op, i, (unsigned long long)img_h, old_l, new_l);
     }
 
@@ -2569,7 +4077,7 @@ static void trace_CmdCopyBuffer(void* cmdBuf, uint64_t srcBuf, uint64_t dstBuf,
                 static int staging_dump = 0;
                 staging_dump++;
                 if (staging_dump <= 10) {
-                    LOG("[CMD#%d] STAGING-CB: src=0x%llx dst=0x%llx srcOff=%lu dstOff=%lu sz=%lu -> SSBO[0] staging_ptr=%p\n",
+                    LOGT(ICD_LC_CMD, "[CMD#%d] STAGING-CB: src=0x%llx dst=0x%llx srcOff=%lu dstOff=%lu sz=%lu -> SSBO[0] staging_ptr=%p\n",
                         op, (unsigned long long)srcBuf, (unsigned long long)dstBuf,
                         (unsigned long)srcOff, (unsigned long)dstOff, (unsigned long)sz, staging_ptr);
                     if (staging_ptr) {
@@ -2578,7 +4086,7 @@ static void trace_CmdCopyBuffer(void* cmdBuf, uint64_t srcBuf, uint64_t dstBuf,
                         uint32_t nw = g_ssbo0_range / 4;
                         if (nw > 64) nw = 64;
                         for (uint32_t wi = 0; wi < nw; wi += 4) {
-                            LOG("  CB[%2u]: %08x(%g) %08x(%g) %08x(%g) %08x(%g)\n",
+                            LOGT(ICD_LC_CMD, "  CB[%2u]: %08x(%g) %08x(%g) %08x(%g) %08x(%g)\n",
                                 wi, u[wi], f[wi], u[wi+1], f[wi+1],
                                 u[wi+2], f[wi+2], u[wi+3], f[wi+3]);
                         }
@@ -2589,11 +4097,24 @@ static void trace_CmdCopyBuffer(void* cmdBuf, uint64_t srcBuf, uint64_t dstBuf,
     }
 
     if (copy_log <= 50)
-        LOG("[CMD#%d] CmdCopyBuffer: cb=%p src=0x%llx dst=0x%llx regions=%u\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdCopyBuffer: cb=%p src=0x%llx dst=0x%llx regions=%u\n",
             op, real, (unsigned long long)srcBuf, (unsigned long long)dstBuf, regionCount);
+    cb_state_note_write(cmdBuf, dstBuf);
     real_cmd_copy_buffer(real, srcBuf, dstBuf, regionCount, pRegions);
 }
 
+/* --- CmdCopyBuffer2 (Vulkan 1.3 / KHR) ---
+ * VkCopyBufferInfo2: sType+pNext, srcBuffer at 16, dstBuffer at 24.
+ * Only tracked for the BC GPU decoder. */
+typedef void (*PFN_vkCmdCopyBuffer2)(void*, const void*);
+static PFN_vkCmdCopyBuffer2 real_cmd_copy_buffer2 = NULL;
+
+static void trace_CmdCopyBuffer2(void* cmdBuf, const void* pCopyInfo) {
+    if (pCopyInfo)
+        cb_state_note_write(cmdBuf, *(const uint64_t*)((const uint8_t*)pCopyInfo + 24));
+    real_cmd_copy_buffer2(unwrap(cmdBuf), pCopyInfo);
+}
+
 /* --- CmdCopyBufferToImage --- */
 typedef void (*PFN_vkCmdCopyBufToImg)(void*, uint64_t, uint64_t, uint32_t, uint32_t, const void*);
 static PFN_vkCmdCopyBufToImg real_cmd_copy_buf_to_img = NULL;
@@ -2602,6 +4123,11 @@ static PFN_vkCmdCopyBufToImg real_cmd_copy_buf_to_img = NULL;
 typedef void (*PFN_vkCmdClearColorImage)(void*, uint64_t, uint32_t, const void*, uint32_t, const void*);
 static PFN_vkCmdClearColorImage real_cmd_clear_color;
 
+static int bc_upload(void* real_cb, uint64_t buffer, uint64_t image, uint32_t layout,
+                     const BcImageInfo* bc, uint32_t regionCount,
+                     const uint8_t* regions, uint32_t stride,
+                     int src_written);  /* "BCn Decode" */
+
 static void trace_CmdCopyBufferToImage(void* cmdBuf, uint64_t buffer, uint64_t image,
                                          uint32_t imageLayout, uint32_t regionCount,
                                          const void* pRegions) {
@@ -2609,12 +4135,18 @@ static void trace_CmdCopyBufferToImage(void* cmdBuf, uint64_t buffer, uint64_t i
     int op = ++g_cmd_op_count;
 
     /* BC-substituted images: buffer has BC data but image is RGBA8.
-     * Can't copy directly. Instead clear to MAGENTA so we can check if
-     * geometry is correct (vertex position test). */
-    int bc_idx = bc_img_lookup(image);
-    if (bc_idx >= 0) {
+     * Decode on the CPU and copy RGBA instead. If that isn't possible
+     * (BC6H, unmapped source, ICD_BC_DECODE=0) clear to MAGENTA so the
+     * texture is at least visibly wrong rather than garbage. */
+    BcImageInfo bc;
+    if (bc_img_lookup(image, &bc)) {
+        if (bc_upload(real, buffer, image, imageLayout, &bc, regionCount,
+                      (const uint8_t*)pRegions, 56, cb_state_wrote(cmdBuf, buffer)))
+            return;
         static int bc_clear_count = 0;
         bc_clear_count++;
+        if (is_etc2_format(bc.rgba_format))
+            return; /* compressed: can't be cleared, leave it undefined */
         /* Lazily resolve CmdClearColorImage if not yet captured by GDPA */
         if (!real_cmd_clear_color && thunk_lib)
             real_cmd_clear_color = (PFN_vkCmdClearColorImage)dlsym(thunk_lib, "vkCmdClearColorImage");
@@ -2632,13 +4164,13 @@ static void trace_CmdCopyBufferToImage(void* cmdBuf, uint64_t buffer, uint64_t i
             real_cmd_clear_color(real, image, 7, clearColor, 1, range);
         }
         if (bc_clear_count <= 5) {
-            LOG("[CMD#%d] CmdCopyBufToImg: BC img=0x%llx cleared MAGENTA (bc_fmt=%u, #%d)\n",
-                op, (unsigned long long)image, g_bc_images[bc_idx].bc_format, bc_clear_count);
+            LOGT(ICD_LC_CMD, "[CMD#%d] CmdCopyBufToImg: BC img=0x%llx cleared MAGENTA (bc_fmt=%u, #%d)\n",
+                op, (unsigned long long)image, bc.bc_format, bc_clear_count);
         }
         return; /* skip the actual copy */
     }
 
-    LOG("[CMD#%d] CmdCopyBufferToImage: cb=%p buf=0x%llx img=0x%llx layout=%u regions=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdCopyBufferToImage: cb=%p buf=0x%llx img=0x%llx layout=%u regions=%u\n",
         op, real, (unsigned long long)buffer, (unsigned long long)image,
         imageLayout, regionCount);
     real_cmd_copy_buf_to_img(real, buffer, image, imageLayout, regionCount, pRegions);
@@ -2665,24 +4197,31 @@ static void trace_CmdCopyBufferToImage2(void* cmdBuf, const void* pCopyInfo) {
     if (pCopyInfo)
         dst_image = *(const uint64_t*)((const char*)pCopyInfo + 24);
 
-    int bc_idx = bc_img_lookup(dst_image);
-    if (bc_idx >= 0) {
+    BcImageInfo bc;
+    if (bc_img_lookup(dst_image, &bc)) {
+        /* VkBufferImageCopy2: sType+pNext, then the VkBufferImageCopy body */
+        const uint8_t* ci = (const uint8_t*)pCopyInfo;
+        const uint8_t* regions = *(const uint8_t* const*)(ci + 40);
+        uint64_t src = *(const uint64_t*)(ci + 16);
+        if (regions && bc_upload(real, src, dst_image, *(const uint32_t*)(ci + 32), &bc,
+                                 *(const uint32_t*)(ci + 36), regions + 16, 72,
+                                 cb_state_wrote(cmdBuf, src)))
+            return;
         static int bc_skip_count2 = 0;
         bc_skip_count2++;
         if (bc_skip_count2 <= 10) {
-            LOG("[CMD#%d] CmdCopyBufferToImage2: SKIP BC img=0x%llx (bc_fmt=%u, #%d)\n",
-                op, (unsigned long long)dst_image, g_bc_images[bc_idx].bc_format, bc_skip_count2);
+            LOGT(ICD_LC_CMD, "[CMD#%d] CmdCopyBufferToImage2: SKIP BC img=0x%llx (bc_fmt=%u, #%d)\n",
+                op, (unsigned long long)dst_image, bc.bc_format, bc_skip_count2);
         }
         return; /* skip — BC data can't be copied into RGBA image */
     }
 
-    LOG("[CMD#%d] CmdCopyBufferToImage2: cb=%p img=0x%llx\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdCopyBufferToImage2: cb=%p img=0x%llx\n",
         op, real, (unsigned long long)dst_image);
     real_cmd_copy_buf_to_img2(real, pCopyInfo);
 }
 
 /* real_cmd_clear_color already forward-declared above CmdCopyBufferToImage */
-static uint64_t g_last_render_image = 0;
 
 /* --- CmdCopyImageToBuffer --- */
 typedef void (*PFN_vkCmdCopyImgToBuf)(void*, uint64_t, uint32_t, uint64_t, uint32_t, const void*);
@@ -2692,45 +4231,17 @@ static PFN_vkCmdCopyImgToBuf real_cmd_copy_img_to_buf = NULL;
  * to verify the copy pipeline works. If staging reads red, the pipeline
  * works but DXVK renders black. If staging reads zero, pipeline is broken. */
 static int g_citb_diag_done = 0;
-static void* g_last_render_cb = NULL; /* wrapped CB handle that last called CmdBeginRendering */
-
-/* --- Per-CB render pass tracking ---
- * Track which command buffers are currently inside a render pass.
- * CmdBeginRendering sets the flag, CmdEndRendering clears it.
- * CmdDrawIndexed checks the flag to detect draws outside render pass. */
-#define MAX_CB_TRACK 64
-static struct {
-    void* cb_real;       /* unwrapped CB handle */
-    int   in_render_pass;
-    uint32_t rp_w, rp_h; /* render area from CmdBeginRendering */
-} g_cb_state[MAX_CB_TRACK];
-static int g_cb_state_count = 0;
-
-static int cb_state_idx(void* real) {
-    for (int i = 0; i < g_cb_state_count; i++)
-        if (g_cb_state[i].cb_real == real) return i;
-    if (g_cb_state_count < MAX_CB_TRACK) {
-        int idx = g_cb_state_count++;
-        g_cb_state[idx].cb_real = real;
-        g_cb_state[idx].in_render_pass = 0;
-        return idx;
-    }
-    return -1;
-}
 
 /* --- Pipeline VIS cache ---
  * Track vertex input state per pipeline for draw-time binding checks. */
-#define MAX_PIPE_CACHE 256
-static struct {
-    uint64_t pipeline;
+typedef struct {
     uint32_t bindingCount;
     uint32_t strides[8];
     uint32_t bindingSlots[8]; /* actual binding slot numbers */
-} g_pipe_vis[MAX_PIPE_CACHE];
-static int g_pipe_vis_count = 0;
+} PipeVis;
 
-/* Currently bound pipeline handle (set by CmdBindPipeline) */
-static uint64_t g_cur_pipeline = 0;
+/* pipeline → PipeVis; dropped in vkDestroyPipeline */
+static HandleMap g_pipe_vis = HMAP_INIT(PipeVis);
 
 /* Forward declare EDS function pointer array (defined at file scope before wrapped_GDPA).
  * Used by trace_CmdDrawIndexed to inject dynamic state into secondary CBs. */
@@ -2742,7 +4253,7 @@ static void trace_CmdCopyImageToBuffer(void* cmdBuf, uint64_t image, uint32_t im
                                          const void* pRegions) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdCopyImageToBuffer: cb=%p img=0x%llx layout=%u buf=0x%llx regions=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdCopyImageToBuffer: cb=%p img=0x%llx layout=%u buf=0x%llx regions=%u\n",
         op, real, (unsigned long long)image, imageLayout,
         (unsigned long long)buffer, regionCount);
 
@@ -2759,15 +4270,16 @@ static void trace_CmdCopyImageToBuffer(void* cmdBuf, uint64_t image, uint32_t im
         if (thunk_lib)
             fn_fill = (PFN_CmdFillBuf)dlsym(thunk_lib, "vkCmdFillBuffer");
         if (fn_fill) {
-            LOG("[DIAG] CmdFillBuffer 0xDEADBEEF → buf=0x%llx (BEFORE copy, frame %d)\n",
+            LOGT(ICD_LC_CMD, "[DIAG] CmdFillBuffer 0xDEADBEEF → buf=0x%llx (BEFORE copy, frame %d)\n",
                 (unsigned long long)buffer, citb_count);
             /* Fill entire buffer with 0xDEADBEEF — this is a GPU command in the same CB */
             fn_fill(real, buffer, 0, (uint64_t)-1, 0xDEADBEEF);
         } else {
-            LOG("[DIAG] Could not resolve vkCmdFillBuffer!\n");
+            LOGT(ICD_LC_CMD, "[DIAG] Could not resolve vkCmdFillBuffer!\n");
         }
     }
 
+    cb_state_note_write(cmdBuf, buffer);
     real_cmd_copy_img_to_buf(real, image, imageLayout, buffer, regionCount, pRegions);
 }
 
@@ -2779,7 +4291,7 @@ static void trace_CmdClearColorImage(void* cmdBuf, uint64_t image, uint32_t layo
                                       const void* pRanges) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdClearColorImage: cb=%p img=0x%llx layout=%u ranges=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdClearColorImage: cb=%p img=0x%llx layout=%u ranges=%u\n",
         op, real, (unsigned long long)image, layout, rangeCount);
     real_cmd_clear_color(real, image, layout, pColor, rangeCount, pRanges);
 }
@@ -2793,7 +4305,7 @@ static void trace_CmdClearDepthStencilImage(void* cmdBuf, uint64_t image, uint32
                                               const void* pRanges) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdClearDepthStencilImage: cb=%p img=0x%llx layout=%u ranges=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdClearDepthStencilImage: cb=%p img=0x%llx layout=%u ranges=%u\n",
         op, real, (unsigned long long)image, layout, rangeCount);
     real_cmd_clear_ds(real, image, layout, pDepthStencil, rangeCount, pRanges);
 }
@@ -2842,19 +4354,17 @@ static void trace_CmdBeginRendering(void* cmdBuf, const void* pRenderingInfo) {
             att0_src_img = iv_lookup_image(att0_view);
         }
     }
-    LOG("[CMD#%d] CmdBeginRendering: cb=%p %ux%u colorAtts=%u view=0x%llx img=0x%llx\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdBeginRendering: cb=%p %ux%u colorAtts=%u view=0x%llx img=0x%llx\n",
         op, real, w, h, colorCount,
         (unsigned long long)att0_view, (unsigned long long)att0_src_img);
-    /* Save for diagnostics */
-    g_last_render_image = att0_src_img;
-    g_last_render_cb = cmdBuf;
     /* Track per-CB render pass state */
     {
-        int idx = cb_state_idx(real);
-        if (idx >= 0) {
-            g_cb_state[idx].in_render_pass = 1;
-            g_cb_state[idx].rp_w = w;
-            g_cb_state[idx].rp_h = h;
+        CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+        if (cbs) {
+            cbs->render_image = att0_src_img;
+            cbs->in_render_pass = 1;
+            cbs->rp_w = w;
+            cbs->rp_h = h;
         }
     }
     real_cmd_begin_rendering(real, pRenderingInfo);
@@ -2875,20 +4385,19 @@ static void trace_CmdEndRendering(void* cmdBuf) {
         real_cmd_clear_color = (PFN_vkCmdClearColorImage)dlsym(thunk_lib, "vkCmdClearColorImage");
 
     /* Track per-CB render pass state */
-    {
-        int idx = cb_state_idx(real);
-        if (idx >= 0) g_cb_state[idx].in_render_pass = 0;
-    }
+    CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+    if (cbs) cbs->in_render_pass = 0;
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdEndRendering: cb=%p img=0x%llx\n",
-        op, real, (unsigned long long)g_last_render_image);
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdEndRendering: cb=%p img=0x%llx\n",
+        op, real, (unsigned long long)(cbs ? cbs->render_image : 0));
 }
 
 /* ---- EndCommandBuffer ---- */
 static VkResult trace_EndCommandBuffer(void* cmdBuf) {
     void* real = unwrap(cmdBuf);
+    bc_gpu_end_cb(real);
     VkResult res = real_end_cmd_buf(real);
-    LOG("[D%d] vkEndCommandBuffer: cmdBuf=%p(real=%p) result=%d\n",
+    LOGT(ICD_LC_CMD, "[D%d] vkEndCommandBuffer: cmdBuf=%p(real=%p) result=%d\n",
         g_device_count, cmdBuf, real, res);
     return res;
 }
@@ -2900,69 +4409,46 @@ static PFN_vkCmdBindPipeline real_cmd_bind_pipeline = NULL;
 static void trace_CmdBindPipeline(void* cmdBuf, uint32_t bindPoint, uint64_t pipeline) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdBindPipeline: cb=%p bindPoint=%u(%s) pipeline=0x%llx\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdBindPipeline: cb=%p bindPoint=%u(%s) pipeline=0x%llx\n",
         op, real, bindPoint,
         bindPoint == 0 ? "GRAPHICS" : bindPoint == 1 ? "COMPUTE" : "RAYTRACE",
         (unsigned long long)pipeline);
     if (bindPoint == 0) {
-        g_cur_pipeline = pipeline;
+        CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+        if (cbs) cbs->pipeline = pipeline;
     }
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_BIND_PIPELINE);
-        if (cmd) { cmd->pipe.bindPoint = bindPoint; cmd->pipe.pipeline = pipeline; }
+        RcBindPipeline* cmd = replay_emit(cmdBuf, RCMD_BIND_PIPELINE, sizeof(*cmd));
+        if (cmd) { cmd->bindPoint = bindPoint; cmd->pipeline = pipeline; }
     }
     real_cmd_bind_pipeline(real, bindPoint, pipeline);
 }
 
-/* --- Per-CB vertex buffer tracking for readback --- */
-#define MAX_VB_SLOTS 8
-typedef struct {
-    uint64_t buffer;
-    uint64_t offset;
-    uint64_t size;
-    uint64_t stride;
-    int      bound; /* set to 1 when VB2 binds this slot */
-} VBSlotInfo;
-static VBSlotInfo g_last_vb[MAX_VB_SLOTS];  /* most recently bound VB per slot */
-static uint32_t g_last_vb_max = 0; /* highest bound slot + 1 */
-
-/* --- Index buffer tracking for readback --- */
-static uint64_t g_last_ib_buf = 0;
-static uint64_t g_last_ib_off = 0;
-static uint32_t g_last_ib_type = 0; /* 0=UINT16, 1=UINT32 */
-
 /* --- Per-descriptor-set UBO tracking (from vkUpdateDescriptorSets type=6) --- */
-#define MAX_LAST_UBO 16
-typedef struct {
-    uint64_t buffer;
-    uint64_t offset;
-    uint64_t range;
-} LastUboEntry;
 
-/* Map descriptor set handle → UBO bindings */
-#define MAX_SET_UBO_TRACK 512
+/* Map descriptor set handle → UBO bindings. Sets are recycled by their pools,
+ * so entries are overwritten in place when a handle comes back. */
 typedef struct {
-    uint64_t set_handle;
     LastUboEntry ubos[MAX_LAST_UBO];
     int ubo_count;
 } SetUboTrack;
-static SetUboTrack g_set_ubo_track[MAX_SET_UBO_TRACK];
-static int g_set_ubo_track_count = 0;
-
-/* Currently bound UBOs (updated at CmdBindDescriptorSets from set→UBO map) */
-static LastUboEntry g_last_ubo[MAX_LAST_UBO];
-static int g_last_ubo_count = 0;
-
-/* Last viewport/scissor values for 576-draw diagnostics */
-static float g_last_viewport[6] = {0}; /* x, y, w, h, minD, maxD */
-static uint32_t g_last_scissor[4] = {0}; /* x, y, w, h */
-static uint32_t g_last_viewport_set = 0;
+static HandleMap g_set_ubo_track = HMAP_INIT(SetUboTrack);
 
-/* Last push constant data for diagnostics */
-static uint8_t g_last_pc_data[256];
-static uint32_t g_last_pc_size = 0;
-static uint32_t g_last_pc_stages = 0;
+static void set_ubo_track(uint64_t set, uint32_t binding,
+                          uint64_t buf, uint64_t off, uint64_t range) {
+    if (binding >= MAX_LAST_UBO) return;
+    hmap_wrlock(&g_set_ubo_track);
+    SetUboTrack* t = (SetUboTrack*)hmap_insert_locked(&g_set_ubo_track, set);
+    if (t) {
+        t->ubos[binding].buffer = buf;
+        t->ubos[binding].offset = off;
+        t->ubos[binding].range = range;
+        if ((int)(binding + 1) > t->ubo_count)
+            t->ubo_count = binding + 1;
+    }
+    hmap_unlock(&g_set_ubo_track);
+}
 
 /* --- CmdDraw --- */
 typedef void (*PFN_vkCmdDraw)(void*, uint32_t, uint32_t, uint32_t, uint32_t);
@@ -2972,17 +4458,12 @@ static void trace_CmdDraw(void* cmdBuf, uint32_t vertexCount, uint32_t instanceC
                            uint32_t firstVertex, uint32_t firstInstance) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdDraw: cb=%p verts=%u inst=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdDraw: cb=%p verts=%u inst=%u\n",
         op, real, vertexCount, instanceCount);
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_DRAW);
-        if (cmd) {
-            cmd->draw.vertexCount = vertexCount;
-            cmd->draw.instanceCount = instanceCount;
-            cmd->draw.firstVertex = firstVertex;
-            cmd->draw.firstInstance = firstInstance;
-        }
+        RcDraw* cmd = replay_emit(cmdBuf, RCMD_DRAW, sizeof(*cmd));
+        if (cmd) *cmd = (RcDraw){ vertexCount, instanceCount, firstVertex, firstInstance };
     }
     real_cmd_draw(real, vertexCount, instanceCount, firstVertex, firstInstance);
 }
@@ -2998,22 +4479,19 @@ static void trace_CmdDrawIndexed(void* cmdBuf, uint32_t indexCount, uint32_t ins
                                   uint32_t firstInstance) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
+    const CmdBufState* cbs = cb_state_peek(cmdBuf);
     static int di_diag_count = 0;
     di_diag_count++;
 
-    LOG("[CMD#%d] CmdDrawIndexed: cb=%p indices=%u firstIdx=%u inst=%u vtxOff=%d\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdDrawIndexed: cb=%p indices=%u firstIdx=%u inst=%u vtxOff=%d\n",
         op, real, indexCount, firstIndex, instanceCount, vertexOffset);
 
     /* === DIAGNOSTIC: Read back VB, IB, and UBO data at draw time === */
     /* Focus on 3D MESH draws (bCount>=2 pipeline) — these are the exploded ones.
      * HUD draws (bCount=1, stride=24) render correctly. */
-    int cur_pipe_bcount = 0;
-    for (int p = 0; p < g_pipe_vis_count; p++) {
-        if (g_pipe_vis[p].pipeline == g_cur_pipeline) {
-            cur_pipe_bcount = g_pipe_vis[p].bindingCount;
-            break;
-        }
-    }
+    PipeVis cur_vis = {0};
+    hmap_get(&g_pipe_vis, cbs->pipeline, &cur_vis);
+    int cur_pipe_bcount = (int)cur_vis.bindingCount;
     static int mesh_draw_diag = 0;
     static int hud_draw_diag = 0;
     int do_diag = 0;
@@ -3027,37 +4505,37 @@ static void trace_CmdDrawIndexed(void* cmdBuf, uint32_t indexCount, uint32_t ins
     }
     if (do_diag) {
         /* 1. Index buffer readback */
-        if (g_last_ib_buf) {
-            void* ib_ptr = lookup_ubo_ptr(g_last_ib_buf, g_last_ib_off);
+        if (cbs->ib_buf) {
+            void* ib_ptr = lookup_ubo_ptr(cbs->ib_buf, cbs->ib_off);
             if (ib_ptr) {
                 uint32_t n = indexCount < 12 ? indexCount : 12;
-                if (g_last_ib_type == 0) { /* UINT16 */
+                if (cbs->ib_type == 0) { /* UINT16 */
                     uint16_t* idx = (uint16_t*)ib_ptr;
                     char buf[256]; int pos = 0;
                     for (uint32_t i = 0; i < n; i++)
                         pos += snprintf(buf + pos, sizeof(buf) - pos, "%u ", idx[firstIndex + i]);
-                    LOG("  IB-READBACK(u16, n=%u): %s\n", indexCount, buf);
+                    LOGT(ICD_LC_CMD, "  IB-READBACK(u16, n=%u): %s\n", indexCount, buf);
                 } else { /* UINT32 */
                     uint32_t* idx = (uint32_t*)ib_ptr;
                     char buf[256]; int pos = 0;
                     for (uint32_t i = 0; i < n; i++)
                         pos += snprintf(buf + pos, sizeof(buf) - pos, "%u ", idx[firstIndex + i]);
-                    LOG("  IB-READBACK(u32, n=%u): %s\n", indexCount, buf);
+                    LOGT(ICD_LC_CMD, "  IB-READBACK(u32, n=%u): %s\n", indexCount, buf);
                 }
             } else {
-                LOG("  IB-READBACK: FAILED buf=0x%lx off=%lu\n",
-                    (unsigned long)g_last_ib_buf, (unsigned long)g_last_ib_off);
+                LOGT(ICD_LC_CMD, "  IB-READBACK: FAILED buf=0x%lx off=%lu\n",
+                    (unsigned long)cbs->ib_buf, (unsigned long)cbs->ib_off);
             }
         }
 
         /* 2. Vertex buffer slot 0 readback — read vertices referenced by indices */
-        if (g_last_vb[0].bound && g_last_vb[0].buffer) {
-            uint64_t stride = g_last_vb[0].stride;
+        if (cbs->vb[0].bound && cbs->vb[0].buffer) {
+            uint64_t stride = cbs->vb[0].stride;
             if (stride == 0) stride = 24; /* fallback to baked stride */
-            void* vb_base = lookup_ubo_ptr(g_last_vb[0].buffer, g_last_vb[0].offset);
+            void* vb_base = lookup_ubo_ptr(cbs->vb[0].buffer, cbs->vb[0].offset);
             if (vb_base) {
-                LOG("  VB0: buf=0x%lx off=%lu stride=%lu base=%p vtxOff=%d\n",
-                    (unsigned long)g_last_vb[0].buffer, (unsigned long)g_last_vb[0].offset,
+                LOGT(ICD_LC_CMD, "  VB0: buf=0x%lx off=%lu stride=%lu base=%p vtxOff=%d\n",
+                    (unsigned long)cbs->vb[0].buffer, (unsigned long)cbs->vb[0].offset,
                     (unsigned long)stride, vb_base, vertexOffset);
                 /* Read first 6 vertices — mesh has stride=56 so position is XYZW at offset 0 */
                 uint32_t n = 6;
@@ -3073,121 +4551,117 @@ static void trace_CmdDrawIndexed(void* cmdBuf, uint32_t indexCount, uint32_t ins
                         float pw = *(float*)(base + 12);
                         float u = *(float*)(base + 48);
                         float v2 = *(float*)(base + 52);
-                        LOG("  VB[%d]: pos=(%.4f,%.4f,%.4f,%.4f) uv=(%.4f,%.4f)\n",
+                        LOGT(ICD_LC_CMD, "  VB[%d]: pos=(%.4f,%.4f,%.4f,%.4f) uv=(%.4f,%.4f)\n",
                             vi, px, py, pz, pw, u, v2);
                     } else {
-                        LOG("  VB[%d]: f0=%.4f f1=%.4f f2=%.4f f3=%.4f f4=%.4f f5=%.4f\n",
+                        LOGT(ICD_LC_CMD, "  VB[%d]: f0=%.4f f1=%.4f f2=%.4f f3=%.4f f4=%.4f f5=%.4f\n",
                             vi, f[0], f[1], f[2], f[3], f[4], f[5]);
                     }
                 }
             } else {
-                LOG("  VB-READBACK: FAILED buf=0x%lx off=%lu\n",
-                    (unsigned long)g_last_vb[0].buffer, (unsigned long)g_last_vb[0].offset);
+                LOGT(ICD_LC_CMD, "  VB-READBACK: FAILED buf=0x%lx off=%lu\n",
+                    (unsigned long)cbs->vb[0].buffer, (unsigned long)cbs->vb[0].offset);
             }
         } else {
-            LOG("  VB-READBACK: slot 0 not bound (bound=%d buf=0x%lx)\n",
-                g_last_vb[0].bound, (unsigned long)g_last_vb[0].buffer);
+            LOGT(ICD_LC_CMD, "  VB-READBACK: slot 0 not bound (bound=%d buf=0x%lx)\n",
+                cbs->vb[0].bound, (unsigned long)cbs->vb[0].buffer);
         }
 
         /* 2b. Instance buffer (binding 1) readback — 4x4 transform matrix */
-        if (g_last_vb[1].bound && g_last_vb[1].buffer) {
-            uint64_t inst_stride = g_last_vb[1].stride;
+        if (cbs->vb[1].bound && cbs->vb[1].buffer) {
+            uint64_t inst_stride = cbs->vb[1].stride;
             if (inst_stride == 0) inst_stride = 64;
-            void* inst_base = lookup_ubo_ptr(g_last_vb[1].buffer, g_last_vb[1].offset);
+            void* inst_base = lookup_ubo_ptr(cbs->vb[1].buffer, cbs->vb[1].offset);
             if (inst_base) {
-                LOG("  VB1(inst): buf=0x%lx off=%lu stride=%lu base=%p\n",
-                    (unsigned long)g_last_vb[1].buffer, (unsigned long)g_last_vb[1].offset,
+                LOGT(ICD_LC_CMD, "  VB1(inst): buf=0x%lx off=%lu stride=%lu base=%p\n",
+                    (unsigned long)cbs->vb[1].buffer, (unsigned long)cbs->vb[1].offset,
                     (unsigned long)inst_stride, inst_base);
                 /* Read first 2 instances (4x4 float matrix each = 64 bytes) */
                 for (uint32_t inst = 0; inst < 2 && inst < instanceCount; inst++) {
                     float* m = (float*)((uint8_t*)inst_base + inst * inst_stride);
-                    LOG("  INST[%u] row0: [%.4f %.4f %.4f %.4f]\n", inst, m[0], m[1], m[2], m[3]);
-                    LOG("  INST[%u] row1: [%.4f %.4f %.4f %.4f]\n", inst, m[4], m[5], m[6], m[7]);
-                    LOG("  INST[%u] row2: [%.4f %.4f %.4f %.4f]\n", inst, m[8], m[9], m[10], m[11]);
-                    LOG("  INST[%u] row3: [%.4f %.4f %.4f %.4f]\n", inst, m[12], m[13], m[14], m[15]);
+                    LOGT(ICD_LC_CMD, "  INST[%u] row0: [%.4f %.4f %.4f %.4f]\n", inst, m[0], m[1], m[2], m[3]);
+                    LOGT(ICD_LC_CMD, "  INST[%u] row1: [%.4f %.4f %.4f %.4f]\n", inst, m[4], m[5], m[6], m[7]);
+                    LOGT(ICD_LC_CMD, "  INST[%u] row2: [%.4f %.4f %.4f %.4f]\n", inst, m[8], m[9], m[10], m[11]);
+                    LOGT(ICD_LC_CMD, "  INST[%u] row3: [%.4f %.4f %.4f %.4f]\n", inst, m[12], m[13], m[14], m[15]);
                     /* Hex dump row3 for NaN analysis */
                     {
                         uint32_t h12, h13, h14, h15;
                         memcpy(&h12, &m[12], 4); memcpy(&h13, &m[13], 4);
                         memcpy(&h14, &m[14], 4); memcpy(&h15, &m[15], 4);
-                        LOG("  INST[%u] row3hex: [0x%08x 0x%08x 0x%08x 0x%08x]\n", inst, h12, h13, h14, h15);
+                        LOGT(ICD_LC_CMD, "  INST[%u] row3hex: [0x%08x 0x%08x 0x%08x 0x%08x]\n", inst, h12, h13, h14, h15);
                     }
                 }
             } else {
-                LOG("  VB1(inst): FAILED lookup buf=0x%lx off=%lu\n",
-                    (unsigned long)g_last_vb[1].buffer, (unsigned long)g_last_vb[1].offset);
+                LOGT(ICD_LC_CMD, "  VB1(inst): FAILED lookup buf=0x%lx off=%lu\n",
+                    (unsigned long)cbs->vb[1].buffer, (unsigned long)cbs->vb[1].offset);
             }
         }
 
         /* 3. UBO/SSBO readback — dump ALL tracked entries */
-        LOG("  UBO count=%d\n", g_last_ubo_count);
-        for (int u = 0; u < g_last_ubo_count && u < MAX_LAST_UBO; u++) {
-            if (!g_last_ubo[u].buffer) continue;
-            void* ubo_ptr = lookup_ubo_ptr(g_last_ubo[u].buffer, g_last_ubo[u].offset);
+        LOGT(ICD_LC_CMD, "  UBO count=%d\n", cbs->ubo_count);
+        for (int u = 0; u < cbs->ubo_count && u < MAX_LAST_UBO; u++) {
+            if (!cbs->ubo[u].buffer) continue;
+            void* ubo_ptr = lookup_ubo_ptr(cbs->ubo[u].buffer, cbs->ubo[u].offset);
             if (ubo_ptr) {
                 float* m = (float*)ubo_ptr;
                 /* Count non-zero floats in the first 64 bytes (16 floats) */
                 int nz = 0;
                 for (int f = 0; f < 16; f++) if (m[f] != 0.0f) nz++;
-                LOG("  UBO[%d] buf=0x%lx off=%lu range=%lu nonzero=%d:\n",
-                    u, (unsigned long)g_last_ubo[u].buffer,
-                    (unsigned long)g_last_ubo[u].offset,
-                    (unsigned long)g_last_ubo[u].range, nz);
-                LOG("    [%e %e %e %e]\n", m[0], m[1], m[2], m[3]);
-                LOG("    [%e %e %e %e]\n", m[4], m[5], m[6], m[7]);
-                LOG("    [%e %e %e %e]\n", m[8], m[9], m[10], m[11]);
-                LOG("    [%e %e %e %e]\n", m[12], m[13], m[14], m[15]);
+                LOGT(ICD_LC_CMD, "  UBO[%d] buf=0x%lx off=%lu range=%lu nonzero=%d:\n",
+                    u, (unsigned long)cbs->ubo[u].buffer,
+                    (unsigned long)cbs->ubo[u].offset,
+                    (unsigned long)cbs->ubo[u].range, nz);
+                LOGT(ICD_LC_CMD, "    [%e %e %e %e]\n", m[0], m[1], m[2], m[3]);
+                LOGT(ICD_LC_CMD, "    [%e %e %e %e]\n", m[4], m[5], m[6], m[7]);
+                LOGT(ICD_LC_CMD, "    [%e %e %e %e]\n", m[8], m[9], m[10], m[11]);
+                LOGT(ICD_LC_CMD, "    [%e %e %e %e]\n", m[12], m[13], m[14], m[15]);
             } else {
-                LOG("  UBO[%d] FAILED buf=0x%lx off=%lu\n",
-                    u, (unsigned long)g_last_ubo[u].buffer,
-                    (unsigned long)g_last_ubo[u].offset);
+                LOGT(ICD_LC_CMD, "  UBO[%d] FAILED buf=0x%lx off=%lu\n",
+                    u, (unsigned long)cbs->ubo[u].buffer,
+                    (unsigned long)cbs->ubo[u].offset);
             }
         }
-        if (g_last_ubo_count == 0)
-            LOG("  UBO-READBACK: no UBOs tracked\n");
+        if (cbs->ubo_count == 0)
+            LOGT(ICD_LC_CMD, "  UBO-READBACK: no UBOs tracked\n");
 
         /* 4. Viewport/Scissor/PushConstants/Pipeline — always for mesh draws */
         {
-            LOG("  VIEWPORT: x=%.1f y=%.1f w=%.1f h=%.1f minD=%.3f maxD=%.3f (set=%u)\n",
-                g_last_viewport[0], g_last_viewport[1], g_last_viewport[2],
-                g_last_viewport[3], g_last_viewport[4], g_last_viewport[5],
-                g_last_viewport_set);
-            LOG("  SCISSOR: x=%u y=%u w=%u h=%u\n",
-                g_last_scissor[0], g_last_scissor[1], g_last_scissor[2], g_last_scissor[3]);
+            LOGT(ICD_LC_CMD, "  VIEWPORT: x=%.1f y=%.1f w=%.1f h=%.1f minD=%.3f maxD=%.3f (set=%u)\n",
+                cbs->viewport[0], cbs->viewport[1], cbs->viewport[2],
+                cbs->viewport[3], cbs->viewport[4], cbs->viewport[5],
+                cbs->viewport_set);
+            LOGT(ICD_LC_CMD, "  SCISSOR: x=%u y=%u w=%u h=%u\n",
+                cbs->scissor[0], cbs->scissor[1], cbs->scissor[2], cbs->scissor[3]);
             /* Pipeline vertex input lookup — which pipeline is bound? */
-            LOG("  CUR_PIPELINE: 0x%llx\n", (unsigned long long)g_cur_pipeline);
-            int found_pipe = 0;
-            for (int p = 0; p < g_pipe_vis_count; p++) {
-                if (g_pipe_vis[p].pipeline == g_cur_pipeline) {
-                    LOG("  PIPE-VIS: bindings=%u", g_pipe_vis[p].bindingCount);
-                    for (uint32_t b = 0; b < g_pipe_vis[p].bindingCount && b < 8; b++)
-                        LOG(" slot%u:stride%u", g_pipe_vis[p].bindingSlots[b], g_pipe_vis[p].strides[b]);
-                    LOG("\n");
-                    found_pipe = 1;
-                    break;
-                }
+            LOGT(ICD_LC_CMD, "  CUR_PIPELINE: 0x%llx\n", (unsigned long long)cbs->pipeline);
+            PipeVis vis;
+            if (hmap_get(&g_pipe_vis, cbs->pipeline, &vis)) {
+                LOGT(ICD_LC_CMD, "  PIPE-VIS: bindings=%u", vis.bindingCount);
+                for (uint32_t b = 0; b < vis.bindingCount && b < 8; b++)
+                    LOGT(ICD_LC_CMD, " slot%u:stride%u", vis.bindingSlots[b], vis.strides[b]);
+                LOGT(ICD_LC_CMD, "\n");
+            } else {
+                LOGT(ICD_LC_CMD, "  PIPE-VIS: NOT FOUND in cache (%u entries)\n", hmap_count(&g_pipe_vis));
             }
-            if (!found_pipe)
-                LOG("  PIPE-VIS: NOT FOUND in cache (%d entries)\n", g_pipe_vis_count);
             /* Compare pipeline baked strides vs DXVK's VB2 strides */
-            LOG("  VB2-STRIDES-FROM-DXVK:");
-            for (uint32_t s = 0; s < g_last_vb_max && s < 4; s++) {
-                if (g_last_vb[s].bound)
-                    LOG(" slot%u:stride%lu buf=0x%lx off=%lu",
-                        s, (unsigned long)g_last_vb[s].stride,
-                        (unsigned long)g_last_vb[s].buffer,
-                        (unsigned long)g_last_vb[s].offset);
+            LOGT(ICD_LC_CMD, "  VB2-STRIDES-FROM-DXVK:");
+            for (uint32_t s = 0; s < cbs->vb_max && s < 4; s++) {
+                if (cbs->vb[s].bound)
+                    LOGT(ICD_LC_CMD, " slot%u:stride%lu buf=0x%lx off=%lu",
+                        s, (unsigned long)cbs->vb[s].stride,
+                        (unsigned long)cbs->vb[s].buffer,
+                        (unsigned long)cbs->vb[s].offset);
             }
-            LOG("\n");
+            LOGT(ICD_LC_CMD, "\n");
             /* Push constants data dump */
-            if (g_last_pc_size > 0) {
-                LOG("  PUSH_CONSTS: stages=0x%x size=%u\n", g_last_pc_stages, g_last_pc_size);
-                const uint32_t* u = (const uint32_t*)g_last_pc_data;
-                uint32_t nwords = g_last_pc_size / 4;
+            if (cbs->pc_size > 0) {
+                LOGT(ICD_LC_CMD, "  PUSH_CONSTS: stages=0x%x size=%u\n", cbs->pc_stages, cbs->pc_size);
+                const uint32_t* u = (const uint32_t*)cbs->pc_data;
+                uint32_t nwords = cbs->pc_size / 4;
                 if (nwords > 16) nwords = 16;
                 for (uint32_t w = 0; w < nwords; w++) {
                     float f; memcpy(&f, &u[w], 4);
-                    LOG("    PC[%u]: 0x%08x (%.6g)\n", w, u[w], f);
+                    LOGT(ICD_LC_CMD, "    PC[%u]: 0x%08x (%.6g)\n", w, u[w], f);
                 }
             }
         }
@@ -3195,14 +4669,9 @@ static void trace_CmdDrawIndexed(void* cmdBuf, uint32_t indexCount, uint32_t ins
 
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_DRAW_INDEXED);
-        if (cmd) {
-            cmd->draw_idx.indexCount = indexCount;
-            cmd->draw_idx.instanceCount = instanceCount;
-            cmd->draw_idx.firstIndex = firstIndex;
-            cmd->draw_idx.vertexOffset = vertexOffset;
-            cmd->draw_idx.firstInstance = firstInstance;
-        }
+        RcDrawIndexed* cmd = replay_emit(cmdBuf, RCMD_DRAW_INDEXED, sizeof(*cmd));
+        if (cmd) *cmd = (RcDrawIndexed){ indexCount, instanceCount, firstIndex,
+                                         vertexOffset, firstInstance };
     }
 
     real_cmd_draw_indexed(real, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
@@ -3216,21 +4685,18 @@ static void trace_CmdDrawIndirect(void* cmdBuf, uint64_t buffer, uint64_t offset
                                    uint32_t drawCount, uint32_t stride) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
+    const CmdBufState* cbs = cb_state_peek(cmdBuf);
     static int di_log = 0;
     di_log++;
     if (di_log <= 200)
-        LOG("[CMD#%d] CmdDrawIndirect: cb=%p buf=0x%lx off=%lu count=%u stride=%u\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdDrawIndirect: cb=%p buf=0x%lx off=%lu count=%u stride=%u\n",
             op, real, (unsigned long)buffer, (unsigned long)offset, drawCount, stride);
 
     /* === DIAGNOSTIC: Read indirect buffer, VB data, instance data at draw time === */
     /* Which pipeline is currently bound? */
-    int di_pipe_bcount = 0;
-    for (int p = 0; p < g_pipe_vis_count; p++) {
-        if (g_pipe_vis[p].pipeline == g_cur_pipeline) {
-            di_pipe_bcount = g_pipe_vis[p].bindingCount;
-            break;
-        }
-    }
+    PipeVis di_vis = {0};
+    hmap_get(&g_pipe_vis, cbs->pipeline, &di_vis);
+    int di_pipe_bcount = (int)di_vis.bindingCount;
     static int di_diag = 0;
     static int di_mesh_diag = 0;
     int do_di_diag = 0;
@@ -3238,8 +4704,8 @@ static void trace_CmdDrawIndirect(void* cmdBuf, uint64_t buffer, uint64_t offset
         /* 3D mesh pipeline — always capture first 30 */
         do_di_diag = (++di_mesh_diag <= 30);
         if (do_di_diag)
-            LOG("  *** MESH-PIPELINE (bCount=%d) pipe=0x%llx ***\n",
-                di_pipe_bcount, (unsigned long long)g_cur_pipeline);
+            LOGT(ICD_LC_CMD, "  *** MESH-PIPELINE (bCount=%d) pipe=0x%llx ***\n",
+                di_pipe_bcount, (unsigned long long)cbs->pipeline);
     } else if (++di_diag <= 20) {
         do_di_diag = 1;
     }
@@ -3249,97 +4715,97 @@ static void trace_CmdDrawIndirect(void* cmdBuf, uint64_t buffer, uint64_t offset
         if (ind_ptr) {
             for (uint32_t d = 0; d < drawCount && d < 8; d++) {
                 uint32_t* cmd = (uint32_t*)((uint8_t*)ind_ptr + d * stride);
-                LOG("  INDIRECT[%u]: vertexCount=%u instanceCount=%u firstVertex=%u firstInstance=%u\n",
+                LOGT(ICD_LC_CMD, "  INDIRECT[%u]: vertexCount=%u instanceCount=%u firstVertex=%u firstInstance=%u\n",
                     d, cmd[0], cmd[1], cmd[2], cmd[3]);
             }
         } else {
-            LOG("  INDIRECT: FAILED to read (DEVICE_LOCAL?) buf=0x%lx\n", (unsigned long)buffer);
+            LOGT(ICD_LC_CMD, "  INDIRECT: FAILED to read (DEVICE_LOCAL?) buf=0x%lx\n", (unsigned long)buffer);
         }
 
         /* 2. Vertex buffer slot 0 — read first 3 vertex positions */
-        if (g_last_vb[0].bound && g_last_vb[0].buffer) {
-            uint64_t vb_stride = g_last_vb[0].stride;
+        if (cbs->vb[0].bound && cbs->vb[0].buffer) {
+            uint64_t vb_stride = cbs->vb[0].stride;
             if (vb_stride == 0) vb_stride = 104;
-            void* vb_base = lookup_ubo_ptr(g_last_vb[0].buffer, g_last_vb[0].offset);
+            void* vb_base = lookup_ubo_ptr(cbs->vb[0].buffer, cbs->vb[0].offset);
             if (vb_base) {
-                LOG("  VB0: buf=0x%lx off=%lu stride=%lu\n",
-                    (unsigned long)g_last_vb[0].buffer, (unsigned long)g_last_vb[0].offset,
+                LOGT(ICD_LC_CMD, "  VB0: buf=0x%lx off=%lu stride=%lu\n",
+                    (unsigned long)cbs->vb[0].buffer, (unsigned long)cbs->vb[0].offset,
                     (unsigned long)vb_stride);
                 for (int v = 0; v < 3; v++) {
                     float* pos = (float*)((uint8_t*)vb_base + v * vb_stride);
-                    LOG("    vtx[%d] pos: %.3f %.3f %.3f %.3f\n", v, pos[0], pos[1], pos[2], pos[3]);
+                    LOGT(ICD_LC_CMD, "    vtx[%d] pos: %.3f %.3f %.3f %.3f\n", v, pos[0], pos[1], pos[2], pos[3]);
                     /* Also dump bytes 16-31 (gap in vertex format) */
                     float* gap = (float*)((uint8_t*)vb_base + v * vb_stride + 16);
-                    LOG("    vtx[%d] gap16: %.3f %.3f %.3f %.3f\n", v, gap[0], gap[1], gap[2], gap[3]);
+                    LOGT(ICD_LC_CMD, "    vtx[%d] gap16: %.3f %.3f %.3f %.3f\n", v, gap[0], gap[1], gap[2], gap[3]);
                 }
             } else {
-                LOG("  VB0: DEVICE_LOCAL (unreadable) buf=0x%lx\n", (unsigned long)g_last_vb[0].buffer);
+                LOGT(ICD_LC_CMD, "  VB0: DEVICE_LOCAL (unreadable) buf=0x%lx\n", (unsigned long)cbs->vb[0].buffer);
             }
         }
 
         /* 3. Instance buffer (binding 1) — read transform matrix */
-        if (g_last_vb[1].bound && g_last_vb[1].buffer) {
-            uint64_t inst_stride = g_last_vb[1].stride;
+        if (cbs->vb[1].bound && cbs->vb[1].buffer) {
+            uint64_t inst_stride = cbs->vb[1].stride;
             if (inst_stride == 0) inst_stride = 64;
-            void* inst_base = lookup_ubo_ptr(g_last_vb[1].buffer, g_last_vb[1].offset);
+            void* inst_base = lookup_ubo_ptr(cbs->vb[1].buffer, cbs->vb[1].offset);
             if (inst_base) {
-                LOG("  VB1(instance): buf=0x%lx off=%lu stride=%lu\n",
-                    (unsigned long)g_last_vb[1].buffer, (unsigned long)g_last_vb[1].offset,
+                LOGT(ICD_LC_CMD, "  VB1(instance): buf=0x%lx off=%lu stride=%lu\n",
+                    (unsigned long)cbs->vb[1].buffer, (unsigned long)cbs->vb[1].offset,
                     (unsigned long)inst_stride);
                 /* Dump first instance's 4x4 matrix (4 vec4 = 64 bytes) */
                 float* m = (float*)inst_base;
-                LOG("    inst[0] row0: %.4f %.4f %.4f %.4f\n", m[0], m[1], m[2], m[3]);
-                LOG("    inst[0] row1: %.4f %.4f %.4f %.4f\n", m[4], m[5], m[6], m[7]);
-                LOG("    inst[0] row2: %.4f %.4f %.4f %.4f\n", m[8], m[9], m[10], m[11]);
-                LOG("    inst[0] row3: %.4f %.4f %.4f %.4f\n", m[12], m[13], m[14], m[15]);
+                LOGT(ICD_LC_CMD, "    inst[0] row0: %.4f %.4f %.4f %.4f\n", m[0], m[1], m[2], m[3]);
+                LOGT(ICD_LC_CMD, "    inst[0] row1: %.4f %.4f %.4f %.4f\n", m[4], m[5], m[6], m[7]);
+                LOGT(ICD_LC_CMD, "    inst[0] row2: %.4f %.4f %.4f %.4f\n", m[8], m[9], m[10], m[11]);
+                LOGT(ICD_LC_CMD, "    inst[0] row3: %.4f %.4f %.4f %.4f\n", m[12], m[13], m[14], m[15]);
             } else {
-                LOG("  VB1(instance): DEVICE_LOCAL (unreadable) buf=0x%lx\n",
-                    (unsigned long)g_last_vb[1].buffer);
+                LOGT(ICD_LC_CMD, "  VB1(instance): DEVICE_LOCAL (unreadable) buf=0x%lx\n",
+                    (unsigned long)cbs->vb[1].buffer);
             }
         }
 
         /* 4. Push constant value dump */
-        if (g_last_pc_size > 0) {
-            const uint32_t* u = (const uint32_t*)g_last_pc_data;
-            uint32_t nwords = g_last_pc_size / 4;
-            LOG("  PC: stages=0x%x size=%u:", g_last_pc_stages, g_last_pc_size);
+        if (cbs->pc_size > 0) {
+            const uint32_t* u = (const uint32_t*)cbs->pc_data;
+            uint32_t nwords = cbs->pc_size / 4;
+            LOGT(ICD_LC_CMD, "  PC: stages=0x%x size=%u:", cbs->pc_stages, cbs->pc_size);
             for (uint32_t w = 0; w < nwords && w < 12; w++)
-                LOG(" %08x", u[w]);
-            LOG("\n");
+                LOGT(ICD_LC_CMD, " %08x", u[w]);
+            LOGT(ICD_LC_CMD, "\n");
             /* Also as floats */
-            const float* f = (const float*)g_last_pc_data;
-            LOG("  PC(float):");
+            const float* f = (const float*)cbs->pc_data;
+            LOGT(ICD_LC_CMD, "  PC(float):");
             for (uint32_t w = 0; w < nwords && w < 12; w++)
-                LOG(" %.3f", f[w]);
-            LOG("\n");
+                LOGT(ICD_LC_CMD, " %.3f", f[w]);
+            LOGT(ICD_LC_CMD, "\n");
         }
 
         /* 5. SSBO/UBO readback from last bound descriptor sets */
-        if (g_last_ubo_count > 0) {
-            LOG("  DESCRIPTORS: %d tracked UBO/SSBO bindings\n", g_last_ubo_count);
-            for (int u = 0; u < g_last_ubo_count && u < 4; u++) {
-                uint64_t buf = g_last_ubo[u].buffer;
-                uint64_t boff = g_last_ubo[u].offset;
-                uint64_t range = g_last_ubo[u].range;
+        if (cbs->ubo_count > 0) {
+            LOGT(ICD_LC_CMD, "  DESCRIPTORS: %d tracked UBO/SSBO bindings\n", cbs->ubo_count);
+            for (int u = 0; u < cbs->ubo_count && u < 4; u++) {
+                uint64_t buf = cbs->ubo[u].buffer;
+                uint64_t boff = cbs->ubo[u].offset;
+                uint64_t range = cbs->ubo[u].range;
                 if (buf == 0) continue;
                 void* ptr = lookup_ubo_ptr(buf, boff);
-                LOG("  UBO[%d]: buf=0x%lx off=%lu range=%lu ptr=%p\n",
+                LOGT(ICD_LC_CMD, "  UBO[%d]: buf=0x%lx off=%lu range=%lu ptr=%p\n",
                     u, (unsigned long)buf, (unsigned long)boff, (unsigned long)range, ptr);
                 if (ptr && range >= 16) {
                     /* Dump first 16 floats (64 bytes) of each UBO/SSBO */
                     const float* f = (const float*)ptr;
-                    LOG("    data(float): %.4f %.4f %.4f %.4f | %.4f %.4f %.4f %.4f\n",
+                    LOGT(ICD_LC_CMD, "    data(float): %.4f %.4f %.4f %.4f | %.4f %.4f %.4f %.4f\n",
                         f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7]);
-                    LOG("    data(float): %.4f %.4f %.4f %.4f | %.4f %.4f %.4f %.4f\n",
+                    LOGT(ICD_LC_CMD, "    data(float): %.4f %.4f %.4f %.4f | %.4f %.4f %.4f %.4f\n",
                         f[8], f[9], f[10], f[11], f[12], f[13], f[14], f[15]);
                     /* Also as hex for first 8 words */
                     const uint32_t* h = (const uint32_t*)ptr;
-                    LOG("    data(hex): %08x %08x %08x %08x %08x %08x %08x %08x\n",
+                    LOGT(ICD_LC_CMD, "    data(hex): %08x %08x %08x %08x %08x %08x %08x %08x\n",
                         h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
                 }
             }
         } else {
-            LOG("  DESCRIPTORS: no UBO/SSBO tracked\n");
+            LOGT(ICD_LC_CMD, "  DESCRIPTORS: no UBO/SSBO tracked\n");
         }
     }
 
@@ -3356,7 +4822,7 @@ static void trace_CmdDrawIndexedIndirect(void* cmdBuf, uint64_t buffer, uint64_t
     int op = ++g_cmd_op_count;
     static int dii_log = 0;
     if (++dii_log <= 200)
-        LOG("[CMD#%d] CmdDrawIndexedIndirect: cb=%p buf=0x%lx off=%lu count=%u stride=%u\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdDrawIndexedIndirect: cb=%p buf=0x%lx off=%lu count=%u stride=%u\n",
             op, real, (unsigned long)buffer, (unsigned long)offset, drawCount, stride);
     real_cmd_draw_indexed_indirect(real, buffer, offset, drawCount, stride);
 }
@@ -3368,7 +4834,7 @@ static PFN_vkCmdDispatch real_cmd_dispatch = NULL;
 static void trace_CmdDispatch(void* cmdBuf, uint32_t gx, uint32_t gy, uint32_t gz) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdDispatch: cb=%p groups=%u,%u,%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdDispatch: cb=%p groups=%u,%u,%u\n",
         op, real, gx, gy, gz);
     real_cmd_dispatch(real, gx, gy, gz);
 }
@@ -3381,9 +4847,10 @@ static void trace_CmdFillBuffer(void* cmdBuf, uint64_t dstBuf, uint64_t dstOffse
                                   uint64_t size, uint32_t data) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdFillBuffer: cb=%p buf=0x%llx off=%llu size=%llu data=0x%x\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdFillBuffer: cb=%p buf=0x%llx off=%llu size=%llu data=0x%x\n",
         op, real, (unsigned long long)dstBuf, (unsigned long long)dstOffset,
         (unsigned long long)size, data);
+    cb_state_note_write(cmdBuf, dstBuf);
     real_cmd_fill_buffer(real, dstBuf, dstOffset, size, data);
 }
 
@@ -3395,9 +4862,10 @@ static void trace_CmdUpdateBuffer(void* cmdBuf, uint64_t dstBuf, uint64_t dstOff
                                     uint64_t dataSize, const void* pData) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdUpdateBuffer: cb=%p buf=0x%llx off=%llu size=%llu\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdUpdateBuffer: cb=%p buf=0x%llx off=%llu size=%llu\n",
         op, real, (unsigned long long)dstBuf, (unsigned long long)dstOffset,
         (unsigned long long)dataSize);
+    cb_state_note_write(cmdBuf, dstBuf);
     real_cmd_update_buffer(real, dstBuf, dstOffset, dataSize, pData);
 }
 
@@ -3415,44 +4883,40 @@ static void trace_CmdBindDescriptorSets(void* cmdBuf, uint32_t bindPoint, uint64
     static int ds_log_count = 0;
     ds_log_count++;
     if (ds_log_count <= 2000) {
-        LOG("[CMD#%d] CmdBindDescriptorSets: cb=%p first=%u count=%u dynOffs=%u layout=0x%lx\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdBindDescriptorSets: cb=%p first=%u count=%u dynOffs=%u layout=0x%lx\n",
             op, real, firstSet, setCount, dynOffCount, (unsigned long)layout);
         for (uint32_t s = 0; s < setCount && s < 4; s++) {
-            LOG("  set[%u]: handle=0x%lx\n", firstSet + s, pSets ? (unsigned long)pSets[s] : 0);
+            LOGT(ICD_LC_CMD, "  set[%u]: handle=0x%lx\n", firstSet + s, pSets ? (unsigned long)pSets[s] : 0);
         }
         if (dynOffCount > 0 && pDynOffs) {
             for (uint32_t d = 0; d < dynOffCount && d < 4; d++) {
-                LOG("  dynOff[%u]=%u\n", d, pDynOffs[d]);
+                LOGT(ICD_LC_CMD, "  dynOff[%u]=%u\n", d, pDynOffs[d]);
             }
         }
     }
-    /* Update g_last_ubo from per-set tracking when a set with UBOs is bound */
-    if (pSets) {
+    /* Update this CB's bound UBOs from per-set tracking when a set with UBOs is bound */
+    CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+    if (pSets && cbs) {
         for (uint32_t s = 0; s < setCount; s++) {
-            uint64_t sh = pSets[s];
-            for (int si = 0; si < g_set_ubo_track_count; si++) {
-                if (g_set_ubo_track[si].set_handle == sh && g_set_ubo_track[si].ubo_count > 0) {
-                    for (int u = 0; u < g_set_ubo_track[si].ubo_count && u < MAX_LAST_UBO; u++)
-                        g_last_ubo[u] = g_set_ubo_track[si].ubos[u];
-                    g_last_ubo_count = g_set_ubo_track[si].ubo_count;
-                    break;
-                }
+            hmap_rdlock(&g_set_ubo_track);
+            const SetUboTrack* t = (const SetUboTrack*)hmap_find_locked(&g_set_ubo_track, pSets[s]);
+            if (t && t->ubo_count > 0) {
+                for (int u = 0; u < t->ubo_count && u < MAX_LAST_UBO; u++)
+                    cbs->ubo[u] = t->ubos[u];
+                cbs->ubo_count = t->ubo_count;
             }
+            hmap_unlock(&g_set_ubo_track);
         }
     }
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_BIND_DESC_SETS);
+        uint32_t nsets = pSets ? setCount : 0, ndyn = pDynOffs ? dynOffCount : 0;
+        RcDescSets* cmd = replay_emit(cmdBuf, RCMD_BIND_DESC_SETS,
+                                      sizeof(*cmd) + nsets * 8 + ndyn * 4);
         if (cmd) {
-            cmd->desc.bindPoint = bindPoint;
-            cmd->desc.layout = layout;
-            cmd->desc.firstSet = firstSet;
-            cmd->desc.setCount = setCount < 4 ? setCount : 4;
-            for (uint32_t s = 0; s < cmd->desc.setCount; s++)
-                cmd->desc.sets[s] = pSets ? pSets[s] : 0;
-            cmd->desc.dynOffCount = dynOffCount < 8 ? dynOffCount : 8;
-            for (uint32_t d = 0; d < cmd->desc.dynOffCount; d++)
-                cmd->desc.dynOffs[d] = pDynOffs ? pDynOffs[d] : 0;
+            *cmd = (RcDescSets){ layout, bindPoint, firstSet, nsets, ndyn };
+            if (nsets) memcpy(cmd + 1, pSets, nsets * 8);
+            if (ndyn) memcpy((uint64_t*)(cmd + 1) + nsets, pDynOffs, ndyn * 4);
         }
     }
     /* FEX thunk 7th-arg fix: CmdBindDescriptorSets has 8 args.
@@ -3460,12 +4924,13 @@ static void trace_CmdBindDescriptorSets(void* cmdBuf, uint32_t bindPoint, uint64
      * FEX thunks may corrupt stack-passed args (same bug as VB2 pStrides).
      * Force dynOffCount=0 when DXVK sends 0, to ensure 0 reaches the driver.
      * If dynOffCount > 0, pass through and log warning. */
+    desc_batch_flush();
     if (dynOffCount == 0) {
         real_cmd_bind_desc_sets(real, bindPoint, layout, firstSet, setCount, pSets, 0, NULL);
     } else {
         static int dyn_warn = 0;
         if (++dyn_warn <= 10)
-            LOG("WARNING: CmdBindDescriptorSets dynOffCount=%u (non-zero, may corrupt through thunk!)\n", dynOffCount);
+            LOGW(ICD_LC_CMD, "WARNING: CmdBindDescriptorSets dynOffCount=%u (non-zero, may corrupt through thunk!)\n", dynOffCount);
         real_cmd_bind_desc_sets(real, bindPoint, layout, firstSet, setCount, pSets, dynOffCount, pDynOffs);
     }
 }
@@ -3481,10 +4946,10 @@ static void trace_CmdSetViewport(void* cmdBuf, uint32_t first, uint32_t count, c
     if (count > 0 && pViewports) {
         float w = *(const float*)((const char*)pViewports + 8);
         float h = *(const float*)((const char*)pViewports + 12);
-        LOG("[CMD#%d] CmdSetViewport: cb=%p count=%u vp0=%.0fx%.0f\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdSetViewport: cb=%p count=%u vp0=%.0fx%.0f\n",
             op, real, count, w, h);
     } else {
-        LOG("[CMD#%d] CmdSetViewport: cb=%p count=%u\n", op, real, count);
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdSetViewport: cb=%p count=%u\n", op, real, count);
     }
     real_cmd_set_viewport(real, first, count, pViewports);
 }
@@ -3496,7 +4961,7 @@ static PFN_vkCmdSetScissor real_cmd_set_scissor = NULL;
 static void trace_CmdSetScissor(void* cmdBuf, uint32_t first, uint32_t count, const void* pScissors) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdSetScissor: cb=%p count=%u\n", op, real, count);
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdSetScissor: cb=%p count=%u\n", op, real, count);
     real_cmd_set_scissor(real, first, count, pScissors);
 }
 
@@ -3508,7 +4973,7 @@ static void trace_CmdBindVertexBuffers(void* cmdBuf, uint32_t first, uint32_t co
                                         const uint64_t* pBuffers, const uint64_t* pOffsets) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    LOG("[CMD#%d] CmdBindVertexBuffers: cb=%p first=%u count=%u\n",
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdBindVertexBuffers: cb=%p first=%u count=%u\n",
         op, real, first, count);
     real_cmd_bind_vtx_bufs(real, first, count, pBuffers, pOffsets);
 }
@@ -3532,11 +4997,11 @@ static void trace_CmdBindVertexBuffers2(void* cmdBuf, uint32_t first, uint32_t c
     static int unusual_vb2_count = 0;
     if (is_unusual) unusual_vb2_count++;
     if (vb2_log_count <= 500 || (is_unusual && unusual_vb2_count <= 200)) {
-        LOG("[CMD#%d] CmdBindVertexBuffers2: cb=%p first=%u count=%u pSizes=%p pStrides=%p%s\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdBindVertexBuffers2: cb=%p first=%u count=%u pSizes=%p pStrides=%p%s\n",
             op, real, first, count, (void*)pSizes, (void*)pStrides,
             is_unusual ? " *** MESH-VB ***" : "");
         for (uint32_t i = 0; i < count && i < 4; i++) {
-            LOG("  vb[%u]: buf=0x%lx off=%lu size=%lu stride=%lu\n",
+            LOGT(ICD_LC_CMD, "  vb[%u]: buf=0x%lx off=%lu size=%lu stride=%lu\n",
                 first + i,
                 pBuffers ? (unsigned long)pBuffers[i] : 0,
                 pOffsets ? (unsigned long)pOffsets[i] : 0,
@@ -3545,25 +5010,23 @@ static void trace_CmdBindVertexBuffers2(void* cmdBuf, uint32_t first, uint32_t c
         }
     }
     /* Save VB state for vertex readback at draw time */
-    for (uint32_t i = 0; i < count && (first + i) < MAX_VB_SLOTS; i++) {
-        g_last_vb[first + i].buffer = pBuffers ? pBuffers[i] : 0;
-        g_last_vb[first + i].offset = pOffsets ? pOffsets[i] : 0;
-        g_last_vb[first + i].size   = pSizes   ? pSizes[i]   : 0xFFFFFFFFFFFFFFFFULL;
-        g_last_vb[first + i].stride = pStrides ? pStrides[i] : 0;
-        g_last_vb[first + i].bound = 1;
-        if (first + i + 1 > g_last_vb_max) g_last_vb_max = first + i + 1;
+    CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+    for (uint32_t i = 0; cbs && i < count && (first + i) < MAX_VB_SLOTS; i++) {
+        cbs->vb[first + i].buffer = pBuffers ? pBuffers[i] : 0;
+        cbs->vb[first + i].offset = pOffsets ? pOffsets[i] : 0;
+        cbs->vb[first + i].size   = pSizes   ? pSizes[i]   : 0xFFFFFFFFFFFFFFFFULL;
+        cbs->vb[first + i].stride = pStrides ? pStrides[i] : 0;
+        cbs->vb[first + i].bound = 1;
+        if (first + i + 1 > cbs->vb_max) cbs->vb_max = first + i + 1;
     }
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_BIND_VB);
+        RcBindVB* cmd = replay_emit(cmdBuf, RCMD_BIND_VB, sizeof(*cmd) + count * 16);
         if (cmd) {
-            cmd->vb.first = first;
-            cmd->vb.count = count < 8 ? count : 8;
-            for (uint32_t i = 0; i < cmd->vb.count; i++) {
-                cmd->vb.buffers[i] = pBuffers ? pBuffers[i] : 0;
-                cmd->vb.offsets[i] = pOffsets ? pOffsets[i] : 0;
-                cmd->vb.strides[i] = pStrides ? pStrides[i] : 0;
-            }
+            uint64_t* bufs = (uint64_t*)(cmd + 1);
+            *cmd = (RcBindVB){ first, count };
+            if (pBuffers) memcpy(bufs, pBuffers, count * 8);
+            if (pOffsets) memcpy(bufs + count, pOffsets, count * 8);
         }
     }
     /* PURE VB2 PASSTHROUGH TEST — pass all 7 args through to Vortek/Mali.
@@ -3572,7 +5035,7 @@ static void trace_CmdBindVertexBuffers2(void* cmdBuf, uint32_t first, uint32_t c
     {
         static int vb2_pass_log = 0;
         if (++vb2_pass_log <= 20)
-            LOG("  -> VB2 PASSTHROUGH (all 7 args, no downconvert)\n");
+            LOGT(ICD_LC_CMD, "  -> VB2 PASSTHROUGH (all 7 args, no downconvert)\n");
     }
 }
 
@@ -3583,15 +5046,18 @@ static PFN_vkCmdBindIdxBuf real_cmd_bind_idx_buf = NULL;
 static void trace_CmdBindIndexBuffer(void* cmdBuf, uint64_t buffer, uint64_t offset, uint32_t indexType) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    g_last_ib_buf = buffer;
-    g_last_ib_off = offset;
-    g_last_ib_type = indexType;
-    LOG("[CMD#%d] CmdBindIndexBuffer: cb=%p buf=0x%llx off=%llu type=%u\n",
+    CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+    if (cbs) {
+        cbs->ib_buf = buffer;
+        cbs->ib_off = offset;
+        cbs->ib_type = indexType;
+    }
+    LOGT(ICD_LC_CMD, "[CMD#%d] CmdBindIndexBuffer: cb=%p buf=0x%llx off=%llu type=%u\n",
         op, real, (unsigned long long)buffer, (unsigned long long)offset, indexType);
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_BIND_IB);
-        if (cmd) { cmd->ib.buffer = buffer; cmd->ib.offset = offset; cmd->ib.indexType = indexType; }
+        RcBindIB* cmd = replay_emit(cmdBuf, RCMD_BIND_IB, sizeof(*cmd));
+        if (cmd) *cmd = (RcBindIB){ buffer, offset, indexType };
     }
     real_cmd_bind_idx_buf(real, buffer, offset, indexType);
 }
@@ -3611,20 +5077,23 @@ static void trace_CmdBindIndexBuffer2KHR(void* cmdBuf, uint64_t buffer,
                                           uint32_t indexType) {
     void* real = unwrap(cmdBuf);
     int op = ++g_cmd_op_count;
-    g_last_ib_buf = buffer;
-    g_last_ib_off = offset;
-    g_last_ib_type = indexType;
+    CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+    if (cbs) {
+        cbs->ib_buf = buffer;
+        cbs->ib_off = offset;
+        cbs->ib_type = indexType;
+    }
     static int ib2_log_count = 0;
     ib2_log_count++;
     if (ib2_log_count <= 50) {
-        LOG("[CMD#%d] CmdBindIndexBuffer2KHR: cb=%p buf=0x%llx off=%llu sz=%llu type=%u\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdBindIndexBuffer2KHR: cb=%p buf=0x%llx off=%llu sz=%llu type=%u\n",
             op, real, (unsigned long long)buffer, (unsigned long long)offset,
             (unsigned long long)size, indexType);
     }
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_BIND_IB);
-        if (cmd) { cmd->ib.buffer = buffer; cmd->ib.offset = offset; cmd->ib.indexType = indexType; }
+        RcBindIB* cmd = replay_emit(cmdBuf, RCMD_BIND_IB, sizeof(*cmd));
+        if (cmd) *cmd = (RcBindIB){ buffer, offset, indexType };
     }
     if (real_cmd_bind_idx_buf2) {
         /* Real driver supports it — use it */
@@ -3632,7 +5101,7 @@ static void trace_CmdBindIndexBuffer2KHR(void* cmdBuf, uint64_t buffer,
     } else if (real_cmd_bind_idx_buf) {
         /* Fall back to CmdBindIndexBuffer (drop size param) */
         if (ib2_log_count <= 5)
-            LOG("  IB2->IB1 fallback (maintenance5 not real)\n");
+            LOGT(ICD_LC_CMD, "  IB2->IB1 fallback (maintenance5 not real)\n");
         real_cmd_bind_idx_buf(real, buffer, offset, indexType);
     }
 }
@@ -3640,35 +5109,35 @@ static void trace_CmdBindIndexBuffer2KHR(void* cmdBuf, uint64_t buffer,
 /* --- VB/IB injection for CmdExecuteCommands ---
  * DXVK may bind VB/IB on a different CB than the primary that executes
  * secondaries. After vkBeginCommandBuffer, state is undefined.
- * This injects the last known VB/IB onto the primary before replay. */
-static void inject_vb_ib_state(void* real_primary) {
+ * This injects the VB/IB last bound on src onto the primary before replay. */
+static void inject_vb_ib_state(void* real_primary, const CmdBufState* cbs) {
     static int inject_log = 0;
-    if (g_last_vb[0].bound && g_last_vb[0].buffer && real_cmd_bind_vtx_bufs) {
+    if (cbs->vb[0].bound && cbs->vb[0].buffer && real_cmd_bind_vtx_bufs) {
         uint64_t bufs[MAX_VB_SLOTS];
         uint64_t offs[MAX_VB_SLOTS];
-        uint32_t n = g_last_vb_max > 0 ? g_last_vb_max : 1;
+        uint32_t n = cbs->vb_max > 0 ? cbs->vb_max : 1;
         if (n > MAX_VB_SLOTS) n = MAX_VB_SLOTS;
         for (uint32_t s = 0; s < n; s++) {
-            bufs[s] = g_last_vb[s].buffer;
-            offs[s] = g_last_vb[s].offset;
+            bufs[s] = cbs->vb[s].buffer;
+            offs[s] = cbs->vb[s].offset;
         }
         real_cmd_bind_vtx_bufs(real_primary, 0, n, bufs, offs);
         if (++inject_log <= 20)
-            LOG("  INJECT VB1: slots=%u buf=0x%lx off=%lu stride=%lu(baked)\n",
+            LOGT(ICD_LC_CMD, "  INJECT VB1: slots=%u buf=0x%lx off=%lu stride=%lu(baked)\n",
                 n, (unsigned long)bufs[0], (unsigned long)offs[0],
-                (unsigned long)g_last_vb[0].stride);
+                (unsigned long)cbs->vb[0].stride);
     }
-    if (g_last_ib_buf) {
+    if (cbs->ib_buf) {
         if (real_cmd_bind_idx_buf2)
-            real_cmd_bind_idx_buf2(real_primary, g_last_ib_buf, g_last_ib_off,
-                                   0xFFFFFFFFFFFFFFFFULL, g_last_ib_type);
+            real_cmd_bind_idx_buf2(real_primary, cbs->ib_buf, cbs->ib_off,
+                                   0xFFFFFFFFFFFFFFFFULL, cbs->ib_type);
         else if (real_cmd_bind_idx_buf)
-            real_cmd_bind_idx_buf(real_primary, g_last_ib_buf, g_last_ib_off,
-                                  g_last_ib_type);
+            real_cmd_bind_idx_buf(real_primary, cbs->ib_buf, cbs->ib_off,
+                                  cbs->ib_type);
         if (inject_log <= 20)
-            LOG("  INJECT IB: buf=0x%lx off=%lu type=%u\n",
-                (unsigned long)g_last_ib_buf, (unsigned long)g_last_ib_off,
-                g_last_ib_type);
+            LOGT(ICD_LC_CMD, "  INJECT IB: buf=0x%lx off=%lu type=%u\n",
+                (unsigned long)cbs->ib_buf, (unsigned long)cbs->ib_off,
+                cbs->ib_type);
     }
 }
 
@@ -3682,38 +5151,36 @@ static void trace_CmdPushConstants(void* cmdBuf, uint64_t layout, uint32_t stage
     int op = ++g_cmd_op_count;
     static int pc_log_count = 0;
     pc_log_count++;
-    /* Always save push constant data globally for 576-draw diagnostics */
-    if (pValues && size > 0 && size <= sizeof(g_last_pc_data)) {
-        memcpy(g_last_pc_data, pValues, size);
-        g_last_pc_size = size;
-        g_last_pc_stages = stageFlags;
+    /* Always save push constant data on the CB for 576-draw diagnostics */
+    CmdBufState* cbs = cb_state_get(cmdBuf, 1);
+    if (cbs && pValues && size > 0 && size <= sizeof(cbs->pc_data)) {
+        memcpy(cbs->pc_data, pValues, size);
+        cbs->pc_size = size;
+        cbs->pc_stages = stageFlags;
     }
     if (pc_log_count <= 100) {
-        LOG("[CMD#%d] CmdPushConstants: cb=%p stages=0x%x off=%u size=%u\n",
+        LOGT(ICD_LC_CMD, "[CMD#%d] CmdPushConstants: cb=%p stages=0x%x off=%u size=%u\n",
             op, real, stageFlags, offset, size);
         /* Dump data as uint32/float for diagnostics */
         if (pValues && size >= 4) {
             const uint32_t* u = (const uint32_t*)pValues;
             uint32_t nwords = size / 4;
             if (nwords > 12) nwords = 12;
-            LOG("  data:");
+            LOGT(ICD_LC_CMD, "  data:");
             for (uint32_t w = 0; w < nwords; w++) {
                 float f;
                 memcpy(&f, &u[w], 4);
-                LOG(" [%u]=0x%08x(%.4g)", w, u[w], f);
+                LOGT(ICD_LC_CMD, " [%u]=0x%08x(%.4g)", w, u[w], f);
             }
-            LOG("\n");
+            LOGT(ICD_LC_CMD, "\n");
         }
     }
     /* Record for secondary CB replay */
     {
-        ReplayCmd* cmd = add_replay_cmd(cmdBuf, RCMD_PUSH_CONSTS);
+        RcPushConsts* cmd = replay_emit(cmdBuf, RCMD_PUSH_CONSTS, sizeof(*cmd) + size);
         if (cmd) {
-            cmd->pc.layout = layout;
-            cmd->pc.stageFlags = stageFlags;
-            cmd->pc.offset = offset;
-            cmd->pc.size = size < MAX_REPLAY_DATA ? size : MAX_REPLAY_DATA;
-            if (pValues) memcpy(cmd->pc.data, pValues, cmd->pc.size);
+            *cmd = (RcPushConsts){ layout, stageFlags, offset, size };
+            if (pValues) memcpy(cmd + 1, pValues, size);
         }
     }
     real_cmd_push_consts(real, layout, stageFlags, offset, size, pValues);
@@ -3723,119 +5190,146 @@ static void trace_CmdPushConstants(void* cmdBuf, uint64_t layout, uint32_t stage
  * Replays recorded commands from a secondary CB directly into the primary CB.
  * Called from wrapper_CmdExecuteCommands instead of real_cmd_exec_cmds.
  * This bypasses Vortek's broken secondary CB state inheritance. */
-static void replay_secondary_into_primary(void* real_primary, ReplayCB* rcb) {
-    for (int c = 0; c < rcb->cmd_count; c++) {
-        ReplayCmd* cmd = &rcb->cmds[c];
-        switch (cmd->type) {
-        case RCMD_BIND_VB:
+static void replay_secondary_into_primary(void* real_primary, const CmdBufState* cbs) {
+    const uint8_t* p = cbs->replay;
+    const uint8_t* end = p + cbs->replay_len;
+    while (p < end) {
+        const ReplayRec* rec = (const ReplayRec*)p;
+        const void* d = rec + 1;
+        p += sizeof(ReplayRec) + ((rec->size + 7) & ~7u);
+        switch (rec->type) {
+        case RCMD_BIND_VB: {
+            const RcBindVB* c = d;
+            const uint64_t* bufs = (const uint64_t*)(c + 1);
             if (real_cmd_bind_vtx_bufs)
-                real_cmd_bind_vtx_bufs(real_primary, cmd->vb.first, cmd->vb.count,
-                                       cmd->vb.buffers, cmd->vb.offsets);
+                real_cmd_bind_vtx_bufs(real_primary, c->first, c->count, bufs, bufs + c->count);
             break;
-        case RCMD_BIND_IB:
+        }
+        case RCMD_BIND_IB: {
+            const RcBindIB* c = d;
             if (real_cmd_bind_idx_buf)
-                real_cmd_bind_idx_buf(real_primary, cmd->ib.buffer, cmd->ib.offset,
-                                      cmd->ib.indexType);
+                real_cmd_bind_idx_buf(real_primary, c->buffer, c->offset, c->indexType);
             break;
-        case RCMD_BIND_PIPELINE:
+        }
+        case RCMD_BIND_PIPELINE: {
+            const RcBindPipeline* c = d;
             if (real_cmd_bind_pipeline)
-                real_cmd_bind_pipeline(real_primary, cmd->pipe.bindPoint, cmd->pipe.pipeline);
+                real_cmd_bind_pipeline(real_primary, c->bindPoint, c->pipeline);
             break;
-        case RCMD_BIND_DESC_SETS:
+        }
+        case RCMD_BIND_DESC_SETS: {
+            const RcDescSets* c = d;
+            const uint64_t* sets = (const uint64_t*)(c + 1);
             if (real_cmd_bind_desc_sets)
-                real_cmd_bind_desc_sets(real_primary, cmd->desc.bindPoint, cmd->desc.layout,
-                                        cmd->desc.firstSet, cmd->desc.setCount, cmd->desc.sets,
-                                        cmd->desc.dynOffCount, cmd->desc.dynOffs);
+                real_cmd_bind_desc_sets(real_primary, c->bindPoint, c->layout, c->firstSet,
+                                        c->setCount, sets, c->dynOffCount,
+                                        (const uint32_t*)(sets + c->setCount));
             break;
-        case RCMD_PUSH_CONSTS:
+        }
+        case RCMD_PUSH_CONSTS: {
+            const RcPushConsts* c = d;
             if (real_cmd_push_consts)
-                real_cmd_push_consts(real_primary, cmd->pc.layout, cmd->pc.stageFlags,
-                                     cmd->pc.offset, cmd->pc.size, cmd->pc.data);
+                real_cmd_push_consts(real_primary, c->layout, c->stageFlags,
+                                     c->offset, c->size, c + 1);
             break;
-        case RCMD_DRAW_INDEXED:
+        }
+        case RCMD_DRAW_INDEXED: {
+            const RcDrawIndexed* c = d;
             if (real_cmd_draw_indexed)
-                real_cmd_draw_indexed(real_primary, cmd->draw_idx.indexCount,
-                                      cmd->draw_idx.instanceCount, cmd->draw_idx.firstIndex,
-                                      cmd->draw_idx.vertexOffset, cmd->draw_idx.firstInstance);
+                real_cmd_draw_indexed(real_primary, c->indexCount, c->instanceCount,
+                                      c->firstIndex, c->vertexOffset, c->firstInstance);
             break;
-        case RCMD_DRAW:
+        }
+        case RCMD_DRAW: {
+            const RcDraw* c = d;
             if (real_cmd_draw)
-                real_cmd_draw(real_primary, cmd->draw.vertexCount, cmd->draw.instanceCount,
-                              cmd->draw.firstVertex, cmd->draw.firstInstance);
+                real_cmd_draw(real_primary, c->vertexCount, c->instanceCount,
+                              c->firstVertex, c->firstInstance);
             break;
+        }
         /* Extended dynamic state replay */
-        case RCMD_EDS_UINT:
-            if (cmd->eds_uint.slot >= 0 && cmd->eds_uint.slot < MAX_DYN_WRAPPERS && dyn_real[cmd->eds_uint.slot])
-                ((void(*)(void*,uint32_t))dyn_real[cmd->eds_uint.slot])(real_primary, cmd->eds_uint.value);
+        case RCMD_EDS_UINT: {
+            const RcEdsUint* c = d;
+            if (c->slot >= 0 && c->slot < MAX_DYN_WRAPPERS && dyn_real[c->slot])
+                ((void(*)(void*,uint32_t))dyn_real[c->slot])(real_primary, c->value);
             break;
+        }
         case RCMD_EDS_VIEWPORT:
             if (dyn_real[0])
-                ((void(*)(void*,uint32_t,const void*))dyn_real[0])(real_primary, cmd->eds_viewport.count, cmd->eds_viewport.data);
+                ((void(*)(void*,uint32_t,const void*))dyn_real[0])(
+                    real_primary, ((const RcRects*)d)->count, (const RcRects*)d + 1);
             break;
         case RCMD_EDS_SCISSOR:
             if (dyn_real[1])
-                ((void(*)(void*,uint32_t,const void*))dyn_real[1])(real_primary, cmd->eds_scissor.count, cmd->eds_scissor.data);
+                ((void(*)(void*,uint32_t,const void*))dyn_real[1])(
+                    real_primary, ((const RcRects*)d)->count, (const RcRects*)d + 1);
             break;
-        case RCMD_EDS_DEPTHBIAS:
+        case RCMD_EDS_DEPTHBIAS: {
+            const RcDepthBias* c = d;
             if (dyn_real[2])
-                ((void(*)(void*,float,float,float))dyn_real[2])(real_primary, cmd->eds_depthbias.a, cmd->eds_depthbias.b, cmd->eds_depthbias.c);
+                ((void(*)(void*,float,float,float))dyn_real[2])(real_primary, c->a, c->b, c->c);
             break;
+        }
         case RCMD_EDS_BLEND:
             if (dyn_real[3])
-                ((void(*)(void*,const float*))dyn_real[3])(real_primary, cmd->eds_blend.vals);
+                ((void(*)(void*,const float*))dyn_real[3])(real_primary, ((const RcBlend*)d)->vals);
             break;
-        case RCMD_EDS_STENCIL2:
-            if (cmd->eds_stencil2.slot >= 0 && cmd->eds_stencil2.slot < MAX_DYN_WRAPPERS && dyn_real[cmd->eds_stencil2.slot])
-                ((void(*)(void*,uint32_t,uint32_t))dyn_real[cmd->eds_stencil2.slot])(real_primary, cmd->eds_stencil2.face, cmd->eds_stencil2.val);
+        case RCMD_EDS_STENCIL2: {
+            const RcStencil2* c = d;
+            if (c->slot >= 0 && c->slot < MAX_DYN_WRAPPERS && dyn_real[c->slot])
+                ((void(*)(void*,uint32_t,uint32_t))dyn_real[c->slot])(real_primary, c->face, c->val);
             break;
-        case RCMD_EDS_STENCILOP:
+        }
+        case RCMD_EDS_STENCILOP: {
+            const RcStencilOp* c = d;
             if (dyn_real[12])
                 ((void(*)(void*,uint32_t,uint32_t,uint32_t,uint32_t,uint32_t))dyn_real[12])(
-                    real_primary, cmd->eds_stencilop.face, cmd->eds_stencilop.fail,
-                    cmd->eds_stencilop.pass, cmd->eds_stencilop.dfail, cmd->eds_stencilop.cmp);
+                    real_primary, c->face, c->fail, c->pass, c->dfail, c->cmp);
             break;
         }
+        }
     }
 }
 
-/* --- CmdExecuteCommands state logger (uses g_last_vb/ib/ubo defined above) --- */
-static void log_exec_cmds(void* real_primary, uint32_t count, void* const* pSecondary) {
+/* --- CmdExecuteCommands state logger (VB/IB/UBOs bound on the primary) --- */
+static void log_exec_cmds(void* primary, uint32_t count, void* const* pSecondary) {
     static int exec_log_count = 0;
     exec_log_count++;
     if (exec_log_count <= 500) {
-        LOG("CmdExecuteCommands: primary=%p count=%u\n", real_primary, count);
-        if (g_last_vb[0].bound) {
-            LOG("  INHERIT VB0: buf=0x%lx off=%lu stride=%lu\n",
-                (unsigned long)g_last_vb[0].buffer, (unsigned long)g_last_vb[0].offset,
-                (unsigned long)g_last_vb[0].stride);
+        const CmdBufState* cbs = cb_state_peek(primary);
+        LOGT(ICD_LC_CMD, "CmdExecuteCommands: primary=%p count=%u\n", unwrap(primary), count);
+        if (cbs->vb[0].bound) {
+            LOGT(ICD_LC_CMD, "  INHERIT VB0: buf=0x%lx off=%lu stride=%lu\n",
+                (unsigned long)cbs->vb[0].buffer, (unsigned long)cbs->vb[0].offset,
+                (unsigned long)cbs->vb[0].stride);
             /* Read back first vertex to see what data the 576-draw will use */
-            uint64_t stride = g_last_vb[0].stride ? g_last_vb[0].stride : 24;
-            void* vb_ptr = lookup_ubo_ptr(g_last_vb[0].buffer, g_last_vb[0].offset);
+            uint64_t stride = cbs->vb[0].stride ? cbs->vb[0].stride : 24;
+            void* vb_ptr = lookup_ubo_ptr(cbs->vb[0].buffer, cbs->vb[0].offset);
             if (vb_ptr) {
                 float* pos = (float*)vb_ptr;
-                LOG("  INHERIT VB[0] pos=(%.4f, %.4f) VB[1] pos=(%.4f, %.4f)\n",
+                LOGT(ICD_LC_CMD, "  INHERIT VB[0] pos=(%.4f, %.4f) VB[1] pos=(%.4f, %.4f)\n",
                     pos[0], pos[1],
                     *(float*)((uint8_t*)vb_ptr + stride), *(float*)((uint8_t*)vb_ptr + stride + 4));
             }
         }
-        if (g_last_ib_buf) {
-            LOG("  INHERIT IB: buf=0x%lx off=%lu type=%u\n",
-                (unsigned long)g_last_ib_buf, (unsigned long)g_last_ib_off, g_last_ib_type);
+        if (cbs->ib_buf) {
+            LOGT(ICD_LC_CMD, "  INHERIT IB: buf=0x%lx off=%lu type=%u\n",
+                (unsigned long)cbs->ib_buf, (unsigned long)cbs->ib_off, cbs->ib_type);
         }
-        if (g_last_ubo_count > 0) {
-            for (int u = 0; u < g_last_ubo_count && u < 4; u++) {
-                void* ubo_ptr = lookup_ubo_ptr(g_last_ubo[u].buffer, g_last_ubo[u].offset);
+        if (cbs->ubo_count > 0) {
+            for (int u = 0; u < cbs->ubo_count && u < 4; u++) {
+                void* ubo_ptr = lookup_ubo_ptr(cbs->ubo[u].buffer, cbs->ubo[u].offset);
                 if (ubo_ptr) {
                     float* m = (float*)ubo_ptr;
-                    LOG("  INHERIT UBO[%d]: buf=0x%lx off=%lu first4f=[%e %e %e %e]\n",
-                        u, (unsigned long)g_last_ubo[u].buffer,
-                        (unsigned long)g_last_ubo[u].offset, m[0], m[1], m[2], m[3]);
+                    LOGT(ICD_LC_CMD, "  INHERIT UBO[%d]: buf=0x%lx off=%lu first4f=[%e %e %e %e]\n",
+                        u, (unsigned long)cbs->ubo[u].buffer,
+                        (unsigned long)cbs->ubo[u].offset, m[0], m[1], m[2], m[3]);
                 }
             }
         }
         for (uint32_t i = 0; i < count; i++) {
             void* real_s = unwrap((void*)pSecondary[i]);
-            LOG("  secondary[%u]: wrapped=%p real=%p\n", i, pSecondary[i], real_s);
+            LOGT(ICD_LC_CMD, "  secondary[%u]: wrapped=%p real=%p\n", i, pSecondary[i], real_s);
         }
     }
 }
@@ -3845,9 +5339,11 @@ __attribute__((constructor)) static void install_exec_cmds_logger(void) {
     g_inject_vb_ib = inject_vb_ib_state;
 }
 
-/* --- vkCreateGraphicsPipelines --- */
+/* --- vkCreateGraphicsPipelines / vkCreateComputePipelines --- */
 typedef VkResult (*PFN_vkCreateGraphicsPipelines)(void*, uint64_t, uint32_t, const void*, const void*, uint64_t*);
 static PFN_vkCreateGraphicsPipelines real_create_gfx_pipelines = NULL;
+typedef VkResult (*PFN_vkCreateComputePipelines)(void*, uint64_t, uint32_t, const void*, const void*, uint64_t*);
+static PFN_vkCreateComputePipelines real_create_comp_pipelines = NULL;
 
 typedef void (*PFN_vkDestroyShaderModule)(void*, uint64_t, const void*);
 static PFN_vkDestroyShaderModule real_destroy_shader_module = NULL;
@@ -3874,80 +5370,504 @@ static const uint32_t passthrough_vs_spv[] = {
 static const uint64_t passthrough_vs_size = 300;
 
 /* =========================================================================
- * SPIR-V ClipDistance/CullDistance stripping for Mali GPUs.
+ * USCALED/SSCALED Vertex Format Emulation for Mali GPU
  *
- * Mali (via Vortek) doesn't properly handle shaderClipDistance.
- * DXVK generates shaders with OpCapability ClipDistance and
- * OpDecorate %var BuiltIn ClipDistance. If these are present,
- * pipeline compilation produces wrong vertex positions (explosion).
+ * Mali GPUs lack native support for VK_FORMAT_*_USCALED and VK_FORMAT_*_SSCALED
+ * vertex buffer formats. When DXVK uses these formats, Mali misinterprets the
+ * vertex data, causing "exploded vertices" (scattered triangles).
  *
- * Winlator/Vortek 10.0 strips these from SPIR-V. We do the same.
+ * Fix: Remap USCALED→UINT and SSCALED→SINT in the pipeline VIS, then rewrite
+ * the vertex shader SPIR-V to insert OpConvertUToF/OpConvertSToF after loading
+ * the affected input variables.
  *
- * SPIR-V instruction format: word0 = (wordcount << 16) | opcode
- * - OpCapability (17): [opcode, capability]  capability 32=ClipDistance, 33=CullDistance
- * - OpDecorate (71): [opcode, target, decoration, ...]  decoration 11=BuiltIn, builtin 3=ClipDistance, 4=CullDistance
- * - OpMemberDecorate (72): [opcode, structType, member, decoration, ...] same builtins
+ * Reference: Vortek/Winlator "ScaledFormatEmulationPass"
+ * https://leegao.github.io/winlator-internals/2025/06/02/Vortek2.html
+ * ========================================================================= */
+
+#define MAX_SCALED_ATTRS 16
+typedef struct {
+    uint32_t location;
+    int components;   /* 1-4 */
+    int is_signed;    /* 0=USCALED→UINT, 1=SSCALED→SINT */
+} ScaledAttrRemap;
+
+struct ScaledRemapInfo {
+    int count;
+    ScaledAttrRemap attrs[MAX_SCALED_ATTRS];
+};
+
+/* Returns the UINT/SINT equivalent format for a USCALED/SSCALED format.
+ * Returns 0 if the format is not a scaled format.
+ * Sets *is_signed (0=unsigned, 1=signed) and *components (1-4) via out params. */
+static uint32_t remap_scaled_format(uint32_t fmt, int* is_signed, int* components) {
+    switch (fmt) {
+        /* R8_USCALED(11)→R8_UINT(13), R8_SSCALED(12)→R8_SINT(14) */
+        case 11: *is_signed = 0; *components = 1; return 13;
+        case 12: *is_signed = 1; *components = 1; return 14;
+        /* R8G8_USCALED(18)→R8G8_UINT(20), R8G8_SSCALED(19)→R8G8_SINT(21) */
+        case 18: *is_signed = 0; *components = 2; return 20;
+        case 19: *is_signed = 1; *components = 2; return 21;
+        /* R8G8B8_USCALED(25)→R8G8B8_UINT(27), R8G8B8_SSCALED(26)→R8G8B8_SINT(28) */
+        case 25: *is_signed = 0; *components = 3; return 27;
+        case 26: *is_signed = 1; *components = 3; return 28;
+        /* B8G8R8_USCALED(32)→B8G8R8_UINT(34), B8G8R8_SSCALED(33)→B8G8R8_SINT(35) */
+        case 32: *is_signed = 0; *components = 3; return 34;
+        case 33: *is_signed = 1; *components = 3; return 35;
+        /* R8G8B8A8_USCALED(39)→R8G8B8A8_UINT(41), R8G8B8A8_SSCALED(40)→R8G8B8A8_SINT(42) */
+        case 39: *is_signed = 0; *components = 4; return 41;
+        case 40: *is_signed = 1; *components = 4; return 42;
+        /* B8G8R8A8_USCALED(46)→B8G8R8A8_UINT(48), B8G8R8A8_SSCALED(47)→B8G8R8A8_SINT(49) */
+        case 46: *is_signed = 0; *components = 4; return 48;
+        case 47: *is_signed = 1; *components = 4; return 49;
+        /* A8B8G8R8_USCALED(53)→A8B8G8R8_UINT(55), A8B8G8R8_SSCALED(54)→A8B8G8R8_SINT(56) */
+        case 53: *is_signed = 0; *components = 4; return 55;
+        case 54: *is_signed = 1; *components = 4; return 56;
+        /* A2R10G10B10_USCALED(60)→A2R10G10B10_UINT(62), A2R10G10B10_SSCALED(61)→A2R10G10B10_SINT(63) */
+        case 60: *is_signed = 0; *components = 4; return 62;
+        case 61: *is_signed = 1; *components = 4; return 63;
+        /* A2B10G10R10_USCALED(67)→A2B10G10R10_UINT(69), A2B10G10R10_SSCALED(68)→A2B10G10R10_SINT(70) */
+        case 67: *is_signed = 0; *components = 4; return 69;
+        case 68: *is_signed = 1; *components = 4; return 70;
+        /* R16_USCALED(72)→R16_UINT(74), R16_SSCALED(73)→R16_SINT(75) */
+        case 72: *is_signed = 0; *components = 1; return 74;
+        case 73: *is_signed = 1; *components = 1; return 75;
+        /* R16G16_USCALED(79)→R16G16_UINT(81), R16G16_SSCALED(80)→R16G16_SINT(82) */
+        case 79: *is_signed = 0; *components = 2; return 81;
+        case 80: *is_signed = 1; *components = 2; return 82;
+        /* R16G16B16_USCALED(86)→R16G16B16_UINT(88), R16G16B16_SSCALED(87)→R16G16B16_SINT(89) */
+        case 86: *is_signed = 0; *components = 3; return 88;
+        case 87: *is_signed = 1; *components = 3; return 89;
+        /* R16G16B16A16_USCALED(93)→R16G16B16A16_UINT(95), R16G16B16A16_SSCALED(94)→R16G16B16A16_SINT(96) */
+        case 93: *is_signed = 0; *components = 4; return 95;
+        case 94: *is_signed = 1; *components = 4; return 96;
+        default: return 0; /* not a scaled format */
+    }
+}
+
+/* ==== SPIR-V Rewriter ====
  *
- * We NOP out (replace with OpNop = 0x00010000) the following:
- * 1. OpCapability ClipDistance (0x00020011, 0x00000020)
- * 2. OpCapability CullDistance (0x00020011, 0x00000021)
- * 3. OpDecorate with BuiltIn ClipDistance/CullDistance
- * 4. OpMemberDecorate with BuiltIn ClipDistance/CullDistance
+ * All Mali SPIR-V workarounds run as passes over one parsed module instead
+ * of each walking (and some re-copying) the whole module on its own:
+ *   - an instruction index (word offset of every instruction), with the
+ *     instructions of each core opcode chained, so a pass only visits the
+ *     opcodes it rewrites (SPV_EACH);
+ *   - an ID→definition table and per-ID flags (constant / spec constant)
+ *     for the global types, constants and variables;
+ *   - type maps for 32-bit int/float scalars and vectors, shared by every
+ *     pass, so declarations a pass adds are reused by the next one.
+ * Passes never write the input. They record edits against instructions
+ * (patch a word, drop it, insert words after it) and new global
+ * declarations (emitted before the first OpFunction); spv_emit() applies
+ * them all in one copy into a per-thread buffer that is reused across
+ * modules. A new workaround is one more entry in g_spv_passes[].
+ */
+
+#define SPV_OP_BUCKETS  512             /* core opcodes get per-opcode chains */
+#define SPV_MAX_BOUND   (1u << 22)
+#define SPV_NONE        0xFFFFFFFFu
+
+enum { SPV_K_UINT, SPV_K_SINT, SPV_K_FLOAT, SPV_K_COUNT };
+
+#define SPV_ID_CONST    0x1             /* OpConstant / OpSpecConstant */
+#define SPV_ID_SPEC     0x2             /* OpSpecConstant* result (spec-derived) */
+
+enum { SPV_EDIT_PATCH, SPV_EDIT_DROP, SPV_EDIT_INSERT };
+
+typedef struct {
+    uint32_t next;      /* next edit of the same instruction, 0 = end */
+    uint32_t kind;
+    uint32_t a, b;      /* PATCH: word, value; INSERT: offset in extra[], words */
+} SpvEdit;
+
+/* Per-thread scratch, grown on demand and kept for the next module */
+typedef struct {
+    uint32_t* insn;      uint64_t insn_cap;     /* instruction → word offset */
+    uint32_t* op_next;   uint64_t op_next_cap;  /* next instruction with the same opcode */
+    uint32_t* edit_head; uint64_t edit_head_cap;
+    uint32_t* def;       uint64_t def_cap;      /* ID → defining instruction */
+    uint8_t*  id_flags;  uint64_t id_flags_cap;
+    SpvEdit*  edits;     uint64_t edits_cap;
+    uint32_t* extra;     uint64_t extra_cap;    /* inserted words */
+    uint32_t* out;       uint64_t out_cap;
+} SpvPool;
+
+static __thread SpvPool t_spv_pool;
+
+typedef struct {
+    SpvPool* pool;
+    const uint32_t* code;
+    uint32_t nwords;
+    uint32_t id_bound;          /* bound of the input: def/id_flags size */
+    uint32_t bound;             /* grows as passes allocate IDs */
+    uint32_t n_insn;
+    uint32_t first_fn;          /* index of the first OpFunction (n_insn if none) */
+    uint32_t op_head[SPV_OP_BUCKETS];
+    uint32_t op_tail[SPV_OP_BUCKETS];
+    uint32_t n_edits;           /* edits[0] is the chain terminator */
+    uint32_t n_extra;
+    uint32_t decl_head, decl_tail;
+    int64_t delta;              /* output words - input words */
+    int failed;
+    uint32_t scalar[SPV_K_COUNT];       /* OpTypeInt 32 0/1, OpTypeFloat 32 */
+    uint32_t vec[SPV_K_COUNT][5];       /* vectors of those, 2..4 components */
+    uint32_t zero[SPV_K_COUNT][5];      /* int zero constants (1 = scalar) */
+    const ScaledRemapInfo* remap;
+} SpvModule;
+
+#define SPV_EACH(m, op, i) \
+    for (uint32_t i = (m)->op_head[op]; i != SPV_NONE; i = (m)->pool->op_next[i])
+
+static int spv_reserve(void** buf, uint64_t* cap, uint64_t need, size_t elem) {
+    if (need <= *cap) return 1;
+    uint64_t n = *cap ? *cap : 256;
+    while (n < need) n *= 2;
+    void* p = realloc(*buf, n * elem);
+    if (!p) return 0;
+    *buf = p;
+    *cap = n;
+    return 1;
+}
+
+/* Output buffer of the calling thread (also used for cache hits) */
+static uint32_t* spv_pool_out(uint64_t bytes) {
+    SpvPool* p = &t_spv_pool;
+    if (!spv_reserve((void**)&p->out, &p->out_cap, (bytes + 3) / 4, 4)) return NULL;
+    return p->out;
+}
+
+static inline const uint32_t* spv_words(const SpvModule* m, uint32_t insn) {
+    return m->code + m->pool->insn[insn];
+}
+
+static inline uint32_t spv_def(const SpvModule* m, uint32_t id) {
+    return id < m->id_bound ? m->pool->def[id] : SPV_NONE;
+}
+
+static inline uint8_t spv_id_flags(const SpvModule* m, uint32_t id) {
+    return id < m->id_bound ? m->pool->id_flags[id] : 0;
+}
+
+/* Record the global declaration at instruction n (before the first OpFunction) */
+static void spv_note_global(SpvModule* m, uint32_t n, const uint32_t* w) {
+    SpvPool* p = m->pool;
+    uint32_t op = w[0] & 0xFFFF, wc = w[0] >> 16;
+    uint32_t id = 0;
+
+    if (op >= 19 && op <= 39 && wc >= 2) id = w[1];            /* OpType* */
+    else if (((op >= 41 && op <= 52) || op == 59) && wc >= 3) id = w[2];
+    if (!id || id >= m->id_bound) return;
+    p->def[id] = n;
+
+    switch (op) {
+        case 21: /* OpTypeInt: result width signedness */
+            if (wc == 4 && w[2] == 32 && w[3] <= 1)
+                m->scalar[w[3] ? SPV_K_SINT : SPV_K_UINT] = id;
+            break;
+        case 22: /* OpTypeFloat: result width */
+            if (wc >= 3 && w[2] == 32) m->scalar[SPV_K_FLOAT] = id;
+            break;
+        case 23: /* OpTypeVector: result component count */
+            if (wc == 4 && w[3] >= 2 && w[3] <= 4) {
+                for (int k = 0; k < SPV_K_COUNT; k++)
+                    if (m->scalar[k] && w[2] == m->scalar[k]) m->vec[k][w[3]] = id;
+            }
+            break;
+        case 43: /* OpConstant: type result value... */
+            p->id_flags[id] |= SPV_ID_CONST;
+            if (wc == 4 && w[3] == 0) {
+                for (int k = SPV_K_UINT; k <= SPV_K_SINT; k++)
+                    if (m->scalar[k] && w[1] == m->scalar[k] && !m->zero[k][1]) m->zero[k][1] = id;
+            }
+            break;
+        case 48: case 49: case 51: case 52: /* OpSpecConstantTrue/False/Composite/Op */
+            p->id_flags[id] |= SPV_ID_SPEC;
+            break;
+        case 50: /* OpSpecConstant */
+            p->id_flags[id] |= SPV_ID_SPEC | SPV_ID_CONST;
+            break;
+    }
+}
+
+/* Build the index. Returns 0 (leave the module alone) if it isn't valid SPIR-V. */
+static int spv_parse(SpvModule* m, const uint32_t* code, uint64_t size) {
+    SpvPool* p = &t_spv_pool;
+    uint64_t nwords = size / 4;
+    memset(m, 0, sizeof(*m));
+    if (nwords < 5 || nwords > 0xFFFFFFFFu || code[0] != 0x07230203) return 0;
+    if (code[3] == 0 || code[3] > SPV_MAX_BOUND) return 0;
+    if (!spv_reserve((void**)&p->def, &p->def_cap, code[3], 4) ||
+        !spv_reserve((void**)&p->id_flags, &p->id_flags_cap, code[3], 1))
+        return 0;
+
+    m->pool = p;
+    m->code = code;
+    m->nwords = (uint32_t)nwords;
+    m->id_bound = m->bound = code[3];
+    m->first_fn = SPV_NONE;
+    m->n_edits = 1;
+    memset(p->def, 0xFF, (size_t)m->id_bound * 4);
+    memset(p->id_flags, 0, m->id_bound);
+    memset(m->op_head, 0xFF, sizeof(m->op_head));
+
+    uint32_t i = 5, n = 0;
+    while (i < m->nwords) {
+        uint32_t op = code[i] & 0xFFFF, wc = code[i] >> 16;
+        if (wc == 0 || i + wc > m->nwords) return 0;    /* malformed */
+        if (!spv_reserve((void**)&p->insn, &p->insn_cap, n + 1, 4) ||
+            !spv_reserve((void**)&p->op_next, &p->op_next_cap, n + 1, 4))
+            return 0;
+        p->insn[n] = i;
+        p->op_next[n] = SPV_NONE;
+        if (op < SPV_OP_BUCKETS) {
+            if (m->op_head[op] == SPV_NONE) m->op_head[op] = n;
+            else p->op_next[m->op_tail[op]] = n;
+            m->op_tail[op] = n;
+        }
+        if (op == 54 && m->first_fn == SPV_NONE) m->first_fn = n;
+        if (m->first_fn == SPV_NONE) spv_note_global(m, n, code + i);
+        i += wc;
+        n++;
+    }
+    m->n_insn = n;
+    if (m->first_fn == SPV_NONE) m->first_fn = n;
+    if (!spv_reserve((void**)&p->edit_head, &p->edit_head_cap, n + 1, 4)) return 0;
+    memset(p->edit_head, 0, (size_t)(n + 1) * 4);
+    return 1;
+}
+
+static uint32_t spv_new_id(SpvModule* m) {
+    return m->bound++;
+}
+
+/* Append an edit to instruction insn (SPV_NONE: the global declarations) */
+static uint32_t spv_add_edit(SpvModule* m, uint32_t insn, uint32_t kind, uint32_t a, uint32_t b) {
+    SpvPool* p = m->pool;
+    if (!spv_reserve((void**)&p->edits, &p->edits_cap, m->n_edits + 1, sizeof(SpvEdit))) {
+        m->failed = 1;
+        return 0;
+    }
+    uint32_t e = m->n_edits++;
+    p->edits[e] = (SpvEdit){ 0, kind, a, b };
+    if (insn == SPV_NONE) {
+        if (m->decl_tail) p->edits[m->decl_tail].next = e;
+        else m->decl_head = e;
+        m->decl_tail = e;
+    } else {
+        uint32_t* slot = &p->edit_head[insn];
+        while (*slot) slot = &p->edits[*slot].next;
+        *slot = e;
+    }
+    return e;
+}
+
+static void spv_patch(SpvModule* m, uint32_t insn, uint32_t word, uint32_t value) {
+    spv_add_edit(m, insn, SPV_EDIT_PATCH, word, value);
+}
+
+static void spv_drop(SpvModule* m, uint32_t insn) {
+    for (uint32_t e = m->pool->edit_head[insn]; e; e = m->pool->edits[e].next)
+        if (m->pool->edits[e].kind == SPV_EDIT_DROP) return;
+    if (spv_add_edit(m, insn, SPV_EDIT_DROP, 0, 0))
+        m->delta -= spv_words(m, insn)[0] >> 16;
+}
+
+/* Reserve nwords to be emitted after instruction insn (SPV_NONE: as a
+ * global declaration). The pointer is valid until the next insert. */
+static uint32_t* spv_insert(SpvModule* m, uint32_t insn, uint32_t nwords) {
+    SpvPool* p = m->pool;
+    if (!spv_reserve((void**)&p->extra, &p->extra_cap, (uint64_t)m->n_extra + nwords, 4) ||
+        !spv_add_edit(m, insn, SPV_EDIT_INSERT, m->n_extra, nwords)) {
+        m->failed = 1;
+        return NULL;
+    }
+    uint32_t* w = p->extra + m->n_extra;
+    m->n_extra += nwords;
+    m->delta += nwords;
+    return w;
+}
+
+/* ---- Type/constant helpers: return the existing ID or declare one ---- */
+
+static uint32_t spv_type_scalar(SpvModule* m, int k) {
+    if (!m->scalar[k]) {
+        uint32_t* w = spv_insert(m, SPV_NONE, k == SPV_K_FLOAT ? 3 : 4);
+        if (!w) return 0;
+        m->scalar[k] = spv_new_id(m);
+        if (k == SPV_K_FLOAT) {
+            w[0] = (3 << 16) | 22;              /* OpTypeFloat 32 */
+            w[1] = m->scalar[k];
+            w[2] = 32;
+        } else {
+            w[0] = (4 << 16) | 21;              /* OpTypeInt 32 signedness */
+            w[1] = m->scalar[k];
+            w[2] = 32;
+            w[3] = (k == SPV_K_SINT);
+        }
+    }
+    return m->scalar[k];
+}
+
+static uint32_t spv_type_vec(SpvModule* m, int k, int n) {
+    if (n <= 1) return spv_type_scalar(m, k);
+    if (!m->vec[k][n]) {
+        uint32_t comp = spv_type_scalar(m, k);
+        uint32_t* w = comp ? spv_insert(m, SPV_NONE, 4) : NULL;
+        if (!w) return 0;
+        m->vec[k][n] = spv_new_id(m);
+        w[0] = (4 << 16) | 23;                  /* OpTypeVector */
+        w[1] = m->vec[k][n];
+        w[2] = comp;
+        w[3] = n;
+    }
+    return m->vec[k][n];
+}
+
+static uint32_t spv_type_ptr(SpvModule* m, uint32_t storage, uint32_t base) {
+    SpvPool* p = m->pool;
+    SPV_EACH(m, 32, i) {                        /* OpTypePointer: result storage type */
+        const uint32_t* w = spv_words(m, i);
+        if ((w[0] >> 16) == 4 && w[2] == storage && w[3] == base) return w[1];
+    }
+    for (uint32_t e = m->decl_head; e; e = p->edits[e].next) {
+        const uint32_t* w = p->extra + p->edits[e].a;
+        if (w[0] == ((4 << 16) | 32) && w[2] == storage && w[3] == base) return w[1];
+    }
+    uint32_t* w = spv_insert(m, SPV_NONE, 4);
+    if (!w) return 0;
+    w[0] = (4 << 16) | 32;
+    w[1] = spv_new_id(m);
+    w[2] = storage;
+    w[3] = base;
+    return w[1];
+}
+
+/* Zero of the 32-bit int type k with n components (1 = scalar) */
+static uint32_t spv_const_zero(SpvModule* m, int k, int n) {
+    if (m->zero[k][n]) return m->zero[k][n];
+    if (n <= 1) {
+        uint32_t type = spv_type_scalar(m, k);
+        uint32_t* w = type ? spv_insert(m, SPV_NONE, 4) : NULL;
+        if (!w) return 0;
+        m->zero[k][1] = spv_new_id(m);
+        w[0] = (4 << 16) | 43;                  /* OpConstant */
+        w[1] = type;
+        w[2] = m->zero[k][1];
+        w[3] = 0;
+    } else {
+        uint32_t type = spv_type_vec(m, k, n);
+        uint32_t comp = type ? spv_const_zero(m, k, 1) : 0;
+        uint32_t* w = comp ? spv_insert(m, SPV_NONE, 3 + n) : NULL;
+        if (!w) return 0;
+        m->zero[k][n] = spv_new_id(m);
+        w[0] = ((3 + n) << 16) | 44;            /* OpConstantComposite */
+        w[1] = type;
+        w[2] = m->zero[k][n];
+        for (int c = 0; c < n; c++) w[3 + c] = comp;
+    }
+    return m->zero[k][n];
+}
+
+/* Apply every recorded edit in one copy into the thread's output buffer */
+static const uint32_t* spv_emit(SpvModule* m, uint64_t* out_size) {
+    SpvPool* p = m->pool;
+    uint64_t total = (uint64_t)((int64_t)m->nwords + m->delta);
+    uint32_t* out = spv_pool_out(total * 4);
+    if (!out) return NULL;
+
+    memcpy(out, m->code, 5 * 4);
+    out[3] = m->bound;
+    uint64_t o = 5;
+    uint32_t run = 5;                           /* start of the pending unedited words */
+    for (uint32_t i = 0; i <= m->n_insn; i++) {
+        uint32_t at = i < m->n_insn ? p->insn[i] : m->nwords;
+        uint32_t e0 = i < m->n_insn ? p->edit_head[i] : 0;
+        if (e0 || i == m->first_fn || i == m->n_insn) {
+            memcpy(out + o, m->code + run, (size_t)(at - run) * 4);
+            o += at - run;
+            run = at;
+        }
+        if (i == m->first_fn) {
+            for (uint32_t e = m->decl_head; e; e = p->edits[e].next) {
+                memcpy(out + o, p->extra + p->edits[e].a, (size_t)p->edits[e].b * 4);
+                o += p->edits[e].b;
+            }
+        }
+        if (!e0) continue;
+
+        const uint32_t* w = m->code + at;
+        uint32_t wc = w[0] >> 16;
+        int dropped = 0;
+        for (uint32_t e = e0; e; e = p->edits[e].next)
+            if (p->edits[e].kind == SPV_EDIT_DROP) dropped = 1;
+        if (!dropped) {
+            memcpy(out + o, w, (size_t)wc * 4);
+            for (uint32_t e = e0; e; e = p->edits[e].next)
+                if (p->edits[e].kind == SPV_EDIT_PATCH) out[o + p->edits[e].a] = p->edits[e].b;
+            o += wc;
+        }
+        for (uint32_t e = e0; e; e = p->edits[e].next) {
+            if (p->edits[e].kind != SPV_EDIT_INSERT) continue;
+            memcpy(out + o, p->extra + p->edits[e].a, (size_t)p->edits[e].b * 4);
+            o += p->edits[e].b;
+        }
+        run = at + wc;
+    }
+    if (o != total) {
+        LOGE(ICD_LC_SHADER, "SPIRV-REWRITE: emitted %lu words, expected %lu\n",
+            (unsigned long)o, (unsigned long)total);
+        return NULL;
+    }
+    *out_size = total * 4;
+    return out;
+}
+
+/* =========================================================================
+ * Pass: ClipDistance/CullDistance stripping.
+ *
+ * Mali (via Vortek) doesn't properly handle shaderClipDistance.
+ * DXVK generates shaders with OpCapability ClipDistance and
+ * OpDecorate %var BuiltIn ClipDistance. If these are present,
+ * pipeline compilation produces wrong vertex positions (explosion).
+ *
+ * Winlator/Vortek 10.0 strips these from SPIR-V. We do the same, dropping:
+ * 1. OpCapability (17) ClipDistance (32) / CullDistance (33)
+ * 2. OpDecorate (71) with BuiltIn (11) ClipDistance (3) / CullDistance (4)
+ * 3. OpMemberDecorate (72) with the same builtins
  * ========================================================================= */
-static int strip_clip_distance_spirv(uint32_t* code, uint64_t codeSize) {
-    uint64_t nwords = codeSize / 4;
-    if (nwords < 5 || code[0] != 0x07230203) return 0; /* not valid SPIR-V */
+static int spv_pass_strip_clip_distance(SpvModule* m) {
     int changes = 0;
-    uint64_t i = 5; /* skip header (5 words) */
-    while (i < nwords) {
-        uint32_t instr = code[i];
-        uint16_t opcode = instr & 0xFFFF;
-        uint16_t wcount = instr >> 16;
-        if (wcount == 0 || i + wcount > nwords) break; /* malformed */
-
-        if (opcode == 17 && wcount == 2) { /* OpCapability */
-            uint32_t cap = code[i+1];
-            if (cap == 32 || cap == 33) { /* ClipDistance or CullDistance */
-                LOG("  SPIRV-STRIP: OpCapability %s at word %lu\n",
-                    cap == 32 ? "ClipDistance" : "CullDistance", (unsigned long)i);
-                code[i]   = 0x00010000; /* OpNop */
-                code[i+1] = 0x00010000; /* OpNop */
-                changes++;
-            }
+    SPV_EACH(m, 17, i) {
+        const uint32_t* w = spv_words(m, i);
+        if ((w[0] >> 16) == 2 && (w[1] == 32 || w[1] == 33)) {
+            LOGD(ICD_LC_SHADER, "  SPIRV-STRIP: OpCapability %s\n",
+                w[1] == 32 ? "ClipDistance" : "CullDistance");
+            spv_drop(m, i);
+            changes++;
         }
-        else if (opcode == 71 && wcount >= 4) { /* OpDecorate */
-            uint32_t decoration = code[i+2];
-            if (decoration == 11) { /* BuiltIn */
-                uint32_t builtin = code[i+3];
-                if (builtin == 3 || builtin == 4) { /* ClipDistance or CullDistance */
-                    LOG("  SPIRV-STRIP: OpDecorate BuiltIn %s at word %lu\n",
-                        builtin == 3 ? "ClipDistance" : "CullDistance", (unsigned long)i);
-                    for (uint16_t w = 0; w < wcount; w++)
-                        code[i+w] = 0x00010000; /* OpNop */
-                    changes++;
-                }
-            }
+    }
+    SPV_EACH(m, 71, i) {
+        const uint32_t* w = spv_words(m, i);
+        if ((w[0] >> 16) >= 4 && w[2] == 11 && (w[3] == 3 || w[3] == 4)) {
+            LOGD(ICD_LC_SHADER, "  SPIRV-STRIP: OpDecorate %%%u BuiltIn %s\n",
+                w[1], w[3] == 3 ? "ClipDistance" : "CullDistance");
+            spv_drop(m, i);
+            changes++;
         }
-        else if (opcode == 72 && wcount >= 5) { /* OpMemberDecorate */
-            uint32_t decoration = code[i+3];
-            if (decoration == 11) { /* BuiltIn */
-                uint32_t builtin = code[i+4];
-                if (builtin == 3 || builtin == 4) { /* ClipDistance or CullDistance */
-                    LOG("  SPIRV-STRIP: OpMemberDecorate BuiltIn %s at word %lu\n",
-                        builtin == 3 ? "ClipDistance" : "CullDistance", (unsigned long)i);
-                    for (uint16_t w = 0; w < wcount; w++)
-                        code[i+w] = 0x00010000; /* OpNop */
-                    changes++;
-                }
-            }
+    }
+    SPV_EACH(m, 72, i) {
+        const uint32_t* w = spv_words(m, i);
+        if ((w[0] >> 16) >= 5 && w[3] == 11 && (w[4] == 3 || w[4] == 4)) {
+            LOGD(ICD_LC_SHADER, "  SPIRV-STRIP: OpMemberDecorate %%%u.%u BuiltIn %s\n",
+                w[1], w[2], w[4] == 3 ? "ClipDistance" : "CullDistance");
+            spv_drop(m, i);
+            changes++;
         }
-        i += wcount;
     }
     return changes;
 }
 
 /* =========================================================================
- * Mali SPIR-V Fix: OpConstantComposite → OpSpecConstantComposite
+ * Pass: OpConstantComposite → OpSpecConstantComposite
  *
  * Mali's compiler incorrectly constant-folds OpConstantComposite (0x2C)
  * when its operands include specialization constants. DXVK 1.7.3+ generates
@@ -3958,95 +5878,32 @@ static int strip_clip_distance_spirv(uint32_t* code, uint64_t codeSize) {
  *
  * Fix: Replace opcode 0x2C (OpConstantComposite) with 0x33
  * (OpSpecConstantComposite) for composites that reference spec constants.
- *
- * Also adds optimization barriers: replaces OpSelect using spec constants
- * with the non-folded branch to prevent Mali's aggressive optimizer from
- * breaking live code paths.
+ * Constants may only reference earlier ones, so one walk in module order
+ * also catches composites built from converted composites.
  *
  * Reference: Vortek/Winlator "MaliCompositeConstantFixPass"
  * https://leegao.github.io/winlator-internals/2025/08/10/OpCompositeConstant.html
  * ========================================================================= */
-static int fix_mali_spirv(uint32_t* code, uint64_t codeSize) {
-    uint64_t nwords = codeSize / 4;
-    if (nwords < 5 || code[0] != 0x07230203) return 0;
+static int spv_pass_spec_composite(SpvModule* m) {
     int changes = 0;
-
-    /* Pass 1: Find all spec constant IDs (OpSpecConstantTrue/False/Op/Composite).
-     * These are SPIR-V result IDs that hold specialization-derived values. */
-    #define MAX_SPEC_IDS 512
-    uint32_t spec_ids[MAX_SPEC_IDS];
-    int n_spec = 0;
-
-    uint64_t idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-
-        /* OpSpecConstantTrue (0x30), OpSpecConstantFalse (0x31),
-         * OpSpecConstant (0x32), OpSpecConstantComposite (0x33),
-         * OpSpecConstantOp (0x34) — all produce spec-derived result IDs */
-        if (op >= 0x30 && op <= 0x34 && wc >= 3) {
-            uint32_t result_id = code[idx + 2];
-            if (n_spec < MAX_SPEC_IDS)
-                spec_ids[n_spec++] = result_id;
-        }
-        idx += wc;
-    }
-
-    if (n_spec == 0) return 0; /* no spec constants → nothing to fix */
-
-    /* Helper: check if an ID is a spec constant */
-    #define IS_SPEC(id) ({ \
-        int _found = 0; \
-        for (int _j = 0; _j < n_spec; _j++) { \
-            if (spec_ids[_j] == (id)) { _found = 1; break; } \
-        } _found; })
-
-    /* Pass 2: Convert OpConstantComposite → OpSpecConstantComposite
-     * when any operand is a spec constant.
-     * Also propagate: the result of such a composite becomes a spec ID too. */
-    int changed_pass2 = 1;
-    int iter = 0;
-    while (changed_pass2 && iter < 5) { /* iterate to propagate transitively */
-        changed_pass2 = 0;
-        iter++;
-        idx = 5;
-        while (idx < nwords) {
-            uint32_t instr = code[idx];
-            uint16_t op = instr & 0xFFFF;
-            uint16_t wc = instr >> 16;
-            if (wc == 0 || idx + wc > nwords) break;
-
-            if (op == 0x2C && wc >= 4) { /* OpConstantComposite: type(1) result(1) constituents(N) */
-                uint32_t result_id = code[idx + 2];
-                /* Check if any constituent is a spec constant */
-                int has_spec = 0;
-                for (uint16_t c = 3; c < wc; c++) {
-                    if (IS_SPEC(code[idx + c])) { has_spec = 1; break; }
-                }
-                if (has_spec) {
-                    /* Change opcode from 0x2C to 0x33 (preserve word count) */
-                    code[idx] = (code[idx] & 0xFFFF0000) | 0x33;
-                    changes++;
-                    changed_pass2 = 1;
-                    /* The result is now a spec constant too */
-                    if (n_spec < MAX_SPEC_IDS)
-                        spec_ids[n_spec++] = result_id;
-                }
+    SPV_EACH(m, 0x2C, i) {                      /* OpConstantComposite: type result constituents... */
+        const uint32_t* w = spv_words(m, i);
+        uint32_t wc = w[0] >> 16;
+        if (wc < 4 || w[2] >= m->id_bound) continue;
+        for (uint32_t c = 3; c < wc; c++) {
+            if (spv_id_flags(m, w[c]) & SPV_ID_SPEC) {
+                spv_patch(m, i, 0, (w[0] & 0xFFFF0000) | 0x33);
+                m->pool->id_flags[w[2]] |= SPV_ID_SPEC;
+                changes++;
+                break;
             }
-            idx += wc;
         }
     }
-
-    #undef IS_SPEC
-    #undef MAX_SPEC_IDS
     return changes;
 }
 
 /* =========================================================================
- * Mali SPIR-V Fix: Optimization Barrier (OpBitFieldInsert after OpShiftLeftLogical)
+ * Pass: Optimization Barrier (OpBitFieldInsert after OpShiftLeftLogical)
  *
  * Mali's compiler aggressively constant-folds OpShiftLeftLogical when the
  * shift amount is a compile-time constant. This produces incorrect results
@@ -4060,1025 +5917,1514 @@ static int fix_mali_spirv(uint32_t* code, uint64_t codeSize) {
  * OpBitFieldInsert(base, insert, offset=0, count=0) replaces 0 bits = no-op,
  * but Mali's compiler cannot optimize through the opcode boundary.
  *
- * IMPORTANT: This pass GROWS the SPIR-V buffer (7 extra words per barrier).
- * Returns newly allocated buffer, or NULL if no changes needed.
- * Caller must free() the returned buffer.
- *
  * Reference: Vortek/Winlator "MaliOptimizationBarrierPass"
  * ========================================================================= */
-static uint32_t* add_mali_shift_barriers(const uint32_t* code, uint64_t codeSize,
-                                          uint64_t* outSize, int* nBarriersOut) {
-    uint64_t nwords = codeSize / 4;
-    *outSize = codeSize;
-    *nBarriersOut = 0;
-    if (nwords < 5 || code[0] != 0x07230203) return NULL;
-
-    uint32_t bound = code[3];
-
-    /* ---- Pass 1: Collect constant IDs and find integer types ---- */
-    #define BARRIER_MAX_CONST 2048
-    uint32_t const_ids[BARRIER_MAX_CONST];
-    int n_const = 0;
-
-    uint32_t uint_type = 0;   /* OpTypeInt 32 0 */
-    uint32_t int_type  = 0;   /* OpTypeInt 32 1 */
-    uint32_t uint_zero = 0;   /* OpConstant %uint 0 */
-    uint32_t int_zero  = 0;   /* OpConstant %int  0 */
-
-    /* Integer vector types: uvec[N] and svec[N] for N=2,3,4 */
-    uint32_t uvec_type[5] = {0};  /* vec<uint32, N> */
-    uint32_t svec_type[5] = {0};  /* vec<sint32, N> */
-
-    uint64_t idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-
-        /* OpTypeInt: [4|21] result width signedness */
-        if (op == 21 && wc == 4 && code[idx + 2] == 32) {
-            if (code[idx + 3] == 0) uint_type = code[idx + 1];
-            else if (code[idx + 3] == 1) int_type = code[idx + 1];
-        }
-        /* OpTypeVector: [4|23] result comp_type count
-         * SPIR-V guarantees OpTypeInt precedes OpTypeVector that uses it */
-        if (op == 23 && wc == 4) {
-            uint32_t comp = code[idx + 2];
-            uint32_t cnt  = code[idx + 3];
-            if (cnt >= 2 && cnt <= 4) {
-                if (comp == uint_type && uint_type) uvec_type[cnt] = code[idx + 1];
-                if (comp == int_type  && int_type)  svec_type[cnt] = code[idx + 1];
-            }
-        }
-        /* OpConstant: [wc|43] type result value... */
-        if (op == 43 && wc >= 4) {
-            uint32_t tid = code[idx + 1], rid = code[idx + 2];
-            if (n_const < BARRIER_MAX_CONST) const_ids[n_const++] = rid;
-            if (wc == 4 && code[idx + 3] == 0) {
-                if (tid == uint_type && uint_type) uint_zero = rid;
-                else if (tid == int_type && int_type) int_zero = rid;
+static int spv_pass_shift_barriers(SpvModule* m) {
+    int n_barriers = 0;
+    SPV_EACH(m, 196, i) {                       /* OpShiftLeftLogical: type result base shift */
+        const uint32_t* w = spv_words(m, i);
+        if ((w[0] >> 16) != 5 || !(spv_id_flags(m, w[4]) & SPV_ID_CONST)) continue;
+
+        /* Scalar or vector 32-bit integer result */
+        int k = -1, n = 0;
+        for (int kk = SPV_K_UINT; kk <= SPV_K_SINT && k < 0; kk++) {
+            if (w[1] == m->scalar[kk]) { k = kk; n = 1; }
+            for (int c = 2; c <= 4 && k < 0; c++)
+                if (w[1] == m->vec[kk][c]) { k = kk; n = c; }
+        }
+        if (k < 0) continue;
+
+        uint32_t insert_z = spv_const_zero(m, k, n);
+        uint32_t uint_zero = spv_const_zero(m, SPV_K_UINT, 1);
+        uint32_t* b = (insert_z && uint_zero) ? spv_insert(m, i, 7) : NULL;
+        if (!b) break;
+        uint32_t temp_id = spv_new_id(m);
+        spv_patch(m, i, 2, temp_id);            /* shift now defines temp */
+        b[0] = (7 << 16) | 201;                 /* OpBitFieldInsert */
+        b[1] = w[1];                            /* result type     */
+        b[2] = w[2];                            /* original ID     */
+        b[3] = temp_id;                         /* base            */
+        b[4] = insert_z;                        /* insert = 0      */
+        b[5] = uint_zero;                       /* offset = 0      */
+        b[6] = uint_zero;                       /* count  = 0      */
+        n_barriers++;
+    }
+    return n_barriers;
+}
+
+/* =========================================================================
+ * Pass: Emulate USCALED/SSCALED by converting Input types
+ *
+ * For each remapped vertex attribute (m->remap, vertex stages only):
+ *   1. Change the Input variable's pointer type from float→int, and that of
+ *      every OpAccessChain/OpInBoundsAccessChain into it (no index keeps the
+ *      vector, one index points at a component)
+ *   2. After each OpLoad from the variable or one of those chains, insert
+ *      OpConvertUToF/OpConvertSToF back to the type the shader loaded
+ * Variables that are never used are left alone.
+ * ========================================================================= */
+static int spv_pass_scaled_formats(SpvModule* m) {
+    const ScaledRemapInfo* remap = m->remap;
+    if (!remap || remap->count == 0) return 0;
+    if (!m->scalar[SPV_K_FLOAT]) {
+        LOGD(ICD_LC_SHADER, "  SCALED-SPIRV: no OpTypeFloat 32 found, skipping\n");
+        return 0;
+    }
+
+    int n_vars = 0;
+    for (int r = 0; r < remap->count; r++) {
+        const ScaledAttrRemap* a = &remap->attrs[r];
+
+        /* Input variable decorated with this Location (OpDecorate %var Location N) */
+        uint32_t var_id = 0, var_insn = SPV_NONE;
+        SPV_EACH(m, 71, d) {
+            const uint32_t* w = spv_words(m, d);
+            if ((w[0] >> 16) < 4 || w[2] != 30 || w[3] != a->location) continue;
+            uint32_t def = spv_def(m, w[1]);
+            if (def == SPV_NONE) continue;
+            const uint32_t* v = spv_words(m, def);
+            if ((v[0] & 0xFFFF) == 59 && (v[0] >> 16) >= 4 && v[3] == 1) { /* OpVariable Input */
+                var_id = w[1];
+                var_insn = def;
+                break;
             }
         }
-        /* OpSpecConstant: [wc|50] type result value... */
-        if (op == 50 && wc >= 4) {
-            if (n_const < BARRIER_MAX_CONST) const_ids[n_const++] = code[idx + 2];
+        if (!var_id) {
+            LOGD(ICD_LC_SHADER, "  SCALED-SPIRV: no Input variable at location %u, skipping\n",
+                a->location);
+            continue;
         }
-        idx += wc;
-    }
 
-    /* Helper: is id a constant? */
-    #define BARRIER_IS_CONST(id) ({ int _f=0; \
-        for (int _i=0; _i<n_const; _i++) { \
-            if (const_ids[_i]==(id)) { _f=1; break; } \
-        } _f; })
-
-    /* ---- Pass 2: Count qualifying OpShiftLeftLogical (scalar + vector) ---- */
-    int n_barriers = 0;
-    int need_int_shift = 0;        /* need scalar int zero */
-    int need_uvec[5] = {0};        /* need uvecN zero for N=2,3,4 */
-    int need_svec[5] = {0};        /* need svecN zero for N=2,3,4 */
-    idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-
-        /* OpShiftLeftLogical: [5|196] type result base shift */
-        if (op == 196 && wc == 5) {
-            uint32_t rtype = code[idx + 1];
-            uint32_t shift_id = code[idx + 4];
-            if (BARRIER_IS_CONST(shift_id)) {
-                int match = 0;
-                if (rtype == uint_type && uint_type) { match = 1; }
-                else if (rtype == int_type && int_type) { match = 1; need_int_shift = 1; }
-                else {
-                    for (int n = 2; n <= 4; n++) {
-                        if (rtype == uvec_type[n] && uvec_type[n]) { match = 1; need_uvec[n] = 1; break; }
-                        if (rtype == svec_type[n] && svec_type[n]) { match = 1; need_svec[n] = 1; break; }
+        /* Float type the shader loads (pointee of the variable's pointer type) */
+        uint32_t float_type = 0;
+        uint32_t ptr_def = spv_def(m, spv_words(m, var_insn)[1]);
+        if (ptr_def != SPV_NONE && (spv_words(m, ptr_def)[0] & 0xFFFF) == 32)
+            float_type = spv_words(m, ptr_def)[3];
+        if (!float_type) float_type = a->components > 1 ? m->vec[SPV_K_FLOAT][a->components] : 0;
+        if (!float_type) float_type = m->scalar[SPV_K_FLOAT];
+
+        int k = a->is_signed ? SPV_K_SINT : SPV_K_UINT;
+
+        /* The variable and the access chains into it, as pairs of pointer ID
+         * and component count. Chains of chains are picked up by repeating
+         * the walk until nothing new turns up. */
+        uint32_t* ptrs = NULL;
+        uint64_t ptrs_cap = 0;
+        uint32_t n_ptrs = 0;
+        if (!spv_reserve((void**)&ptrs, &ptrs_cap, 2, 4)) break;
+        ptrs[n_ptrs++] = var_id;
+        ptrs[n_ptrs++] = (uint32_t)a->components;
+        int grew = 1, n_chains = 0;
+        while (grew && !m->failed) {
+            grew = 0;
+            for (uint32_t op = 65; op <= 66; op++) {
+                SPV_EACH(m, op, c) {            /* type result base indexes... */
+                    const uint32_t* w = spv_words(m, c);
+                    uint32_t wc = w[0] >> 16, comps = 0, known = 0;
+                    if (wc < 4 || wc > 5) continue;
+                    for (uint32_t j = 0; j < n_ptrs; j += 2) {
+                        if (ptrs[j] == w[3]) comps = ptrs[j + 1];
+                        if (ptrs[j] == w[2]) known = 1;
+                    }
+                    if (!comps || known || (wc == 5 && comps == 1)) continue;
+                    if (wc == 5) comps = 1;
+                    uint32_t chain_ptr = spv_type_ptr(m, 1, spv_type_vec(m, k, (int)comps));
+                    if (!chain_ptr || !spv_reserve((void**)&ptrs, &ptrs_cap, n_ptrs + 2, 4)) {
+                        m->failed = 1;
+                        break;
                     }
+                    spv_patch(m, c, 1, chain_ptr);
+                    ptrs[n_ptrs++] = w[2];
+                    ptrs[n_ptrs++] = comps;
+                    n_chains++;
+                    grew = 1;
                 }
-                if (match) n_barriers++;
             }
         }
-        idx += wc;
-    }
-
-    if (n_barriers == 0) {
-        return NULL;
-    }
 
-    /* ---- Determine extra definitions needed ---- */
-    int need_uint_type = (!uint_type);
-    int need_uint_zero = (!uint_zero);
-    /* Need int_zero for scalar signed shifts AND as component for svecN zeros */
-    int any_signed = need_int_shift;
-    for (int n = 2; n <= 4; n++) { if (need_svec[n]) any_signed = 1; }
-    int need_int_zero = (any_signed && !int_zero);
+        int n_loads = 0;
+        SPV_EACH(m, 61, l) {                    /* OpLoad: type result pointer [access] */
+            if (m->failed) break;
+            const uint32_t* w = spv_words(m, l);
+            uint32_t comps = 0;
+            for (uint32_t j = 0; (w[0] >> 16) >= 4 && j < n_ptrs && !comps; j += 2)
+                if (ptrs[j] == w[3]) comps = ptrs[j + 1];
+            if (!comps) continue;
+            uint32_t load_type = spv_type_vec(m, k, (int)comps);
+            uint32_t* c = load_type ? spv_insert(m, l, 4) : NULL;
+            if (!c) break;
+            uint32_t temp_id = spv_new_id(m);
+            spv_patch(m, l, 1, load_type);
+            spv_patch(m, l, 2, temp_id);
+            c[0] = (4 << 16) | (a->is_signed ? 111 : 112);  /* OpConvertSToF / OpConvertUToF */
+            c[1] = w[1];                        /* the float type the shader loaded */
+            c[2] = w[2];
+            c[3] = temp_id;
+            n_loads++;
+        }
+        free(ptrs);
+        if (m->failed) break;
+        if (!n_loads && !n_chains) continue;
+
+        uint32_t int_ptr = spv_type_ptr(m, 1, spv_type_vec(m, k, a->components));
+        if (!int_ptr) break;
+        /* New types are declared just before the first function, so the
+         * variable moves there too rather than use its type before it */
+        const uint32_t* v = spv_words(m, var_insn);
+        uint32_t* nv = spv_insert(m, SPV_NONE, v[0] >> 16);
+        if (!nv) break;
+        memcpy(nv, v, (size_t)(v[0] >> 16) * 4);
+        nv[1] = int_ptr;
+        spv_drop(m, var_insn);
+        LOGD(ICD_LC_SHADER, "  SCALED-SPIRV: loc=%u var=%%%u float_type=%%%u comps=%d %s, %d loads, %d chains\n",
+            a->location, var_id, float_type, a->components,
+            a->is_signed ? "SINT" : "UINT", n_loads, n_chains);
+        n_vars++;
+    }
+    return n_vars;
+}
+
+typedef int (*SpvPassFn)(SpvModule* m);
+
+static const struct {
+    const char* name;
+    SpvPassFn run;
+} g_spv_passes[] = {
+    { "strip ClipDistance/CullDistance",     spv_pass_strip_clip_distance },
+    { "ConstantComposite→SpecConstant",      spv_pass_spec_composite },
+    { "shift barriers",                      spv_pass_shift_barriers },
+    { "SCALED format emulation",             spv_pass_scaled_formats },
+};
 
-    int extra_words = 0;
-    if (need_uint_type) extra_words += 4;
-    if (need_uint_zero) extra_words += 4;
-    if (need_int_zero)  extra_words += 4;
-    /* Each vector zero: OpConstantComposite = (3+N) words */
-    for (int n = 2; n <= 4; n++) {
-        if (need_uvec[n]) extra_words += (3 + n);
-        if (need_svec[n]) extra_words += (3 + n);
+/* Run every Mali fixup pass over code (remap: vertex stages with SCALED
+ * attributes, else NULL). Returns the rewritten module in the calling
+ * thread's output buffer — valid until the thread's next spv_rewrite or
+ * spv_cache_get, never freed by the caller — or NULL if nothing changed.
+ * *fixes is the number of fixes applied, -1 if the rewrite failed. */
+static const uint32_t* spv_rewrite(const uint32_t* code, uint64_t size,
+                                   const ScaledRemapInfo* remap,
+                                   uint64_t* out_size, int* fixes) {
+    SpvModule m;
+    *out_size = size;
+    *fixes = 0;
+    if (!spv_parse(&m, code, size)) return NULL;
+    m.remap = remap;
+
+    for (size_t i = 0; i < sizeof(g_spv_passes) / sizeof(g_spv_passes[0]) && !m.failed; i++) {
+        int n = g_spv_passes[i].run(&m);
+        if (n > 0) {
+            *fixes += n;
+            LOGD(ICD_LC_SHADER, "  MALI-FIX: %s: %d\n", g_spv_passes[i].name, n);
+        }
+    }
+    if (m.failed) {
+        LOGW(ICD_LC_SHADER, "SPIRV-REWRITE: out of memory, module left unpatched\n");
+        *fixes = -1;
+        return NULL;
     }
+    if (*fixes == 0) return NULL;
 
-    /* ---- Allocate output buffer ---- */
-    uint64_t out_nwords = nwords + (uint64_t)n_barriers * 7 + extra_words;
-    uint32_t* out = (uint32_t*)malloc(out_nwords * 4);
+    const uint32_t* out = spv_emit(&m, out_size);
     if (!out) {
+        *out_size = size;
+        *fixes = -1;
         return NULL;
     }
+    return out;
+}
 
-    /* Assign new IDs */
-    uint32_t next_id = bound;
-    if (need_uint_type) uint_type = next_id++;
-    if (need_uint_zero) uint_zero = next_id++;
-    if (need_int_zero)  int_zero  = next_id++;
-    /* IDs for vector zero constants */
-    uint32_t uvec_zero[5] = {0};
-    uint32_t svec_zero[5] = {0};
-    for (int n = 2; n <= 4; n++) {
-        if (need_uvec[n]) uvec_zero[n] = next_id++;
-        if (need_svec[n]) svec_zero[n] = next_id++;
-    }
-    uint32_t temp_base = next_id;
-    next_id += n_barriers;
-
-    /* Copy header */
-    memcpy(out, code, 5 * 4);
-    out[3] = next_id; /* updated bound */
-
-    /* ---- Pass 3: Copy with barrier insertions ---- */
-    uint64_t oidx = 5;
-    int bidx = 0;
-    int defs_done = 0;
-
-    idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-
-        /* Insert extra type/constant defs right before first OpFunction */
-        if (op == 54 && !defs_done) {
-            defs_done = 1;
-            if (need_uint_type) {
-                out[oidx++] = (4 << 16) | 21; /* OpTypeInt */
-                out[oidx++] = uint_type;
-                out[oidx++] = 32;
-                out[oidx++] = 0;
-            }
-            if (need_uint_zero) {
-                out[oidx++] = (4 << 16) | 43; /* OpConstant */
-                out[oidx++] = uint_type;
-                out[oidx++] = uint_zero;
-                out[oidx++] = 0;
-            }
-            if (need_int_zero) {
-                out[oidx++] = (4 << 16) | 43; /* OpConstant */
-                out[oidx++] = int_type;
-                out[oidx++] = int_zero;
-                out[oidx++] = 0;
-            }
-            /* Emit vector zero constants: OpConstantComposite %vecType zeros... */
-            for (int n = 2; n <= 4; n++) {
-                if (need_uvec[n] && uvec_zero[n]) {
-                    out[oidx++] = ((3 + n) << 16) | 44; /* OpConstantComposite */
-                    out[oidx++] = uvec_type[n];
-                    out[oidx++] = uvec_zero[n];
-                    for (int c = 0; c < n; c++)
-                        out[oidx++] = uint_zero;
-                }
-                if (need_svec[n] && svec_zero[n]) {
-                    out[oidx++] = ((3 + n) << 16) | 44; /* OpConstantComposite */
-                    out[oidx++] = svec_type[n];
-                    out[oidx++] = svec_zero[n];
-                    for (int c = 0; c < n; c++)
-                        out[oidx++] = int_zero;
-                }
-            }
-        }
+/* ==== SPIR-V Fixup Cache ====
+ *
+ * The Mali fixup passes (see "SPIR-V Rewriter") run as JIT'd x86-64 over
+ * every module, and DXVK creates thousands of shaders while loading. Their
+ * output depends only on the input SPIR-V and the scaled-format remap, so it
+ * is cached under a 64-bit hash of both:
+ *   - in memory, an LRU of up to SPV_CACHE_MEM_BYTES of rewritten code;
+ *   - on disk, an append-only file under the Wine prefix
+ *     ($WINEPREFIX/icd_spirv_cache.bin), mmap'd and indexed on first use,
+ *     so later runs skip the rewrite for every shader seen before.
+ * Entries also carry a SHA-256 of the input and remap that a hit must
+ * match, so a colliding hash is a miss and never another shader's code.
+ * Disk entries record when they were last hit; a file past 3/4 of
+ * SPV_CACHE_DISK_MAX is rewritten on open with the most recently used
+ * entries, up to half of it.
+ * Modules the fixups leave alone are cached as "unchanged" entries.
+ * Bump SPV_FIXUP_VERSION whenever a fixup's output changes; it is part of
+ * every key and of the file header. The spirv-opt replacement files are
+ * still checked after the cache, they can appear between runs.
+ */
 
-        /* Qualifying OpShiftLeftLogical? (scalar or vector integer) */
-        if (op == 196 && wc == 5) {
-            uint32_t rtype     = code[idx + 1];
-            uint32_t result_id = code[idx + 2];
-            uint32_t shift_id  = code[idx + 4];
-
-            if (BARRIER_IS_CONST(shift_id)) {
-                /* Determine zero constant for the insert parameter */
-                uint32_t insert_z = 0;
-                if (rtype == uint_type && uint_type)      insert_z = uint_zero;
-                else if (rtype == int_type && int_type)   insert_z = int_zero;
-                else {
-                    for (int n = 2; n <= 4; n++) {
-                        if (rtype == uvec_type[n] && uvec_type[n]) { insert_z = uvec_zero[n]; break; }
-                        if (rtype == svec_type[n] && svec_type[n]) { insert_z = svec_zero[n]; break; }
-                    }
-                }
+#define SPV_FIXUP_VERSION     3
+#define SPV_CACHE_MAGIC       0x43535049   /* "IPSC" */
+#define SPV_CACHE_ENTRY_MAGIC 0x45535049   /* "IPSE" */
+#define SPV_CACHE_MEM_BYTES   (32ULL * 1024 * 1024)
+#define SPV_CACHE_DISK_MAX    (256ULL * 1024 * 1024)
+#define SPV_CACHE_FILE        "icd_spirv_cache.bin"
+#define SPV_CACHE_FORMAT      2
+#define SPV_CACHE_STAMP_SECS  (24 * 3600)   /* granularity of the last-hit time */
 
-                if (insert_z) {
-                    uint32_t temp_id = temp_base + bidx;
-
-                    /* Copy shift with renamed result → temp_id */
-                    memcpy(out + oidx, code + idx, wc * 4);
-                    out[oidx + 2] = temp_id;
-                    oidx += wc;
-
-                    /* Insert OpBitFieldInsert(temp, zero, 0, 0) → original ID
-                     * insert = type-matched zero (scalar or vector)
-                     * offset, count = scalar uint 0 (always) */
-                    out[oidx++] = (7 << 16) | 201; /* OpBitFieldInsert */
-                    out[oidx++] = rtype;             /* result type     */
-                    out[oidx++] = result_id;          /* original ID     */
-                    out[oidx++] = temp_id;            /* base            */
-                    out[oidx++] = insert_z;           /* insert = 0      */
-                    out[oidx++] = uint_zero;          /* offset = 0      */
-                    out[oidx++] = uint_zero;          /* count  = 0      */
-
-                    bidx++;
-                    idx += wc;
-                    continue;
-                }
+typedef struct {
+    uint32_t magic;
+    uint32_t fixup_version;
+    uint32_t header_size;
+    uint32_t format;            /* SPV_CACHE_FORMAT */
+    uint32_t reserved[4];
+} SpvCacheFileHeader;           /* 32 bytes */
+
+/* Followed by out_size bytes of code, padded to 8 */
+typedef struct {
+    uint32_t magic;
+    int32_t fixes;
+    uint64_t key;
+    uint64_t in_size;
+    uint64_t out_size;          /* 0 = module unchanged */
+    uint64_t used;              /* time of the last hit, for compaction */
+    uint8_t digest[32];         /* spv_cache_digest of the input */
+} SpvCacheDiskEntry;            /* 72 bytes */
+
+typedef struct SpvCacheEntry {
+    struct SpvCacheEntry* prev;     /* LRU list, most recent first */
+    struct SpvCacheEntry* next;
+    uint64_t key;
+    uint64_t in_size;
+    uint64_t out_size;
+    int fixes;
+    uint8_t digest[32];
+    uint32_t code[];
+} SpvCacheEntry;
+
+static pthread_once_t g_spv_cache_once = PTHREAD_ONCE_INIT;
+static int g_spv_cache_on = 0;
+static pthread_mutex_t g_spv_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static HandleMap g_spv_cache_mem = HMAP_INIT(SpvCacheEntry*);
+static HandleMap g_spv_cache_disk = HMAP_INIT(uint64_t);   /* key → entry offset in the mapping */
+static SpvCacheEntry* g_spv_lru_head = NULL;
+static SpvCacheEntry* g_spv_lru_tail = NULL;
+static uint64_t g_spv_lru_bytes = 0;
+static const uint8_t* g_spv_disk_map = NULL;
+static int g_spv_disk_fd = -1;
+static uint64_t g_spv_disk_size = 0;
+static uint64_t g_spv_cache_hits = 0, g_spv_cache_disk_hits = 0, g_spv_cache_misses = 0;
+
+static inline uint64_t spv_hash_mix(uint64_t h, uint64_t v) {
+    h ^= v * 0x9E3779B97F4A7C15ULL;
+    h = (h << 31) | (h >> 33);
+    return h * 0xC2B2AE3D27D4EB4FULL;
+}
+
+/* Cache key: the SPIR-V words, the scaled-format remap (vertex stages of
+ * pipelines with USCALED/SSCALED attributes) and SPV_FIXUP_VERSION */
+static uint64_t spv_cache_key(const uint32_t* code, uint64_t size, const ScaledRemapInfo* remap) {
+    uint64_t h = spv_hash_mix(SPV_FIXUP_VERSION, size);
+    uint64_t n = size / 8;
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t w;
+        memcpy(&w, (const uint8_t*)code + i * 8, 8);
+        h = spv_hash_mix(h, w);
+    }
+    if (size & 4) h = spv_hash_mix(h, code[size / 4 - 1]);
+    if (remap && remap->count > 0) {
+        h = spv_hash_mix(h, (uint64_t)remap->count << 32 | 0x5CA1ED);
+        for (int i = 0; i < remap->count && i < MAX_SCALED_ATTRS; i++)
+            h = spv_hash_mix(h, (uint64_t)remap->attrs[i].location << 32 |
+                                (uint32_t)(remap->attrs[i].components << 1 | remap->attrs[i].is_signed));
+    }
+    h ^= h >> 29;
+    return h ? h : 1;   /* 0 is the empty HandleMap key */
+}
+
+/* Plain SHA-256 (FIPS 180-4) for the cache's content check */
+typedef struct {
+    uint32_t h[8];
+    uint8_t buf[64];
+    uint64_t len;
+} Sha256;
+
+static const uint32_t g_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA256_ROR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static void sha256_block(uint32_t* h, const uint8_t* p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = SHA256_ROR(w[i - 15], 7) ^ SHA256_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROR(w[i - 2], 17) ^ SHA256_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (SHA256_ROR(e, 6) ^ SHA256_ROR(e, 11) ^ SHA256_ROR(e, 25)) +
+                      ((e & f) ^ (~e & g)) + g_sha256_k[i] + w[i];
+        uint32_t t2 = (SHA256_ROR(a, 2) ^ SHA256_ROR(a, 13) ^ SHA256_ROR(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+static void sha256_init(Sha256* s) {
+    static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(s->h, iv, sizeof(iv));
+    s->len = 0;
+}
+
+static void sha256_update(Sha256* s, const void* data, size_t n) {
+    const uint8_t* p = (const uint8_t*)data;
+    size_t fill = s->len & 63;
+    s->len += n;
+    if (fill) {
+        size_t take = 64 - fill < n ? 64 - fill : n;
+        memcpy(s->buf + fill, p, take);
+        p += take;
+        n -= take;
+        if (fill + take < 64) return;
+        sha256_block(s->h, s->buf);
+    }
+    for (; n >= 64; p += 64, n -= 64)
+        sha256_block(s->h, p);
+    memcpy(s->buf, p, n);
+}
+
+static void sha256_final(Sha256* s, uint8_t out[32]) {
+    static const uint8_t pad[64] = { 0x80 };
+    uint64_t bits = s->len * 8;
+    size_t fill = s->len & 63;
+    uint8_t len_be[8];
+    for (int i = 0; i < 8; i++)
+        len_be[i] = (uint8_t)(bits >> (56 - 8 * i));
+    sha256_update(s, pad, (fill < 56 ? 56 : 120) - fill);
+    sha256_update(s, len_be, 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (uint8_t)(s->h[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(s->h[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(s->h[i] >> 8);
+        out[4 * i + 3] = (uint8_t)s->h[i];
+    }
+}
+
+/* SHA-256 of everything spv_cache_key hashes; a hit must match it. Only
+ * computed with the cache on, for a key already cached or a new entry. */
+static void spv_cache_digest(const uint32_t* code, uint64_t size, const ScaledRemapInfo* remap,
+                             uint8_t digest[32]) {
+    Sha256 sh;
+    sha256_init(&sh);
+    uint32_t ver[3] = { SPV_FIXUP_VERSION, (uint32_t)size, (uint32_t)(size >> 32) };
+    sha256_update(&sh, ver, sizeof(ver));
+    sha256_update(&sh, code, size);
+    for (int i = 0; remap && i < remap->count && i < MAX_SCALED_ATTRS; i++) {
+        uint32_t a[3] = { remap->attrs[i].location, (uint32_t)remap->attrs[i].components,
+                          (uint32_t)remap->attrs[i].is_signed };
+        sha256_update(&sh, a, sizeof(a));
+    }
+    sha256_final(&sh, digest);
+}
+
+/* Directory the on-disk caches live in: $WINEPREFIX, else ~/.wine */
+static int icd_prefix_dir(char* out, size_t n) {
+    const char* dir = getenv("WINEPREFIX");
+    if (dir && *dir)
+        return snprintf(out, n, "%s", dir) < (int)n;
+    if ((dir = getenv("HOME")) && *dir)
+        return snprintf(out, n, "%s/.wine", dir) < (int)n;
+    return 0;
+}
+
+typedef struct {
+    uint64_t off, len, used;
+} SpvCacheKeep;
+
+static int spv_keep_by_use(const void* a, const void* b) {
+    uint64_t x = ((const SpvCacheKeep*)a)->used, y = ((const SpvCacheKeep*)b)->used;
+    return x < y ? 1 : x > y ? -1 : 0;      /* newest first */
+}
+
+static int spv_keep_by_off(const void* a, const void* b) {
+    uint64_t x = ((const SpvCacheKeep*)a)->off, y = ((const SpvCacheKeep*)b)->off;
+    return x < y ? -1 : x > y;
+}
+
+/* Rewrite <path> with the most recently used indexed entries, up to half of
+ * SPV_CACHE_DISK_MAX, in their original order. Caller holds the file lock
+ * and the mapping of all `size` bytes. Returns 1 if the file was replaced. */
+static int spv_cache_compact(const char* path, uint64_t size) {
+    hmap_rdlock(&g_spv_cache_disk);
+    uint32_t n = 0, cap = g_spv_cache_disk.cap;
+    SpvCacheKeep* keep = (SpvCacheKeep*)malloc((size_t)g_spv_cache_disk.count * sizeof(SpvCacheKeep) + 1);
+    for (uint32_t i = 0; keep && i < cap; i++) {
+        if (!g_spv_cache_disk.keys[i]) continue;
+        uint64_t off = *(uint64_t*)hmap_val(&g_spv_cache_disk, i);
+        const SpvCacheDiskEntry* d = (const SpvCacheDiskEntry*)(g_spv_disk_map + off);
+        keep[n].off = off;
+        keep[n].len = sizeof(*d) + ((d->out_size + 7) & ~7ULL);
+        keep[n].used = d->used;
+        n++;
+    }
+    hmap_unlock(&g_spv_cache_disk);
+    if (!keep) return 0;
+
+    qsort(keep, n, sizeof(*keep), spv_keep_by_use);
+    uint64_t total = sizeof(SpvCacheFileHeader);
+    uint32_t kept = 0;
+    while (kept < n && total + keep[kept].len <= SPV_CACHE_DISK_MAX / 2)
+        total += keep[kept++].len;
+    qsort(keep, kept, sizeof(*keep), spv_keep_by_off);
+
+    char tmp[512 + 24];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int ok = fd >= 0;
+    uint64_t at = sizeof(SpvCacheFileHeader);
+    for (uint32_t i = 0; ok && i < kept; i++) {
+        ok = pwrite(fd, g_spv_disk_map + keep[i].off, keep[i].len, (off_t)at) == (ssize_t)keep[i].len;
+        at += keep[i].len;
+    }
+    if (ok) ok = pwrite(fd, g_spv_disk_map, sizeof(SpvCacheFileHeader), 0) ==
+                 (ssize_t)sizeof(SpvCacheFileHeader);
+    if (fd >= 0) ok = close(fd) == 0 && ok;
+    if (ok && rename(tmp, path) == 0) {
+        LOG("SPIR-V cache: compacted %s, kept %u of %u entries (%llu of %llu KB)\n", path,
+            kept, n, (unsigned long long)(total / 1024), (unsigned long long)(size / 1024));
+    } else {
+        LOGW(ICD_LC_SHADER, "SPIR-V cache: can't compact %s\n", path);
+        unlink(tmp);
+        ok = 0;
+    }
+    free(keep);
+    return ok;
+}
+
+static void spv_cache_open_disk(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOGW(ICD_LC_SHADER, "SPIR-V cache: can't open %s, memory only\n", path);
+        return;
+    }
+    flock(fd, LOCK_EX);
+    struct stat st;
+    uint64_t size = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+    SpvCacheFileHeader hdr;
+    if (size < sizeof(hdr) || pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        hdr.magic != SPV_CACHE_MAGIC || hdr.fixup_version != SPV_FIXUP_VERSION ||
+        hdr.header_size != sizeof(hdr) || hdr.format != SPV_CACHE_FORMAT) {
+        /* New file, or written by other fixups: start over */
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.magic = SPV_CACHE_MAGIC;
+        hdr.fixup_version = SPV_FIXUP_VERSION;
+        hdr.header_size = sizeof(hdr);
+        hdr.format = SPV_CACHE_FORMAT;
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            return;
+        }
+        size = sizeof(hdr);
+    }
+
+    /* Index every complete entry; a torn tail (crash mid-append) is cut off */
+    uint64_t end = sizeof(hdr);
+    uint32_t entries = 0;
+    if (size > sizeof(hdr)) {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            g_spv_disk_map = (const uint8_t*)map;
+            while (end + sizeof(SpvCacheDiskEntry) <= size) {
+                const SpvCacheDiskEntry* d = (const SpvCacheDiskEntry*)(g_spv_disk_map + end);
+                uint64_t len = sizeof(*d) + ((d->out_size + 7) & ~7ULL);
+                if (d->magic != SPV_CACHE_ENTRY_MAGIC || (d->out_size & 3) ||
+                    d->out_size > size || end + len > size)
+                    break;
+                hmap_put(&g_spv_cache_disk, d->key, &end);
+                entries++;
+                end += len;
             }
         }
+        if (end < size && ftruncate(fd, (off_t)end) != 0)
+            end = size;     /* leave it; appends go after the junk */
+    }
+    if (g_spv_disk_map && end > SPV_CACHE_DISK_MAX / 4 * 3 && spv_cache_compact(path, size)) {
+        /* Index the rewritten file instead; it is at most half full */
+        munmap((void*)g_spv_disk_map, size);
+        g_spv_disk_map = NULL;
+        hmap_clear(&g_spv_cache_disk);
+        flock(fd, LOCK_UN);
+        close(fd);
+        spv_cache_open_disk(path);
+        return;
+    }
+    flock(fd, LOCK_UN);
+    g_spv_disk_fd = fd;
+    g_spv_disk_size = end;
+    LOG("SPIR-V cache: %s, %u entries (%llu KB)\n", path, entries,
+        (unsigned long long)(end / 1024));
+}
 
-        /* Default: copy instruction unchanged */
-        memcpy(out + oidx, code + idx, wc * 4);
-        oidx += wc;
-        idx += wc;
+static void spv_cache_init(void) {
+    const char* env = getenv("ICD_SPV_CACHE");
+    if (env && *env == '0') {
+        LOG("SPIR-V cache disabled (ICD_SPV_CACHE=0)\n");
+        return;
     }
+    g_spv_cache_on = 1;
 
-    *outSize = oidx * 4;
-    *nBarriersOut = bidx;
+    char path[512];
+    const char* dir = getenv("ICD_SPV_CACHE_DIR");
+    if (dir && *dir) {
+        snprintf(path, sizeof(path), "%s/" SPV_CACHE_FILE, dir);
+    } else if (icd_prefix_dir(path, sizeof(path) - sizeof("/" SPV_CACHE_FILE))) {
+        strcat(path, "/" SPV_CACHE_FILE);
+    } else {
+        LOG("SPIR-V cache: no prefix directory, memory only\n");
+        return;
+    }
+    spv_cache_open_disk(path);
+}
 
-    #undef BARRIER_IS_CONST
-    #undef BARRIER_MAX_CONST
-    return out;
+static void spv_lru_unlink(SpvCacheEntry* e) {
+    if (e->prev) e->prev->next = e->next; else g_spv_lru_head = e->next;
+    if (e->next) e->next->prev = e->prev; else g_spv_lru_tail = e->prev;
+    e->prev = e->next = NULL;
 }
 
-/* =========================================================================
- * USCALED/SSCALED Vertex Format Emulation for Mali GPU
- *
- * Mali GPUs lack native support for VK_FORMAT_*_USCALED and VK_FORMAT_*_SSCALED
- * vertex buffer formats. When DXVK uses these formats, Mali misinterprets the
- * vertex data, causing "exploded vertices" (scattered triangles).
+static void spv_lru_push_front(SpvCacheEntry* e) {
+    e->prev = NULL;
+    e->next = g_spv_lru_head;
+    if (g_spv_lru_head) g_spv_lru_head->prev = e;
+    g_spv_lru_head = e;
+    if (!g_spv_lru_tail) g_spv_lru_tail = e;
+}
+
+/* Add a result to the memory LRU, evicting the least recently used ones */
+static void spv_cache_insert_locked(uint64_t key, const uint8_t digest[32], uint64_t in_size,
+                                    const uint32_t* code, uint64_t out_size, int fixes) {
+    SpvCacheEntry* e = (SpvCacheEntry*)malloc(sizeof(SpvCacheEntry) + out_size);
+    if (!e) return;
+    e->key = key;
+    e->in_size = in_size;
+    e->out_size = out_size;
+    e->fixes = fixes;
+    memcpy(e->digest, digest, sizeof(e->digest));
+    if (out_size) memcpy(e->code, code, out_size);
+
+    SpvCacheEntry* old = NULL;
+    if (hmap_get(&g_spv_cache_mem, key, &old)) {
+        spv_lru_unlink(old);
+        g_spv_lru_bytes -= sizeof(SpvCacheEntry) + old->out_size;
+        free(old);
+    }
+    if (!hmap_put(&g_spv_cache_mem, key, &e)) {
+        hmap_del(&g_spv_cache_mem, key, NULL);
+        free(e);
+        return;
+    }
+    spv_lru_push_front(e);
+    g_spv_lru_bytes += sizeof(SpvCacheEntry) + out_size;
+    while (g_spv_lru_bytes > SPV_CACHE_MEM_BYTES && g_spv_lru_tail != e) {
+        SpvCacheEntry* victim = g_spv_lru_tail;
+        spv_lru_unlink(victim);
+        hmap_del(&g_spv_cache_mem, victim->key, NULL);
+        g_spv_lru_bytes -= sizeof(SpvCacheEntry) + victim->out_size;
+        free(victim);
+    }
+}
+
+static void spv_cache_report(void) {
+    if (!g_spv_cache_on) return;
+    LOG("SPIR-V cache: %llu hits (%llu from disk), %llu misses, %u in memory (%llu KB)\n",
+        (unsigned long long)__atomic_load_n(&g_spv_cache_hits, __ATOMIC_RELAXED),
+        (unsigned long long)__atomic_load_n(&g_spv_cache_disk_hits, __ATOMIC_RELAXED),
+        (unsigned long long)__atomic_load_n(&g_spv_cache_misses, __ATOMIC_RELAXED),
+        hmap_count(&g_spv_cache_mem), (unsigned long long)(g_spv_lru_bytes / 1024));
+}
+
+/* Look up the fixup result for module `in` (key = spv_cache_key of it). On
+ * a hit, *out is the rewritten code in the calling thread's pooled output
+ * buffer (NULL if the fixups leave it unchanged) and *fixes the number of
+ * fixes the rewrite applied. The buffer belongs to the pool: the caller must
+ * not free it, and it is valid until the thread's next spv_rewrite or
+ * spv_cache_get. */
+static int spv_cache_get(uint64_t key, const uint32_t* in, uint64_t in_size,
+                         const ScaledRemapInfo* remap,
+                         const uint32_t** out, uint64_t* out_size, int* fixes) {
+    pthread_once(&g_spv_cache_once, spv_cache_init);
+    if (!g_spv_cache_on) return 0;
+
+    int hit = 0;
+    SpvCacheEntry* e = NULL;
+    uint64_t off;
+    uint8_t digest[32];
+    /* The digest only confirms a key we already have */
+    if (!hmap_get(&g_spv_cache_mem, key, &e) &&
+        !(g_spv_disk_map && hmap_get(&g_spv_cache_disk, key, &off)))
+        goto count;
+    spv_cache_digest(in, in_size, remap, digest);
+
+    pthread_mutex_lock(&g_spv_cache_lock);
+    if (hmap_get(&g_spv_cache_mem, key, &e) && e->in_size == in_size &&
+        !memcmp(e->digest, digest, sizeof(e->digest))) {
+        spv_lru_unlink(e);
+        spv_lru_push_front(e);
+        hit = 1;
+    } else if (g_spv_disk_map && hmap_get(&g_spv_cache_disk, key, &off)) {
+        const SpvCacheDiskEntry* d = (const SpvCacheDiskEntry*)(g_spv_disk_map + off);
+        if (d->in_size == in_size && !memcmp(d->digest, digest, sizeof(d->digest))) {
+            /* Keep it through the next compaction */
+            uint64_t now = (uint64_t)time(NULL);
+            if (d->used + SPV_CACHE_STAMP_SECS < now &&
+                pwrite(g_spv_disk_fd, &now, sizeof(now),
+                       (off_t)(off + offsetof(SpvCacheDiskEntry, used))) != (ssize_t)sizeof(now))
+                LOGD(ICD_LC_SHADER, "SPIR-V cache: can't update entry at %llu\n",
+                    (unsigned long long)off);
+            spv_cache_insert_locked(key, digest, in_size, (const uint32_t*)(d + 1),
+                                    d->out_size, d->fixes);
+            hit = hmap_get(&g_spv_cache_mem, key, &e);
+            if (hit) __atomic_add_fetch(&g_spv_cache_disk_hits, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (hit) {
+        *out = NULL;
+        if (e->out_size) {
+            uint32_t* buf = spv_pool_out(e->out_size);
+            if (buf) memcpy(buf, e->code, e->out_size);
+            else hit = 0;
+            *out = buf;
+        }
+        *out_size = e->out_size ? e->out_size : in_size;
+        *fixes = e->fixes;
+    }
+    pthread_mutex_unlock(&g_spv_cache_lock);
+
+count:;
+    uint64_t n = hit ? __atomic_add_fetch(&g_spv_cache_hits, 1, __ATOMIC_RELAXED)
+                     : __atomic_add_fetch(&g_spv_cache_misses, 1, __ATOMIC_RELAXED);
+    if ((n & 1023) == 0) spv_cache_report();
+    return hit;
+}
+
+/* Record the fixup result for module `in` (code NULL / fixes 0: unchanged) */
+static void spv_cache_put(uint64_t key, const uint32_t* in, uint64_t in_size,
+                          const ScaledRemapInfo* remap,
+                          const uint32_t* code, uint64_t out_size, int fixes) {
+    if (!g_spv_cache_on) return;
+    if (!code || fixes <= 0) out_size = 0;
+    uint8_t digest[32];
+    spv_cache_digest(in, in_size, remap, digest);
+    pthread_mutex_lock(&g_spv_cache_lock);
+    spv_cache_insert_locked(key, digest, in_size, code, out_size, fixes);
+    pthread_mutex_unlock(&g_spv_cache_lock);
+
+    if (g_spv_disk_fd < 0) return;
+    uint64_t len = sizeof(SpvCacheDiskEntry) + ((out_size + 7) & ~7ULL);
+    if (__atomic_load_n(&g_spv_disk_size, __ATOMIC_RELAXED) + len > SPV_CACHE_DISK_MAX) return;
+    uint8_t* buf = (uint8_t*)calloc(1, len);
+    if (!buf) return;
+    SpvCacheDiskEntry* d = (SpvCacheDiskEntry*)buf;
+    d->magic = SPV_CACHE_ENTRY_MAGIC;
+    d->fixes = fixes;
+    d->key = key;
+    d->in_size = in_size;
+    d->out_size = out_size;
+    d->used = (uint64_t)time(NULL);
+    memcpy(d->digest, digest, sizeof(d->digest));
+    if (out_size) memcpy(d + 1, code, out_size);
+    /* One write per entry under the file lock: other processes sharing the
+     * prefix append to the same file */
+    flock(g_spv_disk_fd, LOCK_EX);
+    off_t end = lseek(g_spv_disk_fd, 0, SEEK_END);
+    if (end > 0 && pwrite(g_spv_disk_fd, buf, len, end) == (ssize_t)len)
+        __atomic_store_n(&g_spv_disk_size, (uint64_t)end + len, __ATOMIC_RELAXED);
+    flock(g_spv_disk_fd, LOCK_UN);
+    free(buf);
+}
+
+/* ==== Pipeline Cache ====
  *
- * Fix: Remap USCALED→UINT and SSCALED→SINT in the pipeline VIS, then rewrite
- * the vertex shader SPIR-V to insert OpConvertUToF/OpConvertSToF after loading
- * the affected input variables.
+ * DXVK creates most pipelines without a VkPipelineCache, so everything Mali
+ * compiles is thrown away when the game exits, and the SPIR-V rewrite means
+ * the driver would not recognise the original shaders anyway. The ICD keeps
+ * its own VkPipelineCache per game: created from a file at device creation,
+ * used by every vkCreate*Pipelines call that passes no cache, and written
+ * back after PCACHE_SAVE_KEYS new pipelines (at most every PCACHE_SAVE_SECS)
+ * and when the last device is destroyed. The file is
+ * $WINEPREFIX/icd_pipeline_cache/<game>.bin, <game> being the application
+ * name DXVK reports (else the executable name).
  *
- * Reference: Vortek/Winlator "ScaledFormatEmulationPass"
- * https://leegao.github.io/winlator-internals/2025/06/02/Vortek2.html
- * ========================================================================= */
+ * Next to the driver's blob the file lists the keys of the pipelines that
+ * went into it, which is what the hit rate is measured against. A key
+ * hashes the post-fixup shaders and the pipeline state, never handles: a
+ * stage contributes its SPIR-V fixup cache key (same input, remap and
+ * SPV_FIXUP_VERSION, same rewritten code), its entry point and its
+ * specialization data. Files written by other fixups are dropped, and so
+ * are the keys of a blob the driver refuses (driver update, other GPU).
+ */
 
-#define MAX_SCALED_ATTRS 16
-typedef struct {
-    uint32_t location;
-    int components;   /* 1-4 */
-    int is_signed;    /* 0=USCALED→UINT, 1=SSCALED→SINT */
-} ScaledAttrRemap;
+#define PCACHE_MAGIC        0x43504349   /* "ICPC" */
+#define PCACHE_VERSION      1
+#define PCACHE_DIR          "icd_pipeline_cache"
+#define PCACHE_SAVE_KEYS    128
+#define PCACHE_SAVE_SECS    60
+#define PCACHE_REPORT_EVERY 256
+#define PCACHE_FILE_MAX     (512ULL * 1024 * 1024)
 
+/* Followed by key_count sorted keys (uint64_t), then blob_size bytes of
+ * vkGetPipelineCacheData output */
 typedef struct {
-    int count;
-    ScaledAttrRemap attrs[MAX_SCALED_ATTRS];
-} ScaledRemapInfo;
-
-/* Returns the UINT/SINT equivalent format for a USCALED/SSCALED format.
- * Returns 0 if the format is not a scaled format.
- * Sets *is_signed (0=unsigned, 1=signed) and *components (1-4) via out params. */
-static uint32_t remap_scaled_format(uint32_t fmt, int* is_signed, int* components) {
-    switch (fmt) {
-        /* R8_USCALED(11)→R8_UINT(13), R8_SSCALED(12)→R8_SINT(14) */
-        case 11: *is_signed = 0; *components = 1; return 13;
-        case 12: *is_signed = 1; *components = 1; return 14;
-        /* R8G8_USCALED(18)→R8G8_UINT(20), R8G8_SSCALED(19)→R8G8_SINT(21) */
-        case 18: *is_signed = 0; *components = 2; return 20;
-        case 19: *is_signed = 1; *components = 2; return 21;
-        /* R8G8B8_USCALED(25)→R8G8B8_UINT(27), R8G8B8_SSCALED(26)→R8G8B8_SINT(28) */
-        case 25: *is_signed = 0; *components = 3; return 27;
-        case 26: *is_signed = 1; *components = 3; return 28;
-        /* B8G8R8_USCALED(32)→B8G8R8_UINT(34), B8G8R8_SSCALED(33)→B8G8R8_SINT(35) */
-        case 32: *is_signed = 0; *components = 3; return 34;
-        case 33: *is_signed = 1; *components = 3; return 35;
-        /* R8G8B8A8_USCALED(39)→R8G8B8A8_UINT(41), R8G8B8A8_SSCALED(40)→R8G8B8A8_SINT(42) */
-        case 39: *is_signed = 0; *components = 4; return 41;
-        case 40: *is_signed = 1; *components = 4; return 42;
-        /* B8G8R8A8_USCALED(46)→B8G8R8A8_UINT(48), B8G8R8A8_SSCALED(47)→B8G8R8A8_SINT(49) */
-        case 46: *is_signed = 0; *components = 4; return 48;
-        case 47: *is_signed = 1; *components = 4; return 49;
-        /* A8B8G8R8_USCALED(53)→A8B8G8R8_UINT(55), A8B8G8R8_SSCALED(54)→A8B8G8R8_SINT(56) */
-        case 53: *is_signed = 0; *components = 4; return 55;
-        case 54: *is_signed = 1; *components = 4; return 56;
-        /* A2R10G10B10_USCALED(60)→A2R10G10B10_UINT(62), A2R10G10B10_SSCALED(61)→A2R10G10B10_SINT(63) */
-        case 60: *is_signed = 0; *components = 4; return 62;
-        case 61: *is_signed = 1; *components = 4; return 63;
-        /* A2B10G10R10_USCALED(67)→A2B10G10R10_UINT(69), A2B10G10R10_SSCALED(68)→A2B10G10R10_SINT(70) */
-        case 67: *is_signed = 0; *components = 4; return 69;
-        case 68: *is_signed = 1; *components = 4; return 70;
-        /* R16_USCALED(72)→R16_UINT(74), R16_SSCALED(73)→R16_SINT(75) */
-        case 72: *is_signed = 0; *components = 1; return 74;
-        case 73: *is_signed = 1; *components = 1; return 75;
-        /* R16G16_USCALED(79)→R16G16_UINT(81), R16G16_SSCALED(80)→R16G16_SINT(82) */
-        case 79: *is_signed = 0; *components = 2; return 81;
-        case 80: *is_signed = 1; *components = 2; return 82;
-        /* R16G16B16_USCALED(86)→R16G16B16_UINT(88), R16G16B16_SSCALED(87)→R16G16B16_SINT(89) */
-        case 86: *is_signed = 0; *components = 3; return 88;
-        case 87: *is_signed = 1; *components = 3; return 89;
-        /* R16G16B16A16_USCALED(93)→R16G16B16A16_UINT(95), R16G16B16A16_SSCALED(94)→R16G16B16A16_SINT(96) */
-        case 93: *is_signed = 0; *components = 4; return 95;
-        case 94: *is_signed = 1; *components = 4; return 96;
-        default: return 0; /* not a scaled format */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fixup_version;
+    uint32_t key_count;
+    uint64_t blob_size;
+    uint64_t reserved;
+} PipeCacheFileHeader;          /* 32 bytes */
+
+typedef VkResult (*PFN_vkCreatePipelineCache)(void*, const void*, const void*, uint64_t*);
+typedef VkResult (*PFN_vkGetPipelineCacheData)(void*, uint64_t, size_t*, void*);
+typedef void (*PFN_vkDestroyPipelineCache)(void*, uint64_t, const void*);
+static PFN_vkCreatePipelineCache real_create_pipeline_cache = NULL;
+static PFN_vkGetPipelineCacheData real_get_pipeline_cache_data = NULL;
+static PFN_vkDestroyPipelineCache real_destroy_pipeline_cache = NULL;
+
+static uint64_t g_pcache = 0;                   /* the ICD's VkPipelineCache, 0 = off */
+static void* g_pcache_device = NULL;
+static char g_pcache_path[512];
+static uint64_t* g_pcache_loaded = NULL;        /* sorted keys from the file */
+static uint32_t g_pcache_loaded_count = 0;
+static HandleMap g_pcache_seen = HMAP_INIT(uint8_t);      /* key → 1, pipelines created this run */
+static HandleMap g_pcache_modules = HMAP_INIT(uint64_t);  /* VkShaderModule → stage code hash */
+static pthread_mutex_t g_pcache_save_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_pcache_hits = 0, g_pcache_misses = 0, g_pcache_untracked = 0;
+static uint32_t g_pcache_unsaved = 0;
+static time_t g_pcache_saved_at = 0;
+
+static PFN_vkVoidFunction resolve_dev_fn(void* real_device, const char* name);
+
+/* pNext chain header, for the pipeline create-info walks below */
+typedef struct { uint32_t sType; uint32_t _pad; void* pNext; } PNBase;
+
+/* ---- Keys ---- */
+
+static uint64_t pcache_mix_bytes(uint64_t h, const void* p, size_t len) {
+    const uint8_t* b = (const uint8_t*)p;
+    h = spv_hash_mix(h, len);
+    for (; len >= 8; len -= 8, b += 8) {
+        uint64_t w;
+        memcpy(&w, b, 8);
+        h = spv_hash_mix(h, w);
+    }
+    if (len) {
+        uint64_t w = 0;
+        memcpy(&w, b, len);
+        h = spv_hash_mix(h, w);
+    }
+    return h;
+}
+
+/* Bytes [from, to) of an optional create-info struct */
+static uint64_t pcache_mix_state(uint64_t h, const void* state, size_t from, size_t to) {
+    if (!state) return spv_hash_mix(h, 0);
+    return pcache_mix_bytes(h, (const uint8_t*)state + from, to - from);
+}
+
+/* Array member of a create-info struct: count at count_off, pointer at ptr_off */
+static uint64_t pcache_mix_array(uint64_t h, const void* state, size_t count_off,
+                                 size_t ptr_off, size_t elem_size) {
+    if (!state) return h;
+    uint32_t n = *(const uint32_t*)((const uint8_t*)state + count_off);
+    const void* arr = *(const void* const*)((const uint8_t*)state + ptr_off);
+    return arr ? pcache_mix_bytes(h, arr, (size_t)n * elem_size) : spv_hash_mix(h, 0);
+}
+
+/* VkPipelineShaderStageCreateInfo: flags(16) stage(20) module(24) pName(32)
+ * pSpecializationInfo(40). Returns 0 for a module the ICD didn't see. */
+static uint64_t pcache_mix_stage(uint64_t h, const uint8_t* st) {
+    uint64_t code = 0;
+    if (!hmap_get(&g_pcache_modules, *(const uint64_t*)(st + 24), &code)) return 0;
+    h = spv_hash_mix(h, code);
+    h = pcache_mix_bytes(h, st + 16, 8);
+    const char* name = *(const char* const*)(st + 32);
+    h = name ? pcache_mix_bytes(h, name, strlen(name)) : spv_hash_mix(h, 0);
+    /* VkSpecializationInfo: mapEntryCount(0) pMapEntries(8, 16 bytes each)
+     * dataSize(16) pData(24) */
+    const uint8_t* spec = *(const uint8_t* const*)(st + 40);
+    if (spec) {
+        h = pcache_mix_array(h, spec, 0, 8, 16);
+        const void* data = *(const void* const*)(spec + 24);
+        if (data) h = pcache_mix_bytes(h, data, *(const uint64_t*)(spec + 16));
+    }
+    return h ? h : 1;
+}
+
+static uint64_t pcache_finish(uint64_t h) {
+    h ^= h >> 29;
+    return h ? h : 1;   /* 0 is the empty HandleMap key */
+}
+
+/* Key of a VkGraphicsPipelineCreateInfo (layout in trace_CreateGraphicsPipelines).
+ * 0 when untracked: pipeline libraries, or a stage module not seen by the ICD. */
+static uint64_t pcache_gfx_key(const uint8_t* ci) {
+    uint32_t stage_count = *(const uint32_t*)(ci + 20);
+    const uint8_t* stages = *(const uint8_t* const*)(ci + 24);
+    if (!stage_count || !stages) return 0;
+    uint64_t h = spv_hash_mix(PCACHE_VERSION, *(const uint32_t*)(ci + 16));
+    for (uint32_t s = 0; s < stage_count; s++)
+        if (!(h = pcache_mix_stage(h, stages + s * 48))) return 0;
+
+    const uint8_t* vis = *(const uint8_t* const*)(ci + 32);
+    h = pcache_mix_array(h, vis, 20, 24, 12);   /* bindings */
+    h = pcache_mix_array(h, vis, 32, 40, 16);   /* attributes (after scaled-format remap) */
+    h = pcache_mix_state(h, *(const void* const*)(ci + 40), 16, 28);    /* input assembly */
+    h = pcache_mix_state(h, *(const void* const*)(ci + 48), 16, 24);    /* tessellation */
+    const uint8_t* vp = *(const uint8_t* const*)(ci + 56);
+    h = pcache_mix_state(h, vp, 20, 24);                                /* viewport count */
+    h = pcache_mix_state(h, vp, 32, 36);                                /* scissor count */
+    h = pcache_mix_state(h, *(const void* const*)(ci + 64), 16, 60);    /* rasterization */
+    const uint8_t* ms = *(const uint8_t* const*)(ci + 72);
+    h = pcache_mix_state(h, ms, 16, 32);
+    h = pcache_mix_state(h, ms, 40, 48);
+    if (ms && *(const void* const*)(ms + 32))                           /* pSampleMask */
+        h = pcache_mix_bytes(h, *(const void* const*)(ms + 32),
+                             (*(const uint32_t*)(ms + 20) + 31) / 32 * 4);
+    /* VkPipelineDepthStencilStateCreateInfo is 104 bytes with no padding:
+     * flags..stencilTestEnable(16..40) front(40) back(68) minDepthBounds(96)
+     * maxDepthBounds(100) */
+    h = pcache_mix_state(h, *(const void* const*)(ci + 80), 16, 104);   /* depth/stencil */
+    const uint8_t* blend = *(const uint8_t* const*)(ci + 88);
+    h = pcache_mix_state(h, blend, 16, 32);
+    h = pcache_mix_state(h, blend, 40, 56);                             /* blendConstants */
+    h = pcache_mix_array(h, blend, 28, 32, 32);                         /* attachments */
+    h = pcache_mix_array(h, *(const void* const*)(ci + 96), 20, 24, 4); /* dynamic states */
+    h = spv_hash_mix(h, *(const uint32_t*)(ci + 120));                  /* subpass */
+
+    /* VkPipelineRenderingCreateInfo: viewMask(16) colorAttachmentCount(20)
+     * pColorAttachmentFormats(24) depthFormat(32) stencilFormat(36) */
+    for (const PNBase* pn = *(const PNBase* const*)(ci + 8); pn; pn = (const PNBase*)pn->pNext) {
+        if (pn->sType != 1000044002) continue;
+        h = pcache_mix_state(h, pn, 16, 24);
+        h = pcache_mix_array(h, pn, 20, 24, 4);
+        h = pcache_mix_state(h, pn, 32, 40);
+    }
+    return pcache_finish(h);
+}
+
+/* Key of a VkComputePipelineCreateInfo: flags(16), stage(24) */
+static uint64_t pcache_compute_key(const uint8_t* ci) {
+    uint64_t h = spv_hash_mix(PCACHE_VERSION, (uint64_t)*(const uint32_t*)(ci + 16) << 32 | 0xC0);
+    if (!(h = pcache_mix_stage(h, ci + 24))) return 0;
+    return pcache_finish(h);
+}
+
+/* Stage hash for a module the ICD created (post-fixup code, see above) */
+static void pcache_note_module(uint64_t module, uint64_t code_hash) {
+    if (g_pcache && module && code_hash) hmap_put(&g_pcache_modules, module, &code_hash);
+}
+
+static void pcache_forget_module(uint64_t module) {
+    if (g_pcache) hmap_del(&g_pcache_modules, module, NULL);
+}
+
+static int pcache_loaded_has(uint64_t key) {
+    uint32_t lo = 0, hi = g_pcache_loaded_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (g_pcache_loaded[mid] == key) return 1;
+        if (g_pcache_loaded[mid] < key) lo = mid + 1;
+        else hi = mid;
     }
+    return 0;
 }
 
-/* =========================================================================
- * SPIR-V Rewriter: Emulate USCALED/SSCALED by converting Input types
- *
- * For each remapped vertex attribute:
- *   1. Change the Input variable's pointer type from float→int
- *   2. After each OpLoad from that variable, insert OpConvertUToF/OpConvertSToF
- *
- * Returns newly allocated SPIR-V buffer, or NULL if no changes needed.
- * Caller must free() the returned buffer.
- * ========================================================================= */
-static uint32_t* emulate_scaled_formats_spirv(const uint32_t* code, uint64_t codeSize,
-                                               const ScaledRemapInfo* remap,
-                                               uint64_t* outSize) {
-    uint64_t nwords = codeSize / 4;
-    *outSize = codeSize;
-    if (nwords < 5 || code[0] != 0x07230203 || remap->count == 0) return NULL;
-
-    uint32_t bound = code[3];
-    uint32_t next_id = bound;
-
-    /* ---- Pass 1: Scan types and variables ---- */
-    #define SCALED_MAX_TYPES 128
-    #define SCALED_MAX_VARS  64
-
-    uint32_t float32_type = 0;     /* OpTypeFloat 32 */
-    uint32_t uint32_type = 0;      /* OpTypeInt 32 0 */
-    uint32_t sint32_type = 0;      /* OpTypeInt 32 1 */
-
-    /* Track float vector types: fvec_type[N] = type ID for vec<float,N> (1=scalar) */
-    uint32_t fvec_type[5] = {0};   /* index 1-4 */
-
-    /* Track int vector types */
-    uint32_t uvec_type[5] = {0};   /* vec<uint,N> */
-    uint32_t svec_type[5] = {0};   /* vec<sint,N> */
-
-    /* Track pointer types: map type_id → base_type_id for Input storage class */
-    struct { uint32_t ptr_id; uint32_t base_id; } ptr_types[SCALED_MAX_TYPES];
-    int n_ptr_types = 0;
-
-    /* Track Input variables: var_id, pointer_type_id */
-    struct { uint32_t var_id; uint32_t ptr_type_id; } input_vars[SCALED_MAX_VARS];
-    int n_input_vars = 0;
-
-    /* Track Location decorations: var_id → location */
-    struct { uint32_t var_id; uint32_t location; } locations[SCALED_MAX_VARS];
-    int n_locations = 0;
-
-    uint64_t idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-
-        switch (op) {
-            case 22: /* OpTypeFloat: [3|22] result width */
-                if (wc == 3 && code[idx + 2] == 32)
-                    float32_type = code[idx + 1];
-                break;
-            case 21: /* OpTypeInt: [4|21] result width signedness */
-                if (wc == 4 && code[idx + 2] == 32) {
-                    if (code[idx + 3] == 0) uint32_type = code[idx + 1];
-                    else sint32_type = code[idx + 1];
-                }
-                break;
-            case 23: /* OpTypeVector: [4|23] result component_type count */
-                if (wc == 4) {
-                    uint32_t comp_type = code[idx + 2];
-                    uint32_t count = code[idx + 3];
-                    if (count >= 1 && count <= 4) {
-                        if (comp_type == float32_type && float32_type)
-                            fvec_type[count] = code[idx + 1];
-                        /* We'll match int vectors after we know uint/sint type IDs */
-                    }
-                }
-                break;
-            case 32: /* OpTypePointer: [4|32] result storage_class base_type */
-                if (wc == 4) {
-                    uint32_t sc = code[idx + 2];
-                    if (sc == 1 && n_ptr_types < SCALED_MAX_TYPES) { /* Input */
-                        ptr_types[n_ptr_types].ptr_id = code[idx + 1];
-                        ptr_types[n_ptr_types].base_id = code[idx + 3];
-                        n_ptr_types++;
-                    }
-                }
-                break;
-            case 59: /* OpVariable: [4|59] result_type result storage_class */
-                if (wc >= 4 && code[idx + 3] == 1 && n_input_vars < SCALED_MAX_VARS) { /* Input */
-                    input_vars[n_input_vars].var_id = code[idx + 2];
-                    input_vars[n_input_vars].ptr_type_id = code[idx + 1];
-                    n_input_vars++;
-                }
-                break;
-            case 71: /* OpDecorate: [wc|71] target decoration [operands...] */
-                if (wc >= 4 && code[idx + 2] == 30 && n_locations < SCALED_MAX_VARS) { /* Location */
-                    locations[n_locations].var_id = code[idx + 1];
-                    locations[n_locations].location = code[idx + 3];
-                    n_locations++;
-                }
-                break;
-        }
-        idx += wc;
-    }
-
-    /* Also scan for existing int vector types */
-    idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-        if (op == 23 && wc == 4) { /* OpTypeVector */
-            uint32_t comp_type = code[idx + 2];
-            uint32_t count = code[idx + 3];
-            if (count >= 1 && count <= 4) {
-                if (comp_type == uint32_type && uint32_type)
-                    uvec_type[count] = code[idx + 1];
-                if (comp_type == sint32_type && sint32_type)
-                    svec_type[count] = code[idx + 1];
-            }
+static int pcache_key_cmp(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* ---- File ---- */
+
+/* <game> part of the file name: the application name, else the executable */
+static void pcache_game_name(char* out, size_t n) {
+    char buf[256] = "";
+    if (g_app_name[0]) {
+        snprintf(buf, sizeof(buf), "%s", g_app_name);
+    } else {
+        int fd = open("/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ssize_t len = read(fd, buf, sizeof(buf) - 1);
+            buf[len > 0 ? len : 0] = 0;
+            close(fd);
+        }
+    }
+    /* Wine passes Windows paths: strip either kind of directory */
+    const char* base = buf;
+    for (const char* c = buf; *c; c++)
+        if (*c == '/' || *c == '\\') base = c + 1;
+    size_t k = 0;
+    for (; base[k] && k + 1 < n; k++) {
+        char c = base[k];
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                 (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '_';
+        out[k] = ok ? c : '_';
+    }
+    out[k] = 0;
+    if (!k) snprintf(out, n, "default");
+}
+
+static int pcache_write_all(int fd, const void* p, size_t len) {
+    const uint8_t* b = (const uint8_t*)p;
+    while (len) {
+        ssize_t w = write(fd, b, len);
+        if (w <= 0) return 0;
+        b += w;
+        len -= (size_t)w;
+    }
+    return 1;
+}
+
+/* Write the driver's blob and the keys of the pipelines in it to a temp
+ * file, then rename it over the cache file. wait=0 (periodic save from a
+ * pipeline call) skips if another save is running. */
+static void pcache_save(int wait) {
+    if (wait) pthread_mutex_lock(&g_pcache_save_lock);
+    else if (pthread_mutex_trylock(&g_pcache_save_lock) != 0) return;
+    if (!g_pcache) {
+        pthread_mutex_unlock(&g_pcache_save_lock);
+        return;
+    }
+
+    /* Keys first: every pipeline they name is in the cache by the time
+     * the blob is read */
+    __atomic_store_n(&g_pcache_unsaved, 0, __ATOMIC_RELAXED);
+    g_pcache_saved_at = time(NULL);
+    hmap_rdlock(&g_pcache_seen);
+    uint32_t cap = g_pcache_loaded_count + g_pcache_seen.count;
+    uint64_t* keys = (uint64_t*)malloc(((size_t)cap + 1) * sizeof(uint64_t));
+    uint32_t n = 0;
+    if (keys) {
+        memcpy(keys, g_pcache_loaded, (size_t)g_pcache_loaded_count * sizeof(uint64_t));
+        n = g_pcache_loaded_count;
+        for (uint32_t i = 0; i < g_pcache_seen.cap; i++)
+            if (g_pcache_seen.keys[i]) keys[n++] = g_pcache_seen.keys[i];
+    }
+    hmap_unlock(&g_pcache_seen);
+
+    size_t size = 0;
+    uint8_t* blob = NULL;
+    VkResult r = keys ? real_get_pipeline_cache_data(g_pcache_device, g_pcache, &size, NULL) : -1;
+    if (r == 0 && size && size <= PCACHE_FILE_MAX && (blob = (uint8_t*)malloc(size)))
+        r = real_get_pipeline_cache_data(g_pcache_device, g_pcache, &size, blob);
+    if (r != 0 || !blob) {
+        LOGW(ICD_LC_PIPE, "Pipeline cache: can't read cache data (%d, %zu bytes), not saved\n", r, size);
+        goto out;
+    }
+
+    qsort(keys, n, sizeof(uint64_t), pcache_key_cmp);
+    uint32_t uniq = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (!uniq || keys[uniq - 1] != keys[i]) keys[uniq++] = keys[i];
+
+    PipeCacheFileHeader hdr = { PCACHE_MAGIC, PCACHE_VERSION, SPV_FIXUP_VERSION,
+                                uniq, size, 0 };
+    char tmp[sizeof(g_pcache_path) + 24];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", g_pcache_path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int ok = fd >= 0 &&
+             pcache_write_all(fd, &hdr, sizeof(hdr)) &&
+             pcache_write_all(fd, keys, (size_t)uniq * sizeof(uint64_t)) &&
+             pcache_write_all(fd, blob, size);
+    if (fd >= 0) ok = close(fd) == 0 && ok;
+    if (ok && rename(tmp, g_pcache_path) == 0) {
+        LOGI(ICD_LC_PIPE, "Pipeline cache: saved %u pipelines, %zu KB to %s\n",
+            uniq, size / 1024, g_pcache_path);
+    } else {
+        LOGW(ICD_LC_PIPE, "Pipeline cache: can't write %s\n", tmp);
+        unlink(tmp);
+    }
+
+out:
+    free(blob);
+    free(keys);
+    pthread_mutex_unlock(&g_pcache_save_lock);
+}
+
+/* Read <path>: the initial data for the cache and the keys it holds.
+ * Returns a malloc'd copy of the whole file, NULL if missing or stale. */
+static uint8_t* pcache_read_file(const char* path, PipeCacheFileHeader* hdr) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    uint8_t* data = NULL;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(*hdr) &&
+        (uint64_t)st.st_size <= PCACHE_FILE_MAX &&
+        (data = (uint8_t*)malloc(st.st_size)) &&
+        pread(fd, data, st.st_size, 0) == st.st_size) {
+        memcpy(hdr, data, sizeof(*hdr));
+        if (hdr->magic != PCACHE_MAGIC || hdr->version != PCACHE_VERSION ||
+            sizeof(*hdr) + (uint64_t)hdr->key_count * 8 + hdr->blob_size != (uint64_t)st.st_size) {
+            LOGW(ICD_LC_PIPE, "Pipeline cache: %s is not a cache file, starting over\n", path);
+        } else if (hdr->fixup_version != SPV_FIXUP_VERSION) {
+            LOG("Pipeline cache: %s was built with other SPIR-V fixups, starting over\n", path);
+        } else {
+            close(fd);
+            return data;
         }
-        idx += wc;
     }
+    free(data);
+    close(fd);
+    return NULL;
+}
 
-    if (!float32_type) {
-        LOG("  SCALED-SPIRV: no OpTypeFloat 32 found, skipping\n");
-        return NULL;
+/* ---- Device lifetime ---- */
+
+/* Create the ICD's cache on a new real device, seeded from the game's file */
+static void pcache_open(void* real_device) {
+    const char* env = getenv("ICD_PIPELINE_CACHE");
+    if (env && *env == '0') {
+        LOG("Pipeline cache disabled (ICD_PIPELINE_CACHE=0)\n");
+        return;
+    }
+    real_create_pipeline_cache = (PFN_vkCreatePipelineCache)resolve_dev_fn(real_device, "vkCreatePipelineCache");
+    real_get_pipeline_cache_data = (PFN_vkGetPipelineCacheData)resolve_dev_fn(real_device, "vkGetPipelineCacheData");
+    real_destroy_pipeline_cache = (PFN_vkDestroyPipelineCache)resolve_dev_fn(real_device, "vkDestroyPipelineCache");
+    if (!real_create_pipeline_cache || !real_get_pipeline_cache_data || !real_destroy_pipeline_cache) {
+        LOGW(ICD_LC_PIPE, "Pipeline cache: vkCreatePipelineCache & co unavailable\n");
+        return;
     }
 
-    /* ---- Pass 2: Match variables to remap targets ---- */
-    struct {
-        uint32_t var_id;
-        uint32_t float_type;    /* current float/vec type */
-        uint32_t int_type;      /* target int/ivec type (may need creation) */
-        uint32_t int_ptr_type;  /* target pointer type (may need creation) */
-        int components;
-        int is_signed;
-        int need_int_type;      /* 1 if we need to create int vector type */
-        int need_ptr_type;      /* 1 if we need to create pointer type */
-    } remap_vars[MAX_SCALED_ATTRS];
-    int n_remap_vars = 0;
+    char dir[400], game[64];
+    const char* env_dir = getenv("ICD_PIPELINE_CACHE_DIR");
+    if (env_dir && *env_dir) {
+        snprintf(dir, sizeof(dir), "%s", env_dir);
+    } else if (icd_prefix_dir(dir, sizeof(dir) - sizeof("/" PCACHE_DIR))) {
+        strcat(dir, "/" PCACHE_DIR);
+    } else {
+        LOG("Pipeline cache: no prefix directory, disabled\n");
+        return;
+    }
+    mkdir(dir, 0755);
+    pcache_game_name(game, sizeof(game));
+    snprintf(g_pcache_path, sizeof(g_pcache_path), "%s/%s.bin", dir, game);
+
+    PipeCacheFileHeader hdr;
+    uint8_t* file = pcache_read_file(g_pcache_path, &hdr);
+    const uint8_t* blob = file ? file + sizeof(hdr) + (size_t)hdr.key_count * 8 : NULL;
+
+    /* VkPipelineCacheCreateInfo: sType(4) pad(4) pNext(8) flags(4) pad(4)
+     * initialDataSize(8) pInitialData(8) */
+    uint8_t ci[40];
+    memset(ci, 0, sizeof(ci));
+    *(uint32_t*)ci = 17;    /* VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO */
+    *(uint64_t*)(ci + 24) = blob ? hdr.blob_size : 0;
+    *(const void**)(ci + 32) = blob;
+    uint64_t cache = 0;
+    VkResult r = real_create_pipeline_cache(real_device, ci, NULL, &cache);
+    if (r != 0 && blob) {
+        LOGW(ICD_LC_PIPE, "Pipeline cache: driver refused %s (%d), starting over\n", g_pcache_path, r);
+        blob = NULL;
+        memset(ci + 24, 0, 16);
+        r = real_create_pipeline_cache(real_device, ci, NULL, &cache);
+    }
+    if (r != 0 || !cache) {
+        LOGW(ICD_LC_PIPE, "Pipeline cache: vkCreatePipelineCache failed (%d), disabled\n", r);
+        free(file);
+        return;
+    }
 
-    for (int r = 0; r < remap->count; r++) {
-        uint32_t target_loc = remap->attrs[r].location;
-        int comps = remap->attrs[r].components;
-        int is_signed = remap->attrs[r].is_signed;
-
-        /* Find variable at this location */
-        uint32_t var_id = 0;
-        uint32_t var_ptr_type = 0;
-        for (int v = 0; v < n_input_vars; v++) {
-            for (int l = 0; l < n_locations; l++) {
-                if (locations[l].var_id == input_vars[v].var_id &&
-                    locations[l].location == target_loc) {
-                    var_id = input_vars[v].var_id;
-                    var_ptr_type = input_vars[v].ptr_type_id;
-                    break;
-                }
-            }
-            if (var_id) break;
-        }
-        if (!var_id) {
-            LOG("  SCALED-SPIRV: no Input variable at location %u, skipping\n", target_loc);
+    /* A blob from another driver or GPU is silently ignored: the cache
+     * comes back with nothing but the header (VkPipelineCacheHeaderVersionOne,
+     * whose size is its first word) */
+    if (blob && hdr.blob_size >= 4) {
+        size_t size = 0;
+        uint32_t header_size = *(const uint32_t*)blob;
+        if (hdr.blob_size > header_size &&
+            real_get_pipeline_cache_data(real_device, cache, &size, NULL) == 0 &&
+            size <= header_size) {
+            LOG("Pipeline cache: driver ignored the blob in %s (other driver?), starting over\n",
+                g_pcache_path);
+            blob = NULL;
+        }
+    }
+    if (blob && hdr.key_count) {
+        g_pcache_loaded = (uint64_t*)malloc((size_t)hdr.key_count * 8);
+        if (g_pcache_loaded) {
+            memcpy(g_pcache_loaded, file + sizeof(hdr), (size_t)hdr.key_count * 8);
+            g_pcache_loaded_count = hdr.key_count;
+        }
+    }
+    LOG("Pipeline cache: %s, %u pipelines (%llu KB)\n", g_pcache_path, g_pcache_loaded_count,
+        blob ? (unsigned long long)(hdr.blob_size / 1024) : 0ULL);
+    free(file);
+
+    g_pcache_device = real_device;
+    g_pcache_saved_at = time(NULL);
+    g_pcache = cache;
+}
+
+static void pcache_report(void) {
+    uint64_t hits = __atomic_load_n(&g_pcache_hits, __ATOMIC_RELAXED);
+    uint64_t misses = __atomic_load_n(&g_pcache_misses, __ATOMIC_RELAXED);
+    LOG("Pipeline cache: %llu hits, %llu misses (%.1f%% hit rate), %llu untracked, "
+        "%u pipelines from the file\n",
+        (unsigned long long)hits, (unsigned long long)misses,
+        hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+        (unsigned long long)__atomic_load_n(&g_pcache_untracked, __ATOMIC_RELAXED),
+        g_pcache_loaded_count);
+}
+
+/* Save and destroy the cache before the real device goes away */
+static void pcache_close(void) {
+    if (!g_pcache) return;
+    pcache_report();
+    pcache_save(1);
+    pthread_mutex_lock(&g_pcache_save_lock);
+    real_destroy_pipeline_cache(g_pcache_device, g_pcache, NULL);
+    g_pcache = 0;
+    g_pcache_device = NULL;
+    free(g_pcache_loaded);
+    g_pcache_loaded = NULL;
+    g_pcache_loaded_count = 0;
+    g_pcache_hits = g_pcache_misses = g_pcache_untracked = 0;
+    g_pcache_unsaved = 0;
+    pthread_mutex_unlock(&g_pcache_save_lock);
+    hmap_clear(&g_pcache_seen);
+    hmap_clear(&g_pcache_modules);
+}
+
+/* ---- Pipeline creation ---- */
+
+/* Count the pipelines a vkCreate*Pipelines call created as hits (key in the
+ * file) or misses, once per key and run; save once enough are new */
+static void pcache_account(const void* pCreateInfos, uint32_t count, int compute,
+                           const uint64_t* pPipelines) {
+    if (!g_pcache || !pPipelines) return;
+    uint32_t fresh = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!pPipelines[i]) continue;
+        const uint8_t* ci = (const uint8_t*)pCreateInfos + (size_t)i * (compute ? 96 : 144);
+        uint64_t key = compute ? pcache_compute_key(ci) : pcache_gfx_key(ci);
+        if (!key) {
+            __atomic_add_fetch(&g_pcache_untracked, 1, __ATOMIC_RELAXED);
             continue;
         }
+        hmap_wrlock(&g_pcache_seen);
+        int first = !hmap_find_locked(&g_pcache_seen, key);
+        uint8_t* v = first ? (uint8_t*)hmap_insert_locked(&g_pcache_seen, key) : NULL;
+        if (v) *v = 1;
+        hmap_unlock(&g_pcache_seen);
+        if (!first) continue;
 
-        /* Find the base float type through the pointer */
-        uint32_t base_float = 0;
-        for (int p = 0; p < n_ptr_types; p++) {
-            if (ptr_types[p].ptr_id == var_ptr_type) {
-                base_float = ptr_types[p].base_id;
-                break;
-            }
-        }
+        int hit = pcache_loaded_has(key);
+        uint64_t n = __atomic_add_fetch(hit ? &g_pcache_hits : &g_pcache_misses, 1, __ATOMIC_RELAXED);
+        if (!hit) fresh++;
+        if ((__atomic_load_n(hit ? &g_pcache_misses : &g_pcache_hits, __ATOMIC_RELAXED) + n) %
+            PCACHE_REPORT_EVERY == 0)
+            pcache_report();
+    }
+    if (fresh &&
+        __atomic_add_fetch(&g_pcache_unsaved, fresh, __ATOMIC_RELAXED) >= PCACHE_SAVE_KEYS &&
+        time(NULL) - g_pcache_saved_at >= PCACHE_SAVE_SECS)
+        pcache_save(0);
+}
 
-        /* Determine the integer type we need */
-        uint32_t* ivec_arr = is_signed ? svec_type : uvec_type;
-        uint32_t int_base = is_signed ? sint32_type : uint32_type;
-        uint32_t target_int_type = ivec_arr[comps];
-        int need_int_type = 0;
-        int need_ptr_type = 1;
-
-        if (!int_base) need_int_type = 1; /* need to create OpTypeInt */
-        if (comps > 1 && !target_int_type) need_int_type = 1; /* need to create vector type */
-        if (comps == 1 && int_base) target_int_type = int_base;
-
-        /* Check if pointer type already exists */
-        uint32_t target_ptr_type = 0;
-        if (target_int_type) {
-            for (int p = 0; p < n_ptr_types; p++) {
-                if (ptr_types[p].base_id == target_int_type) {
-                    target_ptr_type = ptr_types[p].ptr_id;
-                    need_ptr_type = 0;
-                    break;
-                }
-            }
-        }
+/* ==== Pipeline Worker Pool ====
+ *
+ * vkCreate*Pipelines used to do everything on DXVK's calling thread: the
+ * inline-shader fixups, one thunk round trip per inline shader module, then
+ * one round trip for the whole batch. Now each call fans out into
+ * independent items (one per inline shader stage, then, for batches that
+ * can be split, one per pipeline) that run on a worker pool (see
+ * "Worker Pools") with the caller helping, so stages and pipelines go
+ * through the thunk and Vortek concurrently, next to the calls DXVK's own
+ * compiler threads make. Everything these paths share is safe to use from several threads:
+ *   - g_pipe_vis is a locked HandleMap;
+ *   - the SPIR-V fixup cache has its own lock;
+ *   - rewrite scratch is per thread;
+ *   - temp module lists are per call.
+ *
+ * ICD_PIPE_WORKERS=N sets the pool size (default: CPUs - 1, at most
+ * PIPE_POOL_MAX). ICD_PIPE_WORKERS=0 runs everything on the caller as before.
+ */
 
-        remap_vars[n_remap_vars].var_id = var_id;
-        remap_vars[n_remap_vars].float_type = base_float;
-        remap_vars[n_remap_vars].int_type = target_int_type;
-        remap_vars[n_remap_vars].int_ptr_type = target_ptr_type;
-        remap_vars[n_remap_vars].components = comps;
-        remap_vars[n_remap_vars].is_signed = is_signed;
-        remap_vars[n_remap_vars].need_int_type = need_int_type;
-        remap_vars[n_remap_vars].need_ptr_type = need_ptr_type;
-        n_remap_vars++;
-
-        LOG("  SCALED-SPIRV: loc=%u var=%%%u float_type=%%%u comps=%d %s need_create=%d,%d\n",
-            target_loc, var_id, base_float, comps,
-            is_signed ? "SINT" : "UINT",
-            need_int_type, need_ptr_type);
-    }
-
-    if (n_remap_vars == 0) return NULL;
-
-    /* ---- Pass 3: Count OpLoads from remapped variables ---- */
-    int n_loads = 0;
-    idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-        if (op == 61 && wc >= 4) { /* OpLoad: [4|61] result_type result pointer */
-            uint32_t ptr_id = code[idx + 3];
-            for (int v = 0; v < n_remap_vars; v++) {
-                if (remap_vars[v].var_id == ptr_id) {
-                    n_loads++;
-                    break;
-                }
-            }
-        }
-        idx += wc;
-    }
+#define PIPE_POOL_MAX 8
 
-    LOG("  SCALED-SPIRV: %d vars to remap, %d loads to patch\n", n_remap_vars, n_loads);
-    if (n_loads == 0) return NULL;
+static WorkerPool g_pipe_pool = WORKER_POOL_INIT("Pipeline worker", "ICD_PIPE_WORKERS", PIPE_POOL_MAX);
 
-    /* ---- Allocate new type IDs ---- */
-    int new_type_words = 0;
-    for (int v = 0; v < n_remap_vars; v++) {
-        if (remap_vars[v].need_int_type) {
-            uint32_t int_base = remap_vars[v].is_signed ? sint32_type : uint32_type;
-            if (!int_base) {
-                /* Need to create OpTypeInt 32 0/1: 4 words */
-                uint32_t new_int = next_id++;
-                if (remap_vars[v].is_signed) sint32_type = new_int;
-                else uint32_type = new_int;
-                int_base = new_int;
-                new_type_words += 4;
-            }
-            if (remap_vars[v].components > 1) {
-                /* Need to create OpTypeVector: 4 words */
-                uint32_t new_vec = next_id++;
-                if (remap_vars[v].is_signed) svec_type[remap_vars[v].components] = new_vec;
-                else uvec_type[remap_vars[v].components] = new_vec;
-                remap_vars[v].int_type = new_vec;
-                new_type_words += 4;
-            } else {
-                remap_vars[v].int_type = int_base;
-            }
+/* ---- Inline shader stages ---- */
+
+typedef struct {
+    uint8_t* stage;     /* VkPipelineShaderStageCreateInfo */
+    PNBase* pn;         /* its inline VkShaderModuleCreateInfo (sType=16) */
+    uint32_t pipe;      /* index into the batch (remap_info) */
+    uint32_t s;         /* stage index, for logs */
+    uint64_t module;    /* created module, 0 on failure */
+} InlineStage;
+
+typedef struct {
+    void* real_device;
+    const ScaledRemapInfo* remap_info;
+    InlineStage* stages;
+} InlineShaderJob;
+
+/* Queue stage if it has no VkShaderModule but an inline create info */
+static void inline_stage_add(InlineStage** list, uint32_t* n, uint32_t* cap,
+                             uint8_t* stage, uint32_t pipe, uint32_t s) {
+    if (*(uint64_t*)(stage + 24) != 0) return; /* already has a VkShaderModule */
+    /* Walk pNext for VkShaderModuleCreateInfo (sType=16)
+     * Layout: sType(4)+pad(4)+pNext(8)+flags(4)+pad(4)+codeSize(8)+pCode(8) = 40 bytes */
+    PNBase* pn = (PNBase*)(*(void**)(stage + 8));
+    while (pn && pn->sType != 16) pn = (PNBase*)pn->pNext;
+    if (!pn) return;
+    if (*n == *cap) {
+        uint32_t ncap = *cap ? *cap * 2 : 8;
+        InlineStage* nl = (InlineStage*)realloc(*list, ncap * sizeof(InlineStage));
+        if (!nl) {
+            LOGW(ICD_LC_SHADER, "  WARNING: out of memory queueing inline shader (%u)\n", *n);
+            return;
         }
-        /* Re-check: the int_type may have been set by a previous var with same component count */
-        if (!remap_vars[v].int_type) {
-            uint32_t* ivec_arr2 = remap_vars[v].is_signed ? svec_type : uvec_type;
-            uint32_t int_base2 = remap_vars[v].is_signed ? sint32_type : uint32_type;
-            remap_vars[v].int_type = (remap_vars[v].components > 1) ?
-                                      ivec_arr2[remap_vars[v].components] : int_base2;
-        }
-        if (remap_vars[v].need_ptr_type && remap_vars[v].int_type) {
-            /* Need to create OpTypePointer Input: 4 words */
-            uint32_t new_ptr = next_id++;
-            remap_vars[v].int_ptr_type = new_ptr;
-            new_type_words += 4;
-            /* Other vars with same int_type can reuse this pointer */
-            for (int v2 = v + 1; v2 < n_remap_vars; v2++) {
-                if (remap_vars[v2].int_type == remap_vars[v].int_type &&
-                    remap_vars[v2].need_ptr_type) {
-                    remap_vars[v2].int_ptr_type = new_ptr;
-                    remap_vars[v2].need_ptr_type = 0; /* don't create duplicate */
+        *list = nl;
+        *cap = ncap;
+    }
+    (*list)[(*n)++] = (InlineStage){ stage, pn, pipe, s, 0 };
+}
+
+/* Create a real VkShaderModule for one inline stage (pool item) */
+static void inline_stage_to_module(void* ctx, uint32_t item) {
+    InlineShaderJob* job = (InlineShaderJob*)ctx;
+    InlineStage* it = &job->stages[item];
+    void* real_device = job->real_device;
+    const ScaledRemapInfo* remap_info = job->remap_info;
+    uint8_t* stage = it->stage;
+    PNBase* pn = it->pn;
+    uint32_t i = it->pipe, s = it->s;
+    uint64_t* pModule = (uint64_t*)(stage + 24);
+    /* Create real VkShaderModule from inline data */
+    uint64_t new_module = 0;
+    uint64_t codeSize = *(uint64_t*)((uint8_t*)pn + 24);
+    const uint32_t* pCode = *(const uint32_t**)((uint8_t*)pn + 32);
+    uint32_t stageBit = *(uint32_t*)(stage + 20);
+    /* SPIR-V integrity check before module creation */
+    if (pCode && codeSize >= 20) {
+        uint32_t magic = pCode[0];
+        uint32_t version = pCode[1];
+        uint32_t generator = pCode[2];
+        uint32_t bound = pCode[3];
+        /* XOR checksum of all SPIR-V words */
+        uint32_t cksum = 0;
+        uint64_t nwords_spv = codeSize / 4;
+        for (uint64_t w = 0; w < nwords_spv; w++)
+            cksum ^= pCode[w];
+        /* Last 2 words for truncation detection */
+        uint32_t last0 = nwords_spv > 1 ? pCode[nwords_spv-2] : 0;
+        uint32_t last1 = nwords_spv > 0 ? pCode[nwords_spv-1] : 0;
+        LOGD(ICD_LC_SHADER, "  SPIRV-CHECK: stage[%u] magic=0x%08x ver=0x%x gen=0x%x bound=%u words=%lu cksum=0x%08x last=[0x%08x,0x%08x]\n",
+            s, magic, version, generator, bound, (unsigned long)nwords_spv,
+            cksum, last0, last1);
+        /* Dump SPIR-V to file for offline analysis */
+        {
+            static int spv_dump_count = 0;
+            int dump_idx = __atomic_fetch_add(&spv_dump_count, 1, __ATOMIC_RELAXED);
+            if (dump_idx < 30) {
+                char spv_fname[128];
+                snprintf(spv_fname, sizeof(spv_fname),
+                         "/tmp/shader_%03d_w%lu_s%x.spv",
+                         dump_idx, (unsigned long)nwords_spv, stageBit);
+                FILE* spv_f = fopen(spv_fname, "wb");
+                if (spv_f) {
+                    fwrite(pCode, 1, codeSize, spv_f);
+                    fclose(spv_f);
+                    LOGD(ICD_LC_SHADER, "  SHADER-DUMP: %s (%lu bytes)\n", spv_fname, (unsigned long)codeSize);
                 }
             }
         }
     }
-
-    /* ---- Pass 4: Allocate output and copy with modifications ---- */
-    uint64_t out_nwords = nwords + new_type_words + n_loads * 4;
-    uint32_t* out = (uint32_t*)malloc(out_nwords * 4);
-    if (!out) return NULL;
-
-    uint64_t oidx = 0;
-    /* Copy header */
-    memcpy(out, code, 5 * 4);
-    out[3] = next_id; /* update bound */
-    oidx = 5;
-
-    int types_inserted = 0;
-    idx = 5;
-    while (idx < nwords) {
-        uint32_t instr = code[idx];
-        uint16_t op = instr & 0xFFFF;
-        uint16_t wc = instr >> 16;
-        if (wc == 0 || idx + wc > nwords) break;
-
-        /* Insert new types just before the first OpFunction */
-        if (op == 54 && !types_inserted) { /* OpFunction */
-            types_inserted = 1;
-            /* Emit any new OpTypeInt */
-            if (uint32_type >= bound) { /* was freshly allocated */
-                out[oidx++] = (4 << 16) | 21; /* OpTypeInt */
-                out[oidx++] = uint32_type;
-                out[oidx++] = 32;
-                out[oidx++] = 0; /* unsigned */
-            }
-            if (sint32_type >= bound) { /* was freshly allocated */
-                out[oidx++] = (4 << 16) | 21; /* OpTypeInt */
-                out[oidx++] = sint32_type;
-                out[oidx++] = 32;
-                out[oidx++] = 1; /* signed */
+    /* SPIR-V instruction census for large shaders
+     * Opcodes: FMul=133 FAdd=129 IAdd=128 Dot=148
+     * MxV=145 VxM=144 MxM=146 ExtInst=12
+     * SHL=196 SHR_L=194 SHR_A=195 BFI=201 */
+    if (pCode && codeSize > 8000) {
+        uint64_t nw = codeSize / 4;
+        int n_shl=0, n_shr_l=0, n_shr_a=0, n_dot=0;
+        int n_mxv=0, n_vxm=0, n_mxm=0, n_fmul=0, n_fadd=0;
+        int n_bfi=0, n_iadd=0, n_ext=0, n_load=0;
+        uint64_t ci3 = 5;
+        while (ci3 < nw) {
+            uint32_t w = pCode[ci3];
+            uint16_t opc = w & 0xFFFF;
+            uint16_t wc3 = w >> 16;
+            if (wc3 == 0 || ci3 + wc3 > nw) break;
+            switch (opc) {
+                case 194: n_shr_l++; break;
+                case 195: n_shr_a++; break;
+                case 196: n_shl++; break;
+                case 148: n_dot++; break;
+                case 145: n_mxv++; break;
+                case 144: n_vxm++; break;
+                case 146: n_mxm++; break;
+                case 133: n_fmul++; break;
+                case 129: n_fadd++; break;
+                case 128: n_iadd++; break;
+                case 201: n_bfi++; break;
+                case 12: n_ext++; break;
+                case 61: n_load++; break;
             }
-            /* Emit any new OpTypeVector */
-            for (int c = 2; c <= 4; c++) {
-                if (uvec_type[c] >= bound) {
-                    out[oidx++] = (4 << 16) | 23; /* OpTypeVector */
-                    out[oidx++] = uvec_type[c];
-                    out[oidx++] = uint32_type;
-                    out[oidx++] = c;
-                }
-                if (svec_type[c] >= bound) {
-                    out[oidx++] = (4 << 16) | 23; /* OpTypeVector */
-                    out[oidx++] = svec_type[c];
-                    out[oidx++] = sint32_type;
-                    out[oidx++] = c;
-                }
-            }
-            /* Emit any new OpTypePointer Input */
-            for (int v = 0; v < n_remap_vars; v++) {
-                if (remap_vars[v].need_ptr_type && remap_vars[v].int_ptr_type >= bound) {
-                    out[oidx++] = (4 << 16) | 32; /* OpTypePointer */
-                    out[oidx++] = remap_vars[v].int_ptr_type;
-                    out[oidx++] = 1; /* Input */
-                    out[oidx++] = remap_vars[v].int_type;
-                    /* Mark as emitted so we don't emit duplicates */
-                    uint32_t emitted_ptr = remap_vars[v].int_ptr_type;
-                    for (int v2 = v + 1; v2 < n_remap_vars; v2++) {
-                        if (remap_vars[v2].int_ptr_type == emitted_ptr)
-                            remap_vars[v2].need_ptr_type = 0;
+            ci3 += wc3;
+        }
+        LOGD(ICD_LC_SHADER, "  SPIRV-CENSUS: stage[%u] bit=0x%x %luB: "
+            "FMul=%d FAdd=%d Dot=%d MxV=%d VxM=%d MxM=%d "
+            "SHL=%d SHR_L=%d SHR_A=%d IAdd=%d BFI=%d Ext=%d Load=%d\n",
+            s, stageBit, (unsigned long)codeSize,
+            n_fmul, n_fadd, n_dot, n_mxv, n_vxm, n_mxm,
+            n_shl, n_shr_l, n_shr_a, n_iadd, n_bfi, n_ext, n_load);
+    }
+    /* ==== Apply ALL Mali SPIR-V fixes ==== */
+    const uint32_t* fixedCode = NULL;
+    uint32_t* optCode = NULL;
+    uint64_t effectiveSize = codeSize;
+    uint8_t patched_ci[40];
+    const void* moduleCI = (const void*)pn;
+    uint64_t spv_key = 0;
+    if (pCode && codeSize > 20) {
+        const ScaledRemapInfo* remap = (stageBit == 1 && remap_info && remap_info[i].count > 0)
+            ? &remap_info[i] : NULL;
+        spv_key = spv_cache_key(pCode, codeSize, remap);
+        int total_fixes = 0;
+        if (spv_cache_get(spv_key, pCode, codeSize, remap, &fixedCode, &effectiveSize, &total_fixes)) {
+            LOGD(ICD_LC_SHADER, "  MALI-FIX: stage[%u] cache hit, %d fixes\n", s, total_fixes);
+        } else {
+            fixedCode = spv_rewrite(pCode, codeSize, remap, &effectiveSize, &total_fixes);
+            if (total_fixes >= 0)
+                spv_cache_put(spv_key, pCode, codeSize, remap, fixedCode, effectiveSize, total_fixes);
+            else
+                total_fixes = 0;
+            if (total_fixes > 0)
+                LOGD(ICD_LC_SHADER, "  MALI-FIX: stage[%u] %d fixes (%lu→%lu bytes)\n",
+                    s, total_fixes, (unsigned long)codeSize, (unsigned long)effectiveSize);
+        }
+        /* Fix 4: spirv-opt pre-optimized shader replacement.
+         * Mali miscompiles large vertex shaders with OpFunctionCall.
+         * We pre-optimize with spirv-opt (inline + DCE + CCP) and
+         * load the result from /tmp/spirvopt_<cksum>.spv.
+         * This eliminates function calls and simplifies control flow. */
+        if (stageBit == 1 && codeSize >= 8000) {
+            /* Compute XOR checksum of ORIGINAL (pre-fix) code */
+            uint32_t orig_cksum = 0;
+            uint64_t nw_orig = codeSize / 4;
+            for (uint64_t w2 = 0; w2 < nw_orig; w2++)
+                orig_cksum ^= pCode[w2];
+            char opt_path[128];
+            snprintf(opt_path, sizeof(opt_path),
+                     "/tmp/spirvopt_%08x.spv", orig_cksum);
+            FILE* opt_f = fopen(opt_path, "rb");
+            if (opt_f) {
+                fseek(opt_f, 0, SEEK_END);
+                long opt_fsize = ftell(opt_f);
+                fseek(opt_f, 0, SEEK_SET);
+                if (opt_fsize > 20 && opt_fsize < 200000) {
+                    uint32_t* opt_code = (uint32_t*)malloc(opt_fsize);
+                    if (opt_code) {
+                        size_t rd = fread(opt_code, 1, opt_fsize, opt_f);
+                        if ((long)rd == opt_fsize && opt_code[0] == 0x07230203) {
+                            fixedCode = optCode = opt_code;
+                            effectiveSize = opt_fsize;
+                            spv_key = spv_cache_key(opt_code, opt_fsize, NULL);
+                            total_fixes++;
+                            LOGD(ICD_LC_SHADER, "  MALI-FIX: stage[%u] SPIRV-OPT replaced cksum=0x%08x (%lu→%lu bytes)\n",
+                                s, orig_cksum, (unsigned long)codeSize, (unsigned long)opt_fsize);
+                        } else {
+                            free(opt_code);
+                            LOGD(ICD_LC_SHADER, "  MALI-FIX: stage[%u] SPIRV-OPT file corrupt: %s\n", s, opt_path);
+                        }
                     }
-                    remap_vars[v].need_ptr_type = 0;
                 }
+                fclose(opt_f);
+            } else {
+                LOGD(ICD_LC_SHADER, "  MALI-FIX: stage[%u] no spirv-opt file: %s (cksum=0x%08x)\n",
+                    s, opt_path, orig_cksum);
             }
         }
-
-        /* Check if this is an OpVariable that needs its type changed */
-        int var_match = -1;
-        if (op == 59 && wc >= 4 && code[idx + 3] == 1) { /* OpVariable Input */
-            uint32_t vid = code[idx + 2];
-            for (int v = 0; v < n_remap_vars; v++) {
-                if (remap_vars[v].var_id == vid) { var_match = v; break; }
-            }
-        }
-
-        /* Check if this is an OpLoad from a remapped variable */
-        int load_match = -1;
-        if (op == 61 && wc >= 4) { /* OpLoad */
-            uint32_t ptr_id = code[idx + 3];
-            for (int v = 0; v < n_remap_vars; v++) {
-                if (remap_vars[v].var_id == ptr_id) { load_match = v; break; }
+        if (total_fixes > 0 && fixedCode) {
+            memcpy(patched_ci, (const uint8_t*)pn, 40);
+            *(const uint32_t**)(patched_ci + 32) = fixedCode;
+            *(uint64_t*)(patched_ci + 24) = effectiveSize;
+            moduleCI = (const void*)patched_ci;
+        }
+    }
+    VkResult r;
+    r = real_create_shader_module(real_device, moduleCI, NULL, &new_module);
+    free(optCode);
+    if (r == 0 && new_module) {
+        *pModule = new_module;
+        it->module = new_module;
+        pcache_note_module(new_module, spv_key);
+        LOGD(ICD_LC_SHADER, "  inline->module: stage[%u] bit=0x%x codeSize=%lu module=0x%lx\n",
+            s, stageBit, (unsigned long)codeSize, (unsigned long)new_module);
+
+        /* CRITICAL: Strip VkShaderModuleCreateInfo (sType=16)
+         * from this stage's pNext chain. Now that we have a real
+         * VkShaderModule, leaving the inline SPIR-V in pNext is
+         * dangerous: FEX thunks for CreateGraphicsPipelines may
+         * try to marshal the pCode pointer across IPC, but the
+         * thunks don't know about maintenance5 inline shaders.
+         * This can corrupt pipeline creation for large shaders
+         * (65KB mesh shader vs 2.4KB font shader). */
+        {
+            void** ppStageNext = (void**)(stage + 8);
+            PNBase* prev2 = NULL;
+            PNBase* cur2 = (PNBase*)*ppStageNext;
+            while (cur2) {
+                if (cur2->sType == 16) {
+                    /* Unlink VkShaderModuleCreateInfo */
+                    if (prev2) prev2->pNext = cur2->pNext;
+                    else *ppStageNext = cur2->pNext;
+                    LOGD(ICD_LC_SHADER, "  stripped VkShaderModuleCreateInfo from stage[%u] pNext\n", s);
+                    break;
+                }
+                prev2 = cur2;
+                cur2 = (PNBase*)cur2->pNext;
             }
         }
-
-        if (var_match >= 0 && remap_vars[var_match].int_ptr_type) {
-            /* Change result type from float pointer to int pointer */
-            memcpy(out + oidx, code + idx, wc * 4);
-            out[oidx + 1] = remap_vars[var_match].int_ptr_type;
-            oidx += wc;
-        } else if (load_match >= 0 && remap_vars[load_match].int_type) {
-            /* Rewrite the OpLoad: change result type to int, rename result ID */
-            uint32_t orig_result_id = code[idx + 2];
-            uint32_t temp_id = next_id++;
-            /* Update bound in header */
-            out[3] = next_id;
-
-            /* Emit modified OpLoad: result type = int, result = temp_id */
-            memcpy(out + oidx, code + idx, wc * 4);
-            out[oidx + 1] = remap_vars[load_match].int_type;
-            out[oidx + 2] = temp_id;
-            oidx += wc;
-
-            /* Insert OpConvertUToF(112) or OpConvertSToF(111):
-             * [4|op] result_type result operand */
-            uint32_t conv_op = remap_vars[load_match].is_signed ? 111 : 112;
-            uint32_t float_type = remap_vars[load_match].float_type;
-            /* For scalar float (components==1), use float32_type directly */
-            if (remap_vars[load_match].components == 1 && !float_type)
-                float_type = float32_type;
-            /* For vectors, use the fvec_type */
-            if (!float_type && remap_vars[load_match].components > 1)
-                float_type = fvec_type[remap_vars[load_match].components];
-            if (!float_type) float_type = float32_type; /* fallback */
-
-            out[oidx++] = (4 << 16) | conv_op;
-            out[oidx++] = float_type;
-            out[oidx++] = orig_result_id;
-            out[oidx++] = temp_id;
-        } else {
-            /* Copy instruction unchanged */
-            memcpy(out + oidx, code + idx, wc * 4);
-            oidx += wc;
-        }
-        idx += wc;
+    } else {
+        LOGW(ICD_LC_SHADER, "  WARNING: failed to create module from inline SPIR-V: %d\n", r);
     }
-
-    *outSize = oidx * 4;
-    LOG("  SCALED-SPIRV: rewrote %d loads, %lu→%lu bytes (new types: %d words)\n",
-        n_loads, (unsigned long)codeSize, (unsigned long)(oidx * 4), new_type_words);
-
-    #undef SCALED_MAX_TYPES
-    #undef SCALED_MAX_VARS
-    return out;
 }
 
 /* Convert inline VkShaderModuleCreateInfo (maintenance5) to real VkShaderModule.
  * Vortek's IPC can't serialize pNext chains on shader stages, so we pre-create
- * the modules and patch the stage to use them.
- * Returns number of temp modules created; caller must destroy them after pipeline creation.
+ * the modules (on the pipeline pool) and patch the stages to use them.
+ * pCreateInfos are VkGraphicsPipelineCreateInfo (144 bytes) or, with
+ * compute set, VkComputePipelineCreateInfo (96 bytes, stage embedded at 24).
+ * Returns the number of temp modules created, listed in *temp_modules;
+ * caller destroys them after pipeline creation and frees the list.
  */
-#define MAX_TEMP_MODULES 32
 static uint32_t fixup_inline_shaders(void* real_device, const void* pCreateInfos,
-                                      uint32_t pipe_count, uint64_t* temp_modules,
+                                      uint32_t pipe_count, int compute,
+                                      uint64_t** temp_modules,
                                       const ScaledRemapInfo* remap_info) {
-    uint32_t n_temp = 0;
-    typedef struct { uint32_t sType; uint32_t _pad; void* pNext; } PNBase;
+    InlineStage* stages = NULL;
+    uint32_t n_stages = 0, cap = 0;
+    *temp_modules = NULL;
 
     for (uint32_t i = 0; i < pipe_count; i++) {
-        uint8_t* ci = (uint8_t*)pCreateInfos + i * 144;
-        uint32_t stageCount = *(uint32_t*)(ci + 20);
-        uint8_t* pStages = *(uint8_t**)(ci + 24);
-        if (!pStages) continue;
-
-        for (uint32_t s = 0; s < stageCount && s < 6; s++) {
-            uint8_t* stage = pStages + s * 48;
-            uint64_t* pModule = (uint64_t*)(stage + 24);
-
-            if (*pModule != 0) continue; /* already has a VkShaderModule */
-
-            /* Walk pNext for VkShaderModuleCreateInfo (sType=16)
-             * Layout: sType(4)+pad(4)+pNext(8)+flags(4)+pad(4)+codeSize(8)+pCode(8) = 40 bytes */
-            PNBase* pn = (PNBase*)(*(void**)(stage + 8));
-            while (pn) {
-                if (pn->sType == 16) { /* VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO */
-                    if (n_temp >= MAX_TEMP_MODULES) {
-                        LOG("  WARNING: too many inline shaders (%u)\n", n_temp);
-                        break;
-                    }
-                    /* Create real VkShaderModule from inline data */
-                    uint64_t new_module = 0;
-                    uint64_t codeSize = *(uint64_t*)((uint8_t*)pn + 24);
-                    const uint32_t* pCode = *(const uint32_t**)((uint8_t*)pn + 32);
-                    uint32_t stageBit = *(uint32_t*)(stage + 20);
-                    /* SPIR-V integrity check before module creation */
-                    if (pCode && codeSize >= 20) {
-                        uint32_t magic = pCode[0];
-                        uint32_t version = pCode[1];
-                        uint32_t generator = pCode[2];
-                        uint32_t bound = pCode[3];
-                        /* XOR checksum of all SPIR-V words */
-                        uint32_t cksum = 0;
-                        uint64_t nwords_spv = codeSize / 4;
-                        for (uint64_t w = 0; w < nwords_spv; w++)
-                            cksum ^= pCode[w];
-                        /* Last 2 words for truncation detection */
-                        uint32_t last0 = nwords_spv > 1 ? pCode[nwords_spv-2] : 0;
-                        uint32_t last1 = nwords_spv > 0 ? pCode[nwords_spv-1] : 0;
-                        LOG("  SPIRV-CHECK: stage[%u] magic=0x%08x ver=0x%x gen=0x%x bound=%u words=%lu cksum=0x%08x last=[0x%08x,0x%08x]\n",
-                            s, magic, version, generator, bound, (unsigned long)nwords_spv,
-                            cksum, last0, last1);
-                        /* Dump SPIR-V to file for offline analysis */
-                        {
-                            static int spv_dump_count = 0;
-                            if (spv_dump_count < 30) {
-                                char spv_fname[128];
-                                snprintf(spv_fname, sizeof(spv_fname),
-                                         "/tmp/shader_%03d_w%lu_s%x.spv",
-                                         spv_dump_count, (unsigned long)nwords_spv, stageBit);
-                                FILE* spv_f = fopen(spv_fname, "wb");
-                                if (spv_f) {
-                                    fwrite(pCode, 1, codeSize, spv_f);
-                                    fclose(spv_f);
-                                    LOG("  SHADER-DUMP: %s (%lu bytes)\n", spv_fname, (unsigned long)codeSize);
-                                }
-                                spv_dump_count++;
-                            }
-                        }
-                    }
-                    /* SPIR-V instruction census for large shaders
-                     * Opcodes: FMul=133 FAdd=129 IAdd=128 Dot=148
-                     * MxV=145 VxM=144 MxM=146 ExtInst=12
-                     * SHL=196 SHR_L=194 SHR_A=195 BFI=201 */
-                    if (pCode && codeSize > 8000) {
-                        uint64_t nw = codeSize / 4;
-                        int n_shl=0, n_shr_l=0, n_shr_a=0, n_dot=0;
-                        int n_mxv=0, n_vxm=0, n_mxm=0, n_fmul=0, n_fadd=0;
-                        int n_bfi=0, n_iadd=0, n_ext=0, n_load=0;
-                        uint64_t ci3 = 5;
-                        while (ci3 < nw) {
-                            uint32_t w = pCode[ci3];
-                            uint16_t opc = w & 0xFFFF;
-                            uint16_t wc3 = w >> 16;
-                            if (wc3 == 0 || ci3 + wc3 > nw) break;
-                            switch (opc) {
-                                case 194: n_shr_l++; break;
-                                case 195: n_shr_a++; break;
-                                case 196: n_shl++; break;
-                                case 148: n_dot++; break;
-                                case 145: n_mxv++; break;
-                                case 144: n_vxm++; break;
-                                case 146: n_mxm++; break;
-                                case 133: n_fmul++; break;
-                                case 129: n_fadd++; break;
-                                case 128: n_iadd++; break;
-                                case 201: n_bfi++; break;
-                                case 12: n_ext++; break;
-                                case 61: n_load++; break;
-                            }
-                            ci3 += wc3;
-                        }
-                        LOG("  SPIRV-CENSUS: stage[%u] bit=0x%x %luB: "
-                            "FMul=%d FAdd=%d Dot=%d MxV=%d VxM=%d MxM=%d "
-                            "SHL=%d SHR_L=%d SHR_A=%d IAdd=%d BFI=%d Ext=%d Load=%d\n",
-                            s, stageBit, (unsigned long)codeSize,
-                            n_fmul, n_fadd, n_dot, n_mxv, n_vxm, n_mxm,
-                            n_shl, n_shr_l, n_shr_a, n_iadd, n_bfi, n_ext, n_load);
-                    }
-                    /* ==== Apply ALL Mali SPIR-V fixes ==== */
-                    uint32_t* mutableCode = NULL;
-                    uint64_t effectiveSize = codeSize;
-                    uint8_t patched_ci[40];
-                    const void* moduleCI = (const void*)pn;
-                    if (pCode && codeSize > 20) {
-                        mutableCode = (uint32_t*)malloc(codeSize);
-                        if (mutableCode) {
-                            memcpy(mutableCode, pCode, codeSize);
-                            int total_fixes = 0;
-                            /* ==== Mali SPIR-V Fixes (re-enabled) ==== */
-                            /* Fix 1: Strip ClipDistance/CullDistance (Mali unsupported) */
-                            {
-                                int n_strip = strip_clip_distance_spirv(mutableCode, codeSize);
-                                if (n_strip > 0) {
-                                    total_fixes += n_strip;
-                                    LOG("  MALI-FIX: stage[%u] stripped %d ClipDistance/CullDistance\n", s, n_strip);
-                                }
-                            }
-                            /* Fix 2: OpConstantComposite→OpSpecConstantComposite */
-                            {
-                                int n_composite = fix_mali_spirv(mutableCode, effectiveSize);
-                                if (n_composite > 0) {
-                                    total_fixes += n_composite;
-                                    LOG("  MALI-FIX: stage[%u] fixed %d ConstantComposite→Spec\n", s, n_composite);
-                                }
-                            }
-                            /* Fix 3: Shift optimization barriers */
-                            {
-                                uint64_t barrierSize = 0;
-                                int nBarriers = 0;
-                                uint32_t* barrierCode = add_mali_shift_barriers(
-                                    mutableCode, effectiveSize, &barrierSize, &nBarriers);
-                                if (barrierCode) {
-                                    free(mutableCode);
-                                    mutableCode = barrierCode;
-                                    effectiveSize = barrierSize;
-                                    total_fixes += nBarriers;
-                                    LOG("  MALI-FIX: stage[%u] added %d shift barriers (%lu→%lu bytes)\n",
-                                        s, nBarriers, (unsigned long)codeSize, (unsigned long)barrierSize);
-                                }
-                            }
-                            /* Fix 5: USCALED/SSCALED format emulation (vertex shaders only) */
-                            if (stageBit == 1 && remap_info && remap_info[i].count > 0) {
-                                uint64_t scaledSize = 0;
-                                uint32_t* scaledCode = emulate_scaled_formats_spirv(
-                                    mutableCode, effectiveSize, &remap_info[i], &scaledSize);
-                                if (scaledCode) {
-                                    free(mutableCode);
-                                    mutableCode = scaledCode;
-                                    effectiveSize = scaledSize;
-                                    total_fixes++;
-                                    LOG("  MALI-FIX: stage[%u] SCALED format emulation (%lu→%lu bytes)\n",
-                                        s, (unsigned long)codeSize, (unsigned long)scaledSize);
-                                }
-                            }
-                            /* Fix 4: spirv-opt pre-optimized shader replacement.
-                             * Mali miscompiles large vertex shaders with OpFunctionCall.
-                             * We pre-optimize with spirv-opt (inline + DCE + CCP) and
-                             * load the result from /tmp/spirvopt_<cksum>.spv.
-                             * This eliminates function calls and simplifies control flow. */
-                            if (stageBit == 1 && codeSize >= 8000) {
-                                /* Compute XOR checksum of ORIGINAL (pre-fix) code */
-                                uint32_t orig_cksum = 0;
-                                uint64_t nw_orig = codeSize / 4;
-                                for (uint64_t w2 = 0; w2 < nw_orig; w2++)
-                                    orig_cksum ^= pCode[w2];
-                                char opt_path[128];
-                                snprintf(opt_path, sizeof(opt_path),
-                                         "/tmp/spirvopt_%08x.spv", orig_cksum);
-                                FILE* opt_f = fopen(opt_path, "rb");
-                                if (opt_f) {
-                                    fseek(opt_f, 0, SEEK_END);
-                                    long opt_fsize = ftell(opt_f);
-                                    fseek(opt_f, 0, SEEK_SET);
-                                    if (opt_fsize > 20 && opt_fsize < 200000) {
-                                        uint32_t* opt_code = (uint32_t*)malloc(opt_fsize);
-                                        if (opt_code) {
-                                            size_t rd = fread(opt_code, 1, opt_fsize, opt_f);
-                                            if ((long)rd == opt_fsize && opt_code[0] == 0x07230203) {
-                                                free(mutableCode);
-                                                mutableCode = opt_code;
-                                                effectiveSize = opt_fsize;
-                                                total_fixes++;
-                                                LOG("  MALI-FIX: stage[%u] SPIRV-OPT replaced cksum=0x%08x (%lu→%lu bytes)\n",
-                                                    s, orig_cksum, (unsigned long)codeSize, (unsigned long)opt_fsize);
-                                            } else {
-                                                free(opt_code);
-                                                LOG("  MALI-FIX: stage[%u] SPIRV-OPT file corrupt: %s\n", s, opt_path);
-                                            }
-                                        }
-                                    }
-                                    fclose(opt_f);
-                                } else {
-                                    LOG("  MALI-FIX: stage[%u] no spirv-opt file: %s (cksum=0x%08x)\n",
-                                        s, opt_path, orig_cksum);
-                                }
-                            }
-                            if (total_fixes > 0) {
-                                memcpy(patched_ci, (const uint8_t*)pn, 40);
-                                *(const uint32_t**)(patched_ci + 32) = mutableCode;
-                                *(uint64_t*)(patched_ci + 24) = effectiveSize;
-                                moduleCI = (const void*)patched_ci;
-                            }
-                        }
-                    }
-                    VkResult r;
-                    r = real_create_shader_module(real_device, moduleCI, NULL, &new_module);
-                    if (mutableCode) free(mutableCode);
-                    if (r == 0 && new_module) {
-                        *pModule = new_module;
-                        temp_modules[n_temp++] = new_module;
-                        LOG("  inline->module: stage[%u] bit=0x%x codeSize=%lu module=0x%lx\n",
-                            s, stageBit, (unsigned long)codeSize, (unsigned long)new_module);
-
-                        /* CRITICAL: Strip VkShaderModuleCreateInfo (sType=16)
-                         * from this stage's pNext chain. Now that we have a real
-                         * VkShaderModule, leaving the inline SPIR-V in pNext is
-                         * dangerous: FEX thunks for CreateGraphicsPipelines may
-                         * try to marshal the pCode pointer across IPC, but the
-                         * thunks don't know about maintenance5 inline shaders.
-                         * This can corrupt pipeline creation for large shaders
-                         * (65KB mesh shader vs 2.4KB font shader). */
-                        {
-                            void** ppStageNext = (void**)(stage + 8);
-                            PNBase* prev2 = NULL;
-                            PNBase* cur2 = (PNBase*)*ppStageNext;
-                            while (cur2) {
-                                if (cur2->sType == 16) {
-                                    /* Unlink VkShaderModuleCreateInfo */
-                                    if (prev2) prev2->pNext = cur2->pNext;
-                                    else *ppStageNext = cur2->pNext;
-                                    LOG("  stripped VkShaderModuleCreateInfo from stage[%u] pNext\n", s);
-                                    break;
-                                }
-                                prev2 = cur2;
-                                cur2 = (PNBase*)cur2->pNext;
-                            }
-                        }
-                    } else {
-                        LOG("  WARNING: failed to create module from inline SPIR-V: %d\n", r);
-                    }
-                    break;
-                }
-                pn = (PNBase*)pn->pNext;
-            }
+        uint8_t* ci = (uint8_t*)pCreateInfos + i * (compute ? 96 : 144);
+        if (compute) {
+            inline_stage_add(&stages, &n_stages, &cap, ci + 24, i, 0);
+        } else {
+            uint32_t stageCount = *(uint32_t*)(ci + 20);
+            uint8_t* pStages = *(uint8_t**)(ci + 24);
+            for (uint32_t s = 0; pStages && s < stageCount && s < 6; s++)
+                inline_stage_add(&stages, &n_stages, &cap, pStages + s * 48, i, s);
         }
 
         /* Strip VkPipelineCreateFlags2CreateInfoKHR (sType=1000470005) from pipe pNext.
@@ -5089,7 +7435,7 @@ static uint32_t fixup_inline_shaders(void* real_device, const void* pCreateInfos
             PNBase* pn = (PNBase*)*ppNext;
             while (pn) {
                 if (pn->sType == 1000470005) {
-                    LOG("  stripped PipelineCreateFlags2 from pNext\n");
+                    LOGD(ICD_LC_SHADER, "  stripped PipelineCreateFlags2 from pNext\n");
                     if (prev) prev->pNext = pn->pNext;
                     else *ppNext = pn->pNext;
                     break;
@@ -5099,9 +7445,83 @@ static uint32_t fixup_inline_shaders(void* real_device, const void* pCreateInfos
             }
         }
     }
+    if (n_stages == 0) return 0;
+
+    InlineShaderJob job = { real_device, remap_info, stages };
+    worker_pool_for(&g_pipe_pool, n_stages, inline_stage_to_module, &job);
+
+    uint64_t* modules = (uint64_t*)malloc(n_stages * sizeof(uint64_t));
+    uint32_t n_temp = 0;
+    for (uint32_t k = 0; k < n_stages && modules; k++)
+        if (stages[k].module) modules[n_temp++] = stages[k].module;
+    free(stages);
+    *temp_modules = modules;
     return n_temp;
 }
 
+/* ---- Pipeline batches ---- */
+
+typedef struct {
+    void* real;
+    uint64_t cache;
+    const uint8_t* infos;
+    uint32_t stride;            /* sizeof the create info */
+    int compute;
+    const void* pAllocator;
+    uint64_t* pPipelines;
+    VkResult* results;
+} PipeBatch;
+
+static void pipe_batch_create_one(void* ctx, uint32_t i) {
+    PipeBatch* b = (PipeBatch*)ctx;
+    const void* ci = b->infos + (size_t)i * b->stride;
+    b->results[i] = b->compute
+        ? real_create_comp_pipelines(b->real, b->cache, 1, ci, b->pAllocator, &b->pPipelines[i])
+        : real_create_gfx_pipelines(b->real, b->cache, 1, ci, b->pAllocator, &b->pPipelines[i]);
+}
+
+/* vkCreate*Pipelines for a batch, split into one call per pipeline on the
+ * pool when that is equivalent to a single call: no
+ * EARLY_RETURN_ON_FAILURE (later pipelines must stay NULL) and no
+ * derivative that names its base by index within the batch. */
+static VkResult create_pipeline_batch(void* real, uint64_t cache, uint32_t count,
+                                      const void* pCreateInfos, int compute,
+                                      const void* pAllocator, uint64_t* pPipelines) {
+    uint32_t stride = compute ? 96 : 144;
+    uint32_t base_off = compute ? 80 : 128;   /* basePipelineHandle, Index follows */
+    int split = count > 1 && worker_pool_start(&g_pipe_pool) > 0;
+    for (uint32_t i = 0; i < count && split; i++) {
+        const uint8_t* ci = (const uint8_t*)pCreateInfos + (size_t)i * stride;
+        uint32_t flags = *(const uint32_t*)(ci + 16);
+        if (flags & 0x200) split = 0;        /* EARLY_RETURN_ON_FAILURE */
+        if ((flags & 0x4) && *(const uint64_t*)(ci + base_off) == 0 &&
+            *(const int32_t*)(ci + base_off + 8) >= 0)
+            split = 0;                       /* DERIVATIVE of pCreateInfos[index] */
+    }
+    VkResult* results = split ? (VkResult*)malloc(count * sizeof(VkResult)) : NULL;
+    if (!results) {
+        return compute
+            ? real_create_comp_pipelines(real, cache, count, pCreateInfos, pAllocator, pPipelines)
+            : real_create_gfx_pipelines(real, cache, count, pCreateInfos, pAllocator, pPipelines);
+    }
+
+    PipeBatch b = { real, cache, (const uint8_t*)pCreateInfos, stride, compute,
+                    pAllocator, pPipelines, results };
+    worker_pool_for(&g_pipe_pool, count, pipe_batch_create_one, &b);
+
+    /* Same result a single call reports: the first error, else
+     * PIPELINE_COMPILE_REQUIRED if any pipeline needs it */
+    VkResult res = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (results[i] < 0) { res = results[i]; break; }
+        if (results[i] == 1000297000) res = results[i];
+    }
+    free(results);
+    LOGD(ICD_LC_PIPE, "[D%d] %s pipelines: %u created on the pool, result=%d\n",
+        g_device_count, compute ? "compute" : "graphics", count, res);
+    return res;
+}
+
 static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint32_t count,
                                                const void* pCreateInfos, const void* pAllocator,
                                                uint64_t* pPipelines) {
@@ -5117,7 +7537,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
         uint64_t renderPass = *(uint64_t*)(ci + 112);
         uint64_t layout = *(uint64_t*)(ci + 104);
 
-        LOG("[D%d] GfxPipe[%u]: stages=%u renderPass=0x%lx layout=0x%lx\n",
+        LOGD(ICD_LC_PIPE, "[D%d] GfxPipe[%u]: stages=%u renderPass=0x%lx layout=0x%lx\n",
             g_device_count, i, stageCount, (unsigned long)renderPass, (unsigned long)layout);
 
         /* Log vertex input state — key for vertex debugging */
@@ -5127,7 +7547,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
              * 32:attributeCount(4) 36:pad 40:pAttributes(8) = 48 */
             uint32_t bindingCount = *(uint32_t*)((uint8_t*)pVertexInputState + 20);
             uint32_t attrCount = *(uint32_t*)((uint8_t*)pVertexInputState + 32);
-            LOG("  vertexInput: bindings=%u attrs=%u\n", bindingCount, attrCount);
+            LOGD(ICD_LC_PIPE, "  vertexInput: bindings=%u attrs=%u\n", bindingCount, attrCount);
             /* Log first few bindings */
             if (bindingCount > 0) {
                 uint8_t* pBindings = *(uint8_t**)((uint8_t*)pVertexInputState + 24);
@@ -5136,7 +7556,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                     uint32_t binding = *(uint32_t*)(pBindings + b*12);
                     uint32_t stride = *(uint32_t*)(pBindings + b*12 + 4);
                     uint32_t rate = *(uint32_t*)(pBindings + b*12 + 8);
-                    LOG("    binding[%u]: slot=%u stride=%u rate=%u\n", b, binding, stride, rate);
+                    LOGD(ICD_LC_PIPE, "    binding[%u]: slot=%u stride=%u rate=%u\n", b, binding, stride, rate);
                 }
             }
             /* Log ALL attributes (critical for stride bake debugging) */
@@ -5148,16 +7568,16 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                     uint32_t bind = *(uint32_t*)(pAttrs + a*16 + 4);
                     uint32_t fmt = *(uint32_t*)(pAttrs + a*16 + 8);
                     uint32_t off = *(uint32_t*)(pAttrs + a*16 + 12);
-                    LOG("    attr[%u]: loc=%u bind=%u fmt=%u off=%u\n", a, loc, bind, fmt, off);
+                    LOGD(ICD_LC_PIPE, "    attr[%u]: loc=%u bind=%u fmt=%u off=%u\n", a, loc, bind, fmt, off);
                 }
             }
         } else {
-            LOG("  vertexInput: NULL (vertex pulling?)\n");
+            LOGD(ICD_LC_PIPE, "  vertexInput: NULL (vertex pulling?)\n");
         }
         /* Log input assembly topology */
         if (pInputAssemblyState) {
             uint32_t topology = *(uint32_t*)((uint8_t*)pInputAssemblyState + 16);
-            LOG("  topology=%u\n", topology); /* 0=POINT_LIST 1=LINE_LIST 2=LINE_STRIP 3=TRIANGLE_LIST 4=TRIANGLE_STRIP 5=TRIANGLE_FAN */
+            LOGD(ICD_LC_PIPE, "  topology=%u\n", topology); /* 0=POINT_LIST 1=LINE_LIST 2=LINE_STRIP 3=TRIANGLE_LIST 4=TRIANGLE_STRIP 5=TRIANGLE_FAN */
         }
         /* Log dynamic states and strip DYN_STRIDE.
          * FEX thunks can't marshal 7th arg (pStrides) of VB2 from x86-64 stack
@@ -5169,10 +7589,10 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                 uint32_t* pDynCount = (uint32_t*)((uint8_t*)pDynState + 20);
                 uint32_t dynCount = *pDynCount;
                 uint32_t* dynStates = *(uint32_t**)((uint8_t*)pDynState + 24);
-                LOG("  dynamicStates(%u):", dynCount);
+                LOGD(ICD_LC_PIPE, "  dynamicStates(%u):", dynCount);
                 for (uint32_t d = 0; d < dynCount && d < 20; d++)
-                    LOG(" %u", dynStates[d]);
-                LOG("\n");
+                    LOGD(ICD_LC_PIPE, " %u", dynStates[d]);
+                LOGD(ICD_LC_PIPE, "\n");
                 /* PURE VB2 PASSTHROUGH TEST — keep DYN_STRIDE, don't strip anything.
                  * VB2 passes strides through to Vortek/Mali directly. */
                 int has_dyn_stride = 0;
@@ -5180,9 +7600,9 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                     if (dynStates[d] == 1000267005) has_dyn_stride = 1;
                 }
                 if (has_dyn_stride)
-                    LOG("  -> KEEPING DYN_STRIDE (VB2 passthrough test)\n");
+                    LOGD(ICD_LC_PIPE, "  -> KEEPING DYN_STRIDE (VB2 passthrough test)\n");
             } else {
-                LOG("  dynamicStates: NULL\n");
+                LOGD(ICD_LC_PIPE, "  dynamicStates: NULL\n");
             }
         }
 
@@ -5195,7 +7615,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                 for (uint32_t b = 0; b < bCount; b++) {
                     uint32_t slot = *(uint32_t*)(pBind + b*12);
                     uint32_t stride = *(uint32_t*)(pBind + b*12 + 4);
-                    LOG("  -> PASSTHROUGH stride: binding %u: slot=%u stride=%u (NOT baking)\n",
+                    LOGD(ICD_LC_PIPE, "  -> PASSTHROUGH stride: binding %u: slot=%u stride=%u (NOT baking)\n",
                         b, slot, stride);
                 }
             }
@@ -5208,7 +7628,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                     uint32_t stageBit = *(uint32_t*)(pStages + s*48 + 20);
                     uint64_t module = *(uint64_t*)(pStages + s*48 + 24);
                     void* pNext = *(void**)(pStages + s*48 + 8);
-                    LOG("  stage[%u]: bit=0x%x module=0x%lx pNext=%p\n",
+                    LOGD(ICD_LC_PIPE, "  stage[%u]: bit=0x%x module=0x%lx pNext=%p\n",
                         s, stageBit, (unsigned long)module, pNext);
                 }
             }
@@ -5218,7 +7638,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
         if (pColorBlendState) {
             uint32_t* logicOpEnable = (uint32_t*)((uint8_t*)pColorBlendState + 20);
             if (*logicOpEnable) {
-                LOG("  -> PATCHING logicOpEnable=0 (Mali unsupported)\n");
+                LOGD(ICD_LC_PIPE, "  -> PATCHING logicOpEnable=0 (Mali unsupported)\n");
                 *logicOpEnable = 0;
                 *(uint32_t*)((uint8_t*)pColorBlendState + 24) = 0;
             }
@@ -5237,12 +7657,12 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
         uint32_t aCount = *(uint32_t*)((uint8_t*)pVIS + 32);
         uint8_t* pAttr = *(uint8_t**)((uint8_t*)pVIS + 40);
         if (1) { /* log ALL pipelines now */
-            LOG("  FINAL-VIS[%u]: bCount=%u aCount=%u\n", i, bCount, aCount);
+            LOGD(ICD_LC_PIPE, "  FINAL-VIS[%u]: bCount=%u aCount=%u\n", i, bCount, aCount);
             for (uint32_t b = 0; b < bCount && b < 4; b++) {
                 uint32_t slot = *(uint32_t*)(pBind + b*12);
                 uint32_t stride = *(uint32_t*)(pBind + b*12 + 4);
                 uint32_t rate = *(uint32_t*)(pBind + b*12 + 8);
-                LOG("    bind[%u]: slot=%u stride=%u rate=%u (raw: %02x%02x%02x%02x %02x%02x%02x%02x %02x%02x%02x%02x)\n",
+                LOGD(ICD_LC_PIPE, "    bind[%u]: slot=%u stride=%u rate=%u (raw: %02x%02x%02x%02x %02x%02x%02x%02x %02x%02x%02x%02x)\n",
                     b, slot, stride, rate,
                     pBind[b*12+0], pBind[b*12+1], pBind[b*12+2], pBind[b*12+3],
                     pBind[b*12+4], pBind[b*12+5], pBind[b*12+6], pBind[b*12+7],
@@ -5276,7 +7696,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                     case 106: fmtName="R32G32B32_SFLOAT"; break;
                     case 109: fmtName="R32G32B32A32_SFLOAT"; break;
                 }
-                LOG("    attr[%u]: loc=%u bind=%u fmt=%u(%s) off=%u\n",
+                LOGD(ICD_LC_PIPE, "    attr[%u]: loc=%u bind=%u fmt=%u(%s) off=%u\n",
                     a, loc, abind, fmt, fmtName, off);
             }
         }
@@ -5300,7 +7720,7 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
                 int is_signed = 0, components = 0;
                 uint32_t new_fmt = remap_scaled_format(fmt, &is_signed, &components);
                 if (new_fmt) {
-                    LOG("  SCALED-REMAP: pipe[%u] attr[%u] loc=%u fmt=%u→%u (%s, %d comps)\n",
+                    LOGD(ICD_LC_PIPE, "  SCALED-REMAP: pipe[%u] attr[%u] loc=%u fmt=%u→%u (%s, %d comps)\n",
                         i, a, loc, fmt, new_fmt,
                         is_signed ? "SSCALED→SINT" : "USCALED→UINT", components);
                     *pFmt = new_fmt; /* remap format in-place */
@@ -5317,133 +7737,115 @@ static VkResult trace_CreateGraphicsPipelines(void* device, uint64_t cache, uint
 
     /* Convert inline shaders to real VkShaderModule objects.
      * FEX thunks can't marshal inline SPIR-V pNext across IPC. */
-    uint64_t temp_modules[MAX_TEMP_MODULES];
+    uint64_t* temp_modules = NULL;
     uint32_t n_temp = 0;
     if (real_create_shader_module) {
-        n_temp = fixup_inline_shaders(real, pCreateInfos, count, temp_modules, scaled_remap);
-        if (n_temp > 0) LOG("  created %u temp shader modules\n", n_temp);
+        n_temp = fixup_inline_shaders(real, pCreateInfos, count, 0, &temp_modules, scaled_remap);
+        if (n_temp > 0) LOGD(ICD_LC_PIPE, "  created %u temp shader modules\n", n_temp);
     }
     free(scaled_remap);
 
-    VkResult res = real_create_gfx_pipelines(real, cache, count, pCreateInfos, pAllocator, pPipelines);
-    LOG("[D%d] vkCreateGraphicsPipelines: dev=%p count=%u result=%d\n",
+    if (!cache) cache = g_pcache;
+    VkResult res = create_pipeline_batch(real, cache, count, pCreateInfos, 0, pAllocator, pPipelines);
+    pcache_account(pCreateInfos, count, 0, pPipelines);
+    LOGD(ICD_LC_PIPE, "[D%d] vkCreateGraphicsPipelines: dev=%p count=%u result=%d\n",
         g_device_count, real, count, res);
     if (res != 0) {
-        LOG("[D%d] *** CreateGraphicsPipelines FAILED: count=%u result=%d ***\n",
+        LOGW(ICD_LC_PIPE, "[D%d] *** CreateGraphicsPipelines FAILED: count=%u result=%d ***\n",
             g_device_count, count, res);
     }
 
     /* Cache pipeline VIS info for draw-time binding mismatch checks */
     if (res == 0 && pPipelines) {
         for (uint32_t i = 0; i < count; i++) {
-            if (g_pipe_vis_count >= MAX_PIPE_CACHE) break;
             const uint8_t* ci = (const uint8_t*)pCreateInfos + i * 144;
             void* pVIS = *(void**)(ci + 32);
             if (!pVIS) continue;
             uint32_t bCount = *(uint32_t*)((uint8_t*)pVIS + 20);
             uint8_t* pBind = *(uint8_t**)((uint8_t*)pVIS + 24);
-            int idx = g_pipe_vis_count++;
-            g_pipe_vis[idx].pipeline = pPipelines[i];
-            g_pipe_vis[idx].bindingCount = bCount;
+            PipeVis vis = {0};
+            vis.bindingCount = bCount;
             for (uint32_t b = 0; b < bCount && b < 8; b++) {
-                g_pipe_vis[idx].bindingSlots[b] = *(uint32_t*)(pBind + b*12);
-                g_pipe_vis[idx].strides[b] = *(uint32_t*)(pBind + b*12 + 4);
+                vis.bindingSlots[b] = *(uint32_t*)(pBind + b*12);
+                vis.strides[b] = *(uint32_t*)(pBind + b*12 + 4);
             }
-            LOG("  PIPE-CACHE[%d]: pipe=0x%llx bindings=%u",
-                idx, (unsigned long long)pPipelines[i], bCount);
+            hmap_put(&g_pipe_vis, pPipelines[i], &vis);
+            LOGD(ICD_LC_PIPE, "  PIPE-CACHE[%u]: pipe=0x%llx bindings=%u",
+                hmap_count(&g_pipe_vis), (unsigned long long)pPipelines[i], bCount);
             for (uint32_t b = 0; b < bCount && b < 8; b++)
-                LOG(" slot%u:stride%u", g_pipe_vis[idx].bindingSlots[b], g_pipe_vis[idx].strides[b]);
-            LOG("\n");
+                LOGD(ICD_LC_PIPE, " slot%u:stride%u", vis.bindingSlots[b], vis.strides[b]);
+            LOGD(ICD_LC_PIPE, "\n");
         }
     }
 
     /* Destroy temporary shader modules */
     if (n_temp > 0 && real_destroy_shader_module) {
         for (uint32_t i = 0; i < n_temp; i++) {
+            pcache_forget_module(temp_modules[i]);
             real_destroy_shader_module(real, temp_modules[i], NULL);
         }
-        LOG("  destroyed %u temp shader modules\n", n_temp);
+        LOGD(ICD_LC_PIPE, "  destroyed %u temp shader modules\n", n_temp);
     }
+    free(temp_modules);
 
     return res;
 }
 
-/* --- vkCreateComputePipelines --- */
-typedef VkResult (*PFN_vkCreateComputePipelines)(void*, uint64_t, uint32_t, const void*, const void*, uint64_t*);
-static PFN_vkCreateComputePipelines real_create_comp_pipelines = NULL;
-
 static VkResult trace_CreateComputePipelines(void* device, uint64_t cache, uint32_t count,
                                               const void* pCreateInfos, const void* pAllocator,
                                               uint64_t* pPipelines) {
     void* real = unwrap(device);
-    typedef struct { uint32_t sType; uint32_t _pad; void* pNext; } PNBase;
 
     /* VkComputePipelineCreateInfo (LP64):
      *   0: sType(4)+pad(4)  8: pNext(8)  16: flags(4)+pad(4)
      *  24: stage(48 = VkPipelineShaderStageCreateInfo)  72: layout(8)  80: basePipeHandle(8)  88: basePipeIndex(4)
      * Total ~ 96 bytes
      */
-    uint64_t temp_modules[MAX_TEMP_MODULES];
+    uint64_t* temp_modules = NULL;
     uint32_t n_temp = 0;
-
-    for (uint32_t i = 0; i < count; i++) {
-        uint8_t* ci = (uint8_t*)pCreateInfos + i * 96;
-        /* stage is embedded at offset 24, module at stage+24 = ci+48 */
-        uint64_t* pModule = (uint64_t*)(ci + 24 + 24);
-
-        if (*pModule == 0 && real_create_shader_module && n_temp < MAX_TEMP_MODULES) {
-            /* Walk stage pNext for inline VkShaderModuleCreateInfo */
-            PNBase* pn = (PNBase*)(*(void**)(ci + 24 + 8));
-            while (pn) {
-                if (pn->sType == 16) {
-                    uint64_t new_module = 0;
-                    VkResult r = real_create_shader_module(real, (const void*)pn, NULL, &new_module);
-                    if (r == 0 && new_module) {
-                        *pModule = new_module;
-                        temp_modules[n_temp++] = new_module;
-                        LOG("[D%d] CompPipe[%u]: inline->module 0x%lx\n",
-                            g_device_count, i, (unsigned long)new_module);
-                    }
-                    break;
-                }
-                pn = (PNBase*)pn->pNext;
-            }
-        }
-
-        /* Strip VkPipelineCreateFlags2CreateInfoKHR from pipe pNext */
-        {
-            void** ppNext = (void**)(ci + 8);
-            PNBase* prev = NULL;
-            PNBase* pn = (PNBase*)*ppNext;
-            while (pn) {
-                if (pn->sType == 1000470005) {
-                    if (prev) prev->pNext = pn->pNext;
-                    else *ppNext = pn->pNext;
-                    break;
-                }
-                prev = pn;
-                pn = (PNBase*)pn->pNext;
-            }
-        }
+    if (real_create_shader_module) {
+        n_temp = fixup_inline_shaders(real, pCreateInfos, count, 1, &temp_modules, NULL);
+        if (n_temp > 0)
+            LOGD(ICD_LC_PIPE, "[D%d] CompPipe: created %u temp shader modules\n", g_device_count, n_temp);
     }
 
-    VkResult res = real_create_comp_pipelines(real, cache, count, pCreateInfos, pAllocator, pPipelines);
-    LOG("[D%d] vkCreateComputePipelines: dev=%p count=%u result=%d\n",
+    if (!cache) cache = g_pcache;
+    VkResult res = create_pipeline_batch(real, cache, count, pCreateInfos, 1, pAllocator, pPipelines);
+    pcache_account(pCreateInfos, count, 1, pPipelines);
+    LOGD(ICD_LC_PIPE, "[D%d] vkCreateComputePipelines: dev=%p count=%u result=%d\n",
         g_device_count, real, count, res);
     if (res != 0) {
-        LOG("[D%d] *** CreateComputePipelines FAILED: count=%u result=%d ***\n",
+        LOGW(ICD_LC_PIPE, "[D%d] *** CreateComputePipelines FAILED: count=%u result=%d ***\n",
             g_device_count, count, res);
     }
 
     /* Destroy temporary modules */
     if (n_temp > 0 && real_destroy_shader_module) {
-        for (uint32_t i = 0; i < n_temp; i++)
+        for (uint32_t i = 0; i < n_temp; i++) {
+            pcache_forget_module(temp_modules[i]);
             real_destroy_shader_module(real, temp_modules[i], NULL);
+        }
     }
+    free(temp_modules);
 
     return res;
 }
 
+/* Trace: vkDestroyPipeline — drop the VIS cache entry */
+typedef void (*PFN_vkDestroyPipeline)(void*, uint64_t, const void*);
+static PFN_vkDestroyPipeline real_destroy_pipeline = NULL;
+
+static void trace_DestroyPipeline(void* device, uint64_t pipeline, const void* pAllocator) {
+    hmap_del(&g_pipe_vis, pipeline, NULL);
+    real_destroy_pipeline(unwrap(device), pipeline, pAllocator);
+}
+
+/* Trace: vkDestroyShaderModule — drop its pipeline cache stage hash */
+static void trace_DestroyShaderModule(void* device, uint64_t module, const void* pAllocator) {
+    pcache_forget_module(module);
+    real_destroy_shader_module(unwrap(device), module, pAllocator);
+}
+
 /* ==== Forward declarations for memory requirements (defined later) ==== */
 typedef void (*PFN_vkGetBufMemReqs)(void*, uint64_t, void*);
 static PFN_vkGetBufMemReqs real_get_buf_mem_reqs;
@@ -5774,14 +8176,12 @@ typedef struct {
 } TemplateEntryCompact;
 
 typedef struct {
-    uint64_t templateHandle;
     uint32_t entryCount;
-    TemplateEntryCompact* entries;
+    TemplateEntryCompact* entries;  /* malloc'd, freed in vkDestroyDescriptorUpdateTemplate */
 } TrackedTemplate;
 
-#define MAX_TRACKED_TEMPLATES 256
-static TrackedTemplate g_templates[MAX_TRACKED_TEMPLATES];
-static int g_template_count = 0;
+/* template handle → TrackedTemplate */
+static HandleMap g_templates = HMAP_INIT(TrackedTemplate);
 
 typedef VkResult (*PFN_vkCreateDescUpdateTemplate)(void*, const void*, const void*, uint64_t*);
 static PFN_vkCreateDescUpdateTemplate real_create_desc_update_template = NULL;
@@ -5797,34 +8197,45 @@ static VkResult null_guard_CreateDescriptorUpdateTemplate(void* device, const vo
     uint32_t entryCount = *(const uint32_t*)(ci + 20);
     const uint8_t* pEntries = *(const uint8_t* const*)(ci + 24);
 
-    if (entryCount > 0 && pEntries && g_template_count < MAX_TRACKED_TEMPLATES) {
-        TrackedTemplate* t = &g_templates[g_template_count];
-        t->templateHandle = *pTemplate;
-        t->entryCount = entryCount;
-        t->entries = (TemplateEntryCompact*)malloc(entryCount * sizeof(TemplateEntryCompact));
-        if (t->entries) {
+    if (entryCount > 0 && pEntries) {
+        TrackedTemplate t;
+        t.entryCount = entryCount;
+        t.entries = (TemplateEntryCompact*)malloc(entryCount * sizeof(TemplateEntryCompact));
+        if (t.entries) {
             for (uint32_t i = 0; i < entryCount; i++) {
                 const uint8_t* e = pEntries + i * 32;
-                t->entries[i].dstBinding = *(const uint32_t*)(e + 0);
-                t->entries[i].descriptorCount = *(const uint32_t*)(e + 8);
-                t->entries[i].descriptorType = *(const uint32_t*)(e + 12);
-                t->entries[i].offset = *(const uint64_t*)(e + 16);
-                t->entries[i].stride = *(const uint64_t*)(e + 24);
+                t.entries[i].dstBinding = *(const uint32_t*)(e + 0);
+                t.entries[i].descriptorCount = *(const uint32_t*)(e + 8);
+                t.entries[i].descriptorType = *(const uint32_t*)(e + 12);
+                t.entries[i].offset = *(const uint64_t*)(e + 16);
+                t.entries[i].stride = *(const uint64_t*)(e + 24);
             }
-            g_template_count++;
-            LOG("DescUpdateTemplate: handle=0x%lx entries=%u (tracked #%d)\n",
-                (unsigned long)*pTemplate, entryCount, g_template_count);
+            if (!hmap_put(&g_templates, *pTemplate, &t)) {
+                free(t.entries);
+                return res;
+            }
+            LOGD(ICD_LC_DESC, "DescUpdateTemplate: handle=0x%lx entries=%u (tracked #%u)\n",
+                (unsigned long)*pTemplate, entryCount, hmap_count(&g_templates));
         }
     }
     return res;
 }
 
-static TrackedTemplate* find_template(uint64_t handle) {
-    for (int i = 0; i < g_template_count; i++) {
-        if (g_templates[i].templateHandle == handle)
-            return &g_templates[i];
-    }
-    return NULL;
+/* Copies the tracked layout into *out. The entries array stays valid until
+ * the template is destroyed, which the app may not do while updating with it. */
+static TrackedTemplate* find_template(uint64_t handle, TrackedTemplate* out) {
+    return hmap_get(&g_templates, handle, out) ? out : NULL;
+}
+
+typedef void (*PFN_vkDestroyDescUpdateTemplate)(void*, uint64_t, const void*);
+static PFN_vkDestroyDescUpdateTemplate real_destroy_desc_update_template = NULL;
+
+static void null_guard_DestroyDescriptorUpdateTemplate(void* device, uint64_t descriptorUpdateTemplate,
+                                                        const void* pAllocator) {
+    TrackedTemplate t;
+    if (hmap_del(&g_templates, descriptorUpdateTemplate, &t))
+        free(t.entries);
+    real_destroy_desc_update_template(unwrap(device), descriptorUpdateTemplate, pAllocator);
 }
 
 typedef void (*PFN_vkUpdateDescSetWithTemplate)(void*, uint64_t, uint64_t, const void*);
@@ -5835,13 +8246,15 @@ static void null_guard_UpdateDescriptorSetWithTemplate(void* device, uint64_t de
                                                         const void* pData) {
     void* real = unwrap(device);
     if (!g_dummies_init) create_dummy_resources(real);
+    desc_batch_flush();  /* the set may have batched writes */
 
-    TrackedTemplate* tmpl = find_template(descriptorUpdateTemplate);
+    TrackedTemplate tmpl_info;
+    TrackedTemplate* tmpl = find_template(descriptorUpdateTemplate, &tmpl_info);
     /* Log first few template updates to diagnose UBO bindings */
     static int tmpl_log_count = 0;
     tmpl_log_count++;
     if (tmpl && pData && tmpl_log_count <= 50) {
-        LOG("DescTemplUpdate: set=0x%lx tmpl=0x%lx entries=%u\n",
+        LOGT(ICD_LC_DESC, "DescTemplUpdate: set=0x%lx tmpl=0x%lx entries=%u\n",
             (unsigned long)descriptorSet, (unsigned long)descriptorUpdateTemplate, tmpl->entryCount);
         for (uint32_t e = 0; e < tmpl->entryCount && e < 8; e++) {
             uint32_t type = tmpl->entries[e].descriptorType;
@@ -5855,10 +8268,10 @@ static void null_guard_UpdateDescriptorSetWithTemplate(void* device, uint64_t de
                 uint64_t buf = *(uint64_t*)(p + 0);
                 uint64_t boff = *(uint64_t*)(p + 8);
                 uint64_t range = *(uint64_t*)(p + 16);
-                LOG("  entry[%u] bind=%u type=%u count=%u: buf=0x%lx off=%lu range=%lu\n",
+                LOGT(ICD_LC_DESC, "  entry[%u] bind=%u type=%u count=%u: buf=0x%lx off=%lu range=%lu\n",
                     e, dstBind, type, count, (unsigned long)buf, (unsigned long)boff, (unsigned long)range);
             } else {
-                LOG("  entry[%u] bind=%u type=%u count=%u off=%lu stride=%lu\n",
+                LOGT(ICD_LC_DESC, "  entry[%u] bind=%u type=%u count=%u off=%lu stride=%lu\n",
                     e, dstBind, type, count, (unsigned long)off, (unsigned long)stride);
             }
         }
@@ -5876,26 +8289,8 @@ static void null_guard_UpdateDescriptorSetWithTemplate(void* device, uint64_t de
                 uint64_t buf = *(uint64_t*)(p + 0);
                 uint64_t boff = *(uint64_t*)(p + 8);
                 uint64_t range = *(uint64_t*)(p + 16);
-                if (buf != 0) {
-                    int idx = -1;
-                    for (int si = 0; si < g_set_ubo_track_count; si++) {
-                        if (g_set_ubo_track[si].set_handle == descriptorSet) {
-                            idx = si; break;
-                        }
-                    }
-                    if (idx < 0 && g_set_ubo_track_count < MAX_SET_UBO_TRACK) {
-                        idx = g_set_ubo_track_count++;
-                        g_set_ubo_track[idx].set_handle = descriptorSet;
-                        g_set_ubo_track[idx].ubo_count = 0;
-                    }
-                    if (idx >= 0) {
-                        g_set_ubo_track[idx].ubos[dstBind].buffer = buf;
-                        g_set_ubo_track[idx].ubos[dstBind].offset = boff;
-                        g_set_ubo_track[idx].ubos[dstBind].range = range;
-                        if ((int)(dstBind + 1) > g_set_ubo_track[idx].ubo_count)
-                            g_set_ubo_track[idx].ubo_count = dstBind + 1;
-                    }
-                }
+                if (buf != 0)
+                    set_ubo_track(descriptorSet, dstBind, buf, boff, range);
             }
         }
         for (uint32_t e = 0; e < tmpl->entryCount; e++) {
@@ -5925,42 +8320,30 @@ static void null_guard_UpdateDescriptorSetWithTemplate(void* device, uint64_t de
                 uint64_t boff = *(uint64_t*)(p + 8);
                 uint64_t range = *(uint64_t*)(p + 16);
                 void* ubo_ptr = lookup_ubo_ptr(buf, boff);
-                LOG("TMPL-UBO[%u]: type=%u buf=0x%lx off=%lu range=%lu ptr=%p (bufs=%d maps=%d)\n",
+                LOGT(ICD_LC_DESC, "TMPL-UBO[%u]: type=%u buf=0x%lx off=%lu range=%lu ptr=%p (bufs=%u maps=%u)\n",
                     e, type, (unsigned long)buf, (unsigned long)boff,
-                    (unsigned long)range, ubo_ptr, g_buf_mem_count, g_map_ptr_count);
+                    (unsigned long)range, ubo_ptr, hmap_count(&g_buf_mem), hmap_count(&g_map_ptrs));
                 if (!ubo_ptr) {
                     /* Diagnose WHY lookup failed */
-                    uint64_t found_mem = 0;
-                    for (int ii = g_buf_mem_count - 1; ii >= 0; ii--) {
-                        if (g_buf_mem[ii].buffer == buf) {
-                            found_mem = g_buf_mem[ii].memory;
-                            LOG("  DIAG: buf found in g_buf_mem[%d] mem=0x%lx memOff=%lu\n",
-                                ii, (unsigned long)found_mem, (unsigned long)g_buf_mem[ii].memOffset);
-                            break;
-                        }
-                    }
-                    if (!found_mem) {
-                        LOG("  DIAG: buf 0x%lx NOT FOUND in g_buf_mem (searched %d entries)\n",
-                            (unsigned long)buf, g_buf_mem_count);
+                    BufMemEntry bm;
+                    MapPtrEntry mp;
+                    if (!hmap_get(&g_buf_mem, buf, &bm)) {
+                        LOGT(ICD_LC_DESC, "  DIAG: buf 0x%lx NOT FOUND in g_buf_mem (%u entries)\n",
+                            (unsigned long)buf, hmap_count(&g_buf_mem));
                     } else {
-                        int map_found = 0;
-                        for (int ii = g_map_ptr_count - 1; ii >= 0; ii--) {
-                            if (g_map_ptrs[ii].memory == found_mem) {
-                                map_found = 1;
-                                LOG("  DIAG: mem 0x%lx found in g_map_ptrs[%d] ptr=%p mapOff=%lu\n",
-                                    (unsigned long)found_mem, ii,
-                                    g_map_ptrs[ii].pointer, (unsigned long)g_map_ptrs[ii].mapOffset);
-                                break;
-                            }
-                        }
-                        if (!map_found) {
-                            LOG("  DIAG: mem 0x%lx NOT MAPPED (searched %d map entries) -> DEVICE_LOCAL only?\n",
-                                (unsigned long)found_mem, g_map_ptr_count);
+                        LOGT(ICD_LC_DESC, "  DIAG: buf found in g_buf_mem mem=0x%lx memOff=%lu\n",
+                            (unsigned long)bm.memory, (unsigned long)bm.memOffset);
+                        if (map_ptr_find(bm.memory, &mp)) {
+                            LOGT(ICD_LC_DESC, "  DIAG: mem 0x%lx found in g_map_ptrs ptr=%p mapOff=%lu\n",
+                                (unsigned long)bm.memory, mp.pointer, (unsigned long)mp.mapOffset);
+                        } else {
+                            LOGT(ICD_LC_DESC, "  DIAG: mem 0x%lx NOT MAPPED (%u map entries) -> DEVICE_LOCAL only?\n",
+                                (unsigned long)bm.memory, hmap_count(&g_map_ptrs));
                         }
                     }
                 }
                 /* FULL-SCAN removed — this SSBO is the text/glyph table, not mesh transform.
-                 * Mesh UBO readback now happens at CmdDrawIndexed time via g_last_ubo. */
+                 * Mesh UBO readback now happens at CmdDrawIndexed time via cbs->ubo. */
             }
         }
     }
@@ -6006,12 +8389,441 @@ static void null_guard_UpdateDescriptorSetWithTemplate(void* device, uint64_t de
         }
     }
 
-    real_update_desc_set_with_template(real, descriptorSet, descriptorUpdateTemplate, pData);
+    real_update_desc_set_with_template(real, descriptorSet, descriptorUpdateTemplate, pData);
+}
+
+/* ==== Descriptor Update Batching ====
+ *
+ * Every vkUpdateDescriptorSets is one thunk round trip, and DXVK issues many
+ * small ones. Deferrable writes are copied (with their image/buffer/texel
+ * infos, NULL handles already patched) into one pending list for the shared
+ * real device, and flushed as a single vkUpdateDescriptorSets. The list is
+ * flushed:
+ *   - before a descriptor set is bound (CmdBindDescriptorSets) or a queue is
+ *     submitted, so the driver sees the writes before any use;
+ *   - before anything that could reorder against them or invalidate their
+ *     handles: template updates, copies, freeing/resetting sets, destroying
+ *     a pool, layout, buffer, view or sampler, device teardown;
+ *   - when it reaches DESC_BATCH_MAX_WRITES.
+ * Writes with a pNext chain or an unknown type are sent immediately.
+ *
+ * At flush time the writes are grouped per set. A group whose shape
+ * (layout + binding/element/count/type of every write) has been seen
+ * DESC_TMPL_REPEATS times gets a cached VkDescriptorUpdateTemplate and goes
+ * out as vkUpdateDescriptorSetWithTemplate: one handle plus a packed info
+ * blob, instead of 64 bytes per write plus pointers for Vortek to chase.
+ * Writes to different sets commute, and a set's writes keep their order.
+ *
+ * ICD_DESC_BATCH=0 flushes at the end of every vkUpdateDescriptorSets call
+ * (templates still apply).
+ */
+
+#define DESC_BATCH_MAX_WRITES  4096
+#define DESC_TMPL_REPEATS      3    /* uses of a shape before it gets a template */
+#define DESC_TMPL_MAX_ENTRIES  32
+#define DESC_SHAPES_PER_LAYOUT 16
+
+typedef struct {
+    uint64_t set;
+    uint32_t binding;
+    uint32_t elem;
+    uint32_t count;
+    uint32_t type;
+    uint32_t info_off;      /* copied infos, in DescBatch::infos */
+    uint32_t seq;           /* arrival order within the batch */
+} DescPendingWrite;
+
+static struct {
+    pthread_mutex_t lock;
+    void* device;           /* real device the pending writes belong to */
+    DescPendingWrite* writes;
+    uint32_t count, cap;
+    uint8_t* infos;
+    uint32_t info_len, info_cap;
+    uint8_t* scratch;       /* VkWriteDescriptorSet array / template blob */
+    uint32_t scratch_cap;
+    uint64_t calls, deferred, flushes, thunk_calls, tmpl_updates;
+} g_desc_batch = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t g_desc_batch_once = PTHREAD_ONCE_INIT;
+static int g_desc_batch_defer = 1;  /* 0: flush at the end of each call */
+
+/* descriptor set → its VkDescriptorSetLayout (from vkAllocateDescriptorSets) */
+static HandleMap g_desc_set_layout = HMAP_INIT(uint64_t);
+
+typedef struct {
+    uint64_t key;           /* shape hash */
+    uint64_t tmpl;          /* 0 until DESC_TMPL_REPEATS uses */
+    uint32_t uses;
+    int failed;             /* template creation failed: don't retry */
+    uint32_t n;
+    uint32_t* fields;       /* n x {binding, elem, count, type}, compared on reuse */
+} DescShape;
+
+/* layout → shapes seen on its sets; templates die with the layout */
+typedef struct {
+    uint32_t count;
+    DescShape shapes[DESC_SHAPES_PER_LAYOUT];
+} DescLayoutShapes;
+static HandleMap g_desc_layout_shapes = HMAP_INIT(DescLayoutShapes);
+
+static void desc_batch_init(void) {
+    const char* env = getenv("ICD_DESC_BATCH");
+    if (env && *env == '0') {
+        g_desc_batch_defer = 0;
+        LOG("Descriptor batching: deferral disabled (ICD_DESC_BATCH=0)\n");
+    }
+}
+
+/* Bytes of info per descriptor, 0 if writes of this type can't be deferred */
+static uint32_t desc_info_stride(uint32_t type) {
+    if (type <= 3 || type == 10) return 24;   /* VkDescriptorImageInfo */
+    if (type >= 6 && type <= 9) return 24;    /* VkDescriptorBufferInfo */
+    if (type == 4 || type == 5) return 8;     /* VkBufferView */
+    return 0;
+}
+
+/* VkWriteDescriptorSet field holding the infos: pImageInfo, pBufferInfo or pTexelBufferView */
+static uint32_t desc_info_field(uint32_t type) {
+    if (type == 4 || type == 5) return 56;
+    if (type >= 6 && type <= 9) return 48;
+    return 40;
+}
+
+static int desc_grow(void** buf, uint32_t* cap, uint32_t need, uint32_t min) {
+    if (need <= *cap) return 1;
+    uint32_t ncap = *cap ? *cap : min;
+    while (ncap < need) ncap *= 2;
+    void* nbuf = realloc(*buf, ncap);
+    if (!nbuf) return 0;
+    *buf = nbuf;
+    *cap = ncap;
+    return 1;
+}
+
+/* Fill a VkWriteDescriptorSet for a pending write */
+static void desc_build_write(uint8_t* ws, const DescPendingWrite* w, uint8_t* info) {
+    memset(ws, 0, WRITE_DESC_SET_SIZE);
+    *(uint32_t*)(ws + 0) = 35; /* VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET */
+    *(uint64_t*)(ws + 16) = w->set;
+    *(uint32_t*)(ws + 24) = w->binding;
+    *(uint32_t*)(ws + 28) = w->elem;
+    *(uint32_t*)(ws + 32) = w->count;
+    *(uint32_t*)(ws + 36) = w->type;
+    *(uint8_t**)(ws + desc_info_field(w->type)) = info;
+}
+
+/* Copy one write into the batch (see desc_write_deferrable). Returns 1 if
+ * queued, 0 if skipped because of a NULL handle that can't be patched, -1
+ * if the batch can't grow and the caller must apply the write itself.
+ * Caller holds the lock. */
+static int desc_batch_add(const uint8_t* ws) {
+    DescPendingWrite w;
+    w.set = *(const uint64_t*)(ws + 16);
+    w.binding = *(const uint32_t*)(ws + 24);
+    w.elem = *(const uint32_t*)(ws + 28);
+    w.count = *(const uint32_t*)(ws + 32);
+    w.type = *(const uint32_t*)(ws + 36);
+    uint32_t stride = desc_info_stride(w.type);
+    const uint8_t* src = *(const uint8_t* const*)(ws + desc_info_field(w.type));
+    uint32_t bytes = w.count * stride;
+
+    if (!desc_grow((void**)&g_desc_batch.infos, &g_desc_batch.info_cap,
+                   g_desc_batch.info_len + bytes, 16384) ||
+        !desc_grow((void**)&g_desc_batch.writes, &g_desc_batch.cap,
+                   (g_desc_batch.count + 1) * sizeof(DescPendingWrite),
+                   256 * sizeof(DescPendingWrite))) {
+        LOGW(ICD_LC_DESC, "desc batch: out of memory, writing set 0x%llx directly\n",
+            (unsigned long long)w.set);
+        return -1;
+    }
+    w.info_off = g_desc_batch.info_len;
+    w.seq = g_desc_batch.count;
+    uint8_t* info = g_desc_batch.infos + w.info_off;
+    memcpy(info, src, bytes);
+
+    /* Patch NULL handles in our copy, not in the app's arrays */
+    uint8_t tmp[WRITE_DESC_SET_SIZE];
+    desc_build_write(tmp, &w, info);
+    if (!fix_or_check_write(tmp)) return 0;
+
+    g_desc_batch.info_len += bytes;
+    g_desc_batch.writes[g_desc_batch.count++] = w;
+    return 1;
+}
+
+/* Plain writes of a known type with their info array: anything else goes
+ * to the driver unchanged */
+static int desc_write_deferrable(const uint8_t* ws) {
+    uint32_t type = *(const uint32_t*)(ws + 36);
+    return *(const void* const*)(ws + 8) == NULL && desc_info_stride(type) &&
+           *(const void* const*)(ws + desc_info_field(type)) != NULL;
+}
+
+static int desc_write_cmp(const void* a, const void* b) {
+    const DescPendingWrite* x = (const DescPendingWrite*)a;
+    const DescPendingWrite* y = (const DescPendingWrite*)b;
+    if (x->set != y->set) return x->set < y->set ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* Send one set's writes through a cached template if its shape qualifies.
+ * Returns 1 if the writes were applied. Caller holds the batch lock. */
+static int desc_try_template(void* real, const DescPendingWrite* g, uint32_t n) {
+    if (n > DESC_TMPL_MAX_ENTRIES || !real_update_desc_set_with_template ||
+        !real_create_desc_update_template)
+        return 0;
+    uint64_t layout = 0;
+    if (!hmap_get(&g_desc_set_layout, g[0].set, &layout)) return 0;
+
+    /* Shape hash; a binding written twice would make template entries overlap */
+    uint64_t key = 0xcbf29ce484222325ULL ^ layout;
+    uint32_t blob_size = 0;
+    uint32_t fields[DESC_TMPL_MAX_ENTRIES * 4];
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t j = 0; j < i; j++)
+            if (g[j].binding == g[i].binding) return 0;
+        uint32_t* f = fields + i * 4;
+        f[0] = g[i].binding;
+        f[1] = g[i].elem;
+        f[2] = g[i].count;
+        f[3] = g[i].type;
+        for (int k = 0; k < 4; k++) key = (key ^ f[k]) * 0x100000001b3ULL;
+        blob_size += g[i].count * desc_info_stride(g[i].type);
+    }
+    if (!key) key = 1;
+    size_t fields_size = (size_t)n * 4 * sizeof(uint32_t);
+
+    /* A shape is only reused if its writes match, not just its hash */
+    hmap_wrlock(&g_desc_layout_shapes);
+    DescLayoutShapes* ls = (DescLayoutShapes*)hmap_insert_locked(&g_desc_layout_shapes, layout);
+    DescShape* s = NULL;
+    int collided = 0;
+    for (uint32_t i = 0; ls && i < ls->count && !s; i++) {
+        if (ls->shapes[i].key != key) continue;
+        if (ls->shapes[i].n == n && !memcmp(ls->shapes[i].fields, fields, fields_size))
+            s = &ls->shapes[i];
+        else
+            collided = 1;
+    }
+    if (!s && !collided && ls && ls->count < DESC_SHAPES_PER_LAYOUT) {
+        uint32_t* copy = (uint32_t*)malloc(fields_size);
+        if (copy) {
+            memcpy(copy, fields, fields_size);
+            s = &ls->shapes[ls->count++];
+            s->key = key;
+            s->n = n;
+            s->fields = copy;
+        }
+    }
+    DescShape shape = {0};
+    if (s) {
+        s->uses++;
+        shape = *s;
+    }
+    hmap_unlock(&g_desc_layout_shapes);
+    if (!s || shape.failed || shape.uses < DESC_TMPL_REPEATS) return 0;
+
+    if (!shape.tmpl) {
+        /* VkDescriptorUpdateTemplateEntry[n] + VkDescriptorUpdateTemplateCreateInfo */
+        uint8_t entries[DESC_TMPL_MAX_ENTRIES * 32];
+        uint64_t off = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t* e = entries + i * 32;
+            uint64_t stride = desc_info_stride(g[i].type);
+            *(uint32_t*)(e + 0) = g[i].binding;
+            *(uint32_t*)(e + 4) = g[i].elem;
+            *(uint32_t*)(e + 8) = g[i].count;
+            *(uint32_t*)(e + 12) = g[i].type;
+            *(uint64_t*)(e + 16) = off;
+            *(uint64_t*)(e + 24) = stride;
+            off += g[i].count * stride;
+        }
+        uint8_t ci[72] = {0};
+        *(uint32_t*)(ci + 0) = 1000085000; /* VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO */
+        *(uint32_t*)(ci + 20) = n;
+        *(const uint8_t**)(ci + 24) = entries;
+        *(uint32_t*)(ci + 32) = 0;         /* VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET */
+        *(uint64_t*)(ci + 40) = layout;
+        uint64_t tmpl = 0;
+        VkResult res = real_create_desc_update_template(real, ci, NULL, &tmpl);
+
+        hmap_wrlock(&g_desc_layout_shapes);
+        ls = (DescLayoutShapes*)hmap_find_locked(&g_desc_layout_shapes, layout);
+        for (uint32_t i = 0; ls && i < ls->count; i++) {
+            if (ls->shapes[i].key != key || ls->shapes[i].n != n ||
+                memcmp(ls->shapes[i].fields, fields, fields_size))
+                continue;
+            ls->shapes[i].tmpl = res == 0 ? tmpl : 0;
+            ls->shapes[i].failed = res != 0 || !tmpl;
+        }
+        hmap_unlock(&g_desc_layout_shapes);
+        if (res != 0 || !tmpl) {
+            LOGW(ICD_LC_DESC, "desc batch: template for layout 0x%llx (%u writes) failed: %d\n",
+                (unsigned long long)layout, n, res);
+            return 0;
+        }
+        LOGD(ICD_LC_DESC, "desc batch: template 0x%llx for layout 0x%llx, %u writes, %u bytes\n",
+            (unsigned long long)tmpl, (unsigned long long)layout, n, blob_size);
+        shape.tmpl = tmpl;
+    }
+
+    if (!desc_grow((void**)&g_desc_batch.scratch, &g_desc_batch.scratch_cap, blob_size, 4096))
+        return 0;
+    uint8_t* blob = g_desc_batch.scratch;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t bytes = g[i].count * desc_info_stride(g[i].type);
+        memcpy(blob, g_desc_batch.infos + g[i].info_off, bytes);
+        blob += bytes;
+    }
+    real_update_desc_set_with_template(real, g[0].set, shape.tmpl, g_desc_batch.scratch);
+    g_desc_batch.tmpl_updates++;
+    g_desc_batch.thunk_calls++;
+    return 1;
+}
+
+/* Send every pending write to the driver. Caller holds the lock. */
+static void desc_batch_flush_locked(void) {
+    uint32_t n = g_desc_batch.count;
+    if (!n) return;
+    void* real = g_desc_batch.device;
+    DescPendingWrite* ws = g_desc_batch.writes;
+    qsort(ws, n, sizeof(*ws), desc_write_cmp);
+
+    /* Template groups go out as they are found; the rest are compacted to
+     * the front of the array and sent in one call at the end. */
+    uint32_t plain = 0;
+    for (uint32_t i = 0; i < n;) {
+        uint32_t j = i + 1;
+        while (j < n && ws[j].set == ws[i].set) j++;
+        if (!desc_try_template(real, ws + i, j - i)) {
+            memmove(ws + plain, ws + i, (j - i) * sizeof(*ws));
+            plain += j - i;
+        }
+        i = j;
+    }
+    if (plain && desc_grow((void**)&g_desc_batch.scratch, &g_desc_batch.scratch_cap,
+                           plain * WRITE_DESC_SET_SIZE, 4096)) {
+        for (uint32_t i = 0; i < plain; i++)
+            desc_build_write(g_desc_batch.scratch + i * WRITE_DESC_SET_SIZE, &ws[i],
+                             g_desc_batch.infos + ws[i].info_off);
+        real_update_desc_sets(real, plain, g_desc_batch.scratch, 0, NULL);
+        g_desc_batch.thunk_calls++;
+    }
+    g_desc_batch.flushes++;
+    __atomic_store_n(&g_desc_batch.count, 0, __ATOMIC_RELEASE);
+    g_desc_batch.info_len = 0;
+}
+
+static void desc_batch_flush(void) {
+    if (!__atomic_load_n(&g_desc_batch.count, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&g_desc_batch.lock);
+    desc_batch_flush_locked();
+    pthread_mutex_unlock(&g_desc_batch.lock);
+}
+
+/* vkDestroyDescriptorSetLayout: its sets can't be updated any more, so the
+ * pending writes go out first, then the layout's templates are destroyed. */
+static void desc_batch_forget_layout(void* real_device, uint64_t layout) {
+    pthread_mutex_lock(&g_desc_batch.lock);
+    desc_batch_flush_locked();
+    DescLayoutShapes ls;
+    if (hmap_del(&g_desc_layout_shapes, layout, &ls)) {
+        for (uint32_t i = 0; i < ls.count; i++) {
+            if (ls.shapes[i].tmpl && real_destroy_desc_update_template)
+                real_destroy_desc_update_template(real_device, ls.shapes[i].tmpl, NULL);
+            free(ls.shapes[i].fields);
+        }
+    }
+    pthread_mutex_unlock(&g_desc_batch.lock);
+}
+
+/* Last device reference: flush, destroy every template, log the savings */
+static void desc_batch_close(void* real_device) {
+    pthread_mutex_lock(&g_desc_batch.lock);
+    desc_batch_flush_locked();
+    uint32_t tmpls = 0;
+    hmap_wrlock(&g_desc_layout_shapes);
+    for (uint32_t i = 0; i < g_desc_layout_shapes.cap; i++) {
+        if (!g_desc_layout_shapes.keys[i]) continue;
+        DescLayoutShapes* ls = (DescLayoutShapes*)hmap_val(&g_desc_layout_shapes, i);
+        for (uint32_t s = 0; s < ls->count; s++) {
+            free(ls->shapes[s].fields);
+            if (!ls->shapes[s].tmpl) continue;
+            if (real_destroy_desc_update_template)
+                real_destroy_desc_update_template(real_device, ls->shapes[s].tmpl, NULL);
+            tmpls++;
+        }
+    }
+    hmap_unlock(&g_desc_layout_shapes);
+    hmap_clear(&g_desc_layout_shapes);
+    hmap_clear(&g_desc_set_layout);
+    if (g_desc_batch.calls)
+        LOG("Descriptor batching: %llu vkUpdateDescriptorSets (%llu writes deferred) -> "
+            "%llu flushes, %llu driver calls (%llu via %u templates)\n",
+            (unsigned long long)g_desc_batch.calls, (unsigned long long)g_desc_batch.deferred,
+            (unsigned long long)g_desc_batch.flushes, (unsigned long long)g_desc_batch.thunk_calls,
+            (unsigned long long)g_desc_batch.tmpl_updates, tmpls);
+    g_desc_batch.device = NULL;
+    g_desc_batch.calls = g_desc_batch.deferred = g_desc_batch.flushes = 0;
+    g_desc_batch.thunk_calls = g_desc_batch.tmpl_updates = 0;
+    pthread_mutex_unlock(&g_desc_batch.lock);
+}
+
+/* vkAllocateDescriptorSets: remember each set's layout for the template path */
+static void desc_batch_note_sets(const void* pAllocInfo, const uint64_t* pDescSets) {
+    /* VkDescriptorSetAllocateInfo: 24: descriptorSetCount(4)  32: pSetLayouts(8) */
+    uint32_t count = *(const uint32_t*)((const char*)pAllocInfo + 24);
+    const uint64_t* layouts = *(const uint64_t* const*)((const char*)pAllocInfo + 32);
+    if (!layouts) return;
+    for (uint32_t i = 0; i < count; i++)
+        hmap_put(&g_desc_set_layout, pDescSets[i], &layouts[i]);
 }
 
+/* ---- vkUpdateDescriptorSets ---- */
+
 static int g_null_guard_logged = 0;
 static int g_uds_log_count = 0;
 
+/* Send a call to the driver as is, minus writes with unfixable NULL handles */
+static void desc_update_now(void* real, uint32_t writeCount, const void* pWrites,
+                            uint32_t copyCount, const void* pCopies) {
+    /* Build filtered writes array: fix NULL handles or skip unfixable writes */
+    uint8_t filtered[64 * WRITE_DESC_SET_SIZE]; /* stack buffer for up to 64 writes */
+    uint8_t* heap_buf = NULL;
+    uint8_t* out = filtered;
+
+    if (writeCount > 64) {
+        heap_buf = (uint8_t*)malloc(writeCount * WRITE_DESC_SET_SIZE);
+        out = heap_buf ? heap_buf : filtered;
+        if (!heap_buf) writeCount = 64; /* safety cap */
+    }
+
+    uint32_t kept = 0;
+    uint32_t skipped = 0;
+    for (uint32_t w = 0; w < writeCount; w++) {
+        uint8_t* ws = (uint8_t*)pWrites + w * WRITE_DESC_SET_SIZE;
+        /* Make a mutable copy so we can patch in-place */
+        memcpy(out + kept * WRITE_DESC_SET_SIZE, ws, WRITE_DESC_SET_SIZE);
+        if (fix_or_check_write(out + kept * WRITE_DESC_SET_SIZE)) {
+            kept++;
+        } else {
+            skipped++;
+        }
+    }
+
+    if (skipped > 0 && !g_null_guard_logged) {
+        LOGT(ICD_LC_DESC, "null_guard: skipped %u/%u descriptor writes with unfixable NULL handles\n",
+            skipped, writeCount);
+        g_null_guard_logged = 1;
+    }
+
+    if (kept > 0 || copyCount > 0)
+        real_update_desc_sets(real, kept, out, copyCount, pCopies);
+
+    if (heap_buf) free(heap_buf);
+}
+
 static void null_guard_UpdateDescriptorSets(void* device, uint32_t writeCount,
                                              const void* pWrites,
                                              uint32_t copyCount, const void* pCopies) {
@@ -6019,6 +8831,7 @@ static void null_guard_UpdateDescriptorSets(void* device, uint32_t writeCount,
 
     /* Lazily init dummy resources on first call */
     if (!g_dummies_init) create_dummy_resources(real);
+    pthread_once(&g_desc_batch_once, desc_batch_init);
 
     /* Track UBO entries for ALL UDS calls; only LOG first N */
     g_uds_log_count++;
@@ -6038,72 +8851,61 @@ static void null_guard_UpdateDescriptorSets(void* device, uint32_t writeCount,
                     uint64_t boff = *(const uint64_t*)(pBufInfo + 8);
                     uint64_t range = *(const uint64_t*)(pBufInfo + 16);
                     if (g_uds_log_count <= 200) {
-                        LOG("UDS[%u]: set=0x%lx bind=%u type=%u buf=0x%lx off=%lu range=%lu\n",
+                        LOGT(ICD_LC_DESC, "UDS[%u]: set=0x%lx bind=%u type=%u buf=0x%lx off=%lu range=%lu\n",
                             g_uds_log_count, (unsigned long)dstSet, dstBinding, type,
                             (unsigned long)buf, (unsigned long)boff, (unsigned long)range);
                     }
-                    if ((type == 6 || type == 7) && dstBinding < MAX_LAST_UBO) {
-                        int idx = -1;
-                        for (int si = 0; si < g_set_ubo_track_count; si++) {
-                            if (g_set_ubo_track[si].set_handle == dstSet) {
-                                idx = si; break;
-                            }
-                        }
-                        if (idx < 0 && g_set_ubo_track_count < MAX_SET_UBO_TRACK) {
-                            idx = g_set_ubo_track_count++;
-                            g_set_ubo_track[idx].set_handle = dstSet;
-                            g_set_ubo_track[idx].ubo_count = 0;
-                        }
-                        if (idx >= 0) {
-                            g_set_ubo_track[idx].ubos[dstBinding].buffer = buf;
-                            g_set_ubo_track[idx].ubos[dstBinding].offset = boff;
-                            g_set_ubo_track[idx].ubos[dstBinding].range = range;
-                            if ((int)(dstBinding + 1) > g_set_ubo_track[idx].ubo_count)
-                                g_set_ubo_track[idx].ubo_count = dstBinding + 1;
-                        }
-                    }
+                    if (type == 6 || type == 7)
+                        set_ubo_track(dstSet, dstBinding, buf, boff, range);
                 }
             } else if (g_uds_log_count <= 50) {
-                LOG("UDS[%u]: set=0x%lx bind=%u type=%u count=%u\n",
+                LOGT(ICD_LC_DESC, "UDS[%u]: set=0x%lx bind=%u type=%u count=%u\n",
                     g_uds_log_count, (unsigned long)dstSet, dstBinding, type, count);
             }
         }
     }
 
-    /* Build filtered writes array: fix NULL handles or skip unfixable writes */
-    uint8_t filtered[64 * WRITE_DESC_SET_SIZE]; /* stack buffer for up to 64 writes */
-    uint8_t* heap_buf = NULL;
-    uint8_t* out = filtered;
-
-    if (writeCount > 64) {
-        heap_buf = (uint8_t*)malloc(writeCount * WRITE_DESC_SET_SIZE);
-        out = heap_buf ? heap_buf : filtered;
-        if (!heap_buf) writeCount = 64; /* safety cap */
+    /* Copies read sets, so they (and writes we can't copy) need every
+     * earlier write applied first */
+    int defer = copyCount == 0 && pWrites;
+    for (uint32_t w = 0; defer && w < writeCount; w++)
+        defer = desc_write_deferrable((const uint8_t*)pWrites + w * WRITE_DESC_SET_SIZE);
+    if (!defer) {
+        desc_batch_flush();
+        desc_update_now(real, writeCount, pWrites, copyCount, pCopies);
+        return;
     }
 
-    uint32_t kept = 0;
     uint32_t skipped = 0;
+    pthread_mutex_lock(&g_desc_batch.lock);
+    if (g_desc_batch.device != real) {
+        desc_batch_flush_locked();
+        g_desc_batch.device = real;
+    }
+    g_desc_batch.calls++;
     for (uint32_t w = 0; w < writeCount; w++) {
-        uint8_t* ws = (uint8_t*)pWrites + w * WRITE_DESC_SET_SIZE;
-        /* Make a mutable copy so we can patch in-place */
-        memcpy(out + kept * WRITE_DESC_SET_SIZE, ws, WRITE_DESC_SET_SIZE);
-        if (fix_or_check_write(out + kept * WRITE_DESC_SET_SIZE)) {
-            kept++;
-        } else {
+        const uint8_t* ws = (const uint8_t*)pWrites + w * WRITE_DESC_SET_SIZE;
+        if (*(const uint32_t*)(ws + 32) == 0) continue;
+        int added = desc_batch_add(ws);
+        if (added > 0) {
+            g_desc_batch.deferred++;
+        } else if (added == 0) {
             skipped++;
+        } else {
+            /* The batch can't grow: what is pending goes first, in order */
+            desc_batch_flush_locked();
+            desc_update_now(real, 1, ws, 0, NULL);
         }
     }
+    if (!g_desc_batch_defer || g_desc_batch.count >= DESC_BATCH_MAX_WRITES)
+        desc_batch_flush_locked();
+    pthread_mutex_unlock(&g_desc_batch.lock);
 
     if (skipped > 0 && !g_null_guard_logged) {
-        LOG("null_guard: skipped %u/%u descriptor writes with unfixable NULL handles\n",
+        LOGT(ICD_LC_DESC, "null_guard: skipped %u/%u descriptor writes with unfixable NULL handles\n",
             skipped, writeCount);
         g_null_guard_logged = 1;
     }
-
-    if (kept > 0)
-        real_update_desc_sets(real, kept, out, copyCount, pCopies);
-
-    if (heap_buf) free(heap_buf);
 }
 
 /* --- vkCreateRenderPass / vkCreateRenderPass2 --- */
@@ -6114,7 +8916,7 @@ static VkResult trace_CreateRenderPass(void* device, const void* pCreateInfo,
                                         const void* pAllocator, uint64_t* pRenderPass) {
     void* real = unwrap(device);
     VkResult res = real_create_render_pass(real, pCreateInfo, pAllocator, pRenderPass);
-    LOG("[D%d] vkCreateRenderPass: dev=%p result=%d rp=0x%llx\n",
+    LOGD(ICD_LC_PIPE, "[D%d] vkCreateRenderPass: dev=%p result=%d rp=0x%llx\n",
         g_device_count, real, res, pRenderPass ? (unsigned long long)*pRenderPass : 0);
     return res;
 }
@@ -6126,7 +8928,7 @@ static VkResult trace_CreateRenderPass2(void* device, const void* pCreateInfo,
                                          const void* pAllocator, uint64_t* pRenderPass) {
     void* real = unwrap(device);
     VkResult res = real_create_render_pass2(real, pCreateInfo, pAllocator, pRenderPass);
-    LOG("[D%d] vkCreateRenderPass2: dev=%p result=%d rp=0x%llx\n",
+    LOGD(ICD_LC_PIPE, "[D%d] vkCreateRenderPass2: dev=%p result=%d rp=0x%llx\n",
         g_device_count, real, res, pRenderPass ? (unsigned long long)*pRenderPass : 0);
     return res;
 }
@@ -6143,8 +8945,9 @@ static VkResult trace_AllocateDescriptorSets(void* device, const void* pAllocInf
     if (pAllocInfo)
         count = *(const uint32_t*)((const char*)pAllocInfo + 24);
     VkResult res = real_alloc_desc_sets(real, pAllocInfo, pDescSets);
-    LOG("[D%d] vkAllocateDescriptorSets: dev=%p count=%u result=%d\n",
+    LOGT(ICD_LC_DESC, "[D%d] vkAllocateDescriptorSets: dev=%p count=%u result=%d\n",
         g_device_count, real, count, res);
+    if (res == 0 && pAllocInfo && pDescSets) desc_batch_note_sets(pAllocInfo, pDescSets);
     return res;
 }
 
@@ -6156,11 +8959,60 @@ static VkResult trace_CreateDescriptorPool(void* device, const void* pCreateInfo
                                             const void* pAllocator, uint64_t* pPool) {
     void* real = unwrap(device);
     VkResult res = real_create_desc_pool(real, pCreateInfo, pAllocator, pPool);
-    LOG("[D%d] vkCreateDescriptorPool: dev=%p result=%d pool=0x%llx\n",
+    LOGD(ICD_LC_DESC, "[D%d] vkCreateDescriptorPool: dev=%p result=%d pool=0x%llx\n",
         g_device_count, real, res, pPool ? (unsigned long long)*pPool : 0);
     return res;
 }
 
+/* --- Calls that must not overtake batched descriptor writes ---
+ * Freed sets and destroyed handles can't be written any more, so pending
+ * writes go to the driver first (see "Descriptor Update Batching"). */
+typedef VkResult (*PFN_vkFreeDescSets)(void*, uint64_t, uint32_t, const uint64_t*);
+static PFN_vkFreeDescSets real_free_desc_sets = NULL;
+
+static VkResult trace_FreeDescriptorSets(void* device, uint64_t pool, uint32_t count,
+                                          const uint64_t* pSets) {
+    desc_batch_flush();
+    return real_free_desc_sets(unwrap(device), pool, count, pSets);
+}
+
+typedef VkResult (*PFN_vkResetDescPool)(void*, uint64_t, uint32_t);
+static PFN_vkResetDescPool real_reset_desc_pool = NULL;
+
+static VkResult trace_ResetDescriptorPool(void* device, uint64_t pool, uint32_t flags) {
+    desc_batch_flush();
+    return real_reset_desc_pool(unwrap(device), pool, flags);
+}
+
+/* vkDestroyDescriptorPool, vkDestroySampler, vkDestroyBufferView */
+typedef void (*PFN_vkDestroyObject)(void*, uint64_t, const void*);
+static PFN_vkDestroyObject real_destroy_desc_pool = NULL;
+static PFN_vkDestroyObject real_destroy_sampler = NULL;
+static PFN_vkDestroyObject real_destroy_buffer_view = NULL;
+static PFN_vkDestroyObject real_destroy_dsl = NULL;
+
+static void trace_DestroyDescriptorPool(void* device, uint64_t pool, const void* pAllocator) {
+    desc_batch_flush();
+    real_destroy_desc_pool(unwrap(device), pool, pAllocator);
+}
+
+static void trace_DestroySampler(void* device, uint64_t sampler, const void* pAllocator) {
+    desc_batch_flush();
+    real_destroy_sampler(unwrap(device), sampler, pAllocator);
+}
+
+static void trace_DestroyBufferView(void* device, uint64_t view, const void* pAllocator) {
+    desc_batch_flush();
+    real_destroy_buffer_view(unwrap(device), view, pAllocator);
+}
+
+/* Also drops the batching templates built on the layout */
+static void trace_DestroyDescriptorSetLayout(void* device, uint64_t layout, const void* pAllocator) {
+    void* real = unwrap(device);
+    desc_batch_forget_layout(real, layout);
+    real_destroy_dsl(real, layout, pAllocator);
+}
+
 /* ==== Memory requirements patching ====
  *
  * When we add a virtual DEVICE_LOCAL-only type (g_added_type_index >= 0),
@@ -6183,7 +9035,7 @@ static void wrapped_GetBufferMemoryRequirements(void* device, uint64_t buffer, v
         uint32_t orig = *bits;
         if (g_added_type_index >= 0)
             *bits |= (1u << g_added_type_index);
-        LOG("GetBufMemReqs: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
+        LOGD(ICD_LC_MEM, "GetBufMemReqs: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
     }
 }
 
@@ -6207,7 +9059,7 @@ static void wrapped_GetBufferMemoryRequirements2(void* device, const void* pInfo
         uint32_t orig = *bits;
         if (g_added_type_index >= 0)
             *bits |= (1u << g_added_type_index);
-        LOG("GetBufMemReqs2: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
+        LOGD(ICD_LC_MEM, "GetBufMemReqs2: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
     }
 }
 
@@ -6238,7 +9090,7 @@ static void wrapped_GetDeviceBufferMemoryRequirements(void* device, const void*
         uint32_t orig = *bits;
         if (g_added_type_index >= 0)
             *bits |= (1u << g_added_type_index);
-        LOG("GetDevBufMemReqs: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
+        LOGD(ICD_LC_MEM, "GetDevBufMemReqs: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
     }
 }
 
@@ -6253,8 +9105,1572 @@ static void wrapped_GetDeviceImageMemoryRequirements(void* device, const void* p
         uint32_t orig = *bits;
         if (g_added_type_index >= 0)
             *bits |= (1u << g_added_type_index);
-        LOG("GetDevImgMemReqs: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
+        LOGD(ICD_LC_MEM, "GetDevImgMemReqs: bits=0x%x -> 0x%x (added_idx=%d)\n", orig, *bits, g_added_type_index);
+    }
+}
+
+/* ==== BCn Decode ====
+ *
+ * Mali has no BC support, so BC images are created as RGBA8 (see
+ * trace_CreateImage) and uploads into them are decoded on the CPU at record
+ * time: the blocks are read straight out of the app's staging buffer
+ * (lookup_ubo_ptr), decoded into a HOST_VISIBLE staging chunk owned by the
+ * command buffer, and the copy is recorded from that chunk with RGBA regions.
+ * Reading at record time relies on the staging buffer being filled from the
+ * host before the copy is recorded, which is how DXVK uploads textures; data
+ * a GPU command writes into it (even earlier in the same command buffer) is
+ * not seen, nor are host writes made between recording and submission.
+ *
+ * Chunks go back to the pool when their command buffer is begun again,
+ * reset or freed, directly or through vkResetCommandPool and
+ * vkDestroyCommandPool — Vulkan guarantees it is no longer pending then, so
+ * no fences are needed. Big regions (full mip chains) are split by block rows across a
+ * small worker pool; the recording thread decodes alongside it.
+ *
+ * BC1-5 and BC7 are decoded. BC6H has no RGBA8 representation and keeps the
+ * magenta clear. With ICD_BC_TARGET=etc2 most images are ETC2/EAC instead
+ * and the decoded blocks are re-encoded, see "ETC2 / EAC transcode".
+ * ICD_BC_DECODE=0 restores the clears everywhere;
+ * ICD_BC_DECODE_THREADS=N sizes the pool (default: cores - 1, max 4).
+ */
+
+#define BC_STAGE_CHUNK     (4ULL * 1024 * 1024)
+#define BC_STAGE_KEEP      16   /* idle 4 MiB chunks kept for reuse */
+#define BC_POOL_MIN_ROWS   64   /* smaller jobs decode on the caller only */
+#define BC_ROWS_PER_CLAIM  8
+#define BC_POOL_MAX        4
+
+static inline uint32_t bc_rgba(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+/* BC1 color block, also the color half of BC2/BC3. BC2/BC3 always use the
+ * 4-color mode; in 3-color mode index 3 is transparent only for BC1 RGBA. */
+static void bc_decode_color(const uint8_t* b, uint32_t* px, int four_color, int punch_alpha) {
+    uint32_t c0 = b[0] | (b[1] << 8);
+    uint32_t c1 = b[2] | (b[3] << 8);
+    uint32_t r0 = (c0 >> 11) & 31, g0 = (c0 >> 5) & 63, b0 = c0 & 31;
+    uint32_t r1 = (c1 >> 11) & 31, g1 = (c1 >> 5) & 63, b1 = c1 & 31;
+    r0 = (r0 << 3) | (r0 >> 2); g0 = (g0 << 2) | (g0 >> 4); b0 = (b0 << 3) | (b0 >> 2);
+    r1 = (r1 << 3) | (r1 >> 2); g1 = (g1 << 2) | (g1 >> 4); b1 = (b1 << 3) | (b1 >> 2);
+
+    uint32_t pal[4];
+    pal[0] = bc_rgba(r0, g0, b0, 255);
+    pal[1] = bc_rgba(r1, g1, b1, 255);
+    if (four_color || c0 > c1) {
+        pal[2] = bc_rgba((2 * r0 + r1 + 1) / 3, (2 * g0 + g1 + 1) / 3, (2 * b0 + b1 + 1) / 3, 255);
+        pal[3] = bc_rgba((r0 + 2 * r1 + 1) / 3, (g0 + 2 * g1 + 1) / 3, (b0 + 2 * b1 + 1) / 3, 255);
+    } else {
+        pal[2] = bc_rgba((r0 + r1 + 1) / 2, (g0 + g1 + 1) / 2, (b0 + b1 + 1) / 2, 255);
+        pal[3] = punch_alpha ? 0 : bc_rgba(0, 0, 0, 255);
+    }
+
+    uint32_t idx = b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24);
+    for (int i = 0; i < 16; i++)
+        px[i] = pal[(idx >> (2 * i)) & 3];
+}
+
+/* BC4 channel block (BC3 alpha, BC4, each half of BC5). Signed blocks
+ * produce two's complement bytes for the R8G8B8A8_SNORM substitute. */
+static void bc_decode_channel(const uint8_t* b, uint8_t* out, int is_signed) {
+    int e0 = is_signed ? (int8_t)b[0] : b[0];
+    int e1 = is_signed ? (int8_t)b[1] : b[1];
+    if (is_signed) {
+        if (e0 < -127) e0 = -127;
+        if (e1 < -127) e1 = -127;
+    }
+
+    int pal[8];
+    pal[0] = e0;
+    pal[1] = e1;
+    if (e0 > e1) {
+        for (int i = 1; i < 7; i++)
+            pal[i + 1] = ((7 - i) * e0 + i * e1) / 7;
+    } else {
+        for (int i = 1; i < 5; i++)
+            pal[i + 1] = ((5 - i) * e0 + i * e1) / 5;
+        pal[6] = is_signed ? -127 : 0;
+        pal[7] = is_signed ? 127 : 255;
+    }
+
+    uint64_t idx = 0;
+    for (int i = 0; i < 6; i++)
+        idx |= (uint64_t)b[2 + i] << (8 * i);
+    for (int i = 0; i < 16; i++)
+        out[i] = (uint8_t)pal[(idx >> (3 * i)) & 7];
+}
+
+/* ---- BC7 ---- */
+
+typedef struct {
+    uint8_t subsets, part_bits, rot_bits, isel_bits;
+    uint8_t color_bits, alpha_bits, ep_pbits, shared_pbits;
+    uint8_t idx_bits, idx2_bits;
+} Bc7Mode;
+
+static const Bc7Mode g_bc7_modes[8] = {
+    { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+    { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+    { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+    { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+    { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+    { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+    { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+    { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+/* 2-subset partitions: bit i = subset of pixel i */
+static const uint16_t g_bc7_part2[64] = {
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+    0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+    0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+    0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+    0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+};
+
+/* 3-subset partitions: bits 2i..2i+1 = subset of pixel i */
+static const uint32_t g_bc7_part3[64] = {
+    0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+    0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+    0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+    0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+    0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+    0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+    0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+    0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+};
+
+/* Anchor (fix-up) pixel of subset 1 for 2 subsets, subsets 1 and 2 for 3 */
+static const uint8_t g_bc7_anchor2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+static const uint8_t g_bc7_anchor3a[64] = {
+     3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+     3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+     8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+     3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+};
+static const uint8_t g_bc7_anchor3b[64] = {
+    15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+    15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+    15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+    15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+};
+
+static const uint8_t g_bc7_w2[4] = { 0, 21, 43, 64 };
+static const uint8_t g_bc7_w3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t g_bc7_w4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static inline uint32_t bc7_bits(const uint64_t q[2], uint32_t* pos, uint32_t n) {
+    uint32_t p = *pos;
+    *pos = p + n;
+    if (!n) return 0;
+    uint64_t v;
+    if (p >= 64) v = q[1] >> (p - 64);
+    else v = (q[0] >> p) | (p ? q[1] << (64 - p) : 0);
+    return (uint32_t)(v & ((1u << n) - 1));
+}
+
+static inline uint32_t bc7_lerp(uint32_t e0, uint32_t e1, uint32_t index, uint32_t bits) {
+    uint32_t w = bits == 2 ? g_bc7_w2[index] : bits == 3 ? g_bc7_w3[index] : g_bc7_w4[index];
+    return ((64 - w) * e0 + w * e1 + 32) >> 6;
+}
+
+static void bc7_decode(const uint8_t* b, uint32_t* px) {
+    uint64_t q[2];
+    memcpy(q, b, 16);
+
+    uint32_t mode = 0;
+    while (mode < 8 && !(b[0] & (1u << mode))) mode++;
+    if (mode == 8) {  /* reserved mode: transparent black */
+        memset(px, 0, 16 * sizeof(uint32_t));
+        return;
+    }
+    const Bc7Mode* m = &g_bc7_modes[mode];
+    uint32_t pos = mode + 1;
+    uint32_t part = bc7_bits(q, &pos, m->part_bits);
+    uint32_t rot = bc7_bits(q, &pos, m->rot_bits);
+    uint32_t isel = bc7_bits(q, &pos, m->isel_bits);
+
+    /* Endpoints: all R, then all G, then B, then A; then p-bits */
+    uint32_t ep[6][4];
+    uint32_t ne = m->subsets * 2u;
+    for (uint32_t c = 0; c < 3; c++)
+        for (uint32_t e = 0; e < ne; e++)
+            ep[e][c] = bc7_bits(q, &pos, m->color_bits);
+    for (uint32_t e = 0; e < ne; e++)
+        ep[e][3] = m->alpha_bits ? bc7_bits(q, &pos, m->alpha_bits) : 255;
+
+    uint32_t cbits = m->color_bits, abits = m->alpha_bits;
+    if (m->ep_pbits || m->shared_pbits) {
+        uint32_t pb[6];
+        if (m->ep_pbits) {
+            for (uint32_t e = 0; e < ne; e++) pb[e] = bc7_bits(q, &pos, 1);
+        } else {
+            for (uint32_t s = 0; s < m->subsets; s++) pb[2 * s] = pb[2 * s + 1] = bc7_bits(q, &pos, 1);
+        }
+        for (uint32_t e = 0; e < ne; e++) {
+            for (uint32_t c = 0; c < 3; c++) ep[e][c] = (ep[e][c] << 1) | pb[e];
+            if (abits) ep[e][3] = (ep[e][3] << 1) | pb[e];
+        }
+        cbits++;
+        if (abits) abits++;
     }
+    for (uint32_t e = 0; e < ne; e++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            uint32_t v = ep[e][c] << (8 - cbits);
+            ep[e][c] = v | (v >> cbits);
+        }
+        if (abits) {
+            uint32_t v = ep[e][3] << (8 - abits);
+            ep[e][3] = v | (v >> abits);
+        }
+    }
+
+    /* Indices: each subset's anchor pixel drops its top bit */
+    uint32_t anchor1 = 0, anchor2 = 0;
+    if (m->subsets == 2) anchor1 = g_bc7_anchor2[part];
+    if (m->subsets == 3) { anchor1 = g_bc7_anchor3a[part]; anchor2 = g_bc7_anchor3b[part]; }
+    uint8_t idx[16], idx2[16];
+    for (uint32_t i = 0; i < 16; i++) {
+        int anchor = i == 0 || (m->subsets > 1 && i == anchor1) || (m->subsets > 2 && i == anchor2);
+        idx[i] = (uint8_t)bc7_bits(q, &pos, m->idx_bits - anchor);
+    }
+    if (m->idx2_bits)
+        for (uint32_t i = 0; i < 16; i++)
+            idx2[i] = (uint8_t)bc7_bits(q, &pos, m->idx2_bits - (i == 0));
+
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t s = 0;
+        if (m->subsets == 2) s = (g_bc7_part2[part] >> i) & 1;
+        if (m->subsets == 3) s = (g_bc7_part3[part] >> (2 * i)) & 3;
+        const uint32_t* e0 = ep[2 * s];
+        const uint32_t* e1 = ep[2 * s + 1];
+
+        uint32_t ci = idx[i], cb = m->idx_bits, ai = idx[i], ab = m->idx_bits;
+        if (m->idx2_bits) {
+            if (isel) { ci = idx2[i]; cb = m->idx2_bits; }
+            else { ai = idx2[i]; ab = m->idx2_bits; }
+        }
+        uint32_t c[4];
+        c[0] = bc7_lerp(e0[0], e1[0], ci, cb);
+        c[1] = bc7_lerp(e0[1], e1[1], ci, cb);
+        c[2] = bc7_lerp(e0[2], e1[2], ci, cb);
+        c[3] = m->alpha_bits ? bc7_lerp(e0[3], e1[3], ai, ab) : 255;
+        if (rot) {
+            uint32_t t = c[3];
+            c[3] = c[rot - 1];
+            c[rot - 1] = t;
+        }
+        px[i] = bc_rgba(c[0], c[1], c[2], c[3]);
+    }
+}
+
+/* ---- Block dispatch ---- */
+
+static int bc_decode_supported(uint32_t bc_fmt) {
+    return is_bc_format(bc_fmt) && bc_fmt != 143 && bc_fmt != 144;  /* not BC6H */
+}
+
+static uint32_t bc_block_bytes(uint32_t bc_fmt) {
+    return (bc_fmt <= 134 || bc_fmt == 139 || bc_fmt == 140) ? 8 : 16;
+}
+
+/* Decode one 4x4 block into 16 RGBA8 pixels (row-major) */
+static void bc_decode_block(uint32_t bc_fmt, const uint8_t* b, uint32_t* px) {
+    uint8_t ch[16], ch2[16];
+    switch (bc_fmt) {
+    case 131: case 132:     /* BC1 RGB */
+        bc_decode_color(b, px, 0, 0);
+        break;
+    case 133: case 134:     /* BC1 RGBA */
+        bc_decode_color(b, px, 0, 1);
+        break;
+    case 135: case 136:     /* BC2: explicit 4-bit alpha */
+        bc_decode_color(b + 8, px, 1, 0);
+        for (int i = 0; i < 16; i++)
+            px[i] = (px[i] & 0x00FFFFFF) | ((uint32_t)((b[i >> 1] >> (4 * (i & 1))) & 15) * 17 << 24);
+        break;
+    case 137: case 138:     /* BC3 */
+        bc_decode_color(b + 8, px, 1, 0);
+        bc_decode_channel(b, ch, 0);
+        for (int i = 0; i < 16; i++)
+            px[i] = (px[i] & 0x00FFFFFF) | ((uint32_t)ch[i] << 24);
+        break;
+    case 139: case 140:     /* BC4 → (r, 0, 0, 1) */
+        bc_decode_channel(b, ch, bc_fmt == 140);
+        for (int i = 0; i < 16; i++)
+            px[i] = bc_rgba(ch[i], 0, 0, bc_fmt == 140 ? 127 : 255);
+        break;
+    case 141: case 142:     /* BC5 → (r, g, 0, 1) */
+        bc_decode_channel(b, ch, bc_fmt == 142);
+        bc_decode_channel(b + 8, ch2, bc_fmt == 142);
+        for (int i = 0; i < 16; i++)
+            px[i] = bc_rgba(ch[i], ch2[i], 0, bc_fmt == 142 ? 127 : 255);
+        break;
+    case 145: case 146:     /* BC7 */
+        bc7_decode(b, px);
+        break;
+    default:
+        memset(px, 0, 16 * sizeof(uint32_t));
+        break;
+    }
+}
+
+/* ---- ETC2 / EAC transcode (ICD_BC_TARGET=etc2) ----
+ *
+ * Optional re-encode of the decoded 4x4 blocks into Mali-native ETC2/EAC
+ * formats of the same block size, so substituted images keep the BC memory
+ * footprint instead of growing 4-8x as RGBA8 (see bc_to_rgba_format):
+ *   BC1 → ETC2 RGB8 / RGB8A1, BC2/BC3/BC7 → ETC2 RGBA8 (EAC alpha),
+ *   BC4 → EAC R11, BC5 → EAC R11G11.
+ * The encoders are the quick kind: ETC1-style individual/differential
+ * blocks with both flips and all eight tables tried (no T/H/planar), and an
+ * EAC search over the 16 tables with the multiplier fitted to the range.
+ */
+
+static const int g_etc1_mods[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+static const int8_t g_eac_mods[16][8] = {
+    { -3, -6, -9, -15, 2, 5, 8, 14 },  { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 },  { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 },  { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 },  { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 },   { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 },   { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 },   { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 },    { -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+static inline int etc_clamp255(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* Pixels of sub-block s (0/1) for a flip, as row-major indices */
+static void etc_subblock(int flip, int s, int idx[8]) {
+    for (int i = 0; i < 8; i++) {
+        int x = flip ? (i & 3) : (s * 2 + (i & 1));
+        int y = flip ? (s * 2 + (i >> 2)) : (i >> 1);
+        idx[i] = y * 4 + x;
+    }
+}
+
+/* Best table for one sub-block around base color c. Fills sel[] with the
+ * pixel index values (ETC order: 0 +a, 1 +b, 2 -a, 3 -b; punch-through
+ * non-opaque: 0 base, 1 +b, 2 transparent, 3 -b) and returns the error. */
+static uint32_t etc_fit_subblock(const uint32_t* px, const int idx[8], const int c[3],
+                                 int punch, int* table, int sel[8]) {
+    uint32_t best = ~0u;
+    for (int t = 0; t < 8; t++) {
+        int a = punch ? 0 : g_etc1_mods[t][0], b = g_etc1_mods[t][1];
+        int mods[4] = { a, b, -a, -b };
+        uint32_t err = 0;
+        int s[8];
+        for (int i = 0; i < 8 && err < best; i++) {
+            uint32_t p = px[idx[i]];
+            if (punch && (p >> 24) < 128) {
+                s[i] = 2;
+                continue;
+            }
+            uint32_t pe = ~0u;
+            for (int m = 0; m < 4; m++) {
+                if (punch && m == 2) continue;
+                int dr = etc_clamp255(c[0] + mods[m]) - (int)(p & 255);
+                int dg = etc_clamp255(c[1] + mods[m]) - (int)((p >> 8) & 255);
+                int db = etc_clamp255(c[2] + mods[m]) - (int)((p >> 16) & 255);
+                uint32_t e = (uint32_t)(dr * dr + dg * dg + db * db);
+                if (e < pe) { pe = e; s[i] = m; }
+            }
+            err += pe;
+        }
+        if (err < best) {
+            best = err;
+            *table = t;
+            memcpy(sel, s, sizeof(s));
+        }
+    }
+    return best;
+}
+
+/* Encode 16 RGBA pixels as an ETC2 RGB8 block, or RGB8A1 when punch is set
+ * (alpha < 128 becomes transparent). Differential mode is always kept in
+ * range, so decoders never see the T/H/planar modes. */
+static void etc_encode_rgb(const uint32_t* px, int punch, uint8_t* out) {
+    int transparent = 0;
+    if (punch)
+        for (int i = 0; i < 16; i++)
+            if ((px[i] >> 24) < 128) transparent = 1;
+
+    uint32_t best = ~0u;
+    uint8_t blk[8];
+    memset(out, 0, 8);
+    for (int flip = 0; flip < 2; flip++) {
+        int idx[2][8];
+        int avg[2][3];
+        for (int s = 0; s < 2; s++) {
+            etc_subblock(flip, s, idx[s]);
+            int sum[3] = { 0, 0, 0 }, n = 0;
+            for (int i = 0; i < 8; i++) {
+                uint32_t p = px[idx[s][i]];
+                if (transparent && (p >> 24) < 128) continue;
+                sum[0] += p & 255; sum[1] += (p >> 8) & 255; sum[2] += (p >> 16) & 255;
+                n++;
+            }
+            for (int c = 0; c < 3; c++) avg[s][c] = n ? (sum[c] + n / 2) / n : 0;
+        }
+
+        /* mode 0: differential (5-bit + 3-bit delta), mode 1: individual 4-bit */
+        for (int mode = 0; mode < (punch ? 1 : 2); mode++) {
+            int q[2][3], col[2][3];
+            for (int c = 0; c < 3; c++) {
+                if (mode == 0) {
+                    int q1 = (avg[0][c] * 31 + 127) / 255;
+                    int q2 = (avg[1][c] * 31 + 127) / 255;
+                    int d = q2 - q1;
+                    if (d < -4) d = -4;
+                    if (d > 3) d = 3;
+                    q[0][c] = q1;
+                    q[1][c] = d;                    /* stored as the delta */
+                    col[0][c] = (q1 << 3) | (q1 >> 2);
+                    col[1][c] = ((q1 + d) << 3) | ((q1 + d) >> 2);
+                } else {
+                    for (int s = 0; s < 2; s++) {
+                        q[s][c] = (avg[s][c] * 15 + 127) / 255;
+                        col[s][c] = q[s][c] * 17;
+                    }
+                }
+            }
+            int tab[2], sel[2][8];
+            uint32_t err = etc_fit_subblock(px, idx[0], col[0], transparent, &tab[0], sel[0]);
+            if (err >= best) continue;
+            err += etc_fit_subblock(px, idx[1], col[1], transparent, &tab[1], sel[1]);
+            if (err >= best) continue;
+            best = err;
+
+            for (int c = 0; c < 3; c++)
+                blk[c] = mode == 0 ? (uint8_t)((q[0][c] << 3) | (q[1][c] & 7))
+                                   : (uint8_t)((q[0][c] << 4) | q[1][c]);
+            /* bit 1: diff (RGB8) / opaque (RGB8A1, always differential) */
+            int bit1 = punch ? !transparent : (mode == 0);
+            blk[3] = (uint8_t)((tab[0] << 5) | (tab[1] << 2) | (bit1 << 1) | flip);
+            uint32_t msb = 0, lsb = 0;
+            for (int s = 0; s < 2; s++)
+                for (int i = 0; i < 8; i++) {
+                    int p = idx[s][i];
+                    int bit = (p & 3) * 4 + (p >> 2);       /* column-major */
+                    msb |= (uint32_t)(sel[s][i] >> 1) << bit;
+                    lsb |= (uint32_t)(sel[s][i] & 1) << bit;
+                }
+            blk[4] = (uint8_t)(msb >> 8); blk[5] = (uint8_t)msb;
+            blk[6] = (uint8_t)(lsb >> 8); blk[7] = (uint8_t)lsb;
+            memcpy(out, blk, 8);
+        }
+    }
+}
+
+/* EAC block for one channel. kind 0: 8-bit alpha, 1: R11 unsigned,
+ * 2: R11 signed (v holds two's complement bytes, as from bc_decode_channel) */
+static void eac_encode(const uint8_t* v, int kind, uint8_t* out) {
+    int target[16], lo = 1 << 30, hi = -(1 << 30);
+    for (int i = 0; i < 16; i++) {
+        int t = v[i];
+        if (kind == 1) t = (t * 2047 + 127) / 255;
+        if (kind == 2) {
+            t = (int8_t)v[i];
+            if (t < -127) t = -127;
+            t = t * 1023 / 127;
+        }
+        target[i] = t;
+        if (t < lo) lo = t;
+        if (t > hi) hi = t;
+    }
+    int scale = kind ? 8 : 1;
+    int vmin = kind == 2 ? -1023 : 0, vmax = kind == 0 ? 255 : (kind == 1 ? 2047 : 1023);
+    int center = (lo + hi + 1) >> 1;
+    int base = center;                  /* alpha: base + mod * m */
+    if (kind == 1) base = center / 8;   /* R11: base * 8 + 4 + mod * m * 8 */
+    if (kind == 2) base = (center >= 0 ? center + 4 : center - 4) / 8;  /* signed: base * 8 + ... */
+    if (base > (kind == 2 ? 127 : 255)) base = kind == 2 ? 127 : 255;
+    if (base < (kind == 2 ? -127 : 0)) base = kind == 2 ? -127 : 0;
+
+    uint32_t best = ~0u;
+    uint64_t best_bits = 0;
+    int best_t = 0, best_m = 1;
+    for (int t = 0; t < 16 && best; t++) {
+        const int8_t* mods = g_eac_mods[t];
+        int span = mods[7] - mods[3];
+        int m = (hi - lo + span * scale - 1) / (span * scale);
+        if (m < 1) m = 1;
+        if (m > 15) m = 15;
+        uint32_t err = 0;
+        uint64_t bits = 0;
+        for (int i = 0; i < 16 && err < best; i++) {
+            uint32_t pe = ~0u;
+            int sel = 0;
+            for (int k = 0; k < 8; k++) {
+                int val = kind == 0 ? base + mods[k] * m
+                        : (kind == 1 ? base * 8 + 4 : base * 8) + mods[k] * m * 8;
+                if (val < vmin) val = vmin;
+                if (val > vmax) val = vmax;
+                int d = val - target[i];
+                uint32_t e = (uint32_t)(d * d);
+                if (e < pe) { pe = e; sel = k; }
+            }
+            err += pe;
+            int pos = (i & 3) * 4 + (i >> 2);   /* column-major, first pixel in the top bits */
+            bits |= (uint64_t)sel << (45 - 3 * pos);
+        }
+        if (err < best) {
+            best = err;
+            best_bits = bits;
+            best_t = t;
+            best_m = m;
+        }
+    }
+    out[0] = (uint8_t)base;
+    out[1] = (uint8_t)((best_m << 4) | best_t);
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (uint8_t)(best_bits >> (40 - 8 * i));
+}
+
+static uint32_t etc2_block_bytes(uint32_t fmt) {
+    return (fmt <= 150 || fmt == 153 || fmt == 154) ? 8 : 16;
+}
+
+/* Re-encode one decoded block (bc_decode_block output) as etc_fmt */
+static void etc_encode_block(uint32_t etc_fmt, const uint32_t* px, uint8_t* out) {
+    uint8_t ch[16];
+    switch (etc_fmt) {
+    case 147: case 148:
+        etc_encode_rgb(px, 0, out);
+        break;
+    case 149: case 150:
+        etc_encode_rgb(px, 1, out);
+        break;
+    case 151: case 152:
+        for (int i = 0; i < 16; i++) ch[i] = (uint8_t)(px[i] >> 24);
+        eac_encode(ch, 0, out);
+        etc_encode_rgb(px, 0, out + 8);
+        break;
+    default:    /* EAC R11 / R11G11 */
+        for (int i = 0; i < 16; i++) ch[i] = (uint8_t)px[i];
+        eac_encode(ch, (etc_fmt & 1) ? 1 : 2, out);
+        if (etc_fmt >= 155) {
+            for (int i = 0; i < 16; i++) ch[i] = (uint8_t)(px[i] >> 8);
+            eac_encode(ch, (etc_fmt & 1) ? 1 : 2, out + 8);
+        }
+        break;
+    }
+}
+
+/* One region's worth of slices (depth slices x array layers), split into
+ * block rows that the caller and the pool decode BC_ROWS_PER_CLAIM at a time */
+typedef struct {
+    const uint8_t* src;
+    uint8_t* dst;
+    uint64_t src_row_pitch;     /* one row of blocks */
+    uint64_t src_slice_pitch;
+    uint64_t dst_slice_pitch;
+    uint32_t dst_row_pitch;
+    uint32_t format;
+    uint32_t block_bytes;
+    uint32_t out_format;        /* ETC2/EAC re-encode target, 0 = RGBA8 texels */
+    uint32_t width, height;     /* texels */
+    uint32_t block_rows;        /* per slice */
+    uint32_t total_rows;        /* over all slices */
+} BcDecodeJob;
+
+static void bc_decode_row(const BcDecodeJob* j, uint32_t row) {
+    uint32_t slice = row / j->block_rows, by = row % j->block_rows;
+    const uint8_t* s = j->src + slice * j->src_slice_pitch + by * j->src_row_pitch;
+    uint32_t px[16];
+    if (j->out_format) {        /* dst_row_pitch is one row of output blocks */
+        uint8_t* d = j->dst + slice * j->dst_slice_pitch + (uint64_t)by * j->dst_row_pitch;
+        uint32_t out_bytes = etc2_block_bytes(j->out_format);
+        for (uint32_t x = 0; x < j->width; x += 4, s += j->block_bytes, d += out_bytes) {
+            bc_decode_block(j->format, s, px);
+            etc_encode_block(j->out_format, px, d);
+        }
+        return;
+    }
+    uint8_t* d = j->dst + slice * j->dst_slice_pitch + (uint64_t)by * 4 * j->dst_row_pitch;
+    uint32_t rows = j->height - by * 4;
+    if (rows > 4) rows = 4;
+    for (uint32_t x = 0; x < j->width; x += 4, s += j->block_bytes) {
+        bc_decode_block(j->format, s, px);
+        uint32_t cols = j->width - x;
+        if (cols > 4) cols = 4;
+        for (uint32_t y = 0; y < rows; y++)
+            memcpy(d + y * j->dst_row_pitch + x * 4, px + y * 4, cols * 4);
+    }
+}
+
+/* Pool item: BC_ROWS_PER_CLAIM block rows */
+static void bc_decode_rows(void* ctx, uint32_t item) {
+    const BcDecodeJob* j = (const BcDecodeJob*)ctx;
+    uint32_t r = item * BC_ROWS_PER_CLAIM;
+    uint32_t end = r + BC_ROWS_PER_CLAIM;
+    if (end > j->total_rows) end = j->total_rows;
+    for (; r < end; r++) bc_decode_row(j, r);
+}
+
+/* ---- Decode worker pool ---- */
+
+static pthread_once_t g_bc_init_once = PTHREAD_ONCE_INIT;
+static int g_bc_decode = 1;
+static int g_bc_gpu = 0;       /* ICD_BC_DECODE=gpu, see "GPU transcode" */
+static WorkerPool g_bc_pool = WORKER_POOL_INIT("BC decode", "ICD_BC_DECODE_THREADS", BC_POOL_MAX);
+
+static void bc_decode_init(void) {
+    const char* env = getenv("ICD_BC_DECODE");
+    if (env && *env == '0') {
+        g_bc_decode = 0;
+        LOG("BC decode disabled (ICD_BC_DECODE=0), BC uploads clear to magenta\n");
+        return;
+    }
+    g_bc_gpu = env && strcmp(env, "gpu") == 0;
+    worker_pool_start(&g_bc_pool);
+    LOG("BC decode enabled%s\n", g_bc_gpu ? ", BC1-BC5 on the GPU" : "");
+}
+
+static int bc_decode_enabled(void) {
+    pthread_once(&g_bc_init_once, bc_decode_init);
+    return g_bc_decode;
+}
+
+static void bc_decode(BcDecodeJob* j) {
+    uint32_t items = (j->total_rows + BC_ROWS_PER_CLAIM - 1) / BC_ROWS_PER_CLAIM;
+    if (j->total_rows < BC_POOL_MIN_ROWS) {
+        for (uint32_t i = 0; i < items; i++) bc_decode_rows(j, i);
+        return;
+    }
+    worker_pool_for(&g_bc_pool, items, bc_decode_rows, j);
+}
+
+/* ---- Staging chunks ---- */
+
+typedef struct BcStageChunk {
+    struct BcStageChunk* next;
+    uint64_t buffer;
+    uint64_t memory;
+    uint8_t* ptr;       /* persistently mapped */
+    uint64_t size;
+    uint64_t used;
+} BcStageChunk;
+
+static pthread_mutex_t g_bc_stage_lock = PTHREAD_MUTEX_INITIALIZER;
+static BcStageChunk* g_bc_stage_free = NULL;
+static uint32_t g_bc_stage_free_count = 0;
+static uint32_t g_bc_stage_live = 0;
+
+/* real command buffer → its chunks, newest (the one being filled) first */
+static HandleMap g_bc_cb_stage = HMAP_INIT(BcStageChunk*);
+/* real command buffer → its command pool, for vkResetCommandPool and
+ * vkDestroyCommandPool */
+static HandleMap g_bc_cb_pool = HMAP_INIT(uint64_t);
+
+static uint64_t g_bc_decode_regions = 0;
+static uint64_t g_bc_decode_bytes = 0;
+
+static void bc_stage_destroy(BcStageChunk* c) {
+    void* dev = shared_real_device;
+    if (dev && c->buffer && real_destroy_buffer) real_destroy_buffer(dev, c->buffer, NULL);
+    if (dev && c->memory && real_free_memory) real_free_memory(dev, c->memory, NULL);
+    free(c);
+    __atomic_sub_fetch(&g_bc_stage_live, 1, __ATOMIC_RELAXED);
+}
+
+static BcStageChunk* bc_stage_create(uint64_t size) {
+    void* dev = shared_real_device;
+    if (!dev) return NULL;
+    if (!real_get_buf_mem_reqs)
+        real_get_buf_mem_reqs = (PFN_vkGetBufMemReqs)resolve_dev_fn(dev, "vkGetBufferMemoryRequirements");
+    if (!real_create_buffer || !real_alloc_memory || !real_bind_buf_mem ||
+        !real_map_memory || !real_get_buf_mem_reqs)
+        return NULL;
+
+    BcStageChunk* c = (BcStageChunk*)calloc(1, sizeof(BcStageChunk));
+    if (!c) return NULL;
+    __atomic_add_fetch(&g_bc_stage_live, 1, __ATOMIC_RELAXED);
+    c->size = size;
+
+    /* VkBufferCreateInfo: sType=12, size @24, usage @32 = TRANSFER_SRC | STORAGE_BUFFER
+     * (the GPU transcode writes into it) */
+    uint8_t bci[56];
+    memset(bci, 0, sizeof(bci));
+    *(uint32_t*)bci = 12;
+    *(uint64_t*)(bci + 24) = size;
+    *(uint32_t*)(bci + 32) = 0x1 | 0x20;
+    VkResult r = real_create_buffer(dev, bci, NULL, &c->buffer);
+    if (r != 0) goto fail;
+
+    uint8_t reqs[24];  /* VkMemoryRequirements: size(8)+align(8)+memTypeBits(4) */
+    real_get_buf_mem_reqs(dev, c->buffer, reqs);
+    uint64_t mem_size = *(uint64_t*)reqs;
+    uint32_t bits = *(uint32_t*)(reqs + 16);
+    /* Prefer the staging types (HOST_VISIBLE), else whatever is allowed */
+    uint32_t pick = (bits & 0x3) ? (bits & 0x3) : bits;
+    uint32_t type = 0;
+    while (type < 31 && !(pick & (1u << type))) type++;
+
+    uint8_t mai[32];
+    memset(mai, 0, sizeof(mai));
+    *(uint32_t*)mai = 5;  /* VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO */
+    *(uint64_t*)(mai + 16) = mem_size;
+    *(uint32_t*)(mai + 24) = type;
+    r = real_alloc_memory(dev, mai, NULL, &c->memory);
+    if (r != 0) goto fail;
+    r = real_bind_buf_mem(dev, c->buffer, c->memory, 0);
+    if (r != 0) goto fail;
+    void* ptr = NULL;
+    r = real_map_memory(dev, c->memory, 0, (uint64_t)-1, 0, &ptr);
+    if (r != 0 || !ptr) goto fail;
+    c->ptr = (uint8_t*)ptr;
+
+    LOGD(ICD_LC_MEM, "BC staging chunk: %llu KB type=%u buf=0x%llx (%u live)\n",
+        (unsigned long long)(size / 1024), type, (unsigned long long)c->buffer,
+        __atomic_load_n(&g_bc_stage_live, __ATOMIC_RELAXED));
+    return c;
+
+fail:
+    LOGW(ICD_LC_MEM, "BC staging chunk of %llu KB failed: %d\n",
+        (unsigned long long)(size / 1024), r);
+    bc_stage_destroy(c);
+    return NULL;
+}
+
+/* Reserve size bytes (16-byte aligned) for a command buffer's decoded data */
+static BcStageChunk* bc_stage_alloc(void* real_cb, uint64_t size, uint64_t* offset) {
+    uint64_t key = (uint64_t)(uintptr_t)real_cb;
+    BcStageChunk* head = NULL;
+    hmap_get(&g_bc_cb_stage, key, &head);
+    if (head) {
+        uint64_t off = (head->used + 15) & ~15ULL;
+        if (off + size <= head->size) {
+            head->used = off + size;
+            *offset = off;
+            return head;
+        }
+    }
+
+    BcStageChunk* c = NULL;
+    if (size <= BC_STAGE_CHUNK) {
+        pthread_mutex_lock(&g_bc_stage_lock);
+        c = g_bc_stage_free;
+        if (c) {
+            g_bc_stage_free = c->next;
+            g_bc_stage_free_count--;
+        }
+        pthread_mutex_unlock(&g_bc_stage_lock);
+    }
+    if (!c) {
+        uint64_t chunk = (size + BC_STAGE_CHUNK - 1) & ~(BC_STAGE_CHUNK - 1);
+        c = bc_stage_create(chunk);
+        if (!c) return NULL;
+    }
+    c->used = size;
+    c->next = head;
+    if (!hmap_put(&g_bc_cb_stage, key, &c)) {
+        c->next = NULL;
+        bc_stage_destroy(c);
+        return NULL;
+    }
+    *offset = 0;
+    return c;
+}
+
+static void bc_stage_recycle(BcStageChunk* c) {
+    while (c) {
+        BcStageChunk* next = c->next;
+        if (c->size == BC_STAGE_CHUNK) {
+            pthread_mutex_lock(&g_bc_stage_lock);
+            if (g_bc_stage_free_count < BC_STAGE_KEEP) {
+                c->next = g_bc_stage_free;
+                g_bc_stage_free = c;
+                g_bc_stage_free_count++;
+                c = NULL;
+            }
+            pthread_mutex_unlock(&g_bc_stage_lock);
+        }
+        if (c) bc_stage_destroy(c);
+        c = next;
+    }
+}
+
+/* ---- GPU transcode (ICD_BC_DECODE=gpu) ----
+ *
+ * BC1-BC5 UNORM/SRGB uploads can instead be decoded by a compute shader
+ * that reads the blocks straight from the source buffer (every buffer has
+ * STORAGE_BUFFER usage, see trace_CreateBuffer) and writes packed RGBA8
+ * into the staging chunk; the copy into the image stays in the app's
+ * command buffer as in the CPU path. One pipeline per BC family, selected
+ * by specialization constant 0.
+ *
+ * The dispatches can't be recorded into the app's command buffer: DXVK
+ * tracks its own compute bindings and would not rebind after ours. They go
+ * into an ICD-owned prologue command buffer (same queue family) that the
+ * submit wrappers insert right before the app's. The prologue starts with a
+ * transfer/host→compute barrier, so the shader sees blocks written by
+ * earlier command buffers, and ends with a compute→transfer barrier, which
+ * orders it before the copy. BC7, SNORM formats and secondary command
+ * buffers use the CPU decoder, and so does an upload whose source buffer a
+ * transfer earlier in the same command buffer wrote: the prologue would
+ * run before that write. The source is bound once for all regions when the
+ * range fits maxStorageBufferRange, otherwise once per region; a region
+ * that doesn't fit on its own goes to the CPU decoder.
+ */
+
+/* Compute shader, local size 8x8x1, one invocation per texel (z = slice).
+ * Source: shaders/bcn_decode.comp; gen_bcn_decode_spv.sh regenerates the
+ * header after a change. */
+#include "bcn_decode_spv.h"
+
+#define BC_GPU_FAMILIES   8     /* queue families with a prologue pool */
+#define BC_GPU_SETS       32    /* descriptor sets per prologue */
+#define BC_SRC_ALIGN      256   /* >= minStorageBufferOffsetAlignment */
+
+typedef struct {
+    uint32_t src_word, src_row_words, src_slice_words, dst_word;
+    uint32_t width, height, src_words;
+} BcGpuPush;
+
+/* An ICD-owned command buffer submitted before an app command buffer */
+typedef struct BcGpuCb {
+    struct BcGpuCb* next;       /* free list */
+    void* cb;                   /* real handle */
+    void* wrapped;              /* wrapper, so submit paths can unwrap it */
+    uint64_t desc_pool;
+    uint32_t family;
+    int open;                   /* still recording */
+} BcGpuCb;
+
+typedef VkResult (*PFN_vkResetCmdBuf)(void*, uint32_t);
+
+static int g_bcg_state = 0;             /* 0 = not set up, 1 = ready, -1 = unavailable */
+static pthread_mutex_t g_bcg_lock = PTHREAD_MUTEX_INITIALIZER;  /* pools + prologue recording */
+static uint64_t g_bcg_set_layout, g_bcg_pipe_layout, g_bcg_module;
+static uint64_t g_bcg_pipes[6];
+static uint64_t g_bcg_cmd_pools[BC_GPU_FAMILIES];
+static BcGpuCb* g_bcg_free = NULL;
+static uint32_t g_bcg_live = 0;         /* app command buffers with a prologue */
+static uint64_t g_bcg_dispatches = 0;
+
+/* command pool → queue family, primary command buffer → queue family */
+static HandleMap g_bc_pool_family = HMAP_INIT(uint32_t);
+static HandleMap g_bc_cb_family = HMAP_INIT(uint32_t);
+
+static PFN_vkCreateDescSetLayout g_bcg_create_set_layout;
+static PFN_vkCreatePipelineLayout g_bcg_create_pipe_layout;
+static PFN_vkCreateShaderModule g_bcg_create_module;
+static PFN_vkCreateComputePipelines g_bcg_create_pipes;
+static PFN_vkCreateDescPool g_bcg_create_desc_pool;
+static PFN_vkResetDescPool g_bcg_reset_desc_pool;
+static PFN_vkAllocDescSets g_bcg_alloc_sets;
+static PFN_vkUpdateDescriptorSets g_bcg_update_sets;
+static PFN_vkCreateCommandPool g_bcg_create_cmd_pool;
+static PFN_vkAllocCmdBufs g_bcg_alloc_cbs;
+static PFN_vkBeginCmdBuf g_bcg_begin;
+static PFN_vkEndCmdBuf g_bcg_end;
+static PFN_vkResetCmdBuf g_bcg_reset;
+static PFN_vkCmdBindPipeline g_bcg_bind_pipe;
+static PFN_vkCmdBindDescSets g_bcg_bind_sets;
+static PFN_vkCmdPushConsts g_bcg_push;
+static PFN_vkCmdDispatch g_bcg_dispatch;
+static PFN_vkCmdPipelineBarrierV1 g_bcg_barrier;
+static PFN_vkDestroyObject g_bcg_destroy_pipe, g_bcg_destroy_pipe_layout,
+                           g_bcg_destroy_set_layout, g_bcg_destroy_module,
+                           g_bcg_destroy_desc_pool, g_bcg_destroy_cmd_pool;
+
+static int bc_gpu_mode(uint32_t bc_fmt) {
+    switch (bc_fmt) {
+    case 131: case 132: return 0;
+    case 133: case 134: return 1;
+    case 135: case 136: return 2;
+    case 137: case 138: return 3;
+    case 139: return 4;
+    case 141: return 5;
+    default: return -1;
+    }
+}
+
+static void bc_gpu_track_pool(uint64_t pool, uint32_t family) {
+    if (bc_decode_enabled() && g_bc_gpu && pool)
+        hmap_put(&g_bc_pool_family, pool, &family);
+}
+
+/* Remember the queue family of primary command buffers; prologues must be
+ * allocated from a pool of the same family */
+static void bc_gpu_track_cbs(const void* pAllocInfo, void** pCmdBufs, uint32_t count) {
+    if (!g_bc_gpu || !pAllocInfo) return;
+    uint64_t pool = *(const uint64_t*)((const uint8_t*)pAllocInfo + 16);
+    uint32_t level = *(const uint32_t*)((const uint8_t*)pAllocInfo + 24);
+    uint32_t family;
+    if (level != 0 || !hmap_get(&g_bc_pool_family, pool, &family)) return;
+    for (uint32_t i = 0; i < count; i++)
+        hmap_put(&g_bc_cb_family, (uint64_t)(uintptr_t)pCmdBufs[i], &family);
+}
+
+static void bc_gpu_forget_cb(void* real_cb) {
+    if (g_bc_gpu) hmap_del(&g_bc_cb_family, (uint64_t)(uintptr_t)real_cb, NULL);
+}
+
+#define BCG_RESOLVE(var, type, name) \
+    if (!(var = (type)resolve_dev_fn(dev, name))) return -1
+
+static int bc_gpu_setup_locked(void* dev) {
+    BCG_RESOLVE(g_bcg_create_set_layout, PFN_vkCreateDescSetLayout, "vkCreateDescriptorSetLayout");
+    BCG_RESOLVE(g_bcg_create_pipe_layout, PFN_vkCreatePipelineLayout, "vkCreatePipelineLayout");
+    BCG_RESOLVE(g_bcg_create_module, PFN_vkCreateShaderModule, "vkCreateShaderModule");
+    BCG_RESOLVE(g_bcg_create_pipes, PFN_vkCreateComputePipelines, "vkCreateComputePipelines");
+    BCG_RESOLVE(g_bcg_create_desc_pool, PFN_vkCreateDescPool, "vkCreateDescriptorPool");
+    BCG_RESOLVE(g_bcg_reset_desc_pool, PFN_vkResetDescPool, "vkResetDescriptorPool");
+    BCG_RESOLVE(g_bcg_alloc_sets, PFN_vkAllocDescSets, "vkAllocateDescriptorSets");
+    BCG_RESOLVE(g_bcg_update_sets, PFN_vkUpdateDescriptorSets, "vkUpdateDescriptorSets");
+    BCG_RESOLVE(g_bcg_create_cmd_pool, PFN_vkCreateCommandPool, "vkCreateCommandPool");
+    BCG_RESOLVE(g_bcg_alloc_cbs, PFN_vkAllocCmdBufs, "vkAllocateCommandBuffers");
+    BCG_RESOLVE(g_bcg_begin, PFN_vkBeginCmdBuf, "vkBeginCommandBuffer");
+    BCG_RESOLVE(g_bcg_end, PFN_vkEndCmdBuf, "vkEndCommandBuffer");
+    BCG_RESOLVE(g_bcg_reset, PFN_vkResetCmdBuf, "vkResetCommandBuffer");
+    BCG_RESOLVE(g_bcg_bind_pipe, PFN_vkCmdBindPipeline, "vkCmdBindPipeline");
+    BCG_RESOLVE(g_bcg_bind_sets, PFN_vkCmdBindDescSets, "vkCmdBindDescriptorSets");
+    BCG_RESOLVE(g_bcg_push, PFN_vkCmdPushConsts, "vkCmdPushConstants");
+    BCG_RESOLVE(g_bcg_dispatch, PFN_vkCmdDispatch, "vkCmdDispatch");
+    BCG_RESOLVE(g_bcg_barrier, PFN_vkCmdPipelineBarrierV1, "vkCmdPipelineBarrier");
+    BCG_RESOLVE(g_bcg_destroy_pipe, PFN_vkDestroyObject, "vkDestroyPipeline");
+    BCG_RESOLVE(g_bcg_destroy_pipe_layout, PFN_vkDestroyObject, "vkDestroyPipelineLayout");
+    BCG_RESOLVE(g_bcg_destroy_set_layout, PFN_vkDestroyObject, "vkDestroyDescriptorSetLayout");
+    BCG_RESOLVE(g_bcg_destroy_module, PFN_vkDestroyObject, "vkDestroyShaderModule");
+    BCG_RESOLVE(g_bcg_destroy_desc_pool, PFN_vkDestroyObject, "vkDestroyDescriptorPool");
+    BCG_RESOLVE(g_bcg_destroy_cmd_pool, PFN_vkDestroyObject, "vkDestroyCommandPool");
+
+    /* VkDescriptorSetLayoutBinding x2: binding, type=STORAGE_BUFFER(7), count, stage=COMPUTE */
+    uint8_t bindings[48];
+    memset(bindings, 0, sizeof(bindings));
+    for (uint32_t b = 0; b < 2; b++) {
+        *(uint32_t*)(bindings + b * 24 + 0) = b;
+        *(uint32_t*)(bindings + b * 24 + 4) = 7;
+        *(uint32_t*)(bindings + b * 24 + 8) = 1;
+        *(uint32_t*)(bindings + b * 24 + 12) = 0x20;
+    }
+    uint8_t dslci[32];
+    memset(dslci, 0, sizeof(dslci));
+    *(uint32_t*)dslci = 32;  /* VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO */
+    *(uint32_t*)(dslci + 20) = 2;
+    *(const void**)(dslci + 24) = bindings;
+    if (g_bcg_create_set_layout(dev, dslci, NULL, &g_bcg_set_layout) != 0) return -1;
+
+    /* VkPushConstantRange {stage, offset, size} + VkPipelineLayoutCreateInfo */
+    uint32_t range[3] = { 0x20, 0, sizeof(BcGpuPush) };
+    uint8_t plci[48];
+    memset(plci, 0, sizeof(plci));
+    *(uint32_t*)plci = 30;  /* VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO */
+    *(uint32_t*)(plci + 20) = 1;
+    *(const void**)(plci + 24) = &g_bcg_set_layout;
+    *(uint32_t*)(plci + 32) = 1;
+    *(const void**)(plci + 40) = range;
+    if (g_bcg_create_pipe_layout(dev, plci, NULL, &g_bcg_pipe_layout) != 0) return -1;
+
+    uint8_t smci[40];
+    memset(smci, 0, sizeof(smci));
+    *(uint32_t*)smci = 16;  /* VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO */
+    *(uint64_t*)(smci + 24) = sizeof(bcn_decode_spv);
+    *(const void**)(smci + 32) = bcn_decode_spv;
+    if (g_bcg_create_module(dev, smci, NULL, &g_bcg_module) != 0) return -1;
+
+    /* One VkComputePipelineCreateInfo (96 bytes) per mode, differing only in
+     * the VkSpecializationInfo data */
+    uint32_t modes[6] = { 0, 1, 2, 3, 4, 5 };
+    uint8_t map_entry[16];          /* VkSpecializationMapEntry {id 0, offset 0, size 4} */
+    memset(map_entry, 0, sizeof(map_entry));
+    *(uint64_t*)(map_entry + 8) = 4;
+    uint8_t spec[6][32];
+    uint8_t cpci[6][96];
+    memset(spec, 0, sizeof(spec));
+    memset(cpci, 0, sizeof(cpci));
+    for (int m = 0; m < 6; m++) {
+        *(uint32_t*)(spec[m] + 0) = 1;
+        *(const void**)(spec[m] + 8) = map_entry;
+        *(uint64_t*)(spec[m] + 16) = 4;
+        *(const void**)(spec[m] + 24) = &modes[m];
+        *(uint32_t*)cpci[m] = 29;                   /* VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO */
+        *(uint32_t*)(cpci[m] + 24) = 18;            /* stage.sType */
+        *(uint32_t*)(cpci[m] + 44) = 0x20;          /* stage.stage = COMPUTE */
+        *(uint64_t*)(cpci[m] + 48) = g_bcg_module;  /* stage.module */
+        *(const char**)(cpci[m] + 56) = "main";
+        *(const void**)(cpci[m] + 64) = spec[m];
+        *(uint64_t*)(cpci[m] + 72) = g_bcg_pipe_layout;
+        *(int32_t*)(cpci[m] + 88) = -1;
+    }
+    if (g_bcg_create_pipes(dev, 0, 6, cpci, NULL, g_bcg_pipes) != 0) return -1;
+    return 1;
+}
+
+/* Prologue for an app command buffer, begun and ready to record into.
+ * Called with g_bcg_lock held. */
+static BcGpuCb* bc_gpu_prologue_locked(uint32_t family) {
+    void* dev = shared_real_device;
+    BcGpuCb** pp = &g_bcg_free;
+    while (*pp && (*pp)->family != family) pp = &(*pp)->next;
+    BcGpuCb* p = *pp;
+    if (p) {
+        *pp = p->next;
+    } else {
+        if (family >= BC_GPU_FAMILIES) return NULL;
+        if (!g_bcg_cmd_pools[family]) {
+            uint8_t cpci[24];
+            memset(cpci, 0, sizeof(cpci));
+            *(uint32_t*)cpci = 39;              /* VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO */
+            *(uint32_t*)(cpci + 16) = 0x2;      /* RESET_COMMAND_BUFFER */
+            *(uint32_t*)(cpci + 20) = family;
+            if (g_bcg_create_cmd_pool(dev, cpci, NULL, &g_bcg_cmd_pools[family]) != 0)
+                return NULL;
+        }
+        p = (BcGpuCb*)calloc(1, sizeof(BcGpuCb));
+        if (!p) return NULL;
+        p->family = family;
+
+        uint8_t cbai[32];
+        memset(cbai, 0, sizeof(cbai));
+        *(uint32_t*)cbai = 40;                  /* VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO */
+        *(uint64_t*)(cbai + 16) = g_bcg_cmd_pools[family];
+        *(uint32_t*)(cbai + 28) = 1;
+        uint32_t sizes[2] = { 7, BC_GPU_SETS * 2 };  /* VkDescriptorPoolSize: STORAGE_BUFFER */
+        uint8_t dpci[40];
+        memset(dpci, 0, sizeof(dpci));
+        *(uint32_t*)dpci = 33;                  /* VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO */
+        *(uint32_t*)(dpci + 20) = BC_GPU_SETS;
+        *(uint32_t*)(dpci + 24) = 1;
+        *(const void**)(dpci + 32) = sizes;
+        if (g_bcg_alloc_cbs(dev, cbai, &p->cb) != 0 || !p->cb ||
+            !(p->wrapped = wrap_handle(p->cb)) ||
+            g_bcg_create_desc_pool(dev, dpci, NULL, &p->desc_pool) != 0) {
+            LOGW(ICD_LC_RES, "BC GPU decode: prologue allocation failed for family %u\n", family);
+            if (p->wrapped) free_wrapper(p->wrapped);
+            free(p);   /* the command buffer goes with its pool */
+            return NULL;
+        }
+    }
+
+    uint8_t cbbi[32];
+    memset(cbbi, 0, sizeof(cbbi));
+    *(uint32_t*)cbbi = 42;                      /* VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO */
+    *(uint32_t*)(cbbi + 16) = 0x4;              /* SIMULTANEOUS_USE: the app may resubmit */
+    if (g_bcg_begin(p->cb, cbbi) != 0) {
+        p->next = g_bcg_free;
+        g_bcg_free = p;
+        return NULL;
+    }
+    /* Blocks written by transfers or the host before this command buffer */
+    uint8_t mb[24];                             /* VkMemoryBarrier */
+    memset(mb, 0, sizeof(mb));
+    *(uint32_t*)mb = 46;
+    *(uint32_t*)(mb + 16) = 0x1000 | 0x4000;    /* TRANSFER_WRITE | HOST_WRITE */
+    *(uint32_t*)(mb + 20) = 0x20;               /* SHADER_READ */
+    g_bcg_barrier(p->cb, 0x1000 | 0x4000, 0x800, 0, 1, mb, 0, NULL, 0, NULL);  /* TRANSFER|HOST → COMPUTE */
+    p->open = 1;
+    return p;
+}
+
+/* Close a prologue: make the shader writes visible to the app's copy */
+static void bc_gpu_end_locked(BcGpuCb* p) {
+    if (!p->open) return;
+    uint8_t mb[24];                             /* VkMemoryBarrier */
+    memset(mb, 0, sizeof(mb));
+    *(uint32_t*)mb = 46;
+    *(uint32_t*)(mb + 16) = 0x40;               /* SHADER_WRITE */
+    *(uint32_t*)(mb + 20) = 0x800;              /* TRANSFER_READ */
+    g_bcg_barrier(p->cb, 0x800, 0x1000, 0, 1, mb, 0, NULL, 0, NULL);  /* COMPUTE → TRANSFER */
+    g_bcg_end(p->cb);
+    p->open = 0;
+}
+
+static void bc_gpu_recycle(BcGpuCb* p) {
+    pthread_mutex_lock(&g_bcg_lock);
+    g_bcg_reset(p->cb, 0);
+    g_bcg_reset_desc_pool(shared_real_device, p->desc_pool, 0);
+    p->open = 0;
+    p->next = g_bcg_free;
+    g_bcg_free = p;
+    pthread_mutex_unlock(&g_bcg_lock);
+    __atomic_sub_fetch(&g_bcg_live, 1, __ATOMIC_RELAXED);
+}
+
+/* Tear down everything the GPU path created (last device reference) */
+static void bc_gpu_destroy_all(void) {
+    void* dev = shared_real_device;
+    pthread_mutex_lock(&g_bcg_lock);
+    while (g_bcg_free) {
+        BcGpuCb* p = g_bcg_free;
+        g_bcg_free = p->next;
+        if (dev) g_bcg_destroy_desc_pool(dev, p->desc_pool, NULL);
+        free_wrapper(p->wrapped);
+        free(p);
+    }
+    if (dev && g_bcg_state == 1) {
+        for (int f = 0; f < BC_GPU_FAMILIES; f++)
+            if (g_bcg_cmd_pools[f]) g_bcg_destroy_cmd_pool(dev, g_bcg_cmd_pools[f], NULL);
+        for (int m = 0; m < 6; m++)
+            if (g_bcg_pipes[m]) g_bcg_destroy_pipe(dev, g_bcg_pipes[m], NULL);
+        g_bcg_destroy_module(dev, g_bcg_module, NULL);
+        g_bcg_destroy_pipe_layout(dev, g_bcg_pipe_layout, NULL);
+        g_bcg_destroy_set_layout(dev, g_bcg_set_layout, NULL);
+    }
+    memset(g_bcg_cmd_pools, 0, sizeof(g_bcg_cmd_pools));
+    memset(g_bcg_pipes, 0, sizeof(g_bcg_pipes));
+    g_bcg_module = g_bcg_pipe_layout = g_bcg_set_layout = 0;
+    if (g_bcg_state == 1) g_bcg_state = 0;   /* a new device sets up again */
+    pthread_mutex_unlock(&g_bcg_lock);
+}
+
+/* real app command buffer → its prologue */
+static HandleMap g_bc_cb_prologue = HMAP_INIT(BcGpuCb*);
+
+/* Source bytes of one region, [*lo, *hi). Returns 0 for an empty region. */
+static int bc_gpu_src_range(const uint8_t* rg, uint32_t bsize, uint64_t* lo, uint64_t* hi) {
+    uint64_t off = *(const uint64_t*)rg;
+    uint32_t row_len = *(const uint32_t*)(rg + 8);
+    uint32_t img_h = *(const uint32_t*)(rg + 12);
+    uint32_t layers = *(const uint32_t*)(rg + 28);
+    uint32_t w = *(const uint32_t*)(rg + 44);
+    uint32_t h = *(const uint32_t*)(rg + 48);
+    uint32_t d = *(const uint32_t*)(rg + 52);
+    if (!w || !h || !d || !layers) return 0;
+    if (!row_len) row_len = w;
+    if (!img_h) img_h = h;
+    uint64_t row = (uint64_t)((row_len + 3) / 4) * bsize;
+    uint64_t slice = row * ((img_h + 3) / 4);
+    *lo = off;
+    *hi = off + slice * ((uint64_t)d * layers - 1) + row * ((h + 3) / 4 - 1)
+        + (uint64_t)((w + 3) / 4) * bsize;
+    return 1;
+}
+
+/* Allocate and write a descriptor set binding src[base, hi) and the chunk.
+ * Called with g_bcg_lock held. Returns 0 if the prologue's pool is full. */
+static uint64_t bc_gpu_set_locked(BcGpuCb* p, uint64_t buffer, uint64_t base, uint64_t hi,
+                                  const BcStageChunk* chunk) {
+    uint8_t dsai[40];
+    memset(dsai, 0, sizeof(dsai));
+    *(uint32_t*)dsai = 34;      /* VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO */
+    *(uint64_t*)(dsai + 16) = p->desc_pool;
+    *(uint32_t*)(dsai + 24) = 1;
+    *(const void**)(dsai + 32) = &g_bcg_set_layout;
+    uint64_t set = 0;
+    if (g_bcg_alloc_sets(shared_real_device, dsai, &set) != 0) return 0;
+
+    uint64_t infos[2][3] = {    /* VkDescriptorBufferInfo {buffer, offset, range} */
+        { buffer, base, hi - base },
+        { chunk->buffer, 0, chunk->size },
+    };
+    uint8_t writes[2][64];
+    memset(writes, 0, sizeof(writes));
+    for (int b = 0; b < 2; b++) {
+        *(uint32_t*)writes[b] = 35;             /* VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET */
+        *(uint64_t*)(writes[b] + 16) = set;
+        *(uint32_t*)(writes[b] + 24) = b;
+        *(uint32_t*)(writes[b] + 32) = 1;
+        *(uint32_t*)(writes[b] + 36) = 7;       /* STORAGE_BUFFER */
+        *(const void**)(writes[b] + 48) = infos[b];
+    }
+    g_bcg_update_sets(shared_real_device, 2, writes, 0, NULL);
+    return set;
+}
+
+/* Record the dispatches decoding an upload into the command buffer's
+ * prologue; the decoded texels land in chunk at the offsets the copy will
+ * read. Returns 0 (nothing recorded) if the CPU decoder must be used. */
+static int bc_gpu_record(void* real_cb, int mode, uint64_t buffer, const BcImageInfo* bc,
+                         uint32_t regionCount, const uint8_t* regions, uint32_t stride,
+                         BcStageChunk* chunk, uint64_t dst_off) {
+    uint32_t family;
+    if (!hmap_get(&g_bc_cb_family, (uint64_t)(uintptr_t)real_cb, &family)) return 0;
+    uint32_t bsize = bc_block_bytes(bc->bc_format);
+    uint64_t limit = g_max_storage_buffer_range ? g_max_storage_buffer_range : 0x8000000ULL;
+    if (chunk->size > limit) return 0;
+
+    /* Source range covering every region, bound once if it fits; otherwise
+     * each region binds its own */
+    uint64_t lo = ~0ULL, hi = 0, rlo, rhi;
+    for (uint32_t r = 0; r < regionCount; r++) {
+        if (!bc_gpu_src_range(regions + (size_t)r * stride, bsize, &rlo, &rhi)) continue;
+        if (rhi - (rlo & ~(uint64_t)(BC_SRC_ALIGN - 1)) > limit) return 0;
+        if (rlo < lo) lo = rlo;
+        if (rhi > hi) hi = rhi;
+    }
+    if (hi == 0) return 1;      /* only empty regions */
+    uint64_t base = lo & ~(uint64_t)(BC_SRC_ALIGN - 1);
+    int per_region = hi - base > limit;
+
+    int ok = 0;
+    pthread_mutex_lock(&g_bcg_lock);
+    if (g_bcg_state == 0) {
+        g_bcg_state = bc_gpu_setup_locked(shared_real_device);
+        if (g_bcg_state < 0)
+            LOGW(ICD_LC_RES, "BC GPU decode: pipeline setup failed, using the CPU decoder\n");
+        else
+            LOG("BC GPU decode: 6 compute pipelines ready\n");
+    }
+    if (g_bcg_state < 0) goto out;
+
+    BcGpuCb* p = NULL;
+    hmap_get(&g_bc_cb_prologue, (uint64_t)(uintptr_t)real_cb, &p);
+    if (!p) {
+        p = bc_gpu_prologue_locked(family);
+        if (!p) goto out;
+        if (!hmap_put(&g_bc_cb_prologue, (uint64_t)(uintptr_t)real_cb, &p)) {
+            g_bcg_reset(p->cb, 0);
+            p->open = 0;
+            p->next = g_bcg_free;
+            g_bcg_free = p;
+            goto out;
+        }
+        __atomic_add_fetch(&g_bcg_live, 1, __ATOMIC_RELAXED);
+    }
+    if (!p->open) goto out;     /* app recorded after ending: can't extend */
+
+    /* Allocate every set before recording, so a full pool leaves nothing
+     * half-recorded */
+    uint32_t nsets = per_region ? regionCount : 1;
+    uint64_t* sets = (uint64_t*)alloca(nsets * sizeof(uint64_t));
+    uint64_t* bases = (uint64_t*)alloca(nsets * sizeof(uint64_t));
+    uint64_t* ends = (uint64_t*)alloca(nsets * sizeof(uint64_t));
+    for (uint32_t i = 0; i < nsets; i++) {
+        bases[i] = base;
+        ends[i] = hi;
+        sets[i] = 0;
+        if (per_region) {
+            if (!bc_gpu_src_range(regions + (size_t)i * stride, bsize, &rlo, &rhi)) continue;
+            bases[i] = rlo & ~(uint64_t)(BC_SRC_ALIGN - 1);
+            ends[i] = rhi;
+        }
+        if (!(sets[i] = bc_gpu_set_locked(p, buffer, bases[i], ends[i], chunk)))
+            goto out;   /* pool full; the sets go back with the prologue */
+    }
+
+    g_bcg_bind_pipe(p->cb, 1, g_bcg_pipes[mode]);   /* VK_PIPELINE_BIND_POINT_COMPUTE */
+    if (!per_region)
+        g_bcg_bind_sets(p->cb, 1, g_bcg_pipe_layout, 0, 1, &sets[0], 0, NULL);
+    for (uint32_t r = 0; r < regionCount; r++) {
+        const uint8_t* rg = regions + (size_t)r * stride;
+        uint32_t row_len = *(const uint32_t*)(rg + 8);
+        uint32_t img_h = *(const uint32_t*)(rg + 12);
+        uint32_t layers = *(const uint32_t*)(rg + 28);
+        uint32_t w = *(const uint32_t*)(rg + 44);
+        uint32_t h = *(const uint32_t*)(rg + 48);
+        uint32_t d = *(const uint32_t*)(rg + 52);
+        if (!row_len) row_len = w;
+        if (!img_h) img_h = h;
+        uint32_t slices = d * layers;
+        if (w && h && slices) {
+            uint32_t i = per_region ? r : 0;
+            if (per_region)
+                g_bcg_bind_sets(p->cb, 1, g_bcg_pipe_layout, 0, 1, &sets[i], 0, NULL);
+            BcGpuPush pc;
+            pc.src_word = (uint32_t)((*(const uint64_t*)rg - bases[i]) / 4);
+            pc.src_row_words = ((row_len + 3) / 4) * bsize / 4;
+            pc.src_slice_words = pc.src_row_words * ((img_h + 3) / 4);
+            pc.dst_word = (uint32_t)(dst_off / 4);
+            pc.width = w;
+            pc.height = h;
+            pc.src_words = (uint32_t)((ends[i] - bases[i]) / 4);
+            g_bcg_push(p->cb, g_bcg_pipe_layout, 0x20, 0, sizeof(pc), &pc);
+            g_bcg_dispatch(p->cb, (w + 7) / 8, (h + 7) / 8, slices);
+            __atomic_add_fetch(&g_bcg_dispatches, 1, __ATOMIC_RELAXED);
+        }
+        dst_off += ((uint64_t)w * h * slices * 4 + 15) & ~15ULL;
+    }
+    ok = 1;
+out:
+    pthread_mutex_unlock(&g_bcg_lock);
+    return ok;
+}
+
+/* App command buffer ended: close its prologue */
+static void bc_gpu_end_cb(void* real_cb) {
+    if (!__atomic_load_n(&g_bcg_live, __ATOMIC_RELAXED)) return;
+    BcGpuCb* p = NULL;
+    if (!hmap_get(&g_bc_cb_prologue, (uint64_t)(uintptr_t)real_cb, &p)) return;
+    pthread_mutex_lock(&g_bcg_lock);
+    bc_gpu_end_locked(p);
+    pthread_mutex_unlock(&g_bcg_lock);
+}
+
+static BcGpuCb* bc_gpu_prologue_of(void* wrapped_cb) {
+    BcGpuCb* p = NULL;
+    if (wrapped_cb)
+        hmap_get(&g_bc_cb_prologue, (uint64_t)(uintptr_t)unwrap(wrapped_cb), &p);
+    return p;
+}
+
+/* Submit infos with each prologue inserted right before its command buffer.
+ * Returns pSubmits unchanged when there is nothing to insert, otherwise a
+ * malloc'd copy the caller frees once the submit has been issued or copied. */
+static const void* bc_gpu_submits(int v2, uint32_t count, const void* pSubmits) {
+    if (!__atomic_load_n(&g_bcg_live, __ATOMIC_RELAXED) || !pSubmits) return pSubmits;
+    uint32_t extra = 0, total = 0;
+    for (uint32_t s = 0; s < count; s++) {
+        uint32_t n;
+        if (v2) {
+            const ICD_VkSubmitInfo2* si = (const ICD_VkSubmitInfo2*)pSubmits + s;
+            n = si->pCommandBufferInfos ? si->commandBufferInfoCount : 0;
+            for (uint32_t c = 0; c < n; c++)
+                if (bc_gpu_prologue_of(si->pCommandBufferInfos[c].commandBuffer)) extra++;
+        } else {
+            const ICD_VkSubmitInfo* si = (const ICD_VkSubmitInfo*)pSubmits + s;
+            n = si->pCommandBuffers ? si->commandBufferCount : 0;
+            for (uint32_t c = 0; c < n; c++)
+                if (bc_gpu_prologue_of(si->pCommandBuffers[c])) extra++;
+        }
+        total += n;
+    }
+    if (!extra) return pSubmits;
+
+    size_t elem = v2 ? sizeof(ICD_VkSubmitInfo2) : sizeof(ICD_VkSubmitInfo);
+    size_t cb_elem = v2 ? sizeof(ICD_VkCommandBufferSubmitInfo) : sizeof(void*);
+    uint8_t* mem = (uint8_t*)malloc(count * elem + (size_t)(total + extra) * cb_elem);
+    if (!mem) return pSubmits;
+    memcpy(mem, pSubmits, count * elem);
+    uint8_t* cur = mem + count * elem;
+    for (uint32_t s = 0; s < count; s++) {
+        if (v2) {
+            ICD_VkSubmitInfo2* si = (ICD_VkSubmitInfo2*)mem + s;
+            if (!si->pCommandBufferInfos) continue;
+            ICD_VkCommandBufferSubmitInfo* out = (ICD_VkCommandBufferSubmitInfo*)cur;
+            uint32_t k = 0;
+            for (uint32_t c = 0; c < si->commandBufferInfoCount; c++) {
+                BcGpuCb* p = bc_gpu_prologue_of(si->pCommandBufferInfos[c].commandBuffer);
+                if (p) {
+                    out[k] = si->pCommandBufferInfos[c];
+                    out[k++].commandBuffer = p->wrapped;
+                }
+                out[k++] = si->pCommandBufferInfos[c];
+            }
+            si->pCommandBufferInfos = out;
+            si->commandBufferInfoCount = k;
+            cur += k * cb_elem;
+        } else {
+            ICD_VkSubmitInfo* si = (ICD_VkSubmitInfo*)mem + s;
+            if (!si->pCommandBuffers) continue;
+            void** out = (void**)cur;
+            uint32_t k = 0;
+            for (uint32_t c = 0; c < si->commandBufferCount; c++) {
+                BcGpuCb* p = bc_gpu_prologue_of(si->pCommandBuffers[c]);
+                if (p) out[k++] = p->wrapped;
+                out[k++] = si->pCommandBuffers[c];
+            }
+            si->pCommandBuffers = out;
+            si->commandBufferCount = k;
+            cur += k * cb_elem;
+        }
+    }
+    return mem;
+}
+
+/* Command buffer begun again, reset or freed: it is not pending, so its
+ * decoded uploads are no longer needed */
+static void bc_stage_release_cb(void* real_cb) {
+    if (__atomic_load_n(&g_bcg_live, __ATOMIC_RELAXED)) {
+        BcGpuCb* p = NULL;
+        if (hmap_del(&g_bc_cb_prologue, (uint64_t)(uintptr_t)real_cb, &p))
+            bc_gpu_recycle(p);
+    }
+    if (!hmap_count(&g_bc_cb_stage)) return;
+    BcStageChunk* c = NULL;
+    if (hmap_del(&g_bc_cb_stage, (uint64_t)(uintptr_t)real_cb, &c))
+        bc_stage_recycle(c);
+}
+
+static void bc_stage_track_cbs(const void* pAllocInfo, void** pCmdBufs, uint32_t count) {
+    if (!pAllocInfo || !bc_decode_enabled()) return;
+    uint64_t pool = *(const uint64_t*)((const uint8_t*)pAllocInfo + 16);
+    for (uint32_t i = 0; i < count; i++)
+        if (pCmdBufs[i]) hmap_put(&g_bc_cb_pool, (uint64_t)(uintptr_t)pCmdBufs[i], &pool);
+}
+
+static void bc_stage_forget_cb(void* real_cb) {
+    if (hmap_count(&g_bc_cb_pool))
+        hmap_del(&g_bc_cb_pool, (uint64_t)(uintptr_t)real_cb, NULL);
+}
+
+/* Every command buffer of `pool` was reset (or freed, if `destroyed`).
+ * Only command buffers holding chunks or a prologue are looked at. */
+static void bc_stage_release_pool(uint64_t pool, int destroyed) {
+    if (!hmap_count(&g_bc_cb_pool)) return;
+    HandleMap* maps[2] = { &g_bc_cb_stage, &g_bc_cb_prologue };
+    for (int m = 0; m < 2; m++) {
+        if (!hmap_count(maps[m])) continue;
+        hmap_rdlock(maps[m]);
+        uint32_t n = 0, cap = maps[m]->cap;
+        uint64_t* cbs = (uint64_t*)malloc((size_t)maps[m]->count * sizeof(uint64_t));
+        for (uint32_t i = 0; cbs && i < cap; i++)
+            if (maps[m]->keys[i]) cbs[n++] = maps[m]->keys[i];
+        hmap_unlock(maps[m]);
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t cb_pool = 0;
+            if (hmap_get(&g_bc_cb_pool, cbs[i], &cb_pool) && cb_pool == pool)
+                bc_stage_release_cb((void*)(uintptr_t)cbs[i]);
+        }
+        free(cbs);
+    }
+    if (!destroyed) return;
+    /* The pool's command buffers are gone with it */
+    hmap_wrlock(&g_bc_cb_pool);
+    for (uint32_t i = 0; i < g_bc_cb_pool.cap; ) {
+        uint64_t key = g_bc_cb_pool.keys[i];
+        if (key && *(uint64_t*)hmap_val(&g_bc_cb_pool, i) == pool) {
+            hmap_remove_locked(&g_bc_cb_pool, key, NULL);
+            bc_gpu_forget_cb((void*)(uintptr_t)key);
+            continue;   /* the cluster shifted into slot i */
+        }
+        i++;
+    }
+    hmap_unlock(&g_bc_cb_pool);
+    hmap_del(&g_bc_pool_family, pool, NULL);
+}
+
+/* Last device reference going away: drop every chunk, including those of
+ * command buffers whose pool was destroyed without freeing them */
+static void bc_stage_destroy_all(void) {
+    hmap_wrlock(&g_bc_cb_stage);
+    for (uint32_t i = 0; i < g_bc_cb_stage.cap; i++) {
+        if (!g_bc_cb_stage.keys[i]) continue;
+        BcStageChunk* c = *(BcStageChunk**)hmap_val(&g_bc_cb_stage, i);
+        while (c) {
+            BcStageChunk* next = c->next;
+            bc_stage_destroy(c);
+            c = next;
+        }
+        g_bc_cb_stage.keys[i] = 0;
+    }
+    g_bc_cb_stage.count = 0;
+    hmap_unlock(&g_bc_cb_stage);
+
+    /* Prologues back onto the free list, then everything the GPU path made */
+    pthread_mutex_lock(&g_bcg_lock);
+    hmap_wrlock(&g_bc_cb_prologue);
+    for (uint32_t i = 0; i < g_bc_cb_prologue.cap; i++) {
+        if (!g_bc_cb_prologue.keys[i]) continue;
+        BcGpuCb* p = *(BcGpuCb**)hmap_val(&g_bc_cb_prologue, i);
+        p->next = g_bcg_free;
+        g_bcg_free = p;
+        g_bc_cb_prologue.keys[i] = 0;
+    }
+    g_bc_cb_prologue.count = 0;
+    g_bcg_live = 0;
+    hmap_unlock(&g_bc_cb_prologue);
+    pthread_mutex_unlock(&g_bcg_lock);
+    bc_gpu_destroy_all();
+
+    pthread_mutex_lock(&g_bc_stage_lock);
+    BcStageChunk* c = g_bc_stage_free;
+    g_bc_stage_free = NULL;
+    g_bc_stage_free_count = 0;
+    pthread_mutex_unlock(&g_bc_stage_lock);
+    while (c) {
+        BcStageChunk* next = c->next;
+        bc_stage_destroy(c);
+        c = next;
+    }
+}
+
+/* Decode a BC upload and record it as an RGBA8 copy (or an ETC2/EAC copy
+ * when the image was substituted with one). regions points at the first
+ * VkBufferImageCopy body (56 bytes), stride is the array stride (56 for
+ * vkCmdCopyBufferToImage, 72 for VkBufferImageCopy2). Returns 0 if the
+ * upload can't be decoded and nothing was recorded. */
+static int bc_upload(void* real_cb, uint64_t buffer, uint64_t image, uint32_t layout,
+                     const BcImageInfo* bc, uint32_t regionCount,
+                     const uint8_t* regions, uint32_t stride, int src_written) {
+    if (!bc_decode_enabled() || !bc_decode_supported(bc->bc_format) ||
+        !regionCount || !regions || !real_cmd_copy_buf_to_img)
+        return 0;
+
+    uint32_t bsize = bc_block_bytes(bc->bc_format);
+    uint32_t etc = is_etc2_format(bc->rgba_format) ? bc->rgba_format : 0;
+    uint32_t obytes = etc ? etc2_block_bytes(etc) : 0;
+    /* The prologue runs before the whole command buffer, so it would read
+     * the source before a transfer recorded earlier in it wrote the blocks */
+    int mode = g_bc_gpu && !etc && !src_written ? bc_gpu_mode(bc->bc_format) : -1;
+    const uint8_t** srcs = (const uint8_t**)alloca(regionCount * sizeof(uint8_t*));
+    uint64_t total = 0;
+    for (uint32_t r = 0; r < regionCount; r++) {
+        const uint8_t* rg = regions + (size_t)r * stride;
+        uint32_t layers = *(const uint32_t*)(rg + 28);
+        uint32_t w = *(const uint32_t*)(rg + 44);
+        uint32_t h = *(const uint32_t*)(rg + 48);
+        uint32_t d = *(const uint32_t*)(rg + 52);
+        if (layers == ~0u) return 0;  /* VK_REMAINING_ARRAY_LAYERS: size unknown here */
+        uint64_t slice = etc ? (uint64_t)((w + 3) / 4) * ((h + 3) / 4) * obytes : (uint64_t)w * h * 4;
+        total += (slice * d * layers + 15) & ~15ULL;
+    }
+
+    uint64_t off = 0;
+    BcStageChunk* chunk = bc_stage_alloc(real_cb, total, &off);
+    if (!chunk) return 0;
+
+    /* The GPU reads the blocks itself; only the CPU decoder needs them mapped */
+    int gpu = mode >= 0 &&
+        bc_gpu_record(real_cb, mode, buffer, bc, regionCount, regions, stride, chunk, off);
+    for (uint32_t r = 0; !gpu && r < regionCount; r++) {
+        srcs[r] = (const uint8_t*)lookup_ubo_ptr(buffer, *(const uint64_t*)(regions + (size_t)r * stride));
+        if (!srcs[r]) return 0;   /* the reserved chunk space is reclaimed with the CB */
+    }
+
+    uint8_t* out = (uint8_t*)alloca(regionCount * 56);
+    for (uint32_t r = 0; r < regionCount; r++) {
+        const uint8_t* rg = regions + (size_t)r * stride;
+        uint8_t* o = out + r * 56;
+        memcpy(o, rg, 56);
+        uint32_t row_len = *(const uint32_t*)(rg + 8);
+        uint32_t img_h = *(const uint32_t*)(rg + 12);
+        uint32_t layers = *(const uint32_t*)(rg + 28);
+        uint32_t w = *(const uint32_t*)(rg + 44);
+        uint32_t h = *(const uint32_t*)(rg + 48);
+        uint32_t d = *(const uint32_t*)(rg + 52);
+        if (!row_len) row_len = w;
+        if (!img_h) img_h = h;
+
+        BcDecodeJob job;
+        memset(&job, 0, sizeof(job));
+        job.src = srcs[r];
+        job.dst = chunk->ptr + off;
+        job.src_row_pitch = (uint64_t)((row_len + 3) / 4) * bsize;
+        job.src_slice_pitch = job.src_row_pitch * ((img_h + 3) / 4);
+        job.dst_row_pitch = etc ? (w + 3) / 4 * obytes : w * 4;
+        job.dst_slice_pitch = etc ? (uint64_t)job.dst_row_pitch * ((h + 3) / 4) : (uint64_t)w * h * 4;
+        job.format = bc->bc_format;
+        job.block_bytes = bsize;
+        job.out_format = etc;
+        job.width = w;
+        job.height = h;
+        job.block_rows = (h + 3) / 4;
+        job.total_rows = job.block_rows * d * layers;
+        if (!gpu && w && job.total_rows) bc_decode(&job);
+
+        *(uint64_t*)(o + 0) = off;   /* bufferOffset */
+        *(uint32_t*)(o + 8) = 0;     /* bufferRowLength: tightly packed */
+        *(uint32_t*)(o + 12) = 0;    /* bufferImageHeight */
+        off += ((uint64_t)job.dst_slice_pitch * d * layers + 15) & ~15ULL;
+    }
+
+    real_cmd_copy_buf_to_img(real_cb, chunk->buffer, image, layout, regionCount, out);
+
+    uint64_t n = __atomic_add_fetch(&g_bc_decode_regions, regionCount, __ATOMIC_RELAXED);
+    uint64_t bytes = __atomic_add_fetch(&g_bc_decode_bytes, total, __ATOMIC_RELAXED);
+    if (n <= 8 || (n & 1023) < regionCount)
+        LOGD(ICD_LC_RES, "BC decode: img=0x%llx fmt=%u->%u regions=%u %s (%llu total, %llu MB decoded)\n",
+            (unsigned long long)image, bc->bc_format, bc->rgba_format, regionCount, gpu ? "gpu" : "cpu",
+            (unsigned long long)n, (unsigned long long)(bytes >> 20));
+    return 1;
 }
 
 /* ==== Extended Dynamic State (EDS) C wrappers ====
@@ -6273,58 +10689,57 @@ static int dyn_wrapper_count = 0;
 
 /* Helper: record a uint32_t EDS command for secondary CBs */
 static void record_eds_uint(void* cb, int slot, uint32_t v) {
-    ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_UINT);
-    if (cmd) { cmd->eds_uint.slot = slot; cmd->eds_uint.value = v; }
+    RcEdsUint* cmd = replay_emit(cb, RCMD_EDS_UINT, sizeof(*cmd));
+    if (cmd) *cmd = (RcEdsUint){ slot, v };
 }
 static void record_eds_stencil2(void* cb, int slot, uint32_t face, uint32_t val) {
-    ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_STENCIL2);
-    if (cmd) { cmd->eds_stencil2.slot = slot; cmd->eds_stencil2.face = face; cmd->eds_stencil2.val = val; }
+    RcStencil2* cmd = replay_emit(cb, RCMD_EDS_STENCIL2, sizeof(*cmd));
+    if (cmd) *cmd = (RcStencil2){ slot, face, val };
 }
 
-/* Slot 0: vkCmdSetViewportWithCount — log + global save + replay record */
+/* Slot 0: vkCmdSetViewportWithCount — log + per-CB save + replay record */
 static void unwrap3_0(void* cb, uint32_t n, const void* p) {
     static int vp_log = 0;
     vp_log++;
     if (p && n >= 1) {
         const float* vp = (const float*)p;
-        g_last_viewport[0] = vp[0]; g_last_viewport[1] = vp[1];
-        g_last_viewport[2] = vp[2]; g_last_viewport[3] = vp[3];
-        g_last_viewport[4] = vp[4]; g_last_viewport[5] = vp[5];
-        g_last_viewport_set = 1;
+        CmdBufState* cbs = cb_state_get(cb, 1);
+        if (cbs) {
+            memcpy(cbs->viewport, vp, sizeof(cbs->viewport));
+            cbs->viewport_set = 1;
+        }
         if (vp_log <= 50) {
-            LOG("VIEWPORT: n=%u x=%.1f y=%.1f w=%.1f h=%.1f minD=%.3f maxD=%.3f\n",
+            LOGT(ICD_LC_CMD, "VIEWPORT: n=%u x=%.1f y=%.1f w=%.1f h=%.1f minD=%.3f maxD=%.3f\n",
                 n, vp[0], vp[1], vp[2], vp[3], vp[4], vp[5]);
         }
         /* Record for secondary CB replay */
-        ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_VIEWPORT);
-        if (cmd) { cmd->eds_viewport.slot = 0; cmd->eds_viewport.count = 1;
-                    memcpy(cmd->eds_viewport.data, vp, 6 * sizeof(float)); }
+        RcRects* cmd = replay_emit(cb, RCMD_EDS_VIEWPORT, sizeof(*cmd) + n * 6 * sizeof(float));
+        if (cmd) { cmd->count = n; memcpy(cmd + 1, vp, n * 6 * sizeof(float)); }
     }
     ((void(*)(void*,uint32_t,const void*))dyn_real[0])(unwrap(cb), n, p);
 }
-/* Slot 1: vkCmdSetScissorWithCount — global save + replay record */
+/* Slot 1: vkCmdSetScissorWithCount — per-CB save + replay record */
 static void unwrap3_1(void* cb, uint32_t n, const void* p) {
     if (p && n >= 1) {
         const uint32_t* sc = (const uint32_t*)p;
-        g_last_scissor[0] = sc[0]; g_last_scissor[1] = sc[1];
-        g_last_scissor[2] = sc[2]; g_last_scissor[3] = sc[3];
+        CmdBufState* cbs = cb_state_get(cb, 1);
+        if (cbs) memcpy(cbs->scissor, sc, sizeof(cbs->scissor));
         /* Record for secondary CB replay */
-        ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_SCISSOR);
-        if (cmd) { cmd->eds_scissor.slot = 1; cmd->eds_scissor.count = 1;
-                    memcpy(cmd->eds_scissor.data, sc, 4 * sizeof(uint32_t)); }
+        RcRects* cmd = replay_emit(cb, RCMD_EDS_SCISSOR, sizeof(*cmd) + n * 4 * sizeof(uint32_t));
+        if (cmd) { cmd->count = n; memcpy(cmd + 1, sc, n * 4 * sizeof(uint32_t)); }
     }
     ((void(*)(void*,uint32_t,const void*))dyn_real[1])(unwrap(cb), n, p);
 }
 /* Slot 2: vkCmdSetDepthBias */
 static void unwrap_depthbias_2(void* cb, float a, float b, float c) {
-    ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_DEPTHBIAS);
-    if (cmd) { cmd->eds_depthbias.a = a; cmd->eds_depthbias.b = b; cmd->eds_depthbias.c = c; }
+    RcDepthBias* cmd = replay_emit(cb, RCMD_EDS_DEPTHBIAS, sizeof(*cmd));
+    if (cmd) *cmd = (RcDepthBias){ a, b, c };
     ((void(*)(void*,float,float,float))dyn_real[2])(unwrap(cb), a, b, c);
 }
 /* Slot 3: vkCmdSetBlendConstants */
 static void unwrap_blend_3(void* cb, const float* p) {
-    ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_BLEND);
-    if (cmd && p) { memcpy(cmd->eds_blend.vals, p, 4 * sizeof(float)); }
+    RcBlend* cmd = replay_emit(cb, RCMD_EDS_BLEND, sizeof(*cmd));
+    if (cmd && p) memcpy(cmd->vals, p, 4 * sizeof(float));
     ((void(*)(void*,const float*))dyn_real[3])(unwrap(cb), p);
 }
 /* Slots 4-11,13-14: uint32_t EDS (cull, frontFace, depth*, stencilTest, rasterDiscard, depthBias, topology, primRestart) */
@@ -6340,9 +10755,8 @@ static void unwrap2_13(void* cb, uint32_t v) { record_eds_uint(cb, 13, v); ((voi
 static void unwrap2_14(void* cb, uint32_t v) { record_eds_uint(cb, 14, v); ((void(*)(void*,uint32_t))dyn_real[14])(unwrap(cb), v); }
 /* Slot 12: vkCmdSetStencilOp (6 args) */
 static void unwrap6_12(void* cb, uint32_t face, uint32_t fail, uint32_t pass, uint32_t dfail, uint32_t cmp) {
-    ReplayCmd* cmd = add_replay_cmd(cb, RCMD_EDS_STENCILOP);
-    if (cmd) { cmd->eds_stencilop.face = face; cmd->eds_stencilop.fail = fail;
-               cmd->eds_stencilop.pass = pass; cmd->eds_stencilop.dfail = dfail; cmd->eds_stencilop.cmp = cmp; }
+    RcStencilOp* cmd = replay_emit(cb, RCMD_EDS_STENCILOP, sizeof(*cmd));
+    if (cmd) *cmd = (RcStencilOp){ face, fail, pass, dfail, cmp };
     ((void(*)(void*,uint32_t,uint32_t,uint32_t,uint32_t,uint32_t))dyn_real[12])(unwrap(cb), face, fail, pass, dfail, cmp);
 }
 /* Slots 15-17: stencil compare/write mask, reference */
@@ -6511,6 +10925,18 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_queue_wait_idle = (PFN_vkQueueWaitIdle)fn;
         return (PFN_vkVoidFunction)wrapper_QueueWaitIdle;
     }
+    if (strcmp(pName, "vkQueuePresentKHR") == 0) {
+        real_queue_present = (PFN_vkQueuePresentKHR)fn;
+        return (PFN_vkVoidFunction)wrapper_QueuePresentKHR;
+    }
+    if (strcmp(pName, "vkQueueBindSparse") == 0) {
+        real_queue_bind_sparse = (PFN_vkQueueBindSparse)fn;
+        return (PFN_vkVoidFunction)wrapper_QueueBindSparse;
+    }
+    if (strcmp(pName, "vkDeviceWaitIdle") == 0) {
+        real_device_wait_idle = (PFN_vkDeviceWaitIdle)fn;
+        return (PFN_vkVoidFunction)wrapper_DeviceWaitIdle;
+    }
     if (strcmp(pName, "vkCmdExecuteCommands") == 0) {
         real_cmd_exec_cmds = (PFN_vkCmdExecCmds)fn;
         return (PFN_vkVoidFunction)wrapper_CmdExecuteCommands;
@@ -6560,6 +10986,18 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_create_cmd_pool = (PFN_vkCreateCommandPool)fn;
         return (PFN_vkVoidFunction)trace_CreateCommandPool;
     }
+    if (strcmp(pName, "vkResetCommandPool") == 0) {
+        real_reset_cmd_pool = (PFN_vkResetCommandPool)fn;
+        return (PFN_vkVoidFunction)trace_ResetCommandPool;
+    }
+    if (strcmp(pName, "vkDestroyCommandPool") == 0) {
+        real_destroy_cmd_pool = (PFN_vkDestroyCommandPool)fn;
+        return (PFN_vkVoidFunction)trace_DestroyCommandPool;
+    }
+    if (strcmp(pName, "vkResetCommandBuffer") == 0) {
+        real_reset_cmd_buf = (PFN_vkResetCommandBuffer)fn;
+        return (PFN_vkVoidFunction)trace_ResetCommandBuffer;
+    }
     if (strcmp(pName, "vkAllocateMemory") == 0) {
         real_alloc_memory = (PFN_vkAllocateMemory)fn;
         return (PFN_vkVoidFunction)trace_AllocateMemory;
@@ -6568,10 +11006,18 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_create_buffer = (PFN_vkCreateBuffer)fn;
         return (PFN_vkVoidFunction)trace_CreateBuffer;
     }
+    if (strcmp(pName, "vkDestroyBuffer") == 0) {
+        real_destroy_buffer = (PFN_vkDestroyBuffer)fn;
+        return (PFN_vkVoidFunction)trace_DestroyBuffer;
+    }
     if (strcmp(pName, "vkCreateImage") == 0) {
         real_create_image = (PFN_vkCreateImage)fn;
         return (PFN_vkVoidFunction)trace_CreateImage;
     }
+    if (strcmp(pName, "vkDestroyImage") == 0) {
+        real_destroy_image = (PFN_vkDestroyImage)fn;
+        return (PFN_vkVoidFunction)trace_DestroyImage;
+    }
     if (strcmp(pName, "vkCreateFence") == 0) {
         real_create_fence = (PFN_vkCreateFence)fn;
         return (PFN_vkVoidFunction)trace_CreateFence;
@@ -6588,6 +11034,10 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_unmap_memory = (PFN_vkUnmapMemory)fn;
         return (PFN_vkVoidFunction)trace_UnmapMemory;
     }
+    if (strcmp(pName, "vkFreeMemory") == 0) {
+        real_free_memory = (PFN_vkFreeMemory)fn;
+        return (PFN_vkVoidFunction)trace_FreeMemory;
+    }
     /* Capture Invalidate/Flush for cache coherence fix */
     if (strcmp(pName, "vkInvalidateMappedMemoryRanges") == 0) {
         real_invalidate_mapped = (PFN_vkInvalidateMappedMemoryRanges)fn;
@@ -6631,6 +11081,10 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_create_image_view = (PFN_vkCreateImageView)fn;
         return (PFN_vkVoidFunction)trace_CreateImageView;
     }
+    if (strcmp(pName, "vkDestroyImageView") == 0) {
+        real_destroy_image_view = (PFN_vkDestroyImageView)fn;
+        return (PFN_vkVoidFunction)trace_DestroyImageView;
+    }
     if (strcmp(pName, "vkCreateSampler") == 0) {
         real_create_sampler = (PFN_vkCreateSampler)fn;
         return (PFN_vkVoidFunction)trace_CreateSampler;
@@ -6641,7 +11095,7 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
     }
     if (strcmp(pName, "vkDestroyShaderModule") == 0) {
         real_destroy_shader_module = (PFN_vkDestroyShaderModule)fn;
-        return fn; /* pass through, no wrapper needed */
+        return (PFN_vkVoidFunction)trace_DestroyShaderModule;
     }
     if (strcmp(pName, "vkCreateGraphicsPipelines") == 0) {
         real_create_gfx_pipelines = (PFN_vkCreateGraphicsPipelines)fn;
@@ -6651,6 +11105,10 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_create_comp_pipelines = (PFN_vkCreateComputePipelines)fn;
         return (PFN_vkVoidFunction)trace_CreateComputePipelines;
     }
+    if (strcmp(pName, "vkDestroyPipeline") == 0) {
+        real_destroy_pipeline = (PFN_vkDestroyPipeline)fn;
+        return (PFN_vkVoidFunction)trace_DestroyPipeline;
+    }
     if (strcmp(pName, "vkCreateRenderPass") == 0) {
         real_create_render_pass = (PFN_vkCreateRenderPass)fn;
         return (PFN_vkVoidFunction)trace_CreateRenderPass;
@@ -6668,6 +11126,30 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_create_desc_pool = (PFN_vkCreateDescPool)fn;
         return (PFN_vkVoidFunction)trace_CreateDescriptorPool;
     }
+    if (strcmp(pName, "vkFreeDescriptorSets") == 0) {
+        real_free_desc_sets = (PFN_vkFreeDescSets)fn;
+        return (PFN_vkVoidFunction)trace_FreeDescriptorSets;
+    }
+    if (strcmp(pName, "vkResetDescriptorPool") == 0) {
+        real_reset_desc_pool = (PFN_vkResetDescPool)fn;
+        return (PFN_vkVoidFunction)trace_ResetDescriptorPool;
+    }
+    if (strcmp(pName, "vkDestroyDescriptorPool") == 0) {
+        real_destroy_desc_pool = (PFN_vkDestroyObject)fn;
+        return (PFN_vkVoidFunction)trace_DestroyDescriptorPool;
+    }
+    if (strcmp(pName, "vkDestroyDescriptorSetLayout") == 0) {
+        real_destroy_dsl = (PFN_vkDestroyObject)fn;
+        return (PFN_vkVoidFunction)trace_DestroyDescriptorSetLayout;
+    }
+    if (strcmp(pName, "vkDestroySampler") == 0) {
+        real_destroy_sampler = (PFN_vkDestroyObject)fn;
+        return (PFN_vkVoidFunction)trace_DestroySampler;
+    }
+    if (strcmp(pName, "vkDestroyBufferView") == 0) {
+        real_destroy_buffer_view = (PFN_vkDestroyObject)fn;
+        return (PFN_vkVoidFunction)trace_DestroyBufferView;
+    }
     if (strcmp(pName, "vkUpdateDescriptorSets") == 0) {
         real_update_desc_sets = (PFN_vkUpdateDescriptorSets)fn;
         LOG("GDPA: vkUpdateDescriptorSets -> null_guard wrapper (real=%p)\n", (void*)fn);
@@ -6685,6 +11167,11 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         LOG("GDPA: %s -> template tracker (real=%p)\n", pName, (void*)fn);
         return (PFN_vkVoidFunction)null_guard_CreateDescriptorUpdateTemplate;
     }
+    if (strcmp(pName, "vkDestroyDescriptorUpdateTemplate") == 0 ||
+        strcmp(pName, "vkDestroyDescriptorUpdateTemplateKHR") == 0) {
+        real_destroy_desc_update_template = (PFN_vkDestroyDescUpdateTemplate)fn;
+        return (PFN_vkVoidFunction)null_guard_DestroyDescriptorUpdateTemplate;
+    }
     if (strcmp(pName, "vkCreateBufferView") == 0) {
         real_create_buffer_view = (PFN_vkCreateBufferView)fn;
         LOG("GDPA: vkCreateBufferView -> %p (captured for dummy resources)\n", (void*)fn);
@@ -6697,6 +11184,11 @@ static PFN_vkVoidFunction wrapped_GDPA(void* device, const char* pName) {
         real_cmd_copy_buffer = (PFN_vkCmdCopyBuffer)fn;
         return (PFN_vkVoidFunction)trace_CmdCopyBuffer;
     }
+    if (strcmp(pName, "vkCmdCopyBuffer2") == 0 ||
+        strcmp(pName, "vkCmdCopyBuffer2KHR") == 0) {
+        real_cmd_copy_buffer2 = (PFN_vkCmdCopyBuffer2)fn;
+        return (PFN_vkVoidFunction)trace_CmdCopyBuffer2;
+    }
     if (strcmp(pName, "vkCmdCopyBufferToImage") == 0) {
         real_cmd_copy_buf_to_img = (PFN_vkCmdCopyBufToImg)fn;
         return (PFN_vkVoidFunction)trace_CmdCopyBufferToImage;
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Compile shaders/bcn_decode.comp into bcn_decode_spv.h, the SPIR-V words of
+# the GPU BCn decoder that fex_thunk_icd.c embeds (ICD_BC_DECODE=gpu).
+# Rerun after editing the shader and commit both files.
+#
+# Needs glslangValidator, spirv-opt and spirv-val (glslang-tools and
+# spirv-tools packages, or the Vulkan SDK). With a .spv argument only the
+# header is re-emitted from that module.
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SRC="$SCRIPT_DIR/shaders/bcn_decode.comp"
+OUT="$SCRIPT_DIR/bcn_decode_spv.h"
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+if [ -n "$1" ]; then
+    cp "$1" "$TMP/bcn_decode.spv"
+else
+    # Vulkan 1.0 / SPIR-V 1.0: the ICD creates the module on whatever the
+    # driver reports, and Vortek forwards it unchanged
+    glslangValidator -V --target-env vulkan1.0 -o "$TMP/raw.spv" "$SRC"
+    spirv-opt -O --strip-debug -o "$TMP/bcn_decode.spv" "$TMP/raw.spv"
+fi
+spirv-val --target-env vulkan1.0 "$TMP/bcn_decode.spv"
+
+# od prints host-order words; SPIR-V files are little-endian, like every
+# host this is built on
+{
+    echo "/* Generated by gen_bcn_decode_spv.sh from shaders/bcn_decode.comp; do not edit. */"
+    echo "static const uint32_t bcn_decode_spv[] = {"
+    od -An -v -tx4 -w24 "$TMP/bcn_decode.spv" |
+        awk '{ printf "   "; for (i = 1; i <= NF; i++) printf " 0x%s,", $i; printf "\n" }'
+    echo "};"
+} > "$OUT"
+
+echo "Wrote $OUT ($(( $(stat -c %s "$TMP/bcn_decode.spv") / 4 )) words)"
@@ -39,6 +39,7 @@
 #include "allocation.h"
 #include "loader.h"
 #include "log.h"
+#include "manifest_cache.h"
 
 static void *cJSON_malloc(const VkAllocationCallbacks *pAllocator, size_t size) {
     return loader_calloc(pAllocator, size, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
@@ -951,6 +952,142 @@ cJSON *loader_cJSON_GetObjectItem(cJSON *object, const char *string) {
     return c;
 }
 
+/* Binary form of a parse tree, used by the manifest cache so an unchanged manifest does not have to be parsed again.
+ * Each node is a type byte and a has-name byte, the name (u32 length + bytes) if present, then a double and an int32 for
+ * numbers, a u32 length + bytes for strings, or a u32 child count followed by the children for arrays and objects. */
+#define CJSON_BINARY_MAX_DEPTH 64
+
+static size_t binary_put(uint8_t *out, size_t out_size, size_t pos, const void *src, size_t len) {
+    if (out && len <= out_size && pos <= out_size - len) memcpy(out + pos, src, len);
+    return pos + len;
+}
+
+static size_t binary_put_string(uint8_t *out, size_t out_size, size_t pos, const char *str) {
+    uint32_t len = (uint32_t)strlen(str);
+    pos = binary_put(out, out_size, pos, &len, sizeof(len));
+    return binary_put(out, out_size, pos, str, len);
+}
+
+static size_t serialize_item(const cJSON *item, uint8_t *out, size_t out_size, size_t pos) {
+    uint8_t tag[2] = {(uint8_t)(item->type & 0xFF), item->string != NULL};
+    pos = binary_put(out, out_size, pos, tag, sizeof(tag));
+    if (item->string) pos = binary_put_string(out, out_size, pos, item->string);
+    switch (item->type & 0xFF) {
+        case cJSON_Number: {
+            int32_t valueint = item->valueint;
+            pos = binary_put(out, out_size, pos, &item->valuedouble, sizeof(item->valuedouble));
+            pos = binary_put(out, out_size, pos, &valueint, sizeof(valueint));
+            break;
+        }
+        case cJSON_String:
+            pos = binary_put_string(out, out_size, pos, item->valuestring ? item->valuestring : "");
+            break;
+        case cJSON_Array:
+        case cJSON_Object: {
+            uint32_t count = 0;
+            for (const cJSON *c = item->child; c; c = c->next) count++;
+            pos = binary_put(out, out_size, pos, &count, sizeof(count));
+            for (const cJSON *c = item->child; c; c = c->next) pos = serialize_item(c, out, out_size, pos);
+            break;
+        }
+        default:
+            break;
+    }
+    return pos;
+}
+
+size_t loader_cJSON_Serialize(const cJSON *item, uint8_t *out, size_t out_size) { return serialize_item(item, out, out_size, 0); }
+
+struct binary_reader {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+};
+
+static bool binary_get(struct binary_reader *r, void *dst, size_t len) {
+    if (len > r->size - r->pos) return false;
+    memcpy(dst, r->data + r->pos, len);
+    r->pos += len;
+    return true;
+}
+
+static char *binary_get_string(const VkAllocationCallbacks *pAllocator, struct binary_reader *r, bool *out_of_memory) {
+    uint32_t len;
+    if (!binary_get(r, &len, sizeof(len)) || len > r->size - r->pos) return NULL;
+    char *str = (char *)cJSON_malloc(pAllocator, (size_t)len + 1);
+    if (!str) {
+        *out_of_memory = true;
+        return NULL;
+    }
+    memcpy(str, r->data + r->pos, len);
+    str[len] = '\0';
+    r->pos += len;
+    return str;
+}
+
+static bool deserialize_item(cJSON *item, struct binary_reader *r, int depth, bool *out_of_memory) {
+    uint8_t tag[2];
+    if (depth > CJSON_BINARY_MAX_DEPTH || !binary_get(r, tag, sizeof(tag)) || tag[0] > cJSON_Object) return false;
+    item->type = tag[0];
+    if (tag[1]) {
+        item->string = binary_get_string(item->pAllocator, r, out_of_memory);
+        if (!item->string) return false;
+    }
+    switch (item->type) {
+        case cJSON_Number: {
+            int32_t valueint;
+            if (!binary_get(r, &item->valuedouble, sizeof(item->valuedouble)) || !binary_get(r, &valueint, sizeof(valueint)))
+                return false;
+            item->valueint = valueint;
+            break;
+        }
+        case cJSON_String:
+            item->valuestring = binary_get_string(item->pAllocator, r, out_of_memory);
+            return item->valuestring != NULL;
+        case cJSON_Array:
+        case cJSON_Object: {
+            uint32_t count;
+            if (!binary_get(r, &count, sizeof(count))) return false;
+            cJSON *prev = NULL;
+            for (uint32_t i = 0; i < count; i++) {
+                cJSON *child = cJSON_New_Item(item->pAllocator);
+                if (!child) {
+                    *out_of_memory = true;
+                    return false;
+                }
+                if (prev) {
+                    prev->next = child;
+                    child->prev = prev;
+                } else {
+                    item->child = child;
+                }
+                prev = child;
+                if (!deserialize_item(child, r, depth + 1, out_of_memory)) return false;
+                /* loader_cJSON_GetObjectItem expects every member of an object to be named */
+                if (item->type == cJSON_Object && !child->string) return false;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return true;
+}
+
+cJSON *loader_cJSON_Deserialize(const VkAllocationCallbacks *pAllocator, const uint8_t *data, size_t size, bool *out_of_memory) {
+    struct binary_reader r = {data, size, 0};
+    cJSON *c = cJSON_New_Item(pAllocator);
+    if (!c) {
+        *out_of_memory = true;
+        return NULL;
+    }
+    if (!deserialize_item(c, &r, 0, out_of_memory) || r.pos != size) {
+        loader_cJSON_Delete(c);
+        return NULL;
+    }
+    return c;
+}
+
 VkResult loader_get_json(const struct loader_instance *inst, const char *filename, cJSON **json) {
     FILE *file = NULL;
     char *json_buf = NULL;
@@ -983,6 +1120,14 @@ VkResult loader_get_json(const struct loader_instance *inst, const char *filenam
         res = VK_ERROR_INITIALIZATION_FAILED;
         goto out;
     }
+    // Manifests that haven't changed since they were last parsed come straight out of the manifest cache
+    struct manifest_cache_stamp stamp;
+    res = manifest_cache_find_json(inst, filename, file, &stamp, json);
+    if (res != VK_INCOMPLETE) {
+        goto out;
+    }
+    res = VK_SUCCESS;
+
     // NOTE: We can't just use fseek(file, 0, SEEK_END) because that isn't guaranteed to be supported on all systems
     size_t fread_ret_count = 0;
     do {
@@ -1022,6 +1167,7 @@ VkResult loader_get_json(const struct loader_instance *inst, const char *filenam
         loader_log(inst, VULKAN_LOADER_ERROR_BIT, 0, "loader_get_json: Invalid JSON file %s.", filename);
         goto out;
     }
+    manifest_cache_store_json(filename, &stamp, *json);
 
 out:
     loader_instance_heap_free(inst, json_buf);
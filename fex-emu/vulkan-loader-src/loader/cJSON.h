@@ -25,6 +25,8 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <vulkan/vulkan_core.h>
@@ -79,6 +81,11 @@ cJSON *loader_cJSON_GetArrayItem(cJSON *array, int item);
 /* Get item "string" from object. Case insensitive. */
 cJSON *loader_cJSON_GetObjectItem(cJSON *object, const char *string);
 
+/* Write the binary form of a parse tree into out and return its size. Call with out == NULL to query the size. */
+size_t loader_cJSON_Serialize(const cJSON *item, uint8_t *out, size_t out_size);
+/* Rebuild a parse tree from loader_cJSON_Serialize output. Returns NULL if the data is malformed or memory ran out. */
+cJSON *loader_cJSON_Deserialize(const VkAllocationCallbacks *pAllocator, const uint8_t *data, size_t size, bool *out_of_memory);
+
 /* When assigning an integer value, it needs to be propagated to valuedouble
  * too. */
 #define cJSON_SetIntValue(object, val) ((object) ? (object)->valueint = (object)->valuedouble = (val) : (val))
@@ -59,6 +59,7 @@
 #include "loader_environment.h"
 #include "gpa_helper.h"
 #include "log.h"
+#include "manifest_cache.h"
 #include "unknown_function_handling.h"
 #include "vk_loader_platform.h"
 #include "wsi.h"
@@ -1827,6 +1828,7 @@ void loader_initialize(void) {
     loader_platform_thread_create_mutex(&loader_preload_icd_lock);
     loader_platform_thread_create_mutex(&loader_global_instance_list_lock);
     init_global_loader_settings();
+    init_global_manifest_cache();
 
     // initialize logging
     loader_init_global_debug_level();
@@ -1861,6 +1863,7 @@ void loader_release() {
 
     // release mutexes
     teardown_global_loader_settings();
+    teardown_global_manifest_cache();
     loader_platform_thread_delete_mutex(&loader_lock);
     loader_platform_thread_delete_mutex(&loader_preload_icd_lock);
     loader_platform_thread_delete_mutex(&loader_global_instance_list_lock);
@@ -2897,25 +2900,38 @@ VkResult add_data_files(const struct loader_instance *inst, char *search_path, s
             if (NULL == dir_stream) {
                 continue;
             }
-            while (1) {
-                dir_entry = readdir(dir_stream);
-                if (NULL == dir_entry) {
-                    break;
-                }
+            // A directory that hasn't changed since it was last read still holds the same manifests
+            struct manifest_cache_stamp dir_stamp;
+            uint32_t first_new_file = out_files->count;
+            VkResult cache_res = manifest_cache_find_dir(inst, cur_file, dir_stream, &dir_stamp, out_files);
+            if (cache_res != VK_INCOMPLETE) {
+                vk_result = cache_res;
+            } else {
+                while (1) {
+                    dir_entry = readdir(dir_stream);
+                    if (NULL == dir_entry) {
+                        break;
+                    }
 
-                name = &(dir_entry->d_name[0]);
-                loader_get_fullpath(name, cur_file, sizeof(full_path), full_path);
-                name = full_path;
+                    name = &(dir_entry->d_name[0]);
+                    loader_get_fullpath(name, cur_file, sizeof(full_path), full_path);
+                    name = full_path;
 
-                VkResult local_res;
-                local_res = add_if_manifest_file(inst, name, out_files);
+                    VkResult local_res;
+                    local_res = add_if_manifest_file(inst, name, out_files);
 
-                // Incomplete means this was not a valid data file.
-                if (local_res == VK_INCOMPLETE) {
-                    continue;
-                } else if (local_res != VK_SUCCESS) {
-                    vk_result = local_res;
-                    break;
+                    // Incomplete means this was not a valid data file.
+                    if (local_res == VK_INCOMPLETE) {
+                        continue;
+                    } else if (local_res != VK_SUCCESS) {
+                        vk_result = local_res;
+                        break;
+                    }
+                }
+                if (vk_result == VK_SUCCESS) {
+                    uint32_t new_file_count = out_files->count - first_new_file;
+                    manifest_cache_store_dir(cur_file, &dir_stamp, new_file_count ? &out_files->list[first_new_file] : NULL,
+                                             new_file_count);
                 }
             }
             loader_closedir(inst, dir_stream);
@@ -3586,6 +3602,7 @@ VkResult loader_icd_scan(const struct loader_instance *inst, struct loader_icd_t
     }
 
     // Get a list of manifest files for ICDs
+    manifest_cache_prepare(inst);
     res = loader_get_data_files(inst, LOADER_DATA_FILE_MANIFEST_DRIVER, NULL, &manifest_files);
     if (VK_SUCCESS != res) {
         goto out;
@@ -3678,6 +3695,7 @@ out:
         }
     }
     free_string_list(inst, &manifest_files);
+    manifest_cache_persist(inst);
     return res;
 }
 
@@ -3690,6 +3708,7 @@ VkResult loader_parse_instance_layers(struct loader_instance *inst, enum loader_
     VkResult res = VK_SUCCESS;
     struct loader_string_list manifest_files = {0};
 
+    manifest_cache_prepare(inst);
     res = loader_get_data_files(inst, manifest_type, path_override, &manifest_files);
     if (VK_SUCCESS != res) {
         goto out;
@@ -3723,6 +3742,7 @@ VkResult loader_parse_instance_layers(struct loader_instance *inst, enum loader_
     }
 out:
     free_string_list(inst, &manifest_files);
+    manifest_cache_persist(inst);
 
     return res;
 }
@@ -0,0 +1,620 @@
+/*
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "manifest_cache.h"
+
+#include "allocation.h"
+#include "loader.h"
+#include "loader_environment.h"
+#include "log.h"
+
+#if COMMON_UNIX_PLATFORMS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MANIFEST_CACHE_ENV_VAR "VK_LOADER_MANIFEST_CACHE"
+#define MANIFEST_CACHE_FILE_NAME "loader_manifest_cache.bin"
+#define MANIFEST_CACHE_MAGIC 0x434D4B56u  // "VKMC"
+#define MANIFEST_CACHE_VERSION 1
+#define MANIFEST_CACHE_MAX_ENTRIES 8192
+#define MANIFEST_CACHE_MAX_FILE_SIZE (64u * 1024u * 1024u)
+// Entries modified this recently are not stored: a second write within the same timestamp tick would go unnoticed.
+#define MANIFEST_CACHE_RACY_SECONDS 2
+
+enum manifest_cache_kind {
+    MANIFEST_CACHE_KIND_DIR = 1,   // data is the directory's manifest paths, each NUL terminated
+    MANIFEST_CACHE_KIND_JSON = 2,  // data is loader_cJSON_Serialize output
+};
+
+// On-disk layout: header, then `count` records. Each record is followed by its NUL terminated path and its data, padded
+// to 8 bytes. Written in host byte order; the file never leaves the machine.
+struct manifest_cache_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t record_size;
+};
+
+struct manifest_cache_file_record {
+    uint32_t kind;
+    uint32_t path_len;  // not counting the NUL
+    uint32_t data_len;
+    uint32_t reserved;
+    uint64_t checksum;  // of the data
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+};
+
+struct manifest_cache_entry {
+    uint32_t kind;
+    uint32_t data_len;
+    struct manifest_cache_stamp stamp;
+    const char *path;     // points into the mapping unless owned
+    const uint8_t *data;  // points into the mapping unless owned
+    uint64_t checksum;
+    bool owned;
+    bool verified;  // data checked against checksum
+};
+
+struct manifest_cache {
+    char *path;  // cache file in use, NULL when the cache is disabled
+    void *map;
+    size_t map_size;
+    struct manifest_cache_entry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *buckets;  // entry index + 1, 0 is an empty bucket
+    uint32_t bucket_count;
+    bool dirty;
+    uint32_t hits;
+    uint32_t misses;
+};
+
+static loader_platform_thread_mutex global_manifest_cache_lock;
+static struct manifest_cache global_manifest_cache;
+
+static size_t manifest_cache_align(size_t size) { return (size + 7) & ~(size_t)7; }
+
+static uint64_t manifest_cache_fnv(const uint8_t *data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t manifest_cache_hash(uint32_t kind, const char *path) {
+    return manifest_cache_fnv((const uint8_t *)path, strlen(path), 14695981039346656037ULL ^ kind);
+}
+
+static uint64_t manifest_cache_checksum(const uint8_t *data, size_t size) {
+    return manifest_cache_fnv(data, size, 14695981039346656037ULL);
+}
+
+static bool manifest_cache_stamp_fd(int fd, struct manifest_cache_stamp *stamp) {
+    struct stat st;
+    memset(stamp, 0, sizeof(*stamp));
+    if (fd < 0 || fstat(fd, &st) != 0) return false;
+    stamp->ino = (uint64_t)st.st_ino;
+    stamp->size = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+    stamp->mtime_sec = st.st_mtimespec.tv_sec;
+    stamp->mtime_nsec = st.st_mtimespec.tv_nsec;
+    stamp->ctime_sec = st.st_ctimespec.tv_sec;
+    stamp->ctime_nsec = st.st_ctimespec.tv_nsec;
+#else
+    stamp->mtime_sec = st.st_mtim.tv_sec;
+    stamp->mtime_nsec = st.st_mtim.tv_nsec;
+    stamp->ctime_sec = st.st_ctim.tv_sec;
+    stamp->ctime_nsec = st.st_ctim.tv_nsec;
+#endif
+    stamp->valid = true;
+    return true;
+}
+
+static bool manifest_cache_stamp_equal(const struct manifest_cache_stamp *a, const struct manifest_cache_stamp *b) {
+    return a->ino == b->ino && a->size == b->size && a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec &&
+           a->ctime_sec == b->ctime_sec && a->ctime_nsec == b->ctime_nsec;
+}
+
+static bool manifest_cache_stamp_is_racy(const struct manifest_cache_stamp *stamp) {
+    return stamp->mtime_sec + MANIFEST_CACHE_RACY_SECONDS >= (int64_t)time(NULL);
+}
+
+static struct manifest_cache_entry *manifest_cache_lookup(struct manifest_cache *cache, uint32_t kind, const char *path) {
+    if (cache->bucket_count == 0) return NULL;
+    uint32_t mask = cache->bucket_count - 1;
+    for (uint32_t i = (uint32_t)manifest_cache_hash(kind, path) & mask;; i = (i + 1) & mask) {
+        uint32_t slot = cache->buckets[i];
+        if (slot == 0) return NULL;
+        struct manifest_cache_entry *entry = &cache->entries[slot - 1];
+        if (entry->kind == kind && strcmp(entry->path, path) == 0) return entry;
+    }
+}
+
+static void manifest_cache_index(struct manifest_cache *cache, uint32_t index) {
+    uint32_t mask = cache->bucket_count - 1;
+    const struct manifest_cache_entry *entry = &cache->entries[index];
+    uint32_t i = (uint32_t)manifest_cache_hash(entry->kind, entry->path) & mask;
+    while (cache->buckets[i] != 0) i = (i + 1) & mask;
+    cache->buckets[i] = index + 1;
+}
+
+// Make room for one more entry, keeping the bucket table at most half full.
+static bool manifest_cache_reserve(struct manifest_cache *cache) {
+    if (cache->count >= MANIFEST_CACHE_MAX_ENTRIES) return false;
+    if (cache->count == cache->capacity) {
+        uint32_t new_capacity = cache->capacity ? cache->capacity * 2 : 64;
+        void *new_entries =
+            loader_realloc(NULL, cache->entries, cache->capacity * sizeof(struct manifest_cache_entry),
+                           new_capacity * sizeof(struct manifest_cache_entry), VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE);
+        if (!new_entries) return false;
+        cache->entries = new_entries;
+        cache->capacity = new_capacity;
+    }
+    if ((cache->count + 1) * 2 > cache->bucket_count) {
+        uint32_t new_bucket_count = cache->bucket_count ? cache->bucket_count * 2 : 128;
+        uint32_t *new_buckets = loader_calloc(NULL, new_bucket_count * sizeof(uint32_t), VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE);
+        if (!new_buckets) return false;
+        loader_free(NULL, cache->buckets);
+        cache->buckets = new_buckets;
+        cache->bucket_count = new_bucket_count;
+        for (uint32_t i = 0; i < cache->count; i++) manifest_cache_index(cache, i);
+    }
+    return true;
+}
+
+static void manifest_cache_free_entry(struct manifest_cache_entry *entry) {
+    if (entry->owned) {
+        loader_free(NULL, (void *)entry->path);
+        loader_free(NULL, (void *)entry->data);
+    }
+}
+
+static void manifest_cache_clear(struct manifest_cache *cache) {
+    for (uint32_t i = 0; i < cache->count; i++) manifest_cache_free_entry(&cache->entries[i]);
+    loader_free(NULL, cache->entries);
+    loader_free(NULL, cache->buckets);
+    if (cache->map) munmap(cache->map, cache->map_size);
+    loader_free(NULL, cache->path);
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Add or replace an entry. path and data are adopted when owned is set, even on failure. Entries read from the file are
+// checked against their checksum the first time they are used.
+static void manifest_cache_insert(struct manifest_cache *cache, uint32_t kind, const char *path, const uint8_t *data,
+                                  uint32_t data_len, uint64_t checksum, const struct manifest_cache_stamp *stamp, bool owned) {
+    struct manifest_cache_entry *entry = manifest_cache_lookup(cache, kind, path);
+    if (entry) {
+        manifest_cache_free_entry(entry);
+    } else if (manifest_cache_reserve(cache)) {
+        entry = &cache->entries[cache->count];
+        entry->kind = kind;
+        entry->path = path;
+        manifest_cache_index(cache, cache->count++);
+    } else {
+        if (owned) {
+            loader_free(NULL, (void *)path);
+            loader_free(NULL, (void *)data);
+        }
+        return;
+    }
+    entry->path = path;
+    entry->data = data;
+    entry->data_len = data_len;
+    entry->checksum = checksum;
+    entry->stamp = *stamp;
+    entry->owned = owned;
+    entry->verified = owned;
+}
+
+// Returns the entry for path if it is still valid for stamp
+static struct manifest_cache_entry *manifest_cache_find(struct manifest_cache *cache, uint32_t kind, const char *path,
+                                                        const struct manifest_cache_stamp *stamp) {
+    struct manifest_cache_entry *entry = manifest_cache_lookup(cache, kind, path);
+    if (!entry || !manifest_cache_stamp_equal(&entry->stamp, stamp)) return NULL;
+    if (!entry->verified) {
+        if (manifest_cache_checksum(entry->data, entry->data_len) != entry->checksum) return NULL;
+        entry->verified = true;
+    }
+    return entry;
+}
+
+static char *manifest_cache_concat(const char *a, const char *b) {
+    size_t a_len = strlen(a), b_len = strlen(b);
+    char *out = loader_calloc(NULL, a_len + b_len + 1, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE);
+    if (out) {
+        memcpy(out, a, a_len);
+        memcpy(out + a_len, b, b_len);
+    }
+    return out;
+}
+
+// Returns the cache file path to use, or NULL when the cache is disabled.
+static char *manifest_cache_resolve_path(const struct loader_instance *inst) {
+    char *path = NULL;
+    char *override = loader_secure_getenv(MANIFEST_CACHE_ENV_VAR, inst);
+    if (override && override[0] != '\0') {
+        if (strcmp(override, "0") != 0) path = manifest_cache_concat(override, "");
+        loader_free_getenv(override, inst);
+        return path;
+    }
+    loader_free_getenv(override, inst);
+
+    char *xdg_cache_home = loader_secure_getenv("XDG_CACHE_HOME", inst);
+    if (xdg_cache_home && xdg_cache_home[0] != '\0') {
+        path = manifest_cache_concat(xdg_cache_home, "/vulkan/" MANIFEST_CACHE_FILE_NAME);
+    } else {
+        char *home = loader_secure_getenv("HOME", inst);
+        if (home && home[0] != '\0') path = manifest_cache_concat(home, "/.cache/vulkan/" MANIFEST_CACHE_FILE_NAME);
+        loader_free_getenv(home, inst);
+    }
+    loader_free_getenv(xdg_cache_home, inst);
+    return path;
+}
+
+// Map the cache file and index its records in place. A file that fails validation anywhere is ignored as a whole.
+static void manifest_cache_load(const struct loader_instance *inst, struct manifest_cache *cache) {
+    int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct manifest_cache_file_header) ||
+        st.st_size > (off_t)MANIFEST_CACHE_MAX_FILE_SIZE) {
+        close(fd);
+        return;
+    }
+    size_t map_size = (size_t)st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    cache->map = map;
+    cache->map_size = map_size;
+
+    const uint8_t *base = map;
+    const struct manifest_cache_file_header *header = map;
+    bool valid = header->magic == MANIFEST_CACHE_MAGIC && header->version == MANIFEST_CACHE_VERSION &&
+                 header->record_size == sizeof(struct manifest_cache_file_record) &&
+                 header->count <= MANIFEST_CACHE_MAX_ENTRIES;
+    size_t pos = sizeof(struct manifest_cache_file_header);
+    for (uint32_t i = 0; valid && i < header->count; i++) {
+        struct manifest_cache_file_record record;
+        if (map_size - pos < sizeof(record)) {
+            valid = false;
+            break;
+        }
+        memcpy(&record, base + pos, sizeof(record));
+        pos += sizeof(record);
+        size_t payload = (size_t)record.path_len + 1 + record.data_len;
+        if ((record.kind != MANIFEST_CACHE_KIND_DIR && record.kind != MANIFEST_CACHE_KIND_JSON) || payload > map_size - pos ||
+            base[pos + record.path_len] != '\0' || strlen((const char *)base + pos) != record.path_len) {
+            valid = false;
+            break;
+        }
+        struct manifest_cache_stamp stamp = {true,
+                                             record.ino,
+                                             record.size,
+                                             record.mtime_sec,
+                                             record.mtime_nsec,
+                                             record.ctime_sec,
+                                             record.ctime_nsec};
+        manifest_cache_insert(cache, record.kind, (const char *)base + pos, base + pos + record.path_len + 1, record.data_len,
+                              record.checksum, &stamp, false);
+        pos += manifest_cache_align(payload);
+        if (pos > map_size) pos = map_size;
+    }
+    if (!valid) {
+        loader_log(inst, VULKAN_LOADER_DEBUG_BIT, 0, "Ignoring invalid manifest cache %s", cache->path);
+        for (uint32_t i = 0; i < cache->count; i++) manifest_cache_free_entry(&cache->entries[i]);
+        cache->count = 0;
+        if (cache->buckets) memset(cache->buckets, 0, cache->bucket_count * sizeof(uint32_t));
+        return;
+    }
+    loader_log(inst, VULKAN_LOADER_DEBUG_BIT, 0, "Loaded manifest cache %s (%u entries)", cache->path, cache->count);
+}
+
+static void manifest_cache_make_parent_dirs(char *path) {
+    for (char *c = path + 1; *c; c++) {
+        if (*c != '/') continue;
+        *c = '\0';
+        mkdir(path, 0755);
+        *c = '/';
+    }
+}
+
+static bool manifest_cache_write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Serialize every entry to a temporary file next to the cache and rename it into place, so concurrent readers only ever
+// map a complete file.
+static void manifest_cache_write(const struct loader_instance *inst, struct manifest_cache *cache) {
+    if (!cache->dirty || !cache->path) return;
+    cache->dirty = false;
+
+    size_t total = sizeof(struct manifest_cache_file_header);
+    for (uint32_t i = 0; i < cache->count; i++) {
+        total += sizeof(struct manifest_cache_file_record) +
+                 manifest_cache_align(strlen(cache->entries[i].path) + 1 + cache->entries[i].data_len);
+    }
+    uint8_t *buf = loader_calloc(NULL, total, VK_SYSTEM_ALLOCATION_SCOPE_COMMAND);
+    char *tmp_path = manifest_cache_concat(cache->path, ".XXXXXX");
+    if (!buf || !tmp_path) goto out;
+
+    struct manifest_cache_file_header header = {MANIFEST_CACHE_MAGIC, MANIFEST_CACHE_VERSION, cache->count,
+                                                sizeof(struct manifest_cache_file_record)};
+    memcpy(buf, &header, sizeof(header));
+    size_t pos = sizeof(header);
+    for (uint32_t i = 0; i < cache->count; i++) {
+        const struct manifest_cache_entry *entry = &cache->entries[i];
+        struct manifest_cache_file_record record = {entry->kind,
+                                                    (uint32_t)strlen(entry->path),
+                                                    entry->data_len,
+                                                    0,
+                                                    entry->checksum,
+                                                    entry->stamp.ino,
+                                                    entry->stamp.size,
+                                                    entry->stamp.mtime_sec,
+                                                    entry->stamp.mtime_nsec,
+                                                    entry->stamp.ctime_sec,
+                                                    entry->stamp.ctime_nsec};
+        memcpy(buf + pos, &record, sizeof(record));
+        pos += sizeof(record);
+        memcpy(buf + pos, entry->path, record.path_len + 1);
+        if (entry->data_len) memcpy(buf + pos + record.path_len + 1, entry->data, entry->data_len);
+        pos += manifest_cache_align((size_t)record.path_len + 1 + entry->data_len);
+    }
+
+    manifest_cache_make_parent_dirs(tmp_path);
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        loader_log(inst, VULKAN_LOADER_DEBUG_BIT, 0, "Unable to write manifest cache %s: %s", cache->path, strerror(errno));
+        goto out;
+    }
+    fchmod(fd, 0644);
+    bool written = manifest_cache_write_all(fd, buf, total);
+    close(fd);
+    if (!written || rename(tmp_path, cache->path) != 0) {
+        loader_log(inst, VULKAN_LOADER_DEBUG_BIT, 0, "Unable to write manifest cache %s: %s", cache->path, strerror(errno));
+        unlink(tmp_path);
+    }
+
+out:
+    loader_free(NULL, tmp_path);
+    loader_free(NULL, buf);
+}
+
+void init_global_manifest_cache(void) {
+    loader_platform_thread_create_mutex(&global_manifest_cache_lock);
+    memset(&global_manifest_cache, 0, sizeof(global_manifest_cache));
+}
+
+void teardown_global_manifest_cache(void) {
+    manifest_cache_clear(&global_manifest_cache);
+    loader_platform_thread_delete_mutex(&global_manifest_cache_lock);
+}
+
+void manifest_cache_prepare(const struct loader_instance *inst) {
+    char *path = manifest_cache_resolve_path(inst);
+    loader_platform_thread_lock_mutex(&global_manifest_cache_lock);
+    struct manifest_cache *cache = &global_manifest_cache;
+    if ((path == NULL && cache->path == NULL) || (path && cache->path && strcmp(path, cache->path) == 0)) {
+        loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+        loader_free(NULL, path);
+        return;
+    }
+    manifest_cache_write(inst, cache);
+    manifest_cache_clear(cache);
+    cache->path = path;
+    if (path) manifest_cache_load(inst, cache);
+    loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+}
+
+void manifest_cache_persist(const struct loader_instance *inst) {
+    loader_platform_thread_lock_mutex(&global_manifest_cache_lock);
+    struct manifest_cache *cache = &global_manifest_cache;
+    if (cache->hits || cache->misses) {
+        loader_log(inst, VULKAN_LOADER_DEBUG_BIT, 0, "Manifest cache: %u hits, %u misses", cache->hits, cache->misses);
+        cache->hits = 0;
+        cache->misses = 0;
+    }
+    manifest_cache_write(inst, cache);
+    loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+}
+
+VkResult manifest_cache_find_dir(const struct loader_instance *inst, const char *dir_path, DIR *dir_stream,
+                                 struct manifest_cache_stamp *stamp, struct loader_string_list *out_files) {
+    VkResult res = VK_INCOMPLETE;
+    if (!manifest_cache_stamp_fd(dirfd(dir_stream), stamp)) return res;
+
+    loader_platform_thread_lock_mutex(&global_manifest_cache_lock);
+    struct manifest_cache *cache = &global_manifest_cache;
+    if (!cache->path) {
+        stamp->valid = false;
+        goto out;
+    }
+    const struct manifest_cache_entry *entry = manifest_cache_find(cache, MANIFEST_CACHE_KIND_DIR, dir_path, stamp);
+    if (!entry) {
+        cache->misses++;
+        goto out;
+    }
+    // Every listed path was built from dir_path; anything else means the entry is not ours to trust.
+    size_t dir_len = strlen(dir_path);
+    const char *end = (const char *)entry->data + entry->data_len;
+    if (entry->data_len && end[-1] != '\0') goto out;
+    for (const char *file = (const char *)entry->data; file < end; file += strlen(file) + 1) {
+        if (strncmp(file, dir_path, dir_len) != 0) goto out;
+    }
+    res = VK_SUCCESS;
+    for (const char *file = (const char *)entry->data; file < end && res == VK_SUCCESS; file += strlen(file) + 1) {
+        res = copy_str_to_string_list(inst, out_files, file, strlen(file));
+    }
+    cache->hits++;
+
+out:
+    loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+    return res;
+}
+
+void manifest_cache_store_dir(const char *dir_path, const struct manifest_cache_stamp *stamp, char *const *files,
+                              uint32_t file_count) {
+    if (!stamp->valid || manifest_cache_stamp_is_racy(stamp)) return;
+    size_t data_len = 0;
+    for (uint32_t i = 0; i < file_count; i++) data_len += strlen(files[i]) + 1;
+    char *path = manifest_cache_concat(dir_path, "");
+    uint8_t *data = loader_calloc(NULL, data_len ? data_len : 1, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE);
+    if (!path || !data) {
+        loader_free(NULL, path);
+        loader_free(NULL, data);
+        return;
+    }
+    size_t pos = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        size_t len = strlen(files[i]) + 1;
+        memcpy(data + pos, files[i], len);
+        pos += len;
+    }
+
+    loader_platform_thread_lock_mutex(&global_manifest_cache_lock);
+    struct manifest_cache *cache = &global_manifest_cache;
+    if (cache->path) {
+        manifest_cache_insert(cache, MANIFEST_CACHE_KIND_DIR, path, data, (uint32_t)data_len,
+                              manifest_cache_checksum(data, data_len), stamp, true);
+        cache->dirty = true;
+    } else {
+        loader_free(NULL, path);
+        loader_free(NULL, data);
+    }
+    loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+}
+
+VkResult manifest_cache_find_json(const struct loader_instance *inst, const char *filename, FILE *file,
+                                  struct manifest_cache_stamp *stamp, cJSON **json) {
+    VkResult res = VK_INCOMPLETE;
+    if (!manifest_cache_stamp_fd(fileno(file), stamp)) return res;
+
+    loader_platform_thread_lock_mutex(&global_manifest_cache_lock);
+    struct manifest_cache *cache = &global_manifest_cache;
+    if (!cache->path) {
+        stamp->valid = false;
+        goto out;
+    }
+    const struct manifest_cache_entry *entry = manifest_cache_find(cache, MANIFEST_CACHE_KIND_JSON, filename, stamp);
+    if (!entry) {
+        cache->misses++;
+        goto out;
+    }
+    bool out_of_memory = false;
+    *json = loader_cJSON_Deserialize(inst ? &inst->alloc_callbacks : NULL, entry->data, entry->data_len, &out_of_memory);
+    if (out_of_memory) {
+        res = VK_ERROR_OUT_OF_HOST_MEMORY;
+    } else if (*json) {
+        res = VK_SUCCESS;
+        cache->hits++;
+    } else {
+        cache->misses++;
+    }
+
+out:
+    loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+    return res;
+}
+
+void manifest_cache_store_json(const char *filename, const struct manifest_cache_stamp *stamp, const cJSON *json) {
+    if (!stamp->valid || manifest_cache_stamp_is_racy(stamp)) return;
+    size_t data_len = loader_cJSON_Serialize(json, NULL, 0);
+    if (data_len > UINT32_MAX) return;
+    char *path = manifest_cache_concat(filename, "");
+    uint8_t *data = loader_calloc(NULL, data_len, VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE);
+    if (!path || !data) {
+        loader_free(NULL, path);
+        loader_free(NULL, data);
+        return;
+    }
+    loader_cJSON_Serialize(json, data, data_len);
+
+    loader_platform_thread_lock_mutex(&global_manifest_cache_lock);
+    struct manifest_cache *cache = &global_manifest_cache;
+    if (cache->path) {
+        manifest_cache_insert(cache, MANIFEST_CACHE_KIND_JSON, path, data, (uint32_t)data_len,
+                              manifest_cache_checksum(data, data_len), stamp, true);
+        cache->dirty = true;
+    } else {
+        loader_free(NULL, path);
+        loader_free(NULL, data);
+    }
+    loader_platform_thread_unlock_mutex(&global_manifest_cache_lock);
+}
+
+#else  // !COMMON_UNIX_PLATFORMS
+
+void init_global_manifest_cache(void) {}
+void teardown_global_manifest_cache(void) {}
+void manifest_cache_prepare(const struct loader_instance *inst) { (void)inst; }
+void manifest_cache_persist(const struct loader_instance *inst) { (void)inst; }
+
+VkResult manifest_cache_find_dir(const struct loader_instance *inst, const char *dir_path, DIR *dir_stream,
+                                 struct manifest_cache_stamp *stamp, struct loader_string_list *out_files) {
+    (void)inst;
+    (void)dir_path;
+    (void)dir_stream;
+    (void)out_files;
+    memset(stamp, 0, sizeof(*stamp));
+    return VK_INCOMPLETE;
+}
+
+void manifest_cache_store_dir(const char *dir_path, const struct manifest_cache_stamp *stamp, char *const *files,
+                              uint32_t file_count) {
+    (void)dir_path;
+    (void)stamp;
+    (void)files;
+    (void)file_count;
+}
+
+VkResult manifest_cache_find_json(const struct loader_instance *inst, const char *filename, FILE *file,
+                                  struct manifest_cache_stamp *stamp, cJSON **json) {
+    (void)inst;
+    (void)filename;
+    (void)file;
+    (void)json;
+    memset(stamp, 0, sizeof(*stamp));
+    return VK_INCOMPLETE;
+}
+
+void manifest_cache_store_json(const char *filename, const struct manifest_cache_stamp *stamp, const cJSON *json) {
+    (void)filename;
+    (void)stamp;
+    (void)json;
+}
+
+#endif  // COMMON_UNIX_PLATFORMS
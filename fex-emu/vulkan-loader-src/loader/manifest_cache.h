@@ -0,0 +1,71 @@
+/*
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Persistent cache of manifest scan results.
+//
+// Every vkCreateInstance walks the driver and layer search directories and parses each manifest it finds. Under FEX that
+// is hundreds of emulated syscalls and a full JSON parse per manifest, repeated on every launch even though the files
+// almost never change. The cache remembers the manifest list of each search directory (keyed by the directory's stamp)
+// and the parse tree of each manifest (keyed by the file's stamp), and keeps them in a binary file that is memory-mapped
+// on startup. A directory or manifest whose stamp no longer matches is read the normal way and its entry replaced.
+//
+// VK_LOADER_MANIFEST_CACHE=0 disables the cache, any other value is used as the cache file path. The default location is
+// $XDG_CACHE_HOME/vulkan/loader_manifest_cache.bin (or $HOME/.cache/vulkan/...). The cache is never used in
+// high-integrity (setuid) processes. Only available on unix platforms; elsewhere every lookup misses.
+
+#pragma once
+
+#include "cJSON.h"
+#include "loader_common.h"
+
+#if defined(_WIN32)
+#include "dirent_on_windows.h"
+#elif COMMON_UNIX_PLATFORMS
+#include <dirent.h>
+#endif
+
+// What a cache entry is validated against.
+struct manifest_cache_stamp {
+    bool valid;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+};
+
+void init_global_manifest_cache(void);
+void teardown_global_manifest_cache(void);
+
+// Load (or switch to) the cache file selected by the environment. Called at the start of every manifest scan.
+void manifest_cache_prepare(const struct loader_instance *inst);
+
+// Write back entries added since the last call. Called at the end of every manifest scan.
+void manifest_cache_persist(const struct loader_instance *inst);
+
+// Append the cached manifest list of the directory open in dir_stream to out_files.
+// Returns VK_INCOMPLETE on a miss, in which case stamp is filled in for manifest_cache_store_dir.
+VkResult manifest_cache_find_dir(const struct loader_instance *inst, const char *dir_path, DIR *dir_stream,
+                                 struct manifest_cache_stamp *stamp, struct loader_string_list *out_files);
+void manifest_cache_store_dir(const char *dir_path, const struct manifest_cache_stamp *stamp, char *const *files,
+                              uint32_t file_count);
+
+// Rebuild the cached parse tree of the manifest open in file.
+// Returns VK_INCOMPLETE on a miss, in which case stamp is filled in for manifest_cache_store_json.
+VkResult manifest_cache_find_json(const struct loader_instance *inst, const char *filename, FILE *file,
+                                  struct manifest_cache_stamp *stamp, cJSON **json);
+void manifest_cache_store_json(const char *filename, const struct manifest_cache_stamp *stamp, const cJSON *json);
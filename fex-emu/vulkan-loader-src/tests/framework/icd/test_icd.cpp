@@ -880,7 +880,7 @@ VKAPI_ATTR VkResult VKAPI_CALL test_vkCreateCommandPool([[maybe_unused]] VkDevic
                                                         [[maybe_unused]] const VkAllocationCallbacks* pAllocator,
                                                         VkCommandPool* pCommandPool) {
     if (pCommandPool != nullptr) {
-        pCommandPool = reinterpret_cast<VkCommandPool*>(0xdeadbeefdeadbeef);
+        *pCommandPool = to_nondispatch_handle<VkCommandPool>(0xdeadbeefdeadbeef);
     }
     return VK_SUCCESS;
 }
@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <stack>
 #include <string>
 #include <utility>
@@ -98,6 +99,12 @@ struct JsonWriter {
         output += std::string(value ? "true" : "false");
     }
 
+    void AddKeyedInteger(std::string const& key, uint64_t value) {
+        CommaAndNewLine();
+        Indent();
+        output += "\"" + key + "\": " + std::to_string(value);
+    }
+
    private:
     void CommaAndNewLine() {
         if (stack.size() > 0) {
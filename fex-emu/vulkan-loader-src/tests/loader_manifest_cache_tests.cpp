@@ -0,0 +1,248 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and/or associated documentation files (the "Materials"), to
+ * deal in the Materials without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Materials, and to permit persons to whom the Materials are
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice(s) and this permission notice shall be included in
+ * all copies or substantial portions of the Materials.
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE MATERIALS OR THE
+ * USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include "test_environment.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#if COMMON_UNIX_PLATFORMS
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+const uint32_t cache_test_layer_count = 400;
+
+std::string cache_test_layer_name(uint32_t index) { return "VK_LAYER_manifest_cache_test_" + std::to_string(index); }
+
+// Write explicit layer manifests straight into the search folder. The layers are never enabled, so there is no need to
+// copy a layer binary for each of them.
+void add_cache_test_layers(FrameworkEnvironment& env, uint32_t first, uint32_t count) {
+    auto& folder = env.get_folder(ManifestLocation::explicit_layer);
+    for (uint32_t i = first; i < first + count; i++) {
+        folder.write_manifest(cache_test_layer_name(i) + ".json",
+                              ManifestLayer{}
+                                  .add_layer(ManifestLayer::LayerDescription{}
+                                                 .set_name(cache_test_layer_name(i))
+                                                 .set_lib_path(TEST_LAYER_PATH_EXPORT_VERSION_2))
+                                  .get_manifest_str());
+    }
+}
+
+// The cache refuses entries modified in the last couple of seconds, so move every manifest and search folder an hour
+// into the past.
+void backdate_search_folders(FrameworkEnvironment& env) {
+    struct timespec times[2] = {{0, UTIME_OMIT}, {time(nullptr) - 3600, 0}};
+    for (auto location : {ManifestLocation::null, ManifestLocation::driver, ManifestLocation::explicit_layer,
+                          ManifestLocation::implicit_layer, ManifestLocation::unsecured_location,
+                          ManifestLocation::settings_location}) {
+        auto& folder = env.get_folder(location);
+        for (auto const& file : folder.get_files()) {
+            ASSERT_EQ(0, utimensat(AT_FDCWD, (folder.location() / file).c_str(), times, 0));
+        }
+        ASSERT_EQ(0, utimensat(AT_FDCWD, folder.location().c_str(), times, 0));
+    }
+}
+
+// Create an instance and return how long vkCreateInstance took
+std::chrono::microseconds timed_create_instance(FrameworkEnvironment& env) {
+    InstWrapper inst{env.vulkan_functions};
+    FillDebugUtilsCreateDetails(inst.create_info, env.debug_log);
+    auto start = std::chrono::steady_clock::now();
+    inst.CheckCreate();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+std::chrono::microseconds average_create_instance(FrameworkEnvironment& env, uint32_t iterations) {
+    std::chrono::microseconds total{0};
+    for (uint32_t i = 0; i < iterations; i++) total += timed_create_instance(env);
+    return total / iterations;
+}
+
+struct ManifestCacheStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+};
+
+// Sum the hit and miss counts the loader logged at the end of each scan
+ManifestCacheStats logged_cache_stats(DebugUtilsLogger const& log) {
+    ManifestCacheStats stats;
+    const std::string prefix = "Manifest cache: ";
+    for (size_t pos = log.returned_output.find(prefix); pos != std::string::npos;
+         pos = log.returned_output.find(prefix, pos + 1)) {
+        unsigned hits = 0, misses = 0;
+        if (sscanf(log.returned_output.c_str() + pos + prefix.size(), "%u hits, %u misses", &hits, &misses) == 2) {
+            stats.hits += hits;
+            stats.misses += misses;
+        }
+    }
+    return stats;
+}
+
+struct ManifestCacheFile {
+    ManifestCacheFile()
+        : folder(fs::path(FRAMEWORK_BUILD_DIRECTORY) / "manifest_cache"),
+          file(folder / "loader_manifest_cache.bin"),
+          env_var("VK_LOADER_MANIFEST_CACHE", file.str()) {
+        fs::delete_folder(folder);
+    }
+    ~ManifestCacheFile() { fs::delete_folder(folder); }
+
+    // Drop the in-memory cache so the next scan maps the file again, like a new process would
+    void reload() {
+        env_var.set_new_value("0");
+        {
+            // Any scan makes the loader notice the new value
+            uint32_t count = 0;
+            env_functions->vkEnumerateInstanceLayerProperties(&count, nullptr);
+        }
+        env_var.set_new_value(file.str());
+    }
+
+    fs::path folder;
+    fs::path file;
+    EnvVarWrapper env_var;
+    VulkanFunctions* env_functions = nullptr;
+};
+
+TEST(ManifestCache, RepeatedInstanceCreationSkipsScan) {
+    FrameworkEnvironment env{};
+    env.add_icd(TestICDDetails(TEST_ICD_PATH_VERSION_2)).add_physical_device({});
+    add_cache_test_layers(env, 0, cache_test_layer_count);
+    backdate_search_folders(env);
+
+    ManifestCacheFile cache;
+    cache.env_functions = &env.vulkan_functions;
+
+    // Nothing cached yet: every folder is walked and every manifest parsed
+    auto uncached = timed_create_instance(env);
+    auto stats = logged_cache_stats(env.debug_log);
+    ASSERT_EQ(stats.hits, 0U);
+    ASSERT_GT(stats.misses, cache_test_layer_count);
+    struct stat st;
+    ASSERT_EQ(0, stat(cache.file.c_str(), &st));
+    env.debug_log.clear();
+
+    // Same process, warm in-memory cache
+    auto warm = average_create_instance(env, 10);
+    stats = logged_cache_stats(env.debug_log);
+    ASSERT_GT(stats.hits, cache_test_layer_count);
+    ASSERT_EQ(stats.misses, 0U);
+    env.debug_log.clear();
+
+    // Fresh mapping of the file written by the first run
+    cache.reload();
+    auto mapped = timed_create_instance(env);
+    ASSERT_TRUE(env.debug_log.find("Loaded manifest cache"));
+    stats = logged_cache_stats(env.debug_log);
+    ASSERT_GT(stats.hits, cache_test_layer_count);
+    ASSERT_EQ(stats.misses, 0U);
+    env.debug_log.clear();
+
+    // Without the cache, for comparison
+    cache.env_var.set_new_value("0");
+    auto disabled = average_create_instance(env, 10);
+    cache.env_var.set_new_value(cache.file.str());
+
+    std::cout << "Manifest scan with " << cache_test_layer_count << " layer manifests: uncached " << uncached.count()
+              << "us, cache disabled " << disabled.count() << "us, warm " << warm.count() << "us, freshly mapped "
+              << mapped.count() << "us\n";
+
+    auto layers = env.GetLayerProperties(cache_test_layer_count);
+    for (uint32_t i = 0; i < cache_test_layer_count; i++) {
+        ASSERT_TRUE(string_eq(layers[i].layerName, cache_test_layer_name(i).c_str()));
+    }
+}
+
+TEST(ManifestCache, ChangedManifestsAreRescanned) {
+    FrameworkEnvironment env{};
+    env.add_icd(TestICDDetails(TEST_ICD_PATH_VERSION_2)).add_physical_device({});
+    add_cache_test_layers(env, 0, 100);
+    backdate_search_folders(env);
+
+    ManifestCacheFile cache;
+    cache.env_functions = &env.vulkan_functions;
+    timed_create_instance(env);
+    cache.reload();
+    env.GetLayerProperties(100);
+
+    // A manifest rewritten with a longer layer name changes size
+    auto& folder = env.get_folder(ManifestLocation::explicit_layer);
+    folder.write_manifest(cache_test_layer_name(7) + ".json",
+                          ManifestLayer{}
+                              .add_layer(ManifestLayer::LayerDescription{}
+                                             .set_name("VK_LAYER_manifest_cache_test_renamed")
+                                             .set_lib_path(TEST_LAYER_PATH_EXPORT_VERSION_2))
+                              .get_manifest_str());
+    // A new manifest changes the folder
+    add_cache_test_layers(env, 100, 1);
+    backdate_search_folders(env);
+
+    auto layers = env.GetLayerProperties(101);
+    bool found_renamed = false, found_new = false, found_old = false;
+    for (auto const& layer : layers) {
+        found_renamed |= string_eq(layer.layerName, "VK_LAYER_manifest_cache_test_renamed");
+        found_new |= string_eq(layer.layerName, cache_test_layer_name(100).c_str());
+        found_old |= string_eq(layer.layerName, cache_test_layer_name(7).c_str());
+    }
+    ASSERT_TRUE(found_renamed);
+    ASSERT_TRUE(found_new);
+    ASSERT_FALSE(found_old);
+
+    // A removed manifest disappears even though everything else still hits the cache
+    folder.remove(cache_test_layer_name(3) + ".json");
+    backdate_search_folders(env);
+    layers = env.GetLayerProperties(100);
+    for (auto const& layer : layers) {
+        ASSERT_FALSE(string_eq(layer.layerName, cache_test_layer_name(3).c_str()));
+    }
+}
+
+TEST(ManifestCache, CorruptCacheFileIsIgnored) {
+    FrameworkEnvironment env{};
+    env.add_icd(TestICDDetails(TEST_ICD_PATH_VERSION_2)).add_physical_device({});
+    add_cache_test_layers(env, 0, 20);
+    backdate_search_folders(env);
+
+    ManifestCacheFile cache;
+    cache.env_functions = &env.vulkan_functions;
+    timed_create_instance(env);
+
+    // Flip bytes all through the file; the loader must fall back to a normal scan
+    int fd = open(cache.file.c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    struct stat st;
+    ASSERT_EQ(0, fstat(fd, &st));
+    std::vector<char> contents(static_cast<size_t>(st.st_size));
+    ASSERT_EQ(st.st_size, pread(fd, contents.data(), contents.size(), 0));
+    for (size_t i = 16; i < contents.size(); i += 37) contents[i] = static_cast<char>(~contents[i]);
+    ASSERT_EQ(st.st_size, pwrite(fd, contents.data(), contents.size(), 0));
+    close(fd);
+    cache.reload();
+
+    auto layers = env.GetLayerProperties(20);
+    for (uint32_t i = 0; i < 20; i++) {
+        ASSERT_TRUE(string_eq(layers[i].layerName, cache_test_layer_name(i).c_str()));
+    }
+}
+
+#endif  // COMMON_UNIX_PLATFORMS
@@ -0,0 +1,808 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and/or associated documentation files (the "Materials"), to
+ * deal in the Materials without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Materials, and to permit persons to whom the Materials are
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice(s) and this permission notice shall be included in
+ * all copies or substantial portions of the Materials.
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ *
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE MATERIALS OR THE
+ * USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+// Startup and per-frame benchmark for the launcher's Vulkan chain.
+//
+// Drives vkCreateInstance -> device -> headless surface -> swapchain -> N presents -> teardown through each available
+// chain and prints per-stage timings and heap allocation counts as JSON:
+//   icd    loader + mock ICD
+//   layer  loader + VK_LAYER_HEADLESS_surface + mock ICD
+//   full   loader + VK_LAYER_HEADLESS_surface + FEX thunk ICD shim, with the mock ICD standing in for the FEX thunk
+//          (ICD_THUNK_LIB)
+// The mock ICD is the test framework's, plus the resource, sync and present entry points the layer and the shim call
+// during startup and per frame. Images have no contents, so the per-frame numbers cover the chain's own work (the
+// layer's readback bookkeeping and frame transport copy) and not any GPU work.
+//
+// Usage: test_startup_benchmark [--frames N] [--runs N] [--extent WxH] [--chain icd|layer|full]... [--output file.json]
+
+#include "test_environment.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+
+#include <malloc.h>
+
+// Heap allocation counting. Every malloc in the process goes through here, including the loader's, the layer's and
+// the ICDs', so a stage's counts cover the whole chain.
+#if defined(__GLIBC__)
+#define BENCHMARK_COUNTS_ALLOCATIONS 1
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+static std::atomic<uint64_t> allocation_count{0};
+static std::atomic<uint64_t> allocated_bytes{0};
+static std::atomic<uint64_t> free_count{0};
+
+static inline void count_allocation(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" {
+void* malloc(size_t size) {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) {
+    count_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+void* realloc(void* ptr, size_t size) {
+    count_allocation(size);
+    return __libc_realloc(ptr, size);
+}
+void* memalign(size_t alignment, size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+void* aligned_alloc(size_t alignment, size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    count_allocation(size);
+    void* mem = __libc_memalign(alignment, size);
+    if (mem == nullptr) return ENOMEM;
+    *ptr = mem;
+    return 0;
+}
+void free(void* ptr) {
+    if (ptr == nullptr) return;
+    free_count.fetch_add(1, std::memory_order_relaxed);
+    __libc_free(ptr);
+}
+}
+#else
+#define BENCHMARK_COUNTS_ALLOCATIONS 0
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct AllocationCounters {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    uint64_t frees = 0;
+};
+
+AllocationCounters read_allocation_counters() {
+    AllocationCounters counters;
+#if BENCHMARK_COUNTS_ALLOCATIONS
+    counters.allocations = allocation_count.load(std::memory_order_relaxed);
+    counters.bytes = allocated_bytes.load(std::memory_order_relaxed);
+    counters.frees = free_count.load(std::memory_order_relaxed);
+#endif
+    return counters;
+}
+
+struct Sample {
+    uint64_t ns = 0;
+    AllocationCounters allocations;
+};
+
+// Time and allocations from construction to finish()
+struct Measurement {
+    Clock::time_point start = Clock::now();
+    AllocationCounters start_counters = read_allocation_counters();
+
+    Sample finish() const {
+        auto end_counters = read_allocation_counters();
+        Sample sample;
+        sample.ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        sample.allocations.allocations = end_counters.allocations - start_counters.allocations;
+        sample.allocations.bytes = end_counters.bytes - start_counters.bytes;
+        sample.allocations.frees = end_counters.frees - start_counters.frees;
+        return sample;
+    }
+};
+
+void check(VkResult result, const char* what) {
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(std::string(what) + " failed: " + std::to_string(static_cast<int>(result)));
+    }
+}
+
+// Entry points the test ICD doesn't implement, registered as device functions of the mock physical device. Non
+// dispatchable handles are plain pointers (64-bit only, see CMakeLists.txt).
+namespace mock {
+
+struct Resource {
+    VkDeviceSize size = 0;
+};
+
+struct Memory {
+    std::unique_ptr<uint8_t[]> data;
+};
+
+std::atomic<uint64_t> next_sync_handle{0x5000};
+std::atomic<uint32_t> next_image_index{0};
+uint32_t swapchain_image_count = 1;
+
+template <typename T>
+T to_handle(void* ptr) {
+    return reinterpret_cast<T>(ptr);
+}
+template <typename T>
+T new_sync_handle() {
+    return reinterpret_cast<T>(next_sync_handle.fetch_add(8, std::memory_order_relaxed));
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateImage(VkDevice, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks*,
+                                           VkImage* pImage) {
+    auto* image = new Resource;
+    image->size = static_cast<VkDeviceSize>(pCreateInfo->extent.width) * pCreateInfo->extent.height *
+                  pCreateInfo->extent.depth * pCreateInfo->arrayLayers * 4;
+    *pImage = to_handle<VkImage>(image);
+    return VK_SUCCESS;
+}
+VKAPI_ATTR void VKAPI_CALL DestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*) {
+    delete reinterpret_cast<Resource*>(image);
+}
+VKAPI_ATTR void VKAPI_CALL GetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* pMemoryRequirements) {
+    pMemoryRequirements->size = reinterpret_cast<Resource*>(image)->size;
+    pMemoryRequirements->alignment = 256;
+    pMemoryRequirements->memoryTypeBits = 0x3;
+}
+VKAPI_ATTR VkResult VKAPI_CALL BindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize) { return VK_SUCCESS; }
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateBuffer(VkDevice, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks*,
+                                            VkBuffer* pBuffer) {
+    auto* buffer = new Resource;
+    buffer->size = pCreateInfo->size;
+    *pBuffer = to_handle<VkBuffer>(buffer);
+    return VK_SUCCESS;
+}
+VKAPI_ATTR void VKAPI_CALL DestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*) {
+    delete reinterpret_cast<Resource*>(buffer);
+}
+VKAPI_ATTR void VKAPI_CALL GetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements) {
+    pMemoryRequirements->size = reinterpret_cast<Resource*>(buffer)->size;
+    pMemoryRequirements->alignment = 256;
+    pMemoryRequirements->memoryTypeBits = 0x3;
+}
+VKAPI_ATTR VkResult VKAPI_CALL BindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize) { return VK_SUCCESS; }
+
+VKAPI_ATTR VkResult VKAPI_CALL AllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks*,
+                                              VkDeviceMemory* pMemory) {
+    auto* memory = new Memory;
+    memory->data.reset(new uint8_t[pAllocateInfo->allocationSize]);
+    *pMemory = to_handle<VkDeviceMemory>(memory);
+    return VK_SUCCESS;
+}
+VKAPI_ATTR void VKAPI_CALL FreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+    delete reinterpret_cast<Memory*>(memory);
+}
+VKAPI_ATTR VkResult VKAPI_CALL MapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize, VkMemoryMapFlags,
+                                         void** ppData) {
+    *ppData = reinterpret_cast<Memory*>(memory)->data.get() + offset;
+    return VK_SUCCESS;
+}
+VKAPI_ATTR void VKAPI_CALL UnmapMemory(VkDevice, VkDeviceMemory) {}
+VKAPI_ATTR VkResult VKAPI_CALL FlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*) { return VK_SUCCESS; }
+
+VKAPI_ATTR VkResult VKAPI_CALL CreateFence(VkDevice, const VkFenceCreateInfo*, const VkAllocationCallbacks*, VkFence* pFence) {
+    *pFence = new_sync_handle<VkFence>();
+    return VK_SUCCESS;
+}
+VKAPI_ATTR void VKAPI_CALL DestroyFence(VkDevice, VkFence, const VkAllocationCallbacks*) {}
+VKAPI_ATTR VkResult VKAPI_CALL ResetFences(VkDevice, uint32_t, const VkFence*) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL WaitForFences(VkDevice, uint32_t, const VkFence*, VkBool32, uint64_t) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL GetFenceStatus(VkDevice, VkFence) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL CreateSemaphore(VkDevice, const VkSemaphoreCreateInfo*, const VkAllocationCallbacks*,
+                                               VkSemaphore* pSemaphore) {
+    *pSemaphore = new_sync_handle<VkSemaphore>();
+    return VK_SUCCESS;
+}
+VKAPI_ATTR void VKAPI_CALL DestroySemaphore(VkDevice, VkSemaphore, const VkAllocationCallbacks*) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL QueueSubmit(VkQueue, uint32_t, const VkSubmitInfo*, VkFence) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL QueueWaitIdle(VkQueue) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL DeviceWaitIdle(VkDevice) { return VK_SUCCESS; }
+
+VKAPI_ATTR VkResult VKAPI_CALL ResetCommandBuffer(VkCommandBuffer, VkCommandBufferResetFlags) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL BeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo*) { return VK_SUCCESS; }
+VKAPI_ATTR VkResult VKAPI_CALL EndCommandBuffer(VkCommandBuffer) { return VK_SUCCESS; }
+VKAPI_ATTR void VKAPI_CALL FreeCommandBuffers(VkDevice, VkCommandPool, uint32_t, const VkCommandBuffer*) {}
+VKAPI_ATTR void VKAPI_CALL CmdPipelineBarrier(VkCommandBuffer, VkPipelineStageFlags, VkPipelineStageFlags, VkDependencyFlags,
+                                              uint32_t, const VkMemoryBarrier*, uint32_t, const VkBufferMemoryBarrier*, uint32_t,
+                                              const VkImageMemoryBarrier*) {}
+VKAPI_ATTR void VKAPI_CALL CmdCopyImageToBuffer(VkCommandBuffer, VkImage, VkImageLayout, VkBuffer, uint32_t,
+                                                const VkBufferImageCopy*) {}
+
+// Only reached when no layer owns the swapchain (the icd chain)
+VKAPI_ATTR VkResult VKAPI_CALL AcquireNextImageKHR(VkDevice, VkSwapchainKHR, uint64_t, VkSemaphore, VkFence,
+                                                   uint32_t* pImageIndex) {
+    *pImageIndex = next_image_index.fetch_add(1, std::memory_order_relaxed) % swapchain_image_count;
+    return VK_SUCCESS;
+}
+VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue, const VkPresentInfoKHR*) { return VK_SUCCESS; }
+
+#define MOCK_FUNCTION(name) VulkanFunction{"vk" #name, to_vkVoidFunction(name)}
+
+void add_device_functions(PhysicalDevice& phys_dev) {
+    phys_dev.add_device_functions({
+        MOCK_FUNCTION(CreateImage),
+        MOCK_FUNCTION(DestroyImage),
+        MOCK_FUNCTION(GetImageMemoryRequirements),
+        MOCK_FUNCTION(BindImageMemory),
+        MOCK_FUNCTION(CreateBuffer),
+        MOCK_FUNCTION(DestroyBuffer),
+        MOCK_FUNCTION(GetBufferMemoryRequirements),
+        MOCK_FUNCTION(BindBufferMemory),
+        MOCK_FUNCTION(AllocateMemory),
+        MOCK_FUNCTION(FreeMemory),
+        MOCK_FUNCTION(MapMemory),
+        MOCK_FUNCTION(UnmapMemory),
+        MOCK_FUNCTION(FlushMappedMemoryRanges),
+        VulkanFunction{"vkInvalidateMappedMemoryRanges", to_vkVoidFunction(FlushMappedMemoryRanges)},
+        MOCK_FUNCTION(CreateFence),
+        MOCK_FUNCTION(DestroyFence),
+        MOCK_FUNCTION(ResetFences),
+        MOCK_FUNCTION(WaitForFences),
+        MOCK_FUNCTION(GetFenceStatus),
+        MOCK_FUNCTION(CreateSemaphore),
+        MOCK_FUNCTION(DestroySemaphore),
+        MOCK_FUNCTION(QueueSubmit),
+        MOCK_FUNCTION(QueueWaitIdle),
+        MOCK_FUNCTION(DeviceWaitIdle),
+        MOCK_FUNCTION(ResetCommandBuffer),
+        MOCK_FUNCTION(BeginCommandBuffer),
+        MOCK_FUNCTION(EndCommandBuffer),
+        MOCK_FUNCTION(FreeCommandBuffers),
+        MOCK_FUNCTION(CmdPipelineBarrier),
+        MOCK_FUNCTION(CmdCopyImageToBuffer),
+        MOCK_FUNCTION(AcquireNextImageKHR),
+        MOCK_FUNCTION(QueuePresentKHR),
+    });
+}
+
+#undef MOCK_FUNCTION
+
+}  // namespace mock
+
+// One GPU with a single graphics queue, a device-local and a host-visible memory type, and headless presentation
+void setup_mock_icd(TestICD& icd, VkExtent2D extent) {
+    icd.set_icd_api_version(VK_API_VERSION_1_3);
+    icd.set_min_icd_interface_version(3);
+    icd.set_enable_icd_wsi(true);
+    icd.add_instance_extensions({"VK_KHR_surface", "VK_EXT_headless_surface", "VK_KHR_get_physical_device_properties2"});
+
+    icd.add_physical_device({});
+    auto& phys_dev = icd.physical_devices.back();
+    phys_dev.set_api_version(VK_API_VERSION_1_3);
+    phys_dev.set_deviceName("startup benchmark mock GPU");
+    phys_dev.add_queue_family_properties(
+        MockQueueFamilyProperties{}
+            .set_properties(VkQueueFamilyProperties{VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, 1, 0, {1, 1, 1}})
+            .set_support_present(true));
+    phys_dev.add_extension("VK_KHR_swapchain");
+
+    VkPhysicalDeviceMemoryProperties memory_properties{};
+    memory_properties.memoryTypeCount = 2;
+    memory_properties.memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+    memory_properties.memoryTypes[1] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1};
+    memory_properties.memoryHeapCount = 2;
+    memory_properties.memoryHeaps[0] = {4ULL << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+    memory_properties.memoryHeaps[1] = {2ULL << 30, 0};
+    phys_dev.set_memory_properties(memory_properties);
+
+    VkSurfaceCapabilitiesKHR capabilities{};
+    capabilities.minImageCount = 2;
+    capabilities.maxImageCount = 8;
+    capabilities.currentExtent = extent;
+    capabilities.minImageExtent = {1, 1};
+    capabilities.maxImageExtent = {16384, 16384};
+    capabilities.maxImageArrayLayers = 1;
+    capabilities.supportedTransforms = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    capabilities.currentTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    capabilities.supportedCompositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    capabilities.supportedUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    phys_dev.set_surface_capabilities(capabilities);
+    phys_dev.add_surface_format(VkSurfaceFormatKHR{VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR});
+    phys_dev.add_surface_present_modes({VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR});
+
+    mock::add_device_functions(phys_dev);
+}
+
+struct Options {
+    uint32_t frames = 300;
+    uint32_t runs = 5;
+    VkExtent2D extent{1280, 720};
+    std::vector<std::string> chains;
+    std::string output;
+};
+
+struct ChainDescription {
+    const char* name;
+    bool headless_layer;
+    bool fex_thunk_icd;
+};
+
+const ChainDescription all_chains[] = {
+    {"icd", false, false},
+    {"layer", true, false},
+    {"full", true, true},
+};
+
+bool chain_available(ChainDescription const& chain) {
+#if !defined(HEADLESS_LAYER_PATH)
+    if (chain.headless_layer) return false;
+#endif
+#if !defined(FEX_THUNK_ICD_PATH)
+    if (chain.fex_thunk_icd) return false;
+#endif
+    (void)chain;
+    return true;
+}
+
+const char* const stage_names[] = {
+    "create_instance", "enumerate_physical_devices", "create_device", "create_surface", "create_swapchain", "first_present",
+    "teardown",
+};
+enum Stage {
+    stage_create_instance,
+    stage_enumerate_physical_devices,
+    stage_create_device,
+    stage_create_surface,
+    stage_create_swapchain,
+    stage_first_present,
+    stage_teardown
+};
+const size_t stage_count = sizeof(stage_names) / sizeof(stage_names[0]);
+
+struct RunResult {
+    Sample stages[stage_count];
+    Sample time_to_first_present;
+    std::vector<Sample> frames;  // acquire + present of every frame after the first
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    uint32_t swapchain_images = 0;
+};
+
+struct ChainDeviceFunctions {
+    PFN_vkGetDeviceQueue GetDeviceQueue;
+    PFN_vkCreateSwapchainKHR CreateSwapchainKHR;
+    PFN_vkGetSwapchainImagesKHR GetSwapchainImagesKHR;
+    PFN_vkAcquireNextImageKHR AcquireNextImageKHR;
+    PFN_vkQueuePresentKHR QueuePresentKHR;
+    PFN_vkDestroySwapchainKHR DestroySwapchainKHR;
+    PFN_vkCreateSemaphore CreateSemaphore;
+    PFN_vkDestroySemaphore DestroySemaphore;
+    PFN_vkDeviceWaitIdle DeviceWaitIdle;
+};
+
+// Mirrors an application's startup: everything up to the first present is timed stage by stage, the remaining frames
+// individually, then the whole chain is torn down again
+RunResult run_chain(FrameworkEnvironment& env, Options const& options) {
+    RunResult result;
+    VulkanFunctions& vk = env.vulkan_functions;
+    Measurement startup;
+
+    Measurement stage;
+    VkApplicationInfo app_info{VK_STRUCTURE_TYPE_APPLICATION_INFO};
+    app_info.pApplicationName = "startup_benchmark";
+    app_info.apiVersion = VK_API_VERSION_1_3;
+    const char* instance_extensions[] = {"VK_KHR_surface", "VK_EXT_headless_surface"};
+    VkInstanceCreateInfo instance_info{VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO};
+    instance_info.pApplicationInfo = &app_info;
+    instance_info.enabledExtensionCount = 2;
+    instance_info.ppEnabledExtensionNames = instance_extensions;
+    VkInstance instance = VK_NULL_HANDLE;
+    check(vk.vkCreateInstance(&instance_info, nullptr, &instance), "vkCreateInstance");
+    result.stages[stage_create_instance] = stage.finish();
+
+    stage = Measurement{};
+    uint32_t phys_dev_count = 1;
+    VkPhysicalDevice phys_dev = VK_NULL_HANDLE;
+    VkResult enumerate_result = vk.vkEnumeratePhysicalDevices(instance, &phys_dev_count, &phys_dev);
+    if (enumerate_result == VK_INCOMPLETE) enumerate_result = VK_SUCCESS;
+    check(enumerate_result, "vkEnumeratePhysicalDevices");
+    result.stages[stage_enumerate_physical_devices] = stage.finish();
+
+    stage = Measurement{};
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_info{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+    queue_info.queueFamilyIndex = 0;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    const char* device_extensions[] = {"VK_KHR_swapchain"};
+    VkDeviceCreateInfo device_info{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    device_info.enabledExtensionCount = 1;
+    device_info.ppEnabledExtensionNames = device_extensions;
+    VkDevice device = VK_NULL_HANDLE;
+    check(vk.vkCreateDevice(phys_dev, &device_info, nullptr, &device), "vkCreateDevice");
+    ChainDeviceFunctions dev{};
+    dev.GetDeviceQueue = vk.load(device, "vkGetDeviceQueue");
+    dev.CreateSwapchainKHR = vk.load(device, "vkCreateSwapchainKHR");
+    dev.GetSwapchainImagesKHR = vk.load(device, "vkGetSwapchainImagesKHR");
+    dev.AcquireNextImageKHR = vk.load(device, "vkAcquireNextImageKHR");
+    dev.QueuePresentKHR = vk.load(device, "vkQueuePresentKHR");
+    dev.DestroySwapchainKHR = vk.load(device, "vkDestroySwapchainKHR");
+    dev.CreateSemaphore = vk.load(device, "vkCreateSemaphore");
+    dev.DestroySemaphore = vk.load(device, "vkDestroySemaphore");
+    dev.DeviceWaitIdle = vk.load(device, "vkDeviceWaitIdle");
+    VkQueue queue = VK_NULL_HANDLE;
+    dev.GetDeviceQueue(device, 0, 0, &queue);
+    result.stages[stage_create_device] = stage.finish();
+
+    stage = Measurement{};
+    PFN_vkCreateHeadlessSurfaceEXT CreateHeadlessSurfaceEXT = vk.load(instance, "vkCreateHeadlessSurfaceEXT");
+    PFN_vkDestroySurfaceKHR DestroySurfaceKHR = vk.load(instance, "vkDestroySurfaceKHR");
+    if (CreateHeadlessSurfaceEXT == nullptr) throw std::runtime_error("vkCreateHeadlessSurfaceEXT not found");
+    VkHeadlessSurfaceCreateInfoEXT surface_info{VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT};
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    check(CreateHeadlessSurfaceEXT(instance, &surface_info, nullptr, &surface), "vkCreateHeadlessSurfaceEXT");
+    result.stages[stage_create_surface] = stage.finish();
+
+    stage = Measurement{};
+    PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR GetSurfaceCapabilities =
+        vk.load(instance, "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+    PFN_vkGetPhysicalDeviceSurfacePresentModesKHR GetSurfacePresentModes =
+        vk.load(instance, "vkGetPhysicalDeviceSurfacePresentModesKHR");
+    VkSurfaceCapabilitiesKHR capabilities{};
+    check(GetSurfaceCapabilities(phys_dev, surface, &capabilities), "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+    uint32_t mode_count = 0;
+    check(GetSurfacePresentModes(phys_dev, surface, &mode_count, nullptr), "vkGetPhysicalDeviceSurfacePresentModesKHR");
+    std::vector<VkPresentModeKHR> modes(mode_count);
+    check(GetSurfacePresentModes(phys_dev, surface, &mode_count, modes.data()), "vkGetPhysicalDeviceSurfacePresentModesKHR");
+    // Unpaced presents where the chain offers them, so the frame numbers measure the chain rather than a vsync interval
+    if (std::find(modes.begin(), modes.end(), VK_PRESENT_MODE_IMMEDIATE_KHR) != modes.end()) {
+        result.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    }
+
+    VkSwapchainCreateInfoKHR swapchain_info{VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
+    swapchain_info.surface = surface;
+    swapchain_info.minImageCount = std::max(3U, capabilities.minImageCount);
+    if (capabilities.maxImageCount != 0) swapchain_info.minImageCount = std::min(swapchain_info.minImageCount, capabilities.maxImageCount);
+    swapchain_info.imageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    swapchain_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    swapchain_info.imageExtent = options.extent;
+    swapchain_info.imageArrayLayers = 1;
+    swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    swapchain_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapchain_info.presentMode = result.present_mode;
+    swapchain_info.clipped = VK_TRUE;
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    check(dev.CreateSwapchainKHR(device, &swapchain_info, nullptr, &swapchain), "vkCreateSwapchainKHR");
+    check(dev.GetSwapchainImagesKHR(device, swapchain, &result.swapchain_images, nullptr), "vkGetSwapchainImagesKHR");
+    std::vector<VkImage> images(result.swapchain_images);
+    check(dev.GetSwapchainImagesKHR(device, swapchain, &result.swapchain_images, images.data()), "vkGetSwapchainImagesKHR");
+    mock::swapchain_image_count = result.swapchain_images;
+    VkSemaphoreCreateInfo semaphore_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VkSemaphore acquire_semaphore = VK_NULL_HANDLE;
+    check(dev.CreateSemaphore(device, &semaphore_info, nullptr, &acquire_semaphore), "vkCreateSemaphore");
+    result.stages[stage_create_swapchain] = stage.finish();
+
+    auto present_frame = [&]() {
+        uint32_t image_index = 0;
+        check(dev.AcquireNextImageKHR(device, swapchain, UINT64_MAX, acquire_semaphore, VK_NULL_HANDLE, &image_index),
+              "vkAcquireNextImageKHR");
+        VkPresentInfoKHR present_info{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+        present_info.waitSemaphoreCount = 1;
+        present_info.pWaitSemaphores = &acquire_semaphore;
+        present_info.swapchainCount = 1;
+        present_info.pSwapchains = &swapchain;
+        present_info.pImageIndices = &image_index;
+        check(dev.QueuePresentKHR(queue, &present_info), "vkQueuePresentKHR");
+    };
+
+    stage = Measurement{};
+    present_frame();
+    result.stages[stage_first_present] = stage.finish();
+    result.time_to_first_present = startup.finish();
+
+    result.frames.reserve(options.frames);
+    for (uint32_t i = 1; i < options.frames; i++) {
+        Measurement frame;
+        present_frame();
+        result.frames.push_back(frame.finish());
+    }
+
+    stage = Measurement{};
+    check(dev.DeviceWaitIdle(device), "vkDeviceWaitIdle");
+    dev.DestroySemaphore(device, acquire_semaphore, nullptr);
+    dev.DestroySwapchainKHR(device, swapchain, nullptr);
+    DestroySurfaceKHR(instance, surface, nullptr);
+    vk.vkDestroyDevice(device, nullptr);
+    vk.vkDestroyInstance(instance, nullptr);
+    result.stages[stage_teardown] = stage.finish();
+    return result;
+}
+
+template <typename T>
+T median_of(std::vector<T> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+void write_samples(JsonWriter& writer, std::string const& key, std::vector<Sample> const& samples) {
+    std::vector<uint64_t> ns, allocations, bytes, frees;
+    for (auto const& sample : samples) {
+        ns.push_back(sample.ns);
+        allocations.push_back(sample.allocations.allocations);
+        bytes.push_back(sample.allocations.bytes);
+        frees.push_back(sample.allocations.frees);
+    }
+    writer.StartKeyedObject(key);
+    writer.AddKeyedInteger("median_ns", median_of(ns));
+    writer.AddKeyedInteger("min_ns", *std::min_element(ns.begin(), ns.end()));
+    writer.AddKeyedInteger("max_ns", *std::max_element(ns.begin(), ns.end()));
+    writer.AddKeyedInteger("allocations", median_of(allocations));
+    writer.AddKeyedInteger("allocated_bytes", median_of(bytes));
+    writer.AddKeyedInteger("frees", median_of(frees));
+    writer.EndObject();
+}
+
+// Frame statistics over every run's frames; allocation counts are totals so per-frame rates stay exact
+void write_frames(JsonWriter& writer, std::vector<RunResult> const& runs) {
+    std::vector<uint64_t> ns;
+    AllocationCounters totals;
+    uint64_t total_ns = 0;
+    for (auto const& run : runs) {
+        for (auto const& frame : run.frames) {
+            ns.push_back(frame.ns);
+            total_ns += frame.ns;
+            totals.allocations += frame.allocations.allocations;
+            totals.bytes += frame.allocations.bytes;
+            totals.frees += frame.allocations.frees;
+        }
+    }
+    writer.StartKeyedObject("present");
+    writer.AddKeyedInteger("frames", ns.size());
+    if (!ns.empty()) {
+        std::sort(ns.begin(), ns.end());
+        writer.AddKeyedInteger("median_ns", ns[ns.size() / 2]);
+        writer.AddKeyedInteger("mean_ns", total_ns / ns.size());
+        writer.AddKeyedInteger("min_ns", ns.front());
+        writer.AddKeyedInteger("p99_ns", ns[std::min(ns.size() - 1, ns.size() * 99 / 100)]);
+        writer.AddKeyedInteger("max_ns", ns.back());
+    }
+    writer.AddKeyedInteger("allocations", totals.allocations);
+    writer.AddKeyedInteger("allocated_bytes", totals.bytes);
+    writer.AddKeyedInteger("frees", totals.frees);
+    writer.EndObject();
+}
+
+const char* present_mode_name(VkPresentModeKHR mode) {
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+        default: return "other";
+    }
+}
+
+void benchmark_chain(ChainDescription const& chain, Options const& options, JsonWriter& writer) {
+    FrameworkEnvironment env{FrameworkSettings{}.set_log_filter("error")};
+
+    // The full chain loads the shim as the driver and the mock ICD as the shim's FEX thunk, so the mock is set up through
+    // its own library handle instead of env.add_icd
+    std::unique_ptr<LibraryWrapper> mock_icd_library;
+    std::unique_ptr<EnvVarWrapper> thunk_lib_env_var;
+    TestICD* icd = nullptr;
+    std::vector<std::string> components{"loader"};
+    if (chain.headless_layer) components.push_back("VK_LAYER_HEADLESS_surface");
+#if defined(FEX_THUNK_ICD_PATH)
+    if (chain.fex_thunk_icd) {
+        mock_icd_library = std::make_unique<LibraryWrapper>(fs::path(TEST_ICD_PATH_EXPORT_NONE));
+        GetNewTestICDFunc reset_icd = mock_icd_library->get_symbol(RESET_ICD_FUNC_STR);
+        icd = reset_icd();
+        thunk_lib_env_var = std::make_unique<EnvVarWrapper>("ICD_THUNK_LIB", TEST_ICD_PATH_EXPORT_NONE);
+        env.get_folder(ManifestLocation::driver)
+            .write_manifest("fex_thunk_icd.json",
+                            ManifestICD{}.set_lib_path(FEX_THUNK_ICD_PATH).set_api_version(VK_API_VERSION_1_3).get_manifest_str());
+        components.push_back("fex_thunk_icd");
+    }
+#endif
+    if (icd == nullptr) icd = &env.add_icd(TestICDDetails(TEST_ICD_PATH_VERSION_2, VK_API_VERSION_1_3));
+    components.push_back("mock_icd");
+    setup_mock_icd(*icd, options.extent);
+
+#if defined(HEADLESS_LAYER_PATH)
+    if (chain.headless_layer) {
+        // Same layer description as app/src/main/assets/VK_LAYER_HEADLESS_surface.json
+        env.get_folder(ManifestLocation::implicit_layer)
+            .write_manifest("VK_LAYER_HEADLESS_surface.json",
+                            ManifestLayer{}
+                                .add_layer(ManifestLayer::LayerDescription{}
+                                               .set_name("VK_LAYER_HEADLESS_surface")
+                                               .set_type(ManifestLayer::LayerDescription::Type::GLOBAL)
+                                               .set_lib_path(HEADLESS_LAYER_PATH)
+                                               .set_api_version(VK_API_VERSION_1_3)
+                                               .set_implementation_version(1)
+                                               .add_instance_extensions({{"VK_KHR_surface", 25},
+                                                                         {"VK_KHR_xcb_surface", 6},
+                                                                         {"VK_KHR_xlib_surface", 6},
+                                                                         {"VK_EXT_headless_surface", 1}})
+                                               .add_device_extension({"VK_KHR_swapchain", 70})
+                                               .set_disable_environment("DISABLE_HEADLESS_LAYER"))
+                                .get_manifest_str());
+    }
+#endif
+
+    std::vector<RunResult> runs;
+    for (uint32_t i = 0; i < options.runs; i++) {
+        runs.push_back(run_chain(env, options));
+    }
+
+    writer.StartObject();
+    writer.AddKeyedString("name", chain.name);
+    writer.StartKeyedArray("components");
+    for (auto const& component : components) writer.AddString(component);
+    writer.EndArray();
+    writer.AddKeyedString("present_mode", present_mode_name(runs.front().present_mode));
+    writer.AddKeyedInteger("swapchain_images", runs.front().swapchain_images);
+    writer.StartKeyedObject("stages");
+    for (size_t s = 0; s < stage_count; s++) {
+        std::vector<Sample> samples;
+        for (auto const& run : runs) samples.push_back(run.stages[s]);
+        write_samples(writer, stage_names[s], samples);
+    }
+    writer.EndObject();
+    std::vector<Sample> startup;
+    for (auto const& run : runs) startup.push_back(run.time_to_first_present);
+    write_samples(writer, "time_to_first_present", startup);
+    write_frames(writer, runs);
+    writer.EndObject();
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--frames" && value) {
+            options.frames = static_cast<uint32_t>(std::max(1L, std::strtol(value, nullptr, 10)));
+        } else if (arg == "--runs" && value) {
+            options.runs = static_cast<uint32_t>(std::max(1L, std::strtol(value, nullptr, 10)));
+        } else if (arg == "--extent" && value) {
+            unsigned width = 0, height = 0;
+            if (sscanf(value, "%ux%u", &width, &height) != 2 || width == 0 || height == 0) return false;
+            options.extent = {width, height};
+        } else if (arg == "--chain" && value) {
+            options.chains.push_back(value);
+        } else if (arg == "--output" && value) {
+            options.output = value;
+        } else {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--frames N] [--runs N] [--extent WxH] [--chain icd|layer|full]... [--output file.json]\n";
+        return 2;
+    }
+
+    // Same isolation as the test executables: nothing from the host's Vulkan setup may leak into the measured chain
+    EnvVarWrapper vk_icd_filenames_env_var{"VK_ICD_FILENAMES"};
+    EnvVarWrapper vk_driver_files_env_var{"VK_DRIVER_FILES"};
+    EnvVarWrapper vk_add_driver_files_env_var{"VK_ADD_DRIVER_FILES"};
+    EnvVarWrapper vk_layer_path_env_var{"VK_LAYER_PATH"};
+    EnvVarWrapper vk_add_layer_path_env_var{"VK_ADD_LAYER_PATH"};
+    EnvVarWrapper vk_instance_layers_env_var{"VK_INSTANCE_LAYERS"};
+    EnvVarWrapper vk_loader_drivers_select_env_var{"VK_LOADER_DRIVERS_SELECT"};
+    EnvVarWrapper vk_loader_drivers_disable_env_var{"VK_LOADER_DRIVERS_DISABLE"};
+    EnvVarWrapper vk_loader_layers_enable_env_var{"VK_LOADER_LAYERS_ENABLE"};
+    EnvVarWrapper vk_loader_layers_disable_env_var{"VK_LOADER_LAYERS_DISABLE"};
+    EnvVarWrapper vk_loader_disable_inst_ext_filter_env_var{"VK_LOADER_DISABLE_INST_EXT_FILTER"};
+    EnvVarWrapper vk_loader_manifest_cache_env_var{"VK_LOADER_MANIFEST_CACHE", "0"};
+    EnvVarWrapper disable_headless_layer_env_var{"DISABLE_HEADLESS_LAYER"};
+    EnvVarWrapper xdg_config_home_env_var{"XDG_CONFIG_HOME", ETC_DIR};
+    EnvVarWrapper xdg_config_dirs_env_var{"XDG_CONFIG_DIRS"};
+    EnvVarWrapper xdg_data_home_env_var{"XDG_DATA_HOME"};
+    EnvVarWrapper xdg_data_dirs_env_var{"XDG_DATA_DIRS"};
+    EnvVarWrapper home_env_var{"HOME", HOME_DIR};
+
+    std::vector<ChainDescription> chains;
+    for (auto const& chain : all_chains) {
+        bool selected = options.chains.empty() ||
+                        std::find(options.chains.begin(), options.chains.end(), chain.name) != options.chains.end();
+        if (!selected) continue;
+        if (!chain_available(chain)) {
+            if (!options.chains.empty()) std::cerr << "startup_benchmark: chain '" << chain.name << "' was not built\n";
+            continue;
+        }
+        chains.push_back(chain);
+    }
+    for (auto const& name : options.chains) {
+        bool known = false;
+        for (auto const& chain : all_chains) known |= name == chain.name;
+        if (!known) {
+            std::cerr << "startup_benchmark: unknown chain '" << name << "'\n";
+            return 2;
+        }
+    }
+
+    JsonWriter writer;
+    writer.StartObject();
+    writer.AddKeyedString("benchmark", "vulkan_startup");
+    writer.AddKeyedInteger("frames", options.frames);
+    writer.AddKeyedInteger("runs", options.runs);
+    writer.StartKeyedObject("extent");
+    writer.AddKeyedInteger("width", options.extent.width);
+    writer.AddKeyedInteger("height", options.extent.height);
+    writer.EndObject();
+    writer.AddKeyedBool("counts_allocations", BENCHMARK_COUNTS_ALLOCATIONS != 0);
+    writer.StartKeyedArray("chains");
+    try {
+        for (auto const& chain : chains) benchmark_chain(chain, options, writer);
+    } catch (std::exception const& e) {
+        std::cerr << "startup_benchmark: " << e.what() << "\n";
+        return 1;
+    }
+    writer.EndArray();
+    writer.EndObject();
+    writer.output += "\n";
+
+    if (options.output.empty()) {
+        std::cout << writer.output;
+    } else {
+        std::ofstream out(options.output);
+        out << writer.output;
+        if (!out) {
+            std::cerr << "startup_benchmark: could not write " << options.output << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""
+Decodes the headless Vulkan layer's binary trace ring
+(/tmp/layer_trace.<pid>.bin inside the FEX rootfs).
+
+The layer records every intercepted call (TRACE_FN) and a few per-frame
+trace points into per-thread rings in a MAP_SHARED file, so the contents
+survive a crash. This script merges the rings by timestamp (then global
+sequence number) and prints them as text, oldest first. See "Section 3a: Binary Trace Ring" in
+app/src/main/assets/vulkan_headless_layer.c for the layout.
+
+Usage:
+    python3 decode_layer_trace.py <layer_trace.PID.bin> [options]
+
+Options:
+    --tail N       print only the last N events (default: all)
+    --thread TID   only events from this thread
+    --summary      per-thread and per-name event counts instead of events
+
+Example:
+    adb shell "run-as com.mediatek.steamlauncher cat files/fex-rootfs/Ubuntu_22_04/tmp/layer_trace.1234.bin" > layer_trace.1234.bin
+    python3 decode_layer_trace.py layer_trace.1234.bin --tail 50
+"""
+
+import sys
+import struct
+from collections import Counter
+
+TRACE_MAGIC = 0x52544C48   # "HLTR"
+TRACE_VERSION = 1
+TRACE_FLAG_ABORT = 1
+
+HEADER_FMT = '<8IQ4I8x'    # TraceFileHeader, 64 bytes
+RING_HDR_FMT = '<IIQ'      # TraceRing {tid, reserved, head}
+EVENT_FMT = '<QIIHHI'      # TraceEvent, 24 bytes
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < struct.calcsize(HEADER_FMT):
+        sys.exit(f"{path}: too small for a trace header")
+
+    (magic, version, header_size, name_len, max_names, max_threads,
+     ring_events, pid, start_ns, name_count, thread_count,
+     abort_tid, abort_seq) = struct.unpack_from(HEADER_FMT, data, 0)
+    if magic != TRACE_MAGIC:
+        sys.exit(f"{path}: bad magic 0x{magic:08x}")
+    if version != TRACE_VERSION:
+        sys.exit(f"{path}: unsupported version {version}")
+
+    names = {}
+    off = header_size
+    for i in range(1, min(name_count, max_names)):
+        raw = data[off + i * name_len:off + (i + 1) * name_len]
+        names[i] = raw.split(b'\0', 1)[0].decode('ascii', 'replace')
+
+    ring_hdr = struct.calcsize(RING_HDR_FMT)
+    ev_size = struct.calcsize(EVENT_FMT)
+    ring_size = ring_hdr + ring_events * ev_size
+    rings_off = header_size + max_names * name_len
+
+    events = []
+    wrapped = {}
+    for r in range(min(thread_count, max_threads)):
+        base = rings_off + r * ring_size
+        tid, _, head = struct.unpack_from(RING_HDR_FMT, data, base)
+        count = min(head, ring_events)
+        if head > ring_events:
+            wrapped[tid] = head - ring_events
+        for k in range(head - count, head):
+            slot = base + ring_hdr + (k % ring_events) * ev_size
+            ts, seq, etid, name_id, flags, arg = struct.unpack_from(EVENT_FMT, data, slot)
+            if name_id == 0:
+                continue
+            events.append((seq, ts, etid, name_id, flags, arg))
+
+    # seq is a 32-bit counter; sort by timestamp first so a wrap can't reorder
+    events.sort(key=lambda e: (e[1], e[0]))
+    info = {
+        'pid': pid, 'start_ns': start_ns, 'threads': thread_count,
+        'max_threads': max_threads, 'abort_tid': abort_tid,
+        'abort_seq': abort_seq, 'wrapped': wrapped,
+    }
+    return info, names, events
+
+
+def main():
+    args = sys.argv[1:]
+    if not args or args[0] in ('-h', '--help'):
+        print(__doc__)
+        sys.exit(0 if args else 1)
+
+    path = args[0]
+    tail = None
+    thread = None
+    summary = False
+    i = 1
+    while i < len(args):
+        if args[i] == '--tail' and i + 1 < len(args):
+            tail = int(args[i + 1])
+            i += 2
+        elif args[i] == '--thread' and i + 1 < len(args):
+            thread = int(args[i + 1])
+            i += 2
+        elif args[i] == '--summary':
+            summary = True
+            i += 1
+        else:
+            sys.exit(f"Unknown argument: {args[i]}")
+
+    info, names, events = load(path)
+    if thread is not None:
+        events = [e for e in events if e[2] == thread]
+
+    print(f"pid {info['pid']}, {info['threads']} thread(s), {len(events)} event(s)")
+    if info['threads'] > info['max_threads']:
+        print(f"  {info['threads'] - info['max_threads']} thread(s) had no ring (events dropped)")
+    for tid, lost in sorted(info['wrapped'].items()):
+        print(f"  T{tid}: {lost} older event(s) overwritten")
+    if info['abort_tid']:
+        print(f"  SIGABRT on T{info['abort_tid']} at call sequence {info['abort_seq']}")
+
+    if summary:
+        per_thread = Counter(e[2] for e in events)
+        per_name = Counter(names.get(e[3], f"#{e[3]}") for e in events)
+        print("\nEvents per thread:")
+        for tid, n in per_thread.most_common():
+            print(f"  T{tid:<8} {n}")
+        print("\nEvents per name:")
+        for name, n in per_name.most_common():
+            print(f"  {name:<48} {n}")
+        return
+
+    if tail is not None:
+        events = events[-tail:]
+    print()
+    for seq, ts, tid, name_id, flags, arg in events:
+        rel_ms = (ts - info['start_ns']) / 1e6
+        name = names.get(name_id, f"#{name_id}")
+        mark = "  <-- SIGABRT" if flags & TRACE_FLAG_ABORT else ""
+        if arg >= 0x80000000:
+            arg -= 0x100000000   # VkResult codes are negative
+        print(f"{rel_ms:12.3f}ms  [{seq:>8}] T{tid:<8} {name} {arg}{mark}")
+
+
+if __name__ == '__main__':
+    main()